@@ -778,6 +778,11 @@
 /** A field contained an transformation that should only be used when loading
  * old states. */
 #define VERR_SSM_FIELD_LOAD_ONLY_TRANSFORMATION (-1879)
+/** The base file of an incremental saved state has been modified or
+ * replaced since the incremental one was saved. */
+#define VERR_SSM_BASE_MISMATCH                  (-1880)
+/** Too many incremental saved states on top of each other. */
+#define VERR_SSM_BASE_TOO_DEEP                  (-1881)
 /** @} */
 
 
@@ -135,8 +135,10 @@ typedef struct INTNETBUF
     STAMCOUNTER     cStatLost;
     /** Number of bad frames (both rings). */
     STAMCOUNTER     cStatBadFrames;
-    /** Reserved for future use. */
-    STAMCOUNTER     aStatReserved[2];
+    /** Number of bursts taken off the send ring by IntNetR0IfSend. */
+    STAMCOUNTER     cStatSendBursts;
+    /** Number of frames in those bursts. */
+    STAMCOUNTER     cStatSendBurstFrames;
     /** Reserved for future send profiling. */
     STAMPROFILE     StatSend1;
     /** Reserved for future send profiling. */
@@ -705,6 +705,8 @@ typedef enum LOGGROUP
     LOG_GROUP_VBGL,
     /** Generic virtual disk layer. */
     LOG_GROUP_VD,
+    /** Dedup virtual disk backend. */
+    LOG_GROUP_VD_DEDUP,
     /** DMG virtual disk backend. */
     LOG_GROUP_VD_DMG,
     /** iSCSI virtual disk backend. */
@@ -1081,6 +1083,7 @@ typedef enum LOGGROUP
     "VBGD",         \
     "VBGL",         \
     "VD",           \
+    "VD_DEDUP",     \
     "VD_DMG",       \
     "VD_ISCSI",     \
     "VD_PARALLELS", \
@@ -582,6 +582,27 @@ typedef struct VBOXHDDBACKEND
                                                     PVDINTERFACE pVDIfsImage,
                                                     PVDINTERFACE pVDIfsOperation));
 
+    /**
+     * Queries the allocation state of the given offset and how many bytes
+     * following it share the same state. The pointer may be NULL, indicating
+     * that every block of the image is considered allocated.
+     *
+     * Backends may report ranges as allocated which are not (e.g. when the
+     * state is only known at a coarser granularity) but must never report
+     * allocated data as unallocated.
+     *
+     * @returns VBox status code.
+     * @param   pBackendData    Opaque state data for this image.
+     * @param   uOffset         Offset to start the query at.
+     * @param   cbRange         Maximum number of bytes to check.
+     * @param   pcbRange        Where to store the number of bytes starting at
+     *                          uOffset sharing the same state, at most cbRange.
+     * @param   pfAllocated     Where to store whether the range is allocated.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnQueryAllocation, (void *pBackendData, uint64_t uOffset,
+                                                   uint64_t cbRange, uint64_t *pcbRange,
+                                                   bool *pfAllocated));
+
 } VBOXHDDBACKEND;
 
 /** Pointer to VD backend. */
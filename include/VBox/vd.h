@@ -192,7 +192,9 @@ typedef struct VBOXHDDRAW
 /** Open image in read-only mode with sharing access with others. */
 #define VD_OPEN_FLAGS_READONLY      RT_BIT(0)
 /** Honor zero block writes instead of ignoring them whenever possible.
- * This is not supported by all formats. It is silently ignored in this case. */
+ * Without this flag zero writes to blocks which are unallocated in the whole
+ * image chain are dropped generically for all dynamic image formats, some
+ * formats (VDI) additionally keep track of explicit zero blocks. */
 #define VD_OPEN_FLAGS_HONOR_ZEROES  RT_BIT(1)
 /** Honor writes of the same data instead of ignoring whenever possible.
  * This is handled generically, and is only meaningful for differential image
@@ -726,6 +728,11 @@ VBOXDDU_DECL(int) VDMerge(PVBOXHDD pDisk, unsigned nImageFrom,
  *          have the same content it is enough to check the diff image for changed data
  *          and copy it to the destination diff image which is achieved with
  *          nImageSameFrom and nImageSameTo. Setting both to 0 can suppress a lot of I/O.
+ *
+ * @note The data is copied in a pipelined fashion, reading ahead from the source
+ *       while the destination is written. The number of chunks in flight can be
+ *       set with the "CopyPipelineDepth" key of a config interface in
+ *       pVDIfsOperation, a value of 1 disables the pipeline.
  */
 VBOXDDU_DECL(int) VDCopyEx(PVBOXHDD pDiskFrom, unsigned nImage, PVBOXHDD pDiskTo,
                            const char *pszBackend, const char *pszFilename,
@@ -58,6 +58,9 @@ RT_C_DECLS_BEGIN
 /** The special value for the final pass.  */
 #define SSM_PASS_FINAL                          UINT32_MAX
 
+/** The max number of base files in a chain of incremental saved states. */
+#define SSM_MAX_BASE_DEPTH                      16
+
 
 #ifdef IN_RING3
 /** @defgroup grp_ssm_r3     The SSM Host Context Ring-3 API
@@ -1058,6 +1061,8 @@ typedef struct SSMSTRMOPS
 {
     /** Struct magic + version (SSMSTRMOPS_VERSION). */
     uint32_t    u32Version;
+    /** SSMSTRMOPS_FLAGS_XXX. */
+    uint32_t    fFlags;
 
     /**
      * Write bytes to the stream.
@@ -1140,7 +1145,14 @@ typedef struct SSMSTRMOPS
     uint32_t    u32EndVersion;
 } SSMSTRMOPS;
 /** Struct magic + version (SSMSTRMOPS_VERSION). */
-#define SSMSTRMOPS_VERSION      UINT32_C(0x55aa0001)
+#define SSMSTRMOPS_VERSION      UINT32_C(0x55aa0002)
+
+/** @name SSMSTRMOPS::fFlags
+ * @{ */
+/** The stream compresses the data itself, so SSM stores the data raw instead
+ * of LZF compressing it. */
+#define SSMSTRMOPS_FLAGS_NO_COMPRESSION     RT_BIT_32(0)
+/** @} */
 
 
 VMMR3_INT_DECL(void)    SSMR3Term(PVM pVM);
@@ -1176,9 +1188,10 @@ VMMR3_INT_DECL(int)     SSMR3DeregisterDriver(PVM pVM, PPDMDRVINS pDrvIns, const
 VMMR3_INT_DECL(int)     SSMR3DeregisterUsb(PVM pVM, PPDMUSBINS pUsbIns, const char *pszName, uint32_t uInstance);
 VMMR3DECL(int)          SSMR3DeregisterInternal(PVM pVM, const char *pszName);
 VMMR3DECL(int)          SSMR3DeregisterExternal(PVM pVM, const char *pszName);
-VMMR3DECL(int)          SSMR3Save(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser, SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvUser);
+VMMR3DECL(int)          SSMR3Save(PVM pVM, const char *pszFilename, const char *pszBaseFilename, PCSSMSTRMOPS pStreamOps,
+                                  void *pvStreamOpsUser, SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvUser);
 VMMR3_INT_DECL(int)     SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
-                                      const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOps,
+                                      const char *pszFilename, const char *pszBaseFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOps,
                                       SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvProgressUser,
                                       PSSMHANDLE *ppSSM);
 VMMR3_INT_DECL(int)     SSMR3LiveDoStep1(PSSMHANDLE pSSM);
@@ -1189,11 +1202,13 @@ VMMR3DECL(int)          SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
 VMMR3DECL(int)          SSMR3ValidateFile(const char *pszFilename, bool fChecksumIt);
 VMMR3DECL(int)          SSMR3Open(const char *pszFilename, unsigned fFlags, PSSMHANDLE *ppSSM);
 VMMR3DECL(int)          SSMR3Close(PSSMHANDLE pSSM);
+VMMR3DECL(int)          SSMR3Flatten(const char *pszFilename, const char *pszOutFilename);
 VMMR3DECL(int)          SSMR3Seek(PSSMHANDLE pSSM, const char *pszUnit, uint32_t iInstance, uint32_t *piVersion);
 VMMR3DECL(int)          SSMR3HandleGetStatus(PSSMHANDLE pSSM);
 VMMR3DECL(int)          SSMR3HandleSetStatus(PSSMHANDLE pSSM, int iStatus);
 VMMR3DECL(SSMAFTER)     SSMR3HandleGetAfter(PSSMHANDLE pSSM);
 VMMR3DECL(bool)         SSMR3HandleIsLiveSave(PSSMHANDLE pSSM);
+VMMR3DECL(const char *) SSMR3HandleBaseFilename(PSSMHANDLE pSSM);
 VMMR3DECL(uint32_t)     SSMR3HandleMaxDowntime(PSSMHANDLE pSSM);
 VMMR3DECL(uint32_t)     SSMR3HandleHostBits(PSSMHANDLE pSSM);
 VMMR3DECL(uint32_t)     SSMR3HandleRevision(PSSMHANDLE pSSM);
@@ -1203,6 +1218,12 @@ VMMR3_INT_DECL(int)     SSMR3HandleSetGCPtrSize(PSSMHANDLE pSSM, unsigned cbGCPt
 VMMR3DECL(void)         SSMR3HandleReportLivePercent(PSSMHANDLE pSSM, unsigned uPercent);
 VMMR3DECL(int)          SSMR3Cancel(PUVM pUVM);
 
+/** Pointer to a deferred page reader (opaque). */
+typedef struct SSMPAGEREADER *PSSMPAGEREADER;
+VMMR3DECL(int)          SSMR3PageReaderOpen(PSSMHANDLE pSSM, PSSMPAGEREADER *ppReader);
+VMMR3DECL(int)          SSMR3PageReaderRead(PSSMPAGEREADER pReader, uint64_t offPage, void *pvPage);
+VMMR3DECL(void)         SSMR3PageReaderClose(PSSMPAGEREADER pReader);
+
 
 /** Save operations.
  * @{
@@ -1272,6 +1293,7 @@ VMMR3DECL(int) SSMR3GetStrZEx(PSSMHANDLE pSSM, char *psz, size_t cbMax, size_t *
 VMMR3DECL(int) SSMR3GetTimer(PSSMHANDLE pSSM, PTMTIMER pTimer);
 VMMR3DECL(int) SSMR3Skip(PSSMHANDLE pSSM, size_t cb);
 VMMR3DECL(int) SSMR3SkipToEndOfUnit(PSSMHANDLE pSSM);
+VMMR3DECL(int) SSMR3SkipPageDeferred(PSSMHANDLE pSSM, uint64_t *poffPage, bool *pfZero);
 VMMR3DECL(int) SSMR3SetLoadError(PSSMHANDLE pSSM, int rc, RT_SRC_POS_DECL, const char *pszFormat, ...);
 VMMR3DECL(int) SSMR3SetLoadErrorV(PSSMHANDLE pSSM, int rc, RT_SRC_POS_DECL, const char *pszFormat, va_list va);
 VMMR3DECL(int) SSMR3SetCfgError(PSSMHANDLE pSSM, RT_SRC_POS_DECL, const char *pszFormat, ...);
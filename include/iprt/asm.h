@@ -3493,6 +3493,81 @@ DECLINLINE(bool) ASMMemIsZeroPage(void const *pvPage)
 }
 
 
+/**
+ * Finds the first non-zero byte in a memory block.
+ *
+ * Unlike ASMMemIsAll8 there are no size or alignment restrictions.  On AMD64
+ * the bulk of the block is scanned 64 bytes at a time using SSE2 in ring-3
+ * (ring-0 code must not touch the SSE registers), elsewhere it falls back on
+ * unrolled native word compares.
+ *
+ * @returns Pointer to the first non-zero byte.
+ * @returns NULL if the whole block is zero.
+ *
+ * @param   pv      Pointer to the memory block.
+ * @param   cb      Number of bytes in the block.
+ */
+DECLINLINE(void *) ASMMemFirstNonZero(void const *pv, size_t cb)
+{
+    uint8_t const   *pb = (uint8_t const *)pv;
+    uintptr_t const *pu;
+
+    /* Head: byte by byte up to the next 16 byte boundary. */
+    for (; cb && ((uintptr_t)pb & 15); cb--, pb++)
+        if (*pb)
+            return (void *)pb;
+
+# if defined(RT_ARCH_AMD64) && defined(IN_RING3) && RT_INLINE_ASM_GNU_STYLE
+    while (cb >= 64)
+    {
+        uint32_t fEqMask;
+        __asm__ __volatile__("movdqa    (%1), %%xmm0\n\t"
+                             "por     16(%1), %%xmm0\n\t"
+                             "por     32(%1), %%xmm0\n\t"
+                             "por     48(%1), %%xmm0\n\t"
+                             "pxor    %%xmm1, %%xmm1\n\t"
+                             "pcmpeqb %%xmm1, %%xmm0\n\t"
+                             "pmovmskb %%xmm0, %0\n\t"
+                             : "=r" (fEqMask)
+                             : "r" (pb)
+                             : "xmm0", "xmm1", "memory");
+        if (fEqMask != 0xffff)
+            break; /* The word loop below pinpoints the byte. */
+        pb += 64;
+        cb -= 64;
+    }
+# endif
+
+    /* Body: four native words at a time. */
+    pu = (uintptr_t const *)pb;
+    for (; cb >= 4 * sizeof(uintptr_t); cb -= 4 * sizeof(uintptr_t), pu += 4)
+        if (pu[0] | pu[1] | pu[2] | pu[3])
+            break;
+
+    /* Tail (or the group containing the first non-zero byte). */
+    for (pb = (uint8_t const *)pu; cb; cb--, pb++)
+        if (*pb)
+            return (void *)pb;
+    return NULL;
+}
+
+
+/**
+ * Checks if a memory block is all zeros.
+ *
+ * @returns true if zero, false if not.
+ *
+ * @param   pv      Pointer to the memory block.
+ * @param   cb      Number of bytes in the block.
+ *
+ * @sa      ASMMemFirstNonZero
+ */
+DECLINLINE(bool) ASMMemIsZero(void const *pv, size_t cb)
+{
+    return ASMMemFirstNonZero(pv, cb) == NULL;
+}
+
+
 /**
  * Checks if a memory block is filled with the specified byte.
  *
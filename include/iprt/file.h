@@ -1211,7 +1211,9 @@ RTDECL(void) RTFileReadAllFree(void *pvFile, size_t cbFile);
  * for this file will only arrive at that context after they completed and not on
  * the context the request was submitted.
  * To associate a file with a specific context RTFileAioCtxAssociateWithFile() is
- * used. It is only implemented on Windows and does nothing on the other platforms.
+ * used. It is required on Windows, Linux uses it to register the file with an
+ * io_uring based context which makes submitting requests cheaper, and it does
+ * nothing on the other platforms.
  * If the file needs to be associated with different context for some reason
  * the file must be closed first. After it was opened again the new context
  * can be associated with the other context.
@@ -1412,6 +1414,24 @@ RTDECL(uint32_t) RTFileAioCtxGetMaxReqCount(RTFILEAIOCTX hAioCtx);
  */
 RTDECL(int) RTFileAioCtxAssociateWithFile(RTFILEAIOCTX hAioCtx, RTFILE hFile);
 
+/**
+ * Releases the resources an async I/O context keeps for an associated file.
+ *
+ * Must be called before closing a file which was associated with the context
+ * if the context outlives the file. There must be no requests for the file
+ * in flight.
+ *
+ * @returns IPRT status code.
+ *
+ * @param   hAioCtx        The async I/O context handle.
+ * @param   hFile          The file handle.
+ *
+ * @remarks Windows can't detach a file from its completion port, the file has
+ *          to be closed and reopened before it can be associated with another
+ *          context there.
+ */
+RTDECL(int) RTFileAioCtxDisassociateFromFile(RTFILEAIOCTX hAioCtx, RTFILE hFile);
+
 /**
  * Submits a set of requests to an async I/O context for processing.
  *
@@ -539,6 +539,7 @@
 # define RTFileAioCtxAssociateWithFile                  RT_MANGLER(RTFileAioCtxAssociateWithFile)
 # define RTFileAioCtxCreate                             RT_MANGLER(RTFileAioCtxCreate)
 # define RTFileAioCtxDestroy                            RT_MANGLER(RTFileAioCtxDestroy)
+# define RTFileAioCtxDisassociateFromFile               RT_MANGLER(RTFileAioCtxDisassociateFromFile)
 # define RTFileAioCtxGetMaxReqCount                     RT_MANGLER(RTFileAioCtxGetMaxReqCount)
 # define RTFileAioCtxSubmit                             RT_MANGLER(RTFileAioCtxSubmit)
 # define RTFileAioCtxWait                               RT_MANGLER(RTFileAioCtxWait)
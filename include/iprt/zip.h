@@ -85,6 +85,10 @@ typedef enum RTZIPTYPE
     RTZIPTYPE_LZJB,
     /** Lempel-Ziv-Oberhumer compression. */
     RTZIPTYPE_LZO,
+    /** LZ4 compression (frame format when streaming). */
+    RTZIPTYPE_LZ4,
+    /** Zstandard compression. */
+    RTZIPTYPE_ZSTD,
     /** End of valid the valid compression types.  */
     RTZIPTYPE_END
 } RTZIPTYPE;
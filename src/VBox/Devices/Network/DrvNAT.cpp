@@ -307,6 +307,66 @@ static DECLCALLBACK(void) drvNATUrgRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, in
 }
 
 
+/**
+ * Delivers a large TCP segment from the NAT engine to the guest.
+ *
+ * The segment is handed up as a GSO frame if the device takes it, otherwise
+ * it is segmented here, which is still cheaper than having the NAT engine's
+ * TCP produce MSS sized segments.
+ *
+ * @returns VBox status code.
+ * @param   pThis               Pointer to the NAT instance.
+ * @param   pu8Buf              The Ethernet frame, trashed.
+ * @param   cb                  The frame size.
+ * @param   cbMss               The segment size to use.
+ * @thread  Recv, owning DevAccessLock after pfnWaitReceiveAvail succeeded.
+ */
+static int drvNATRecvGso(PDRVNAT pThis, uint8_t *pu8Buf, int cb, uint16_t cbMss)
+{
+    PDMNETWORKGSO Gso;
+    Gso.u8Type      = PDMNETWORKGSOTYPE_IPV4_TCP;
+    Gso.offHdr1     = sizeof(RTNETETHERHDR);
+    Gso.offHdr2     = Gso.offHdr1 + ((PCRTNETIPV4)(pu8Buf + Gso.offHdr1))->ip_hl * 4;
+    Gso.cbHdrsTotal = Gso.offHdr2 + ((PCRTNETTCP)(pu8Buf + Gso.offHdr2))->th_off * 4;
+    Gso.cbHdrsSeg   = Gso.cbHdrsTotal;
+    Gso.cbMaxSeg    = cbMss;
+    if (!PDMNetGsoIsValid(&Gso, sizeof(Gso), cb))
+    {
+        Log(("NAT: invalid GSO context cb=%#x cbHdrsTotal=%#x cbMss=%#x\n", cb, Gso.cbHdrsTotal, cbMss));
+        return VERR_INVALID_PARAMETER;
+    }
+
+    if (pThis->pIAboveNet->pfnReceiveGso)
+    {
+        PDMNetGsoPrepForDirectUse(&Gso, pu8Buf, cb, PDMNETCSUMTYPE_PSEUDO);
+        int rc = pThis->pIAboveNet->pfnReceiveGso(pThis->pIAboveNet, pu8Buf, cb, &Gso);
+        if (RT_SUCCESS(rc))
+        {
+            STAM_COUNTER_INC(&pThis->StatNATRecvGso);
+            return rc;
+        }
+    }
+
+    STAM_COUNTER_INC(&pThis->StatNATRecvGsoSw);
+    uint8_t         abHdrScratch[256];
+    uint32_t const  cSegs = PDMNetGsoCalcSegmentCount(&Gso, cb);
+    for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+    {
+        if (iSeg)
+        {
+            int rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
+            if (RT_FAILURE(rc))
+                return rc; /* we drop the rest. */
+        }
+        uint32_t cbSegFrame;
+        void    *pvSegFrame = PDMNetGsoCarveSegmentQD(&Gso, pu8Buf, cb, abHdrScratch, iSeg, cSegs, &cbSegFrame);
+        int rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvSegFrame, cbSegFrame);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    return VINF_SUCCESS;
+}
+
 static DECLCALLBACK(void) drvNATRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, int cb, struct mbuf *m)
 {
     int rc;
@@ -331,8 +391,23 @@ static DECLCALLBACK(void) drvNATRecvWorker(PDRVNAT pThis, uint8_t *pu8Buf, int c
 
     if (RT_SUCCESS(rc))
     {
-        rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pu8Buf, cb);
-        AssertRC(rc);
+        uint16_t const cbMss = slirp_ext_m_tso_segsz(m);
+        if (!cbMss)
+        {
+            rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pu8Buf, cb);
+            AssertRC(rc);
+        }
+        else
+        {
+            /* Can fail if the wait for room between segments is interrupted
+               or if the segment doesn't make a valid GSO frame, drop it then. */
+            rc = drvNATRecvGso(pThis, pu8Buf, cb, cbMss);
+            if (RT_FAILURE(rc))
+            {
+                Log(("NAT: dropping large segment cb=%#x: %Rrc\n", cb, rc));
+                STAM_COUNTER_INC(&pThis->StatNATRecvGsoDropped);
+            }
+        }
     }
     else if (   rc != VERR_TIMEOUT
              && rc != VERR_INTERRUPTED)
@@ -403,14 +478,28 @@ static void drvNATSendWorker(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf)
         {
             /*
              * GSO frame, need to segment it.
+             *
+             * The NAT engine's TCP doesn't care about segment sizes, it just
+             * appends the payload to the socket buffer, so TCP/IPv4 frames
+             * are carved into as few segments as fit into an mbuf instead of
+             * guest MSS sized ones.
              */
-            /** @todo Make the NAT engine grok large frames?  Could be more efficient... */
 #if 0 /* this is for testing PDMNetGsoCarveSegmentQD. */
             uint8_t         abHdrScratch[256];
 #endif
             uint8_t const  *pbFrame = (uint8_t const *)pSgBuf->aSegs[0].pvSeg;
-            PCPDMNETWORKGSO pGso    = (PCPDMNETWORKGSO)pSgBuf->pvUser;
-            uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);  Assert(cSegs > 1);
+            PDMNETWORKGSO   GsoLarge = *(PCPDMNETWORKGSO)pSgBuf->pvUser;
+            PCPDMNETWORKGSO pGso    = &GsoLarge;
+            if (GsoLarge.u8Type == PDMNETWORKGSOTYPE_IPV4_TCP)
+            {
+                uint32_t cMssPerSeg = RT_MIN((uint32_t)(DRVNAT_MAXFRAMESIZE - 1 - GsoLarge.cbHdrsTotal) / GsoLarge.cbMaxSeg,
+                                             ((uint32_t)pSgBuf->cbUsed - GsoLarge.cbHdrsTotal) / GsoLarge.cbMaxSeg);
+                if (cMssPerSeg > 1)
+                    GsoLarge.cbMaxSeg = (uint16_t)(GsoLarge.cbMaxSeg * cMssPerSeg);
+            }
+            uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);
+            STAM_COUNTER_INC(&pThis->StatNATSendGso);
+            STAM_COUNTER_ADD(&pThis->StatNATSendGsoSegs, cSegs);
             for (size_t iSeg = 0; iSeg < cSegs; iSeg++)
             {
                 size_t cbSeg;
@@ -1461,6 +1550,7 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
         slirp_set_dhcp_dns_proxy(pThis->pNATState, !!fDNSProxy);
         slirp_set_mtu(pThis->pNATState, MTU);
         slirp_set_somaxconn(pThis->pNATState, i32SoMaxConn);
+        slirp_set_gso(pThis->pNATState, pThis->pIAboveNet->pfnReceiveGso != NULL);
         char *pszBindIP = NULL;
         GET_STRING_ALLOC(rc, pThis, pCfg, "BindIP", pszBindIP);
         rc = slirp_set_binding_address(pThis->pNATState, pszBindIP);
@@ -57,6 +57,17 @@
 # define INTNET_GROW_DSTTAB_SIZE    1
 #endif
 
+/** The minimum number of buckets in the MAC address hash (power of two). */
+#define INTNET_MACTAB_HASH_MIN      16
+
+/** The max number of frames IntNetR0IfSend takes off the send ring at a time
+ * for batched delivery. */
+#define INTNET_SEND_BURST_MAX_FRAMES        32
+/** The max number of frame deliveries queued up by a send burst. */
+#define INTNET_SEND_BURST_MAX_DELIVERIES    64
+/** The max number of destination interfaces a send burst can track. */
+#define INTNET_SEND_BURST_MAX_DSTS          16
+
 /** The wakeup bit in the INTNETIF::cBusy and INTNETRUNKIF::cBusy counters. */
 #define INTNET_BUSY_WAKEUP_MASK     RT_BIT_32(30)
 
@@ -80,6 +91,9 @@ typedef struct INTNETMACTABENTRY
      * to this interface onto the trunk.  The reasoning for this is that this could
      * be the interface of a VM that just has been teleported to a different host. */
     bool                    fActive;
+    /** Index of the next entry in the same MAC address hash bucket,
+     * UINT32_MAX if last.  See INTNETMACTAB::paiHashHeads. */
+    uint32_t                iHashNext;
     /** Pointer to the network interface. */
     struct INTNETIF        *pIf;
 } INTNETMACTABENTRY;
@@ -101,6 +115,19 @@ typedef struct INTNETMACTAB
     /** Table entries. */
     PINTNETMACTABENTRY      paEntries;
 
+    /** MAC address hash, index of the highest entry in each bucket (UINT32_MAX
+     * if empty).  Entries of a bucket are chained in descending index order,
+     * i.e. the order the linear scans use.  Rebuilt by intnetR0MacTabRehash
+     * whenever entries are added, removed or change their address. */
+    uint32_t               *paiHashHeads;
+    /** The number of hash buckets, a power of two not smaller than
+     * cEntriesAllocated. */
+    uint32_t                cHashBuckets;
+    /** The number of entries with a dummy MAC address.  These, like
+     * promiscuous entries, match any destination so the hash can only be
+     * used for unicast switching when there are none. */
+    uint32_t                cDummyMacEntries;
+
     /** The number of interface entries currently in promicuous mode. */
     uint32_t                cPromiscuousEntries;
     /** The number of interface entries currently in promicuous mode that
@@ -158,6 +185,49 @@ typedef INTNETDSTTAB *PINTNETDSTTAB;
 typedef INTNETDSTTAB const *PCINTNETDSTTAB;
 
 
+/**
+ * Frames taken off an interface's send ring and queued up for delivery.
+ *
+ * Deliveries to other interfaces are collected per destination so that each
+ * destination gets all its frames written under a single acquisition of its
+ * receive lock and is woken up once per burst instead of once per frame.  The
+ * frames stay in the send ring until the burst has been flushed.
+ */
+typedef struct INTNETSENDBURST
+{
+    /** The number of frames in aSgs. */
+    uint32_t                cFrames;
+    /** The number of queued deliveries. */
+    uint32_t                cDeliveries;
+    /** The number of destination interfaces. */
+    uint32_t                cDsts;
+    /** The frames (pointing into the send ring). */
+    INTNETSG                aSgs[INTNET_SEND_BURST_MAX_FRAMES];
+    /** The queued deliveries, chained up per destination. */
+    struct
+    {
+        /** The frame (index into aSgs). */
+        uint8_t             iSg;
+        /** Whether to replace the destination MAC address. */
+        bool                fReplaceDstMac;
+        /** The next delivery to the same destination, UINT8_MAX if last. */
+        uint8_t             iNext;
+    }                       aDeliveries[INTNET_SEND_BURST_MAX_DELIVERIES];
+    /** The destination interfaces. */
+    struct
+    {
+        /** The destination interface (referenced). */
+        struct INTNETIF    *pIf;
+        /** The first delivery to this destination. */
+        uint8_t             iFirst;
+        /** The last delivery to this destination. */
+        uint8_t             iLast;
+    }                       aDsts[INTNET_SEND_BURST_MAX_DSTS];
+} INTNETSENDBURST;
+/** Pointer to a send burst. */
+typedef INTNETSENDBURST *PINTNETSENDBURST;
+
+
 /** Network layer address type. */
 typedef enum INTNETADDRTYPE
 {
@@ -284,6 +354,9 @@ typedef struct INTNETIF
     void                   *pvIfData;
     /** Header buffer for when we're carving GSO frames. */
     uint8_t                 abGsoHdrs[256];
+    /** The frames being delivered by IntNetR0IfSend.
+     * This is serialized the same way as pDstTab. */
+    INTNETSENDBURST         SendBurst;
 } INTNETIF;
 /** Pointer to an internal network interface. */
 typedef INTNETIF *PINTNETIF;
@@ -1438,6 +1511,63 @@ DECL_FORCE_INLINE(bool) intnetR0AreMacAddrsEqual(PCRTMAC pDstAddr1, PCRTMAC pDst
 }
 
 
+/**
+ * Calculates the number of MAC address hash buckets for a table.
+ *
+ * @returns Number of buckets, a power of two.
+ * @param   cEntriesAllocated   The number of table entries allocated.
+ */
+DECLINLINE(uint32_t) intnetR0MacTabCalcHashBuckets(uint32_t cEntriesAllocated)
+{
+    uint32_t cBuckets = INTNET_MACTAB_HASH_MIN;
+    while (cBuckets < cEntriesAllocated)
+        cBuckets *= 2;
+    return cBuckets;
+}
+
+
+/**
+ * Hashes a MAC address.
+ *
+ * @returns The hash bucket index.
+ * @param   pTab                The MAC address table.
+ * @param   pMacAddr            The address to hash.
+ */
+DECL_FORCE_INLINE(uint32_t) intnetR0MacTabHash(PINTNETMACTAB pTab, PCRTMAC pMacAddr)
+{
+    /* The vendor part is usually the same for all interfaces, so put the
+       lower bits to work and let the multiplication spread them. */
+    uint32_t u32 = ((uint32_t)pMacAddr->au16[2] << 16 | pMacAddr->au16[1]) ^ pMacAddr->au16[0];
+    return (u32 * UINT32_C(0x9e3779b1)) >> 16 & (pTab->cHashBuckets - 1);
+}
+
+
+/**
+ * Rebuilds the MAC address hash of the table.
+ *
+ * The caller must own the network spinlock (or otherwise have exclusive
+ * access to the table).
+ *
+ * @param   pTab                The MAC address table.
+ */
+static void intnetR0MacTabRehash(PINTNETMACTAB pTab)
+{
+    uint32_t i = pTab->cHashBuckets;
+    while (i-- > 0)
+        pTab->paiHashHeads[i] = UINT32_MAX;
+
+    uint32_t cDummyMacEntries = 0;
+    for (i = 0; i < pTab->cEntries; i++)
+    {
+        uint32_t const iBucket = intnetR0MacTabHash(pTab, &pTab->paEntries[i].MacAddr);
+        pTab->paEntries[i].iHashNext = pTab->paiHashHeads[iBucket];
+        pTab->paiHashHeads[iBucket]  = i;
+        cDummyMacEntries += intnetR0IsMacAddrDummy(&pTab->paEntries[i].MacAddr);
+    }
+    pTab->cDummyMacEntries = cDummyMacEntries;
+}
+
+
 /**
  * Switch a unicast frame based on the network layer address (OSI level 3) and
  * return a destination table.
@@ -1570,6 +1700,37 @@ static INTNETSWDECISION intnetR0NetworkPreSwitchUnicast(PINTNETNETWORK pNetwork,
     PINTNETMACTAB       pTab            = &pNetwork->MacTab;
     RTSpinlockAcquire(pNetwork->hAddrSpinlock);
 
+    if (   !pTab->cPromiscuousEntries
+        && !pTab->cDummyMacEntries)
+    {
+        /* Only exact source and destination matches count, look them up in
+           the hash.  The highest active entry wins, like in the scan below. */
+        uint32_t iIfDst = pTab->paiHashHeads[intnetR0MacTabHash(pTab, pDstAddr)];
+        while (   iIfDst != UINT32_MAX
+               && (   !pTab->paEntries[iIfDst].fActive
+                   || !intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfDst].MacAddr, pDstAddr)))
+            iIfDst = pTab->paEntries[iIfDst].iHashNext;
+        if (iIfDst != UINT32_MAX)
+        {
+            uint32_t iIfSrc = UINT32_MAX;
+            if (pSrcAddr)
+            {
+                iIfSrc = pTab->paiHashHeads[intnetR0MacTabHash(pTab, pSrcAddr)];
+                while (   iIfSrc != UINT32_MAX
+                       && (   !pTab->paEntries[iIfSrc].fActive
+                           || !intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfSrc].MacAddr, pSrcAddr)))
+                    iIfSrc = pTab->paEntries[iIfSrc].iHashNext;
+            }
+            if (iIfSrc == UINT32_MAX || iIfSrc < iIfDst)
+                enmSwDecision = pTab->fHostPromiscuousEff && fSrc == INTNETTRUNKDIR_WIRE
+                              ? INTNETSWDECISION_BROADCAST
+                              : INTNETSWDECISION_INTNET;
+        }
+
+        RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock);
+        return enmSwDecision;
+    }
+
     /* Iterate the internal network interfaces and look for matching source and
        destination addresses. */
     uint32_t iIfMac = pTab->cEntries;
@@ -1634,10 +1795,13 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
     pDstTab->pTrunk     = 0;
     pDstTab->cIfs       = 0;
 
-    /* Find exactly matching or promiscuous interfaces. */
-    uint32_t cExactHits = 0;
-    uint32_t iIfMac     = pTab->cEntries;
-    while (iIfMac-- > 0)
+    /* Find exactly matching or promiscuous interfaces.  Without promiscuous
+       or dummy address entries only exact matches qualify, so we can walk
+       the hash bucket instead of the whole table. */
+    uint32_t    cExactHits = 0;
+    bool const  fUseHash   = !pTab->cPromiscuousEntries && !pTab->cDummyMacEntries;
+    uint32_t    iIfMac     = fUseHash ? pTab->paiHashHeads[intnetR0MacTabHash(pTab, pDstAddr)] : pTab->cEntries - 1;
+    for (; iIfMac != UINT32_MAX; iIfMac = fUseHash ? pTab->paEntries[iIfMac].iHashNext : iIfMac - 1)
     {
         if (pTab->paEntries[iIfMac].fActive)
         {
@@ -1990,7 +2154,12 @@ static int intnetR0NetworkEnsureTabSpace(PINTNETNETWORK pNetwork)
             if (RT_SUCCESS(rc))
             {
                 PINTNETMACTABENTRY paNew = (PINTNETMACTABENTRY)RTMemAlloc(sizeof(INTNETMACTABENTRY) * cAllocated);
-                if (paNew)
+                uint32_t const     cHashBuckets = intnetR0MacTabCalcHashBuckets(cAllocated);
+                uint32_t          *paiNewHashHeads = NULL;
+                if (cHashBuckets != pTab->cHashBuckets)
+                    paiNewHashHeads = (uint32_t *)RTMemAlloc(sizeof(uint32_t) * cHashBuckets);
+                if (   paNew
+                    && (paiNewHashHeads || cHashBuckets == pTab->cHashBuckets))
                 {
                     RTSpinlockAcquire(pNetwork->hAddrSpinlock);
 
@@ -2007,12 +2176,26 @@ static int intnetR0NetworkEnsureTabSpace(PINTNETNETWORK pNetwork)
                     pTab->paEntries         = paNew;
                     pTab->cEntriesAllocated = cAllocated;
 
+                    uint32_t *paiOldHashHeads = NULL;
+                    if (paiNewHashHeads)
+                    {
+                        paiOldHashHeads    = pTab->paiHashHeads;
+                        pTab->paiHashHeads = paiNewHashHeads;
+                        pTab->cHashBuckets = cHashBuckets;
+                        intnetR0MacTabRehash(pTab);
+                    }
+
                     RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock);
 
                     RTMemFree(paOld);
+                    RTMemFree(paiOldHashHeads);
                 }
                 else
+                {
+                    RTMemFree(paNew);
+                    RTMemFree(paiNewHashHeads);
                     rc = VERR_NO_MEMORY;
+                }
             }
         }
         else
@@ -2601,6 +2784,26 @@ static int intnetR0RingWriteFrame(PINTNETRINGBUF pRingBuf, PCINTNETSG pSG, PCRTM
 }
 
 
+/**
+ * Gets the frame following @a pHdr in a ring buffer without consuming any.
+ *
+ * @returns Pointer to the next frame header, NULL if @a pHdr is the last
+ *          committed one.
+ * @param   pRingBuf        The ring buffer.
+ * @param   pHdr            The current frame header.
+ */
+DECLINLINE(PINTNETHDR) intnetR0RingGetFrameAfter(PINTNETRINGBUF pRingBuf, PINTNETHDR pHdr)
+{
+    uint32_t offNext = (uint32_t)((uintptr_t)pHdr - (uintptr_t)pRingBuf) + pHdr->offFrame + pHdr->cbFrame;
+    offNext = RT_ALIGN_32(offNext, INTNETHDR_ALIGNMENT);
+    if (offNext >= pRingBuf->offEnd)
+        offNext = pRingBuf->offStart;
+    if (offNext == ASMAtomicUoReadU32(&pRingBuf->offWriteCom))
+        return NULL;
+    return (PINTNETHDR)((uint8_t *)pRingBuf + offNext);
+}
+
+
 /**
  * Sends a frame to a specific interface.
  *
@@ -2661,6 +2864,122 @@ static void intnetR0IfSend(PINTNETIF pIf, PINTNETIF pIfSender, PINTNETSG pSG, PC
 }
 
 
+/**
+ * Delivers the frames queued up by a send burst and releases the
+ * destinations.
+ *
+ * Each destination gets its frames written in order under one acquisition of
+ * its receive lock and is then signalled once.  Frames that don't fit are
+ * handed to intnetR0IfSend, which knows how to deal with overflows.
+ *
+ * @param   pIfSender       The interface sending the frames.
+ * @param   pBurst          The send burst.
+ */
+static void intnetR0IfSendBurstFlush(PINTNETIF pIfSender, PINTNETSENDBURST pBurst)
+{
+    for (uint32_t iDst = 0; iDst < pBurst->cDsts; iDst++)
+    {
+        PINTNETIF   pIf      = pBurst->aDsts[iDst].pIf;
+        bool        fWritten = false;
+        uint8_t     iDelivery = pBurst->aDsts[iDst].iFirst;
+
+        RTSpinlockAcquire(pIf->hRecvInSpinlock);
+        while (iDelivery != UINT8_MAX)
+        {
+            PINTNETSG   pSG        = &pBurst->aSgs[pBurst->aDeliveries[iDelivery].iSg];
+            PCRTMAC     pNewDstMac = pBurst->aDeliveries[iDelivery].fReplaceDstMac ? &pIf->MacAddr : NULL;
+            int rc = intnetR0RingWriteFrame(&pIf->pIntBuf->Recv, pSG, pNewDstMac);
+            if (RT_SUCCESS(rc))
+                fWritten = true;
+            else
+            {
+                RTSpinlockReleaseNoInts(pIf->hRecvInSpinlock);
+                intnetR0IfSend(pIf, pIfSender, pSG, pNewDstMac);
+                fWritten = false; /* intnetR0IfSend signalled it. */
+                RTSpinlockAcquire(pIf->hRecvInSpinlock);
+            }
+            iDelivery = pBurst->aDeliveries[iDelivery].iNext;
+        }
+        RTSpinlockReleaseNoInts(pIf->hRecvInSpinlock);
+
+        if (fWritten)
+        {
+            pIf->cYields = 0;
+            RTSemEventSignal(pIf->hRecvEvent);
+        }
+        intnetR0BusyDecIf(pIf);
+        pBurst->aDsts[iDst].pIf = NULL;
+    }
+    pBurst->cDsts       = 0;
+    pBurst->cDeliveries = 0;
+}
+
+
+/**
+ * Queues up the interface deliveries of a frame in a send burst.
+ *
+ * The destination references are transferred from the destination table to
+ * the burst.  Frames that also go to the trunk are not queued as the trunk may
+ * have to modify them and expects the interfaces to have seen them first.
+ *
+ * @returns true if queued, false if the caller must deliver it directly
+ *          (after flushing the burst).
+ * @param   pIfSender       The interface sending the frame.
+ * @param   pBurst          The send burst.  @a pSG must be one of its frames.
+ * @param   pDstTab         The destination table.
+ * @param   pSG             The frame.
+ */
+static bool intnetR0IfSendBurstQueue(PINTNETIF pIfSender, PINTNETSENDBURST pBurst, PINTNETDSTTAB pDstTab, PINTNETSG pSG)
+{
+    if (pDstTab->fTrunkDst)
+        return false;
+    uint32_t const cIfs = pDstTab->cIfs;
+    if (RT_UNLIKELY(   cIfs > INTNET_SEND_BURST_MAX_DSTS
+                    || cIfs > INTNET_SEND_BURST_MAX_DELIVERIES))
+        return false;
+    if (   pBurst->cDeliveries + cIfs > INTNET_SEND_BURST_MAX_DELIVERIES
+        || pBurst->cDsts + cIfs > INTNET_SEND_BURST_MAX_DSTS)
+        intnetR0IfSendBurstFlush(pIfSender, pBurst);
+
+    uint8_t const iSg = (uint8_t)(pSG - &pBurst->aSgs[0]);
+    Assert(iSg < pBurst->cFrames);
+
+    uint32_t iIf = cIfs;
+    while (iIf-- > 0)
+    {
+        PINTNETIF pIf = pDstTab->aIfs[iIf].pIf;
+
+        /* Queue the delivery. */
+        uint8_t const iDelivery = (uint8_t)pBurst->cDeliveries++;
+        pBurst->aDeliveries[iDelivery].iSg            = iSg;
+        pBurst->aDeliveries[iDelivery].fReplaceDstMac = pDstTab->aIfs[iIf].fReplaceDstMac;
+        pBurst->aDeliveries[iDelivery].iNext          = UINT8_MAX;
+
+        /* Chain it onto the destination, keeping only one reference per destination. */
+        uint32_t iDst = pBurst->cDsts;
+        while (iDst-- > 0)
+            if (pBurst->aDsts[iDst].pIf == pIf)
+                break;
+        if (iDst != UINT32_MAX)
+        {
+            pBurst->aDeliveries[pBurst->aDsts[iDst].iLast].iNext = iDelivery;
+            pBurst->aDsts[iDst].iLast = iDelivery;
+            intnetR0BusyDecIf(pIf);
+        }
+        else
+        {
+            iDst = pBurst->cDsts++;
+            pBurst->aDsts[iDst].pIf    = pIf;
+            pBurst->aDsts[iDst].iFirst = iDelivery;
+            pBurst->aDsts[iDst].iLast  = iDelivery;
+        }
+        pDstTab->aIfs[iIf].pIf = NULL;
+    }
+    pDstTab->cIfs = 0;
+    return true;
+}
+
+
 /**
  * Fallback path that does the GSO segmenting before passing the frame on to the
  * trunk interface.
@@ -3541,9 +3860,23 @@ static void intnetR0NetworkReleaseDstTab(PINTNETNETWORK pNetwork, PINTNETDSTTAB
  * @param   pSG                 The frame to send.
  * @param   pIfSender           The sender interface.  NULL if it originated via
  *                              the trunk.
+ * @param   pBurst              The send burst to queue interface deliveries in,
+ *                              NULL for immediate delivery.
  */
-static void intnetR0NetworkDeliver(PINTNETNETWORK pNetwork, PINTNETDSTTAB pDstTab, PINTNETSG pSG, PINTNETIF pIfSender)
+static void intnetR0NetworkDeliver(PINTNETNETWORK pNetwork, PINTNETDSTTAB pDstTab, PINTNETSG pSG, PINTNETIF pIfSender,
+                                   PINTNETSENDBURST pBurst)
 {
+    /*
+     * Batch it up if we can, otherwise make sure earlier frames are delivered
+     * before this one.
+     */
+    if (pBurst)
+    {
+        if (intnetR0IfSendBurstQueue(pIfSender, pBurst, pDstTab, pSG))
+            return;
+        intnetR0IfSendBurstFlush(pIfSender, pBurst);
+    }
+
     /*
      * Do the interfaces first before sending it to the wire and risk having to
      * modify it.
@@ -3596,9 +3929,11 @@ static void intnetR0NetworkDeliver(PINTNETNETWORK pNetwork, PINTNETDSTTAB pDstTa
  * @param   fSrc            The source flags. This 0 if it's not from the trunk.
  * @param   pSG             Pointer to the gather list.
  * @param   pDstTab         The destination table to use.
+ * @param   pBurst          The send burst @a pSG belongs to when called by
+ *                          IntNetR0IfSend, otherwise NULL.
  */
 static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF pIfSender, uint32_t fSrc,
-                                            PINTNETSG pSG, PINTNETDSTTAB pDstTab)
+                                            PINTNETSG pSG, PINTNETDSTTAB pDstTab, PINTNETSENDBURST pBurst)
 {
     /*
      * Assert reality.
@@ -3648,7 +3983,10 @@ static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF p
 
         PINTNETMACTABENTRY pIfEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIfSender);
         if (pIfEntry)
+        {
             pIfEntry->MacAddr = EthHdr.SrcMac;
+            intnetR0MacTabRehash(&pNetwork->MacTab);
+        }
         pIfSender->MacAddr    = EthHdr.SrcMac;
 
         RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock);
@@ -3684,7 +4022,7 @@ static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF p
     if (enmSwDecision != INTNETSWDECISION_BAD_CONTEXT)
     {
         if (intnetR0NetworkIsContextOk(pNetwork, pIfSender, pDstTab))
-            intnetR0NetworkDeliver(pNetwork, pDstTab, pSG, pIfSender);
+            intnetR0NetworkDeliver(pNetwork, pDstTab, pSG, pIfSender, pBurst);
         else
         {
             intnetR0NetworkReleaseDstTab(pNetwork, pDstTab);
@@ -3742,59 +4080,82 @@ INTNETR0DECL(int) IntNetR0IfSend(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession)
         if (RT_LIKELY(pDstTab))
         {
             /*
-             * Process the send buffer.
+             * Process the send buffer in bursts, leaving the frames in the ring
+             * until their deliveries have been flushed.
              */
-            INTNETSWDECISION    enmSwDecision = INTNETSWDECISION_BROADCAST;
-            INTNETSG            Sg; /** @todo this will have to be changed if we're going to use async sending
-                                     * with buffer sharing for some OS or service. Darwin copies everything so
-                                     * I won't bother allocating and managing SGs right now. Sorry. */
-            PINTNETHDR          pHdr;
-            while ((pHdr = IntNetRingGetNextFrameToRead(&pIf->pIntBuf->Send)) != NULL)
+            PINTNETSENDBURST    pBurst = &pIf->SendBurst;
+            PINTNETHDR          pHdr   = IntNetRingGetNextFrameToRead(&pIf->pIntBuf->Send);
+            while (pHdr)
             {
-                uint8_t const      u8Type = pHdr->u8Type;
-                if (u8Type == INTNETHDR_TYPE_FRAME)
+                INTNETSWDECISION enmSwDecision = INTNETSWDECISION_BROADCAST;
+                pBurst->cFrames = 0;
+                do
                 {
-                    /* Send regular frame. */
-                    void *pvCurFrame = IntNetHdrGetFramePtr(pHdr, pIf->pIntBuf);
-                    IntNetSgInitTemp(&Sg, pvCurFrame, pHdr->cbFrame);
-                    if (pNetwork->fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
-                        intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, pHdr->cbFrame, false /*fGso*/, (uint16_t *)&Sg.fFlags);
-                    enmSwDecision = intnetR0NetworkSend(pNetwork, pIf,  0 /*fSrc*/, &Sg, pDstTab);
-                }
-                else if (u8Type == INTNETHDR_TYPE_GSO)
-                {
-                    /* Send GSO frame if sane. */
-                    PPDMNETWORKGSO  pGso       = IntNetHdrGetGsoContext(pHdr, pIf->pIntBuf);
-                    uint32_t        cbFrame    = pHdr->cbFrame - sizeof(*pGso);
-                    if (RT_LIKELY(PDMNetGsoIsValid(pGso, pHdr->cbFrame, cbFrame)))
+                    PINTNETSG       pSg    = &pBurst->aSgs[pBurst->cFrames++];
+                    uint8_t const   u8Type = pHdr->u8Type;
+                    if (u8Type == INTNETHDR_TYPE_FRAME)
                     {
-                        void       *pvCurFrame = pGso + 1;
-                        IntNetSgInitTempGso(&Sg, pvCurFrame, cbFrame, pGso);
+                        /* Send regular frame. */
+                        void *pvCurFrame = IntNetHdrGetFramePtr(pHdr, pIf->pIntBuf);
+                        IntNetSgInitTemp(pSg, pvCurFrame, pHdr->cbFrame);
                         if (pNetwork->fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
-                            intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, cbFrame, true /*fGso*/, (uint16_t *)&Sg.fFlags);
-                        enmSwDecision = intnetR0NetworkSend(pNetwork, pIf, 0 /*fSrc*/, &Sg, pDstTab);
+                            intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, pHdr->cbFrame, false /*fGso*/, (uint16_t *)&pSg->fFlags);
+                        enmSwDecision = intnetR0NetworkSend(pNetwork, pIf, 0 /*fSrc*/, pSg, pDstTab, pBurst);
                     }
+                    else if (u8Type == INTNETHDR_TYPE_GSO)
+                    {
+                        /* Send GSO frame if sane. */
+                        PPDMNETWORKGSO  pGso       = IntNetHdrGetGsoContext(pHdr, pIf->pIntBuf);
+                        uint32_t        cbFrame    = pHdr->cbFrame - sizeof(*pGso);
+                        if (RT_LIKELY(PDMNetGsoIsValid(pGso, pHdr->cbFrame, cbFrame)))
+                        {
+                            void       *pvCurFrame = pGso + 1;
+                            IntNetSgInitTempGso(pSg, pvCurFrame, cbFrame, pGso);
+                            if (pNetwork->fFlags & INTNET_OPEN_FLAGS_SHARED_MAC_ON_WIRE)
+                                intnetR0IfSnoopAddr(pIf, (uint8_t *)pvCurFrame, cbFrame, true /*fGso*/, (uint16_t *)&pSg->fFlags);
+                            enmSwDecision = intnetR0NetworkSend(pNetwork, pIf, 0 /*fSrc*/, pSg, pDstTab, pBurst);
+                        }
+                        else
+                        {
+                            STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatBadFrames); /* ignore */
+                            enmSwDecision = INTNETSWDECISION_DROP;
+                        }
+                    }
+                    /* Unless it's a padding frame, we're getting babble from the producer. */
                     else
                     {
-                        STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatBadFrames); /* ignore */
+                        if (u8Type != INTNETHDR_TYPE_PADDING)
+                            STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatBadFrames); /* ignore */
                         enmSwDecision = INTNETSWDECISION_DROP;
                     }
-                }
-                /* Unless it's a padding frame, we're getting babble from the producer. */
-                else
+                    if (enmSwDecision == INTNETSWDECISION_BAD_CONTEXT)
+                    {
+                        /* This one stays in the ring. */
+                        pBurst->cFrames--;
+                        break;
+                    }
+                    pHdr = intnetR0RingGetFrameAfter(&pIf->pIntBuf->Send, pHdr);
+                } while (pHdr && pBurst->cFrames < INTNET_SEND_BURST_MAX_FRAMES);
+
+                /*
+                 * Deliver the burst and skip the frames it was made of.
+                 */
+                intnetR0IfSendBurstFlush(pIf, pBurst);
+                STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatSendBursts);
+                STAM_REL_COUNTER_ADD(&pIf->pIntBuf->cStatSendBurstFrames, pBurst->cFrames);
+                while (pBurst->cFrames > 0)
                 {
-                    if (u8Type != INTNETHDR_TYPE_PADDING)
-                        STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatBadFrames); /* ignore */
-                    enmSwDecision = INTNETSWDECISION_DROP;
+                    IntNetRingSkipFrame(&pIf->pIntBuf->Send);
+                    pBurst->cFrames--;
                 }
+
                 if (enmSwDecision == INTNETSWDECISION_BAD_CONTEXT)
                 {
                     rc = VERR_TRY_AGAIN;
                     break;
                 }
-
-                /* Skip to the next frame. */
-                IntNetRingSkipFrame(&pIf->pIntBuf->Send);
+                if (!pHdr)
+                    pHdr = IntNetRingGetNextFrameToRead(&pIf->pIntBuf->Send);
             }
 
             /*
@@ -4096,7 +4457,10 @@ INTNETR0DECL(int) IntNetR0IfSetMacAddress(INTNETIFHANDLE hIf, PSUPDRVSESSION pSe
             /* Update the two copies. */
             PINTNETMACTABENTRY pEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIf); Assert(pEntry);
             if (RT_LIKELY(pEntry))
+            {
                 pEntry->MacAddr = *pMac;
+                intnetR0MacTabRehash(&pNetwork->MacTab);
+            }
             pIf->MacAddr        = *pMac;
             pIf->fMacSet        = true;
 
@@ -4590,6 +4954,7 @@ static DECLCALLBACK(void) intnetR0IfDestruct(void *pvObj, void *pvUser1, void *p
                             &pNetwork->MacTab.paEntries[iIf + 1],
                             (pNetwork->MacTab.cEntries - iIf - 1) * sizeof(pNetwork->MacTab.paEntries[0]));
                 pNetwork->MacTab.cEntries--;
+                intnetR0MacTabRehash(&pNetwork->MacTab);
                 break;
             }
 
@@ -4826,6 +5191,7 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
                     pNetwork->MacTab.paEntries[iIf].pIf                  = pIf;
 
                     pNetwork->MacTab.cEntries = iIf + 1;
+                    intnetR0MacTabRehash(&pNetwork->MacTab);
                     pIf->pNetwork = pNetwork;
 
                     /*
@@ -5089,7 +5455,7 @@ static DECLCALLBACK(bool) intnetR0TrunkIfPortRecv(PINTNETTRUNKSWPORT pSwitchPort
             /*
              * Finally, get down to business of sending the frame.
              */
-            INTNETSWDECISION enmSwDecision = intnetR0NetworkSend(pNetwork, NULL, fSrc, pSG, pDstTab);
+            INTNETSWDECISION enmSwDecision = intnetR0NetworkSend(pNetwork, NULL, fSrc, pSG, pDstTab, NULL /*pBurst*/);
             AssertMsg(enmSwDecision != INTNETSWDECISION_BAD_CONTEXT, ("fSrc=%#x fTrunkDst=%#x hdr=%.14Rhxs\n", fSrc, pDstTab->fTrunkDst, pSG->aSegs[0].pv));
             if (enmSwDecision == INTNETSWDECISION_INTNET)
                 fRc = true; /* drop it */
@@ -5498,6 +5864,7 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
         {
             pIf->pNetwork = NULL;
             pNetwork->MacTab.cEntries--;
+            intnetR0MacTabRehash(&pNetwork->MacTab);
         }
     }
 
@@ -5540,6 +5907,8 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
     pNetwork->hAddrSpinlock = NIL_RTSPINLOCK;
     RTMemFree(pNetwork->MacTab.paEntries);
     pNetwork->MacTab.paEntries = NULL;
+    RTMemFree(pNetwork->MacTab.paiHashHeads);
+    pNetwork->MacTab.paiHashHeads = NULL;
     RTMemFree(pNetwork);
 
     /* Release the create/destroy sem. */
@@ -5883,6 +6252,9 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
     //pNetwork->MacTab.cPromiscuousEntries  = 0;
     //pNetwork->MacTab.cPromiscuousNoTrunkEntries = 0;
     pNetwork->MacTab.paEntries              = NULL;
+    pNetwork->MacTab.paiHashHeads           = NULL;
+    pNetwork->MacTab.cHashBuckets           = intnetR0MacTabCalcHashBuckets(INTNET_GROW_DSTTAB_SIZE);
+    //pNetwork->MacTab.cDummyMacEntries     = 0;
     pNetwork->MacTab.fHostPromiscuousReal   = false;
     pNetwork->MacTab.fHostPromiscuousEff    = false;
     pNetwork->MacTab.fHostActive            = false;
@@ -5916,9 +6288,13 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
         rc = RTSpinlockCreate(&pNetwork->hAddrSpinlock, RTSPINLOCK_FLAGS_INTERRUPT_SAFE, "hAddrSpinlock");
     if (RT_SUCCESS(rc))
     {
-        pNetwork->MacTab.paEntries = (PINTNETMACTABENTRY)RTMemAlloc(sizeof(INTNETMACTABENTRY) * pNetwork->MacTab.cEntriesAllocated);
-        if (!pNetwork->MacTab.paEntries)
+        pNetwork->MacTab.paEntries    = (PINTNETMACTABENTRY)RTMemAlloc(sizeof(INTNETMACTABENTRY) * pNetwork->MacTab.cEntriesAllocated);
+        pNetwork->MacTab.paiHashHeads = (uint32_t *)RTMemAlloc(sizeof(uint32_t) * pNetwork->MacTab.cHashBuckets);
+        if (   !pNetwork->MacTab.paEntries
+            || !pNetwork->MacTab.paiHashHeads)
             rc = VERR_NO_MEMORY;
+        else
+            intnetR0MacTabRehash(&pNetwork->MacTab);
     }
     if (RT_SUCCESS(rc))
     {
@@ -5967,6 +6343,8 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
     pNetwork->hAddrSpinlock = NIL_RTSPINLOCK;
     RTMemFree(pNetwork->MacTab.paEntries);
     pNetwork->MacTab.paEntries = NULL;
+    RTMemFree(pNetwork->MacTab.paiHashHeads);
+    pNetwork->MacTab.paiHashHeads = NULL;
     RTMemFree(pNetwork);
 
     LogFlow(("intnetR0CreateNetwork: returns %Rrc\n", rc));
@@ -45,8 +45,9 @@
 #define LWIPMutexRelease RTSemMutexRelease
 #endif
 
-/** Maximum number of threads lwIP is allowed to create. */
-#define THREADS_MAX 5
+/** Maximum number of threads lwIP is allowed to create.
+ * The NAT service runs up to 8 poll manager threads besides tcpip. */
+#define THREADS_MAX 12
 
 /** Maximum number of mbox entries needed for reasonable performance. */
 #define MBOX_ENTRIES_MAX 128
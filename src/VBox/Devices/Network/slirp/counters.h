@@ -116,6 +116,11 @@ PROFILE_COUNTER(ALIAS_output, "ALIAS::output");
 DRV_COUNTING_COUNTER(NATRecvWakeups, "counting wakeups of NAT RX thread");
 DRV_PROFILE_COUNTER(NATRecv,"Time spent in NATRecv worker");
 DRV_PROFILE_COUNTER(NATRecvWait,"Time spent in NATRecv worker in waiting of free RX buffers");
+DRV_COUNTING_COUNTER(NATSendGso, "counting GSO frames sent by the guest");
+DRV_COUNTING_COUNTER(NATSendGsoSegs, "counting segments the guest's GSO frames were carved into");
+DRV_COUNTING_COUNTER(NATRecvGso, "counting large segments passed to the guest as GSO frames");
+DRV_COUNTING_COUNTER(NATRecvGsoSw, "counting large segments segmented in software for the guest");
+DRV_COUNTING_COUNTER(NATRecvGsoDropped, "counting large segments dropped on the way to the guest");
 DRV_COUNTING_COUNTER(QueuePktSent, "counting packet sent via PDM Queue");
 DRV_COUNTING_COUNTER(QueuePktDropped, "counting packet drops by PDM Queue");
 DRV_COUNTING_COUNTER(ConsumerFalse, "counting consumer's reject number to process the queue's item");
@@ -829,6 +829,7 @@ GetSocket(struct libalias *la, u_short port_net, struct alias_link *pLnk, int li
             }
             so->so_state = SS_ISFCONNECTING; /* slirp happy??? */
             tcp_attach(la->pData, so);
+            sohashtcp(la->pData, so); /* for solookup() */
             /* tcp_{snd,rcv}space -> pData->tcp_{snd,rcv}space */
             sbreserve(la->pData, &so->so_snd, la->tcp_sndspace);
             sbreserve(la->pData, &so->so_rcv, la->tcp_rcvspace);
@@ -837,6 +838,7 @@ GetSocket(struct libalias *la, u_short port_net, struct alias_link *pLnk, int li
         {
             so->so_type = IPPROTO_UDP;
             insque(la->pData, so, &la->udb);
+            sohashudp(la->pData, so); /* for solookupudp() */
         }
         else
         {
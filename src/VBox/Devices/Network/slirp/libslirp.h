@@ -94,6 +94,7 @@ int  slirp_set_binding_address(PNATState, char *addr);
 void slirp_set_mtu(PNATState, int);
 void slirp_info(PNATState pData, const void *pvArg, const char *pszArgs);
 void slirp_set_somaxconn(PNATState pData, int iSoMaxConn);
+void slirp_set_gso(PNATState pData, bool fGso);
 
 /**
  * This macrodefinition is shortcut for check of hosts where Slirp,
@@ -155,6 +156,7 @@ void slirp_register_external_event(PNATState pData, HANDLE hEvent, int index);
 
 struct mbuf *slirp_ext_m_get(PNATState pData, size_t cbMin, void **ppvBuf, size_t *pcbBuf);
 void slirp_ext_m_free(PNATState pData, struct mbuf *, uint8_t *pu8Buf);
+uint16_t slirp_ext_m_tso_segsz(struct mbuf *);
 
 /*
  * Returns the timeout.
@@ -531,6 +531,17 @@ void slirp_ext_m_free(PNATState pData, struct mbuf *m, uint8_t *pu8Buf)
     LogFlowFuncLeave();
 }
 
+/**
+ * Returns the MSS the frame in @a m has to be segmented with, 0 if it's a
+ * normal frame.
+ */
+uint16_t slirp_ext_m_tso_segsz(struct mbuf *m)
+{
+    if (m->m_pkthdr.csum_flags & CSUM_TSO)
+        return m->m_pkthdr.tso_segsz;
+    return 0;
+}
+
 static void zone_destroy(uma_zone_t zone)
 {
     RTCritSectEnter(&zone->csZone);
@@ -54,6 +54,9 @@
 #ifndef RT_OS_WINDOWS
 # include <sys/ioctl.h>
 # include <poll.h>
+# ifdef HAVE_EPOLL
+#  include <sys/epoll.h>
+# endif
 # include <netinet/in.h>
 #else
 # include <Winnls.h>
@@ -71,7 +74,36 @@
 # include "resolv_conf_parser.h"
 #endif
 
-#ifndef RT_OS_WINDOWS
+#if !defined(RT_OS_WINDOWS) && defined(HAVE_EPOLL)
+/*
+ * With epoll the sockets stay registered in pData->epoll_fd between
+ * iterations, slirp_select_fill only touches the set when a socket wants
+ * events it isn't registered for and slirp_select_poll drops interest which
+ * turns out to be stale. The pollfd array only carries the epoll fd.
+ */
+# define DO_POLL_RESET(so)                                         \
+   do {                                                            \
+       (so)->so_poll_events = 0;                                   \
+       (so)->so_poll_revents = 0;                                  \
+   } while (0)
+
+# define DO_ENGAGE_EVENT1(so, fdset, label)                        \
+    slirp_epoll_engage(pData, (so), N_(fdset ## _poll))
+
+# define DO_ENGAGE_EVENT2(so, fdset1, fdset2, label)               \
+    slirp_epoll_engage(pData, (so), N_(fdset1 ## _poll) | N_(fdset2 ## _poll))
+
+# define DO_POLL_EVENTS(rc, error, so, events, label) do {} while (0)
+
+# define DO_CHECK_FD_SET(so, events, fdset)                        \
+    ((so)->so_poll_revents & N_(fdset ## _poll))
+
+  /* specific for Windows Winsock API */
+# define DO_WIN_CHECK_FD_SET(so, events, fdset) 0
+
+#elif !defined(RT_OS_WINDOWS)
+# define DO_POLL_RESET(so) do { (so)->so_poll_index = -1; } while (0)
+
 # define DO_ENGAGE_EVENT1(so, fdset, label)                        \
    do {                                                            \
        if (   so->so_poll_index != -1                              \
@@ -124,7 +156,9 @@
 
   /* specific for Windows Winsock API */
 # define DO_WIN_CHECK_FD_SET(so, events, fdset) 0
+#endif /* !RT_OS_WINDOWS && !HAVE_EPOLL */
 
+#ifndef RT_OS_WINDOWS
 # ifndef RT_OS_LINUX
 #  define readfds_poll   (POLLRDNORM)
 #  define writefds_poll  (POLLWRNORM)
@@ -339,11 +373,26 @@ int slirp_init(PNATState *ppData, uint32_t u32NetAddr, uint32_t u32Netmask,
     }
     pData->phEvents[VBOX_SOCKET_EVENT_INDEX] = CreateEvent(NULL, FALSE, FALSE, NULL);
 #endif
+#ifdef HAVE_EPOLL
+    pData->epoll_fd = epoll_create(64 /* just a hint */);
+    if (pData->epoll_fd < 0)
+    {
+        rc = RTErrConvertFromErrno(errno);
+        LogRel(("NAT: epoll_create failed: %s\n", strerror(errno)));
+        RTMemFree(pData);
+        *ppData = NULL;
+        return rc;
+    }
+    fcntl(pData->epoll_fd, F_SETFD, FD_CLOEXEC);
+#endif
 
     rc = bootp_dhcp_init(pData);
     if (RT_FAILURE(rc))
     {
         Log(("NAT: DHCP server initialization failed\n"));
+#ifdef HAVE_EPOLL
+        close(pData->epoll_fd);
+#endif
         RTMemFree(pData);
         *ppData = NULL;
         return rc;
@@ -554,6 +603,10 @@ void slirp_term(PNATState pData)
 #ifdef RT_OS_WINDOWS
     WSACleanup();
 #endif
+#ifdef HAVE_EPOLL
+    close(pData->epoll_fd);
+    RTMemFree(pData->paEpollEvents);
+#endif
 #ifndef VBOX_WITH_SLIRP_BSD_SBUF
 #ifdef LOG_ENABLED
     Log(("\n"
@@ -601,6 +654,113 @@ static void updtime(PNATState pData)
 #endif
 }
 
+#ifdef HAVE_EPOLL
+AssertCompile(POLLIN == EPOLLIN && POLLOUT == EPOLLOUT && POLLPRI == EPOLLPRI);
+AssertCompile(POLLERR == EPOLLERR && POLLHUP == EPOLLHUP);
+
+/**
+ * Makes sure @a so is registered in the epoll set for (at least) @a fEvents.
+ */
+static void slirp_epoll_engage(PNATState pData, struct socket *so, int fEvents)
+{
+    struct epoll_event ev;
+    int fRegistered;
+    int rc;
+
+    so->so_poll_events |= fEvents;
+    fRegistered = so->so_epoll_fd == so->s ? so->so_epoll_events : 0;
+    if ((so->so_poll_events & ~fRegistered) == 0)
+        return;
+
+    RT_ZERO(ev);
+    ev.events = so->so_poll_events | fRegistered;
+    ev.data.ptr = so;
+    rc = epoll_ctl(pData->epoll_fd, fRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, so->s, &ev);
+    if (rc < 0 && errno == EEXIST)
+        rc = epoll_ctl(pData->epoll_fd, EPOLL_CTL_MOD, so->s, &ev);
+    else if (rc < 0 && errno == ENOENT)
+        rc = epoll_ctl(pData->epoll_fd, EPOLL_CTL_ADD, so->s, &ev);
+    if (rc < 0)
+    {
+        LogRel(("NAT: epoll_ctl(%d) failed: %s\n", so->s, strerror(errno)));
+        return;
+    }
+    so->so_epoll_fd = so->s;
+    so->so_epoll_events = ev.events;
+}
+
+/**
+ * Removes @a so from the epoll set.
+ *
+ * Must be called before so->s is closed, otherwise the descriptor might be
+ * reused by the time we get here and we'd drop someone else's registration.
+ */
+void slirp_epoll_forget(PNATState pData, struct socket *so)
+{
+    if (   so->so_epoll_events
+        && so->so_epoll_fd == so->s
+        && so->s != -1)
+    {
+        struct epoll_event ev;
+        RT_ZERO(ev);
+        epoll_ctl(pData->epoll_fd, EPOLL_CTL_DEL, so->s, &ev);
+    }
+    so->so_epoll_events = 0;
+    so->so_epoll_fd = -1;
+    so->so_poll_revents = 0;
+}
+
+/**
+ * Fetches the pending events of the epoll set into so_poll_revents.
+ *
+ * Sockets which report events slirp_select_fill didn't ask for this time
+ * have their registration narrowed (or dropped) so they don't keep waking
+ * us up.
+ */
+static void slirp_epoll_collect(PNATState pData)
+{
+    int cEvents;
+    int i;
+
+    if (pData->cEpollEvents < pData->nsock + 1)
+    {
+        int cNew = RT_ALIGN_32(pData->nsock + 1, 64);
+        struct epoll_event *paNew = RTMemRealloc(pData->paEpollEvents, cNew * sizeof(struct epoll_event));
+        if (paNew)
+        {
+            pData->paEpollEvents = paNew;
+            pData->cEpollEvents = cNew;
+        }
+        /* else: level triggered, whatever doesn't fit is picked up next time */
+    }
+    if (!pData->cEpollEvents)
+        return;
+
+    cEvents = epoll_wait(pData->epoll_fd, pData->paEpollEvents, pData->cEpollEvents, 0);
+    for (i = 0; i < cEvents; i++)
+    {
+        struct socket *so = (struct socket *)pData->paEpollEvents[i].data.ptr;
+        int fWanted = so->so_poll_events;
+        if (fWanted)
+            fWanted |= EPOLLERR | EPOLLHUP;
+        so->so_poll_revents = pData->paEpollEvents[i].events & fWanted;
+
+        if (pData->paEpollEvents[i].events & ~fWanted)
+        {
+            struct epoll_event ev;
+            RT_ZERO(ev);
+            ev.events = so->so_poll_events;
+            ev.data.ptr = so;
+            if (ev.events)
+                epoll_ctl(pData->epoll_fd, EPOLL_CTL_MOD, so->s, &ev);
+            else
+                epoll_ctl(pData->epoll_fd, EPOLL_CTL_DEL, so->s, &ev);
+            so->so_epoll_events = ev.events;
+        }
+    }
+}
+#endif /* HAVE_EPOLL */
+
 #ifdef RT_OS_WINDOWS
 void slirp_select_fill(PNATState pData, int *pnfds)
 #else /* RT_OS_WINDOWS */
@@ -649,7 +809,7 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
     }
     /* always add the ICMP socket */
 #ifndef RT_OS_WINDOWS
-    pData->icmp_socket.so_poll_index = -1;
+    DO_POLL_RESET(&pData->icmp_socket);
 #endif
     ICMP_ENGAGE_EVENT(&pData->icmp_socket, readfds);
 
@@ -660,7 +820,7 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
     /* { */
         Assert(so->so_type == IPPROTO_TCP);
 #if !defined(RT_OS_WINDOWS)
-        so->so_poll_index = -1;
+        DO_POLL_RESET(so);
 #endif
         STAM_COUNTER_INC(&pData->StatTCP);
 #ifdef VBOX_WITH_NAT_UDP_SOCKET_CLONE
@@ -748,7 +908,7 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
         Assert(so->so_type == IPPROTO_UDP);
         STAM_COUNTER_INC(&pData->StatUDP);
 #if !defined(RT_OS_WINDOWS)
-        so->so_poll_index = -1;
+        DO_POLL_RESET(so);
 #endif
 
         /*
@@ -801,6 +961,17 @@ done:
 
 #if defined(RT_OS_WINDOWS)
     *pnfds = VBOX_EVENT_COUNT;
+#elif defined(HAVE_EPOLL)
+    NOREF(poll_index);
+    if (link_up && nfds > 0)
+    {
+        polls[0].fd = pData->epoll_fd;
+        polls[0].events = POLLIN;
+        polls[0].revents = 0;
+        *pnfds = 1;
+    }
+    else
+        *pnfds = 0;
 #else /* RT_OS_WINDOWS */
     AssertRelease(poll_index <= *pnfds);
     *pnfds = poll_index;
@@ -919,6 +1090,11 @@ void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
      */
     if (!link_up)
         goto done;
+#ifdef HAVE_EPOLL
+    NOREF(polls);
+    if (ndfs > 0)
+        slirp_epoll_collect(pData);
+#endif
 #if defined(RT_OS_WINDOWS)
     /*XXX: before renaming please make see define
      * fIcmp in slirp_state.h
@@ -1760,6 +1936,16 @@ void slirp_set_somaxconn(PNATState pData, int iSoMaxConn)
     }
     LogFlowFuncLeave();
 }
+
+/**
+ * Lets TCP send segments larger than the MTU to the guest, the caller is
+ * responsible for segmenting frames with slirp_ext_m_tso_segsz() != 0.
+ */
+void slirp_set_gso(PNATState pData, bool fGso)
+{
+    LogRel(("NAT: large segments to the guest %s\n", fGso ? "enabled" : "disabled"));
+    pData->fGso = fGso;
+}
 /* don't allow user set less 8kB and more than 1M values */
 #define _8K_1M_CHECK_ARG(name, val) CHECK_ARG(name, (val), 8, 1024)
 void slirp_set_rcvbuf(PNATState pData, int kilobytes)
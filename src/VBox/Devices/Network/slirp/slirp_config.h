@@ -128,6 +128,13 @@
 /* Define if you have sys/stropts.h */
 #undef HAVE_SYS_STROPTS_H
 
+/* Define if you have epoll (sockets are kept in a persistent epoll set
+ * instead of being put into a pollfd array on every iteration) */
+#undef HAVE_EPOLL
+#ifdef RT_OS_LINUX
+# define HAVE_EPOLL
+#endif
+
 /* Define to whatever your compiler thinks inline should be */
 #if defined(_MSC_VER) && !defined(__cplusplus)
 # define inline _inline
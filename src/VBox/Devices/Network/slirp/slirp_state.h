@@ -141,6 +141,9 @@ typedef struct NATState
     int socket_rcv;
     int socket_snd;
     int soMaxConn;
+    /* TCP may hand segments larger than the MTU to if_encap, they're
+     * marked with CSUM_TSO and segmented by (or for) the guest. */
+    bool fGso;
 #ifdef RT_OS_WINDOWS
     ULONG (WINAPI * pfGetAdaptersAddresses)(ULONG, ULONG, PVOID, PIP_ADAPTER_ADDRESSES, PULONG);
 #endif
@@ -159,6 +162,8 @@ typedef struct NATState
     struct in_addr bindIP;
     /* Stuff from tcp_input.c */
     struct socket tcb;
+    /* tcb sockets hashed by local and foreign address and port */
+    struct sohashhead tcb_hash[SO_HASHSIZE];
 
     struct socket *tcp_last_so;
     tcp_seq tcp_iss;
@@ -176,6 +181,8 @@ typedef struct NATState
     /* Stuff from udp.c */
     struct udpstat_t udpstat;
     struct socket udb;
+    /* udb sockets hashed by local address and port */
+    struct sohashhead udb_hash[SO_HASHSIZE];
     struct socket *udp_last_so;
     struct socket icmp_socket;
     struct icmp_storage icmp_msg_head;
@@ -191,6 +198,13 @@ typedef struct NATState
 #  define NSOCK_DEC() do {pData->nsock--;} while (0)
 #  define NSOCK_INC_EX(ex) do {ex->pData->nsock++;} while (0)
 #  define NSOCK_DEC_EX(ex) do {ex->pData->nsock--;} while (0)
+#  ifdef HAVE_EPOLL
+    /* persistent epoll set of all engaged sockets */
+    int epoll_fd;
+    /* buffer for epoll_wait, grown with nsock */
+    struct epoll_event *paEpollEvents;
+    int cEpollEvents;
+#  endif
 # else
 #  define NSOCK_INC() do {} while (0)
 #  define NSOCK_DEC() do {} while (0)
@@ -449,7 +463,7 @@ typedef struct NATState
 # define DO_SORECFROM(data, so) sorecvfrom((data), (so))
 # define SOLOOKUP(so, label, src, sport, dst, dport)                                      \
     do {                                                                                  \
-        (so) = solookup(&VBOX_X2(queue_ ## label ## _label), (src), (sport), (dst), (dport)); \
+        (so) = solookup(pData, &VBOX_X2(queue_ ## label ## _label), (src), (sport), (dst), (dport)); \
     } while (0)
 # define DO_UDP_DETACH(data, so, ignored) udp_detach((data), (so))
 
@@ -70,6 +70,7 @@ struct socket * soCloneUDPSocketWithForegnAddr(PNATState pData, bool fBindSocket
     pNewSocket->so_lport = pSo->so_lport;
     pNewSocket->so_faddr.s_addr = u32ForeignAddr;
     pNewSocket->so_fport = pSo->so_fport;
+    sohashudp(pData, pNewSocket);
     pSo->so_cCloneCounter++;
     LogFlowFunc(("Leave: %R[natsock]\n", pNewSocket));
     return pNewSocket;
@@ -134,12 +135,83 @@ so_init()
 {
 }
 
+/*
+ * Bucket index for the socket lookup hashes.
+ */
+static inline unsigned
+sohashidx(uint32_t u32)
+{
+    return (u32 * UINT32_C(0x9e3779b1)) >> (32 - 10) & (SO_HASHSIZE - 1);
+}
+AssertCompile(SO_HASHSIZE == 1 << 10);
+
+static inline struct sohashhead *
+sohashtcphead(PNATState pData, struct in_addr laddr, u_int lport, struct in_addr faddr, u_int fport)
+{
+    return &pData->tcb_hash[sohashidx(laddr.s_addr ^ RT_H2N_U32(faddr.s_addr) ^ (lport << 16) ^ fport)];
+}
+
+static inline struct sohashhead *
+sohashudphead(PNATState pData, struct in_addr laddr, u_int lport)
+{
+    return &pData->udb_hash[sohashidx(laddr.s_addr ^ lport)];
+}
+
+/*
+ * (Re)hash a tcb socket under its current addresses and ports. Must be
+ * called whenever any of them change.
+ */
+void
+sohashtcp(PNATState pData, struct socket *so)
+{
+    struct sohashhead *head = sohashtcphead(pData, so->so_laddr, so->so_lport, so->so_faddr, so->so_fport);
+    sounhash(pData, so);
+    LIST_INSERT_HEAD(head, so, so_hash);
+}
+
+/*
+ * (Re)hash a udb socket under its current local address and port. The
+ * foreign address of UDP sockets follows the last datagram sent, so it isn't
+ * part of the key.
+ */
+void
+sohashudp(PNATState pData, struct socket *so)
+{
+    struct sohashhead *head = sohashudphead(pData, so->so_laddr, so->so_lport);
+    sounhash(pData, so);
+    LIST_INSERT_HEAD(head, so, so_hash);
+}
+
+void
+sounhash(PNATState pData, struct socket *so)
+{
+    NOREF(pData);
+    if (so->so_hash.le_prev != NULL)
+    {
+        LIST_REMOVE(so, so_hash);
+        so->so_hash.le_prev = NULL;
+    }
+}
+
 struct socket *
-solookup(struct socket *head, struct in_addr laddr,
+solookup(PNATState pData, struct socket *head, struct in_addr laddr,
          u_int lport, struct in_addr faddr, u_int fport)
 {
     struct socket *so;
 
+    if (head == &tcb)
+    {
+        LIST_FOREACH(so, sohashtcphead(pData, laddr, lport, faddr, fport), so_hash)
+        {
+            if (   so->so_lport        == lport
+                && so->so_laddr.s_addr == laddr.s_addr
+                && so->so_faddr.s_addr == faddr.s_addr
+                && so->so_fport        == fport)
+                return so;
+        }
+        return (struct socket *)NULL;
+    }
+
     for (so = head->so_next; so != head; so = so->so_next)
     {
         if (   so->so_lport        == lport
@@ -152,6 +224,24 @@ solookup(struct socket *head, struct in_addr laddr,
     return (struct socket *)NULL;
 }
 
+/*
+ * Look up the udb socket for datagrams from the guest's laddr:lport.
+ */
+struct socket *
+solookupudp(PNATState pData, struct in_addr laddr, u_int lport)
+{
+    struct socket *so;
+
+    LIST_FOREACH(so, sohashudphead(pData, laddr, lport), so_hash)
+    {
+        if (   so->so_lport        == lport
+            && so->so_laddr.s_addr == laddr.s_addr)
+            return so;
+    }
+
+    return (struct socket *)NULL;
+}
+
 /*
  * Create a new socket, initialise the fields
  * It is the responsibility of the caller to
@@ -168,7 +258,11 @@ socreate()
         so->so_state = SS_NOFDREF;
         so->s = -1;
 #if !defined(RT_OS_WINDOWS)
+# ifndef HAVE_EPOLL
         so->so_poll_index = -1;
+# else
+        so->so_epoll_fd = -1;
+# endif
 #endif
     }
     return so;
@@ -216,6 +310,11 @@ sofree(PNATState pData, struct socket *so)
         so->so_m = NULL;
     }
 
+    sounhash(pData, so);
+#ifdef HAVE_EPOLL
+    slirp_epoll_forget(pData, so); /* in case the fd is still open */
+#endif
+
     if (so->so_next && so->so_prev)
     {
         remque(pData, so);  /* crashes if so is not in a queue */
@@ -1177,6 +1276,7 @@ no_sockopt:
         so->so_faddr = alias_addr;
     else
         so->so_faddr = addr.sin_addr;
+    sohashtcp(pData, so);
 
     so->s = s;
     SOCKET_UNLOCK(so);
@@ -82,8 +82,16 @@ struct socket
     struct sbuf     so_rcv;      /* Receive buffer */
     struct sbuf     so_snd;      /* Send buffer */
 #ifndef RT_OS_WINDOWS
+# ifndef HAVE_EPOLL
     int so_poll_index;
+# else
+    int so_poll_events;          /* events wanted by the last slirp_select_fill */
+    int so_poll_revents;         /* events reported to slirp_select_poll */
+    int so_epoll_events;         /* events registered in the epoll set, 0 if none */
+    int so_epoll_fd;             /* the fd registered in the epoll set */
+# endif
 #endif /* !RT_OS_WINDOWS */
+    LIST_ENTRY(socket) so_hash;  /* lookup hash chain (tcb_hash or udb_hash) */
     /*
      * FD_CLOSE/POLLHUP event has been occurred on socket
      */
@@ -156,6 +164,10 @@ void slirpDeleteLinkSocket(void *pvLnk);
 
 extern struct socket tcb;
 
+/* Number of buckets in the socket lookup hashes (power of two) */
+#define SO_HASHSIZE 1024
+LIST_HEAD(sohashhead, socket);
+
 #if defined(DECLARE_IOVEC) && !defined(HAVE_READV)
 struct iovec
 {
@@ -165,7 +177,15 @@ struct iovec
 #endif
 
 void so_init (void);
-struct socket * solookup (struct socket *, struct in_addr, u_int, struct in_addr, u_int);
+struct socket * solookup (PNATState, struct socket *, struct in_addr, u_int, struct in_addr, u_int);
+struct socket * solookupudp (PNATState, struct in_addr, u_int);
+void sohashtcp (PNATState, struct socket *);
+void sohashudp (PNATState, struct socket *);
+void sounhash (PNATState, struct socket *);
+#ifdef HAVE_EPOLL
+/* slirp.c: drop the socket from the epoll set, must precede closing so->s */
+void slirp_epoll_forget (PNATState, struct socket *);
+#endif
 struct socket * socreate (void);
 void sofree (PNATState, struct socket *);
 int soread (PNATState, struct socket *);
@@ -461,7 +461,7 @@ findso:
     {
         QSOCKET_UNLOCK(tcb);
         /* @todo fix SOLOOKUP macrodefinition to be usable here */
-        so = solookup(&tcb, ti->ti_src, ti->ti_sport,
+        so = solookup(pData, &tcb, ti->ti_src, ti->ti_sport,
                       ti->ti_dst, ti->ti_dport);
         if (so)
         {
@@ -524,6 +524,7 @@ findso:
         so->so_lport = ti->ti_sport;
         so->so_faddr = ti->ti_dst;
         so->so_fport = ti->ti_dport;
+        sohashtcp(pData, so);
 
         so->so_iptos = ((struct ip *)ti)->ip_tos;
 
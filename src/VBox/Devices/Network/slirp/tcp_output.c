@@ -99,6 +99,7 @@ tcp_output(PNATState pData, register struct tcpcb *tp)
     u_char opt[MAX_TCPOPTLEN];
     unsigned optlen, hdrlen;
     int idle, sendalot;
+    int tso;
     int size = 0;
 
     LogFlowFunc(("ENTER: tcp_output: tp = %R[tcpcb793]\n", tp));
@@ -120,6 +121,7 @@ tcp_output(PNATState pData, register struct tcpcb *tp)
 
 again:
     sendalot = 0;
+    tso = 0;
     off = tp->snd_nxt - tp->snd_una;
     win = min(tp->snd_wnd, tp->snd_cwnd);
 
@@ -186,8 +188,29 @@ again:
     }
     if (len > tp->t_maxseg)
     {
-        len = tp->t_maxseg;
-        sendalot = 1;
+        /*
+         * If the guest side can take large segments, send as many
+         * maximum size segments as fit into one mbuf in one go (TSO).
+         * Urgent data and persist probes go the usual way.
+         */
+        if (   pData->fGso
+            && !tp->t_force
+            && !SEQ_GT(tp->snd_up, tp->snd_una))
+        {
+            long cbTsoMax = (MJUM16BYTES - if_maxlinkhdr - sizeof(struct tcpiphdr) - MAX_TCPOPTLEN)
+                          / tp->t_maxseg * tp->t_maxseg;
+            tso = 1;
+            if (len > cbTsoMax)
+            {
+                len = cbTsoMax;
+                sendalot = 1;
+            }
+        }
+        else
+        {
+            len = tp->t_maxseg;
+            sendalot = 1;
+        }
     }
     if (SEQ_LT(tp->snd_nxt + len, tp->snd_una + SBUF_LEN(&so->so_snd)))
         flags &= ~TH_FIN;
@@ -206,7 +229,7 @@ again:
      */
     if (len)
     {
-        if (len == tp->t_maxseg)
+        if (len >= tp->t_maxseg)
             goto send;
         if ((1 || idle || tp->t_flags & TF_NODELAY) &&
                 len + off >= SBUF_LEN(&so->so_snd))
@@ -365,7 +388,9 @@ send:
      * Adjust data length if insertion of options will
      * bump the packet length beyond the t_maxseg length.
      */
-    if (len > tp->t_maxseg - optlen)
+    if (tso && optlen)
+        tso = 0;
+    if (!tso && len > tp->t_maxseg - optlen)
     {
         len = tp->t_maxseg - optlen;
         sendalot = 1;
@@ -656,6 +681,11 @@ send:
     M_ASSERTPKTHDR(m);
     m->m_pkthdr.header = mtod(m, void *);
     m->m_len = hdrlen + len; /* XXX Needed? m_len should be correct */
+    if (tso && len > tp->t_maxseg)
+    {
+        m->m_pkthdr.csum_flags |= CSUM_TSO;
+        m->m_pkthdr.tso_segsz = tp->t_maxseg;
+    }
 
     {
         ((struct ip *)ti)->ip_len = m->m_len;
@@ -662,6 +662,147 @@ static void doUnicastTest(PTSTSTATE pThis, bool fHeadGuard)
                       cb, pvBuf, sizeof(s_au16Frame), s_au16Frame);
 }
 
+/**
+ * Measures the unicast switching rate for an increasing number of interfaces
+ * on the network.
+ *
+ * All frames are sent by the first interface to the others in turn and the
+ * receiving ring is drained right away, so what is measured is mostly the
+ * cost of the send path and the destination lookup.  This is done once with
+ * a single frame per send call and once with bursts of frames to the same
+ * destination.
+ *
+ * @param   cbSend              The send buffer size.
+ * @param   cbRecv              The receive buffer size.
+ */
+static void doSwitchBenchmark(uint32_t cbSend, uint32_t cbRecv)
+{
+    static uint32_t const s_acIfs[] = { 2, 8, 32, 128, 256, 512 };
+    uint32_t const        cFrames   = 200000;
+
+    RTTestISub("IntNetR0Init");
+    RTTESTI_CHECK_RC_RETV(IntNetR0Init(), VINF_SUCCESS);
+
+    INTNETIFHANDLE ahIfs[512];
+    PINTNETBUF     apBufs[512];
+    uint32_t       cIfs = 0;
+    for (unsigned iTest = 0; iTest < RT_ELEMENTS(s_acIfs) && !RTTestIErrorCount(); iTest++)
+    {
+        RTTestISubF("switch benchmark, %u interfaces", s_acIfs[iTest]);
+
+        /*
+         * Add interfaces with distinct MAC addresses until we've got enough.
+         */
+        while (cIfs < s_acIfs[iTest])
+        {
+            RTMAC Mac;
+            Mac.au16[0] = 0x8086;
+            Mac.au16[1] = (uint16_t)(cIfs >> 16);
+            Mac.au16[2] = (uint16_t)cIfs;
+
+            ahIfs[cIfs] = INTNET_HANDLE_INVALID;
+            int rc = IntNetR0Open(g_pSession, "switchbench", kIntNetTrunkType_None, "",
+                                  0/*fFlags*/, cbSend, cbRecv, &ahIfs[cIfs]);
+            if (RT_FAILURE(rc))
+            {
+                RTTestIFailed("Opening interface #%u failed: %Rrc\n", cIfs, rc);
+                break;
+            }
+            rc = IntNetR0IfGetBufferPtrs(ahIfs[cIfs], g_pSession, &apBufs[cIfs], NULL);
+            if (RT_SUCCESS(rc))
+                rc = IntNetR0IfSetMacAddress(ahIfs[cIfs], g_pSession, &Mac);
+            if (RT_SUCCESS(rc))
+                rc = IntNetR0IfSetActive(ahIfs[cIfs], g_pSession, true);
+            if (RT_FAILURE(rc))
+            {
+                /* Not counted in cIfs yet, so close it here. */
+                RTTestIFailed("Setting up interface #%u failed: %Rrc\n", cIfs, rc);
+                RTTESTI_CHECK_RC_OK(IntNetR0IfClose(ahIfs[cIfs], g_pSession));
+                break;
+            }
+            cIfs++;
+        }
+        if (cIfs < s_acIfs[iTest])
+            break;
+
+        /*
+         * Send unicast frames from the first interface to all the others.
+         */
+        uint8_t         abFrame[64];
+        PRTNETETHERHDR  pEthHdr = (PRTNETETHERHDR)&abFrame[0];
+        RT_ZERO(abFrame);
+        pEthHdr->SrcMac.au16[0] = 0x8086;
+        pEthHdr->DstMac.au16[0] = 0x8086;
+        pEthHdr->EtherType      = RT_H2BE_U16(RTNET_ETHERTYPE_IPV4);
+
+        uint32_t cReceived = 0;
+        uint64_t nsStart   = RTTimeNanoTS();
+        for (uint32_t iFrame = 0; iFrame < cFrames; iFrame++)
+        {
+            uint32_t const iIfDst = 1 + iFrame % (cIfs - 1);
+            pEthHdr->DstMac.au16[1] = (uint16_t)(iIfDst >> 16);
+            pEthHdr->DstMac.au16[2] = (uint16_t)iIfDst;
+
+            int rc = tstIntNetSendBuf(&apBufs[0]->Send, ahIfs[0], g_pSession, abFrame, sizeof(abFrame));
+            if (RT_FAILURE(rc))
+            {
+                RTTestIFailed("Sending frame %u failed: %Rrc\n", iFrame, rc);
+                break;
+            }
+            while (IntNetRingHasMoreToRead(&apBufs[iIfDst]->Recv))
+            {
+                IntNetRingSkipFrame(&apBufs[iIfDst]->Recv);
+                cReceived++;
+            }
+        }
+        uint64_t cNsElapsed = RTTimeNanoTS() - nsStart;
+
+        RTTESTI_CHECK_MSG(cReceived == cFrames, ("cReceived=%u cFrames=%u\n", cReceived, cFrames));
+        RTTestValue(g_hTest, "Unicast", (uint64_t)(cFrames * 1000000000.0 / RT_MAX(cNsElapsed, 1)), RTTESTUNIT_FRAMES_PER_SEC);
+
+        /*
+         * Same thing with bursts of frames queued up before each send call.
+         */
+        uint32_t const cFramesPerBurst = 16;
+        cReceived = 0;
+        nsStart   = RTTimeNanoTS();
+        for (uint32_t iFrame = 0; iFrame < cFrames; iFrame += cFramesPerBurst)
+        {
+            uint32_t const iIfDst = 1 + (iFrame / cFramesPerBurst) % (cIfs - 1);
+            pEthHdr->DstMac.au16[1] = (uint16_t)(iIfDst >> 16);
+            pEthHdr->DstMac.au16[2] = (uint16_t)iIfDst;
+
+            int rc = VINF_SUCCESS;
+            for (uint32_t i = 0; i < cFramesPerBurst && RT_SUCCESS(rc); i++)
+                rc = IntNetRingWriteFrame(&apBufs[0]->Send, abFrame, sizeof(abFrame));
+            if (RT_SUCCESS(rc))
+                rc = IntNetR0IfSend(ahIfs[0], g_pSession);
+            if (RT_FAILURE(rc))
+            {
+                RTTestIFailed("Sending burst %u failed: %Rrc\n", iFrame / cFramesPerBurst, rc);
+                break;
+            }
+            while (IntNetRingHasMoreToRead(&apBufs[iIfDst]->Recv))
+            {
+                IntNetRingSkipFrame(&apBufs[iIfDst]->Recv);
+                cReceived++;
+            }
+        }
+        cNsElapsed = RTTimeNanoTS() - nsStart;
+
+        RTTESTI_CHECK_MSG(cReceived == cFrames, ("cReceived=%u cFrames=%u\n", cReceived, cFrames));
+        RTTestValue(g_hTest, "Unicast burst", (uint64_t)(cFrames * 1000000000.0 / RT_MAX(cNsElapsed, 1)), RTTESTUNIT_FRAMES_PER_SEC);
+    }
+
+    /*
+     * Close all the interfaces, taking down the network with them.
+     */
+    while (cIfs-- > 0)
+        RTTESTI_CHECK_RC_OK(IntNetR0IfClose(ahIfs[cIfs], g_pSession));
+    RTTESTI_CHECK(IntNetR0GetNetworkCount() == 0);
+    IntNetR0Term();
+}
+
 static void doTest(PTSTSTATE pThis, uint32_t cbRecv, uint32_t cbSend)
 {
 
@@ -745,10 +886,12 @@ int main(int argc, char **argv)
         { "--recv-buffer",   'r', RTGETOPT_REQ_UINT32 },
         { "--send-buffer",   's', RTGETOPT_REQ_UINT32 },
         { "--transfer-size", 'l', RTGETOPT_REQ_UINT32 },
+        { "--switch-benchmark", 'b', RTGETOPT_REQ_NOTHING },
     };
 
     uint32_t cbSend = 1536*2 + 4;
     uint32_t cbRecv = 0x8000;
+    bool     fSwitchBenchmark = false;
 
     int ch;
     RTGETOPTUNION Value;
@@ -769,6 +912,10 @@ int main(int argc, char **argv)
                 cbSend = Value.u32;
                 break;
 
+            case 'b':
+                fSwitchBenchmark = true;
+                break;
+
             default:
                 return RTGetOptPrintError(ch, &Value);
         }
@@ -776,9 +923,14 @@ int main(int argc, char **argv)
     /*
      * Do the testing and report summary.
      */
-    TSTSTATE This;
-    RT_ZERO(This);
-    doTest(&This, cbRecv, cbSend);
+    if (fSwitchBenchmark)
+        doSwitchBenchmark(cbSend, cbRecv);
+    else
+    {
+        TSTSTATE This;
+        RT_ZERO(This);
+        doTest(&This, cbRecv, cbSend);
+    }
 
     return RTTestSummaryAndDestroy(g_hTest);
 }
@@ -369,7 +369,8 @@ public:
     // initializer for loading existing machine XML (either registered or not)
     HRESULT initFromSettings(VirtualBox *aParent,
                              const Utf8Str &strConfigFile,
-                             const Guid *aId);
+                             const Guid *aId,
+                             settings::MachineConfigFile *pPreloadedConfig = NULL);
 
     // initializer for machine config in memory (OVF import)
     HRESULT init(VirtualBox *aParent,
@@ -0,0 +1,196 @@
+/* $Id$ */
+/** @file
+ *
+ * Hash index of media by their full location.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ____H_MEDIUMLOCATIONINDEX
+#define ____H_MEDIUMLOCATIONINDEX
+
+#include <VBox/com/string.h>
+
+#include <iprt/string.h>
+#include <iprt/uni.h>
+
+#include <list>
+#include <vector>
+
+/**
+ * Maps full medium locations to objects in constant time.
+ *
+ * Two locations are considered equal exactly when RTPathCompare() says so,
+ * i.e. on DOS-like hosts the lookup ignores case and treats both slashes
+ * alike. Several objects may share a location; find() returns the one added
+ * first.
+ *
+ * The class does no locking, the owner must serialize access.
+ */
+template <class T>
+class MediumLocationIndex
+{
+public:
+    MediumLocationIndex()
+        : mcEntries(0)
+    {
+        mBuckets.resize(cMinBuckets);
+    }
+
+    /**
+     * Returns the key used for @a strLocation, folded the same way as
+     * RTPathCompare() folds paths on this host.
+     */
+    static com::Utf8Str normalize(const com::Utf8Str &strLocation)
+    {
+#if defined(RT_OS_WINDOWS) || defined(RT_OS_OS2)
+        com::Utf8Str strKey;
+        strKey.reserve(strLocation.length() + 1);
+        const char *psz = strLocation.c_str();
+        for (;;)
+        {
+            RTUNICP uc;
+            int vrc = RTStrGetCpEx(&psz, &uc);
+            if (RT_FAILURE(vrc))
+                return strLocation; /* invalid encoding, fall back on exact matching */
+            if (!uc)
+                break;
+            if (uc == '\\')
+                uc = '/';
+            else
+                uc = RTUniCpToUpper(uc);
+            char szCp[8];
+            *RTStrPutCp(szCp, uc) = '\0';
+            strKey.append(szCp);
+        }
+        return strKey;
+#else
+        return strLocation;
+#endif
+    }
+
+    /**
+     * Adds @a obj under @a strLocation.
+     */
+    void add(const com::Utf8Str &strLocation, const T &obj)
+    {
+        if (mcEntries >= mBuckets.size() * 2)
+            rehash(mBuckets.size() * 4);
+
+        Entry entry;
+        entry.strKey = normalize(strLocation);
+        entry.obj = obj;
+        mBuckets[bucketOf(entry.strKey)].push_back(entry);
+        mcEntries++;
+    }
+
+    /**
+     * Removes @a obj which was added under @a strLocation.
+     *
+     * Falls back on searching the whole index if the object isn't found
+     * under the given location, so a stale location merely costs time.
+     *
+     * @returns true if found and removed, false if not in the index.
+     */
+    bool remove(const com::Utf8Str &strLocation, const T &obj)
+    {
+        com::Utf8Str strKey = normalize(strLocation);
+        if (removeFromBucket(mBuckets[bucketOf(strKey)], obj))
+            return true;
+        for (size_t i = 0; i < mBuckets.size(); i++)
+            if (removeFromBucket(mBuckets[i], obj))
+                return true;
+        return false;
+    }
+
+    /**
+     * Looks up the object stored under @a strLocation.
+     *
+     * @returns true if found, false if not.
+     * @param   strLocation     The full location to look for.
+     * @param   pObj            Where to return the object (can be NULL).
+     */
+    bool find(const com::Utf8Str &strLocation, T *pObj) const
+    {
+        com::Utf8Str strKey = normalize(strLocation);
+        const Bucket &bucket = mBuckets[bucketOf(strKey)];
+        for (typename Bucket::const_iterator it = bucket.begin();
+             it != bucket.end();
+             ++it)
+            if (it->strKey == strKey)
+            {
+                if (pObj)
+                    *pObj = it->obj;
+                return true;
+            }
+        return false;
+    }
+
+    size_t size() const
+    {
+        return mcEntries;
+    }
+
+    void clear()
+    {
+        mBuckets.clear();
+        mBuckets.resize(cMinBuckets);
+        mcEntries = 0;
+    }
+
+private:
+    struct Entry
+    {
+        com::Utf8Str    strKey;
+        T               obj;
+    };
+    typedef std::list<Entry> Bucket;
+
+    enum { cMinBuckets = 64 };
+
+    size_t bucketOf(const com::Utf8Str &strKey) const
+    {
+        return RTStrHash1(strKey.c_str()) % mBuckets.size();
+    }
+
+    bool removeFromBucket(Bucket &bucket, const T &obj)
+    {
+        for (typename Bucket::iterator it = bucket.begin();
+             it != bucket.end();
+             ++it)
+            if (it->obj == obj)
+            {
+                bucket.erase(it);
+                mcEntries--;
+                return true;
+            }
+        return false;
+    }
+
+    void rehash(size_t cBuckets)
+    {
+        std::vector<Bucket> oldBuckets(cBuckets);
+        oldBuckets.swap(mBuckets);
+        for (size_t i = 0; i < oldBuckets.size(); i++)
+            while (!oldBuckets[i].empty())
+            {
+                Bucket &dst = mBuckets[bucketOf(oldBuckets[i].front().strKey)];
+                dst.splice(dst.end(), oldBuckets[i], oldBuckets[i].begin());
+            }
+    }
+
+    std::vector<Bucket> mBuckets;
+    size_t              mcEntries;
+};
+
+#endif // !____H_MEDIUMLOCATIONINDEX
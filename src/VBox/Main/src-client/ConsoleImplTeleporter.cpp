@@ -26,6 +26,7 @@
 #include "AutoCaller.h"
 #include "Logging.h"
 #include "HashedPw.h"
+#include "TeleporterStreams.h"
 
 #include <iprt/asm.h>
 #include <iprt/err.h>
@@ -69,6 +70,13 @@ public:
     bool volatile       mfIOError;
     /** @} */
 
+    /** @name compressed multi-stream transport (optional)
+     * @{ */
+    PTELEPORTERSTREAMS  mpStreams;
+    RTSOCKET            mahStreamSockets[TELEPORTERSTREAMS_MAX_STREAMS];
+    uint32_t            mcStreamSockets;
+    /** @} */
+
     TeleporterState(Console *pConsole, PUVM pUVM, Progress *pProgress, bool fIsSource)
         : mptrConsole(pConsole)
         , mpUVM(pUVM)
@@ -80,6 +88,8 @@ public:
         , mfStopReading(false)
         , mfEndOfStream(false)
         , mfIOError(false)
+        , mpStreams(NULL)
+        , mcStreamSockets(0)
     {
         VMR3RetainUVM(mpUVM);
     }
@@ -104,6 +114,10 @@ public:
     MachineState_T      menmOldMachineState;
     bool                mfSuspendedByUs;
     bool                mfUnlockedMedia;
+    /** The number of data connections to ask for (1 = plain transport). */
+    uint32_t            mcStreams;
+    /** The compression to ask for (RTZIPTYPE_STORE = plain transport). */
+    RTZIPTYPE           menmZipType;
 
     TeleporterStateSrc(Console *pConsole, PUVM pUVM, Progress *pProgress, MachineState_T enmOldMachineState)
         : TeleporterState(pConsole, pUVM, pProgress, true /*fIsSource*/)
@@ -112,6 +126,8 @@ public:
         , menmOldMachineState(enmOldMachineState)
         , mfSuspendedByUs(false)
         , mfUnlockedMedia(false)
+        , mcStreams(1)
+        , menmZipType(RTZIPTYPE_STORE)
     {
     }
 };
@@ -126,6 +142,10 @@ public:
     IMachine                   *mpMachine;
     IInternalMachineControl    *mpControl;
     PRTTCPSERVER                mhServer;
+    /** The port mhServer listens on. */
+    uint32_t                    muPort;
+    /** Set once mhServer has been shut down. */
+    bool                        mfServerStopped;
     PRTTIMERLR                  mphTimerLR;
     bool                        mfLockedMedia;
     int                         mRc;
@@ -138,6 +158,8 @@ public:
         , mpMachine(pMachine)
         , mpControl(pControl)
         , mhServer(NULL)
+        , muPort(0)
+        , mfServerStopped(false)
         , mphTimerLR(phTimerLR)
         , mfLockedMedia(false)
         , mRc(VINF_SUCCESS)
@@ -179,15 +201,14 @@ static const char g_szWelcome[] = "VirtualBox-Teleporter-1.0\n";
  *
  * @returns VBox status code.
  *
- * @param   pState      The teleporter state structure.
+ * @param   Sock        The socket to read from.
  * @param   pszBuf      The output buffer.
  * @param   cchBuf      The size of the output buffer.
  *
  */
-static int teleporterTcpReadLine(TeleporterState *pState, char *pszBuf, size_t cchBuf)
+static int teleporterTcpReadLine(RTSOCKET Sock, char *pszBuf, size_t cchBuf)
 {
     char       *pszStart = pszBuf;
-    RTSOCKET    Sock     = pState->mhSocket;
 
     AssertReturn(cchBuf > 1, VERR_INTERNAL_ERROR);
     *pszBuf = '\0';
@@ -232,7 +253,7 @@ Console::teleporterSrcReadACK(TeleporterStateSrc *pState, const char *pszWhich,
                               const char *pszNAckMsg /*= NULL*/)
 {
     char szMsg[256];
-    int vrc = teleporterTcpReadLine(pState, szMsg, sizeof(szMsg));
+    int vrc = teleporterTcpReadLine(pState->mhSocket, szMsg, sizeof(szMsg));
     if (RT_FAILURE(vrc))
         return setError(E_FAIL, tr("Failed reading ACK(%s): %Rrc"), pszWhich, vrc);
 
@@ -315,6 +336,18 @@ static DECLCALLBACK(int) teleporterTcpOpWrite(void *pvUser, uint64_t offStream,
     AssertReturn(cbToWrite < UINT32_MAX, VERR_OUT_OF_RANGE);
     AssertReturn(pState->mfIsSource, VERR_INVALID_HANDLE);
 
+    if (pState->mpStreams)
+    {
+        int rc = TeleporterStreamsWrite(pState->mpStreams, pvBuf, cbToWrite);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("Teleporter/TCP: Stream write error: %Rrc (cb=%#zx)\n", rc, cbToWrite));
+            return rc;
+        }
+        pState->moffStream += cbToWrite;
+        return VINF_SUCCESS;
+    }
+
     for (;;)
     {
         TELEPORTERTCPHDR Hdr;
@@ -392,6 +425,33 @@ static DECLCALLBACK(int) teleporterTcpOpRead(void *pvUser, uint64_t offStream, v
         if (pState->mfIOError)
             return VERR_IO_GEN_FAILURE;
 
+        /*
+         * The multi-stream transport does the blocking itself.
+         */
+        if (pState->mpStreams)
+        {
+            rc = TeleporterStreamsRead(pState->mpStreams, pvBuf, cbToRead, pcbRead);
+            if (RT_SUCCESS(rc))
+            {
+                pState->moffStream += pcbRead ? *pcbRead : cbToRead;
+                return VINF_SUCCESS;
+            }
+            if (rc == VERR_CANCELLED)
+            {
+                pState->mfEndOfStream = true;
+                return VERR_SSM_CANCELLED;
+            }
+            if (rc == VERR_EOF)
+            {
+                if (!pState->mfStopReading)
+                    pState->mfEndOfStream = true;
+                return VERR_EOF;
+            }
+            pState->mfIOError = true;
+            LogRel(("Teleporter/TCP: Stream read error: %Rrc (cb=%#zx)\n", rc, cbToRead));
+            return rc;
+        }
+
         /*
          * If there is no more data in the current block, read the next
          * block header.
@@ -529,7 +589,16 @@ static DECLCALLBACK(int) teleporterTcpOpClose(void *pvUser, bool fCanceled)
 {
     TeleporterState *pState = (TeleporterState *)pvUser;
 
-    if (pState->mfIsSource)
+    if (pState->mfIsSource && pState->mpStreams)
+    {
+        int rc = TeleporterStreamsFinish(pState->mpStreams, fCanceled);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("Teleporter/TCP: Stream finish error: %Rrc\n", rc));
+            return rc;
+        }
+    }
+    else if (pState->mfIsSource)
     {
         TELEPORTERTCPHDR EofHdr;
         EofHdr.u32Magic = TELEPORTERTCPHDR_MAGIC;
@@ -544,6 +613,8 @@ static DECLCALLBACK(int) teleporterTcpOpClose(void *pvUser, bool fCanceled)
     else
     {
         ASMAtomicWriteBool(&pState->mfStopReading, true);
+        if (pState->mpStreams)
+            TeleporterStreamsStopReading(pState->mpStreams, true);
     }
 
     return VINF_SUCCESS;
@@ -556,6 +627,7 @@ static DECLCALLBACK(int) teleporterTcpOpClose(void *pvUser, bool fCanceled)
 static SSMSTRMOPS const g_teleporterTcpOps =
 {
     SSMSTRMOPS_VERSION,
+    0 /*fFlags*/,
     teleporterTcpOpWrite,
     teleporterTcpOpRead,
     teleporterTcpOpSeek,
@@ -567,6 +639,47 @@ static SSMSTRMOPS const g_teleporterTcpOps =
 };
 
 
+/**
+ * Method table for a TCP based stream when the multi-stream transport
+ * compresses the data, so SSM doesn't spend time on LZF.
+ */
+static SSMSTRMOPS const g_teleporterTcpOpsNoZip =
+{
+    SSMSTRMOPS_VERSION,
+    SSMSTRMOPS_FLAGS_NO_COMPRESSION,
+    teleporterTcpOpWrite,
+    teleporterTcpOpRead,
+    teleporterTcpOpSeek,
+    teleporterTcpOpTell,
+    teleporterTcpOpSize,
+    teleporterTcpOpIsOk,
+    teleporterTcpOpClose,
+    SSMSTRMOPS_VERSION
+};
+
+
+/**
+ * Destroys the multi-stream transport and closes its connections.
+ *
+ * @param   pState          The teleporter state.
+ */
+static void teleporterCloseStreams(TeleporterState *pState)
+{
+    TeleporterStreamsDestroy(pState->mpStreams);
+    pState->mpStreams = NULL;
+
+    for (uint32_t i = 0; i < pState->mcStreamSockets; i++)
+    {
+        if (pState->mfIsSource)
+            RTTcpClientClose(pState->mahStreamSockets[i]);
+        else
+            RTTcpServerDisconnectClient2(pState->mahStreamSockets[i]);
+        pState->mahStreamSockets[i] = NIL_RTSOCKET;
+    }
+    pState->mcStreamSockets = 0;
+}
+
+
 /**
  * Progress cancelation callback.
  */
@@ -618,6 +731,109 @@ static DECLCALLBACK(void) teleporterDstTimeout(RTTIMERLR hTimerLR, void *pvUser,
 }
 
 
+/**
+ * Negotiates the compressed multi-stream transport and connects the data
+ * streams.
+ *
+ * The target answers the transport command with a line telling which port to
+ * connect the data streams to (the teleporter port it listens on), how many
+ * of them it accepts, the compression it settled for and a cookie each stream
+ * must present.  It ACKs the command once all the streams have connected.
+ * Older targets NACK the unknown command and drop the connection, which is
+ * why the transport is opt-in.
+ *
+ * @returns S_OK on success, E_FAIL+setError() on failure.
+ * @param   pState              The teleporter source state.
+ *
+ * @remarks the setError laziness forces this to be a Console member.
+ */
+HRESULT
+Console::teleporterSrcSetupStreams(TeleporterStateSrc *pState)
+{
+    if (!TeleporterStreamsIsZipTypeSupported(pState->menmZipType))
+    {
+        LogRel(("Teleporter: %s compression is not available, not compressing\n",
+                TeleporterStreamsZipTypeName(pState->menmZipType)));
+        pState->menmZipType = RTZIPTYPE_STORE;
+    }
+
+    char szLine[256];
+    RTStrPrintf(szLine, sizeof(szLine), "transport=%u;%s", pState->mcStreams, TeleporterStreamsZipTypeName(pState->menmZipType));
+    HRESULT hrc = teleporterSrcSubmitCommand(pState, szLine, false /*fWaitForAck*/);
+    if (FAILED(hrc))
+        return hrc;
+
+    /*
+     * Parse the reply: transport=<port>;<streams>;<compression>;<cookie>
+     */
+    int vrc = teleporterTcpReadLine(pState->mhSocket, szLine, sizeof(szLine));
+    if (RT_FAILURE(vrc))
+        return setError(E_FAIL, tr("Failed reading the transport reply: %Rrc"), vrc);
+    if (strncmp(szLine, RT_STR_TUPLE("transport=")))
+        return setError(E_FAIL, tr("The target does not support the compressed multi-stream transport ('%s')"), szLine);
+
+    uint32_t    uPort      = 0;
+    uint32_t    cStreams   = 0;
+    RTZIPTYPE   enmZipType = RTZIPTYPE_INVALID;
+    char       *pszCookie  = NULL;
+    char       *pszNext;
+    vrc = RTStrToUInt32Ex(&szLine[sizeof("transport=") - 1], &pszNext, 10, &uPort);
+    if (vrc == VWRN_TRAILING_CHARS && *pszNext == ';')
+        vrc = RTStrToUInt32Ex(pszNext + 1, &pszNext, 10, &cStreams);
+    if (vrc == VWRN_TRAILING_CHARS && *pszNext == ';')
+    {
+        char *pszZip = pszNext + 1;
+        pszCookie = strchr(pszZip, ';');
+        if (pszCookie)
+        {
+            *pszCookie++ = '\0';
+            enmZipType = TeleporterStreamsZipTypeFromName(pszZip);
+        }
+    }
+    if (   !pszCookie
+        || !*pszCookie
+        || uPort == 0
+        || uPort > 65535
+        || cStreams == 0
+        || cStreams > pState->mcStreams
+        || (enmZipType != pState->menmZipType && enmZipType != RTZIPTYPE_STORE))
+        return setError(E_FAIL, tr("Malformed transport reply from the target"));
+
+    /*
+     * Connect the data streams one by one, the target takes them in that order.
+     */
+    for (uint32_t i = 0; i < cStreams; i++)
+    {
+        RTSOCKET hSocket;
+        vrc = RTTcpClientConnect(pState->mstrHostname.c_str(), uPort, &hSocket);
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("Failed to connect data stream #%u to port %u on '%s': %Rrc"),
+                            i, uPort, pState->mstrHostname.c_str(), vrc);
+        pState->mahStreamSockets[pState->mcStreamSockets++] = hSocket;
+        vrc = RTTcpSetSendCoalescing(hSocket, false /*fEnable*/);
+        AssertRC(vrc);
+
+        char   szHello[128];
+        size_t cch = RTStrPrintf(szHello, sizeof(szHello), "%s;%u\n", pszCookie, i);
+        vrc = RTTcpWrite(hSocket, szHello, cch);
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("Failed to introduce data stream #%u: %Rrc"), i, vrc);
+    }
+
+    hrc = teleporterSrcReadACK(pState, "transport");
+    if (FAILED(hrc))
+        return hrc;
+
+    vrc = TeleporterStreamsCreate(&pState->mpStreams, true /*fWriter*/, pState->mahStreamSockets,
+                                  pState->mcStreamSockets, enmZipType);
+    if (RT_FAILURE(vrc))
+        return setError(E_FAIL, tr("Failed to set up the data streams: %Rrc"), vrc);
+    pState->menmZipType = enmZipType;
+    LogRel(("Teleporter: Sending on %u data streams, %s compression\n", cStreams, TeleporterStreamsZipTypeName(enmZipType)));
+    return S_OK;
+}
+
+
 /**
  * Do the teleporter.
  *
@@ -673,6 +889,17 @@ Console::teleporterSrc(TeleporterStateSrc *pState)
     if (FAILED(hrc))
         return hrc;
 
+    /*
+     * Switch to the compressed multi-stream transport if configured to.
+     */
+    if (   pState->mcStreams > 1
+        || pState->menmZipType != RTZIPTYPE_STORE)
+    {
+        hrc = teleporterSrcSetupStreams(pState);
+        if (FAILED(hrc))
+            return hrc;
+    }
+
     /*
      * Start loading the state.
      *
@@ -686,12 +913,19 @@ Console::teleporterSrc(TeleporterStateSrc *pState)
 
     RTSocketRetain(pState->mhSocket);
     void *pvUser = static_cast<void *>(static_cast<TeleporterState *>(pState));
+    PCSSMSTRMOPS pStreamOps = pState->mpStreams && pState->menmZipType != RTZIPTYPE_STORE
+                            ? &g_teleporterTcpOpsNoZip : &g_teleporterTcpOps;
     vrc = VMR3Teleport(pState->mpUVM,
                        pState->mcMsMaxDowntime,
-                       &g_teleporterTcpOps,         pvUser,
+                       pStreamOps,                  pvUser,
                        teleporterProgressCallback,  pvUser,
                        &pState->mfSuspendedByUs);
     RTSocketRelease(pState->mhSocket);
+
+    /* The data streams have been flushed by the close callback. (The
+       connections are closed later as this waits for the other side.) */
+    TeleporterStreamsDestroy(pState->mpStreams);
+    pState->mpStreams = NULL;
     if (RT_FAILURE(vrc))
     {
         if (   vrc == VERR_SSM_CANCELLED
@@ -774,6 +1008,7 @@ Console::teleporterSrcThreadWrapper(RTTHREAD hThread, void *pvUser)
         hrc = pState->mptrConsole->teleporterSrc(pState);
 
     /* Close the connection ASAP on so that the other side can complete. */
+    teleporterCloseStreams(pState);
     if (pState->mhSocket != NIL_RTSOCKET)
     {
         RTTcpClientClose(pState->mhSocket);
@@ -969,6 +1204,28 @@ Console::Teleport(IN_BSTR aHostname, ULONG aPort, IN_BSTR aPassword, ULONG aMaxD
     }
 
 
+    /*
+     * The optional compressed multi-stream transport, see
+     * teleporterSrcSetupStreams.
+     */
+    uint32_t  cStreams   = 1;
+    RTZIPTYPE enmZipType = RTZIPTYPE_STORE;
+    Bstr      bstrValue;
+    HRESULT   hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterStreams").raw(), bstrValue.asOutParam());
+    if (SUCCEEDED(hrc) && !bstrValue.isEmpty())
+        cStreams = RT_MIN(RT_MAX(Utf8Str(bstrValue).toUInt32(), 1), TELEPORTERSTREAMS_MAX_STREAMS);
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterCompression").raw(), bstrValue.asOutParam());
+    if (SUCCEEDED(hrc) && !bstrValue.isEmpty())
+    {
+        Utf8Str strValue(bstrValue);
+        enmZipType = TeleporterStreamsZipTypeFromName(strValue.c_str());
+        if (enmZipType == RTZIPTYPE_INVALID)
+        {
+            LogRel(("Teleporter: Ignoring unknown compression '%s'\n", strValue.c_str()));
+            enmZipType = RTZIPTYPE_STORE;
+        }
+    }
+
     /*
      * Create a progress object, spawn a worker thread and change the state.
      * Note! The thread won't start working until we release the lock.
@@ -976,7 +1233,7 @@ Console::Teleport(IN_BSTR aHostname, ULONG aPort, IN_BSTR aPassword, ULONG aMaxD
     LogFlowThisFunc(("Initiating TELEPORT request...\n"));
 
     ComObjPtr<Progress> ptrProgress;
-    HRESULT hrc = ptrProgress.createObject();
+    hrc = ptrProgress.createObject();
     if (SUCCEEDED(hrc))
         hrc = ptrProgress->init(static_cast<IConsole *>(this),
                                 Bstr(tr("Teleporter")).raw(),
@@ -989,6 +1246,8 @@ Console::Teleport(IN_BSTR aHostname, ULONG aPort, IN_BSTR aPassword, ULONG aMaxD
     pState->mstrHostname    = aHostname;
     pState->muPort          = aPort;
     pState->mcMsMaxDowntime = aMaxDowntime;
+    pState->mcStreams       = cStreams;
+    pState->menmZipType     = enmZipType;
 
     void *pvUser = static_cast<void *>(static_cast<TeleporterState *>(pState));
     ptrProgress->i_setCancelCallback(teleporterProgressCancelCallback, pvUser);
@@ -1113,6 +1372,7 @@ Console::teleporterTrg(PUVM pUVM, IMachine *pMachine, Utf8Str *pErrorMsg, bool f
             TeleporterStateTrg theState(this, pUVM, pProgress, pMachine, mControl, &hTimerLR, fStartPaused);
             theState.mstrPassword      = strPassword;
             theState.mhServer          = hServer;
+            theState.muPort            = uPort;
 
             void *pvUser = static_cast<void *>(static_cast<TeleporterState *>(&theState));
             if (pProgress->i_setCancelCallback(teleporterProgressCancelCallback, pvUser))
@@ -1121,7 +1381,21 @@ Console::teleporterTrg(PUVM pUVM, IMachine *pMachine, Utf8Str *pErrorMsg, bool f
                 hrc = pProgress->SetNextOperation(Bstr(tr("Waiting for incoming VM")).raw(), 1);
                 if (SUCCEEDED(hrc))
                 {
-                    vrc = RTTcpServerListen(hServer, Console::teleporterTrgServeConnection, &theState);
+                    /* The connections are accepted here rather than using
+                       RTTcpServerListen so that the data streams of the
+                       multi-stream transport can be accepted on the same
+                       server while serving the command connection. */
+                    for (;;)
+                    {
+                        RTSOCKET hSocket;
+                        vrc = RTTcpServerListen2(hServer, &hSocket);
+                        if (RT_FAILURE(vrc))
+                            break;
+                        vrc = Console::teleporterTrgServeConnection(hSocket, &theState);
+                        RTTcpServerDisconnectClient2(hSocket);
+                        if (vrc == VERR_TCP_SERVER_STOP)
+                            break;
+                    }
                     pProgress->i_setCancelCallback(NULL, NULL);
 
                     if (vrc == VERR_TCP_SERVER_STOP)
@@ -1154,12 +1428,12 @@ Console::teleporterTrg(PUVM pUVM, IMachine *pMachine, Utf8Str *pErrorMsg, bool f
                             hrc = setError(E_FAIL, tr("Teleporting canceled"));
                         else
                             hrc = setError(E_FAIL, tr("Teleporter timed out waiting for incoming connection"));
-                        LogRel(("Teleporter: RTTcpServerListen aborted - %Rrc\n", vrc));
+                        LogRel(("Teleporter: RTTcpServerListen2 aborted - %Rrc\n", vrc));
                     }
                     else
                     {
-                        hrc = setError(E_FAIL, tr("Unexpected RTTcpServerListen status code %Rrc"), vrc);
-                        LogRel(("Teleporter: Unexpected RTTcpServerListen rc: %Rrc\n", vrc));
+                        hrc = setError(E_FAIL, tr("Unexpected RTTcpServerListen2 status code %Rrc"), vrc);
+                        LogRel(("Teleporter: Unexpected RTTcpServerListen2 rc: %Rrc\n", vrc));
                     }
                 }
                 else
@@ -1250,6 +1524,139 @@ static int teleporterTcpWriteNACK(TeleporterStateTrg *pState, int32_t rc2, const
 }
 
 
+/**
+ * Stops the teleporter server once no more connections are expected.
+ *
+ * @param   pState          The teleporter target state.
+ */
+static void teleporterTrgStopServer(TeleporterStateTrg *pState)
+{
+    if (!pState->mfServerStopped)
+    {
+        RTTcpServerShutdown(pState->mhServer);
+        pState->mfServerStopped = true;
+    }
+}
+
+
+/**
+ * Handles the transport command, switching to the compressed multi-stream
+ * transport.
+ *
+ * See Console::teleporterSrcSetupStreams for the protocol.
+ *
+ * @returns VBox status code, failures have been NACKed.
+ * @param   pState          The teleporter target state.
+ * @param   pszArgs         The command arguments: <streams>;<compression>
+ */
+static int teleporterTrgSetupStreams(TeleporterStateTrg *pState, char *pszArgs)
+{
+    if (pState->mpStreams || pState->mcStreamSockets)
+    {
+        teleporterTcpWriteNACK(pState, VERR_WRONG_ORDER);
+        return VERR_WRONG_ORDER;
+    }
+
+    /*
+     * Parse the request, settling for fewer streams or no compression if
+     * we cannot do what is asked for.
+     */
+    uint32_t cStreams = 0;
+    char    *pszNext  = NULL;
+    int vrc = RTStrToUInt32Ex(pszArgs, &pszNext, 10, &cStreams);
+    if (vrc != VWRN_TRAILING_CHARS || *pszNext != ';' || cStreams == 0)
+    {
+        LogRel(("Teleporter: Malformed transport command arguments '%s'\n", pszArgs));
+        teleporterTcpWriteNACK(pState, VERR_INVALID_PARAMETER);
+        return VERR_INVALID_PARAMETER;
+    }
+    cStreams = RT_MIN(cStreams, TELEPORTERSTREAMS_MAX_STREAMS);
+    RTZIPTYPE enmZipType = TeleporterStreamsZipTypeFromName(pszNext + 1);
+    if (   enmZipType == RTZIPTYPE_INVALID
+        || !TeleporterStreamsIsZipTypeSupported(enmZipType))
+    {
+        LogRel(("Teleporter: '%s' compression is not available, not compressing\n", pszNext + 1));
+        enmZipType = RTZIPTYPE_STORE;
+    }
+
+    /*
+     * The data streams connect to the teleporter port as well, so only the
+     * one port needs to be reachable.
+     */
+    uint8_t abCookie[16];
+    char    szCookie[sizeof(abCookie) * 2 + 1];
+    RTRandBytes(abCookie, sizeof(abCookie));
+    vrc = RTStrPrintHexBytes(szCookie, sizeof(szCookie), abCookie, sizeof(abCookie), 0 /*fFlags*/);
+    AssertRC(vrc);
+
+    char   szReply[128];
+    size_t cch = RTStrPrintf(szReply, sizeof(szReply), "transport=%u;%u;%s;%s\n",
+                             pState->muPort, cStreams, TeleporterStreamsZipTypeName(enmZipType), szCookie);
+    vrc = RTTcpWrite(pState->mhSocket, szReply, cch);
+
+    /*
+     * Accept the data streams.  The source connects them one by one, each
+     * introducing itself with "<cookie>;<index>".  Strays are dropped and we
+     * give up if the streams don't show up within a minute.
+     */
+    RTTIMERLR hTimerLR = NIL_RTTIMERLR;
+    if (RT_SUCCESS(vrc))
+        vrc = RTTimerLRCreateEx(&hTimerLR, 0 /*ns*/, RTTIMER_FLAGS_CPU_ANY, teleporterDstTimeout, pState->mhServer);
+    if (RT_SUCCESS(vrc))
+        vrc = RTTimerLRStart(hTimerLR, 60*UINT64_C(1000000000) /*ns*/);
+    while (   RT_SUCCESS(vrc)
+           && pState->mcStreamSockets < cStreams)
+    {
+        RTSOCKET hSocket;
+        vrc = RTTcpServerListen2(pState->mhServer, &hSocket);
+        if (RT_FAILURE(vrc))
+            break;
+
+        char     szHello[128];
+        uint32_t iStream = UINT32_MAX;
+        int vrc2 = RTTcpSelectOne(hSocket, 10000);
+        if (RT_SUCCESS(vrc2))
+            vrc2 = teleporterTcpReadLine(hSocket, szHello, sizeof(szHello));
+        char *pszIndex = RT_SUCCESS(vrc2) ? strchr(szHello, ';') : NULL;
+        if (pszIndex)
+        {
+            *pszIndex++ = '\0';
+            if (   strcmp(szHello, szCookie)
+                || RTStrToUInt32Full(pszIndex, 10, &iStream) != VINF_SUCCESS)
+                iStream = UINT32_MAX;
+        }
+        if (iStream == pState->mcStreamSockets)
+        {
+            vrc2 = RTTcpSetSendCoalescing(hSocket, false /*fEnable*/);
+            AssertRC(vrc2);
+            pState->mahStreamSockets[pState->mcStreamSockets++] = hSocket;
+        }
+        else
+        {
+            LogRel(("Teleporter: Dropping unexpected data stream connection (%Rrc)\n", vrc2));
+            RTTcpServerDisconnectClient2(hSocket);
+        }
+    }
+    if (hTimerLR != NIL_RTTIMERLR)
+        RTTimerLRDestroy(hTimerLR);
+    teleporterTrgStopServer(pState);
+
+    if (RT_SUCCESS(vrc))
+        vrc = TeleporterStreamsCreate(&pState->mpStreams, false /*fWriter*/, pState->mahStreamSockets,
+                                      pState->mcStreamSockets, enmZipType);
+    if (RT_FAILURE(vrc))
+    {
+        LogRel(("Teleporter: Failed to set up the data streams: %Rrc\n", vrc));
+        teleporterCloseStreams(pState);
+        teleporterTcpWriteNACK(pState, vrc);
+        return vrc;
+    }
+
+    LogRel(("Teleporter: Receiving on %u data streams, %s compression\n", cStreams, TeleporterStreamsZipTypeName(enmZipType)));
+    return teleporterTcpWriteACK(pState);
+}
+
+
 /**
  * @copydoc FNRTTCPSERVE
  *
@@ -1317,12 +1724,13 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
     AssertMsg(SUCCEEDED(hrc) || hrc == E_FAIL, ("%Rhrc\n", hrc));
 
     /*
-     * Stop the server and cancel the timeout timer.
+     * Cancel the timeout timer.  The server is stopped by the first command
+     * unless that sets up the multi-stream transport, which needs it for
+     * accepting the data streams.
      *
      * Note! After this point we must return VERR_TCP_SERVER_STOP, while prior
      *       to it we must not return that value!
      */
-    RTTcpServerShutdown(pState->mhServer);
     RTTimerLRDestroy(*pState->mphTimerLR);
     *pState->mphTimerLR = NIL_RTTIMERLR;
 
@@ -1333,9 +1741,11 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
     for (;;)
     {
         char szCmd[128];
-        vrc = teleporterTcpReadLine(pState, szCmd, sizeof(szCmd));
+        vrc = teleporterTcpReadLine(pState->mhSocket, szCmd, sizeof(szCmd));
         if (RT_FAILURE(vrc))
             break;
+        if (strncmp(szCmd, RT_STR_TUPLE("transport=")))
+            teleporterTrgStopServer(pState);
 
         if (!strcmp(szCmd, "load"))
         {
@@ -1365,6 +1775,8 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
 
             /* The EOS might not have been read, make sure it is. */
             pState->mfStopReading = false;
+            if (pState->mpStreams)
+                TeleporterStreamsStopReading(pState->mpStreams, false);
             size_t cbRead;
             vrc = teleporterTcpOpRead(pvUser2, pState->moffStream, szCmd, 1, &cbRead);
             if (vrc != VERR_EOF)
@@ -1373,9 +1785,12 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
                 teleporterTcpWriteNACK(pState, vrc);
                 break;
             }
+            teleporterCloseStreams(pState);
 
             vrc = teleporterTcpWriteACK(pState);
         }
+        else if (!strncmp(szCmd, RT_STR_TUPLE("transport=")))
+            vrc = teleporterTrgSetupStreams(pState, &szCmd[sizeof("transport=") - 1]);
         else if (!strcmp(szCmd, "cancel"))
         {
             /* Don't ACK this. */
@@ -1445,6 +1860,8 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
         vrc = VERR_WRONG_ORDER;
     if (RT_FAILURE(vrc))
         teleporterTrgUnlockMedia(pState);
+    teleporterCloseStreams(pState);
+    teleporterTrgStopServer(pState);
 
     pState->mRc = vrc;
     pState->mhSocket = NIL_RTSOCKET;
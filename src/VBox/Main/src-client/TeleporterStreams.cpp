@@ -0,0 +1,766 @@
+/* $Id$ */
+/** @file
+ * Compressed, multi-stream transport for the teleporter.
+ *
+ * The saved state stream is cut into fixed size blocks which are dealt out
+ * round robin to a set of TCP connections.  Each connection has its own
+ * thread, which compresses and sends the blocks on the source side, and
+ * receives and decompresses them on the target side.  Since block N always
+ * travels on connection N % cStreams, the receiver can put the stream back
+ * together without any extra sequencing, the block numbers in the headers
+ * are only there for catching protocol errors.
+ *
+ * The end of the stream (or cancellation) is signalled by an empty block on
+ * each connection, continuing the sequence, so it arrives after all the data
+ * and the receiving threads know when to quit.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_MAIN
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/semaphore.h>
+#include <iprt/string.h>
+#include <iprt/tcp.h>
+#include <iprt/thread.h>
+
+#include "TeleporterStreams.h"
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The (uncompressed) size of a block. */
+#define TELEPORTERSTREAMS_BLOCK_SIZE    _256K
+/** The number of blocks each connection can have in flight (power of two). */
+#define TELEPORTERSTREAMS_RING_SIZE     2
+/** The select timeout used for checking the termination flag. */
+#define TELEPORTERSTREAMS_POLL_MS       1000
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Block header, one for each block sent over a data connection.
+ */
+typedef struct TELEPORTERSTREAMHDR
+{
+    /** Magic value (TELEPORTERSTREAMHDR_MAGIC). */
+    uint32_t    u32Magic;
+    /** The block number. */
+    uint32_t    iBlock;
+    /** The uncompressed size of the block.
+     * 0 indicates the end of the stream, while UINT32_MAX indicates
+     * cancelation. */
+    uint32_t    cbBlock;
+    /** The number of bytes following this header.  Equal to cbBlock if the
+     * block is stored uncompressed. */
+    uint32_t    cbStored;
+} TELEPORTERSTREAMHDR;
+AssertCompileSize(TELEPORTERSTREAMHDR, 16);
+/** Magic value for TELEPORTERSTREAMHDR::u32Magic. (Hermeto Pascoal) */
+#define TELEPORTERSTREAMHDR_MAGIC       UINT32_C(0x19360622)
+
+/**
+ * A block buffer.
+ */
+typedef struct TELEPORTERSTREAMBLOCK
+{
+    /** The block data (TELEPORTERSTREAMS_BLOCK_SIZE bytes). */
+    uint8_t            *pbData;
+    /** The block size, 0 for end of stream and UINT32_MAX for cancelation. */
+    uint32_t            cbBlock;
+    /** The block number. */
+    uint32_t            iBlock;
+} TELEPORTERSTREAMBLOCK;
+
+/**
+ * A data connection and its thread.
+ *
+ * The blocks form a single producer, single consumer ring.  On the source
+ * side the caller of TeleporterStreamsWrite produces and the thread consumes,
+ * on the target side it is the other way around.
+ */
+typedef struct TELEPORTERSTREAM
+{
+    /** Pointer to the stream set. */
+    struct TELEPORTERSTREAMS   *pStreams;
+    /** The connection. */
+    RTSOCKET                    hSocket;
+    /** The I/O thread. */
+    RTTHREAD                    hThread;
+    /** Signalled when a block is added to the ring or the thread fails. */
+    RTSEMEVENT                  hEvtFilled;
+    /** Signalled when a block is taken off the ring or the thread fails. */
+    RTSEMEVENT                  hEvtEmptied;
+    /** The ring producer index. */
+    uint32_t volatile           iHead;
+    /** The ring consumer index. */
+    uint32_t volatile           iTail;
+    /** The status of the I/O thread. */
+    int32_t volatile            rc;
+    /** The next block number expected on this connection (target only). */
+    uint32_t                    iNextBlock;
+    /** Buffer for compressed data. */
+    uint8_t                    *pbZip;
+    /** The ring of blocks. */
+    TELEPORTERSTREAMBLOCK       aBlocks[TELEPORTERSTREAMS_RING_SIZE];
+} TELEPORTERSTREAM;
+/** Pointer to a data connection. */
+typedef TELEPORTERSTREAM *PTELEPORTERSTREAM;
+
+/**
+ * A set of data connections making up a transport.
+ */
+typedef struct TELEPORTERSTREAMS
+{
+    /** Set if we're the writing (source) side. */
+    bool                        fWriter;
+    /** Set by TeleporterStreamsFinish. */
+    bool                        fFinished;
+    /** Tells the I/O threads to quit. */
+    bool volatile               fTerminate;
+    /** Makes TeleporterStreamsRead return VERR_EOF. */
+    bool volatile               fStopReading;
+    /** The compression method. */
+    RTZIPTYPE                   enmZipType;
+    /** The current block number. */
+    uint32_t                    iBlock;
+    /** The offset into the current block. */
+    uint32_t                    offBlock;
+    /** VERR_EOF or VERR_CANCELLED once the reader has hit the end of the
+     * stream, VINF_SUCCESS before that. */
+    int                         rcEndOfStream;
+    /** The number of data connections. */
+    uint32_t                    cStreams;
+    /** The data connections. */
+    TELEPORTERSTREAM            aStreams[TELEPORTERSTREAMS_MAX_STREAMS];
+} TELEPORTERSTREAMS;
+
+
+/**
+ * Records a failure of an I/O thread and wakes up the other side.
+ *
+ * @returns rc.
+ * @param   pStrm       The data connection.
+ * @param   rc          The failure status.
+ */
+static int teleporterStreamsFail(PTELEPORTERSTREAM pStrm, int rc)
+{
+    ASMAtomicCmpXchgS32(&pStrm->rc, rc, VINF_SUCCESS);
+    RTSemEventSignal(pStrm->hEvtFilled);
+    RTSemEventSignal(pStrm->hEvtEmptied);
+    return rc;
+}
+
+
+/**
+ * Compresses and sends one block.
+ *
+ * @returns VBox status code.
+ * @param   pStrm       The data connection.
+ * @param   pBlock      The block.
+ */
+static int teleporterStreamsSendBlock(PTELEPORTERSTREAM pStrm, TELEPORTERSTREAMBLOCK const *pBlock)
+{
+    TELEPORTERSTREAMHDR Hdr;
+    Hdr.u32Magic = TELEPORTERSTREAMHDR_MAGIC;
+    Hdr.iBlock   = pBlock->iBlock;
+    Hdr.cbBlock  = pBlock->cbBlock;
+    Hdr.cbStored = 0;
+    if (Hdr.cbBlock == 0 || Hdr.cbBlock == UINT32_MAX)
+        return RTTcpWrite(pStrm->hSocket, &Hdr, sizeof(Hdr));
+
+    /* Store the block if it doesn't compress. */
+    uint8_t const *pbPayload = pBlock->pbData;
+    Hdr.cbStored = Hdr.cbBlock;
+    if (pStrm->pStreams->enmZipType != RTZIPTYPE_STORE)
+    {
+        size_t cbZip;
+        int rc = RTZipBlockCompress(pStrm->pStreams->enmZipType, RTZIPLEVEL_FAST, 0 /*fFlags*/,
+                                    pBlock->pbData, pBlock->cbBlock,
+                                    pStrm->pbZip, pBlock->cbBlock - 1, &cbZip);
+        if (RT_SUCCESS(rc) && cbZip < pBlock->cbBlock)
+        {
+            pbPayload    = pStrm->pbZip;
+            Hdr.cbStored = (uint32_t)cbZip;
+        }
+    }
+    return RTTcpSgWriteL(pStrm->hSocket, 2, &Hdr, sizeof(Hdr), pbPayload, (size_t)Hdr.cbStored);
+}
+
+
+/**
+ * Source side I/O thread, sends the blocks queued on its connection.
+ *
+ * @returns VINF_SUCCESS (ignored).
+ * @param   hThread     The thread handle.
+ * @param   pvUser      The data connection.
+ */
+static DECLCALLBACK(int) teleporterStreamsSendThread(RTTHREAD hThread, void *pvUser)
+{
+    PTELEPORTERSTREAM   pStrm    = (PTELEPORTERSTREAM)pvUser;
+    PTELEPORTERSTREAMS  pStreams = pStrm->pStreams;
+
+    for (;;)
+    {
+        while (ASMAtomicReadU32(&pStrm->iTail) == ASMAtomicReadU32(&pStrm->iHead))
+        {
+            if (ASMAtomicReadBool(&pStreams->fTerminate))
+                return VINF_SUCCESS;
+            RTSemEventWait(pStrm->hEvtFilled, RT_INDEFINITE_WAIT);
+        }
+        if (ASMAtomicReadBool(&pStreams->fTerminate))
+            return VINF_SUCCESS;
+
+        TELEPORTERSTREAMBLOCK const *pBlock = &pStrm->aBlocks[pStrm->iTail % TELEPORTERSTREAMS_RING_SIZE];
+        int rc = teleporterStreamsSendBlock(pStrm, pBlock);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("Teleporter/Streams: Write error: %Rrc (iBlock=%#x cbBlock=%#x)\n", rc, pBlock->iBlock, pBlock->cbBlock));
+            teleporterStreamsFail(pStrm, rc);
+            return VINF_SUCCESS;
+        }
+
+        ASMAtomicIncU32(&pStrm->iTail);
+        RTSemEventSignal(pStrm->hEvtEmptied);
+    }
+}
+
+
+/**
+ * Reads exactly @a cbToRead bytes from the connection, giving up if the
+ * stream set is being terminated while waiting for data.
+ *
+ * @returns VBox status code.
+ * @param   pStrm       The data connection.
+ * @param   pvBuf       Where to put the data.
+ * @param   cbToRead    How much to read.
+ */
+static int teleporterStreamsRecv(PTELEPORTERSTREAM pStrm, void *pvBuf, size_t cbToRead)
+{
+    int rc;
+    do
+    {
+        if (ASMAtomicReadBool(&pStrm->pStreams->fTerminate))
+            return VERR_CANCELLED;
+        rc = RTTcpSelectOne(pStrm->hSocket, TELEPORTERSTREAMS_POLL_MS);
+    } while (rc == VERR_TIMEOUT);
+    if (RT_SUCCESS(rc))
+        rc = RTTcpRead(pStrm->hSocket, pvBuf, cbToRead, NULL);
+    return rc;
+}
+
+
+/**
+ * Receives and decompresses one block.
+ *
+ * @returns VBox status code.
+ * @param   pStrm       The data connection.
+ * @param   pBlock      The block buffer.
+ */
+static int teleporterStreamsRecvBlock(PTELEPORTERSTREAM pStrm, TELEPORTERSTREAMBLOCK *pBlock)
+{
+    TELEPORTERSTREAMHDR Hdr;
+    int rc = teleporterStreamsRecv(pStrm, &Hdr, sizeof(Hdr));
+    if (RT_FAILURE(rc))
+        return rc;
+
+    if (RT_UNLIKELY(   Hdr.u32Magic != TELEPORTERSTREAMHDR_MAGIC
+                    || Hdr.iBlock   != pStrm->iNextBlock
+                    || (   Hdr.cbBlock > TELEPORTERSTREAMS_BLOCK_SIZE
+                        && Hdr.cbBlock != UINT32_MAX)
+                    || (   Hdr.cbBlock != UINT32_MAX
+                        && Hdr.cbStored > Hdr.cbBlock)
+                    || (   Hdr.cbStored == 0
+                        && Hdr.cbBlock != 0
+                        && Hdr.cbBlock != UINT32_MAX) ))
+    {
+        LogRel(("Teleporter/Streams: Invalid block: u32Magic=%#x iBlock=%#x (expected %#x) cbBlock=%#x cbStored=%#x\n",
+                Hdr.u32Magic, Hdr.iBlock, pStrm->iNextBlock, Hdr.cbBlock, Hdr.cbStored));
+        return VERR_IO_GEN_FAILURE;
+    }
+    pBlock->iBlock  = Hdr.iBlock;
+    pBlock->cbBlock = Hdr.cbBlock;
+    if (Hdr.cbBlock == 0 || Hdr.cbBlock == UINT32_MAX)
+        return VINF_SUCCESS;
+
+    if (Hdr.cbStored == Hdr.cbBlock)
+        return teleporterStreamsRecv(pStrm, pBlock->pbData, Hdr.cbStored);
+
+    rc = teleporterStreamsRecv(pStrm, pStrm->pbZip, Hdr.cbStored);
+    if (RT_SUCCESS(rc))
+    {
+        size_t cbActual = 0;
+        rc = RTZipBlockDecompress(pStrm->pStreams->enmZipType, 0 /*fFlags*/, pStrm->pbZip, Hdr.cbStored, NULL,
+                                  pBlock->pbData, Hdr.cbBlock, &cbActual);
+        if (RT_SUCCESS(rc) && cbActual != Hdr.cbBlock)
+            rc = VERR_IO_GEN_FAILURE;
+        if (RT_FAILURE(rc))
+            LogRel(("Teleporter/Streams: Failed to decompress block %#x (%#x -> %#x): %Rrc\n",
+                    Hdr.iBlock, Hdr.cbStored, Hdr.cbBlock, rc));
+    }
+    return rc;
+}
+
+
+/**
+ * Target side I/O thread, receives the blocks of its connection.
+ *
+ * @returns VINF_SUCCESS (ignored).
+ * @param   hThread     The thread handle.
+ * @param   pvUser      The data connection.
+ */
+static DECLCALLBACK(int) teleporterStreamsRecvThread(RTTHREAD hThread, void *pvUser)
+{
+    PTELEPORTERSTREAM   pStrm    = (PTELEPORTERSTREAM)pvUser;
+    PTELEPORTERSTREAMS  pStreams = pStrm->pStreams;
+
+    for (;;)
+    {
+        while (ASMAtomicReadU32(&pStrm->iHead) - ASMAtomicReadU32(&pStrm->iTail) >= TELEPORTERSTREAMS_RING_SIZE)
+        {
+            if (ASMAtomicReadBool(&pStreams->fTerminate))
+                return VINF_SUCCESS;
+            RTSemEventWait(pStrm->hEvtEmptied, RT_INDEFINITE_WAIT);
+        }
+
+        TELEPORTERSTREAMBLOCK *pBlock = &pStrm->aBlocks[pStrm->iHead % TELEPORTERSTREAMS_RING_SIZE];
+        int rc = teleporterStreamsRecvBlock(pStrm, pBlock);
+        if (RT_FAILURE(rc))
+        {
+            if (rc != VERR_CANCELLED)
+                LogRel(("Teleporter/Streams: Read error: %Rrc (iBlock=%#x)\n", rc, pStrm->iNextBlock));
+            teleporterStreamsFail(pStrm, rc);
+            return VINF_SUCCESS;
+        }
+
+        pStrm->iNextBlock += pStreams->cStreams;
+        ASMAtomicIncU32(&pStrm->iHead);
+        RTSemEventSignal(pStrm->hEvtFilled);
+
+        /* Nothing follows the end of the stream. */
+        if (pBlock->cbBlock == 0 || pBlock->cbBlock == UINT32_MAX)
+            return VINF_SUCCESS;
+    }
+}
+
+
+/**
+ * Creates a transport on top of a set of connected sockets.
+ *
+ * The sockets must be passed in the same order on both sides.  They remain
+ * owned by the caller and must not be closed before the transport has been
+ * destroyed.
+ *
+ * @returns VBox status code.
+ * @param   ppStreams       Where to return the transport handle.
+ * @param   fWriter         Set on the source side, clear on the target side.
+ * @param   pahSockets      The data connections.
+ * @param   cSockets        The number of data connections.
+ * @param   enmZipType      The compression method, RTZIPTYPE_STORE for none.
+ */
+int TeleporterStreamsCreate(PTELEPORTERSTREAMS *ppStreams, bool fWriter, RTSOCKET const *pahSockets,
+                            uint32_t cSockets, RTZIPTYPE enmZipType)
+{
+    AssertPtrReturn(ppStreams, VERR_INVALID_POINTER);
+    AssertPtrReturn(pahSockets, VERR_INVALID_POINTER);
+    AssertReturn(cSockets > 0 && cSockets <= TELEPORTERSTREAMS_MAX_STREAMS, VERR_OUT_OF_RANGE);
+    AssertReturn(TeleporterStreamsZipTypeName(enmZipType) != NULL, VERR_INVALID_PARAMETER);
+    *ppStreams = NULL;
+
+    PTELEPORTERSTREAMS pStreams = (PTELEPORTERSTREAMS)RTMemAllocZ(sizeof(*pStreams));
+    if (!pStreams)
+        return VERR_NO_MEMORY;
+    pStreams->fWriter       = fWriter;
+    pStreams->enmZipType    = enmZipType;
+    pStreams->rcEndOfStream = VINF_SUCCESS;
+    pStreams->cStreams      = cSockets;
+    for (uint32_t i = 0; i < cSockets; i++)
+    {
+        PTELEPORTERSTREAM pStrm = &pStreams->aStreams[i];
+        pStrm->pStreams    = pStreams;
+        pStrm->hSocket     = pahSockets[i];
+        pStrm->hThread     = NIL_RTTHREAD;
+        pStrm->hEvtFilled  = NIL_RTSEMEVENT;
+        pStrm->hEvtEmptied = NIL_RTSEMEVENT;
+        pStrm->rc          = VINF_SUCCESS;
+        pStrm->iNextBlock  = i;
+    }
+
+    /*
+     * Allocate the buffers and semaphores, then start the threads.
+     */
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < cSockets && RT_SUCCESS(rc); i++)
+    {
+        PTELEPORTERSTREAM pStrm = &pStreams->aStreams[i];
+        pStrm->pbZip = (uint8_t *)RTMemAlloc(TELEPORTERSTREAMS_BLOCK_SIZE);
+        if (!pStrm->pbZip)
+            rc = VERR_NO_MEMORY;
+        for (uint32_t j = 0; j < TELEPORTERSTREAMS_RING_SIZE && RT_SUCCESS(rc); j++)
+        {
+            pStrm->aBlocks[j].pbData = (uint8_t *)RTMemAlloc(TELEPORTERSTREAMS_BLOCK_SIZE);
+            if (!pStrm->aBlocks[j].pbData)
+                rc = VERR_NO_MEMORY;
+        }
+        if (RT_SUCCESS(rc))
+            rc = RTSemEventCreate(&pStrm->hEvtFilled);
+        if (RT_SUCCESS(rc))
+            rc = RTSemEventCreate(&pStrm->hEvtEmptied);
+    }
+    for (uint32_t i = 0; i < cSockets && RT_SUCCESS(rc); i++)
+        rc = RTThreadCreateF(&pStreams->aStreams[i].hThread,
+                             fWriter ? teleporterStreamsSendThread : teleporterStreamsRecvThread,
+                             &pStreams->aStreams[i], 0 /*cbStack*/, RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE,
+                             fWriter ? "TeleTx%u" : "TeleRx%u", i);
+    if (RT_FAILURE(rc))
+    {
+        TeleporterStreamsDestroy(pStreams);
+        return rc;
+    }
+
+    *ppStreams = pStreams;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Stops the threads and frees the transport.
+ *
+ * This does not send anything, the source side must call
+ * TeleporterStreamsFinish first to terminate the stream properly.
+ *
+ * @param   pStreams        The transport handle, NULL is ignored.
+ */
+void TeleporterStreamsDestroy(PTELEPORTERSTREAMS pStreams)
+{
+    if (!pStreams)
+        return;
+
+    ASMAtomicWriteBool(&pStreams->fTerminate, true);
+    for (uint32_t i = 0; i < pStreams->cStreams; i++)
+    {
+        PTELEPORTERSTREAM pStrm = &pStreams->aStreams[i];
+        if (pStrm->hEvtFilled != NIL_RTSEMEVENT)
+            RTSemEventSignal(pStrm->hEvtFilled);
+        if (pStrm->hEvtEmptied != NIL_RTSEMEVENT)
+            RTSemEventSignal(pStrm->hEvtEmptied);
+    }
+
+    for (uint32_t i = 0; i < pStreams->cStreams; i++)
+    {
+        PTELEPORTERSTREAM pStrm = &pStreams->aStreams[i];
+        if (pStrm->hThread != NIL_RTTHREAD)
+        {
+            /* A thread stuck sending or in the middle of a block needs its
+               connection shut down before it notices. */
+            int rc = RTThreadWait(pStrm->hThread, 5 * TELEPORTERSTREAMS_POLL_MS, NULL);
+            if (rc == VERR_TIMEOUT)
+            {
+                LogRel(("Teleporter/Streams: Shutting down connection #%u to unblock its thread\n", i));
+                RTSocketShutdown(pStrm->hSocket, true /*fRead*/, true /*fWrite*/);
+                rc = RTThreadWait(pStrm->hThread, RT_INDEFINITE_WAIT, NULL);
+            }
+            AssertLogRelRC(rc);
+            pStrm->hThread = NIL_RTTHREAD;
+        }
+        RTSemEventDestroy(pStrm->hEvtFilled);
+        RTSemEventDestroy(pStrm->hEvtEmptied);
+        for (uint32_t j = 0; j < TELEPORTERSTREAMS_RING_SIZE; j++)
+            RTMemFree(pStrm->aBlocks[j].pbData);
+        RTMemFree(pStrm->pbZip);
+    }
+
+    RTMemFree(pStreams);
+}
+
+
+/**
+ * Waits for a free block in the ring of the given connection (source side).
+ *
+ * @returns VBox status code.
+ * @param   pStrm           The data connection.
+ */
+static int teleporterStreamsWaitForFree(PTELEPORTERSTREAM pStrm)
+{
+    while (ASMAtomicReadU32(&pStrm->iHead) - ASMAtomicReadU32(&pStrm->iTail) >= TELEPORTERSTREAMS_RING_SIZE)
+    {
+        int rc = ASMAtomicReadS32(&pStrm->rc);
+        if (RT_FAILURE(rc))
+            return rc;
+        RTSemEventWait(pStrm->hEvtEmptied, RT_INDEFINITE_WAIT);
+    }
+    return ASMAtomicReadS32(&pStrm->rc);
+}
+
+
+/**
+ * Hands the current block over to the thread of its connection and moves on
+ * to the next block (source side).
+ *
+ * @param   pStreams        The transport handle.
+ * @param   cbBlock         The block size, 0 or UINT32_MAX for the end marker.
+ */
+static void teleporterStreamsSubmit(PTELEPORTERSTREAMS pStreams, uint32_t cbBlock)
+{
+    PTELEPORTERSTREAM      pStrm  = &pStreams->aStreams[pStreams->iBlock % pStreams->cStreams];
+    TELEPORTERSTREAMBLOCK *pBlock = &pStrm->aBlocks[pStrm->iHead % TELEPORTERSTREAMS_RING_SIZE];
+    pBlock->iBlock  = pStreams->iBlock;
+    pBlock->cbBlock = cbBlock;
+    ASMAtomicIncU32(&pStrm->iHead);
+    RTSemEventSignal(pStrm->hEvtFilled);
+
+    pStreams->iBlock++;
+    pStreams->offBlock = 0;
+}
+
+
+/**
+ * Writes to the stream (source side).
+ *
+ * @returns VBox status code.
+ * @param   pStreams        The transport handle.
+ * @param   pvBuf           The data to write.
+ * @param   cbToWrite       The number of bytes to write.
+ */
+int TeleporterStreamsWrite(PTELEPORTERSTREAMS pStreams, const void *pvBuf, size_t cbToWrite)
+{
+    AssertReturn(pStreams->fWriter, VERR_INVALID_HANDLE);
+    AssertReturn(!pStreams->fFinished, VERR_WRONG_ORDER);
+
+    while (cbToWrite > 0)
+    {
+        PTELEPORTERSTREAM pStrm = &pStreams->aStreams[pStreams->iBlock % pStreams->cStreams];
+        if (!pStreams->offBlock)
+        {
+            int rc = teleporterStreamsWaitForFree(pStrm);
+            if (RT_FAILURE(rc))
+                return rc;
+        }
+
+        TELEPORTERSTREAMBLOCK *pBlock = &pStrm->aBlocks[pStrm->iHead % TELEPORTERSTREAMS_RING_SIZE];
+        size_t cb = RT_MIN(cbToWrite, TELEPORTERSTREAMS_BLOCK_SIZE - pStreams->offBlock);
+        memcpy(&pBlock->pbData[pStreams->offBlock], pvBuf, cb);
+        pStreams->offBlock += (uint32_t)cb;
+        if (pStreams->offBlock == TELEPORTERSTREAMS_BLOCK_SIZE)
+            teleporterStreamsSubmit(pStreams, TELEPORTERSTREAMS_BLOCK_SIZE);
+
+        pvBuf      = (uint8_t const *)pvBuf + cb;
+        cbToWrite -= cb;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Flushes the stream, sends the end marker and waits for everything to be
+ * written (source side).
+ *
+ * @returns VBox status code.
+ * @param   pStreams        The transport handle.
+ * @param   fCanceled       Whether to tell the other side the stream was
+ *                          canceled instead of ending it normally.
+ */
+int TeleporterStreamsFinish(PTELEPORTERSTREAMS pStreams, bool fCanceled)
+{
+    AssertReturn(pStreams->fWriter, VERR_INVALID_HANDLE);
+    AssertReturn(!pStreams->fFinished, VERR_WRONG_ORDER);
+    pStreams->fFinished = true;
+
+    int rc = VINF_SUCCESS;
+    if (pStreams->offBlock && !fCanceled)
+        teleporterStreamsSubmit(pStreams, pStreams->offBlock);
+    pStreams->offBlock = 0;
+    for (uint32_t i = 0; i < pStreams->cStreams && RT_SUCCESS(rc); i++)
+    {
+        rc = teleporterStreamsWaitForFree(&pStreams->aStreams[pStreams->iBlock % pStreams->cStreams]);
+        if (RT_SUCCESS(rc))
+            teleporterStreamsSubmit(pStreams, fCanceled ? UINT32_MAX : 0);
+    }
+
+    for (uint32_t i = 0; i < pStreams->cStreams; i++)
+    {
+        PTELEPORTERSTREAM pStrm = &pStreams->aStreams[i];
+        while (   ASMAtomicReadU32(&pStrm->iTail) != ASMAtomicReadU32(&pStrm->iHead)
+               && RT_SUCCESS(ASMAtomicReadS32(&pStrm->rc)))
+            RTSemEventWait(pStrm->hEvtEmptied, RT_INDEFINITE_WAIT);
+        if (RT_SUCCESS(rc))
+            rc = ASMAtomicReadS32(&pStrm->rc);
+    }
+    return rc;
+}
+
+
+/**
+ * Reads from the stream (target side).
+ *
+ * @returns VBox status code.
+ * @retval  VERR_EOF at the end of the stream or when stopped by
+ *          TeleporterStreamsStopReading.
+ * @retval  VERR_CANCELLED if the source canceled the stream.
+ *
+ * @param   pStreams        The transport handle.
+ * @param   pvBuf           Where to put the data.
+ * @param   cbToRead        How much to read.
+ * @param   pcbRead         Where to return the number of bytes read.  If
+ *                          NULL, all @a cbToRead bytes must be read.
+ */
+int TeleporterStreamsRead(PTELEPORTERSTREAMS pStreams, void *pvBuf, size_t cbToRead, size_t *pcbRead)
+{
+    AssertReturn(!pStreams->fWriter, VERR_INVALID_HANDLE);
+
+    while (cbToRead > 0)
+    {
+        if (pStreams->rcEndOfStream != VINF_SUCCESS)
+            return pStreams->rcEndOfStream;
+
+        /*
+         * Wait for the current block to arrive.
+         */
+        PTELEPORTERSTREAM pStrm = &pStreams->aStreams[pStreams->iBlock % pStreams->cStreams];
+        while (ASMAtomicReadU32(&pStrm->iTail) == ASMAtomicReadU32(&pStrm->iHead))
+        {
+            if (ASMAtomicReadBool(&pStreams->fStopReading))
+                return VERR_EOF;
+            int rc = ASMAtomicReadS32(&pStrm->rc);
+            if (RT_FAILURE(rc))
+                return rc;
+            RTSemEventWait(pStrm->hEvtFilled, RT_INDEFINITE_WAIT);
+        }
+
+        TELEPORTERSTREAMBLOCK *pBlock = &pStrm->aBlocks[pStrm->iTail % TELEPORTERSTREAMS_RING_SIZE];
+        Assert(pBlock->iBlock == pStreams->iBlock);
+        if (pBlock->cbBlock == 0 || pBlock->cbBlock == UINT32_MAX)
+        {
+            pStreams->rcEndOfStream = pBlock->cbBlock ? VERR_CANCELLED : VERR_EOF;
+            continue;
+        }
+
+        /*
+         * Copy out what we can, moving on to the next block when done with this one.
+         */
+        size_t cb = RT_MIN(cbToRead, pBlock->cbBlock - pStreams->offBlock);
+        memcpy(pvBuf, &pBlock->pbData[pStreams->offBlock], cb);
+        pStreams->offBlock += (uint32_t)cb;
+        if (pStreams->offBlock == pBlock->cbBlock)
+        {
+            pStreams->iBlock++;
+            pStreams->offBlock = 0;
+            ASMAtomicIncU32(&pStrm->iTail);
+            RTSemEventSignal(pStrm->hEvtEmptied);
+        }
+
+        if (pcbRead)
+        {
+            *pcbRead = cb;
+            return VINF_SUCCESS;
+        }
+        pvBuf     = (uint8_t *)pvBuf + cb;
+        cbToRead -= cb;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Makes TeleporterStreamsRead return VERR_EOF instead of waiting for data,
+ * or restores normal reading (target side).
+ *
+ * This can be called from any thread.
+ *
+ * @param   pStreams        The transport handle.
+ * @param   fStop           Whether to stop or resume reading.
+ */
+void TeleporterStreamsStopReading(PTELEPORTERSTREAMS pStreams, bool fStop)
+{
+    ASMAtomicWriteBool(&pStreams->fStopReading, fStop);
+    if (fStop)
+        for (uint32_t i = 0; i < pStreams->cStreams; i++)
+            RTSemEventSignal(pStreams->aStreams[i].hEvtFilled);
+}
+
+
+/**
+ * Checks whether the given compression method is available in this build.
+ *
+ * @returns true if supported, false if not.
+ * @param   enmZipType      The compression method.
+ */
+bool TeleporterStreamsIsZipTypeSupported(RTZIPTYPE enmZipType)
+{
+    switch (enmZipType)
+    {
+        case RTZIPTYPE_STORE:
+            return true;
+        case RTZIPTYPE_LZF:
+        case RTZIPTYPE_LZ4:
+        case RTZIPTYPE_ZSTD:
+        {
+            /* The codecs are optional, so try it out. */
+            uint8_t abSrc[256];
+            uint8_t abDst[sizeof(abSrc)];
+            size_t  cbDst = 0;
+            RT_ZERO(abSrc);
+            return RT_SUCCESS(RTZipBlockCompress(enmZipType, RTZIPLEVEL_FAST, 0 /*fFlags*/, abSrc, sizeof(abSrc),
+                                                 abDst, sizeof(abDst), &cbDst));
+        }
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * Gets the protocol name of a compression method.
+ *
+ * @returns Name, NULL if not usable for the transport.
+ * @param   enmZipType      The compression method.
+ */
+const char *TeleporterStreamsZipTypeName(RTZIPTYPE enmZipType)
+{
+    switch (enmZipType)
+    {
+        case RTZIPTYPE_STORE:   return "none";
+        case RTZIPTYPE_LZF:     return "lzf";
+        case RTZIPTYPE_LZ4:     return "lz4";
+        case RTZIPTYPE_ZSTD:    return "zstd";
+        default:                return NULL;
+    }
+}
+
+
+/**
+ * Looks up a compression method by its protocol name.
+ *
+ * @returns The compression method, RTZIPTYPE_INVALID if unknown.
+ * @param   pszName         The name as returned by TeleporterStreamsZipTypeName.
+ */
+RTZIPTYPE TeleporterStreamsZipTypeFromName(const char *pszName)
+{
+    static RTZIPTYPE const s_aenmTypes[] = { RTZIPTYPE_STORE, RTZIPTYPE_LZF, RTZIPTYPE_LZ4, RTZIPTYPE_ZSTD };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_aenmTypes); i++)
+        if (!strcmp(pszName, TeleporterStreamsZipTypeName(s_aenmTypes[i])))
+            return s_aenmTypes[i];
+    return RTZIPTYPE_INVALID;
+}
+
@@ -0,0 +1,42 @@
+/* $Id$ */
+/** @file
+ * Compressed, multi-stream transport for the teleporter.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ____H_TELEPORTERSTREAMS
+#define ____H_TELEPORTERSTREAMS
+
+#include <iprt/socket.h>
+#include <iprt/zip.h>
+
+/** The max number of data connections. */
+#define TELEPORTERSTREAMS_MAX_STREAMS   8
+
+struct TELEPORTERSTREAMS;
+typedef struct TELEPORTERSTREAMS *PTELEPORTERSTREAMS;
+
+int         TeleporterStreamsCreate(PTELEPORTERSTREAMS *ppStreams, bool fWriter, RTSOCKET const *pahSockets,
+                                    uint32_t cSockets, RTZIPTYPE enmZipType);
+void        TeleporterStreamsDestroy(PTELEPORTERSTREAMS pStreams);
+int         TeleporterStreamsWrite(PTELEPORTERSTREAMS pStreams, const void *pvBuf, size_t cbToWrite);
+int         TeleporterStreamsFinish(PTELEPORTERSTREAMS pStreams, bool fCanceled);
+int         TeleporterStreamsRead(PTELEPORTERSTREAMS pStreams, void *pvBuf, size_t cbToRead, size_t *pcbRead);
+void        TeleporterStreamsStopReading(PTELEPORTERSTREAMS pStreams, bool fStop);
+bool        TeleporterStreamsIsZipTypeSupported(RTZIPTYPE enmZipType);
+const char *TeleporterStreamsZipTypeName(RTZIPTYPE enmZipType);
+RTZIPTYPE   TeleporterStreamsZipTypeFromName(const char *pszName);
+
+#endif /* !____H_TELEPORTERSTREAMS */
+
@@ -397,12 +397,15 @@ HRESULT Machine::init(VirtualBox *aParent,
  *  @param aConfigFile  Local file system path to the VM settings file (can
  *                      be relative to the VirtualBox config directory).
  *  @param aId          UUID of the machine or NULL (see above).
+ *  @param pPreloadedConfig The settings file already parsed by the caller, or
+ *                      NULL to parse it here. The machine takes ownership.
  *
  *  @return  Success indicator. if not S_OK, the machine object is invalid
  */
 HRESULT Machine::initFromSettings(VirtualBox *aParent,
                                   const Utf8Str &strConfigFile,
-                                  const Guid *aId)
+                                  const Guid *aId,
+                                  settings::MachineConfigFile *pPreloadedConfig /* = NULL */)
 {
     LogFlowThisFuncEnter();
     LogFlowThisFunc(("(Init_Registered) aConfigFile='%s\n", strConfigFile.c_str()));
@@ -412,7 +415,15 @@ HRESULT Machine::initFromSettings(VirtualBox *aParent,
     AssertReturn(autoInitSpan.isOk(), E_FAIL);
 
     HRESULT rc = initImpl(aParent, strConfigFile);
-    if (FAILED(rc)) return rc;
+    if (FAILED(rc))
+    {
+        delete pPreloadedConfig;
+        return rc;
+    }
+
+    /* the settings file parsed ahead of time is used instead of reading it
+     * again below, mData owns it from now on */
+    mData->pMachineConfigFile = pPreloadedConfig;
 
     if (aId)
     {
@@ -436,7 +447,8 @@ HRESULT Machine::initFromSettings(VirtualBox *aParent,
             try
             {
                 // load and parse machine XML; this will throw on XML or logic errors
-                mData->pMachineConfigFile = new settings::MachineConfigFile(&mData->m_strConfigFileFull);
+                if (!mData->pMachineConfigFile)
+                    mData->pMachineConfigFile = new settings::MachineConfigFile(&mData->m_strConfigFileFull);
 
                 // reject VM UUID duplicates, they can happen if someone
                 // tries to register an already known VM config again
@@ -707,8 +719,10 @@ HRESULT Machine::registeredInit()
 
         try
         {
-            // load and parse machine XML; this will throw on XML or logic errors
-            mData->pMachineConfigFile = new settings::MachineConfigFile(&mData->m_strConfigFileFull);
+            // load and parse machine XML unless initFromSettings() got it
+            // preloaded; this will throw on XML or logic errors
+            if (!mData->pMachineConfigFile)
+                mData->pMachineConfigFile = new settings::MachineConfigFile(&mData->m_strConfigFileFull);
 
             if (mData->mUuid != mData->pMachineConfigFile->uuid)
                 throw setError(E_FAIL,
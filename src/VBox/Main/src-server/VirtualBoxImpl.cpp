@@ -22,6 +22,7 @@
 #include <iprt/dir.h>
 #include <iprt/env.h>
 #include <iprt/file.h>
+#include <iprt/mp.h>
 #include <iprt/path.h>
 #include <iprt/process.h>
 #include <iprt/rand.h>
@@ -29,6 +30,7 @@
 #include <iprt/string.h>
 #include <iprt/stream.h>
 #include <iprt/thread.h>
+#include <iprt/time.h>
 #include <iprt/uuid.h>
 #include <iprt/cpp/xml.h>
 
@@ -54,6 +56,7 @@
 #include "Global.h"
 #include "MachineImpl.h"
 #include "MediumImpl.h"
+#include "MediumLocationIndex.h"
 #include "SharedFolderImpl.h"
 #include "ProgressImpl.h"
 #include "ProgressProxyImpl.h"
@@ -90,6 +93,9 @@
 
 #define VBOX_GLOBAL_SETTINGS_FILE "VirtualBox.xml"
 
+/** Max number of threads parsing machine settings files at startup. */
+#define VBOX_MAX_SETTINGS_LOADERS 8
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Global variables
@@ -171,6 +177,7 @@ typedef ObjectsList<NATNetwork> NATNetworksOList;
 
 typedef std::map<Guid, ComPtr<IProgress> > ProgressMap;
 typedef std::map<Guid, ComObjPtr<Medium> > HardDiskMap;
+typedef MediumLocationIndex<Medium *> MediaLocationIndex;
 
 /**
  *  Main VirtualBox data structure.
@@ -257,6 +264,25 @@ struct VirtualBox::Data
     // and contains ALL hard disks (base and differencing); it is protected by
     // the same lock as the other media lists above
     HardDiskMap                         mapHardDisks;
+    // the location indexes map the full location of every registered medium
+    // (again including differencing hard disks) to the medium object, so that
+    // lookups by location need not compare against every medium; they are
+    // protected by the media lock as well and must be kept up to date
+    // whenever a registered medium is added, removed or moved
+    MediaLocationIndex                  idxHardDiskLocations,
+                                        idxDVDImageLocations,
+                                        idxFloppyImageLocations;
+
+    MediaLocationIndex *locationIndexFor(DeviceType_T enmDevType)
+    {
+        switch (enmDevType)
+        {
+            case DeviceType_HardDisk:   return &idxHardDiskLocations;
+            case DeviceType_DVD:        return &idxDVDImageLocations;
+            case DeviceType_Floppy:     return &idxFloppyImageLocations;
+            default:                    return NULL;
+        }
+    }
 
     // list of pending machine renames (also protected by media tree lock;
     // see VirtualBox::rememberMachineNameChangeForMedia())
@@ -588,30 +614,127 @@ HRESULT VirtualBox::init()
     return rc;
 }
 
+/**
+ * Work shared by the threads preloading machine settings files, see
+ * initMachines().
+ */
+struct MachineConfigPreload
+{
+    /** Full paths of the settings files (empty if unknown). */
+    std::vector<Utf8Str>                        vecFiles;
+    /** The parsed settings files, NULL where parsing failed. */
+    std::vector<settings::MachineConfigFile *>  vecConfigs;
+    /** The next file to parse. */
+    uint32_t volatile                           iNext;
+};
+
+/**
+ * Thread parsing machine settings files until there are none left.
+ *
+ * Failures are not reported, the file is simply left to Machine to parse
+ * again so that the error ends up in the machine's access error.
+ */
+static DECLCALLBACK(int) preloadMachineConfigsThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    NOREF(hThreadSelf);
+    MachineConfigPreload *pPreload = (MachineConfigPreload *)pvUser;
+
+    for (;;)
+    {
+        uint32_t i = ASMAtomicIncU32(&pPreload->iNext) - 1;
+        if (i >= pPreload->vecFiles.size())
+            break;
+        if (pPreload->vecFiles[i].isEmpty())
+            continue;
+        try
+        {
+            pPreload->vecConfigs[i] = new settings::MachineConfigFile(&pPreload->vecFiles[i]);
+        }
+        catch (...)
+        {
+            pPreload->vecConfigs[i] = NULL;
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
 HRESULT VirtualBox::initMachines()
 {
-    for (settings::MachinesRegistry::const_iterator it = m->pMainConfigFile->llMachines.begin();
-         it != m->pMainConfigFile->llMachines.end();
+    const settings::MachinesRegistry &llMachines = m->pMainConfigFile->llMachines;
+    uint64_t const msStart = RTTimeMilliTS();
+
+    /*
+     * Parse the machine settings files on a few threads first, this is what
+     * takes the time with many machines. Creating the Machine objects and
+     * merging their media registries happens one by one afterwards.
+     */
+    MachineConfigPreload preload;
+    preload.iNext = 0;
+    preload.vecConfigs.resize(llMachines.size(), NULL);
+    for (settings::MachinesRegistry::const_iterator it = llMachines.begin();
+         it != llMachines.end();
          ++it)
     {
-        HRESULT rc = S_OK;
+        Utf8Str strFull;
+        if (RT_FAILURE(i_calculateFullPath(it->strSettingsFile, strFull)))
+            strFull.setNull();
+        preload.vecFiles.push_back(strFull);
+    }
+
+    RTTHREAD ahThreads[VBOX_MAX_SETTINGS_LOADERS];
+    unsigned cThreads = RT_MIN(RTMpGetOnlineCount(), RT_ELEMENTS(ahThreads));
+    cThreads = (unsigned)RT_MIN(cThreads, llMachines.size() / 4);
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        int vrc = RTThreadCreateF(&ahThreads[i], preloadMachineConfigsThread, &preload, 0,
+                                  RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "SettingsLoad%u", i);
+        if (RT_FAILURE(vrc))
+        {
+            cThreads = i;
+            break;
+        }
+    }
+    for (unsigned i = 0; i < cThreads; i++)
+        RTThreadWait(ahThreads[i], RT_INDEFINITE_WAIT, NULL);
+
+    HRESULT rc = S_OK;
+    size_t i = 0;
+    for (settings::MachinesRegistry::const_iterator it = llMachines.begin();
+         it != llMachines.end();
+         ++it, ++i)
+    {
         const settings::MachineRegistryEntry &xmlMachine = *it;
         Guid uuid = xmlMachine.uuid;
 
+        /* hand the parsed settings over to the machine, which owns them now */
+        settings::MachineConfigFile *pConfig = preload.vecConfigs[i];
+        preload.vecConfigs[i] = NULL;
+
         ComObjPtr<Machine> pMachine;
         if (SUCCEEDED(rc = pMachine.createObject()))
         {
             rc = pMachine->initFromSettings(this,
                                             xmlMachine.strSettingsFile,
-                                            &uuid);
+                                            &uuid,
+                                            pConfig);
             if (SUCCEEDED(rc))
                 rc = i_registerMachine(pMachine);
             if (FAILED(rc))
-                return rc;
+                break;
         }
+        else
+            delete pConfig;
     }
 
-    return S_OK;
+    /* free whatever wasn't handed over because of a failure */
+    for (i = 0; i < preload.vecConfigs.size(); i++)
+        delete preload.vecConfigs[i];
+
+    if (SUCCEEDED(rc))
+        LogRel(("Loaded %zu machine(s) in %RU64 ms using %u settings loader thread(s)\n",
+                llMachines.size(), RTTimeMilliTS() - msStart, cThreads));
+    return rc;
 }
 
 /**
@@ -743,6 +866,9 @@ void VirtualBox::uninit()
     m->allFloppyImages.uninitAll();
     m->allDVDImages.uninitAll();
     m->allHardDisks.uninitAll();
+    m->idxFloppyImageLocations.clear();
+    m->idxDVDImageLocations.clear();
+    m->idxHardDiskLocations.clear();
     m->allDHCPServers.uninitAll();
 
     m->mapProgressOperations.clear();
@@ -3295,24 +3421,15 @@ HRESULT VirtualBox::i_findHardDiskByLocation(const Utf8Str &strLocation,
     // hard disk _list_ lock handle
     AutoReadLock alock(m->allHardDisks.getLockHandle() COMMA_LOCKVAL_SRC_POS);
 
-    for (HardDiskMap::const_iterator it = m->mapHardDisks.begin();
-         it != m->mapHardDisks.end();
-         ++it)
+    Medium *pHD;
+    if (m->idxHardDiskLocations.find(strLocation, &pHD))
     {
-        const ComObjPtr<Medium> &pHD = (*it).second;
-
         AutoCaller autoCaller(pHD);
         if (FAILED(autoCaller.rc())) return autoCaller.rc();
-        AutoWriteLock mlock(pHD COMMA_LOCKVAL_SRC_POS);
-
-        Utf8Str strLocationFull = pHD->i_getLocationFull();
 
-        if (0 == RTPathCompare(strLocationFull.c_str(), strLocation.c_str()))
-        {
-            if (aHardDisk)
-                *aHardDisk = pHD;
-            return S_OK;
-        }
+        if (aHardDisk)
+            *aHardDisk = pHD;
+        return S_OK;
     }
 
     if (aSetError)
@@ -3378,37 +3495,43 @@ HRESULT VirtualBox::i_findDVDOrFloppyImage(DeviceType_T mediumType,
     AutoReadLock alock(pMediaList->getLockHandle() COMMA_LOCKVAL_SRC_POS);
 
     bool found = false;
+    Medium *pMedium = NULL;
+
+    // the location is looked up in the index; an ID still needs a walk over
+    // the list, but images are rarely looked up by ID alone
+    if (!aLocation.isEmpty())
+        found = m->locationIndexFor(mediumType)->find(location, &pMedium);
 
     for (MediaList::const_iterator it = pMediaList->begin();
-         it != pMediaList->end();
+         !found && aId && it != pMediaList->end();
          ++it)
     {
         // no AutoCaller, registered image life time is bound to this
-        Medium *pMedium = *it;
+        AutoReadLock imageLock(*it COMMA_LOCKVAL_SRC_POS);
+        if ((*it)->i_getId() == *aId)
+        {
+            pMedium = *it;
+            found = true;
+        }
+    }
+
+    if (found)
+    {
         AutoReadLock imageLock(pMedium COMMA_LOCKVAL_SRC_POS);
         const Utf8Str &strLocationFull = pMedium->i_getLocationFull();
 
-        found =     (    aId
-                      && pMedium->i_getId() == *aId)
-                 || (    !aLocation.isEmpty()
-                      && RTPathCompare(location.c_str(),
-                                       strLocationFull.c_str()) == 0);
-        if (found)
+        if (pMedium->i_getDeviceType() != mediumType)
         {
-            if (pMedium->i_getDeviceType() != mediumType)
-            {
-                if (mediumType == DeviceType_DVD)
-                    return setError(E_INVALIDARG,
-                                    "Cannot mount DVD medium '%s' as floppy", strLocationFull.c_str());
-                else
-                    return setError(E_INVALIDARG,
-                                    "Cannot mount floppy medium '%s' as DVD", strLocationFull.c_str());
-            }
-
-            if (aImage)
-                *aImage = pMedium;
-            break;
+            if (mediumType == DeviceType_DVD)
+                return setError(E_INVALIDARG,
+                                "Cannot mount DVD medium '%s' as floppy", strLocationFull.c_str());
+            else
+                return setError(E_INVALIDARG,
+                                "Cannot mount floppy medium '%s' as DVD", strLocationFull.c_str());
         }
+
+        if (aImage)
+            *aImage = pMedium;
     }
 
     HRESULT rc = found ? S_OK : VBOX_E_OBJECT_NOT_FOUND;
@@ -3889,10 +4012,23 @@ void VirtualBox::i_saveMediaRegistry(settings::MediaRegistry &mediaRegistry,
                  ++it2)
             {
                 const Data::PendingMachineRename &pmr = *it2;
+                Utf8Str strLocationOld;
+                DeviceType_T devType;
+                {
+                    AutoReadLock mlock(pMedium COMMA_LOCKVAL_SRC_POS);
+                    strLocationOld = pMedium->i_getLocationFull();
+                    devType = pMedium->i_getDeviceType();
+                }
                 HRESULT rc = pMedium->i_updatePath(pmr.strConfigDirOld,
                                                    pmr.strConfigDirNew);
                 if (SUCCEEDED(rc))
                 {
+                    // the medium moved, re-index it under its new location
+                    MediaLocationIndex *pIdx = m->locationIndexFor(devType);
+                    pIdx->remove(strLocationOld, pMedium);
+                    AutoReadLock mlock(pMedium COMMA_LOCKVAL_SRC_POS);
+                    pIdx->add(pMedium->i_getLocationFull(), pMedium);
+
                     // Remember which medium objects has been changed,
                     // to trigger saving their registries later.
                     pDesc->llMedia.push_back(pMedium);
@@ -4221,6 +4357,8 @@ HRESULT VirtualBox::i_registerMedium(const ComObjPtr<Medium> &pMedium,
         if (argType == DeviceType_HardDisk)
             m->mapHardDisks[id] = pMedium;
 
+        m->locationIndexFor(argType)->add(strLocationFull, pMedium);
+
         *ppMedium = pMedium;
     }
     else
@@ -4257,11 +4395,13 @@ HRESULT VirtualBox::i_unregisterMedium(Medium *pMedium)
     Assert(i_getMediaTreeLockHandle().isWriteLockOnCurrentThread());
 
     Guid id;
+    Utf8Str strLocationFull;
     ComObjPtr<Medium> pParent;
     DeviceType_T devType;
     {
         AutoReadLock mediumLock(pMedium COMMA_LOCKVAL_SRC_POS);
         id = pMedium->i_getId();
+        strLocationFull = pMedium->i_getLocationFull();
         pParent = pMedium->i_getParent();
         devType = pMedium->i_getDeviceType();
     }
@@ -4294,6 +4434,10 @@ HRESULT VirtualBox::i_unregisterMedium(Medium *pMedium)
         NOREF(cnt);
     }
 
+    bool fRemoved = m->locationIndexFor(devType)->remove(strLocationFull, pMedium);
+    Assert(fRemoved);
+    NOREF(fRemoved);
+
     return S_OK;
 }
 
@@ -0,0 +1,160 @@
+/* $Id$ */
+/** @file
+ * Medium location index testcase - correctness and lookup speed compared
+ * to walking a list.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include "../include/MediumLocationIndex.h"
+
+#include <iprt/err.h>
+#include <iprt/path.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+#include <vector>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** Number of registered media simulated by the benchmark. */
+#define TST_MEDIA_COUNT     20000
+/** Number of lookups timed by the benchmark. */
+#define TST_LOOKUPS         2000
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The test handle. */
+static RTTEST g_hTest;
+
+
+static com::Utf8Str tstLocation(unsigned i)
+{
+    return com::Utf8StrFmt("/home/user/VirtualBox VMs/vm%u/Snapshots/{%08x-1234-5678-9abc-def012345678}.vdi", i / 16, i);
+}
+
+
+static void tstBasics(void)
+{
+    RTTestSub(g_hTest, "Basics");
+
+    MediumLocationIndex<uintptr_t> idx;
+    uintptr_t uObj = 0;
+    RTTESTI_CHECK(!idx.find("/nowhere", &uObj));
+
+    for (unsigned i = 0; i < 1000; i++)
+        idx.add(tstLocation(i), i + 1);
+    RTTESTI_CHECK(idx.size() == 1000);
+    for (unsigned i = 0; i < 1000; i++)
+    {
+        uObj = 0;
+        RTTESTI_CHECK(idx.find(tstLocation(i), &uObj));
+        RTTESTI_CHECK(uObj == i + 1);
+    }
+    RTTESTI_CHECK(!idx.find(tstLocation(1000), NULL));
+
+    /* Duplicate locations return the object added first until it's removed. */
+    idx.add(tstLocation(7), 4242);
+    RTTESTI_CHECK(idx.find(tstLocation(7), &uObj) && uObj == 8);
+    RTTESTI_CHECK(idx.remove(tstLocation(7), 8));
+    RTTESTI_CHECK(idx.find(tstLocation(7), &uObj) && uObj == 4242);
+    RTTESTI_CHECK(idx.remove(tstLocation(7), 4242));
+    RTTESTI_CHECK(!idx.find(tstLocation(7), NULL));
+
+    /* A stale location must not prevent removal. */
+    RTTESTI_CHECK(idx.remove("/moved/elsewhere.vdi", 10));
+    RTTESTI_CHECK(!idx.find(tstLocation(9), NULL));
+    RTTESTI_CHECK(!idx.remove(tstLocation(9), 10));
+    RTTESTI_CHECK(idx.size() == 998);
+
+    /* Lookups must agree with RTPathCompare about case and slashes. */
+    idx.add("/Some/Path/Disk.vdi", 77);
+    bool fFound = idx.find("/some/path/disk.vdi", NULL);
+    RTTESTI_CHECK(fFound == (RTPathCompare("/Some/Path/Disk.vdi", "/some/path/disk.vdi") == 0));
+    fFound = idx.find("\\Some\\Path\\Disk.vdi", NULL);
+    RTTESTI_CHECK(fFound == (RTPathCompare("/Some/Path/Disk.vdi", "\\Some\\Path\\Disk.vdi") == 0));
+    RTTESTI_CHECK(idx.find("/Some/Path/Disk.vdi", NULL));
+
+    idx.clear();
+    RTTESTI_CHECK(idx.size() == 0);
+    RTTESTI_CHECK(!idx.find(tstLocation(0), NULL));
+}
+
+
+static void tstBenchmark(void)
+{
+    RTTestSub(g_hTest, "Benchmark");
+
+    std::vector<com::Utf8Str> vecLocations;
+    MediumLocationIndex<uintptr_t> idx;
+    for (unsigned i = 0; i < TST_MEDIA_COUNT; i++)
+    {
+        vecLocations.push_back(tstLocation(i));
+        idx.add(vecLocations.back(), i);
+    }
+
+    /* Look up locations spread over the whole range, like a media registry
+       being loaded would. */
+    unsigned cFound = 0;
+    uint64_t nsStart = RTTimeNanoTS();
+    for (unsigned i = 0; i < TST_LOOKUPS; i++)
+    {
+        com::Utf8Str strLocation = tstLocation(i * (TST_MEDIA_COUNT / TST_LOOKUPS));
+        for (size_t j = 0; j < vecLocations.size(); j++)
+            if (RTPathCompare(vecLocations[j].c_str(), strLocation.c_str()) == 0)
+            {
+                cFound++;
+                break;
+            }
+    }
+    uint64_t cNsLinear = RTTimeNanoTS() - nsStart;
+    RTTESTI_CHECK(cFound == TST_LOOKUPS);
+
+    cFound = 0;
+    nsStart = RTTimeNanoTS();
+    for (unsigned i = 0; i < TST_LOOKUPS; i++)
+    {
+        uintptr_t uObj;
+        if (idx.find(tstLocation(i * (TST_MEDIA_COUNT / TST_LOOKUPS)), &uObj))
+            cFound++;
+    }
+    uint64_t cNsIndexed = RTTimeNanoTS() - nsStart;
+    RTTESTI_CHECK(cFound == TST_LOOKUPS);
+
+    RTTestValue(g_hTest, "Linear lookup", cNsLinear / TST_LOOKUPS, RTTESTUNIT_NS_PER_CALL);
+    RTTestValue(g_hTest, "Indexed lookup", cNsIndexed / TST_LOOKUPS, RTTESTUNIT_NS_PER_CALL);
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstMediumLocationIndex", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    tstBasics();
+    tstBenchmark();
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
@@ -0,0 +1,321 @@
+/* $Id$ */
+/** @file
+ * Teleporter transport testcase - loopback transfers over the compressed,
+ * multi-stream transport.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include "../src-client/TeleporterStreams.h"
+
+#include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/string.h>
+#include <iprt/tcp.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Arguments for the writer thread.
+ */
+typedef struct TSTWRITER
+{
+    RTSOCKET    ahSockets[TELEPORTERSTREAMS_MAX_STREAMS];
+    uint32_t    cSockets;
+    RTZIPTYPE   enmZipType;
+    /** How much to write before finishing the stream. */
+    size_t      cbToWrite;
+    /** Whether to cancel the stream instead of ending it. */
+    bool        fCancel;
+} TSTWRITER;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The test handle. */
+static RTTEST g_hTest;
+/** The loopback server. */
+static PRTTCPSERVER g_pServer;
+/** The port g_pServer is listening on. */
+static uint32_t g_uPort;
+/** The test data. */
+static uint8_t *g_pbData;
+/** Size of the test data. */
+static size_t const g_cbData = 16 * _1M;
+
+
+/**
+ * Fills the test data with something resembling guest memory: a mix of zero,
+ * patterned and random pages.
+ */
+static void tstInitData(void)
+{
+    for (size_t off = 0; off < g_cbData; off += _4K)
+    {
+        uint8_t *pbPage = &g_pbData[off];
+        switch (RTRandU32Ex(0, 3))
+        {
+            case 0:
+                memset(pbPage, 0, _4K);
+                break;
+            case 1:
+                for (unsigned i = 0; i < _4K; i++)
+                    pbPage[i] = (uint8_t)(i * 7 + off / _4K);
+                break;
+            case 2:
+                memset(pbPage, 0, _4K);
+                for (unsigned i = 0; i < 64; i++)
+                    pbPage[RTRandU32Ex(0, _4K - 1)] = (uint8_t)RTRandU32();
+                break;
+            default:
+                RTRandBytes(pbPage, _4K);
+                break;
+        }
+    }
+}
+
+
+/**
+ * Writer thread, plays the source side.
+ */
+static DECLCALLBACK(int) tstWriterThread(RTTHREAD hThread, void *pvUser)
+{
+    TSTWRITER *pArgs = (TSTWRITER *)pvUser;
+
+    PTELEPORTERSTREAMS pStreams;
+    int rc = TeleporterStreamsCreate(&pStreams, true /*fWriter*/, pArgs->ahSockets, pArgs->cSockets, pArgs->enmZipType);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* SSM writes in all kinds of sizes, so mix it up. */
+    size_t off = 0;
+    while (off < pArgs->cbToWrite && RT_SUCCESS(rc))
+    {
+        size_t cb = RT_MIN(pArgs->cbToWrite - off, RTRandU32Ex(1, _128K));
+        rc = TeleporterStreamsWrite(pStreams, &g_pbData[off], cb);
+        off += cb;
+    }
+    int rc2 = TeleporterStreamsFinish(pStreams, pArgs->fCancel);
+    if (RT_SUCCESS(rc))
+        rc = rc2;
+
+    TeleporterStreamsDestroy(pStreams);
+    return rc;
+}
+
+
+/**
+ * Transfers the test data from one end of a set of loopback connections to
+ * the other and checks that it arrives intact.
+ *
+ * @param   enmZipType      The compression method.
+ * @param   cStreams        The number of connections.
+ * @param   fCancel         Cancel the stream half way.
+ */
+static void tstTransfer(RTZIPTYPE enmZipType, uint32_t cStreams, bool fCancel)
+{
+    RTTestSubF(g_hTest, "%s, %u stream(s)%s", TeleporterStreamsZipTypeName(enmZipType), cStreams, fCancel ? ", canceled" : "");
+
+    /*
+     * Connect.  The connections are accepted in the order they are made.
+     */
+    TSTWRITER   Args;
+    RTSOCKET    ahServerSockets[TELEPORTERSTREAMS_MAX_STREAMS];
+    uint32_t    i;
+    Args.cSockets   = 0;
+    Args.enmZipType = enmZipType;
+    Args.cbToWrite  = fCancel ? g_cbData / 2 + 1234 : g_cbData;
+    Args.fCancel    = fCancel;
+    for (i = 0; i < cStreams; i++)
+    {
+        RTTESTI_CHECK_RC_BREAK(RTTcpClientConnect("127.0.0.1", g_uPort, &Args.ahSockets[i]), VINF_SUCCESS);
+        int rc = RTTcpServerListen2(g_pServer, &ahServerSockets[i]);
+        if (RT_FAILURE(rc))
+        {
+            RTTestIFailed("RTTcpServerListen2 -> %Rrc", rc);
+            RTTcpClientClose(Args.ahSockets[i]);
+            break;
+        }
+        Args.cSockets++;
+    }
+
+    /*
+     * Transfer the data.
+     */
+    if (Args.cSockets == cStreams)
+    {
+        PTELEPORTERSTREAMS pStreams = NULL;
+        RTTHREAD           hThread  = NIL_RTTHREAD;
+        int rc = TeleporterStreamsCreate(&pStreams, false /*fWriter*/, ahServerSockets, cStreams, enmZipType);
+        if (RT_SUCCESS(rc))
+            rc = RTThreadCreate(&hThread, tstWriterThread, &Args, 0, RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "writer");
+        if (RT_SUCCESS(rc))
+        {
+            uint8_t *pbBuf   = (uint8_t *)RTMemAlloc(_256K);
+            uint64_t nsStart = RTTimeNanoTS();
+            size_t   off     = 0;
+            while (off < Args.cbToWrite && pbBuf)
+            {
+                size_t cbRead = RT_MIN(Args.cbToWrite - off, RTRandU32Ex(1, _256K));
+                if (RTRandU32Ex(0, 1))
+                    rc = TeleporterStreamsRead(pStreams, pbBuf, cbRead, &cbRead);
+                else
+                    rc = TeleporterStreamsRead(pStreams, pbBuf, cbRead, NULL);
+                if (RT_FAILURE(rc))
+                    break;
+                if (memcmp(pbBuf, &g_pbData[off], cbRead))
+                {
+                    RTTestIFailed("Data mismatch at offset %#zx (cb=%#zx)", off, cbRead);
+                    break;
+                }
+                off += cbRead;
+            }
+            uint64_t cNsElapsed = RTTimeNanoTS() - nsStart;
+
+            if (!pbBuf)
+                RTTestIFailed("Out of memory");
+            else if (fCancel)
+            {
+                /* Whatever got through before the cancelation must be intact, the rest is dropped. */
+                while (RT_SUCCESS(rc))
+                    rc = TeleporterStreamsRead(pStreams, pbBuf, 1, NULL);
+                if (rc != VERR_CANCELLED)
+                    RTTestIFailed("Expected VERR_CANCELLED at offset %#zx, got %Rrc", off, rc);
+            }
+            else if (RT_FAILURE(rc))
+                RTTestIFailed("TeleporterStreamsRead failed at offset %#zx: %Rrc", off, rc);
+            else if (off == Args.cbToWrite)
+            {
+                RTTestValueF(g_hTest, (uint64_t)off * RT_NS_1SEC / _1M / RT_MAX(cNsElapsed, 1),
+                             RTTESTUNIT_MEGABYTES_PER_SEC, "%s, %u stream(s)", TeleporterStreamsZipTypeName(enmZipType), cStreams);
+
+                /* The end of the stream is sticky. */
+                RTTESTI_CHECK_RC(TeleporterStreamsRead(pStreams, pbBuf, 1, NULL), VERR_EOF);
+                RTTESTI_CHECK_RC(TeleporterStreamsRead(pStreams, pbBuf, 1, NULL), VERR_EOF);
+            }
+            RTMemFree(pbBuf);
+        }
+        else
+            RTTestIFailed("Setting up the transfer failed: %Rrc", rc);
+
+        /* Close our end before waiting so a stuck writer fails instead of hanging. */
+        TeleporterStreamsDestroy(pStreams);
+        for (i = 0; i < cStreams; i++)
+            RTTcpServerDisconnectClient2(ahServerSockets[i]);
+        if (hThread != NIL_RTTHREAD)
+        {
+            int rcThread = VERR_INTERNAL_ERROR;
+            RTTESTI_CHECK_RC(RTThreadWait(hThread, RT_INDEFINITE_WAIT, &rcThread), VINF_SUCCESS);
+            RTTESTI_CHECK_RC(rcThread, VINF_SUCCESS);
+        }
+    }
+    else
+        for (i = 0; i < Args.cSockets; i++)
+            RTTcpServerDisconnectClient2(ahServerSockets[i]);
+
+    for (i = 0; i < Args.cSockets; i++)
+        RTTcpClientClose(Args.ahSockets[i]);
+}
+
+
+/**
+ * Checks that a reader blocked on an idle stream can be stopped.
+ */
+static void tstStopReading(void)
+{
+    RTTestSub(g_hTest, "Stop reading");
+
+    RTSOCKET hClient;
+    RTSOCKET hServer;
+    RTTESTI_CHECK_RC_RETV(RTTcpClientConnect("127.0.0.1", g_uPort, &hClient), VINF_SUCCESS);
+    int rc = RTTcpServerListen2(g_pServer, &hServer);
+    if (RT_SUCCESS(rc))
+    {
+        PTELEPORTERSTREAMS pStreams;
+        RTTESTI_CHECK_RC(rc = TeleporterStreamsCreate(&pStreams, false /*fWriter*/, &hServer, 1, RTZIPTYPE_STORE), VINF_SUCCESS);
+        if (RT_SUCCESS(rc))
+        {
+            uint8_t b;
+            TeleporterStreamsStopReading(pStreams, true);
+            RTTESTI_CHECK_RC(TeleporterStreamsRead(pStreams, &b, 1, NULL), VERR_EOF);
+            TeleporterStreamsStopReading(pStreams, false);
+            TeleporterStreamsDestroy(pStreams);
+        }
+        RTTcpServerDisconnectClient2(hServer);
+    }
+    else
+        RTTestIFailed("RTTcpServerListen2 -> %Rrc", rc);
+    RTTcpClientClose(hClient);
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstTeleporterStreams", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    /*
+     * Set up a loopback server on some random port.
+     */
+    int rc = VERR_NET_ADDRESS_IN_USE;
+    for (unsigned cTries = 0; cTries < 256 && rc == VERR_NET_ADDRESS_IN_USE; cTries++)
+    {
+        g_uPort = RTRandU32Ex(49152, 65534);
+        rc = RTTcpServerCreateEx("127.0.0.1", g_uPort, &g_pServer);
+    }
+    if (RT_FAILURE(rc))
+        return RTTestSkipAndDestroy(g_hTest, "Failed to create loopback server: %Rrc", rc);
+
+    g_pbData = (uint8_t *)RTMemAlloc(g_cbData);
+    if (g_pbData)
+    {
+        tstInitData();
+
+        static RTZIPTYPE const s_aenmZipTypes[] = { RTZIPTYPE_STORE, RTZIPTYPE_LZF, RTZIPTYPE_LZ4, RTZIPTYPE_ZSTD };
+        static uint32_t  const s_acStreams[]    = { 1, 3, TELEPORTERSTREAMS_MAX_STREAMS };
+        for (unsigned iZip = 0; iZip < RT_ELEMENTS(s_aenmZipTypes); iZip++)
+        {
+            if (!TeleporterStreamsIsZipTypeSupported(s_aenmZipTypes[iZip]))
+            {
+                RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "Skipping %s, not supported by this build\n",
+                             TeleporterStreamsZipTypeName(s_aenmZipTypes[iZip]));
+                continue;
+            }
+            for (unsigned iStreams = 0; iStreams < RT_ELEMENTS(s_acStreams); iStreams++)
+                tstTransfer(s_aenmZipTypes[iZip], s_acStreams[iStreams], false /*fCancel*/);
+            tstTransfer(s_aenmZipTypes[iZip], 3, true /*fCancel*/);
+        }
+        tstStopReading();
+
+        RTMemFree(g_pbData);
+    }
+    else
+        RTTestFailed(g_hTest, "Out of memory");
+
+    RTTcpServerDestroy(g_pServer);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
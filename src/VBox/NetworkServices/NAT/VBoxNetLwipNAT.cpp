@@ -96,6 +96,7 @@ extern "C"
 #include "netif/etharp.h"
 
 #include "proxy.h"
+#include "proxy_pollmgr.h"
 #include "pxremap.h"
 #include "portfwd.h"
 }
@@ -492,6 +493,8 @@ void VBoxNetLwipNAT::onLwipTcpIpFini(void* arg)
     VBoxNetLwipNAT *pThis = (VBoxNetLwipNAT *)arg;
 
     /* XXX: proxy finalization */
+    pollmgr_log_stats();
+
     netif_set_link_down(&g_pLwipNat->m_LwipNetIf);
     netif_set_down(&g_pLwipNat->m_LwipNetIf);
     netif_remove(&g_pLwipNat->m_LwipNetIf);
@@ -630,6 +633,7 @@ VBoxNetLwipNAT::VBoxNetLwipNAT(SOCKET icmpsock4, SOCKET icmpsock6) : VBoxNetBase
     m_src6.sin6_len = sizeof(m_src6);
 #endif
     m_ProxyOptions.nameservers = NULL;
+    m_ProxyOptions.pollmgr_threads = 0; /* one per CPU */
 
     m_LwipNetIf.name[0] = 'N';
     m_LwipNetIf.name[1] = 'T';
@@ -819,6 +823,21 @@ int VBoxNetLwipNAT::init()
         }
     }
 
+    /* Number of threads polling host sockets, 0 means one per CPU. */
+    com::Bstr bstrPollMgrKey = com::BstrFmt("NAT/%s/PollManagerThreads", networkName.c_str());
+    com::Bstr bstrPollMgrThreads;
+    hrc = virtualbox->GetExtraData(bstrPollMgrKey.raw(), bstrPollMgrThreads.asOutParam());
+    if (SUCCEEDED(hrc) && !bstrPollMgrThreads.isEmpty())
+    {
+        uint32_t cThreads;
+        rc = RTStrToUInt32Full(com::Utf8Str(bstrPollMgrThreads).c_str(), 10, &cThreads);
+        if (rc == VINF_SUCCESS)
+            m_ProxyOptions.pollmgr_threads = (int)RT_MIN(cThreads, POLLMGR_MAX_THREADS);
+        else
+            LogRel(("NAT: ignoring invalid %ls: \"%ls\"\n",
+                    bstrPollMgrKey.raw(), bstrPollMgrThreads.raw()));
+    }
+
     if (!fDontLoadRulesOnStartup)
     {
         fetchNatPortForwardRules(m_net, false, m_vecPortForwardRule4);
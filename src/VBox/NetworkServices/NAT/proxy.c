@@ -35,7 +35,7 @@
 static SOCKET proxy_create_socket(int, int);
 
 volatile struct proxy_options *g_proxy_options;
-static sys_thread_t pollmgr_tid;
+static sys_thread_t pollmgr_tid[POLLMGR_MAX_THREADS];
 
 /* XXX: for mapping loopbacks to addresses in our network (ip4) */
 struct netif *g_proxy_netif;
@@ -47,7 +47,8 @@ struct netif *g_proxy_netif;
 void
 proxy_init(struct netif *proxy_netif, struct proxy_options *opts)
 {
-    int status;
+    int npollmgr;
+    int i;
 
     LWIP_ASSERT1(opts != NULL);
     LWIP_UNUSED_ARG(proxy_netif);
@@ -72,8 +73,8 @@ proxy_init(struct netif *proxy_netif, struct proxy_options *opts)
         tftpd_init(proxy_netif, opts->tftp_root);
     }
 
-    status = pollmgr_init();
-    if (status < 0) {
+    npollmgr = pollmgr_init(opts->pollmgr_threads);
+    if (npollmgr < 0) {
         errx(EXIT_FAILURE, "failed to initialize poll manager");
         /* NOTREACHED */
     }
@@ -87,13 +88,15 @@ proxy_init(struct netif *proxy_netif, struct proxy_options *opts)
 
     pxping_init(proxy_netif, opts->icmpsock4, opts->icmpsock6);
 
-    pollmgr_tid = sys_thread_new("pollmgr_thread",
-                                 pollmgr_thread, NULL,
-                                 DEFAULT_THREAD_STACKSIZE,
-                                 DEFAULT_THREAD_PRIO);
-    if (!pollmgr_tid) {
-        errx(EXIT_FAILURE, "failed to create poll manager thread");
-        /* NOTREACHED */
+    for (i = 0; i < npollmgr; ++i) {
+        pollmgr_tid[i] = sys_thread_new("pollmgr_thread",
+                                        pollmgr_thread, (void *)(uintptr_t)i,
+                                        DEFAULT_THREAD_STACKSIZE,
+                                        DEFAULT_THREAD_PRIO);
+        if (!pollmgr_tid[i]) {
+            errx(EXIT_FAILURE, "failed to create poll manager thread");
+            /* NOTREACHED */
+        }
     }
 }
 
@@ -22,24 +22,76 @@
 #include "winpoll.h"
 #endif
 
+#include <iprt/log.h>
+#include <iprt/mp.h>
+#include <iprt/thread.h>
+
+/*
+ * On Linux use epoll(7) so that the cost of a wakeup is proportional
+ * to the number of ready sockets, not to the number of sockets we
+ * poll.  The pollfd array is still maintained as the slot table.
+ */
+#if defined(RT_OS_LINUX)
+# define POLLMGR_EPOLL 1
+# include <sys/epoll.h>
+# include <fcntl.h>
+# define POLLMGR_EPOLL_EVENTS 64 /* max events reaped per wakeup */
+#endif
+
 #define POLLMGR_GARBAGE (-1)
 
+struct pollmgr_stats {
+    uint64_t wakeups;           /* returns from poll */
+    uint64_t events;            /* callbacks dispatched */
+    uint64_t chanmsgs;          /* - of them on channels */
+    uint64_t added;             /* dynamic slots added */
+    uint64_t deleted;           /* dynamic slots deleted */
+    nfds_t maxnfds;             /* peak number of slots in use */
+};
+
 struct pollmgr {
     struct pollfd *fds;
     struct pollmgr_handler **handlers;
     nfds_t capacity;            /* allocated size of the arrays */
     nfds_t nfds;                /* part of the arrays in use */
 
+    /* dynamic slots deleted in this iteration, see pollmgr_collect() */
+    int *garbage;
+    nfds_t ngarbage;
+
+#ifdef POLLMGR_EPOLL
+    int epfd;
+    struct epoll_event epevents[POLLMGR_EPOLL_EVENTS];
+#endif
+
+    /* see pollmgr_udpbuf below */
+    u8_t *udpbuf;
+
+    struct pollmgr_stats stats;
+
     /* channels (socketpair) for static slots */
     SOCKET chan[POLLMGR_SLOT_STATIC_COUNT][2];
 #define POLLMGR_CHFD_RD 0       /* - pollmgr side */
 #define POLLMGR_CHFD_WR 1       /* - client side */
-} pollmgr;
+};
+
+static struct pollmgr pollmgr[POLLMGR_MAX_THREADS];
+static int pollmgr_count;
+
+/* instance served by the current thread, NULL means main instance */
+static RTTLS pollmgr_tls = NIL_RTTLS;
 
 
-static void pollmgr_loop(void);
+static int pollmgr_init_one(struct pollmgr *, u8_t *);
+static void pollmgr_fini_one(struct pollmgr *);
+static struct pollmgr *pollmgr_current(void);
+static void pollmgr_loop(struct pollmgr *);
+static void pollmgr_dispatch(struct pollmgr *, int, int);
+static void pollmgr_collect(struct pollmgr *);
 
-static void pollmgr_add_at(int, struct pollmgr_handler *, SOCKET, int);
+static int pollmgr_add_at(struct pollmgr *, int, struct pollmgr_handler *, SOCKET, int);
+static void pollmgr_set_events(struct pollmgr *, int, int);
+static void pollmgr_del_at(struct pollmgr *, int);
 static void pollmgr_refptr_delete(struct pollmgr_refptr *);
 
 
@@ -52,39 +104,99 @@ static void pollmgr_refptr_delete(struct pollmgr_refptr *);
  * fragmentation.
  *
  * We can use shared buffer here since we read from sockets
- * sequentially in a loop over pollfd.
+ * sequentially in a loop over pollfd.  Each poll manager thread has
+ * its own buffer, this one belongs to the main instance.
  */
-u8_t pollmgr_udpbuf[64 * 1024];
+u8_t pollmgr_udpbuf[POLLMGR_UDPBUF_SIZE];
 
 
+/**
+ * Create poll manager instances.  If "nthreads" is not positive, use
+ * one instance per online CPU.
+ *
+ * Returns the number of instances (i.e. threads to start) or -1 on
+ * error.
+ */
 int
-pollmgr_init(void)
+pollmgr_init(int nthreads)
+{
+    int status;
+    int i;
+
+    if (nthreads <= 0) {
+        nthreads = (int)RTMpGetOnlineCount();
+    }
+    if (nthreads > POLLMGR_MAX_THREADS) {
+        nthreads = POLLMGR_MAX_THREADS;
+    }
+#ifdef RT_OS_WINDOWS
+    nthreads = 1;               /* RTWinPoll() is not reentrant */
+#endif
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    if (nthreads > 1) {
+        pollmgr_tls = RTTlsAlloc();
+        if (pollmgr_tls == NIL_RTTLS) {
+            DPRINTF0(("%s: RTTlsAlloc failed\n", __func__));
+            nthreads = 1;
+        }
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+        status = pollmgr_init_one(&pollmgr[i], i == 0 ? pollmgr_udpbuf : NULL);
+        if (status < 0) {
+            while (--i >= 0) {
+                pollmgr_fini_one(&pollmgr[i]);
+            }
+            return -1;
+        }
+    }
+
+    pollmgr_count = nthreads;
+    LogRel(("NAT: %d poll manager thread%s\n",
+            nthreads, (nthreads == 1 ? "" : "s")));
+
+    return nthreads;
+}
+
+
+static int
+pollmgr_init_one(struct pollmgr *pmgr, u8_t *udpbuf)
 {
     struct pollfd *newfds;
     struct pollmgr_handler **newhdls;
+    int *newgarbage;
     nfds_t newcap;
     int status;
     nfds_t i;
 
-    pollmgr.fds = NULL;
-    pollmgr.handlers = NULL;
-    pollmgr.capacity = 0;
-    pollmgr.nfds = 0;
+    memset(pmgr, 0, sizeof(*pmgr));
 
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
-        pollmgr.chan[i][POLLMGR_CHFD_RD] = -1;
-        pollmgr.chan[i][POLLMGR_CHFD_WR] = -1;
+        pmgr->chan[i][POLLMGR_CHFD_RD] = -1;
+        pmgr->chan[i][POLLMGR_CHFD_WR] = -1;
     }
 
+#ifdef POLLMGR_EPOLL
+    pmgr->epfd = epoll_create(POLLMGR_EPOLL_EVENTS); /* size is a hint */
+    if (pmgr->epfd < 0) {
+        perror("epoll_create");
+        return -1;
+    }
+    (void)fcntl(pmgr->epfd, F_SETFD, FD_CLOEXEC);
+#endif
+
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
 #ifndef RT_OS_WINDOWS
-        status = socketpair(PF_LOCAL, SOCK_DGRAM, 0, pollmgr.chan[i]);
+        status = socketpair(PF_LOCAL, SOCK_DGRAM, 0, pmgr->chan[i]);
         if (status < 0) {
             perror("socketpair");
             goto cleanup_close;
         }
 #else
-        status = RTWinSocketPair(PF_INET, SOCK_DGRAM, 0, pollmgr.chan[i]);
+        status = RTWinSocketPair(PF_INET, SOCK_DGRAM, 0, pmgr->chan[i]);
         AssertRCReturn(status, -1);
 
         if (RT_FAILURE(status)) {
@@ -99,94 +211,209 @@ pollmgr_init(void)
     LWIP_ASSERT1(newcap >= POLLMGR_SLOT_STATIC_COUNT);
 
     newfds = (struct pollfd *)
-        malloc(newcap * sizeof(*pollmgr.fds));
+        malloc(newcap * sizeof(*pmgr->fds));
     if (newfds == NULL) {
         perror("calloc");
         goto cleanup_close;
     }
 
     newhdls = (struct pollmgr_handler **)
-        malloc(newcap * sizeof(*pollmgr.handlers));
+        malloc(newcap * sizeof(*pmgr->handlers));
     if (newhdls == NULL) {
         perror("malloc");
         free(newfds);
         goto cleanup_close;
     }
 
-    pollmgr.capacity = newcap;
-    pollmgr.fds = newfds;
-    pollmgr.handlers = newhdls;
+    newgarbage = (int *)malloc(newcap * sizeof(*pmgr->garbage));
+    if (newgarbage == NULL) {
+        perror("malloc");
+        free(newhdls);
+        free(newfds);
+        goto cleanup_close;
+    }
+
+    if (udpbuf == NULL) {
+        udpbuf = (u8_t *)malloc(POLLMGR_UDPBUF_SIZE);
+        if (udpbuf == NULL) {
+            perror("malloc");
+            free(newgarbage);
+            free(newhdls);
+            free(newfds);
+            goto cleanup_close;
+        }
+    }
+
+    pmgr->capacity = newcap;
+    pmgr->fds = newfds;
+    pmgr->handlers = newhdls;
+    pmgr->garbage = newgarbage;
+    pmgr->udpbuf = udpbuf;
 
-    pollmgr.nfds = POLLMGR_SLOT_STATIC_COUNT;
+    pmgr->nfds = POLLMGR_SLOT_STATIC_COUNT;
+    pmgr->stats.maxnfds = pmgr->nfds;
 
-    for (i = 0; i < pollmgr.capacity; ++i) {
-        pollmgr.fds[i].fd = INVALID_SOCKET;
-        pollmgr.fds[i].events = 0;
-        pollmgr.fds[i].revents = 0;
+    for (i = 0; i < pmgr->capacity; ++i) {
+        pmgr->fds[i].fd = INVALID_SOCKET;
+        pmgr->fds[i].events = 0;
+        pmgr->fds[i].revents = 0;
+        pmgr->handlers[i] = NULL;
     }
 
     return 0;
 
   cleanup_close:
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
-        SOCKET *chan = pollmgr.chan[i];
+        SOCKET *chan = pmgr->chan[i];
         if (chan[POLLMGR_CHFD_RD] >= 0) {
             closesocket(chan[POLLMGR_CHFD_RD]);
             closesocket(chan[POLLMGR_CHFD_WR]);
         }
     }
+#ifdef POLLMGR_EPOLL
+    close(pmgr->epfd);
+#endif
 
     return -1;
 }
 
 
+/*
+ * Undo pollmgr_init_one() if we failed to create other instances.
+ */
+static void
+pollmgr_fini_one(struct pollmgr *pmgr)
+{
+    nfds_t i;
+
+    for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
+        SOCKET *chan = pmgr->chan[i];
+        if (chan[POLLMGR_CHFD_RD] >= 0) {
+            closesocket(chan[POLLMGR_CHFD_RD]);
+            closesocket(chan[POLLMGR_CHFD_WR]);
+        }
+    }
+#ifdef POLLMGR_EPOLL
+    close(pmgr->epfd);
+#endif
+
+    if (pmgr->udpbuf != pollmgr_udpbuf) {
+        free(pmgr->udpbuf);
+    }
+    free(pmgr->garbage);
+    free(pmgr->handlers);
+    free(pmgr->fds);
+    memset(pmgr, 0, sizeof(*pmgr));
+}
+
+
+/*
+ * Poll manager instance that runs callbacks on this thread.  Code
+ * that runs before poll manager threads are started (e.g. init
+ * functions that register global sockets) uses the main instance.
+ */
+static struct pollmgr *
+pollmgr_current(void)
+{
+    struct pollmgr *pmgr = NULL;
+
+    if (pollmgr_tls != NIL_RTTLS) {
+        pmgr = (struct pollmgr *)RTTlsGet(pollmgr_tls);
+    }
+
+    return pmgr != NULL ? pmgr : &pollmgr[0];
+}
+
+
+/**
+ * Pick poll manager instance for a new proxied connection given a
+ * hash of its addresses.
+ */
+int
+pollmgr_select(u32_t hash)
+{
+    if (pollmgr_count <= 1) {
+        return 0;
+    }
+
+    /* mix the bits, guest ports tend to be sequential */
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bU;
+    hash ^= hash >> 16;
+
+    return (int)(hash % (u32_t)pollmgr_count);
+}
+
+
 /*
  * Must be called before pollmgr loop is started, so no locking.
+ *
+ * The channel is created in every instance.  The handler is shared,
+ * which is ok since the channel has the same slot in all of them.
+ * Returns the write end of the channel of the main instance.
  */
 SOCKET
 pollmgr_add_chan(int slot, struct pollmgr_handler *handler)
 {
+    int i;
+
     if (slot >= POLLMGR_SLOT_FIRST_DYNAMIC) {
         handler->slot = -1;
         return -1;
     }
 
-    pollmgr_add_at(slot, handler, pollmgr.chan[slot][POLLMGR_CHFD_RD], POLLIN);
-    return pollmgr.chan[slot][POLLMGR_CHFD_WR];
+    for (i = 0; i < pollmgr_count; ++i) {
+        struct pollmgr *pmgr = &pollmgr[i];
+        int status;
+
+        status = pollmgr_add_at(pmgr, slot, handler,
+                                pmgr->chan[slot][POLLMGR_CHFD_RD], POLLIN);
+        if (status < 0) {
+            errx(EXIT_FAILURE, "chan %d: failed to register", slot);
+            /* NOTREACHED */
+        }
+    }
+
+    handler->pmgr = 0;
+    return pollmgr[0].chan[slot][POLLMGR_CHFD_WR];
 }
 
 
 /*
  * Must be called from pollmgr loop (via callbacks), so no locking.
+ * The slot is added to the instance that runs the callback.
  */
 int
 pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
 {
+    struct pollmgr *pmgr = pollmgr_current();
     int slot;
+    int status;
 
     DPRINTF2(("%s: new fd %d\n", __func__, fd));
 
-    if (pollmgr.nfds == pollmgr.capacity) {
+    if (pmgr->nfds == pmgr->capacity) {
         struct pollfd *newfds;
         struct pollmgr_handler **newhdls;
+        int *newgarbage;
         nfds_t newcap;
         nfds_t i;
 
-        newcap = pollmgr.capacity * 2;
+        newcap = pmgr->capacity * 2;
 
         newfds = (struct pollfd *)
-            realloc(pollmgr.fds, newcap * sizeof(*pollmgr.fds));
+            realloc(pmgr->fds, newcap * sizeof(*pmgr->fds));
         if (newfds == NULL) {
             perror("realloc");
             handler->slot = -1;
             return -1;
         }
 
-        pollmgr.fds = newfds; /* don't crash/leak if realloc(handlers) fails */
+        pmgr->fds = newfds; /* don't crash/leak if realloc(handlers) fails */
         /* but don't update capacity yet! */
 
         newhdls = (struct pollmgr_handler **)
-            realloc(pollmgr.handlers, newcap * sizeof(*pollmgr.handlers));
+            realloc(pmgr->handlers, newcap * sizeof(*pmgr->handlers));
         if (newhdls == NULL) {
             perror("realloc");
             /* if we failed to realloc here, then fds points to the
@@ -195,10 +422,21 @@ pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
             return -1;
         }
 
-        pollmgr.handlers = newhdls;
-        pollmgr.capacity = newcap;
+        pmgr->handlers = newhdls;
+
+        newgarbage = (int *)
+            realloc(pmgr->garbage, newcap * sizeof(*pmgr->garbage));
+        if (newgarbage == NULL) {
+            perror("realloc");
+            /* same as above */
+            handler->slot = -1;
+            return -1;
+        }
+
+        pmgr->garbage = newgarbage;
+        pmgr->capacity = newcap;
 
-        for (i = pollmgr.nfds; i < newcap; ++i) {
+        for (i = pmgr->nfds; i < newcap; ++i) {
             newfds[i].fd = INVALID_SOCKET;
             newfds[i].events = 0;
             newfds[i].revents = 0;
@@ -206,28 +444,73 @@ pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
         }
     }
 
-    slot = pollmgr.nfds;
-    ++pollmgr.nfds;
+    slot = pmgr->nfds;
+    ++pmgr->nfds;
+
+    status = pollmgr_add_at(pmgr, slot, handler, fd, events);
+    if (status < 0) {
+        --pmgr->nfds;
+        pmgr->fds[slot].fd = INVALID_SOCKET;
+        pmgr->fds[slot].events = 0;
+        pmgr->handlers[slot] = NULL;
+        handler->slot = -1;
+        return -1;
+    }
+
+    ++pmgr->stats.added;
+    if (pmgr->nfds > pmgr->stats.maxnfds) {
+        pmgr->stats.maxnfds = pmgr->nfds;
+    }
 
-    pollmgr_add_at(slot, handler, fd, events);
     return slot;
 }
 
 
-static void
-pollmgr_add_at(int slot, struct pollmgr_handler *handler, SOCKET fd, int events)
+static int
+pollmgr_add_at(struct pollmgr *pmgr, int slot, struct pollmgr_handler *handler,
+               SOCKET fd, int events)
 {
-    pollmgr.fds[slot].fd = fd;
-    pollmgr.fds[slot].events = events;
-    pollmgr.fds[slot].revents = 0;
-    pollmgr.handlers[slot] = handler;
+    pmgr->fds[slot].fd = fd;
+    pmgr->fds[slot].events = events;
+    pmgr->fds[slot].revents = 0;
+    pmgr->handlers[slot] = handler;
+
+#ifdef POLLMGR_EPOLL
+    {
+        struct epoll_event ev;
+        int status;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = (u16_t)events;
+        ev.data.u32 = (uint32_t)slot;
+
+        status = epoll_ctl(pmgr->epfd, EPOLL_CTL_ADD, fd, &ev);
+        if (status < 0) {
+            DPRINTF0(("%s: fd %d: epoll_ctl(ADD): errno %d\n",
+                      __func__, fd, errno));
+            return -1;
+        }
+    }
+#endif
 
     handler->slot = slot;
+    handler->pmgr = (int)(pmgr - &pollmgr[0]);
+    return 0;
 }
 
 
 ssize_t
 pollmgr_chan_send(int slot, void *buf, size_t nbytes)
+{
+    return pollmgr_chan_send_to(0, slot, buf, nbytes);
+}
+
+
+/**
+ * Send message over a channel of the specified poll manager instance.
+ */
+ssize_t
+pollmgr_chan_send_to(int instance, int slot, void *buf, size_t nbytes)
 {
     SOCKET fd;
     ssize_t nsent;
@@ -236,7 +519,9 @@ pollmgr_chan_send(int slot, void *buf, size_t nbytes)
         return -1;
     }
 
-    fd = pollmgr.chan[slot][POLLMGR_CHFD_WR];
+    LWIP_ASSERT1(instance >= 0 && instance < pollmgr_count);
+
+    fd = pollmgr[instance].chan[slot][POLLMGR_CHFD_WR];
     nsent = send(fd, buf, (int)nbytes, 0);
     if (nsent == SOCKET_ERROR) {
         warn("send on chan %d", slot);
@@ -288,49 +573,138 @@ pollmgr_chan_recv_ptr(struct pollmgr_handler *handler, SOCKET fd, int revents)
 }
 
 
+/**
+ * UDP receive buffer of the poll manager instance that runs the
+ * calling callback.
+ */
+u8_t *
+pollmgr_udpbuf_get(void)
+{
+    return pollmgr_current()->udpbuf;
+}
+
+
 void
 pollmgr_update_events(int slot, int events)
 {
+    struct pollmgr *pmgr = pollmgr_current();
+
     LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
-    LWIP_ASSERT1((nfds_t)slot < pollmgr.nfds);
+    LWIP_ASSERT1((nfds_t)slot < pmgr->nfds);
 
-    pollmgr.fds[slot].events = events;
+    pollmgr_set_events(pmgr, slot, events);
+}
+
+
+static void
+pollmgr_set_events(struct pollmgr *pmgr, int slot, int events)
+{
+    if (pmgr->fds[slot].events == events) {
+        return;
+    }
+
+    pmgr->fds[slot].events = events;
+
+#ifdef POLLMGR_EPOLL
+    {
+        struct epoll_event ev;
+        int status;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = (u16_t)events;
+        ev.data.u32 = (uint32_t)slot;
+
+        status = epoll_ctl(pmgr->epfd, EPOLL_CTL_MOD, pmgr->fds[slot].fd, &ev);
+        if (status < 0) {
+            DPRINTF0(("%s: fd %d: epoll_ctl(MOD): errno %d\n",
+                      __func__, pmgr->fds[slot].fd, errno));
+        }
+    }
+#endif
 }
 
 
 void
 pollmgr_del_slot(int slot)
 {
+    struct pollmgr *pmgr = pollmgr_current();
+
     LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
 
     DPRINTF2(("%s(%d): fd %d ! DELETED\n",
-              __func__, slot, pollmgr.fds[slot].fd));
+              __func__, slot, pmgr->fds[slot].fd));
+
+    pollmgr_del_at(pmgr, slot);
+}
 
-    pollmgr.fds[slot].fd = INVALID_SOCKET; /* see poll loop */
+
+/*
+ * Schedule dynamic slot for garbage collection at the end of this
+ * iteration of the poll loop.  Must be called before the socket is
+ * closed, so that epoll doesn't lose track of it.
+ */
+static void
+pollmgr_del_at(struct pollmgr *pmgr, int slot)
+{
+    LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
+    LWIP_ASSERT1((nfds_t)slot < pmgr->nfds);
+
+    if (pmgr->fds[slot].events == POLLMGR_GARBAGE) {
+        return;                 /* already scheduled */
+    }
+
+#ifdef POLLMGR_EPOLL
+    if (pmgr->fds[slot].fd != INVALID_SOCKET) {
+        struct epoll_event ev;  /* pre 2.6.9 kernels want non-NULL */
+        (void)epoll_ctl(pmgr->epfd, EPOLL_CTL_DEL, pmgr->fds[slot].fd, &ev);
+    }
+#endif
+
+    pmgr->fds[slot].fd = INVALID_SOCKET; /* see poll loop */
+    pmgr->fds[slot].events = POLLMGR_GARBAGE;
+    pmgr->fds[slot].revents = 0;
+    pmgr->handlers[slot] = NULL;
+
+    pmgr->garbage[pmgr->ngarbage++] = slot;
+    ++pmgr->stats.deleted;
 }
 
 
+/**
+ * Thread function.  The argument is the index of the poll manager
+ * instance to run, as cast to a pointer.
+ */
 void
-pollmgr_thread(void *ignored)
+pollmgr_thread(void *arg)
 {
-    LWIP_UNUSED_ARG(ignored);
-    pollmgr_loop();
+    int instance = (int)(uintptr_t)arg;
+    struct pollmgr *pmgr;
+
+    LWIP_ASSERT1(instance >= 0 && instance < pollmgr_count);
+    pmgr = &pollmgr[instance];
+
+    if (pollmgr_tls != NIL_RTTLS) {
+        RTTlsSet(pollmgr_tls, pmgr);
+    }
+
+    pollmgr_loop(pmgr);
 }
 
 
 static void
-pollmgr_loop(void)
+pollmgr_loop(struct pollmgr *pmgr)
 {
     int nready;
-    SOCKET delfirst;
-    SOCKET *pdelprev;
     int i;
 
     for (;;) {
-#ifndef RT_OS_WINDOWS
-        nready = poll(pollmgr.fds, pollmgr.nfds, -1);
+#if defined(POLLMGR_EPOLL)
+        nready = epoll_wait(pmgr->epfd, pmgr->epevents,
+                            POLLMGR_EPOLL_EVENTS, -1);
+#elif !defined(RT_OS_WINDOWS)
+        nready = poll(pmgr->fds, pmgr->nfds, -1);
 #else
-        int rc = RTWinPoll(pollmgr.fds, pollmgr.nfds,RT_INDEFINITE_WAIT, &nready);
+        int rc = RTWinPoll(pmgr->fds, pmgr->nfds,RT_INDEFINITE_WAIT, &nready);
         if (RT_FAILURE(rc)) {
             err(EXIT_FAILURE, "poll"); /* XXX: what to do on error? */
             /* NOTREACHED*/
@@ -352,154 +726,221 @@ pollmgr_loop(void)
             continue;           /* - but be defensive */
         }
 
+        ++pmgr->stats.wakeups;
 
-        delfirst = INVALID_SOCKET;
-        pdelprev = &delfirst;
-
-        for (i = 0; (nfds_t)i < pollmgr.nfds && nready > 0; ++i) {
-            struct pollmgr_handler *handler;
-            SOCKET fd;
-            int revents, nevents;
-
-            fd = pollmgr.fds[i].fd;
-            revents = pollmgr.fds[i].revents;
-
-            /*
-             * Channel handlers can request deletion of dynamic slots
-             * by calling pollmgr_del_slot() that clobbers slot's fd.
-             */
-            if (fd == INVALID_SOCKET && i >= POLLMGR_SLOT_FIRST_DYNAMIC) {
-                /* adjust count if events were pending for that slot */
-                if (revents != 0) {
-                    --nready;
-                }
-
-                /* pretend that slot handler requested deletion */
-                nevents = -1;
-                goto update_events;
-            }
+#ifdef POLLMGR_EPOLL
+        for (i = 0; i < nready; ++i) {
+            pollmgr_dispatch(pmgr,
+                             (int)pmgr->epevents[i].data.u32,
+                             (int)pmgr->epevents[i].events);
+        }
+#else
+        for (i = 0; (nfds_t)i < pmgr->nfds && nready > 0; ++i) {
+            int revents = pmgr->fds[i].revents;
 
             if (revents == 0) {
                 continue; /* next fd */
             }
             --nready;
 
-            handler = pollmgr.handlers[i];
+            pmgr->fds[i].revents = 0;
+            pollmgr_dispatch(pmgr, i, revents);
+        }
+#endif
+
+        pollmgr_collect(pmgr);
+    } /* poll loop */
+}
+
 
-            if (handler != NULL && handler->callback != NULL) {
+/*
+ * Call the handler of the slot and update its events as requested.
+ */
+static void
+pollmgr_dispatch(struct pollmgr *pmgr, int i, int revents)
+{
+    struct pollmgr_handler *handler;
+    SOCKET fd;
+    int nevents;
+
+    LWIP_ASSERT1((nfds_t)i < pmgr->nfds);
+
+    /*
+     * Channel handlers can request deletion of dynamic slots by
+     * calling pollmgr_del_slot() that clobbers slot's fd.  Ignore
+     * pending events for slots deleted earlier in this iteration.
+     */
+    fd = pmgr->fds[i].fd;
+    if (fd == INVALID_SOCKET) {
+        return;
+    }
+
+    ++pmgr->stats.events;
+    if (i < POLLMGR_SLOT_FIRST_DYNAMIC) {
+        ++pmgr->stats.chanmsgs;
+    }
+
+    handler = pmgr->handlers[i];
+
+    if (handler != NULL && handler->callback != NULL) {
 #if LWIP_PROXY_DEBUG /* DEBUG */
-                if (i < POLLMGR_SLOT_FIRST_DYNAMIC) {
-                    if (revents == POLLIN) {
-                        DPRINTF2(("%s: ch %d\n", __func__, i));
-                    }
-                    else {
-                        DPRINTF2(("%s: ch %d @ revents 0x%x!\n",
-                                  __func__, i, revents));
-                    }
-                }
-                else {
-                    DPRINTF2(("%s: fd %d @ revents 0x%x\n",
-                              __func__, fd, revents));
-                }
-#endif /* DEBUG */
-                nevents = (*handler->callback)(handler, fd, revents);
+        if (i < POLLMGR_SLOT_FIRST_DYNAMIC) {
+            if (revents == POLLIN) {
+                DPRINTF2(("%s: ch %d\n", __func__, i));
             }
             else {
-                DPRINTF0(("%s: invalid handler for fd %d: ", __func__, fd));
-                if (handler == NULL) {
-                    DPRINTF0(("NULL\n"));
-                }
-                else {
-                    DPRINTF0(("%p (callback = NULL)\n", (void *)handler));
-                }
-                nevents = -1;   /* delete it */
+                DPRINTF2(("%s: ch %d @ revents 0x%x!\n",
+                          __func__, i, revents));
             }
+        }
+        else {
+            DPRINTF2(("%s: fd %d @ revents 0x%x\n",
+                      __func__, fd, revents));
+        }
+#endif /* DEBUG */
+        nevents = (*handler->callback)(handler, fd, revents);
+    }
+    else {
+        DPRINTF0(("%s: invalid handler for fd %d: ", __func__, fd));
+        if (handler == NULL) {
+            DPRINTF0(("NULL\n"));
+        }
+        else {
+            DPRINTF0(("%p (callback = NULL)\n", (void *)handler));
+        }
+        nevents = -1;   /* delete it */
+    }
 
-          update_events:
-            if (nevents >= 0) {
-                if (nevents != pollmgr.fds[i].events) {
-                    DPRINTF2(("%s: fd %d ! nevents 0x%x\n",
-                              __func__, fd, nevents));
-                }
-                pollmgr.fds[i].events = nevents;
-            }
-            else if (i < POLLMGR_SLOT_FIRST_DYNAMIC) {
-                /* Don't garbage-collect channels. */
-                DPRINTF2(("%s: fd %d ! DELETED (channel %d)\n",
-                          __func__, fd, i));
-                pollmgr.fds[i].fd = INVALID_SOCKET;
-                pollmgr.fds[i].events = 0;
-                pollmgr.fds[i].revents = 0;
-                pollmgr.handlers[i] = NULL;
-            }
-            else {
-                DPRINTF2(("%s: fd %d ! DELETED\n", __func__, fd));
+    if (pmgr->fds[i].fd == INVALID_SOCKET) {
+        return;         /* callback deleted its own slot */
+    }
 
-                /* schedule for deletion (see g/c loop for details) */
-                *pdelprev = i;  /* make previous entry point to us */
-                pdelprev = &pollmgr.fds[i].fd;
+    if (nevents >= 0) {
+        if (nevents != pmgr->fds[i].events) {
+            DPRINTF2(("%s: fd %d ! nevents 0x%x\n",
+                      __func__, fd, nevents));
+        }
+        pollmgr_set_events(pmgr, i, nevents);
+    }
+    else if (i < POLLMGR_SLOT_FIRST_DYNAMIC) {
+        /* Don't garbage-collect channels. */
+        DPRINTF2(("%s: fd %d ! DELETED (channel %d)\n",
+                  __func__, fd, i));
+#ifdef POLLMGR_EPOLL
+        {
+            struct epoll_event ev;
+            (void)epoll_ctl(pmgr->epfd, EPOLL_CTL_DEL, fd, &ev);
+        }
+#endif
+        pmgr->fds[i].fd = INVALID_SOCKET;
+        pmgr->fds[i].events = 0;
+        pmgr->fds[i].revents = 0;
+        pmgr->handlers[i] = NULL;
+    }
+    else {
+        DPRINTF2(("%s: fd %d ! DELETED\n", __func__, fd));
+        pollmgr_del_at(pmgr, i);
+    }
+}
 
-                pollmgr.fds[i].fd = INVALID_SOCKET; /* end of list (for now) */
-                pollmgr.fds[i].events = POLLMGR_GARBAGE;
-                pollmgr.fds[i].revents = 0;
-                pollmgr.handlers[i] = NULL;
-            }
-        } /* processing loop */
-
-
-        /*
-         * Garbage collect and compact the array.
-         *
-         * We overload pollfd::fd of garbage entries to store the
-         * index of the next garbage entry.  The garbage list is
-         * co-directional with the fds array.  The index of the first
-         * entry is in "delfirst", the last entry "points to"
-         * INVALID_SOCKET.
-         *
-         * See update_events code for nevents < 0 at the end of the
-         * processing loop above.
-         */
-        while (delfirst != INVALID_SOCKET) {
-            const int last = pollmgr.nfds - 1;
-
-            /*
-             * We want a live entry in the last slot to swap into the
-             * freed slot, so make sure we have one.
-             */
-            if (pollmgr.fds[last].events == POLLMGR_GARBAGE /* garbage */
-                || pollmgr.fds[last].fd == INVALID_SOCKET)  /* or killed */
-            {
-                /* drop garbage entry at the end of the array */
-                --pollmgr.nfds;
 
-                if (delfirst == last) {
-                    /* congruent to delnext >= pollmgr.nfds test below */
-                    delfirst = INVALID_SOCKET; /* done */
-                }
-            }
-            else {
-                const SOCKET delnext = pollmgr.fds[delfirst].fd;
+static int
+pollmgr_slot_cmp_desc(const void *a, const void *b)
+{
+    const int sa = *(const int *)a;
+    const int sb = *(const int *)b;
+
+    return (sa < sb) - (sa > sb);
+}
 
-                /* copy live entry at the end to the first slot being freed */
-                pollmgr.fds[delfirst] = pollmgr.fds[last]; /* struct copy */
-                pollmgr.handlers[delfirst] = pollmgr.handlers[last];
-                pollmgr.handlers[delfirst]->slot = (int)delfirst;
-                --pollmgr.nfds;
 
-                if ((nfds_t)delnext >= pollmgr.nfds) {
-                    delfirst = INVALID_SOCKET; /* done */
-                }
-                else {
-                    delfirst = delnext;
+/*
+ * Garbage collect and compact the array.
+ *
+ * Deleted slots are processed in descending order.  When we get to a
+ * slot, all garbage above it has been dropped already, so the last
+ * entry in the array is either the slot itself or a live entry that
+ * we can move into the freed slot.
+ */
+static void
+pollmgr_collect(struct pollmgr *pmgr)
+{
+    nfds_t k;
+
+    if (pmgr->ngarbage == 0) {
+        return;
+    }
+
+    if (pmgr->ngarbage > 1) {
+        qsort(pmgr->garbage, pmgr->ngarbage, sizeof(*pmgr->garbage),
+              pollmgr_slot_cmp_desc);
+    }
+
+    for (k = 0; k < pmgr->ngarbage; ++k) {
+        const int slot = pmgr->garbage[k];
+        const int last = (int)pmgr->nfds - 1;
+
+        LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
+        LWIP_ASSERT1(slot <= last);
+        LWIP_ASSERT1(pmgr->fds[slot].events == POLLMGR_GARBAGE);
+
+        if (slot != last) {
+            LWIP_ASSERT1(pmgr->fds[last].events != POLLMGR_GARBAGE);
+
+            /* copy live entry at the end to the slot being freed */
+            pmgr->fds[slot] = pmgr->fds[last]; /* struct copy */
+            pmgr->handlers[slot] = pmgr->handlers[last];
+            pmgr->handlers[slot]->slot = slot;
+
+#ifdef POLLMGR_EPOLL
+            {
+                struct epoll_event ev;
+                int status;
+
+                memset(&ev, 0, sizeof(ev));
+                ev.events = (u16_t)pmgr->fds[slot].events;
+                ev.data.u32 = (uint32_t)slot;
+
+                status = epoll_ctl(pmgr->epfd, EPOLL_CTL_MOD,
+                                   pmgr->fds[slot].fd, &ev);
+                if (status < 0) {
+                    DPRINTF0(("%s: fd %d: epoll_ctl(MOD): errno %d\n",
+                              __func__, pmgr->fds[slot].fd, errno));
                 }
             }
-
-            pollmgr.fds[last].fd = INVALID_SOCKET;
-            pollmgr.fds[last].events = 0;
-            pollmgr.fds[last].revents = 0;
-            pollmgr.handlers[last] = NULL;
+#endif
         }
-    } /* poll loop */
+
+        pmgr->fds[last].fd = INVALID_SOCKET;
+        pmgr->fds[last].events = 0;
+        pmgr->fds[last].revents = 0;
+        pmgr->handlers[last] = NULL;
+        --pmgr->nfds;
+    }
+
+    pmgr->ngarbage = 0;
+}
+
+
+/**
+ * Report per-thread statistics to the release log.  The counters are
+ * read without synchronization, so this is a snapshot at best.
+ */
+void
+pollmgr_log_stats(void)
+{
+    int i;
+
+    for (i = 0; i < pollmgr_count; ++i) {
+        const struct pollmgr *pmgr = &pollmgr[i];
+
+        LogRel(("NAT: pollmgr %d: %RU64 wakeups, %RU64 events"
+                " (%RU64 on channels), %RU64 slots added, %RU64 deleted,"
+                " %u in use, peak %u\n",
+                i, pmgr->stats.wakeups, pmgr->stats.events,
+                pmgr->stats.chanmsgs, pmgr->stats.added, pmgr->stats.deleted,
+                (unsigned int)pmgr->nfds, (unsigned int)pmgr->stats.maxnfds));
+    }
 }
 
 
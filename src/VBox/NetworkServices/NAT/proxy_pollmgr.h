@@ -23,6 +23,14 @@ enum pollmgr_slot_t {
     POLLMGR_SLOT_FIRST_DYNAMIC = POLLMGR_SLOT_STATIC_COUNT
 };
 
+/*
+ * Upper limit on the number of poll manager instances, each with its
+ * own thread.  Instance 0 is the main one that serves port-forwarding
+ * and other global sockets; proxied connections from the guest are
+ * spread over all instances.
+ */
+#define POLLMGR_MAX_THREADS 8
+
 
 struct pollmgr_handler;         /* forward */
 typedef int (*pollmgr_callback)(struct pollmgr_handler *, SOCKET, int);
@@ -31,6 +39,7 @@ struct pollmgr_handler {
     pollmgr_callback callback;
     void *data;
     int slot;
+    int pmgr;                   /* poll manager instance of the slot */
 };
 
 struct pollmgr_refptr {
@@ -40,11 +49,13 @@ struct pollmgr_refptr {
     size_t weak;
 };
 
-int pollmgr_init(void);
+int pollmgr_init(int);
+int pollmgr_select(u32_t);
 
 /* static named slots (aka "channels") */
 SOCKET pollmgr_add_chan(int, struct pollmgr_handler *);
 ssize_t pollmgr_chan_send(int, void *buf, size_t nbytes);
+ssize_t pollmgr_chan_send_to(int, int, void *buf, size_t nbytes);
 void *pollmgr_chan_recv_ptr(struct pollmgr_handler *, SOCKET, int);
 
 /* dynamic slots */
@@ -60,8 +71,11 @@ void pollmgr_update_events(int, int);
 void pollmgr_del_slot(int);
 
 void pollmgr_thread(void *);
+void pollmgr_log_stats(void);
 
 /* buffer for callbacks to receive udp without worrying about truncation */
-extern u8_t pollmgr_udpbuf[64 * 1024];
+#define POLLMGR_UDPBUF_SIZE (64 * 1024)
+extern u8_t pollmgr_udpbuf[POLLMGR_UDPBUF_SIZE]; /* main instance */
+u8_t *pollmgr_udpbuf_get(void);                  /* calling instance */
 
 #endif /* _PROXY_POLLMGR_H_ */
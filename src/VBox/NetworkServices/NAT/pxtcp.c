@@ -308,12 +308,14 @@ pxtcp_init(void)
 
 /**
  * Syntactic sugar for sending pxtcp pointer over poll manager
- * channel.  Used by lwip thread functions.
+ * channel.  Used by lwip thread functions.  The message goes to the
+ * poll manager instance the pxtcp is assigned to.
  */
 static ssize_t
 pxtcp_chan_send(enum pollmgr_slot_t slot, struct pxtcp *pxtcp)
 {
-    return pollmgr_chan_send(slot, &pxtcp, sizeof(pxtcp));
+    return pollmgr_chan_send_to(pxtcp->pmhdl.pmgr,
+                                slot, &pxtcp, sizeof(pxtcp));
 }
 
 
@@ -325,7 +327,8 @@ static ssize_t
 pxtcp_chan_send_weak(enum pollmgr_slot_t slot, struct pxtcp *pxtcp)
 {
     pollmgr_refptr_weak_ref(pxtcp->rp);
-    return pollmgr_chan_send(slot, &pxtcp->rp, sizeof(pxtcp->rp));
+    return pollmgr_chan_send_to(pxtcp->pmhdl.pmgr,
+                                slot, &pxtcp->rp, sizeof(pxtcp->rp));
 }
 
 
@@ -559,6 +562,7 @@ pxtcp_allocate(void)
     pxtcp->pmhdl.callback = NULL;
     pxtcp->pmhdl.data = (void *)pxtcp;
     pxtcp->pmhdl.slot = -1;
+    pxtcp->pmhdl.pmgr = 0;
 
     pxtcp->pcb = NULL;
     pxtcp->sock = INVALID_SOCKET;
@@ -1018,6 +1022,8 @@ pxtcp_pcb_heard(void *arg, struct tcp_pcb *newpcb, err_t error)
     pxtcp->sock = sock;
 
     pxtcp->pmhdl.callback = pxtcp_pmgr_connect;
+    pxtcp->pmhdl.pmgr = pollmgr_select(((u32_t)newpcb->remote_port << 16)
+                                       | newpcb->local_port);
     pxtcp->events = POLLOUT;
 
     nsent = pxtcp_chan_send(POLLMGR_CHAN_PXTCP_ADD, pxtcp);
@@ -137,7 +137,8 @@ pxudp_init(void)
 static ssize_t
 pxudp_chan_send(enum pollmgr_slot_t chan, struct pxudp *pxudp)
 {
-    return pollmgr_chan_send(chan, &pxudp, sizeof(pxudp));
+    return pollmgr_chan_send_to(pxudp->pmhdl.pmgr,
+                                chan, &pxudp, sizeof(pxudp));
 }
 
 
@@ -149,7 +150,8 @@ static ssize_t
 pxudp_chan_send_weak(enum pollmgr_slot_t chan, struct pxudp *pxudp)
 {
     pollmgr_refptr_weak_ref(pxudp->rp);
-    return pollmgr_chan_send(chan, &pxudp->rp, sizeof(pxudp->rp));
+    return pollmgr_chan_send_to(pxudp->pmhdl.pmgr,
+                                chan, &pxudp->rp, sizeof(pxudp->rp));
 }
 
 
@@ -255,6 +257,7 @@ pxudp_allocate(void)
     pxudp->pmhdl.callback = NULL;
     pxudp->pmhdl.data = (void *)pxudp;
     pxudp->pmhdl.slot = -1;
+    pxudp->pmhdl.pmgr = 0;
 
     pxudp->pcb = NULL;
     pxudp->sock = INVALID_SOCKET;
@@ -460,6 +463,8 @@ pxudp_pcb_accept(void *arg, struct udp_pcb *newpcb, struct pbuf *p,
     udp_recv(newpcb, pxudp_pcb_recv, pxudp);
 
     pxudp->pmhdl.callback = pxudp_pmgr_pump;
+    pxudp->pmhdl.pmgr = pollmgr_select(((u32_t)port << 16)
+                                       | newpcb->local_port);
     pxudp_chan_send(POLLMGR_CHAN_PXUDP_ADD, pxudp);
 
     /* dispatch directly instead of calling pxudp_pcb_recv() */
@@ -535,6 +540,7 @@ pxudp_pmgr_pump(struct pollmgr_handler *handler, SOCKET fd, int revents)
 {
     struct pxudp *pxudp;
     struct pbuf *p;
+    u8_t *udpbuf;
     ssize_t nread;
     err_t error;
 
@@ -575,7 +581,8 @@ pxudp_pmgr_pump(struct pollmgr_handler *handler, SOCKET fd, int revents)
         return POLLIN;
     }
 
-    nread = recv(pxudp->sock, pollmgr_udpbuf, sizeof(pollmgr_udpbuf), 0);
+    udpbuf = pollmgr_udpbuf_get(); /* this thread's buffer */
+    nread = recv(pxudp->sock, (char *)udpbuf, POLLMGR_UDPBUF_SIZE, 0);
     if (nread == SOCKET_ERROR) {
         perror(__func__);
         return POLLIN;
@@ -587,7 +594,7 @@ pxudp_pmgr_pump(struct pollmgr_handler *handler, SOCKET fd, int revents)
         return POLLIN;
     }
 
-    error = pbuf_take(p, pollmgr_udpbuf, (u16_t)nread);
+    error = pbuf_take(p, udpbuf, (u16_t)nread);
     if (error != ERR_OK) {
         DPRINTF(("%s: pbuf_take(%d) failed\n", __func__, (int)nread));
         pbuf_free(p);
@@ -1029,6 +1029,7 @@ static void rtAioMgrFileDestroy(PRTAIOMGRFILEINT pThis)
 {
     pThis->u32Magic = ~RTAIOMGRFILE_MAGIC;
     rtAioMgrCloseFile(pThis->pAioMgr, pThis);
+    RTFileAioCtxDisassociateFromFile(pThis->pAioMgr->hAioCtx, pThis->hFile);
     RTAioMgrRelease(pThis->pAioMgr);
     RTMemFree(pThis);
 }
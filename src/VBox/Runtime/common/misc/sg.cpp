@@ -438,31 +438,10 @@ RTDECL(bool) RTSgBufIsZero(PRTSGBUF pSgBuf, size_t cbCheck)
         if (!cbThisCheck)
             break;
 
-        /* Use optimized inline assembler if possible. */
-        if (   !(cbThisCheck % 4)
-            && (cbThisCheck * 8 <= UINT32_MAX))
+        if (!ASMMemIsZero(pvBuf, cbThisCheck))
         {
-            if (ASMBitFirstSet((volatile void *)pvBuf, (uint32_t)cbThisCheck * 8) != -1)
-            {
-                fIsZero = false;
-                break;
-            }
-        }
-        else
-        {
-            for (unsigned i = 0; i < cbThisCheck; i++)
-            {
-                char *pbBuf = (char *)pvBuf;
-                if (*pbBuf)
-                {
-                    fIsZero = false;
-                    break;
-                }
-                pvBuf = pbBuf + 1;
-            }
-
-            if (!fIsZero)
-                break;
+            fIsZero = false;
+            break;
         }
 
         cbLeft -= cbThisCheck;
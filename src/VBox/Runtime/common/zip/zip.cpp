@@ -35,6 +35,8 @@
 #define RTZIP_LZF_BLOCK_BY_BLOCK
 //#define RTZIP_USE_LZJB 1
 //#define RTZIP_USE_LZO 1
+//#define RTZIP_USE_LZ4 1
+//#define RTZIP_USE_ZSTD 1
 
 /** @todo FastLZ? QuickLZ? Others? */
 
@@ -58,6 +60,15 @@
 #ifdef RTZIP_USE_LZO
 # include <lzo/lzo1x.h>
 #endif
+#ifdef RTZIP_USE_LZ4
+# include <lz4.h>
+# include <lz4hc.h>
+# include <lz4frame.h>
+#endif
+#ifdef RTZIP_USE_ZSTD
+# include <zstd.h>
+# include <zstd_errors.h>
+#endif
 
 #include <iprt/zip.h>
 #include "internal/iprt.h"
@@ -113,6 +124,13 @@ typedef const RTZIPLZFHDR *PCRTZIPLZFHDR;
 
 #endif /* RTZIP_USE_LZF */
 
+#ifdef RTZIP_USE_LZ4
+/** The max number of input bytes we feed LZ4F_compressUpdate in one go.
+ * This keeps LZ4F_compressBound() well below the output buffer size even with
+ * a full 64KB block pending inside the compression context. */
+# define RTZIPLZ4_MAX_CHUNK_SIZE                _32K
+#endif
+
 
 /**
  * Compressor/Decompressor instance data.
@@ -176,6 +194,28 @@ typedef struct RTZIPCOMP
             uint8_t     abInput[RTZIPLZF_MAX_UNCOMPRESSED_DATA_SIZE];
         } LZF;
 #endif
+#ifdef RTZIP_USE_LZ4
+        /** LZ4 frame stream. */
+        struct
+        {
+            /** The LZ4 frame compression context. */
+            LZ4F_cctx          *pCCtx;
+            /** The frame preferences (compression level and such). */
+            LZ4F_preferences_t  Prefs;
+            /** Current output buffer offset (abBuffer). */
+            size_t              offOutput;
+        } LZ4;
+#endif
+#ifdef RTZIP_USE_ZSTD
+        /** Zstandard stream. */
+        struct
+        {
+            /** The compression stream. */
+            ZSTD_CStream       *pCStrm;
+            /** Current output buffer offset (abBuffer). */
+            size_t              offOutput;
+        } Zstd;
+#endif
 
     } u;
 } RTZIPCOMP;
@@ -248,6 +288,34 @@ typedef struct RTZIPDECOMP
             uint8_t    *pbSpill;
         } LZF;
 #endif
+#ifdef RTZIP_USE_LZ4
+        /** LZ4 frame stream. */
+        struct
+        {
+            /** The LZ4 frame decompression context. */
+            LZ4F_dctx          *pDCtx;
+            /** Current input buffer offset (abBuffer). */
+            size_t              offInput;
+            /** The number of valid bytes in the input buffer. */
+            size_t              cbInput;
+            /** Set when we've reached the end of the frame. */
+            bool                fEndOfFrame;
+        } LZ4;
+#endif
+#ifdef RTZIP_USE_ZSTD
+        /** Zstandard stream. */
+        struct
+        {
+            /** The decompression stream. */
+            ZSTD_DStream       *pDStrm;
+            /** Current input buffer offset (abBuffer). */
+            size_t              offInput;
+            /** The number of valid bytes in the input buffer. */
+            size_t              cbInput;
+            /** Set when we've reached the end of the frame. */
+            bool                fEndOfFrame;
+        } Zstd;
+#endif
 
     } u;
 } RTZIPDECOM;
@@ -1337,6 +1405,489 @@ static DECLCALLBACK(int) rtZipLZFDecompInit(PRTZIPDECOMP pZip)
 #endif /* RTZIP_USE_LZF */
 
 
+#ifdef RTZIP_USE_LZ4
+
+/**
+ * Convert from LZ4 frame API error to iprt status code.
+ *
+ * The frame API only exposes the error codes when statically linking, so we
+ * just tell compression and decompression failures apart.
+ *
+ * @returns iprt status code.
+ * @param   cbRc            The LZ4F return value (LZ4F_isError is true).
+ * @param   fCompressing    Set if we're compressing, clear if decompressing.
+ */
+static int zipErrConvertFromLZ4F(size_t cbRc, bool fCompressing)
+{
+    Assert(LZ4F_isError(cbRc));
+    LogFlow(("LZ4F error: %s\n", LZ4F_getErrorName(cbRc))); NOREF(cbRc);
+    return fCompressing ? VERR_ZIP_ERROR : VERR_ZIP_CORRUPTED;
+}
+
+
+/**
+ * Translates the IPRT compression level to a LZ4 one.
+ *
+ * @returns LZ4 compression level, 0 being the regular fast compressor and
+ *          anything from LZ4HC_CLEVEL_MIN and up the HC compressor.
+ * @param   enmLevel        The IPRT compression level.
+ */
+DECLINLINE(int) rtZipLZ4Level(RTZIPLEVEL enmLevel)
+{
+    return enmLevel == RTZIPLEVEL_MAX ? LZ4HC_CLEVEL_DEFAULT : 0;
+}
+
+
+/**
+ * Flushes the output buffer.
+ *
+ * @returns iprt status code.
+ * @param   pZip        The compressor instance.
+ */
+static int rtZipLZ4CompFlushOutput(PRTZIPCOMP pZip)
+{
+    size_t cb = pZip->u.LZ4.offOutput;
+    pZip->u.LZ4.offOutput = 0;
+    if (!cb)
+        return VINF_SUCCESS;
+    return pZip->pfnOut(pZip->pvUser, &pZip->abBuffer[0], cb);
+}
+
+
+/**
+ * @copydoc RTZipCompress
+ */
+static DECLCALLBACK(int) rtZipLZ4Compress(PRTZIPCOMP pZip, const void *pvBuf, size_t cbBuf)
+{
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    while (cbBuf > 0)
+    {
+        size_t const cbChunk = RT_MIN(cbBuf, RTZIPLZ4_MAX_CHUNK_SIZE);
+
+        /*
+         * Flush output buffer if LZ4F might not have enough room for the chunk.
+         */
+        if (sizeof(pZip->abBuffer) - pZip->u.LZ4.offOutput < LZ4F_compressBound(cbChunk, &pZip->u.LZ4.Prefs))
+        {
+            int rc = rtZipLZ4CompFlushOutput(pZip);
+            if (RT_FAILURE(rc))
+                return rc;
+        }
+
+        size_t cbRc = LZ4F_compressUpdate(pZip->u.LZ4.pCCtx,
+                                          &pZip->abBuffer[pZip->u.LZ4.offOutput], sizeof(pZip->abBuffer) - pZip->u.LZ4.offOutput,
+                                          pbBuf, cbChunk, NULL);
+        if (LZ4F_isError(cbRc))
+            return zipErrConvertFromLZ4F(cbRc, true /*fCompressing*/);
+        pZip->u.LZ4.offOutput += cbRc;
+        pbBuf += cbChunk;
+        cbBuf -= cbChunk;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @copydoc RTZipCompFinish
+ */
+static DECLCALLBACK(int) rtZipLZ4CompFinish(PRTZIPCOMP pZip)
+{
+    if (sizeof(pZip->abBuffer) - pZip->u.LZ4.offOutput < LZ4F_compressBound(0, &pZip->u.LZ4.Prefs))
+    {
+        int rc = rtZipLZ4CompFlushOutput(pZip);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    size_t cbRc = LZ4F_compressEnd(pZip->u.LZ4.pCCtx,
+                                   &pZip->abBuffer[pZip->u.LZ4.offOutput], sizeof(pZip->abBuffer) - pZip->u.LZ4.offOutput,
+                                   NULL);
+    if (LZ4F_isError(cbRc))
+        return zipErrConvertFromLZ4F(cbRc, true /*fCompressing*/);
+    pZip->u.LZ4.offOutput += cbRc;
+    return rtZipLZ4CompFlushOutput(pZip);
+}
+
+
+/**
+ * @copydoc RTZipCompDestroy
+ */
+static DECLCALLBACK(int) rtZipLZ4CompDestroy(PRTZIPCOMP pZip)
+{
+    if (pZip->u.LZ4.pCCtx)
+    {
+        LZ4F_freeCompressionContext(pZip->u.LZ4.pCCtx);
+        pZip->u.LZ4.pCCtx = NULL;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Initializes the compressor instance.
+ * @returns iprt status code.
+ * @param   pZip        The compressor instance.
+ * @param   enmLevel    The desired compression level.
+ */
+static DECLCALLBACK(int) rtZipLZ4CompInit(PRTZIPCOMP pZip, RTZIPLEVEL enmLevel)
+{
+    pZip->pfnCompress = rtZipLZ4Compress;
+    pZip->pfnFinish   = rtZipLZ4CompFinish;
+    pZip->pfnDestroy  = rtZipLZ4CompDestroy;
+
+    RT_ZERO(pZip->u.LZ4.Prefs);
+    pZip->u.LZ4.Prefs.frameInfo.blockSizeID   = LZ4F_max64KB;
+    pZip->u.LZ4.Prefs.frameInfo.blockMode     = LZ4F_blockLinked;
+    pZip->u.LZ4.Prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    pZip->u.LZ4.Prefs.compressionLevel        = rtZipLZ4Level(enmLevel);
+    pZip->u.LZ4.offOutput = 1;              /* skip the type byte */
+
+    size_t cbRc = LZ4F_createCompressionContext(&pZip->u.LZ4.pCCtx, LZ4F_VERSION);
+    if (LZ4F_isError(cbRc))
+    {
+        pZip->u.LZ4.pCCtx = NULL;
+        return VERR_ZIP_NO_MEMORY;
+    }
+
+    cbRc = LZ4F_compressBegin(pZip->u.LZ4.pCCtx, &pZip->abBuffer[1], sizeof(pZip->abBuffer) - 1, &pZip->u.LZ4.Prefs);
+    if (LZ4F_isError(cbRc))
+    {
+        rtZipLZ4CompDestroy(pZip);
+        return zipErrConvertFromLZ4F(cbRc, true /*fCompressing*/);
+    }
+    pZip->u.LZ4.offOutput += cbRc;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @copydoc RTZipDecompress
+ */
+static DECLCALLBACK(int) rtZipLZ4Decompress(PRTZIPDECOMP pZip, void *pvBuf, size_t cbBuf, size_t *pcbWritten)
+{
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    size_t   cbWritten = 0;
+    while (!pZip->u.LZ4.fEndOfFrame)
+    {
+        /*
+         * Let LZ4F have a go at whatever input we've got, it may have output
+         * pending from the previous call even when we've got none.
+         */
+        size_t cbDst = cbBuf - cbWritten;
+        size_t cbSrc = pZip->u.LZ4.cbInput - pZip->u.LZ4.offInput;
+        size_t cbRc  = LZ4F_decompress(pZip->u.LZ4.pDCtx, &pbBuf[cbWritten], &cbDst,
+                                       &pZip->abBuffer[pZip->u.LZ4.offInput], &cbSrc, NULL);
+        if (LZ4F_isError(cbRc))
+            return zipErrConvertFromLZ4F(cbRc, false /*fCompressing*/);
+        pZip->u.LZ4.offInput += cbSrc;
+        cbWritten            += cbDst;
+        if (cbRc == 0)
+            pZip->u.LZ4.fEndOfFrame = true;
+        else if (cbWritten >= cbBuf)
+            break;
+        else if (pZip->u.LZ4.offInput >= pZip->u.LZ4.cbInput)
+        {
+            /*
+             * Read more input.
+             */
+            size_t cb = sizeof(pZip->abBuffer);
+            int rc = pZip->pfnIn(pZip->pvUser, &pZip->abBuffer[0], sizeof(pZip->abBuffer), &cb);
+            if (RT_FAILURE(rc))
+                return rc;
+            if (!cb)
+                return VERR_ZIP_CORRUPTED;
+            pZip->u.LZ4.offInput = 0;
+            pZip->u.LZ4.cbInput  = cb;
+        }
+    }
+
+    if (pcbWritten)
+        *pcbWritten = cbWritten;
+    else if (cbWritten < cbBuf)
+        return VERR_NO_DATA;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @copydoc RTZipDecompDestroy
+ */
+static DECLCALLBACK(int) rtZipLZ4DecompDestroy(PRTZIPDECOMP pZip)
+{
+    if (pZip->u.LZ4.pDCtx)
+    {
+        LZ4F_freeDecompressionContext(pZip->u.LZ4.pDCtx);
+        pZip->u.LZ4.pDCtx = NULL;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Initialize the decompressor instance.
+ * @returns iprt status code.
+ * @param   pZip        The decompressor instance.
+ */
+static DECLCALLBACK(int) rtZipLZ4DecompInit(PRTZIPDECOMP pZip)
+{
+    pZip->pfnDecompress = rtZipLZ4Decompress;
+    pZip->pfnDestroy    = rtZipLZ4DecompDestroy;
+
+    pZip->u.LZ4.offInput    = 0;
+    pZip->u.LZ4.cbInput     = 0;
+    pZip->u.LZ4.fEndOfFrame = false;
+    size_t cbRc = LZ4F_createDecompressionContext(&pZip->u.LZ4.pDCtx, LZ4F_VERSION);
+    if (LZ4F_isError(cbRc))
+    {
+        pZip->u.LZ4.pDCtx = NULL;
+        return VERR_ZIP_NO_MEMORY;
+    }
+    return VINF_SUCCESS;
+}
+
+#endif /* RTZIP_USE_LZ4 */
+
+
+#ifdef RTZIP_USE_ZSTD
+
+/**
+ * Convert from Zstandard error to iprt status code.
+ *
+ * @returns iprt status code.
+ * @param   cbRc            The zstd return value (ZSTD_isError is true).
+ * @param   fCompressing    Set if we're compressing, clear if decompressing.
+ */
+static int zipErrConvertFromZstd(size_t cbRc, bool fCompressing)
+{
+    switch (ZSTD_getErrorCode(cbRc))
+    {
+        case ZSTD_error_no_error:
+            return VINF_SUCCESS;
+
+        case ZSTD_error_memory_allocation:
+            return VERR_ZIP_NO_MEMORY;
+
+        case ZSTD_error_dstSize_tooSmall:
+            return VERR_BUFFER_OVERFLOW;
+
+        case ZSTD_error_version_unsupported:
+        case ZSTD_error_frameParameter_unsupported:
+            return VERR_ZIP_UNSUPPORTED_VERSION;
+
+        default:
+            LogFlow(("zstd error: %s\n", ZSTD_getErrorName(cbRc)));
+            return fCompressing ? VERR_ZIP_ERROR : VERR_ZIP_CORRUPTED;
+    }
+}
+
+
+/**
+ * Translates the IPRT compression level to a Zstandard one.
+ *
+ * @returns Zstandard compression level.
+ * @param   enmLevel        The IPRT compression level.
+ */
+DECLINLINE(int) rtZipZstdLevel(RTZIPLEVEL enmLevel)
+{
+    switch (enmLevel)
+    {
+        case RTZIPLEVEL_STORE:
+        case RTZIPLEVEL_FAST:       return 1;
+        default:
+        case RTZIPLEVEL_DEFAULT:    return 3;
+        case RTZIPLEVEL_MAX:        return 19;
+    }
+}
+
+
+/**
+ * Worker for rtZipZstdCompress and rtZipZstdCompFinish.
+ *
+ * @returns iprt status code.
+ * @param   pZip        The compressor instance.
+ * @param   pvBuf       The input, NULL if finishing.
+ * @param   cbBuf       The input size.
+ * @param   enmOp       ZSTD_e_continue or ZSTD_e_end.
+ */
+static int rtZipZstdCompressWorker(PRTZIPCOMP pZip, const void *pvBuf, size_t cbBuf, ZSTD_EndDirective enmOp)
+{
+    ZSTD_inBuffer In = { pvBuf, cbBuf, 0 };
+    for (;;)
+    {
+        /*
+         * Flush output buffer?
+         */
+        if (pZip->u.Zstd.offOutput >= sizeof(pZip->abBuffer))
+        {
+            int rc = pZip->pfnOut(pZip->pvUser, &pZip->abBuffer[0], pZip->u.Zstd.offOutput);
+            if (RT_FAILURE(rc))
+                return rc;
+            pZip->u.Zstd.offOutput = 0;
+        }
+
+        ZSTD_outBuffer Out = { &pZip->abBuffer[0], sizeof(pZip->abBuffer), pZip->u.Zstd.offOutput };
+        size_t cbRc = ZSTD_compressStream2(pZip->u.Zstd.pCStrm, &Out, &In, enmOp);
+        if (ZSTD_isError(cbRc))
+            return zipErrConvertFromZstd(cbRc, true /*fCompressing*/);
+        pZip->u.Zstd.offOutput = Out.pos;
+
+        if (enmOp == ZSTD_e_end ? cbRc == 0 : In.pos >= In.size)
+            break;
+    }
+
+    /* The final flush. */
+    if (enmOp == ZSTD_e_end && pZip->u.Zstd.offOutput > 0)
+    {
+        int rc = pZip->pfnOut(pZip->pvUser, &pZip->abBuffer[0], pZip->u.Zstd.offOutput);
+        pZip->u.Zstd.offOutput = 0;
+        return rc;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @copydoc RTZipCompress
+ */
+static DECLCALLBACK(int) rtZipZstdCompress(PRTZIPCOMP pZip, const void *pvBuf, size_t cbBuf)
+{
+    return rtZipZstdCompressWorker(pZip, pvBuf, cbBuf, ZSTD_e_continue);
+}
+
+
+/**
+ * @copydoc RTZipCompFinish
+ */
+static DECLCALLBACK(int) rtZipZstdCompFinish(PRTZIPCOMP pZip)
+{
+    return rtZipZstdCompressWorker(pZip, NULL, 0, ZSTD_e_end);
+}
+
+
+/**
+ * @copydoc RTZipCompDestroy
+ */
+static DECLCALLBACK(int) rtZipZstdCompDestroy(PRTZIPCOMP pZip)
+{
+    if (pZip->u.Zstd.pCStrm)
+    {
+        ZSTD_freeCStream(pZip->u.Zstd.pCStrm);
+        pZip->u.Zstd.pCStrm = NULL;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Initializes the compressor instance.
+ * @returns iprt status code.
+ * @param   pZip        The compressor instance.
+ * @param   enmLevel    The desired compression level.
+ */
+static DECLCALLBACK(int) rtZipZstdCompInit(PRTZIPCOMP pZip, RTZIPLEVEL enmLevel)
+{
+    pZip->pfnCompress = rtZipZstdCompress;
+    pZip->pfnFinish   = rtZipZstdCompFinish;
+    pZip->pfnDestroy  = rtZipZstdCompDestroy;
+
+    pZip->u.Zstd.offOutput = 1;             /* skip the type byte */
+    pZip->u.Zstd.pCStrm    = ZSTD_createCStream();
+    if (!pZip->u.Zstd.pCStrm)
+        return VERR_ZIP_NO_MEMORY;
+
+    size_t cbRc = ZSTD_CCtx_setParameter(pZip->u.Zstd.pCStrm, ZSTD_c_compressionLevel, rtZipZstdLevel(enmLevel));
+    if (!ZSTD_isError(cbRc))
+        cbRc = ZSTD_CCtx_setParameter(pZip->u.Zstd.pCStrm, ZSTD_c_checksumFlag, 1);
+    if (ZSTD_isError(cbRc))
+    {
+        rtZipZstdCompDestroy(pZip);
+        return zipErrConvertFromZstd(cbRc, true /*fCompressing*/);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @copydoc RTZipDecompress
+ */
+static DECLCALLBACK(int) rtZipZstdDecompress(PRTZIPDECOMP pZip, void *pvBuf, size_t cbBuf, size_t *pcbWritten)
+{
+    ZSTD_outBuffer Out = { pvBuf, cbBuf, 0 };
+    while (!pZip->u.Zstd.fEndOfFrame)
+    {
+        /*
+         * Let zstd have a go at whatever input we've got, it may have output
+         * pending from the previous call even when we've got none.
+         */
+        ZSTD_inBuffer In = { &pZip->abBuffer[0], pZip->u.Zstd.cbInput, pZip->u.Zstd.offInput };
+        size_t cbRc = ZSTD_decompressStream(pZip->u.Zstd.pDStrm, &Out, &In);
+        if (ZSTD_isError(cbRc))
+            return zipErrConvertFromZstd(cbRc, false /*fCompressing*/);
+        pZip->u.Zstd.offInput = In.pos;
+        if (cbRc == 0)
+            pZip->u.Zstd.fEndOfFrame = true;
+        else if (Out.pos >= Out.size)
+            break;
+        else if (pZip->u.Zstd.offInput >= pZip->u.Zstd.cbInput)
+        {
+            /*
+             * Read more input.
+             */
+            size_t cb = sizeof(pZip->abBuffer);
+            int rc = pZip->pfnIn(pZip->pvUser, &pZip->abBuffer[0], sizeof(pZip->abBuffer), &cb);
+            if (RT_FAILURE(rc))
+                return rc;
+            if (!cb)
+                return VERR_ZIP_CORRUPTED;
+            pZip->u.Zstd.offInput = 0;
+            pZip->u.Zstd.cbInput  = cb;
+        }
+    }
+
+    if (pcbWritten)
+        *pcbWritten = Out.pos;
+    else if (Out.pos < cbBuf)
+        return VERR_NO_DATA;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @copydoc RTZipDecompDestroy
+ */
+static DECLCALLBACK(int) rtZipZstdDecompDestroy(PRTZIPDECOMP pZip)
+{
+    if (pZip->u.Zstd.pDStrm)
+    {
+        ZSTD_freeDStream(pZip->u.Zstd.pDStrm);
+        pZip->u.Zstd.pDStrm = NULL;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Initialize the decompressor instance.
+ * @returns iprt status code.
+ * @param   pZip        The decompressor instance.
+ */
+static DECLCALLBACK(int) rtZipZstdDecompInit(PRTZIPDECOMP pZip)
+{
+    pZip->pfnDecompress = rtZipZstdDecompress;
+    pZip->pfnDestroy    = rtZipZstdDecompDestroy;
+
+    pZip->u.Zstd.offInput    = 0;
+    pZip->u.Zstd.cbInput     = 0;
+    pZip->u.Zstd.fEndOfFrame = false;
+    pZip->u.Zstd.pDStrm      = ZSTD_createDStream();
+    if (!pZip->u.Zstd.pDStrm)
+        return VERR_ZIP_NO_MEMORY;
+    return VINF_SUCCESS;
+}
+
+#endif /* RTZIP_USE_ZSTD */
+
+
 /**
  * Create a compressor instance.
  *
@@ -1422,6 +1973,18 @@ RTDECL(int)     RTZipCompCreate(PRTZIPCOMP *ppZip, void *pvUser, PFNRTZIPOUT pfn
 #endif
             break;
 
+        case RTZIPTYPE_LZ4:
+#ifdef RTZIP_USE_LZ4
+            rc = rtZipLZ4CompInit(pZip, enmLevel);
+#endif
+            break;
+
+        case RTZIPTYPE_ZSTD:
+#ifdef RTZIP_USE_ZSTD
+            rc = rtZipZstdCompInit(pZip, enmLevel);
+#endif
+            break;
+
         case RTZIPTYPE_LZJB:
         case RTZIPTYPE_LZO:
             break;
@@ -1622,6 +2185,22 @@ static int rtzipDecompInit(PRTZIPDECOMP pZip)
 #endif
             break;
 
+        case RTZIPTYPE_LZ4:
+#ifdef RTZIP_USE_LZ4
+            rc = rtZipLZ4DecompInit(pZip);
+#else
+            AssertMsgFailed(("LZ4 is not include in this build!\n"));
+#endif
+            break;
+
+        case RTZIPTYPE_ZSTD:
+#ifdef RTZIP_USE_ZSTD
+            rc = rtZipZstdDecompInit(pZip);
+#else
+            AssertMsgFailed(("Zstd is not include in this build!\n"));
+#endif
+            break;
+
         default:
             AssertMsgFailed(("Invalid compression type %d (%#x)!\n", pZip->enmType, pZip->enmType));
             rc = VERR_INVALID_MAGIC;
@@ -1800,6 +2379,38 @@ RTDECL(int) RTZipBlockCompress(RTZIPTYPE enmType, RTZIPLEVEL enmLevel, uint32_t
 #endif
         }
 
+        case RTZIPTYPE_LZ4:
+        {
+#ifdef RTZIP_USE_LZ4
+            AssertReturn(cbSrc <= LZ4_MAX_INPUT_SIZE, VERR_TOO_MUCH_DATA);
+            int const cbDstMax = (int)RT_MIN(cbDst, (size_t)INT32_MAX);
+            int cbDstActual;
+            if (enmLevel == RTZIPLEVEL_MAX)
+                cbDstActual = LZ4_compress_HC((const char *)pvSrc, (char *)pvDst, (int)cbSrc, cbDstMax, LZ4HC_CLEVEL_DEFAULT);
+            else
+                cbDstActual = LZ4_compress_default((const char *)pvSrc, (char *)pvDst, (int)cbSrc, cbDstMax);
+            if (RT_UNLIKELY(cbDstActual <= 0))
+                return VERR_BUFFER_OVERFLOW;
+            *pcbDstActual = (size_t)cbDstActual;
+            break;
+#else
+            return VERR_NOT_SUPPORTED;
+#endif
+        }
+
+        case RTZIPTYPE_ZSTD:
+        {
+#ifdef RTZIP_USE_ZSTD
+            size_t cbRc = ZSTD_compress(pvDst, cbDst, pvSrc, cbSrc, rtZipZstdLevel(enmLevel));
+            if (RT_UNLIKELY(ZSTD_isError(cbRc)))
+                return zipErrConvertFromZstd(cbRc, true /*fCompressing*/);
+            *pcbDstActual = cbRc;
+            break;
+#else
+            return VERR_NOT_SUPPORTED;
+#endif
+        }
+
         case RTZIPTYPE_ZLIB:
         case RTZIPTYPE_BZLIB:
             return VERR_NOT_SUPPORTED;
@@ -1959,6 +2570,42 @@ RTDECL(int) RTZipBlockDecompress(RTZIPTYPE enmType, uint32_t fFlags,
         case RTZIPTYPE_BZLIB:
             return VERR_NOT_SUPPORTED;
 
+        case RTZIPTYPE_LZ4:
+        {
+#ifdef RTZIP_USE_LZ4
+            AssertReturn(cbSrc <= INT32_MAX, VERR_TOO_MUCH_DATA);
+            /* Note! LZ4_decompress_safe doesn't tell a too small output buffer
+                     apart from corrupted input. */
+            int cbDstActual = LZ4_decompress_safe((const char *)pvSrc, (char *)pvDst, (int)cbSrc,
+                                                  (int)RT_MIN(cbDst, (size_t)INT32_MAX));
+            if (RT_UNLIKELY(cbDstActual < 0))
+                return VERR_ZIP_CORRUPTED;
+            if (pcbSrcActual)
+                *pcbSrcActual = cbSrc;
+            if (pcbDstActual)
+                *pcbDstActual = (size_t)cbDstActual;
+            break;
+#else
+            return VERR_NOT_SUPPORTED;
+#endif
+        }
+
+        case RTZIPTYPE_ZSTD:
+        {
+#ifdef RTZIP_USE_ZSTD
+            size_t cbRc = ZSTD_decompress(pvDst, cbDst, pvSrc, cbSrc);
+            if (RT_UNLIKELY(ZSTD_isError(cbRc)))
+                return zipErrConvertFromZstd(cbRc, false /*fCompressing*/);
+            if (pcbSrcActual)
+                *pcbSrcActual = cbSrc;
+            if (pcbDstActual)
+                *pcbDstActual = cbRc;
+            break;
+#else
+            return VERR_NOT_SUPPORTED;
+#endif
+        }
+
         default:
             AssertMsgFailed(("%d\n", enmType));
             return VERR_INVALID_PARAMETER;
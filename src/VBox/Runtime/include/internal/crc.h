@@ -0,0 +1,294 @@
+/* $Id$ */
+/** @file
+ * IPRT - Internal header containing the shared CRC32 workers.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+#ifndef ___internal_crc_h
+#define ___internal_crc_h
+
+#include <iprt/types.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/string.h>
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+# include <iprt/asm-amd64-x86.h>
+# include <iprt/x86.h>
+#endif
+
+/** @def RTCRC_WITH_PCLMUL
+ * Defined when the PCLMULQDQ folding code is available.
+ *
+ * This uses XMM registers and is therefore restricted to ring-3 where we
+ * don't have to care about saving the FPU state.  32-bit hosts are skipped
+ * because GCC can't be relied on to have SSE enabled there. */
+#if defined(RT_ARCH_AMD64) && defined(IN_RING3) && (RT_INLINE_ASM_GNU_STYLE || RT_INLINE_ASM_USES_INTRIN)
+# define RTCRC_WITH_PCLMUL
+# if !RT_INLINE_ASM_GNU_STYLE
+#  include <wmmintrin.h>
+#  include <smmintrin.h>
+# endif
+#endif
+
+RT_C_DECLS_BEGIN
+
+/**
+ * Processes a buffer with the slice-by-8 algorithm.
+ *
+ * @returns Updated CRC value.
+ * @param   paau32Table     The 8 lookup tables of the polynomial, the first
+ *                          one being the classic byte-at-a-time table.
+ * @param   uCrc32          The current CRC value.
+ * @param   pv              The data.
+ * @param   cb              Number of bytes to process.
+ */
+DECLINLINE(uint32_t) rtCrc32ProcessSlicing8(const uint32_t (*paau32Table)[256], uint32_t uCrc32, const void *pv, size_t cb)
+{
+    const uint8_t *pu8 = (const uint8_t *)pv;
+
+    /* Align the input so the loop below works with aligned dwords. */
+    while (cb && ((uintptr_t)pu8 & 3))
+    {
+        uCrc32 = paau32Table[0][(uCrc32 ^ *pu8++) & 0xff] ^ (uCrc32 >> 8);
+        cb--;
+    }
+
+    while (cb >= 8)
+    {
+        uint32_t const u32Lo = RT_LE2H_U32(*(const uint32_t *)pu8) ^ uCrc32;
+        uint32_t const u32Hi = RT_LE2H_U32(*(const uint32_t *)(pu8 + 4));
+
+        uCrc32 = paau32Table[7][ u32Lo        & 0xff]
+               ^ paau32Table[6][(u32Lo >>  8) & 0xff]
+               ^ paau32Table[5][(u32Lo >> 16) & 0xff]
+               ^ paau32Table[4][ u32Lo >> 24        ]
+               ^ paau32Table[3][ u32Hi        & 0xff]
+               ^ paau32Table[2][(u32Hi >>  8) & 0xff]
+               ^ paau32Table[1][(u32Hi >> 16) & 0xff]
+               ^ paau32Table[0][ u32Hi >> 24        ];
+        pu8 += 8;
+        cb  -= 8;
+    }
+
+    while (cb--)
+        uCrc32 = paau32Table[0][(uCrc32 ^ *pu8++) & 0xff] ^ (uCrc32 >> 8);
+
+    return uCrc32;
+}
+
+
+#ifdef RTCRC_WITH_PCLMUL
+
+/**
+ * The constants for folding a bit reflected CRC32 with PCLMULQDQ.
+ *
+ * See Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" white paper for how they are derived.
+ */
+typedef struct RTCRC32FOLDCONSTS
+{
+    /** x^(4*128+32) mod P and x^(4*128-32) mod P, for folding 64 byte blocks. */
+    uint64_t    au64K1K2[2];
+    /** x^(128+32) mod P and x^(128-32) mod P, for folding 16 byte blocks. */
+    uint64_t    au64K3K4[2];
+    /** x^64 mod P, for folding 128 bits into 64. */
+    uint64_t    u64K5;
+    /** The polynomial and the Barrett constant (floor(x^64 / P)). */
+    uint64_t    au64PolyMu[2];
+} RTCRC32FOLDCONSTS;
+/** Pointer to const CRC32 folding constants. */
+typedef RTCRC32FOLDCONSTS const *PCRTCRC32FOLDCONSTS;
+
+# if RT_INLINE_ASM_GNU_STYLE
+/** A 128-bit XMM register value. */
+typedef long long RTCRCXMM __attribute__((__vector_size__(16)));
+
+DECLINLINE(RTCRCXMM) rtCrcXmmLoadU(const void *pv)
+{
+    RTCRCXMM uRet;
+    memcpy(&uRet, pv, sizeof(uRet));
+    return uRet;
+}
+
+DECLINLINE(RTCRCXMM) rtCrcXmmFromU64(uint64_t uLo, uint64_t uHi)
+{
+    RTCRCXMM uRet = { (long long)uLo, (long long)uHi };
+    return uRet;
+}
+
+DECLINLINE(uint32_t) rtCrcXmmGetU32(RTCRCXMM uVal, unsigned iDWord)
+{
+    uint32_t au32[4];
+    memcpy(&au32[0], &uVal, sizeof(au32));
+    return au32[iDWord];
+}
+
+#  define RTCRC_XMM_XOR(a_uX, a_uY)          ((a_uX) ^ (a_uY))
+#  define RTCRC_XMM_AND(a_uX, a_uY)          ((a_uX) & (a_uY))
+
+/** Shifts the value right by the given number of bytes (psrldq). */
+#  define RTCRC_XMM_SHR_BYTES(a_uX, a_cb) \
+    __extension__ ({ RTCRCXMM uXmmRet = (a_uX); __asm__("psrldq %1, %0" : "+x" (uXmmRet) : "i" (a_cb)); uXmmRet; })
+/** Carry-less multiplication of a qword from each value, a_fSel is encoded
+ * as for the pclmulqdq instruction. */
+#  define RTCRC_XMM_CLMUL(a_uX, a_uY, a_fSel) \
+    __extension__ ({ RTCRCXMM uXmmRet = (a_uX); __asm__("pclmulqdq %2, %1, %0" : "+x" (uXmmRet) : "x" (a_uY), "i" (a_fSel)); uXmmRet; })
+
+# else /* !RT_INLINE_ASM_GNU_STYLE */
+typedef __m128i RTCRCXMM;
+
+DECLINLINE(RTCRCXMM) rtCrcXmmLoadU(const void *pv)
+{
+    return _mm_loadu_si128((__m128i const *)pv);
+}
+
+DECLINLINE(RTCRCXMM) rtCrcXmmFromU64(uint64_t uLo, uint64_t uHi)
+{
+    return _mm_set_epi64x((int64_t)uHi, (int64_t)uLo);
+}
+
+DECLINLINE(uint32_t) rtCrcXmmGetU32(RTCRCXMM uVal, unsigned iDWord)
+{
+    uint32_t au32[4];
+    _mm_storeu_si128((__m128i *)&au32[0], uVal);
+    return au32[iDWord];
+}
+
+#  define RTCRC_XMM_XOR(a_uX, a_uY)          _mm_xor_si128(a_uX, a_uY)
+#  define RTCRC_XMM_AND(a_uX, a_uY)          _mm_and_si128(a_uX, a_uY)
+#  define RTCRC_XMM_SHR_BYTES(a_uX, a_cb)    _mm_srli_si128(a_uX, a_cb)
+#  define RTCRC_XMM_CLMUL(a_uX, a_uY, a_fSel) _mm_clmulepi64_si128(a_uX, a_uY, a_fSel)
+# endif /* !RT_INLINE_ASM_GNU_STYLE */
+
+/**
+ * Checks whether the host supports the PCLMULQDQ folding code.
+ *
+ * @returns true if supported, false if not.
+ */
+DECLINLINE(bool) rtCrcIsPclmulSupported(void)
+{
+    uint32_t const fEcx = ASMCpuId_ECX(1);
+    return (fEcx & (X86_CPUID_FEATURE_ECX_PCLMUL | X86_CPUID_FEATURE_ECX_SSE4_1))
+        == (X86_CPUID_FEATURE_ECX_PCLMUL | X86_CPUID_FEATURE_ECX_SSE4_1);
+}
+
+/**
+ * Processes a buffer by folding it with PCLMULQDQ.
+ *
+ * Only whole 16 byte blocks are processed, the caller has to take care of the
+ * remainder.
+ *
+ * @returns Updated CRC value.
+ * @param   pConsts         The folding constants of the polynomial.
+ * @param   uCrc32          The current CRC value.
+ * @param   pu8             The data.
+ * @param   cb              Number of bytes to process, at least 64. Only
+ *                          cb & ~15 bytes are processed.
+ */
+DECLINLINE(uint32_t) rtCrc32ProcessPclmul(PCRTCRC32FOLDCONSTS pConsts, uint32_t uCrc32, const uint8_t *pu8, size_t cb)
+{
+    RTCRCXMM uX1 = rtCrcXmmLoadU(pu8);
+    RTCRCXMM uX2 = rtCrcXmmLoadU(pu8 + 16);
+    RTCRCXMM uX3 = rtCrcXmmLoadU(pu8 + 32);
+    RTCRCXMM uX4 = rtCrcXmmLoadU(pu8 + 48);
+    RTCRCXMM uK  = rtCrcXmmFromU64(pConsts->au64K1K2[0], pConsts->au64K1K2[1]);
+    RTCRCXMM uTmp;
+
+    Assert(cb >= 64);
+    uX1 = RTCRC_XMM_XOR(uX1, rtCrcXmmFromU64(uCrc32, 0));
+    pu8 += 64;
+    cb  -= 64;
+
+    /* Fold four 128-bit lanes in parallel. */
+    while (cb >= 64)
+    {
+        RTCRCXMM uX5 = RTCRC_XMM_CLMUL(uX1, uK, 0x00);
+        RTCRCXMM uX6 = RTCRC_XMM_CLMUL(uX2, uK, 0x00);
+        RTCRCXMM uX7 = RTCRC_XMM_CLMUL(uX3, uK, 0x00);
+        RTCRCXMM uX8 = RTCRC_XMM_CLMUL(uX4, uK, 0x00);
+
+        uX1 = RTCRC_XMM_CLMUL(uX1, uK, 0x11);
+        uX2 = RTCRC_XMM_CLMUL(uX2, uK, 0x11);
+        uX3 = RTCRC_XMM_CLMUL(uX3, uK, 0x11);
+        uX4 = RTCRC_XMM_CLMUL(uX4, uK, 0x11);
+
+        uX1 = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX1, uX5), rtCrcXmmLoadU(pu8));
+        uX2 = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX2, uX6), rtCrcXmmLoadU(pu8 + 16));
+        uX3 = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX3, uX7), rtCrcXmmLoadU(pu8 + 32));
+        uX4 = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX4, uX8), rtCrcXmmLoadU(pu8 + 48));
+
+        pu8 += 64;
+        cb  -= 64;
+    }
+
+    /* Fold the lanes into a single one. */
+    uK = rtCrcXmmFromU64(pConsts->au64K3K4[0], pConsts->au64K3K4[1]);
+
+    uTmp = RTCRC_XMM_CLMUL(uX1, uK, 0x00);
+    uX1  = RTCRC_XMM_CLMUL(uX1, uK, 0x11);
+    uX1  = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX1, uX2), uTmp);
+
+    uTmp = RTCRC_XMM_CLMUL(uX1, uK, 0x00);
+    uX1  = RTCRC_XMM_CLMUL(uX1, uK, 0x11);
+    uX1  = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX1, uX3), uTmp);
+
+    uTmp = RTCRC_XMM_CLMUL(uX1, uK, 0x00);
+    uX1  = RTCRC_XMM_CLMUL(uX1, uK, 0x11);
+    uX1  = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX1, uX4), uTmp);
+
+    /* Fold the remaining 16 byte blocks. */
+    while (cb >= 16)
+    {
+        uTmp = RTCRC_XMM_CLMUL(uX1, uK, 0x00);
+        uX1  = RTCRC_XMM_CLMUL(uX1, uK, 0x11);
+        uX1  = RTCRC_XMM_XOR(RTCRC_XMM_XOR(uX1, rtCrcXmmLoadU(pu8)), uTmp);
+
+        pu8 += 16;
+        cb  -= 16;
+    }
+
+    /* Fold 128 bits into 64. */
+    RTCRCXMM const uMask = rtCrcXmmFromU64(UINT32_MAX, UINT32_MAX);
+
+    uTmp = RTCRC_XMM_CLMUL(uX1, uK, 0x10);
+    uX1  = RTCRC_XMM_XOR(RTCRC_XMM_SHR_BYTES(uX1, 8), uTmp);
+
+    uK   = rtCrcXmmFromU64(pConsts->u64K5, 0);
+    uTmp = RTCRC_XMM_SHR_BYTES(uX1, 4);
+    uX1  = RTCRC_XMM_CLMUL(RTCRC_XMM_AND(uX1, uMask), uK, 0x00);
+    uX1  = RTCRC_XMM_XOR(uX1, uTmp);
+
+    /* Barrett reduction to 32 bits. */
+    uK   = rtCrcXmmFromU64(pConsts->au64PolyMu[0], pConsts->au64PolyMu[1]);
+    uTmp = RTCRC_XMM_CLMUL(RTCRC_XMM_AND(uX1, uMask), uK, 0x10);
+    uTmp = RTCRC_XMM_CLMUL(RTCRC_XMM_AND(uTmp, uMask), uK, 0x00);
+    uX1  = RTCRC_XMM_XOR(uX1, uTmp);
+
+    return rtCrcXmmGetU32(uX1, 1);
+}
+
+#endif /* RTCRC_WITH_PCLMUL */
+
+RT_C_DECLS_END
+
+#endif
@@ -40,6 +40,26 @@
  * compensated if the user of this API implements caching itself. The next
  * limitation is that data buffers must be aligned at a 512 byte boundary or the
  * request will fail.
+ *
+ * Kernels since 5.11 provide io_uring which is used instead if available.
+ * The submission and completion queues are shared with the kernel through
+ * memory mappings. A batch of requests is handed to the kernel with a single
+ * io_uring_enter call, and requests which are completed already are reaped
+ * directly from the completion queue without entering the kernel at all. Files
+ * associated with a context are registered with the ring, which saves the file
+ * lookup for every request. The ring keeps a reference to a registered file
+ * until it is disassociated again, so RTFileAioCtxDisassociateFromFile() must
+ * be called before closing a file while the context stays around.
+ * io_uring doesn't depend on O_DIRECT for being asynchronous, buffered I/O is
+ * handed off to kernel worker threads. Setting the IPRT_FILEAIO_NO_IO_URING
+ * environment variable forces the legacy interface for new contexts.
+ *
+ * The ring is set up without IORING_SETUP_SQPOLL and IORING_SETUP_IOPOLL.
+ * Submission queue polling needs a kernel thread spinning on the ring for each
+ * context, and before 5.11 it needs elevated privileges. Polled completions
+ * only work for O_DIRECT files on devices supporting it and require busy
+ * polling in RTFileAioCtxWait() instead of sleeping. Neither pays off for the
+ * VM disk workloads with a couple of dozen requests in flight at most.
  */
 /** @todo r=bird: What's this about "must be opened with O_DIRECT"? An
  *        explanation would be nice, esp. seeing what Linus is quoted saying
@@ -56,9 +76,13 @@
 #include <iprt/err.h>
 #include <iprt/log.h>
 #include <iprt/thread.h>
+#include <iprt/critsect.h>
+#include <iprt/env.h>
+#include <iprt/time.h>
 #include "internal/fileaio.h"
 
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <errno.h>
 
@@ -166,12 +190,201 @@ typedef struct LNXKAIOIOEVENT
 } LNXKAIOIOEVENT, *PLNXKAIOIOEVENT;
 
 
+/**
+ * io_uring submission queue ring offsets (struct io_sqring_offsets).
+ */
+typedef struct LNXURINGSQOFFSETS
+{
+    uint32_t  offHead;
+    uint32_t  offTail;
+    uint32_t  offRingMask;
+    uint32_t  offRingEntries;
+    uint32_t  offFlags;
+    uint32_t  offDropped;
+    uint32_t  offArray;
+    uint32_t  u32Reserved0;
+    uint64_t  u64Reserved1;
+} LNXURINGSQOFFSETS;
+AssertCompileSize(LNXURINGSQOFFSETS, 40);
+
+/**
+ * io_uring completion queue ring offsets (struct io_cqring_offsets).
+ */
+typedef struct LNXURINGCQOFFSETS
+{
+    uint32_t  offHead;
+    uint32_t  offTail;
+    uint32_t  offRingMask;
+    uint32_t  offRingEntries;
+    uint32_t  offOverflow;
+    uint32_t  offCqes;
+    uint32_t  offFlags;
+    uint32_t  u32Reserved0;
+    uint64_t  u64Reserved1;
+} LNXURINGCQOFFSETS;
+AssertCompileSize(LNXURINGCQOFFSETS, 40);
+
+/**
+ * Parameters for io_uring_setup (struct io_uring_params).
+ */
+typedef struct LNXURINGPARAMS
+{
+    /** Number of submission queue entries, set by the kernel. */
+    uint32_t           cSqEntries;
+    /** Number of completion queue entries, set by the kernel. */
+    uint32_t           cCqEntries;
+    /** Setup flags (LNXURING_SETUP_XXX). */
+    uint32_t           fFlags;
+    uint32_t           idSqThreadCpu;
+    uint32_t           cSqThreadIdleMs;
+    /** Features supported by the kernel (LNXURING_FEAT_XXX). */
+    uint32_t           fFeatures;
+    uint32_t           uWqFd;
+    uint32_t           au32Reserved[3];
+    /** Submission queue ring offsets. */
+    LNXURINGSQOFFSETS  SqOffsets;
+    /** Completion queue ring offsets. */
+    LNXURINGCQOFFSETS  CqOffsets;
+} LNXURINGPARAMS;
+AssertCompileSize(LNXURINGPARAMS, 120);
+
+/**
+ * io_uring submission queue entry (struct io_uring_sqe).
+ */
+typedef struct LNXURINGSQE
+{
+    /** The operation (LNXURING_OP_XXX). */
+    uint8_t   u8Opcode;
+    /** Flags (LNXURING_SQE_F_XXX). */
+    uint8_t   fFlags;
+    /** Request priority. */
+    uint16_t  u16IoPrio;
+    /** The file descriptor or index into the registered files. */
+    int32_t   iFd;
+    /** At which offset to start the transfer. */
+    uint64_t  off;
+    /** The userspace pointer to the buffer containing/receiving the data. */
+    uint64_t  u64AddrBuf;
+    /** How many bytes to transfer. */
+    uint32_t  cbTransfer;
+    /** Operation specific flags. */
+    uint32_t  fOpFlags;
+    /** Opaque data which is returned in the completion queue entry. */
+    uint64_t  u64User;
+    uint16_t  u16BufIndex;
+    uint16_t  u16Personality;
+    int32_t   i32SpliceFdIn;
+    uint64_t  au64Reserved[2];
+} LNXURINGSQE;
+AssertCompileSize(LNXURINGSQE, 64);
+/** Pointer to a submission queue entry. */
+typedef LNXURINGSQE *PLNXURINGSQE;
+
+/**
+ * io_uring completion queue entry (struct io_uring_cqe).
+ */
+typedef struct LNXURINGCQE
+{
+    /** The u64User field from the submission queue entry. */
+    uint64_t  u64User;
+    /** The result code of the operation. */
+    int32_t   rc;
+    /** Flags. */
+    uint32_t  fFlags;
+} LNXURINGCQE;
+AssertCompileSize(LNXURINGCQE, 16);
+/** Pointer to a completion queue entry. */
+typedef LNXURINGCQE *PLNXURINGCQE;
+
+/**
+ * Timeout for io_uring_enter (struct __kernel_timespec).
+ */
+typedef struct LNXURINGTIMESPEC
+{
+    int64_t   i64Sec;
+    int64_t   i64NanoSec;
+} LNXURINGTIMESPEC;
+
+/**
+ * Extended argument for io_uring_enter (struct io_uring_getevents_arg).
+ */
+typedef struct LNXURINGGETEVENTSARG
+{
+    uint64_t  u64SigMask;
+    uint32_t  cbSigMask;
+    uint32_t  u32Padding;
+    /** Pointer to the timeout, LNXURINGTIMESPEC. */
+    uint64_t  u64Ts;
+} LNXURINGGETEVENTSARG;
+
+/**
+ * Argument for updating registered files (struct io_uring_files_update).
+ */
+typedef struct LNXURINGFILESUPDATE
+{
+    /** The first index to update. */
+    uint32_t  offFirst;
+    uint32_t  u32Reserved;
+    /** Pointer to the array of file descriptors. */
+    uint64_t  u64Fds;
+} LNXURINGFILESUPDATE;
+
+
+/** Maximum number of files which can be registered with an io_uring instance. */
+#define LNXURING_FILES_MAX 64
+/** Maximum number of bytes the kernel transfers with a single read or write
+ * (MAX_RW_COUNT), larger requests complete short with the legacy interface too. */
+#define LNXURING_TRANSFER_MAX UINT32_C(0x7ffff000)
+
+/**
+ * io_uring instance state of a context.
+ */
+typedef struct LNXURING
+{
+    /** The io_uring file descriptor. */
+    int                 iFdRing;
+    /** Number of entries in the submission queue. */
+    uint32_t            cSqEntries;
+    /** Mask for the submission queue indexes. */
+    uint32_t            fSqMask;
+    /** Mask for the completion queue indexes. */
+    uint32_t            fCqMask;
+    /** Kernel owned head of the submission queue. */
+    volatile uint32_t  *pu32SqHead;
+    /** Tail of the submission queue, only written by us. */
+    volatile uint32_t  *pu32SqTail;
+    /** Head of the completion queue, only written by us. */
+    volatile uint32_t  *pu32CqHead;
+    /** Kernel owned tail of the completion queue. */
+    volatile uint32_t  *pu32CqTail;
+    /** The submission queue entries. */
+    PLNXURINGSQE        paSqes;
+    /** The completion queue entries. */
+    PLNXURINGCQE        paCqes;
+    /** The mapping of the rings. */
+    void               *pvRings;
+    /** Size of the ring mapping. */
+    size_t              cbRings;
+    /** Size of the submission queue entry mapping. */
+    size_t              cbSqes;
+    /** Lock serializing submissions and the registered file table. */
+    RTCRITSECT          CritSectSq;
+    /** Flag whether the file table was registered. */
+    bool                fFilesRegistered;
+    /** Number of used slots in the file table (highest used + 1). */
+    uint32_t            cFds;
+    /** File descriptors registered in the file table, -1 for unused slots. */
+    int                 aFds[LNXURING_FILES_MAX];
+} LNXURING;
+/** Pointer to an io_uring instance state. */
+typedef LNXURING *PLNXURING;
+
 /**
  * Async I/O completion context state.
  */
 typedef struct RTFILEAIOCTXINTERNAL
 {
-    /** Handle to the async I/O context. */
+    /** Handle to the async I/O context, not used with io_uring. */
     LNXKAIOCONTEXT      AioContext;
     /** Maximum number of requests this context can handle. */
     int                 cRequestsMax;
@@ -187,6 +400,10 @@ typedef struct RTFILEAIOCTXINTERNAL
     uint32_t            fFlags;
     /** Magic value (RTFILEAIOCTX_MAGIC). */
     uint32_t            u32Magic;
+    /** Flag whether io_uring is used instead of the legacy interface. */
+    bool                fIoUring;
+    /** The io_uring state if fIoUring is set. */
+    LNXURING            Uring;
 } RTFILEAIOCTXINTERNAL;
 /** Pointer to an internal context structure. */
 typedef RTFILEAIOCTXINTERNAL *PRTFILEAIOCTXINTERNAL;
@@ -222,6 +439,37 @@ typedef RTFILEAIOREQINTERNAL *PRTFILEAIOREQINTERNAL;
 /** The max number of events to get in one call. */
 #define AIO_MAXIMUM_REQUESTS_PER_CONTEXT 64
 
+/** @name io_uring syscall numbers, the same on all architectures.
+ * @{ */
+#ifndef __NR_io_uring_setup
+# define __NR_io_uring_setup              425
+#endif
+#ifndef __NR_io_uring_enter
+# define __NR_io_uring_enter              426
+#endif
+#ifndef __NR_io_uring_register
+# define __NR_io_uring_register           427
+#endif
+/** @} */
+
+/** @name io_uring constants.
+ * @{ */
+#define LNXURING_SETUP_CLAMP              RT_BIT_32(4)
+#define LNXURING_FEAT_SINGLE_MMAP         RT_BIT_32(0)
+#define LNXURING_FEAT_NODROP              RT_BIT_32(1)
+#define LNXURING_FEAT_EXT_ARG             RT_BIT_32(8)
+#define LNXURING_ENTER_GETEVENTS          RT_BIT_32(0)
+#define LNXURING_ENTER_EXT_ARG            RT_BIT_32(3)
+#define LNXURING_SQE_F_FIXED_FILE         RT_BIT_32(0)
+#define LNXURING_OP_FSYNC                 3
+#define LNXURING_OP_READ                  22
+#define LNXURING_OP_WRITE                 23
+#define LNXURING_REGISTER_FILES           2
+#define LNXURING_REGISTER_FILES_UPDATE    6
+#define LNXURING_OFF_SQ_RING              UINT64_C(0)
+#define LNXURING_OFF_SQES                 UINT64_C(0x10000000)
+/** @} */
+
 
 /**
  * Creates a new async I/O context.
@@ -287,6 +535,430 @@ DECLINLINE(int) rtFileAsyncIoLinuxGetEvents(LNXKAIOCONTEXT AioContext, long cReq
     return rc;
 }
 
+/**
+ * Tries to set up an io_uring instance for the given context.
+ *
+ * @returns IPRT status code, VERR_NOT_SUPPORTED if the kernel lacks io_uring or
+ *          the features we depend on.
+ * @param   pUring      The io_uring state to initialize.
+ * @param   cEntries    Number of requests the submission queue should hold.
+ */
+static int rtFileAioLnxUringCreate(PLNXURING pUring, uint32_t cEntries)
+{
+    LNXURINGPARAMS Params;
+    RT_ZERO(Params);
+    Params.fFlags = LNXURING_SETUP_CLAMP;
+
+    int iFdRing = syscall(__NR_io_uring_setup, cEntries, &Params);
+    if (iFdRing == -1)
+        return errno == ENOSYS ? VERR_NOT_SUPPORTED : RTErrConvertFromErrno(errno);
+
+    /*
+     * We need a single mapping for both rings, completions must never be dropped
+     * and waiting with a timeout must be possible without an extra request.
+     */
+    uint32_t const fFeaturesRequired = LNXURING_FEAT_SINGLE_MMAP | LNXURING_FEAT_NODROP | LNXURING_FEAT_EXT_ARG;
+    if ((Params.fFeatures & fFeaturesRequired) != fFeaturesRequired)
+    {
+        close(iFdRing);
+        return VERR_NOT_SUPPORTED;
+    }
+
+    pUring->cbRings = RT_MAX(Params.SqOffsets.offArray + Params.cSqEntries * sizeof(uint32_t),
+                             Params.CqOffsets.offCqes + Params.cCqEntries * sizeof(LNXURINGCQE));
+    pUring->cbSqes  = Params.cSqEntries * sizeof(LNXURINGSQE);
+    pUring->pvRings = mmap(NULL, pUring->cbRings, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           iFdRing, LNXURING_OFF_SQ_RING);
+    if (pUring->pvRings != MAP_FAILED)
+    {
+        pUring->paSqes = (PLNXURINGSQE)mmap(NULL, pUring->cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            iFdRing, LNXURING_OFF_SQES);
+        if ((void *)pUring->paSqes != MAP_FAILED)
+        {
+            int rc = RTCritSectInit(&pUring->CritSectSq);
+            if (RT_SUCCESS(rc))
+            {
+                uint8_t *pbRings = (uint8_t *)pUring->pvRings;
+
+                pUring->iFdRing    = iFdRing;
+                pUring->cSqEntries = Params.cSqEntries;
+                pUring->fSqMask    = *(uint32_t *)(pbRings + Params.SqOffsets.offRingMask);
+                pUring->fCqMask    = *(uint32_t *)(pbRings + Params.CqOffsets.offRingMask);
+                pUring->pu32SqHead = (volatile uint32_t *)(pbRings + Params.SqOffsets.offHead);
+                pUring->pu32SqTail = (volatile uint32_t *)(pbRings + Params.SqOffsets.offTail);
+                pUring->pu32CqHead = (volatile uint32_t *)(pbRings + Params.CqOffsets.offHead);
+                pUring->pu32CqTail = (volatile uint32_t *)(pbRings + Params.CqOffsets.offTail);
+                pUring->paCqes     = (PLNXURINGCQE)(pbRings + Params.CqOffsets.offCqes);
+
+                /* The submission queue entries map one to one to the ring slots. */
+                uint32_t *pau32Array = (uint32_t *)(pbRings + Params.SqOffsets.offArray);
+                for (uint32_t i = 0; i < Params.cSqEntries; i++)
+                    pau32Array[i] = i;
+
+                /* Register an empty file table, the files are filled in when associated. */
+                for (unsigned i = 0; i < RT_ELEMENTS(pUring->aFds); i++)
+                    pUring->aFds[i] = -1;
+                pUring->cFds = 0;
+                pUring->fFilesRegistered = syscall(__NR_io_uring_register, iFdRing, LNXURING_REGISTER_FILES,
+                                                   &pUring->aFds[0], RT_ELEMENTS(pUring->aFds)) == 0;
+                return VINF_SUCCESS;
+            }
+
+            munmap(pUring->paSqes, pUring->cbSqes);
+        }
+        munmap(pUring->pvRings, pUring->cbRings);
+    }
+
+    close(iFdRing);
+    return VERR_NO_MEMORY;
+}
+
+/**
+ * Destroys the io_uring instance of a context.
+ *
+ * @returns nothing.
+ * @param   pUring      The io_uring state.
+ */
+static void rtFileAioLnxUringDestroy(PLNXURING pUring)
+{
+    munmap(pUring->paSqes, pUring->cbSqes);
+    munmap(pUring->pvRings, pUring->cbRings);
+    close(pUring->iFdRing);
+    RTCritSectDelete(&pUring->CritSectSq);
+}
+
+/**
+ * Registers the given file with the io_uring instance if there is room.
+ *
+ * @returns nothing, the file is used without registering it if this fails.
+ * @param   pUring      The io_uring state.
+ * @param   iFd         The file descriptor to register.
+ */
+static void rtFileAioLnxUringRegisterFile(PLNXURING pUring, int iFd)
+{
+    if (!pUring->fFilesRegistered)
+        return;
+
+    RTCritSectEnter(&pUring->CritSectSq);
+
+    /*
+     * Always update the slot, even if the descriptor is registered already.
+     * It might have been closed and reused for another file in the meantime.
+     */
+    uint32_t idxSlot = UINT32_MAX;
+    for (uint32_t i = 0; i < pUring->cFds; i++)
+    {
+        if (pUring->aFds[i] == iFd)
+        {
+            idxSlot = i;
+            break;
+        }
+        if (pUring->aFds[i] == -1 && idxSlot == UINT32_MAX)
+            idxSlot = i;
+    }
+    if (idxSlot == UINT32_MAX && pUring->cFds < RT_ELEMENTS(pUring->aFds))
+        idxSlot = pUring->cFds;
+
+    if (idxSlot != UINT32_MAX)
+    {
+        LNXURINGFILESUPDATE Update;
+        Update.offFirst    = idxSlot;
+        Update.u32Reserved = 0;
+        Update.u64Fds      = (uintptr_t)&iFd;
+        int rcLnx = syscall(__NR_io_uring_register, pUring->iFdRing, LNXURING_REGISTER_FILES_UPDATE, &Update, 1);
+        if (rcLnx == 1)
+        {
+            pUring->aFds[idxSlot] = iFd;
+            if (idxSlot == pUring->cFds)
+                pUring->cFds++;
+        }
+    }
+
+    RTCritSectLeave(&pUring->CritSectSq);
+}
+
+/**
+ * Removes the given file from the registered files of the io_uring instance.
+ *
+ * @returns nothing.
+ * @param   pUring      The io_uring state.
+ * @param   iFd         The file descriptor to unregister.
+ */
+static void rtFileAioLnxUringUnregisterFile(PLNXURING pUring, int iFd)
+{
+    if (!pUring->fFilesRegistered)
+        return;
+
+    RTCritSectEnter(&pUring->CritSectSq);
+
+    for (uint32_t i = 0; i < pUring->cFds; i++)
+        if (pUring->aFds[i] == iFd)
+        {
+            int iFdUnused = -1;
+            LNXURINGFILESUPDATE Update;
+            Update.offFirst    = i;
+            Update.u32Reserved = 0;
+            Update.u64Fds      = (uintptr_t)&iFdUnused;
+            int rcLnx = syscall(__NR_io_uring_register, pUring->iFdRing, LNXURING_REGISTER_FILES_UPDATE, &Update, 1);
+            AssertMsg(rcLnx == 1, ("Unregistering file %d failed with %d errno=%d\n", iFd, rcLnx, errno)); NOREF(rcLnx);
+
+            /* Don't use the slot even if the kernel kept the file, the descriptor may be reused. */
+            pUring->aFds[i] = -1;
+            while (pUring->cFds && pUring->aFds[pUring->cFds - 1] == -1)
+                pUring->cFds--;
+            break;
+        }
+
+    RTCritSectLeave(&pUring->CritSectSq);
+}
+
+/**
+ * Fills in a submission queue entry for the given request.
+ *
+ * @returns nothing.
+ * @param   pUring      The io_uring state, the caller owns the submission lock.
+ * @param   pSqe        The submission queue entry to fill in.
+ * @param   pReqInt     The request.
+ */
+static void rtFileAioLnxUringPrepSqe(PLNXURING pUring, PLNXURINGSQE pSqe, PRTFILEAIOREQINTERNAL pReqInt)
+{
+    RT_ZERO(*pSqe);
+    switch (pReqInt->AioCB.u16IoOpCode)
+    {
+        case LNXKAIO_IOCB_CMD_READ:
+            pSqe->u8Opcode = LNXURING_OP_READ;
+            break;
+        case LNXKAIO_IOCB_CMD_WRITE:
+            pSqe->u8Opcode = LNXURING_OP_WRITE;
+            break;
+        default:
+            AssertMsg(pReqInt->AioCB.u16IoOpCode == LNXKAIO_IOCB_CMD_FSYNC, ("Invalid opcode %u\n", pReqInt->AioCB.u16IoOpCode));
+            pSqe->u8Opcode = LNXURING_OP_FSYNC;
+            break;
+    }
+
+    pSqe->iFd = (int32_t)pReqInt->AioCB.uFileDesc;
+    for (uint32_t i = 0; i < pUring->cFds; i++)
+        if (pUring->aFds[i] == pSqe->iFd)
+        {
+            pSqe->iFd     = (int32_t)i;
+            pSqe->fFlags |= LNXURING_SQE_F_FIXED_FILE;
+            break;
+        }
+
+    pSqe->off        = pReqInt->AioCB.off;
+    pSqe->u64AddrBuf = (uintptr_t)pReqInt->AioCB.pvBuf;
+    pSqe->cbTransfer = (uint32_t)RT_MIN(pReqInt->AioCB.cbTransfer, LNXURING_TRANSFER_MAX);
+    pSqe->u64User    = (uintptr_t)pReqInt;
+}
+
+/**
+ * Submits an array of requests to the io_uring instance of the context.
+ *
+ * The requests are put into the submission queue and handed to the kernel with
+ * as few io_uring_enter calls as possible, usually a single one.
+ *
+ * @returns IPRT status code.
+ * @param   pCtxInt     The context.
+ * @param   pahReqs     The requests, already validated and marked as submitted.
+ * @param   cReqs       Number of requests.
+ * @param   pcSubmitted Where to store the number of requests the kernel accepted.
+ */
+static int rtFileAioLnxUringSubmit(PRTFILEAIOCTXINTERNAL pCtxInt, PRTFILEAIOREQ pahReqs, size_t cReqs, size_t *pcSubmitted)
+{
+    PLNXURING pUring = &pCtxInt->Uring;
+    int       rc     = VINF_SUCCESS;
+    size_t    cSubmitted = 0;
+
+    RTCritSectEnter(&pUring->CritSectSq);
+    while (cSubmitted < cReqs)
+    {
+        uint32_t const idxTail = *pUring->pu32SqTail;
+        uint32_t const cFree   = pUring->cSqEntries - (idxTail - ASMAtomicReadU32(pUring->pu32SqHead));
+        uint32_t const cBatch  = (uint32_t)RT_MIN(cReqs - cSubmitted, cFree);
+        if (!cBatch)
+        {
+            rc = VERR_TRY_AGAIN;
+            break;
+        }
+
+        for (uint32_t i = 0; i < cBatch; i++)
+            rtFileAioLnxUringPrepSqe(pUring, &pUring->paSqes[(idxTail + i) & pUring->fSqMask],
+                                     pahReqs[cSubmitted + i]);
+
+        /* Count the requests as active before the kernel can complete them. */
+        ASMAtomicAddS32(&pCtxInt->cRequests, cBatch);
+        ASMAtomicWriteU32(pUring->pu32SqTail, idxTail + cBatch);
+
+        int cConsumed;
+        do
+            cConsumed = syscall(__NR_io_uring_enter, pUring->iFdRing, cBatch, 0, 0, NULL, 0);
+        while (cConsumed == -1 && errno == EINTR);
+        if (cConsumed == -1)
+        {
+            rc = RTErrConvertFromErrno(errno);
+            cConsumed = 0;
+        }
+
+        cSubmitted += cConsumed;
+        if ((uint32_t)cConsumed < cBatch)
+        {
+            /* Take back what the kernel didn't consume, it will not look at the entries again. */
+            ASMAtomicWriteU32(pUring->pu32SqTail, idxTail + cConsumed);
+            ASMAtomicSubS32(&pCtxInt->cRequests, cBatch - cConsumed);
+            if (RT_SUCCESS(rc))
+                rc = VERR_TRY_AGAIN;
+            break;
+        }
+    }
+    RTCritSectLeave(&pUring->CritSectSq);
+
+    *pcSubmitted = cSubmitted;
+    return rc;
+}
+
+/**
+ * Collects completed requests from the completion queue of the io_uring.
+ *
+ * @returns Number of completed requests stored in the array.
+ * @param   pUring      The io_uring state.
+ * @param   pahReqs     Where to store the completed requests.
+ * @param   cReqs       Maximum number of requests to collect.
+ */
+static uint32_t rtFileAioLnxUringReap(PLNXURING pUring, PRTFILEAIOREQ pahReqs, size_t cReqs)
+{
+    uint32_t       idxHead = *pUring->pu32CqHead;
+    uint32_t const idxTail = ASMAtomicReadU32(pUring->pu32CqTail);
+    uint32_t       cDone   = 0;
+
+    while (   idxHead != idxTail
+           && cDone < cReqs)
+    {
+        PLNXURINGCQE pCqe = &pUring->paCqes[idxHead & pUring->fCqMask];
+        PRTFILEAIOREQINTERNAL pReqInt = (PRTFILEAIOREQINTERNAL)(uintptr_t)pCqe->u64User;
+        AssertPtr(pReqInt);
+        Assert(pReqInt->u32Magic == RTFILEAIOREQ_MAGIC);
+
+        if (RT_UNLIKELY(pCqe->rc < 0))
+            pReqInt->Rc = RTErrConvertFromErrno(-pCqe->rc);
+        else
+        {
+            pReqInt->Rc = VINF_SUCCESS;
+            pReqInt->cbTransfered = pCqe->rc;
+        }
+
+        /* Mark the request as finished. */
+        RTFILEAIOREQ_SET_STATE(pReqInt, COMPLETED);
+
+        pahReqs[cDone++] = (RTFILEAIOREQ)pReqInt;
+        idxHead++;
+    }
+
+    /* Hand the entries back to the kernel. */
+    ASMAtomicWriteU32(pUring->pu32CqHead, idxHead);
+    return cDone;
+}
+
+/**
+ * Waits for completed requests on the io_uring instance of the context.
+ *
+ * Requests already in the completion queue are collected without entering the
+ * kernel, the kernel is only asked to wait if there are not enough.
+ *
+ * @returns Number of completed requests (natural number w/ 0), IPRT error code (negative).
+ * @param   pCtxInt     The context.
+ * @param   cMinReqs    Minimum number of requests to wait for.
+ * @param   cReqs       Size of the request array.
+ * @param   pahReqs     Where to store the completed requests.
+ * @param   pTimeout    The timeout, NULL for waiting indefinitely.
+ */
+static int rtFileAioLnxUringGetEvents(PRTFILEAIOCTXINTERNAL pCtxInt, size_t cMinReqs, size_t cReqs,
+                                      PRTFILEAIOREQ pahReqs, struct timespec *pTimeout)
+{
+    PLNXURING pUring = &pCtxInt->Uring;
+
+    uint32_t cDone = rtFileAioLnxUringReap(pUring, pahReqs, cReqs);
+    if (cDone >= cMinReqs)
+        return cDone;
+
+    LNXURINGTIMESPEC     Ts;
+    LNXURINGGETEVENTSARG Arg;
+    RT_ZERO(Arg);
+    if (pTimeout)
+    {
+        Ts.i64Sec     = pTimeout->tv_sec;
+        Ts.i64NanoSec = pTimeout->tv_nsec;
+        Arg.u64Ts     = (uintptr_t)&Ts;
+    }
+
+    int rcLnx = syscall(__NR_io_uring_enter, pUring->iFdRing, 0, cMinReqs - cDone,
+                        LNXURING_ENTER_GETEVENTS | LNXURING_ENTER_EXT_ARG, &Arg, sizeof(Arg));
+    if (   rcLnx == -1
+        && errno != ETIME
+        && !cDone)
+        return RTErrConvertFromErrno(errno);
+
+    /* Don't lose requests collected before the wait failed, the error shows up on the next call. */
+    cDone += rtFileAioLnxUringReap(pUring, &pahReqs[cDone], cReqs - cDone);
+    return cDone;
+}
+
+/**
+ * Waits for completed requests on the legacy context.
+ *
+ * @returns Number of completed requests (natural number w/ 0), IPRT error code (negative).
+ * @param   pCtxInt     The context.
+ * @param   cMinReqs    Minimum number of requests to wait for.
+ * @param   cReqs       Size of the request array.
+ * @param   pahReqs     Where to store the completed requests.
+ * @param   pTimeout    The timeout, NULL for waiting indefinitely.
+ */
+static int rtFileAioLnxKaioGetEvents(PRTFILEAIOCTXINTERNAL pCtxInt, size_t cMinReqs, size_t cReqs,
+                                     PRTFILEAIOREQ pahReqs, struct timespec *pTimeout)
+{
+    LNXKAIOIOEVENT  aPortEvents[AIO_MAXIMUM_REQUESTS_PER_CONTEXT];
+    int             cRequestsToWait = RT_MIN(cReqs, AIO_MAXIMUM_REQUESTS_PER_CONTEXT);
+    int rc = rtFileAsyncIoLinuxGetEvents(pCtxInt->AioContext, RT_MIN(cMinReqs, (size_t)cRequestsToWait), cRequestsToWait,
+                                         &aPortEvents[0], pTimeout);
+    if (RT_FAILURE(rc))
+        return rc;
+    uint32_t const cDone = rc;
+
+    /*
+     * Process received events / requests.
+     */
+    for (uint32_t i = 0; i < cDone; i++)
+    {
+        /*
+         * The iocb is the first element in our request structure.
+         * So we can safely cast it directly to the handle (see above)
+         */
+        PRTFILEAIOREQINTERNAL pReqInt = (PRTFILEAIOREQINTERNAL)aPortEvents[i].pIoCB;
+        AssertPtr(pReqInt);
+        Assert(pReqInt->u32Magic == RTFILEAIOREQ_MAGIC);
+
+        /** @todo aeichner: The rc field contains the result code
+         *  like you can find in errno for the normal read/write ops.
+         *  But there is a second field called rc2. I don't know the
+         *  purpose for it yet.
+         */
+        if (RT_UNLIKELY(aPortEvents[i].rc < 0))
+            pReqInt->Rc = RTErrConvertFromErrno(-aPortEvents[i].rc); /* Convert to positive value. */
+        else
+        {
+            pReqInt->Rc = VINF_SUCCESS;
+            pReqInt->cbTransfered = aPortEvents[i].rc;
+        }
+
+        /* Mark the request as finished. */
+        RTFILEAIOREQ_SET_STATE(pReqInt, COMPLETED);
+
+        pahReqs[i] = (RTFILEAIOREQ)pReqInt;
+    }
+
+    return cDone;
+}
+
 RTR3DECL(int) RTFileAioGetLimits(PRTFILEAIOLIMITS pAioLimits)
 {
     int rc = VINF_SUCCESS;
@@ -436,6 +1108,13 @@ RTDECL(int) RTFileAioReqCancel(RTFILEAIOREQ hReq)
     RTFILEAIOREQ_VALID_RETURN(pReqInt);
     RTFILEAIOREQ_STATE_RETURN_RC(pReqInt, SUBMITTED, VERR_FILE_AIO_NOT_SUBMITTED);
 
+    /*
+     * Canceling with io_uring is asynchronous and the request completes anyway,
+     * file I/O can't be canceled with the legacy interface in practice either.
+     */
+    if (pReqInt->pCtxInt->fIoUring)
+        return VERR_FILE_AIO_IN_PROGRESS;
+
     LNXKAIOIOEVENT AioEvent;
     int rc = rtFileAsyncIoLinuxCancel(pReqInt->AioContext, &pReqInt->AioCB, &AioEvent);
     if (RT_SUCCESS(rc))
@@ -489,8 +1168,13 @@ RTDECL(int) RTFileAioCtxCreate(PRTFILEAIOCTX phAioCtx, uint32_t cAioReqsMax,
     if (RT_UNLIKELY(!pCtxInt))
         return VERR_NO_MEMORY;
 
-    /* Init the event handle. */
-    int rc = rtFileAsyncIoLinuxCreate(cAioReqsMax, &pCtxInt->AioContext);
+    /* Prefer io_uring, falling back to the legacy interface on older kernels. */
+    int rc = VERR_NOT_SUPPORTED;
+    if (!RTEnvExist("IPRT_FILEAIO_NO_IO_URING"))
+        rc = rtFileAioLnxUringCreate(&pCtxInt->Uring, cAioReqsMax);
+    pCtxInt->fIoUring = RT_SUCCESS(rc);
+    if (!pCtxInt->fIoUring)
+        rc = rtFileAsyncIoLinuxCreate(cAioReqsMax, &pCtxInt->AioContext);
     if (RT_SUCCESS(rc))
     {
         pCtxInt->fWokenUp     = false;
@@ -521,9 +1205,14 @@ RTDECL(int) RTFileAioCtxDestroy(RTFILEAIOCTX hAioCtx)
         return VERR_FILE_AIO_BUSY;
 
     /* The native bit first, then mark it as dead and free it. */
-    int rc = rtFileAsyncIoLinuxDestroy(pCtxInt->AioContext);
-    if (RT_FAILURE(rc))
-        return rc;
+    if (pCtxInt->fIoUring)
+        rtFileAioLnxUringDestroy(&pCtxInt->Uring);
+    else
+    {
+        int rc = rtFileAsyncIoLinuxDestroy(pCtxInt->AioContext);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
     ASMAtomicUoWriteU32(&pCtxInt->u32Magic, RTFILEAIOCTX_MAGIC_DEAD);
     RTMemFree(pCtxInt);
 
@@ -547,8 +1236,22 @@ RTDECL(uint32_t) RTFileAioCtxGetMaxReqCount(RTFILEAIOCTX hAioCtx)
 
 RTDECL(int) RTFileAioCtxAssociateWithFile(RTFILEAIOCTX hAioCtx, RTFILE hFile)
 {
-    /* Nothing to do. */
-    NOREF(hAioCtx); NOREF(hFile);
+    PRTFILEAIOCTXINTERNAL pCtxInt = hAioCtx;
+    RTFILEAIOCTX_VALID_RETURN(pCtxInt);
+
+    /* Nothing to do for the legacy interface, io_uring can save the file lookup. */
+    if (pCtxInt->fIoUring)
+        rtFileAioLnxUringRegisterFile(&pCtxInt->Uring, (int)RTFileToNative(hFile));
+    return VINF_SUCCESS;
+}
+
+RTDECL(int) RTFileAioCtxDisassociateFromFile(RTFILEAIOCTX hAioCtx, RTFILE hFile)
+{
+    PRTFILEAIOCTXINTERNAL pCtxInt = hAioCtx;
+    RTFILEAIOCTX_VALID_RETURN(pCtxInt);
+
+    if (pCtxInt->fIoUring)
+        rtFileAioLnxUringUnregisterFile(&pCtxInt->Uring, (int)RTFileToNative(hFile));
     return VINF_SUCCESS;
 }
 
@@ -590,6 +1293,39 @@ RTDECL(int) RTFileAioCtxSubmit(RTFILEAIOCTX hAioCtx, PRTFILEAIOREQ pahReqs, size
         RTFILEAIOREQ_SET_STATE(pReqInt, SUBMITTED);
     }
 
+    if (pCtxInt->fIoUring)
+    {
+        size_t cReqsSubmitted = 0;
+        rc = rtFileAioLnxUringSubmit(pCtxInt, pahReqs, cReqs, &cReqsSubmitted);
+        if (RT_FAILURE(rc))
+        {
+            /*
+             * Revert the requests the kernel didn't take into the prepared state.
+             * Unlike the legacy interface invalid requests don't fail the submission,
+             * they complete with an error, so this is a lack of resources mostly.
+             */
+            cReqs   -= cReqsSubmitted;
+            pahReqs += cReqsSubmitted;
+            i = cReqs;
+            while (i-- > 0)
+            {
+                pReqInt = pahReqs[i];
+                pReqInt->pCtxInt = NULL;
+                RTFILEAIOREQ_SET_STATE(pReqInt, PREPARED);
+            }
+
+            if (   rc == VERR_TRY_AGAIN
+                || rc == VERR_RESOURCE_BUSY)
+                return VERR_FILE_AIO_INSUFFICIENT_RESSOURCES;
+
+            pReqInt = pahReqs[0];
+            RTFILEAIOREQ_SET_STATE(pReqInt, COMPLETED);
+            pReqInt->Rc = rc;
+            pReqInt->cbTransfered = 0;
+        }
+        return rc;
+    }
+
     do
     {
         /*
@@ -697,47 +1433,17 @@ RTDECL(int) RTFileAioCtxWait(RTFILEAIOCTX hAioCtx, size_t cMinReqs, RTMSINTERVAL
     int cRequestsCompleted = 0;
     while (!pCtxInt->fWokenUp)
     {
-        LNXKAIOIOEVENT  aPortEvents[AIO_MAXIMUM_REQUESTS_PER_CONTEXT];
-        int             cRequestsToWait = RT_MIN(cReqs, AIO_MAXIMUM_REQUESTS_PER_CONTEXT);
         ASMAtomicXchgBool(&pCtxInt->fWaiting, true);
-        rc = rtFileAsyncIoLinuxGetEvents(pCtxInt->AioContext, cMinReqs, cRequestsToWait, &aPortEvents[0], pTimeout);
+        if (pCtxInt->fIoUring)
+            rc = rtFileAioLnxUringGetEvents(pCtxInt, cMinReqs, cReqs, &pahReqs[cRequestsCompleted], pTimeout);
+        else
+            rc = rtFileAioLnxKaioGetEvents(pCtxInt, cMinReqs, cReqs, &pahReqs[cRequestsCompleted], pTimeout);
         ASMAtomicXchgBool(&pCtxInt->fWaiting, false);
         if (RT_FAILURE(rc))
             break;
         uint32_t const cDone = rc;
         rc = VINF_SUCCESS;
-
-        /*
-         * Process received events / requests.
-         */
-        for (uint32_t i = 0; i < cDone; i++)
-        {
-            /*
-             * The iocb is the first element in our request structure.
-             * So we can safely cast it directly to the handle (see above)
-             */
-            PRTFILEAIOREQINTERNAL pReqInt = (PRTFILEAIOREQINTERNAL)aPortEvents[i].pIoCB;
-            AssertPtr(pReqInt);
-            Assert(pReqInt->u32Magic == RTFILEAIOREQ_MAGIC);
-
-            /** @todo aeichner: The rc field contains the result code
-             *  like you can find in errno for the normal read/write ops.
-             *  But there is a second field called rc2. I don't know the
-             *  purpose for it yet.
-             */
-            if (RT_UNLIKELY(aPortEvents[i].rc < 0))
-                pReqInt->Rc = RTErrConvertFromErrno(-aPortEvents[i].rc); /* Convert to positive value. */
-            else
-            {
-                pReqInt->Rc = VINF_SUCCESS;
-                pReqInt->cbTransfered = aPortEvents[i].rc;
-            }
-
-            /* Mark the request as finished. */
-            RTFILEAIOREQ_SET_STATE(pReqInt, COMPLETED);
-
-            pahReqs[cRequestsCompleted++] = (RTFILEAIOREQ)pReqInt;
-        }
+        cRequestsCompleted += cDone;
 
         /*
          * Done Yet? If not advance and try again.
@@ -814,7 +1520,7 @@ RTDECL(int) RTFileAioCtxWakeup(RTFILEAIOCTX hAioCtx)
         /*
          * If a thread waits the handle must be valid.
          * It is possible that the thread returns from
-         * rtFileAsyncIoLinuxGetEvents() before the signal
+         * the get events syscall before the signal
          * is send.
          * This is no problem because we already set fWokenUp
          * to true which will let the thread return VERR_INTERRUPTED
@@ -0,0 +1,174 @@
+/* $Id$ */
+/** @file
+ * IPRT Testcase - CRC32 and CRC32C correctness and throughput.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/crc.h>
+
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The test handle. */
+static RTTEST g_hTest;
+/** Random test data. */
+static uint8_t *g_pbData;
+/** Size of the test data. */
+static size_t const g_cbData = _1M;
+
+
+/**
+ * Bit at a time reference implementation of a reflected CRC32.
+ */
+static uint32_t tstCrc32Ref(uint32_t uPoly, const uint8_t *pb, size_t cb)
+{
+    uint32_t uCrc = ~0U;
+    while (cb--)
+    {
+        uCrc ^= *pb++;
+        for (unsigned iBit = 0; iBit < 8; iBit++)
+            uCrc = (uCrc >> 1) ^ (uCrc & 1 ? uPoly : 0);
+    }
+    return ~uCrc;
+}
+
+
+/**
+ * Checks known values and compares the result for all kinds of sizes and
+ * alignments against the reference implementation, this catches bugs in the
+ * head and tail handling of the optimized code paths.
+ */
+static void tstCorrectness(void)
+{
+    RTTestSub(g_hTest, "Correctness");
+
+    RTTESTI_CHECK(RTCrc32("123456789", 9) == UINT32_C(0xcbf43926));
+    RTTESTI_CHECK(RTCrc32C("123456789", 9) == UINT32_C(0xe3069283));
+    RTTESTI_CHECK(RTCrc32(NULL, 0) == 0);
+    RTTESTI_CHECK(RTCrc32C(NULL, 0) == 0);
+
+    for (size_t off = 0; off < 16; off++)
+        for (size_t cb = 0; cb < 1100; cb += off + 1)
+        {
+            uint32_t uCrc = RTCrc32(&g_pbData[off], cb);
+            uint32_t uRef = tstCrc32Ref(UINT32_C(0xedb88320), &g_pbData[off], cb);
+            if (uCrc != uRef)
+                RTTestIFailed("RTCrc32 off=%zu cb=%zu: %#RX32, expected %#RX32", off, cb, uCrc, uRef);
+
+            uCrc = RTCrc32C(&g_pbData[off], cb);
+            uRef = tstCrc32Ref(UINT32_C(0x82f63b78), &g_pbData[off], cb);
+            if (uCrc != uRef)
+                RTTestIFailed("RTCrc32C off=%zu cb=%zu: %#RX32, expected %#RX32", off, cb, uCrc, uRef);
+        }
+
+    /* Processing in random chunks must give the same result as doing it in one go. */
+    for (unsigned iRound = 0; iRound < 64; iRound++)
+    {
+        size_t   cbLeft  = RTRandU32Ex(0, _64K);
+        uint8_t *pb      = g_pbData;
+        uint32_t uCrc32  = RTCrc32Start();
+        uint32_t uCrc32C = RTCrc32CStart();
+        while (cbLeft)
+        {
+            size_t cbChunk = RT_MIN(cbLeft, RTRandU32Ex(1, 4096));
+            uCrc32  = RTCrc32Process(uCrc32, pb, cbChunk);
+            uCrc32C = RTCrc32CProcess(uCrc32C, pb, cbChunk);
+            pb     += cbChunk;
+            cbLeft -= cbChunk;
+        }
+        RTTESTI_CHECK(RTCrc32Finish(uCrc32) == RTCrc32(g_pbData, pb - g_pbData));
+        RTTESTI_CHECK(RTCrc32CFinish(uCrc32C) == RTCrc32C(g_pbData, pb - g_pbData));
+    }
+}
+
+
+/**
+ * Measures the throughput for a few typical buffer sizes.
+ */
+static void tstBenchmark(void)
+{
+    static size_t const s_acbBuf[] = { 64, 512, _4K, _64K, _1M };
+
+    RTTestSub(g_hTest, "Benchmark");
+
+    for (unsigned i = 0; i < RT_ELEMENTS(s_acbBuf); i++)
+    {
+        size_t const   cbBuf   = s_acbBuf[i];
+        unsigned const cRounds = (unsigned)RT_MAX(_1G / 8 / cbBuf, 16);
+        uint32_t volatile uCrc = 0;
+        uint64_t cNsElapsed;
+
+        RTThreadYield();
+        cNsElapsed = RTTimeNanoTS();
+        for (unsigned iRound = 0; iRound < cRounds; iRound++)
+            uCrc = RTCrc32(g_pbData, cbBuf);
+        cNsElapsed = RTTimeNanoTS() - cNsElapsed;
+        RTTestValueF(g_hTest, (uint64_t)cbBuf * cRounds * RT_NS_1SEC / _1M / RT_MAX(cNsElapsed, 1),
+                     RTTESTUNIT_MEGABYTES_PER_SEC, "RTCrc32 %zu bytes", cbBuf);
+
+        RTThreadYield();
+        cNsElapsed = RTTimeNanoTS();
+        for (unsigned iRound = 0; iRound < cRounds; iRound++)
+            uCrc = RTCrc32C(g_pbData, cbBuf);
+        cNsElapsed = RTTimeNanoTS() - cNsElapsed;
+        RTTestValueF(g_hTest, (uint64_t)cbBuf * cRounds * RT_NS_1SEC / _1M / RT_MAX(cNsElapsed, 1),
+                     RTTESTUNIT_MEGABYTES_PER_SEC, "RTCrc32C %zu bytes", cbBuf);
+        NOREF(uCrc);
+    }
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstRTCrc32", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    g_pbData = (uint8_t *)RTMemAlloc(g_cbData);
+    if (g_pbData)
+    {
+        RTRandBytes(g_pbData, g_cbData);
+
+        tstCorrectness();
+        tstBenchmark();
+
+        RTMemFree(g_pbData);
+    }
+    else
+        RTTestFailed(g_hTest, "Out of memory");
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
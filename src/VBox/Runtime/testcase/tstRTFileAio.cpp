@@ -30,11 +30,14 @@
 *******************************************************************************/
 #include <iprt/file.h>
 
+#include <iprt/env.h>
 #include <iprt/err.h>
+#include <iprt/getopt.h>
 #include <iprt/mem.h>
 #include <iprt/param.h>
 #include <iprt/string.h>
 #include <iprt/test.h>
+#include <iprt/time.h>
 
 
 /*******************************************************************************
@@ -43,6 +46,8 @@
 /** @todo make configurable through cmd line. */
 #define TSTFILEAIO_MAX_REQS_IN_FLIGHT   64
 #define TSTFILEAIO_BUFFER_SIZE          (64*_1K)
+/** Number of single requests to time in the latency test. */
+#define TSTFILEAIO_LATENCY_REQS         4096
 
 
 /*******************************************************************************
@@ -169,12 +174,144 @@ void tstFileAioTestReadWriteBasic(RTFILE File, bool fWrite, void *pvTestBuf,
     RTTestGuardedFree(g_hTest, paReqs);
 }
 
-int main()
+void tstFileAioTestLatency(RTFILE File, void *pvTestBuf, size_t cbTestBuf, size_t cbTestFile, uint32_t cReqs)
+{
+    void *pvBuf;
+    RTTESTI_CHECK_RC_OK_RETV(RTTestGuardedAlloc(g_hTest, cbTestBuf, PAGE_SIZE, true /*fHead*/, &pvBuf));
+
+    RTFILEAIOCTX hAioContext = NIL_RTFILEAIOCTX;
+    RTFILEAIOREQ hReq        = NIL_RTFILEAIOREQ;
+    int rc;
+    RTTESTI_CHECK_RC(rc = RTFileAioCtxCreate(&hAioContext, 1, 0 /* fFlags */), VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+        RTTESTI_CHECK_RC(rc = RTFileAioCtxAssociateWithFile(hAioContext, File), VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+        RTTESTI_CHECK_RC(rc = RTFileAioReqCreate(&hReq), VINF_SUCCESS);
+
+    /*
+     * Time a single request in flight from submitting it until the completion
+     * was collected, going through the file in buffer sized steps.
+     */
+    RTFOFF   off    = 0;
+    uint32_t cDone  = 0;
+    uint64_t NanoTS = RTTimeNanoTS();
+    while (RT_SUCCESS(rc) && cDone < cReqs)
+    {
+        rc = RTFileAioReqPrepareRead(hReq, File, off, pvBuf, cbTestBuf, NULL);
+        RTTESTI_CHECK_RC_BREAK(rc, VINF_SUCCESS);
+        RTTESTI_CHECK_RC_BREAK(rc = RTFileAioCtxSubmit(hAioContext, &hReq, 1), VINF_SUCCESS);
+
+        RTFILEAIOREQ hReqCompleted;
+        uint32_t     cCompleted = 0;
+        RTTESTI_CHECK_RC_BREAK(rc = RTFileAioCtxWait(hAioContext, 1, RT_INDEFINITE_WAIT,
+                                                     &hReqCompleted, 1, &cCompleted),
+                               VINF_SUCCESS);
+        RTTESTI_CHECK_BREAK(cCompleted == 1 && hReqCompleted == hReq);
+
+        size_t cbTransfered;
+        RTTESTI_CHECK_RC_BREAK(RTFileAioReqGetRC(hReq, &cbTransfered), VINF_SUCCESS);
+        RTTESTI_CHECK_BREAK(cbTransfered == cbTestBuf);
+
+        off += cbTestBuf;
+        if ((size_t)off + cbTestBuf > cbTestFile)
+            off = 0;
+        cDone++;
+    }
+    NanoTS = RTTimeNanoTS() - NanoTS;
+
+    if (cDone)
+    {
+        RTTESTI_CHECK(memcmp(pvBuf, pvTestBuf, cbTestBuf) == 0);
+        RTTestValue(g_hTest, "Latency", NanoTS / cDone, RTTESTUNIT_NS_PER_CALL);
+    }
+
+    /* cleanup */
+    if (hReq != NIL_RTFILEAIOREQ)
+        RTTESTI_CHECK_RC(RTFileAioReqDestroy(hReq), VINF_SUCCESS);
+    if (hAioContext != NIL_RTFILEAIOCTX)
+        RTTESTI_CHECK_RC(RTFileAioCtxDestroy(hAioContext), VINF_SUCCESS);
+    RTTestGuardedFree(g_hTest, pvBuf);
+}
+
+/**
+ * Compares the throughput and latency of the available host interfaces by
+ * reading the prepared test file with each of them.
+ */
+void tstFileAioCompare(const char *pszFile, void *pvTestBuf, size_t cbTestBuf, size_t cbTestFile, uint32_t cReqsMax)
+{
+    static const struct
+    {
+        const char *pszName;
+        const char *pszEnvVar;
+    } s_aBackends[] =
+    {
+#ifdef RT_OS_LINUX
+        { "io_uring", NULL },
+        { "legacy",   "IPRT_FILEAIO_NO_IO_URING" },
+#else
+        { "native",   NULL },
+#endif
+    };
+
+    for (unsigned i = 0; i < RT_ELEMENTS(s_aBackends); i++)
+    {
+        if (s_aBackends[i].pszEnvVar)
+            RTEnvSet(s_aBackends[i].pszEnvVar, "1");
+
+        RTTestSubF(g_hTest, "Compare %s", s_aBackends[i].pszName);
+        RTFILE hFile;
+        int rc;
+        RTTESTI_CHECK_RC(rc = RTFileOpen(&hFile, pszFile,
+                                         RTFILE_O_READWRITE | RTFILE_O_OPEN | RTFILE_O_DENY_NONE | RTFILE_O_ASYNC_IO),
+                         VINF_SUCCESS);
+        if (RT_SUCCESS(rc))
+        {
+            tstFileAioTestReadWriteBasic(hFile, false /*fWrite*/, pvTestBuf, cbTestBuf, cbTestFile, cReqsMax);
+            tstFileAioTestLatency(hFile, pvTestBuf, cbTestBuf, cbTestFile, TSTFILEAIO_LATENCY_REQS);
+            RTFileClose(hFile);
+        }
+
+        if (s_aBackends[i].pszEnvVar)
+            RTEnvUnset(s_aBackends[i].pszEnvVar);
+    }
+}
+
+int main(int argc, char **argv)
 {
     int rc = RTTestInitAndCreate("tstRTFileAio", &g_hTest);
     if (rc)
         return rc;
 
+    /* parse args. */
+    static const RTGETOPTDEF s_aOptions[] =
+    {
+        { "--compare",      'c', RTGETOPT_REQ_NOTHING },
+        { "--help",         'h', RTGETOPT_REQ_NOTHING }
+    };
+
+    bool fCompare = false;
+
+    int ch;
+    RTGETOPTUNION ValueUnion;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0);
+    while ((ch = RTGetOpt(&GetState, &ValueUnion)))
+    {
+        switch (ch)
+        {
+            case 'c':
+                fCompare = true;
+                break;
+
+            case 'h':
+                RTTestIPrintf(RTTESTLVL_ALWAYS, "%s [--help|-h] [--compare|-c]\n", argv[0]);
+                return 1;
+
+            default:
+                return RTGetOptPrintError(ch, &ValueUnion);
+        }
+    }
+
     /* Check if the API is available. */
     RTTestSub(g_hTest, "RTFileAioGetLimits");
     RTFILEAIOLIMITS AioLimits;
@@ -216,6 +353,11 @@ int main()
                 }
             }
 
+            /* Throughput and latency of the different host interfaces. */
+            if (   fCompare
+                && RTTestErrorCount(g_hTest) == 0)
+                tstFileAioCompare("tstFileAio#1.tst", pbTestBuf, TSTFILEAIO_BUFFER_SIZE, 100*_1M, cReqsMax);
+
             /* Cleanup */
             RTFileDelete("tstFileAio#1.tst");
         }
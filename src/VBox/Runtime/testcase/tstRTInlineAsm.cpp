@@ -1239,6 +1239,37 @@ void tstASMMemIsZeroPage(RTTEST hTest)
 }
 
 
+void tstASMMemFirstNonZero(RTTEST hTest)
+{
+    RTTestSub(hTest, "ASMMemFirstNonZero");
+
+    /* Use the tail guarded page so reading past the end would blow up. */
+    uint8_t *pbPage = (uint8_t *)RTTestGuardedAllocTail(hTest, PAGE_SIZE);
+    RTTESTI_CHECK_RETV(pbPage);
+    memset(pbPage, 0, PAGE_SIZE);
+
+    for (unsigned offStart = 0; offStart < 48; offStart++)
+    {
+        uint8_t *pbStart = pbPage + offStart;
+        size_t   cbBuf   = PAGE_SIZE - offStart;
+        RTTESTI_CHECK(ASMMemFirstNonZero(pbStart, cbBuf) == NULL);
+        RTTESTI_CHECK(ASMMemIsZero(pbStart, cbBuf));
+        RTTESTI_CHECK(ASMMemIsZero(pbStart, 0));
+
+        for (size_t off = 0; off < cbBuf; off += off < 256 ? 1 : 61)
+        {
+            pbStart[off] = 0x80;
+            RTTESTI_CHECK(ASMMemFirstNonZero(pbStart, cbBuf) == &pbStart[off]);
+            RTTESTI_CHECK(!ASMMemIsZero(pbStart, cbBuf));
+            RTTESTI_CHECK(ASMMemIsZero(pbStart, off));
+            pbStart[off] = 0;
+        }
+    }
+
+    RTTestSubDone(hTest);
+}
+
+
 void tstASMMemZero32(void)
 {
     RTTestSub(g_hTest, "ASMMemFill32");
@@ -1620,6 +1651,7 @@ int main(int argc, char *argv[])
 
     tstASMMemZeroPage();
     tstASMMemIsZeroPage(g_hTest);
+    tstASMMemFirstNonZero(g_hTest);
     tstASMMemZero32();
     tstASMMemFill32();
 
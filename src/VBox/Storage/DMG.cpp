@@ -29,8 +29,12 @@
 #include <iprt/assert.h>
 #include <iprt/base64.h>
 #include <iprt/ctype.h>
+#include <iprt/list.h>
 #include <iprt/mem.h>
+#include <iprt/mp.h>
+#include <iprt/semaphore.h>
 #include <iprt/string.h>
+#include <iprt/thread.h>
 #include <iprt/zip.h>
 #include <iprt/formats/xar.h>
 
@@ -55,6 +59,17 @@
 /** Convert byte offset/size to block number/size. */
 #define DMG_BYTE2BLOCK(u)          ((u) >> 9)
 
+/** Default size of the decompressed extent cache in bytes. */
+#define DMG_DECOMP_CACHE_SIZE_DEFAULT   (8 * _1M)
+/** Upper limit for the decompressed extent cache size. */
+#define DMG_DECOMP_CACHE_SIZE_MAX       (512 * _1M)
+/** Default number of compressed extents to inflate ahead of sequential reads. */
+#define DMG_DECOMP_READ_AHEAD_DEFAULT   4
+/** Upper limit for the read-ahead. */
+#define DMG_DECOMP_READ_AHEAD_MAX       32
+/** Max number of read-ahead worker threads. */
+#define DMG_DECOMP_WORKERS_MAX          4
+
 /**
  * UDIF checksum structure.
  */
@@ -286,6 +301,9 @@ typedef enum DMGEXTENTTYPE
     DMGEXTENTTYPE_32BIT_HACK = 0x7fffffff
 } DMGEXTENTTYPE, *PDMGEXTENTTYPE;
 
+/** Pointer to a decompressed extent cache entry. */
+typedef struct DMGDECOMPENTRY *PDMGDECOMPENTRY;
+
 /**
  * DMG extent mapping a virtual image block to real file offsets.
  */
@@ -301,10 +319,52 @@ typedef struct DMGEXTENT
     uint64_t             offFileStart;
     /** Number of bytes for the extent data in the file. */
     uint64_t             cbFile;
+    /** The decompressed data of a compressed extent if cached, NULL otherwise.
+     * Protected by DMGIMAGE::hDecompMtx. */
+    PDMGDECOMPENTRY      pDecomp;
 } DMGEXTENT;
 /** Pointer to an DMG extent. */
 typedef DMGEXTENT *PDMGEXTENT;
 
+/**
+ * State of a decompressed extent cache entry.
+ */
+typedef enum DMGDECOMPSTATE
+{
+    /** Queued for a read-ahead worker, the data is not there yet. */
+    DMGDECOMPSTATE_QUEUED = 0,
+    /** Being inflated by a worker or by the reading thread. */
+    DMGDECOMPSTATE_INFLATING,
+    /** The data is valid. */
+    DMGDECOMPSTATE_VALID,
+    /** Inflating failed, see rcInflate. */
+    DMGDECOMPSTATE_FAILED
+} DMGDECOMPSTATE;
+
+/**
+ * Decompressed extent cache entry.
+ */
+typedef struct DMGDECOMPENTRY
+{
+    /** Node in the LRU list, most recently used first. */
+    RTLISTNODE           NodeLru;
+    /** Node in the read-ahead queue while DMGDECOMPSTATE_QUEUED. */
+    RTLISTNODE           NodeQueue;
+    /** The extent the data belongs to. */
+    PDMGEXTENT           pExtent;
+    /** The state of the entry. */
+    DMGDECOMPSTATE       enmState;
+    /** Status code of the inflate operation when DMGDECOMPSTATE_FAILED. */
+    int                  rcInflate;
+    /** The compressed data read for a read-ahead worker, freed once inflated.
+     * NULL if the data is read from the image while inflating. */
+    uint8_t             *pbCompressed;
+    /** Size of the decompressed data. */
+    size_t               cbData;
+    /** The decompressed data. */
+    uint8_t              abData[1];
+} DMGDECOMPENTRY;
+
 /**
  * VirtualBox Apple Disk Image (DMG) interpreter instance data.
  */
@@ -362,12 +422,43 @@ typedef struct DMGIMAGE
     /** Index of the last accessed extent. */
     unsigned            idxExtentLast;
 
-    /** Extent which owns the data in the buffer. */
-    PDMGEXTENT          pExtentDecomp;
-    /** Buffer holding the decompressed data for a extent. */
-    void               *pvDecompExtent;
-    /** Size of the buffer. */
-    size_t              cbDecompExtent;
+    /** @name Decompressed extent cache.
+     * Everything below except the statistics is protected by hDecompMtx. The
+     * reading thread is the only one creating and freeing entries and the only
+     * one accessing the image, the workers only inflate the compressed data it
+     * read for the queued entries.
+     * @{ */
+    /** Mutex protecting the cache. */
+    RTSEMFASTMUTEX      hDecompMtx;
+    /** LRU list of cache entries. */
+    RTLISTANCHOR        ListDecompLru;
+    /** Entries waiting for a read-ahead worker. */
+    RTLISTANCHOR        ListDecompQueue;
+    /** Number of bytes of decompressed data in the cache. */
+    size_t              cbDecompCache;
+    /** Max number of bytes to keep in the cache. */
+    size_t              cbDecompCacheMax;
+    /** Number of compressed extents to inflate ahead of sequential reads. */
+    uint32_t            cDecompReadAhead;
+    /** Index of the compressed extent read last, UINT32_MAX if none. */
+    uint32_t            idxExtentDecompLast;
+    /** Signalled when an entry was queued or on shutdown. */
+    RTSEMEVENT          hEvtDecompWork;
+    /** Signalled when a worker is done with an entry. */
+    RTSEMEVENTMULTI     hEvtDecompDone;
+    /** Set when the workers should terminate. */
+    bool volatile       fDecompShutdown;
+    /** Number of worker threads. */
+    unsigned            cDecompWorkers;
+    /** The worker threads. */
+    RTTHREAD            ahDecompWorkers[DMG_DECOMP_WORKERS_MAX];
+    /** Reads served from the cache. */
+    uint64_t            cDecompHits;
+    /** Reads which had to inflate the extent. */
+    uint64_t            cDecompMisses;
+    /** Extents queued for read-ahead. */
+    uint64_t            cDecompReadAheads;
+    /** @} */
 } DMGIMAGE;
 /** Pointer to an instance of the DMG Image Interpreter. */
 typedef DMGIMAGE *PDMGIMAGE;
@@ -387,6 +478,8 @@ typedef struct DMGINFLATESTATE
     size_t    cbSize;
     /* Offset in the file to read. */
     uint64_t  uFileOffset;
+    /* The compressed data if already in memory, NULL to read it from the file. */
+    const uint8_t *pbSrc;
     /* Current read position. */
     ssize_t   iOffset;
 } DMGINFLATESTATE;
@@ -424,6 +517,19 @@ static const VDFILEEXTENSION s_aDmgFileExtensions[] =
     {NULL, VDTYPE_INVALID}
 };
 
+/** Default decompressed extent cache size in bytes, keep in sync with DMG_DECOMP_CACHE_SIZE_DEFAULT. */
+static const char *s_pszDmgConfigDefaultDecompCacheSize = "8388608";
+/** Default read-ahead, keep in sync with DMG_DECOMP_READ_AHEAD_DEFAULT. */
+static const char *s_pszDmgConfigDefaultDecompReadAhead = "4";
+
+/** Description of all accepted config parameters. */
+static const VDCONFIGINFO s_aDmgConfigInfo[] =
+{
+    { "DecompCacheSize",      s_pszDmgConfigDefaultDecompCacheSize,      VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "DecompReadAhead",      s_pszDmgConfigDefaultDecompReadAhead,      VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
+};
+
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
@@ -518,9 +624,14 @@ static DECLCALLBACK(int) dmgFileInflateHelper(void *pvUser, void *pvBuf, size_t
         return VINF_SUCCESS;
     }
     cbBuf = RT_MIN(cbBuf, pInflateState->cbSize);
-    int rc = dmgWrapFileReadSync(pInflateState->pImage, pInflateState->uFileOffset, pvBuf, cbBuf);
-    if (RT_FAILURE(rc))
-        return rc;
+    if (pInflateState->pbSrc)
+        memcpy(pvBuf, &pInflateState->pbSrc[pInflateState->iOffset], cbBuf);
+    else
+    {
+        int rc = dmgWrapFileReadSync(pInflateState->pImage, pInflateState->uFileOffset, pvBuf, cbBuf);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
     pInflateState->uFileOffset += cbBuf;
     pInflateState->iOffset += cbBuf;
     pInflateState->cbSize -= cbBuf;
@@ -532,8 +643,10 @@ static DECLCALLBACK(int) dmgFileInflateHelper(void *pvUser, void *pvBuf, size_t
 /**
  * Internal: read from a file and inflate the compressed data,
  * distinguishing between async and normal operation
+ *
+ * @a pbSrc is the compressed data if it was read already, NULL to read it.
  */
-DECLINLINE(int) dmgFileInflateSync(PDMGIMAGE pImage, uint64_t uOffset, size_t cbToRead,
+DECLINLINE(int) dmgFileInflateSync(PDMGIMAGE pImage, uint64_t uOffset, const uint8_t *pbSrc, size_t cbToRead,
                                    void *pvBuf, size_t cbBuf)
 {
     int rc;
@@ -544,6 +657,7 @@ DECLINLINE(int) dmgFileInflateSync(PDMGIMAGE pImage, uint64_t uOffset, size_t cb
     InflateState.pImage      = pImage;
     InflateState.cbSize      = cbToRead;
     InflateState.uFileOffset = uOffset;
+    InflateState.pbSrc       = pbSrc;
     InflateState.iOffset     = -1;
 
     rc = RTZipDecompCreate(&pZip, &InflateState, dmgFileInflateHelper);
@@ -558,6 +672,402 @@ DECLINLINE(int) dmgFileInflateSync(PDMGIMAGE pImage, uint64_t uOffset, size_t cb
     return rc;
 }
 
+/**
+ * Inflates the extent a decompressed extent cache entry belongs to.
+ *
+ * This only reads from the image if the compressed data hasn't been read
+ * already, which is never the case on the read-ahead workers.
+ *
+ * @returns VBox status code.
+ * @param   pThis     The DMG instance data.
+ * @param   pEntry    The cache entry, not accessed by anyone else meanwhile.
+ */
+static int dmgDecompEntryInflate(PDMGIMAGE pThis, PDMGDECOMPENTRY pEntry)
+{
+    int rc = dmgFileInflateSync(pThis, pEntry->pExtent->offFileStart, pEntry->pbCompressed,
+                                pEntry->pExtent->cbFile, pEntry->abData, pEntry->cbData);
+    RTMemFree(pEntry->pbCompressed);
+    pEntry->pbCompressed = NULL;
+    return rc;
+}
+
+/**
+ * Frees a decompressed extent cache entry which no worker is inflating.
+ *
+ * @param   pThis     The DMG instance data.
+ * @param   pEntry    The cache entry to free.
+ *
+ * @note Caller must own hDecompMtx.
+ */
+static void dmgDecompCacheEntryFree(PDMGIMAGE pThis, PDMGDECOMPENTRY pEntry)
+{
+    Assert(pEntry->enmState != DMGDECOMPSTATE_INFLATING);
+
+    if (pEntry->enmState == DMGDECOMPSTATE_QUEUED)
+        RTListNodeRemove(&pEntry->NodeQueue);
+    RTListNodeRemove(&pEntry->NodeLru);
+    pEntry->pExtent->pDecomp = NULL;
+    pThis->cbDecompCache -= pEntry->cbData;
+    RTMemFree(pEntry->pbCompressed);
+    RTMemFree(pEntry);
+}
+
+/**
+ * Evicts least recently used entries until @a cbNeeded more bytes fit into
+ * the decompressed extent cache.
+ *
+ * @returns true if there is room, false if entries being inflated take up
+ *          too much of the cache.
+ * @param   pThis     The DMG instance data.
+ * @param   cbNeeded  Number of bytes to make room for.
+ *
+ * @note Caller must own hDecompMtx.
+ */
+static bool dmgDecompCacheMakeRoom(PDMGIMAGE pThis, size_t cbNeeded)
+{
+    PDMGDECOMPENTRY pEntry = RTListGetLast(&pThis->ListDecompLru, DMGDECOMPENTRY, NodeLru);
+    while (   pEntry
+           && pThis->cbDecompCache + cbNeeded > pThis->cbDecompCacheMax)
+    {
+        PDMGDECOMPENTRY pPrev = RTListGetPrev(&pThis->ListDecompLru, pEntry, DMGDECOMPENTRY, NodeLru);
+        if (pEntry->enmState != DMGDECOMPSTATE_INFLATING)
+            dmgDecompCacheEntryFree(pThis, pEntry);
+        pEntry = pPrev;
+    }
+
+    return pThis->cbDecompCache + cbNeeded <= pThis->cbDecompCacheMax;
+}
+
+/**
+ * Creates a decompressed extent cache entry for the given extent.
+ *
+ * @returns Pointer to the new entry, NULL if out of memory.
+ * @param   pThis     The DMG instance data.
+ * @param   pExtent   The compressed extent.
+ * @param   enmState  The initial state, DMGDECOMPSTATE_QUEUED queues the entry
+ *                    for the read-ahead workers.
+ * @param   pbCompressed The compressed data of the extent for the read-ahead
+ *                    workers, NULL when not queuing.  The entry takes over
+ *                    the buffer on success.
+ *
+ * @note Caller must own hDecompMtx.
+ */
+static PDMGDECOMPENTRY dmgDecompCacheEntryCreate(PDMGIMAGE pThis, PDMGEXTENT pExtent, DMGDECOMPSTATE enmState,
+                                                 uint8_t *pbCompressed)
+{
+    Assert((enmState == DMGDECOMPSTATE_QUEUED) == (pbCompressed != NULL));
+    size_t cbData = (size_t)DMG_BLOCK2BYTE(pExtent->cSectorsExtent);
+    PDMGDECOMPENTRY pEntry = (PDMGDECOMPENTRY)RTMemAlloc(RT_OFFSETOF(DMGDECOMPENTRY, abData) + cbData);
+    if (pEntry)
+    {
+        pEntry->pExtent   = pExtent;
+        pEntry->enmState  = enmState;
+        pEntry->rcInflate = VINF_SUCCESS;
+        pEntry->pbCompressed = pbCompressed;
+        pEntry->cbData    = cbData;
+        RTListPrepend(&pThis->ListDecompLru, &pEntry->NodeLru);
+        if (enmState == DMGDECOMPSTATE_QUEUED)
+            RTListAppend(&pThis->ListDecompQueue, &pEntry->NodeQueue);
+        pExtent->pDecomp = pEntry;
+        pThis->cbDecompCache += cbData;
+    }
+    return pEntry;
+}
+
+/**
+ * Read-ahead worker thread, inflates queued cache entries.
+ */
+static DECLCALLBACK(int) dmgDecompWorker(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PDMGIMAGE pThis = (PDMGIMAGE)pvUser;
+    NOREF(hThreadSelf);
+
+    RTSemFastMutexRequest(pThis->hDecompMtx);
+    while (!pThis->fDecompShutdown)
+    {
+        PDMGDECOMPENTRY pEntry = RTListGetFirst(&pThis->ListDecompQueue, DMGDECOMPENTRY, NodeQueue);
+        if (!pEntry)
+        {
+            RTSemFastMutexRelease(pThis->hDecompMtx);
+            RTSemEventWait(pThis->hEvtDecompWork, RT_INDEFINITE_WAIT);
+            RTSemFastMutexRequest(pThis->hDecompMtx);
+            continue;
+        }
+
+        RTListNodeRemove(&pEntry->NodeQueue);
+        pEntry->enmState = DMGDECOMPSTATE_INFLATING;
+        RTSemFastMutexRelease(pThis->hDecompMtx);
+
+        AssertPtr(pEntry->pbCompressed);
+        int rc = dmgDecompEntryInflate(pThis, pEntry);
+
+        RTSemFastMutexRequest(pThis->hDecompMtx);
+        pEntry->rcInflate = rc;
+        pEntry->enmState  = RT_SUCCESS(rc) ? DMGDECOMPSTATE_VALID : DMGDECOMPSTATE_FAILED;
+        RTSemEventMultiSignal(pThis->hEvtDecompDone);
+    }
+    RTSemFastMutexRelease(pThis->hDecompMtx);
+
+    /* Pass the shutdown on to the next worker. */
+    RTSemEventSignal(pThis->hEvtDecompWork);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Sets up the decompressed extent cache and starts the read-ahead workers
+ * if the image has compressed extents.
+ *
+ * @returns VBox status code.
+ * @param   pThis     The DMG instance data, extents already parsed.
+ */
+static int dmgDecompCacheInit(PDMGIMAGE pThis)
+{
+    uint32_t cbCacheMax = DMG_DECOMP_CACHE_SIZE_DEFAULT;
+    uint32_t cReadAhead = DMG_DECOMP_READ_AHEAD_DEFAULT;
+    PVDINTERFACECONFIG pIfConfig = VDIfConfigGet(pThis->pVDIfsImage);
+    if (pIfConfig)
+    {
+        int rc = VDCFGQueryU32Def(pIfConfig, "DecompCacheSize", &cbCacheMax, DMG_DECOMP_CACHE_SIZE_DEFAULT);
+        if (RT_FAILURE(rc))
+            return vdIfError(pThis->pIfError, rc, RT_SRC_POS,
+                             N_("DMG: configuration error: failed to read DecompCacheSize as U32"));
+        rc = VDCFGQueryU32Def(pIfConfig, "DecompReadAhead", &cReadAhead, DMG_DECOMP_READ_AHEAD_DEFAULT);
+        if (RT_FAILURE(rc))
+            return vdIfError(pThis->pIfError, rc, RT_SRC_POS,
+                             N_("DMG: configuration error: failed to read DecompReadAhead as U32"));
+    }
+
+    /* The extent being read is always kept, even if it exceeds the limit. */
+    pThis->cbDecompCacheMax    = RT_MIN(cbCacheMax, DMG_DECOMP_CACHE_SIZE_MAX);
+    pThis->cDecompReadAhead    = RT_MIN(cReadAhead, DMG_DECOMP_READ_AHEAD_MAX);
+    pThis->idxExtentDecompLast = UINT32_MAX;
+    pThis->cbDecompCache       = 0;
+    RTListInit(&pThis->ListDecompLru);
+    RTListInit(&pThis->ListDecompQueue);
+
+    unsigned cCompressed = 0;
+    for (unsigned i = 0; i < pThis->cExtents; i++)
+        if (pThis->paExtents[i].enmType == DMGEXTENTTYPE_COMP_ZLIB)
+            cCompressed++;
+    if (!cCompressed)
+        return VINF_SUCCESS;
+
+    int rc = RTSemFastMutexCreate(&pThis->hDecompMtx);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pThis->hEvtDecompWork);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventMultiCreate(&pThis->hEvtDecompDone);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    unsigned cWorkers = RT_MIN(RT_MIN(pThis->cDecompReadAhead, RTMpGetOnlineCount()), DMG_DECOMP_WORKERS_MAX);
+    cWorkers = RT_MIN(cWorkers, cCompressed - 1);
+    for (unsigned i = 0; i < cWorkers; i++)
+    {
+        rc = RTThreadCreateF(&pThis->ahDecompWorkers[i], dmgDecompWorker, pThis, 0,
+                             RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "DmgInflate%u", i);
+        if (RT_FAILURE(rc))
+            break;
+        pThis->cDecompWorkers++;
+    }
+
+    /* Without workers there is no read-ahead, that's all. */
+    if (!pThis->cDecompWorkers)
+        pThis->cDecompReadAhead = 0;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Stops the read-ahead workers and frees the decompressed extent cache.
+ *
+ * @param   pThis     The DMG instance data.
+ */
+static void dmgDecompCacheDestroy(PDMGIMAGE pThis)
+{
+    if (pThis->hDecompMtx == NIL_RTSEMFASTMUTEX)
+        return;
+
+    if (pThis->cDecompWorkers)
+    {
+        ASMAtomicWriteBool(&pThis->fDecompShutdown, true);
+        RTSemEventSignal(pThis->hEvtDecompWork);
+        for (unsigned i = 0; i < pThis->cDecompWorkers; i++)
+            RTThreadWait(pThis->ahDecompWorkers[i], RT_INDEFINITE_WAIT, NULL);
+        pThis->cDecompWorkers = 0;
+    }
+
+    PDMGDECOMPENTRY pEntry, pEntryNext;
+    RTListForEachSafe(&pThis->ListDecompLru, pEntry, pEntryNext, DMGDECOMPENTRY, NodeLru)
+    {
+        RTListNodeRemove(&pEntry->NodeLru);
+        pEntry->pExtent->pDecomp = NULL;
+        RTMemFree(pEntry->pbCompressed);
+        RTMemFree(pEntry);
+    }
+    RTListInit(&pThis->ListDecompQueue);
+    pThis->cbDecompCache = 0;
+
+    RTSemEventMultiDestroy(pThis->hEvtDecompDone);
+    pThis->hEvtDecompDone = NIL_RTSEMEVENTMULTI;
+    RTSemEventDestroy(pThis->hEvtDecompWork);
+    pThis->hEvtDecompWork = NIL_RTSEMEVENT;
+    RTSemFastMutexDestroy(pThis->hDecompMtx);
+    pThis->hDecompMtx = NIL_RTSEMFASTMUTEX;
+}
+
+/**
+ * Queues the compressed extents following @a idxExtent for inflating by the
+ * read-ahead workers.
+ *
+ * The compressed data is read here as the image must only be accessed by the
+ * thread doing the I/O for the disk, the workers just inflate it.
+ *
+ * @param   pThis     The DMG instance data.
+ * @param   idxExtent Index of the compressed extent just read.
+ *
+ * @note Caller must own hDecompMtx, it is left while reading.
+ */
+static void dmgDecompCacheReadAhead(PDMGIMAGE pThis, uint32_t idxExtent)
+{
+    /* Don't let the read-ahead push out more than half of the cache. */
+    size_t   cbQueued = 0;
+    uint32_t cQueued  = 0;
+    for (uint32_t i = idxExtent + 1;
+            i < pThis->cExtents
+         && i <= idxExtent + 4 * pThis->cDecompReadAhead
+         && cQueued < pThis->cDecompReadAhead;
+         i++)
+    {
+        PDMGEXTENT pExtent = &pThis->paExtents[i];
+        if (pExtent->enmType != DMGEXTENTTYPE_COMP_ZLIB)
+            continue;
+        cQueued++;
+        if (pExtent->pDecomp)
+            continue;
+
+        size_t cbData = (size_t)DMG_BLOCK2BYTE(pExtent->cSectorsExtent);
+        if (   cbQueued + cbData > pThis->cbDecompCacheMax / 2
+            || !dmgDecompCacheMakeRoom(pThis, cbData))
+            break;
+
+        /* Nobody else creates entries, so the room is still there afterwards. */
+        uint8_t *pbCompressed = (uint8_t *)RTMemAlloc((size_t)pExtent->cbFile);
+        if (!pbCompressed)
+            break;
+        RTSemFastMutexRelease(pThis->hDecompMtx);
+        int rc = dmgWrapFileReadSync(pThis, pExtent->offFileStart, pbCompressed, (size_t)pExtent->cbFile);
+        RTSemFastMutexRequest(pThis->hDecompMtx);
+        if (   RT_FAILURE(rc)
+            || !dmgDecompCacheEntryCreate(pThis, pExtent, DMGDECOMPSTATE_QUEUED, pbCompressed))
+        {
+            RTMemFree(pbCompressed);
+            break;
+        }
+        cbQueued += cbData;
+        pThis->cDecompReadAheads++;
+        RTSemEventSignal(pThis->hEvtDecompWork);
+    }
+}
+
+/**
+ * Reads from a compressed extent through the decompressed extent cache.
+ *
+ * @returns VBox status code.
+ * @param   pThis     The DMG instance data.
+ * @param   pExtent   The compressed extent.
+ * @param   offExtent Byte offset into the decompressed extent.
+ * @param   pIoCtx    The I/O context to copy the data to.
+ * @param   cbToRead  Number of bytes to read, must not cross the extent end.
+ */
+static int dmgDecompCacheRead(PDMGIMAGE pThis, PDMGEXTENT pExtent, uint64_t offExtent,
+                              PVDIOCTX pIoCtx, size_t cbToRead)
+{
+    int rc = VINF_SUCCESS;
+    uint32_t idxExtent = (uint32_t)(pExtent - pThis->paExtents);
+
+    RTSemFastMutexRequest(pThis->hDecompMtx);
+
+    /* Wait for a worker inflating the extent right now. */
+    PDMGDECOMPENTRY pEntry = pExtent->pDecomp;
+    while (pEntry && pEntry->enmState == DMGDECOMPSTATE_INFLATING)
+    {
+        RTSemEventMultiReset(pThis->hEvtDecompDone);
+        RTSemFastMutexRelease(pThis->hDecompMtx);
+        RTSemEventMultiWait(pThis->hEvtDecompDone, RT_INDEFINITE_WAIT);
+        RTSemFastMutexRequest(pThis->hDecompMtx);
+    }
+
+    /* A failed read-ahead is retried here so the error ends up with the request. */
+    if (pEntry && pEntry->enmState == DMGDECOMPSTATE_FAILED)
+    {
+        dmgDecompCacheEntryFree(pThis, pEntry);
+        pEntry = NULL;
+    }
+
+    if (pEntry && pEntry->enmState == DMGDECOMPSTATE_VALID)
+        pThis->cDecompHits++;
+    else
+    {
+        pThis->cDecompMisses++;
+        if (!pEntry)
+        {
+            dmgDecompCacheMakeRoom(pThis, (size_t)DMG_BLOCK2BYTE(pExtent->cSectorsExtent));
+            pEntry = dmgDecompCacheEntryCreate(pThis, pExtent, DMGDECOMPSTATE_INFLATING, NULL /*pbCompressed*/);
+            if (!pEntry)
+                rc = VERR_NO_MEMORY;
+        }
+        else
+        {
+            /* Queued but not picked up by a worker yet, do it ourselves. */
+            RTListNodeRemove(&pEntry->NodeQueue);
+            pEntry->enmState = DMGDECOMPSTATE_INFLATING;
+        }
+
+        if (RT_SUCCESS(rc))
+        {
+            RTSemFastMutexRelease(pThis->hDecompMtx);
+            rc = dmgDecompEntryInflate(pThis, pEntry);
+            RTSemFastMutexRequest(pThis->hDecompMtx);
+
+            pEntry->rcInflate = rc;
+            pEntry->enmState  = RT_SUCCESS(rc) ? DMGDECOMPSTATE_VALID : DMGDECOMPSTATE_FAILED;
+            if (RT_FAILURE(rc))
+            {
+                dmgDecompCacheEntryFree(pThis, pEntry);
+                pEntry = NULL;
+            }
+        }
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        /* Move to the head of the LRU list. */
+        RTListNodeRemove(&pEntry->NodeLru);
+        RTListPrepend(&pThis->ListDecompLru, &pEntry->NodeLru);
+
+        /*
+         * Only this thread frees entries, so the data can be copied without
+         * holding the lock. The read-ahead below may evict the entry though.
+         */
+        RTSemFastMutexRelease(pThis->hDecompMtx);
+        vdIfIoIntIoCtxCopyTo(pThis->pIfIoXxx, pIoCtx, &pEntry->abData[offExtent], cbToRead);
+        RTSemFastMutexRequest(pThis->hDecompMtx);
+
+        /* Read ahead when the previous compressed extent read was one of the
+           last few before this one, i.e. the image is read sequentially. */
+        if (   pThis->cDecompReadAhead
+            && idxExtent != pThis->idxExtentDecompLast
+            && pThis->idxExtentDecompLast != UINT32_MAX
+            && idxExtent > pThis->idxExtentDecompLast
+            && idxExtent - pThis->idxExtentDecompLast <= 4)
+            dmgDecompCacheReadAhead(pThis, idxExtent);
+        pThis->idxExtentDecompLast = idxExtent;
+    }
+
+    RTSemFastMutexRelease(pThis->hDecompMtx);
+    return rc;
+}
+
 /**
  * Swaps endian.
  * @param   pUdif       The structure.
@@ -816,6 +1326,9 @@ static int dmgFreeImage(PDMGIMAGE pThis, bool fDelete)
      * not signalled as an error. After all nothing bad happens. */
     if (pThis)
     {
+        /* The read-ahead workers read from the file, stop them first. */
+        dmgDecompCacheDestroy(pThis);
+
         RTVfsFileRelease(pThis->hDmgFileInXar);
         pThis->hDmgFileInXar = NIL_RTVFSFILE;
 
@@ -854,13 +1367,6 @@ static int dmgFreeImage(PDMGIMAGE pThis, bool fDelete)
 
         if (fDelete && pThis->pszFilename)
             vdIfIoIntFileDelete(pThis->pIfIoXxx, pThis->pszFilename);
-
-        if (pThis->pvDecompExtent)
-        {
-            RTMemFree(pThis->pvDecompExtent);
-            pThis->pvDecompExtent = NULL;
-            pThis->cbDecompExtent = 0;
-        }
     }
 
     LogFlowFunc(("returns %Rrc\n", rc));
@@ -1697,6 +2203,9 @@ static int dmgOpenImage(PDMGIMAGE pThis, unsigned uOpenFlags)
     }
     RTMemFree(pszXml);
 
+    if (RT_SUCCESS(rc))
+        rc = dmgDecompCacheInit(pThis);
+
     if (RT_FAILURE(rc))
         dmgFreeImage(pThis, false);
     return rc;
@@ -1931,34 +2440,7 @@ static DECLCALLBACK(int) dmgRead(void *pBackendData, uint64_t uOffset,  size_t c
             }
             case DMGEXTENTTYPE_COMP_ZLIB:
             {
-                if (pThis->pExtentDecomp != pExtent)
-                {
-                    if (DMG_BLOCK2BYTE(pExtent->cSectorsExtent) > pThis->cbDecompExtent)
-                    {
-                        if (RT_LIKELY(pThis->pvDecompExtent))
-                            RTMemFree(pThis->pvDecompExtent);
-
-                        pThis->pvDecompExtent = RTMemAllocZ(DMG_BLOCK2BYTE(pExtent->cSectorsExtent));
-                        if (!pThis->pvDecompExtent)
-                            rc = VERR_NO_MEMORY;
-                        else
-                            pThis->cbDecompExtent = DMG_BLOCK2BYTE(pExtent->cSectorsExtent);
-                    }
-
-                    if (RT_SUCCESS(rc))
-                    {
-                        rc = dmgFileInflateSync(pThis, pExtent->offFileStart, pExtent->cbFile,
-                                                pThis->pvDecompExtent,
-                                                RT_MIN(pThis->cbDecompExtent, DMG_BLOCK2BYTE(pExtent->cSectorsExtent)));
-                        if (RT_SUCCESS(rc))
-                            pThis->pExtentDecomp = pExtent;
-                    }
-                }
-
-                if (RT_SUCCESS(rc))
-                    vdIfIoIntIoCtxCopyTo(pThis->pIfIoXxx, pIoCtx,
-                                         (uint8_t *)pThis->pvDecompExtent + DMG_BLOCK2BYTE(uExtentRel),
-                                         cbToRead);
+                rc = dmgDecompCacheRead(pThis, pExtent, DMG_BLOCK2BYTE(uExtentRel), pIoCtx, cbToRead);
                 break;
             }
             default:
@@ -2467,6 +2949,9 @@ static DECLCALLBACK(void) dmgDump(void *pBackendData)
                          pThis->PCHSGeometry.cCylinders, pThis->PCHSGeometry.cHeads, pThis->PCHSGeometry.cSectors,
                          pThis->LCHSGeometry.cCylinders, pThis->LCHSGeometry.cHeads, pThis->LCHSGeometry.cSectors,
                          pThis->cbSize / DMG_SECTOR_SIZE);
+        vdIfErrorMessage(pThis->pIfError, "Decompression cache: cbCache=%zu cbCacheMax=%zu cReadAhead=%u cWorkers=%u hits=%llu misses=%llu read-aheads=%llu\n",
+                         pThis->cbDecompCache, pThis->cbDecompCacheMax, pThis->cDecompReadAhead, pThis->cDecompWorkers,
+                         pThis->cDecompHits, pThis->cDecompMisses, pThis->cDecompReadAheads);
     }
 }
 
@@ -2482,7 +2967,7 @@ const VBOXHDDBACKEND g_DmgBackend =
     /* paFileExtensions */
     s_aDmgFileExtensions,
     /* paConfigInfo */
-    NULL,
+    s_aDmgConfigInfo,
     /* pfnCheckIfValid */
     dmgCheckIfValid,
     /* pfnOpen */
@@ -2566,6 +3051,8 @@ const VBOXHDDBACKEND g_DmgBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
+    NULL,
+    /* pfnQueryAllocation */
     NULL
 };
 
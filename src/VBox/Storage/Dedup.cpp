@@ -0,0 +1,2101 @@
+/* $Id$ */
+/** @file
+ * Dedup - Block-level deduplicating disk image, core code.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_VD_DEDUP
+#include <VBox/vd-plugin.h>
+#include <VBox/err.h>
+
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/avl.h>
+#include <iprt/list.h>
+#include <iprt/mem.h>
+#include <iprt/sha.h>
+#include <iprt/string.h>
+#include <iprt/uuid.h>
+
+#include "VDBackends.h"
+
+/*
+ * The image consists of a header followed by four regions:
+ *
+ *   - The block map with one 32bit entry per virtual block, referencing the
+ *     store block holding the data of the virtual block.
+ *   - The block table with one 32bit entry per store block, giving the index
+ *     slot holding the hash of the store block's data.
+ *   - The index, an open addressing hash table of SHA-256 hashes of all
+ *     store blocks, organized in buckets of 4KB.
+ *   - The store with the data blocks. Every distinct block content is stored
+ *     only once, no matter how many virtual blocks have that content.
+ *
+ * Blocks consisting only of zeros are not stored at all.
+ *
+ * The block map is the authoritative metadata: the reference counts of the
+ * store blocks are not written to the image but counted from the block map
+ * when the image is opened. Everything else is written through in an order
+ * which ensures that a crash at any point leaves at most unreferenced store
+ * blocks and stale index entries behind. Both are cleaned up on the next
+ * open for writing. Released store blocks are only reused after the next
+ * flush, before that the block map on the disk might still reference them.
+ *
+ * All I/O is synchronous, the backend doesn't support async I/O.
+ */
+
+/*******************************************************************************
+*   Constants And Macros, Structures and Typedefs                              *
+*******************************************************************************/
+
+/** The header magic, 'VDDP'. */
+#define DEDUP_HDR_MAGIC                 UINT32_C(0x50444456)
+/** The current header version. */
+#define DEDUP_HDR_VERSION               1
+/** The image is a differencing image. */
+#define DEDUP_HDR_F_DIFF                RT_BIT_32(0)
+
+/** Alignment of the regions in the image. */
+#define DEDUP_REGION_ALIGNMENT          _4K
+/** Block size of new images. */
+#define DEDUP_BLOCK_SIZE_DEFAULT        _64K
+/** Minimum block size accepted when opening an image. */
+#define DEDUP_BLOCK_SIZE_MIN            _4K
+/** Maximum block size accepted when opening an image. */
+#define DEDUP_BLOCK_SIZE_MAX            _1M
+/** Maximum number of virtual blocks, leaves room for the special map entries. */
+#define DEDUP_BLOCKS_MAX                (UINT32_MAX / 2)
+
+/** Block map entry: block not allocated in this image. */
+#define DEDUP_MAP_FREE                  UINT32_C(0)
+/** Block map entry: block contains only zeros. */
+#define DEDUP_MAP_ZERO                  UINT32_MAX
+/** Block table entry: store block is unused. */
+#define DEDUP_BLOCK_TBL_FREE            UINT32_MAX
+
+/** Number of hash bytes kept in the index. */
+#define DEDUP_HASH_SIZE                 28
+/** Size of an index bucket, the unit of caching. */
+#define DEDUP_INDEX_BUCKET_SIZE         _4K
+/** Index entry: slot was never used. */
+#define DEDUP_INDEX_ENTRY_FREE          UINT32_C(0)
+/** Index entry: slot held a hash which was removed. */
+#define DEDUP_INDEX_ENTRY_DELETED       UINT32_MAX
+
+/** Default size of the index cache in bytes. */
+#define DEDUP_INDEX_CACHE_SIZE_DEFAULT  (4 * _1M)
+/** Upper limit for the index cache size. */
+#define DEDUP_INDEX_CACHE_SIZE_MAX      (256 * _1M)
+
+#pragma pack(1)
+/**
+ * The image header, at offset 0. All fields are little endian.
+ */
+typedef struct DedupHeader
+{
+    /** Magic value (DEDUP_HDR_MAGIC). */
+    uint32_t    u32Magic;
+    /** Version of the header (DEDUP_HDR_VERSION). */
+    uint32_t    u32Version;
+    /** Size of the header in bytes. */
+    uint32_t    cbHeader;
+    /** Flags (DEDUP_HDR_F_*). */
+    uint32_t    fFlags;
+    /** Size of the virtual disk in bytes. */
+    uint64_t    cbDisk;
+    /** Size of a block in bytes, power of two. */
+    uint32_t    cbBlock;
+    /** Number of virtual blocks. */
+    uint32_t    cBlocks;
+    /** Number of index buckets. */
+    uint32_t    cIndexBuckets;
+    /** Reserved, MBZ. */
+    uint32_t    u32Reserved;
+    /** Offset of the block map. */
+    uint64_t    offMap;
+    /** Offset of the block table, room for cBlocks + 1 entries. */
+    uint64_t    offBlockTbl;
+    /** Offset of the index. */
+    uint64_t    offIndex;
+    /** Offset of the first store block. */
+    uint64_t    offData;
+    /** UUID of the image. */
+    RTUUID      UuidImage;
+    /** UUID of the last modification. */
+    RTUUID      UuidModification;
+    /** UUID of the parent image. */
+    RTUUID      UuidParent;
+    /** UUID of the last modification of the parent image. */
+    RTUUID      UuidParentModification;
+    /** Physical geometry: cylinders. */
+    uint32_t    cPCHSCylinders;
+    /** Physical geometry: heads. */
+    uint32_t    cPCHSHeads;
+    /** Physical geometry: sectors. */
+    uint32_t    cPCHSSectors;
+    /** Logical geometry: cylinders. */
+    uint32_t    cLCHSCylinders;
+    /** Logical geometry: heads. */
+    uint32_t    cLCHSHeads;
+    /** Logical geometry: sectors. */
+    uint32_t    cLCHSSectors;
+} DedupHeader;
+#pragma pack()
+AssertCompileSize(DedupHeader, 160);
+/** Pointer to an on disk image header. */
+typedef DedupHeader *PDedupHeader;
+
+#pragma pack(1)
+/**
+ * Index entry. All fields are little endian.
+ */
+typedef struct DedupIndexEntry
+{
+    /** The leading bytes of the SHA-256 hash of the block. */
+    uint8_t     abHash[DEDUP_HASH_SIZE];
+    /** Store block number + 1, or one of DEDUP_INDEX_ENTRY_*. */
+    uint32_t    u32Block;
+} DedupIndexEntry;
+#pragma pack()
+AssertCompileSize(DedupIndexEntry, 32);
+/** Pointer to an index entry. */
+typedef DedupIndexEntry *PDedupIndexEntry;
+
+/** Number of entries in an index bucket. */
+#define DEDUP_INDEX_BUCKET_ENTRIES      (DEDUP_INDEX_BUCKET_SIZE / sizeof(DedupIndexEntry))
+
+/**
+ * In memory state of a store block.
+ */
+typedef struct DEDUPBLOCK
+{
+    /** Number of virtual blocks referencing the block, 0 if free. */
+    uint32_t            cRefs;
+    /** The index slot holding the hash of the block, DEDUP_BLOCK_TBL_FREE if
+     * not indexed. For free blocks this is the next block in the free list. */
+    uint32_t            idxSlot;
+} DEDUPBLOCK;
+/** Pointer to the state of a store block. */
+typedef DEDUPBLOCK *PDEDUPBLOCK;
+
+/**
+ * Cached index bucket.
+ */
+typedef struct DEDUPINDEXBUCKET
+{
+    /** AVL tree node, the key is the bucket number. */
+    AVLU32NODECORE      Core;
+    /** Node in the LRU list, most recently used first. */
+    RTLISTNODE          NodeLru;
+    /** The entries as read from the image. */
+    DedupIndexEntry     aEntries[DEDUP_INDEX_BUCKET_ENTRIES];
+} DEDUPINDEXBUCKET;
+/** Pointer to a cached index bucket. */
+typedef DEDUPINDEXBUCKET *PDEDUPINDEXBUCKET;
+
+/**
+ * Dedup image data structure.
+ */
+typedef struct DEDUPIMAGE
+{
+    /** Image file name. */
+    const char         *pszFilename;
+    /** Opaque storage handle. */
+    PVDIOSTORAGE        pStorage;
+
+    /** Pointer to the per-disk VD interface list. */
+    PVDINTERFACE        pVDIfsDisk;
+    /** Pointer to the per-image VD interface list. */
+    PVDINTERFACE        pVDIfsImage;
+    /** Error interface. */
+    PVDINTERFACEERROR   pIfError;
+    /** I/O interface. */
+    PVDINTERFACEIOINT   pIfIo;
+
+    /** Open flags passed by VBoxHDD layer. */
+    unsigned            uOpenFlags;
+    /** Image flags defined during creation or determined during open. */
+    unsigned            uImageFlags;
+    /** Total size of the image. */
+    uint64_t            cbSize;
+    /** Physical geometry of this image. */
+    VDGEOMETRY          PCHSGeometry;
+    /** Logical geometry of this image. */
+    VDGEOMETRY          LCHSGeometry;
+    /** Image UUID. */
+    RTUUID              ImageUuid;
+    /** Image modification UUID. */
+    RTUUID              ModificationUuid;
+    /** Parent image UUID. */
+    RTUUID              ParentUuid;
+    /** Parent image modification UUID. */
+    RTUUID              ParentModificationUuid;
+
+    /** Size of a block in bytes. */
+    uint32_t            cbBlock;
+    /** Number of virtual blocks. */
+    uint32_t            cBlocks;
+    /** Number of index buckets. */
+    uint32_t            cIndexBuckets;
+    /** Offset of the block map. */
+    uint64_t            offMap;
+    /** Offset of the block table. */
+    uint64_t            offBlockTbl;
+    /** Offset of the index. */
+    uint64_t            offIndex;
+    /** Offset of the store. */
+    uint64_t            offData;
+
+    /** The block map, host endian. */
+    uint32_t           *paMap;
+    /** State of the store blocks. */
+    PDEDUPBLOCK         paBlocks;
+    /** Number of store blocks in the image. */
+    uint32_t            cStoreBlocks;
+    /** Number of entries paBlocks has room for. */
+    uint32_t            cStoreBlocksAlloc;
+    /** First free store block, UINT32_MAX if none. */
+    uint32_t            idxBlockFree;
+    /** First store block released since the last flush, UINT32_MAX if none.
+     * The blocks are moved to the free list by the next flush. */
+    uint32_t            idxBlockFreePending;
+    /** Scratch buffer for assembling a block on write. */
+    uint8_t            *pbBlock;
+
+    /** @name Index cache.
+     * @{ */
+    /** Cached buckets by bucket number. */
+    AVLU32TREE          TreeIndexBuckets;
+    /** LRU list of cached buckets. */
+    RTLISTANCHOR        ListIndexLru;
+    /** Number of cached buckets. */
+    uint32_t            cIndexBucketsCached;
+    /** Max number of buckets to cache. */
+    uint32_t            cIndexBucketsCachedMax;
+    /** @} */
+
+    /** @name Statistics.
+     * @{ */
+    /** Virtual blocks referencing a store block. */
+    uint32_t            cBlocksMapped;
+    /** Virtual blocks containing only zeros. */
+    uint32_t            cBlocksZero;
+    /** Store blocks in use. */
+    uint32_t            cStoreBlocksUsed;
+    /** Block writes which found their data in the store already. */
+    uint64_t            cWritesDeduped;
+    /** Block writes which added a new block to the store. */
+    uint64_t            cWritesStored;
+    /** Index bucket lookups served from the cache. */
+    uint64_t            cIndexCacheHits;
+    /** Index bucket lookups which had to read the image. */
+    uint64_t            cIndexCacheMisses;
+    /** @} */
+} DEDUPIMAGE, *PDEDUPIMAGE;
+
+/*******************************************************************************
+*   Static Variables                                                           *
+*******************************************************************************/
+
+/** NULL-terminated array of supported file extensions. */
+static const VDFILEEXTENSION s_aDedupFileExtensions[] =
+{
+    {"vdd", VDTYPE_HDD},
+    {NULL, VDTYPE_INVALID}
+};
+
+/** Default index cache size in bytes, keep in sync with DEDUP_INDEX_CACHE_SIZE_DEFAULT. */
+static const char *s_pszDedupConfigDefaultIndexCacheSize = "4194304";
+
+/** Description of all accepted config parameters. */
+static const VDCONFIGINFO s_aDedupConfigInfo[] =
+{
+    { "IndexCacheSize",       s_pszDedupConfigDefaultIndexCacheSize,     VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
+};
+
+/*******************************************************************************
+*   Internal Functions                                                         *
+*******************************************************************************/
+
+/**
+ * Returns the offset of the given store block in the image.
+ */
+DECLINLINE(uint64_t) dedupStoreBlockOffset(PDEDUPIMAGE pImage, uint32_t idxBlock)
+{
+    return pImage->offData + (uint64_t)idxBlock * pImage->cbBlock;
+}
+
+/**
+ * Computes the dedup ratio in percent, i.e. how many virtual blocks one
+ * store block backs on average.
+ */
+static uint32_t dedupRatioPercent(PDEDUPIMAGE pImage)
+{
+    if (!pImage->cStoreBlocksUsed)
+        return 100;
+    return (uint32_t)((uint64_t)pImage->cBlocksMapped * 100 / pImage->cStoreBlocksUsed);
+}
+
+/**
+ * Internal. Writes the header.
+ */
+static int dedupHeaderWrite(PDEDUPIMAGE pImage)
+{
+    DedupHeader Hdr;
+
+    RT_ZERO(Hdr);
+    Hdr.u32Magic               = RT_H2LE_U32(DEDUP_HDR_MAGIC);
+    Hdr.u32Version             = RT_H2LE_U32(DEDUP_HDR_VERSION);
+    Hdr.cbHeader               = RT_H2LE_U32(sizeof(Hdr));
+    Hdr.fFlags                 = RT_H2LE_U32(pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF ? DEDUP_HDR_F_DIFF : 0);
+    Hdr.cbDisk                 = RT_H2LE_U64(pImage->cbSize);
+    Hdr.cbBlock                = RT_H2LE_U32(pImage->cbBlock);
+    Hdr.cBlocks                = RT_H2LE_U32(pImage->cBlocks);
+    Hdr.cIndexBuckets          = RT_H2LE_U32(pImage->cIndexBuckets);
+    Hdr.offMap                 = RT_H2LE_U64(pImage->offMap);
+    Hdr.offBlockTbl            = RT_H2LE_U64(pImage->offBlockTbl);
+    Hdr.offIndex               = RT_H2LE_U64(pImage->offIndex);
+    Hdr.offData                = RT_H2LE_U64(pImage->offData);
+    Hdr.UuidImage              = pImage->ImageUuid;
+    Hdr.UuidModification       = pImage->ModificationUuid;
+    Hdr.UuidParent             = pImage->ParentUuid;
+    Hdr.UuidParentModification = pImage->ParentModificationUuid;
+    Hdr.cPCHSCylinders         = RT_H2LE_U32(pImage->PCHSGeometry.cCylinders);
+    Hdr.cPCHSHeads             = RT_H2LE_U32(pImage->PCHSGeometry.cHeads);
+    Hdr.cPCHSSectors           = RT_H2LE_U32(pImage->PCHSGeometry.cSectors);
+    Hdr.cLCHSCylinders         = RT_H2LE_U32(pImage->LCHSGeometry.cCylinders);
+    Hdr.cLCHSHeads             = RT_H2LE_U32(pImage->LCHSGeometry.cHeads);
+    Hdr.cLCHSSectors           = RT_H2LE_U32(pImage->LCHSGeometry.cSectors);
+
+    return vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage, 0, &Hdr, sizeof(Hdr));
+}
+
+/**
+ * Internal. Writes the block map entry of the given virtual block.
+ */
+static int dedupMapWrite(PDEDUPIMAGE pImage, uint32_t iBlock)
+{
+    uint32_t u32 = RT_H2LE_U32(pImage->paMap[iBlock]);
+    return vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage,
+                                  pImage->offMap + (uint64_t)iBlock * sizeof(uint32_t),
+                                  &u32, sizeof(u32));
+}
+
+/**
+ * Internal. Writes the block table entry of the given store block.
+ */
+static int dedupBlockTblWrite(PDEDUPIMAGE pImage, uint32_t idxBlock)
+{
+    PDEDUPBLOCK pBlock = &pImage->paBlocks[idxBlock];
+    uint32_t u32 = RT_H2LE_U32(pBlock->cRefs ? pBlock->idxSlot : DEDUP_BLOCK_TBL_FREE);
+    return vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage,
+                                  pImage->offBlockTbl + (uint64_t)idxBlock * sizeof(uint32_t),
+                                  &u32, sizeof(u32));
+}
+
+/**
+ * Internal. Frees a cached index bucket, RTAvlU32Destroy callback.
+ */
+static DECLCALLBACK(int) dedupIndexBucketFree(PAVLU32NODECORE pNode, void *pvUser)
+{
+    NOREF(pvUser);
+    RTMemFree(pNode);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Initializes the index cache, sized according to the
+ * IndexCacheSize config key.
+ */
+static int dedupIndexCacheInit(PDEDUPIMAGE pImage)
+{
+    uint32_t cbCacheMax = DEDUP_INDEX_CACHE_SIZE_DEFAULT;
+    PVDINTERFACECONFIG pIfConfig = VDIfConfigGet(pImage->pVDIfsImage);
+    if (pIfConfig)
+    {
+        int rc = VDCFGQueryU32Def(pIfConfig, "IndexCacheSize", &cbCacheMax, DEDUP_INDEX_CACHE_SIZE_DEFAULT);
+        if (RT_FAILURE(rc))
+            return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                             N_("DEDUP: configuration error: failed to read IndexCacheSize as U32"));
+    }
+
+    /* At least one bucket is needed to look anything up. */
+    cbCacheMax = RT_MIN(cbCacheMax, DEDUP_INDEX_CACHE_SIZE_MAX);
+    pImage->cIndexBucketsCachedMax = RT_MAX(cbCacheMax / sizeof(DEDUPINDEXBUCKET), 1);
+    pImage->cIndexBucketsCached    = 0;
+    pImage->TreeIndexBuckets       = NULL;
+    RTListInit(&pImage->ListIndexLru);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Frees all cached index buckets.
+ */
+static void dedupIndexCacheDestroy(PDEDUPIMAGE pImage)
+{
+    RTAvlU32Destroy(&pImage->TreeIndexBuckets, dedupIndexBucketFree, NULL);
+    RTListInit(&pImage->ListIndexLru);
+    pImage->cIndexBucketsCached = 0;
+}
+
+/**
+ * Internal. Returns the given index bucket, reading it into the cache if
+ * necessary.
+ *
+ * @returns VBox status code.
+ * @param   pImage      The image instance data.
+ * @param   iBucket     The bucket number.
+ * @param   ppBucket    Where to store the pointer to the cached bucket.
+ */
+static int dedupIndexBucketGet(PDEDUPIMAGE pImage, uint32_t iBucket, PDEDUPINDEXBUCKET *ppBucket)
+{
+    PDEDUPINDEXBUCKET pBucket = (PDEDUPINDEXBUCKET)RTAvlU32Get(&pImage->TreeIndexBuckets, iBucket);
+    if (pBucket)
+    {
+        pImage->cIndexCacheHits++;
+        RTListNodeRemove(&pBucket->NodeLru);
+        RTListPrepend(&pImage->ListIndexLru, &pBucket->NodeLru);
+        *ppBucket = pBucket;
+        return VINF_SUCCESS;
+    }
+
+    pImage->cIndexCacheMisses++;
+    if (pImage->cIndexBucketsCached >= pImage->cIndexBucketsCachedMax)
+    {
+        /* Recycle the least recently used bucket. */
+        pBucket = RTListGetLast(&pImage->ListIndexLru, DEDUPINDEXBUCKET, NodeLru);
+        RTListNodeRemove(&pBucket->NodeLru);
+        RTAvlU32Remove(&pImage->TreeIndexBuckets, pBucket->Core.Key);
+    }
+    else
+    {
+        pBucket = (PDEDUPINDEXBUCKET)RTMemAlloc(sizeof(DEDUPINDEXBUCKET));
+        if (!pBucket)
+            return VERR_NO_MEMORY;
+        pImage->cIndexBucketsCached++;
+    }
+
+    int rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage,
+                                   pImage->offIndex + (uint64_t)iBucket * DEDUP_INDEX_BUCKET_SIZE,
+                                   &pBucket->aEntries[0], sizeof(pBucket->aEntries));
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(pBucket);
+        pImage->cIndexBucketsCached--;
+        return rc;
+    }
+
+    pBucket->Core.Key = iBucket;
+    RTAvlU32Insert(&pImage->TreeIndexBuckets, &pBucket->Core);
+    RTListPrepend(&pImage->ListIndexLru, &pBucket->NodeLru);
+    *ppBucket = pBucket;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Updates the store block number of the given index slot, writing
+ * through to the image.
+ *
+ * @returns VBox status code.
+ * @param   pImage      The image instance data.
+ * @param   idxSlot     The index slot.
+ * @param   pbHash      The hash to store, NULL to keep the hash.
+ * @param   u32Block    The new store block number + 1, or one of
+ *                      DEDUP_INDEX_ENTRY_*.
+ */
+static int dedupIndexEntrySet(PDEDUPIMAGE pImage, uint32_t idxSlot, const uint8_t *pbHash,
+                              uint32_t u32Block)
+{
+    PDEDUPINDEXBUCKET pBucket;
+    int rc = dedupIndexBucketGet(pImage, idxSlot / DEDUP_INDEX_BUCKET_ENTRIES, &pBucket);
+    if (RT_SUCCESS(rc))
+    {
+        PDedupIndexEntry pEntry = &pBucket->aEntries[idxSlot % DEDUP_INDEX_BUCKET_ENTRIES];
+        if (pbHash)
+            memcpy(pEntry->abHash, pbHash, sizeof(pEntry->abHash));
+        pEntry->u32Block = RT_H2LE_U32(u32Block);
+        rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage,
+                                    pImage->offIndex + (uint64_t)idxSlot * sizeof(DedupIndexEntry),
+                                    pEntry, sizeof(*pEntry));
+    }
+    return rc;
+}
+
+/**
+ * Internal. Removes the hash in the given index slot.
+ *
+ * A slot can only be made free again if the probe sequence ends right after
+ * it, otherwise the lookup of hashes further down the sequence would stop
+ * early. In that case the tombstones right before the slot are reclaimed as
+ * well, so deleted slots don't pile up and lengthen the lookups of hashes
+ * which aren't in the index. A crash in between only leaves some tombstones
+ * behind.
+ *
+ * @returns VBox status code.
+ * @param   pImage      The image instance data.
+ * @param   idxSlot     The index slot.
+ */
+static int dedupIndexEntryDelete(PDEDUPIMAGE pImage, uint32_t idxSlot)
+{
+    uint32_t const cSlots = pImage->cIndexBuckets * DEDUP_INDEX_BUCKET_ENTRIES;
+    uint32_t idxSlotNext = idxSlot + 1 < cSlots ? idxSlot + 1 : 0;
+    PDEDUPINDEXBUCKET pBucket;
+
+    int rc = dedupIndexBucketGet(pImage, idxSlotNext / DEDUP_INDEX_BUCKET_ENTRIES, &pBucket);
+    if (RT_FAILURE(rc))
+        return rc;
+    if (RT_LE2H_U32(pBucket->aEntries[idxSlotNext % DEDUP_INDEX_BUCKET_ENTRIES].u32Block) != DEDUP_INDEX_ENTRY_FREE)
+        return dedupIndexEntrySet(pImage, idxSlot, NULL, DEDUP_INDEX_ENTRY_DELETED);
+
+    rc = dedupIndexEntrySet(pImage, idxSlot, NULL, DEDUP_INDEX_ENTRY_FREE);
+    for (uint32_t cSlotsLeft = cSlots - 1; RT_SUCCESS(rc) && cSlotsLeft > 0; cSlotsLeft--)
+    {
+        idxSlot = idxSlot > 0 ? idxSlot - 1 : cSlots - 1;
+        rc = dedupIndexBucketGet(pImage, idxSlot / DEDUP_INDEX_BUCKET_ENTRIES, &pBucket);
+        if (   RT_FAILURE(rc)
+            || RT_LE2H_U32(pBucket->aEntries[idxSlot % DEDUP_INDEX_BUCKET_ENTRIES].u32Block) != DEDUP_INDEX_ENTRY_DELETED)
+            break;
+        rc = dedupIndexEntrySet(pImage, idxSlot, NULL, DEDUP_INDEX_ENTRY_FREE);
+    }
+    return rc;
+}
+
+
+/**
+ * Internal. Looks up a hash in the index.
+ *
+ * The slots are probed linearly starting at the first slot of the bucket the
+ * hash belongs to, so most lookups only need a single bucket.
+ *
+ * @returns VBox status code.
+ * @param   pImage      The image instance data.
+ * @param   pbHash      The hash to look for.
+ * @param   pidxSlot    Where to store the slot holding the hash if found, or
+ *                      the slot to insert the hash at if not.
+ * @param   pidxBlock   Where to store the store block with the data, or
+ *                      UINT32_MAX if the hash is not in the index.
+ */
+static int dedupIndexLookup(PDEDUPIMAGE pImage, const uint8_t *pbHash, uint32_t *pidxSlot,
+                            uint32_t *pidxBlock)
+{
+    uint64_t u64Hash;
+    uint32_t idxSlotFree = UINT32_MAX;
+    uint32_t iBucket;
+
+    memcpy(&u64Hash, pbHash, sizeof(u64Hash));
+    iBucket = (uint32_t)(RT_LE2H_U64(u64Hash) % pImage->cIndexBuckets);
+    for (uint32_t cBuckets = 0; cBuckets < pImage->cIndexBuckets; cBuckets++)
+    {
+        PDEDUPINDEXBUCKET pBucket;
+        int rc = dedupIndexBucketGet(pImage, iBucket, &pBucket);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        for (unsigned i = 0; i < DEDUP_INDEX_BUCKET_ENTRIES; i++)
+        {
+            uint32_t idxSlot = iBucket * DEDUP_INDEX_BUCKET_ENTRIES + i;
+            uint32_t u32Block = RT_LE2H_U32(pBucket->aEntries[i].u32Block);
+
+            if (u32Block == DEDUP_INDEX_ENTRY_FREE)
+            {
+                /* End of the probe sequence, the hash is not there. */
+                *pidxSlot  = idxSlotFree != UINT32_MAX ? idxSlotFree : idxSlot;
+                *pidxBlock = UINT32_MAX;
+                return VINF_SUCCESS;
+            }
+
+            /*
+             * Entries of store blocks which were released without the index
+             * being updated (I/O error) are skipped like deleted ones, the
+             * block table tells which slot is current.
+             */
+            if (   u32Block == DEDUP_INDEX_ENTRY_DELETED
+                || u32Block > pImage->cStoreBlocks
+                || pImage->paBlocks[u32Block - 1].cRefs == 0
+                || pImage->paBlocks[u32Block - 1].idxSlot != idxSlot)
+            {
+                if (idxSlotFree == UINT32_MAX)
+                    idxSlotFree = idxSlot;
+            }
+            else if (!memcmp(pBucket->aEntries[i].abHash, pbHash, DEDUP_HASH_SIZE))
+            {
+                *pidxSlot  = idxSlot;
+                *pidxBlock = u32Block - 1;
+                return VINF_SUCCESS;
+            }
+        }
+
+        iBucket = (iBucket + 1) % pImage->cIndexBuckets;
+    }
+
+    /* The index has more slots than there can be store blocks. */
+    AssertReturn(idxSlotFree != UINT32_MAX, VERR_VD_IMAGE_CORRUPTED);
+    *pidxSlot  = idxSlotFree;
+    *pidxBlock = UINT32_MAX;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Flush image data to disk.
+ */
+static int dedupFlushImage(PDEDUPIMAGE pImage)
+{
+    if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+        return VINF_SUCCESS;
+
+    /* All metadata is written through, only the file needs flushing. */
+    int rc = vdIfIoIntFileFlushSync(pImage->pIfIo, pImage->pStorage);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* Nothing on the disk references the released blocks anymore (the tables might not be loaded yet). */
+    while (   pImage->paBlocks
+           && pImage->idxBlockFreePending != UINT32_MAX)
+    {
+        uint32_t idxBlock = pImage->idxBlockFreePending;
+
+        pImage->idxBlockFreePending = pImage->paBlocks[idxBlock].idxSlot;
+        pImage->paBlocks[idxBlock].idxSlot = pImage->idxBlockFree;
+        pImage->idxBlockFree = idxBlock;
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Allocates a store block, recycling free blocks first.
+ *
+ * The new block has one reference and is not indexed yet.
+ */
+static int dedupStoreBlockAlloc(PDEDUPIMAGE pImage, uint32_t *pidxBlock)
+{
+    uint32_t idxBlock = pImage->idxBlockFree;
+
+    /* Every virtual block plus the one being replaced during a write. */
+    if (   idxBlock == UINT32_MAX
+        && pImage->cStoreBlocks > pImage->cBlocks
+        && pImage->idxBlockFreePending != UINT32_MAX)
+    {
+        /* The store is full, make the released blocks reusable. */
+        int rc = dedupFlushImage(pImage);
+        if (RT_FAILURE(rc))
+            return rc;
+        idxBlock = pImage->idxBlockFree;
+    }
+
+    if (idxBlock != UINT32_MAX)
+        pImage->idxBlockFree = pImage->paBlocks[idxBlock].idxSlot;
+    else
+    {
+        AssertReturn(pImage->cStoreBlocks <= pImage->cBlocks, VERR_VD_IMAGE_CORRUPTED);
+
+        if (pImage->cStoreBlocks == pImage->cStoreBlocksAlloc)
+        {
+            uint32_t cNew = RT_MIN(RT_MAX(pImage->cStoreBlocksAlloc * 2, _4K), pImage->cBlocks + 1);
+            PDEDUPBLOCK paNew = (PDEDUPBLOCK)RTMemRealloc(pImage->paBlocks, cNew * sizeof(DEDUPBLOCK));
+            if (!paNew)
+                return VERR_NO_MEMORY;
+            pImage->paBlocks          = paNew;
+            pImage->cStoreBlocksAlloc = cNew;
+        }
+        idxBlock = pImage->cStoreBlocks++;
+    }
+
+    pImage->paBlocks[idxBlock].cRefs   = 1;
+    pImage->paBlocks[idxBlock].idxSlot = DEDUP_BLOCK_TBL_FREE;
+    pImage->cStoreBlocksUsed++;
+    *pidxBlock = idxBlock;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Drops a reference to a store block, removing the block from the
+ * index and putting it on the pending free list when it was the last one.
+ */
+static int dedupStoreBlockRelease(PDEDUPIMAGE pImage, uint32_t idxBlock)
+{
+    PDEDUPBLOCK pBlock = &pImage->paBlocks[idxBlock];
+    int rc = VINF_SUCCESS;
+
+    Assert(pBlock->cRefs > 0);
+    if (--pBlock->cRefs)
+        return VINF_SUCCESS;
+
+    /* The index entry goes first so it never references a recycled block. */
+    if (pBlock->idxSlot != DEDUP_BLOCK_TBL_FREE)
+        rc = dedupIndexEntryDelete(pImage, pBlock->idxSlot);
+    if (RT_SUCCESS(rc))
+        rc = dedupBlockTblWrite(pImage, idxBlock);
+
+    /*
+     * Recycle the block even on failure, the lookup skips stale entries. It must
+     * not be overwritten before the changes referencing other blocks are flushed.
+     */
+    pBlock->idxSlot = pImage->idxBlockFreePending;
+    pImage->idxBlockFreePending = idxBlock;
+    pImage->cStoreBlocksUsed--;
+    return rc;
+}
+
+/**
+ * Internal. Stores the data of a complete virtual block.
+ *
+ * The data is looked up in the index and only written to the store if it
+ * isn't there already. The write order is store block, block table, index
+ * and finally the block map.
+ *
+ * @returns VBox status code.
+ * @param   pImage      The image instance data.
+ * @param   iBlock      The virtual block.
+ * @param   pbData      The block data.
+ */
+static int dedupBlockStore(PDEDUPIMAGE pImage, uint32_t iBlock, const uint8_t *pbData)
+{
+    uint32_t u32Old = pImage->paMap[iBlock];
+    uint32_t u32New = DEDUP_MAP_ZERO;
+    int rc = VINF_SUCCESS;
+
+    if (!ASMMemIsZero(pbData, pImage->cbBlock))
+    {
+        uint8_t abHash[RTSHA256_HASH_SIZE];
+        uint32_t idxSlot;
+        uint32_t idxBlock;
+
+        RTSha256(pbData, pImage->cbBlock, abHash);
+        rc = dedupIndexLookup(pImage, abHash, &idxSlot, &idxBlock);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        if (idxBlock != UINT32_MAX)
+        {
+            pImage->cWritesDeduped++;
+            if (idxBlock + 1 == u32Old)
+                return VINF_SUCCESS;
+            pImage->paBlocks[idxBlock].cRefs++;
+        }
+        else
+        {
+            rc = dedupStoreBlockAlloc(pImage, &idxBlock);
+            if (RT_FAILURE(rc))
+                return rc;
+
+            rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage,
+                                        dedupStoreBlockOffset(pImage, idxBlock),
+                                        pbData, pImage->cbBlock);
+            if (RT_SUCCESS(rc))
+            {
+                pImage->paBlocks[idxBlock].idxSlot = idxSlot;
+                rc = dedupBlockTblWrite(pImage, idxBlock);
+            }
+            if (RT_SUCCESS(rc))
+                rc = dedupIndexEntrySet(pImage, idxSlot, abHash, idxBlock + 1);
+            if (RT_FAILURE(rc))
+            {
+                dedupStoreBlockRelease(pImage, idxBlock);
+                return rc;
+            }
+            pImage->cWritesStored++;
+        }
+        u32New = idxBlock + 1;
+    }
+    else if (u32Old == DEDUP_MAP_ZERO)
+        return VINF_SUCCESS;
+
+    pImage->paMap[iBlock] = u32New;
+    rc = dedupMapWrite(pImage, iBlock);
+    if (RT_FAILURE(rc))
+    {
+        pImage->paMap[iBlock] = u32Old;
+        if (u32New != DEDUP_MAP_ZERO)
+            dedupStoreBlockRelease(pImage, u32New - 1);
+        return rc;
+    }
+
+    if (u32New == DEDUP_MAP_ZERO)
+        pImage->cBlocksZero++;
+    else
+        pImage->cBlocksMapped++;
+
+    if (u32Old == DEDUP_MAP_ZERO)
+        pImage->cBlocksZero--;
+    else if (u32Old != DEDUP_MAP_FREE)
+    {
+        pImage->cBlocksMapped--;
+        rc = dedupStoreBlockRelease(pImage, u32Old - 1);
+    }
+
+    return rc;
+}
+
+/**
+ * Internal. Loads the block map and block table, recomputes the reference
+ * counts and cleans up after an interrupted write.
+ */
+static int dedupLoadTables(PDEDUPIMAGE pImage)
+{
+    uint64_t cbFile;
+    int rc = vdIfIoIntFileGetSize(pImage->pIfIo, pImage->pStorage, &cbFile);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* A partially written last block still counts, its map entry is not set yet. */
+    uint64_t cStoreBlocks = 0;
+    if (cbFile > pImage->offData)
+        cStoreBlocks = (cbFile - pImage->offData + pImage->cbBlock - 1) / pImage->cbBlock;
+    if (cStoreBlocks > (uint64_t)pImage->cBlocks + 1)
+        return vdIfError(pImage->pIfError, VERR_VD_IMAGE_CORRUPTED, RT_SRC_POS,
+                         N_("DEDUP: image '%s' has more store blocks than the disk has blocks"),
+                         pImage->pszFilename);
+    pImage->cStoreBlocks      = (uint32_t)cStoreBlocks;
+    pImage->cStoreBlocksAlloc = RT_MAX(pImage->cStoreBlocks, 1);
+    pImage->idxBlockFree        = UINT32_MAX;
+    pImage->idxBlockFreePending = UINT32_MAX;
+
+    pImage->paMap    = (uint32_t *)RTMemAlloc(pImage->cBlocks * sizeof(uint32_t));
+    pImage->paBlocks = (PDEDUPBLOCK)RTMemAllocZ(pImage->cStoreBlocksAlloc * sizeof(DEDUPBLOCK));
+    if (!pImage->paMap || !pImage->paBlocks)
+        return VERR_NO_MEMORY;
+
+    rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, pImage->offMap,
+                               pImage->paMap, pImage->cBlocks * sizeof(uint32_t));
+    if (RT_FAILURE(rc))
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                         N_("DEDUP: reading the block map of image '%s' failed"), pImage->pszFilename);
+
+    if (pImage->cStoreBlocks)
+    {
+        uint32_t *pau32Tbl = (uint32_t *)RTMemAlloc(pImage->cStoreBlocks * sizeof(uint32_t));
+        if (!pau32Tbl)
+            return VERR_NO_MEMORY;
+        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, pImage->offBlockTbl,
+                                   pau32Tbl, pImage->cStoreBlocks * sizeof(uint32_t));
+        if (RT_SUCCESS(rc))
+        {
+            uint64_t cSlots = (uint64_t)pImage->cIndexBuckets * DEDUP_INDEX_BUCKET_ENTRIES;
+            for (uint32_t i = 0; i < pImage->cStoreBlocks; i++)
+            {
+                uint32_t idxSlot = RT_LE2H_U32(pau32Tbl[i]);
+                pImage->paBlocks[i].idxSlot = idxSlot < cSlots ? idxSlot : DEDUP_BLOCK_TBL_FREE;
+            }
+        }
+        RTMemFree(pau32Tbl);
+        if (RT_FAILURE(rc))
+            return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                             N_("DEDUP: reading the block table of image '%s' failed"), pImage->pszFilename);
+    }
+
+    /* The block map is authoritative, count the references from it. */
+    pImage->cBlocksMapped    = 0;
+    pImage->cBlocksZero      = 0;
+    pImage->cStoreBlocksUsed = 0;
+    for (uint32_t i = 0; i < pImage->cBlocks; i++)
+    {
+        uint32_t u32 = RT_LE2H_U32(pImage->paMap[i]);
+        pImage->paMap[i] = u32;
+        if (u32 == DEDUP_MAP_ZERO)
+            pImage->cBlocksZero++;
+        else if (u32 != DEDUP_MAP_FREE)
+        {
+            if (u32 > pImage->cStoreBlocks)
+                return vdIfError(pImage->pIfError, VERR_VD_IMAGE_CORRUPTED, RT_SRC_POS,
+                                 N_("DEDUP: block %u of image '%s' references a non-existing store block"),
+                                 i, pImage->pszFilename);
+            pImage->paBlocks[u32 - 1].cRefs++;
+            pImage->cBlocksMapped++;
+        }
+    }
+
+    /*
+     * Collect the unreferenced blocks. Blocks which are still indexed were
+     * added to the store by a write which didn't make it to the block map.
+     * Walking backwards puts the lowest block at the head of the free list.
+     */
+    for (uint32_t i = pImage->cStoreBlocks; i-- > 0;)
+    {
+        PDEDUPBLOCK pBlock = &pImage->paBlocks[i];
+        if (pBlock->cRefs)
+        {
+            pImage->cStoreBlocksUsed++;
+            continue;
+        }
+
+        if (   pBlock->idxSlot != DEDUP_BLOCK_TBL_FREE
+            && !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        {
+            PDEDUPINDEXBUCKET pBucket;
+            rc = dedupIndexBucketGet(pImage, pBlock->idxSlot / DEDUP_INDEX_BUCKET_ENTRIES, &pBucket);
+            if (   RT_SUCCESS(rc)
+                && RT_LE2H_U32(pBucket->aEntries[pBlock->idxSlot % DEDUP_INDEX_BUCKET_ENTRIES].u32Block) == i + 1)
+                rc = dedupIndexEntryDelete(pImage, pBlock->idxSlot);
+            if (RT_SUCCESS(rc))
+                rc = dedupBlockTblWrite(pImage, i);
+            if (RT_FAILURE(rc))
+                return rc;
+            LogRel(("DEDUP: Removed unreferenced store block %u of image '%s' from the index\n",
+                    i, pImage->pszFilename));
+        }
+
+        pBlock->idxSlot = pImage->idxBlockFree;
+        pImage->idxBlockFree = i;
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Free all allocated space for representing an image except pImage,
+ * and optionally delete the image from disk.
+ */
+static int dedupFreeImage(PDEDUPIMAGE pImage, bool fDelete)
+{
+    int rc = VINF_SUCCESS;
+
+    /* Freeing a never allocated image (e.g. because the open failed) is
+     * not signalled as an error. After all nothing bad happens. */
+    if (pImage)
+    {
+        if (pImage->pStorage)
+        {
+            /* No point updating the file that is deleted anyway. */
+            if (!fDelete)
+                dedupFlushImage(pImage);
+
+            if (   pImage->paMap
+                && !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+                && (pImage->cWritesDeduped || pImage->cWritesStored))
+            {
+                uint32_t uRatio = dedupRatioPercent(pImage);
+                LogRel(("DEDUP: Image '%s': %u blocks in %u store blocks (ratio %u.%02u), %u zero blocks; "
+                        "%llu block writes deduplicated, %llu stored\n",
+                        pImage->pszFilename, pImage->cBlocksMapped, pImage->cStoreBlocksUsed,
+                        uRatio / 100, uRatio % 100, pImage->cBlocksZero,
+                        pImage->cWritesDeduped, pImage->cWritesStored));
+            }
+
+            rc = vdIfIoIntFileClose(pImage->pIfIo, pImage->pStorage);
+            pImage->pStorage = NULL;
+        }
+
+        dedupIndexCacheDestroy(pImage);
+
+        if (pImage->paMap)
+        {
+            RTMemFree(pImage->paMap);
+            pImage->paMap = NULL;
+        }
+
+        if (pImage->paBlocks)
+        {
+            RTMemFree(pImage->paBlocks);
+            pImage->paBlocks = NULL;
+        }
+
+        if (pImage->pbBlock)
+        {
+            RTMemFree(pImage->pbBlock);
+            pImage->pbBlock = NULL;
+        }
+
+        pImage->cWritesDeduped    = 0;
+        pImage->cWritesStored     = 0;
+        pImage->cIndexCacheHits   = 0;
+        pImage->cIndexCacheMisses = 0;
+
+        if (fDelete && pImage->pszFilename)
+            vdIfIoIntFileDelete(pImage->pIfIo, pImage->pszFilename);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Internal. Validates the header and copies it into the image instance data.
+ */
+static int dedupHeaderLoad(PDEDUPIMAGE pImage, PDedupHeader pHdr, uint64_t cbFile)
+{
+    uint32_t cbBlock = RT_LE2H_U32(pHdr->cbBlock);
+    uint64_t cbDisk  = RT_LE2H_U64(pHdr->cbDisk);
+    uint32_t cBlocks = RT_LE2H_U32(pHdr->cBlocks);
+    uint32_t cIndexBuckets = RT_LE2H_U32(pHdr->cIndexBuckets);
+
+    if (   RT_LE2H_U32(pHdr->u32Magic) != DEDUP_HDR_MAGIC
+        || RT_LE2H_U32(pHdr->u32Version) != DEDUP_HDR_VERSION
+        || RT_LE2H_U32(pHdr->cbHeader) < sizeof(DedupHeader))
+        return vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                         N_("DEDUP: invalid header in image '%s'"), pImage->pszFilename);
+
+    if (   cbBlock < DEDUP_BLOCK_SIZE_MIN
+        || cbBlock > DEDUP_BLOCK_SIZE_MAX
+        || !RT_IS_POWER_OF_TWO(cbBlock)
+        || !cbDisk
+        || cBlocks > DEDUP_BLOCKS_MAX
+        || cBlocks != (cbDisk + cbBlock - 1) / cbBlock
+        || (uint64_t)cIndexBuckets * DEDUP_INDEX_BUCKET_ENTRIES <= cBlocks
+        || (uint64_t)cIndexBuckets * DEDUP_INDEX_BUCKET_ENTRIES > UINT32_MAX)
+        return vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                         N_("DEDUP: invalid disk geometry in the header of image '%s'"), pImage->pszFilename);
+
+    pImage->cbBlock       = cbBlock;
+    pImage->cBlocks       = cBlocks;
+    pImage->cIndexBuckets = cIndexBuckets;
+    pImage->offMap        = RT_LE2H_U64(pHdr->offMap);
+    pImage->offBlockTbl   = RT_LE2H_U64(pHdr->offBlockTbl);
+    pImage->offIndex      = RT_LE2H_U64(pHdr->offIndex);
+    pImage->offData       = RT_LE2H_U64(pHdr->offData);
+
+    /* The regions must follow each other without overlapping. */
+    if (   pImage->offMap < sizeof(DedupHeader)
+        || pImage->offBlockTbl < pImage->offMap + (uint64_t)cBlocks * sizeof(uint32_t)
+        || pImage->offIndex < pImage->offBlockTbl + ((uint64_t)cBlocks + 1) * sizeof(uint32_t)
+        || pImage->offData < pImage->offIndex + (uint64_t)cIndexBuckets * DEDUP_INDEX_BUCKET_SIZE
+        || pImage->offData > cbFile)
+        return vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                         N_("DEDUP: invalid region layout in the header of image '%s'"), pImage->pszFilename);
+
+    pImage->cbSize      = cbDisk;
+    pImage->uImageFlags = RT_LE2H_U32(pHdr->fFlags) & DEDUP_HDR_F_DIFF ? VD_IMAGE_FLAGS_DIFF : VD_IMAGE_FLAGS_NONE;
+    pImage->ImageUuid              = pHdr->UuidImage;
+    pImage->ModificationUuid       = pHdr->UuidModification;
+    pImage->ParentUuid             = pHdr->UuidParent;
+    pImage->ParentModificationUuid = pHdr->UuidParentModification;
+    pImage->PCHSGeometry.cCylinders = RT_LE2H_U32(pHdr->cPCHSCylinders);
+    pImage->PCHSGeometry.cHeads     = RT_LE2H_U32(pHdr->cPCHSHeads);
+    pImage->PCHSGeometry.cSectors   = RT_LE2H_U32(pHdr->cPCHSSectors);
+    pImage->LCHSGeometry.cCylinders = RT_LE2H_U32(pHdr->cLCHSCylinders);
+    pImage->LCHSGeometry.cHeads     = RT_LE2H_U32(pHdr->cLCHSHeads);
+    pImage->LCHSGeometry.cSectors   = RT_LE2H_U32(pHdr->cLCHSSectors);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Sets up the in-memory state needed for I/O once the header is
+ * loaded.
+ */
+static int dedupImageSetup(PDEDUPIMAGE pImage)
+{
+    int rc = dedupIndexCacheInit(pImage);
+    if (RT_SUCCESS(rc))
+        rc = dedupLoadTables(pImage);
+    if (   RT_SUCCESS(rc)
+        && !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+    {
+        pImage->pbBlock = (uint8_t *)RTMemAlloc(pImage->cbBlock);
+        if (!pImage->pbBlock)
+            rc = VERR_NO_MEMORY;
+    }
+    return rc;
+}
+
+/**
+ * Internal: Open an image, constructing all necessary data structures.
+ */
+static int dedupOpenImage(PDEDUPIMAGE pImage, unsigned uOpenFlags)
+{
+    int rc;
+    uint64_t cbFile;
+    DedupHeader Hdr;
+
+    pImage->uOpenFlags = uOpenFlags;
+    pImage->pIfError = VDIfErrorGet(pImage->pVDIfsDisk);
+    pImage->pIfIo = VDIfIoIntGet(pImage->pVDIfsImage);
+    AssertPtrReturn(pImage->pIfIo, VERR_INVALID_PARAMETER);
+
+    rc = vdIfIoIntFileOpen(pImage->pIfIo, pImage->pszFilename,
+                           VDOpenFlagsToFileOpenFlags(uOpenFlags, false /* fCreate */),
+                           &pImage->pStorage);
+    if (RT_SUCCESS(rc))
+        rc = vdIfIoIntFileGetSize(pImage->pIfIo, pImage->pStorage, &cbFile);
+    if (RT_SUCCESS(rc) && cbFile < sizeof(Hdr))
+        rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                       N_("DEDUP: image '%s' is too small"), pImage->pszFilename);
+    if (RT_SUCCESS(rc))
+        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, 0, &Hdr, sizeof(Hdr));
+    if (RT_SUCCESS(rc))
+        rc = dedupHeaderLoad(pImage, &Hdr, cbFile);
+    if (   RT_SUCCESS(rc)
+        && !(uOpenFlags & VD_OPEN_FLAGS_INFO))
+        rc = dedupImageSetup(pImage);
+
+    if (RT_FAILURE(rc))
+        dedupFreeImage(pImage, false);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Internal: Create a dedup image.
+ */
+static int dedupCreateImage(PDEDUPIMAGE pImage, uint64_t cbSize,
+                            unsigned uImageFlags, PCVDGEOMETRY pPCHSGeometry,
+                            PCVDGEOMETRY pLCHSGeometry, PCRTUUID pUuid,
+                            unsigned uOpenFlags, PFNVDPROGRESS pfnProgress,
+                            void *pvUser, unsigned uPercentStart,
+                            unsigned uPercentSpan)
+{
+    int rc;
+    uint64_t cBlocks;
+    uint64_t cIndexBuckets;
+
+    pImage->pIfError = VDIfErrorGet(pImage->pVDIfsDisk);
+    pImage->pIfIo = VDIfIoIntGet(pImage->pVDIfsImage);
+    AssertPtrReturn(pImage->pIfIo, VERR_INVALID_PARAMETER);
+
+    if (uImageFlags & VD_IMAGE_FLAGS_FIXED)
+        return vdIfError(pImage->pIfError, VERR_VD_INVALID_TYPE, RT_SRC_POS,
+                         N_("DEDUP: cannot create fixed image '%s'"), pImage->pszFilename);
+
+    cBlocks = (cbSize + DEDUP_BLOCK_SIZE_DEFAULT - 1) / DEDUP_BLOCK_SIZE_DEFAULT;
+    if (!cBlocks || cBlocks > DEDUP_BLOCKS_MAX)
+        return vdIfError(pImage->pIfError, VERR_VD_INVALID_SIZE, RT_SRC_POS,
+                         N_("DEDUP: invalid size %llu for image '%s'"), cbSize, pImage->pszFilename);
+
+    /* Keep the index at most three quarters full. */
+    cIndexBuckets = (cBlocks + 1) * 4 / 3 / DEDUP_INDEX_BUCKET_ENTRIES + 1;
+
+    pImage->uOpenFlags   = uOpenFlags & ~VD_OPEN_FLAGS_READONLY;
+    pImage->uImageFlags  = uImageFlags & VD_IMAGE_FLAGS_DIFF;
+    pImage->cbSize       = cbSize;
+    pImage->PCHSGeometry = *pPCHSGeometry;
+    pImage->LCHSGeometry = *pLCHSGeometry;
+    pImage->ImageUuid    = *pUuid;
+    RTUuidClear(&pImage->ParentUuid);
+    RTUuidClear(&pImage->ParentModificationUuid);
+    RTUuidCreate(&pImage->ModificationUuid);
+
+    pImage->cbBlock       = DEDUP_BLOCK_SIZE_DEFAULT;
+    pImage->cBlocks       = (uint32_t)cBlocks;
+    pImage->cIndexBuckets = (uint32_t)cIndexBuckets;
+    pImage->offMap        = DEDUP_REGION_ALIGNMENT;
+    pImage->offBlockTbl   = pImage->offMap + RT_ALIGN_64(cBlocks * sizeof(uint32_t), DEDUP_REGION_ALIGNMENT);
+    pImage->offIndex      = pImage->offBlockTbl + RT_ALIGN_64((cBlocks + 1) * sizeof(uint32_t), DEDUP_REGION_ALIGNMENT);
+    pImage->offData       = pImage->offIndex + cIndexBuckets * DEDUP_INDEX_BUCKET_SIZE;
+
+    rc = vdIfIoIntFileOpen(pImage->pIfIo, pImage->pszFilename,
+                           VDOpenFlagsToFileOpenFlags(pImage->uOpenFlags, true /* fCreate */),
+                           &pImage->pStorage);
+    if (RT_FAILURE(rc))
+    {
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("DEDUP: cannot create image '%s'"), pImage->pszFilename);
+        goto out;
+    }
+
+    /* The tables are all zero initially, extending the file takes care of that. */
+    rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pImage->offData);
+    if (RT_SUCCESS(rc))
+        rc = dedupHeaderWrite(pImage);
+    if (RT_FAILURE(rc))
+    {
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("DEDUP: cannot write the header of image '%s'"), pImage->pszFilename);
+        goto out;
+    }
+
+    if (pfnProgress)
+        pfnProgress(pvUser, uPercentStart + uPercentSpan * 98 / 100);
+
+    rc = dedupImageSetup(pImage);
+    if (RT_SUCCESS(rc))
+        rc = dedupFlushImage(pImage);
+
+out:
+    if (RT_SUCCESS(rc) && pfnProgress)
+        pfnProgress(pvUser, uPercentStart + uPercentSpan);
+
+    if (RT_FAILURE(rc))
+        dedupFreeImage(pImage, rc != VERR_ALREADY_EXISTS);
+    return rc;
+}
+
+
+/** @copydoc VBOXHDDBACKEND::pfnCheckIfValid */
+static int dedupCheckIfValid(const char *pszFilename, PVDINTERFACE pVDIfsDisk,
+                             PVDINTERFACE pVDIfsImage, VDTYPE *penmType)
+{
+    LogFlowFunc(("pszFilename=\"%s\" pVDIfsDisk=%#p pVDIfsImage=%#p\n", pszFilename, pVDIfsDisk, pVDIfsImage));
+    PVDIOSTORAGE pStorage = NULL;
+    uint64_t cbFile;
+    DedupHeader Hdr;
+    int rc;
+
+    PVDINTERFACEIOINT pIfIo = VDIfIoIntGet(pVDIfsImage);
+    AssertPtrReturn(pIfIo, VERR_INVALID_PARAMETER);
+
+    if (   !VALID_PTR(pszFilename)
+        || !*pszFilename)
+        return VERR_INVALID_PARAMETER;
+
+    rc = vdIfIoIntFileOpen(pIfIo, pszFilename,
+                           VDOpenFlagsToFileOpenFlags(VD_OPEN_FLAGS_READONLY,
+                                                      false /* fCreate */),
+                           &pStorage);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    rc = vdIfIoIntFileGetSize(pIfIo, pStorage, &cbFile);
+    if (RT_SUCCESS(rc) && cbFile < sizeof(Hdr))
+        rc = VERR_VD_GEN_INVALID_HEADER;
+    if (RT_SUCCESS(rc))
+        rc = vdIfIoIntFileReadSync(pIfIo, pStorage, 0, &Hdr, sizeof(Hdr));
+    if (RT_SUCCESS(rc))
+    {
+        if (   RT_LE2H_U32(Hdr.u32Magic) == DEDUP_HDR_MAGIC
+            && RT_LE2H_U32(Hdr.u32Version) == DEDUP_HDR_VERSION)
+            *penmType = VDTYPE_HDD;
+        else
+            rc = VERR_VD_GEN_INVALID_HEADER;
+    }
+
+    vdIfIoIntFileClose(pIfIo, pStorage);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnOpen */
+static int dedupOpen(const char *pszFilename, unsigned uOpenFlags,
+                     PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
+                     VDTYPE enmType, void **ppBackendData)
+{
+    LogFlowFunc(("pszFilename=\"%s\" uOpenFlags=%#x pVDIfsDisk=%#p pVDIfsImage=%#p ppBackendData=%#p\n", pszFilename, uOpenFlags, pVDIfsDisk, pVDIfsImage, ppBackendData));
+    int rc;
+    PDEDUPIMAGE pImage;
+
+    /* Check open flags. All valid flags are supported. */
+    if (uOpenFlags & ~VD_OPEN_FLAGS_MASK)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    /* Check remaining arguments. */
+    if (   !VALID_PTR(pszFilename)
+        || !*pszFilename)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    pImage = (PDEDUPIMAGE)RTMemAllocZ(sizeof(DEDUPIMAGE));
+    if (!pImage)
+    {
+        rc = VERR_NO_MEMORY;
+        goto out;
+    }
+
+    pImage->pszFilename = pszFilename;
+    pImage->pStorage = NULL;
+    pImage->pVDIfsDisk = pVDIfsDisk;
+    pImage->pVDIfsImage = pVDIfsImage;
+
+    rc = dedupOpenImage(pImage, uOpenFlags);
+    if (RT_SUCCESS(rc))
+        *ppBackendData = pImage;
+    else
+        RTMemFree(pImage);
+
+out:
+    LogFlowFunc(("returns %Rrc (pBackendData=%#p)\n", rc, *ppBackendData));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnCreate */
+static int dedupCreate(const char *pszFilename, uint64_t cbSize,
+                       unsigned uImageFlags, const char *pszComment,
+                       PCVDGEOMETRY pPCHSGeometry,
+                       PCVDGEOMETRY pLCHSGeometry, PCRTUUID pUuid,
+                       unsigned uOpenFlags, unsigned uPercentStart,
+                       unsigned uPercentSpan, PVDINTERFACE pVDIfsDisk,
+                       PVDINTERFACE pVDIfsImage,
+                       PVDINTERFACE pVDIfsOperation, void **ppBackendData)
+{
+    LogFlowFunc(("pszFilename=\"%s\" cbSize=%llu uImageFlags=%#x pszComment=\"%s\" pPCHSGeometry=%#p pLCHSGeometry=%#p Uuid=%RTuuid uOpenFlags=%#x uPercentStart=%u uPercentSpan=%u pVDIfsDisk=%#p pVDIfsImage=%#p pVDIfsOperation=%#p ppBackendData=%#p",
+                 pszFilename, cbSize, uImageFlags, pszComment, pPCHSGeometry, pLCHSGeometry, pUuid, uOpenFlags, uPercentStart, uPercentSpan, pVDIfsDisk, pVDIfsImage, pVDIfsOperation, ppBackendData));
+    int rc = VINF_SUCCESS;
+    PDEDUPIMAGE pImage;
+
+    PFNVDPROGRESS pfnProgress = NULL;
+    void *pvUser = NULL;
+    PVDINTERFACEPROGRESS pIfProgress = VDIfProgressGet(pVDIfsOperation);
+    if (pIfProgress)
+    {
+        pfnProgress = pIfProgress->pfnProgress;
+        pvUser = pIfProgress->Core.pvUser;
+    }
+
+    /* Check open flags. All valid flags are supported. */
+    if (uOpenFlags & ~VD_OPEN_FLAGS_MASK)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    /* Check remaining arguments. */
+    if (   !VALID_PTR(pszFilename)
+        || !*pszFilename
+        || !VALID_PTR(pPCHSGeometry)
+        || !VALID_PTR(pLCHSGeometry)
+        || !VALID_PTR(pUuid))
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    pImage = (PDEDUPIMAGE)RTMemAllocZ(sizeof(DEDUPIMAGE));
+    if (!pImage)
+    {
+        rc = VERR_NO_MEMORY;
+        goto out;
+    }
+    pImage->pszFilename = pszFilename;
+    pImage->pStorage = NULL;
+    pImage->pVDIfsDisk = pVDIfsDisk;
+    pImage->pVDIfsImage = pVDIfsImage;
+
+    rc = dedupCreateImage(pImage, cbSize, uImageFlags, pPCHSGeometry,
+                          pLCHSGeometry, pUuid, uOpenFlags, pfnProgress,
+                          pvUser, uPercentStart, uPercentSpan);
+    if (RT_SUCCESS(rc))
+    {
+        /* So far the image is opened in read/write mode. Make sure the
+         * image is opened in read-only mode if the caller requested that. */
+        if (uOpenFlags & VD_OPEN_FLAGS_READONLY)
+        {
+            dedupFreeImage(pImage, false);
+            rc = dedupOpenImage(pImage, uOpenFlags);
+            if (RT_FAILURE(rc))
+            {
+                RTMemFree(pImage);
+                goto out;
+            }
+        }
+        *ppBackendData = pImage;
+    }
+    else
+        RTMemFree(pImage);
+
+out:
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnRename */
+static int dedupRename(void *pBackendData, const char *pszFilename)
+{
+    LogFlowFunc(("pBackendData=%#p pszFilename=%#p\n", pBackendData, pszFilename));
+    int rc = VINF_SUCCESS;
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+
+    /* Check arguments. */
+    if (   !pImage
+        || !pszFilename
+        || !*pszFilename)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    /* Close the image. */
+    rc = dedupFreeImage(pImage, false);
+    if (RT_FAILURE(rc))
+        goto out;
+
+    /* Rename the file. */
+    rc = vdIfIoIntFileMove(pImage->pIfIo, pImage->pszFilename, pszFilename, 0);
+    if (RT_FAILURE(rc))
+    {
+        /* The move failed, try to reopen the original image. */
+        int rc2 = dedupOpenImage(pImage, pImage->uOpenFlags);
+        if (RT_FAILURE(rc2))
+            rc = rc2;
+
+        goto out;
+    }
+
+    /* Update pImage with the new information. */
+    pImage->pszFilename = pszFilename;
+
+    /* Open the old image with new name. */
+    rc = dedupOpenImage(pImage, pImage->uOpenFlags);
+
+out:
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnClose */
+static int dedupClose(void *pBackendData, bool fDelete)
+{
+    LogFlowFunc(("pBackendData=%#p fDelete=%d\n", pBackendData, fDelete));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    rc = dedupFreeImage(pImage, fDelete);
+    RTMemFree(pImage);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnRead */
+static int dedupRead(void *pBackendData, uint64_t uOffset, size_t cbToRead,
+                     PVDIOCTX pIoCtx, size_t *pcbActuallyRead)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu pIoCtx=%#p cbToRead=%zu pcbActuallyRead=%#p\n",
+                 pBackendData, uOffset, pIoCtx, cbToRead, pcbActuallyRead));
+    int rc = VINF_SUCCESS;
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+
+    AssertPtr(pImage);
+    Assert(uOffset % 512 == 0);
+    Assert(cbToRead % 512 == 0);
+
+    if (   uOffset + cbToRead > pImage->cbSize
+        || cbToRead == 0)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    {
+        uint32_t iBlock   = (uint32_t)(uOffset / pImage->cbBlock);
+        uint32_t offBlock = (uint32_t)(uOffset % pImage->cbBlock);
+        uint32_t u32      = pImage->paMap[iBlock];
+
+        cbToRead = RT_MIN(cbToRead, pImage->cbBlock - offBlock);
+        if (u32 == DEDUP_MAP_FREE)
+            rc = VERR_VD_BLOCK_FREE;
+        else if (u32 == DEDUP_MAP_ZERO)
+            vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
+        else
+            rc = vdIfIoIntFileReadUser(pImage->pIfIo, pImage->pStorage,
+                                       dedupStoreBlockOffset(pImage, u32 - 1) + offBlock,
+                                       pIoCtx, cbToRead);
+        *pcbActuallyRead = cbToRead;
+    }
+
+out:
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnWrite */
+static int dedupWrite(void *pBackendData, uint64_t uOffset, size_t cbToWrite,
+                      PVDIOCTX pIoCtx, size_t *pcbWriteProcess, size_t *pcbPreRead,
+                      size_t *pcbPostRead, unsigned fWrite)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu pIoCtx=%#p cbToWrite=%zu pcbWriteProcess=%#p pcbPreRead=%#p pcbPostRead=%#p\n",
+                 pBackendData, uOffset, pIoCtx, cbToWrite, pcbWriteProcess, pcbPreRead, pcbPostRead));
+    int rc = VINF_SUCCESS;
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    uint32_t iBlock;
+    uint32_t offBlock;
+    uint32_t u32Old;
+
+    AssertPtr(pImage);
+    Assert(uOffset % 512 == 0);
+    Assert(cbToWrite % 512 == 0);
+
+    if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+    {
+        rc = VERR_VD_IMAGE_READ_ONLY;
+        goto out;
+    }
+
+    /* The last block may be written beyond the disk size in full. */
+    if (   uOffset >= pImage->cbSize
+        || uOffset + cbToWrite > (uint64_t)pImage->cBlocks * pImage->cbBlock
+        || cbToWrite == 0)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    iBlock    = (uint32_t)(uOffset / pImage->cbBlock);
+    offBlock  = (uint32_t)(uOffset % pImage->cbBlock);
+    cbToWrite = RT_MIN(cbToWrite, pImage->cbBlock - offBlock);
+    u32Old    = pImage->paMap[iBlock];
+
+    /* Let the generic code fill in the rest of a new block. */
+    if (   u32Old == DEDUP_MAP_FREE
+        && (   cbToWrite < pImage->cbBlock
+            || (fWrite & VD_WRITE_NO_ALLOC)))
+    {
+        *pcbPreRead  = offBlock;
+        *pcbPostRead = pImage->cbBlock - cbToWrite - offBlock;
+        rc = VERR_VD_BLOCK_FREE;
+        goto out;
+    }
+
+    /* The hash covers the complete block, merge partial writes with the current data. */
+    if (cbToWrite < pImage->cbBlock)
+    {
+        if (u32Old == DEDUP_MAP_ZERO)
+            memset(pImage->pbBlock, 0, pImage->cbBlock);
+        else
+            rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage,
+                                       dedupStoreBlockOffset(pImage, u32Old - 1),
+                                       pImage->pbBlock, pImage->cbBlock);
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        size_t cbCopied = vdIfIoIntIoCtxCopyFrom(pImage->pIfIo, pIoCtx, pImage->pbBlock + offBlock, cbToWrite);
+        Assert(cbCopied == cbToWrite); NOREF(cbCopied);
+        rc = dedupBlockStore(pImage, iBlock, pImage->pbBlock);
+    }
+
+    *pcbPreRead  = 0;
+    *pcbPostRead = 0;
+
+out:
+    if (pcbWriteProcess)
+        *pcbWriteProcess = cbToWrite;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnFlush */
+static int dedupFlush(void *pBackendData, PVDIOCTX pIoCtx)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtr(pImage);
+    NOREF(pIoCtx);
+
+    /* The I/O context is always synchronous, the backend doesn't support async I/O. */
+    rc = dedupFlushImage(pImage);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetVersion */
+static unsigned dedupGetVersion(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+        return DEDUP_HDR_VERSION;
+    else
+        return 0;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetSectorSize */
+static uint32_t dedupGetSectorSize(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    uint32_t cb = 0;
+
+    AssertPtr(pImage);
+
+    if (pImage && pImage->pStorage)
+        cb = 512;
+
+    LogFlowFunc(("returns %u\n", cb));
+    return cb;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetSize */
+static uint64_t dedupGetSize(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    uint64_t cb = 0;
+
+    AssertPtr(pImage);
+
+    if (pImage && pImage->pStorage)
+        cb = pImage->cbSize;
+
+    LogFlowFunc(("returns %llu\n", cb));
+    return cb;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetFileSize */
+static uint64_t dedupGetFileSize(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    uint64_t cb = 0;
+
+    AssertPtr(pImage);
+
+    if (pImage && pImage->pStorage)
+        cb = dedupStoreBlockOffset(pImage, pImage->cStoreBlocks);
+
+    LogFlowFunc(("returns %lld\n", cb));
+    return cb;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetPCHSGeometry */
+static int dedupGetPCHSGeometry(void *pBackendData, PVDGEOMETRY pPCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pPCHSGeometry=%#p\n", pBackendData, pPCHSGeometry));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+    {
+        if (pImage->PCHSGeometry.cCylinders)
+        {
+            *pPCHSGeometry = pImage->PCHSGeometry;
+            rc = VINF_SUCCESS;
+        }
+        else
+            rc = VERR_VD_GEOMETRY_NOT_SET;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc (PCHS=%u/%u/%u)\n", rc, pPCHSGeometry->cCylinders, pPCHSGeometry->cHeads, pPCHSGeometry->cSectors));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetPCHSGeometry */
+static int dedupSetPCHSGeometry(void *pBackendData, PCVDGEOMETRY pPCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pPCHSGeometry=%#p PCHS=%u/%u/%u\n", pBackendData, pPCHSGeometry, pPCHSGeometry->cCylinders, pPCHSGeometry->cHeads, pPCHSGeometry->cSectors));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+    {
+        if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+            rc = VERR_VD_IMAGE_READ_ONLY;
+        else
+        {
+            pImage->PCHSGeometry = *pPCHSGeometry;
+            rc = dedupHeaderWrite(pImage);
+        }
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetLCHSGeometry */
+static int dedupGetLCHSGeometry(void *pBackendData, PVDGEOMETRY pLCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pLCHSGeometry=%#p\n", pBackendData, pLCHSGeometry));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+    {
+        if (pImage->LCHSGeometry.cCylinders)
+        {
+            *pLCHSGeometry = pImage->LCHSGeometry;
+            rc = VINF_SUCCESS;
+        }
+        else
+            rc = VERR_VD_GEOMETRY_NOT_SET;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc (LCHS=%u/%u/%u)\n", rc, pLCHSGeometry->cCylinders, pLCHSGeometry->cHeads, pLCHSGeometry->cSectors));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetLCHSGeometry */
+static int dedupSetLCHSGeometry(void *pBackendData, PCVDGEOMETRY pLCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pLCHSGeometry=%#p LCHS=%u/%u/%u\n", pBackendData, pLCHSGeometry, pLCHSGeometry->cCylinders, pLCHSGeometry->cHeads, pLCHSGeometry->cSectors));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+    {
+        if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+            rc = VERR_VD_IMAGE_READ_ONLY;
+        else
+        {
+            pImage->LCHSGeometry = *pLCHSGeometry;
+            rc = dedupHeaderWrite(pImage);
+        }
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetImageFlags */
+static unsigned dedupGetImageFlags(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    unsigned uImageFlags;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+        uImageFlags = pImage->uImageFlags;
+    else
+        uImageFlags = 0;
+
+    LogFlowFunc(("returns %#x\n", uImageFlags));
+    return uImageFlags;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetOpenFlags */
+static unsigned dedupGetOpenFlags(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    unsigned uOpenFlags;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+        uOpenFlags = pImage->uOpenFlags;
+    else
+        uOpenFlags = 0;
+
+    LogFlowFunc(("returns %#x\n", uOpenFlags));
+    return uOpenFlags;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetOpenFlags */
+static int dedupSetOpenFlags(void *pBackendData, unsigned uOpenFlags)
+{
+    LogFlowFunc(("pBackendData=%#p\n uOpenFlags=%#x", pBackendData, uOpenFlags));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    /* Image must be opened and the new flags must be valid. */
+    if (!pImage || (uOpenFlags & ~(  VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_INFO
+                                   | VD_OPEN_FLAGS_SHAREABLE
+                                   | VD_OPEN_FLAGS_SEQUENTIAL | VD_OPEN_FLAGS_SKIP_CONSISTENCY_CHECKS)))
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    /* Implement this operation via reopening the image. */
+    dedupFreeImage(pImage, false);
+    rc = dedupOpenImage(pImage, uOpenFlags);
+
+out:
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetComment */
+static int dedupGetComment(void *pBackendData, char *pszComment,
+                           size_t cbComment)
+{
+    LogFlowFunc(("pBackendData=%#p pszComment=%#p cbComment=%zu\n", pBackendData, pszComment, cbComment));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+        rc = VERR_NOT_SUPPORTED;
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc comment='%s'\n", rc, pszComment));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetComment */
+static int dedupSetComment(void *pBackendData, const char *pszComment)
+{
+    LogFlowFunc(("pBackendData=%#p pszComment=\"%s\"\n", pBackendData, pszComment));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc;
+
+    AssertPtr(pImage);
+
+    if (pImage)
+    {
+        if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+            rc = VERR_VD_IMAGE_READ_ONLY;
+        else
+            rc = VERR_NOT_SUPPORTED;
+    }
+    else
+        rc = VERR_VD_NOT_OPENED;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Internal. Returns one of the UUIDs of the image.
+ */
+static int dedupUuidGet(PDEDUPIMAGE pImage, PCRTUUID pUuidSrc, PRTUUID pUuid)
+{
+    AssertPtr(pImage);
+
+    if (!pImage)
+        return VERR_VD_NOT_OPENED;
+
+    *pUuid = *pUuidSrc;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal. Changes one of the UUIDs of the image and updates the header.
+ */
+static int dedupUuidSet(PDEDUPIMAGE pImage, PRTUUID pUuidDst, PCRTUUID pUuid)
+{
+    AssertPtr(pImage);
+
+    if (!pImage)
+        return VERR_VD_NOT_OPENED;
+    if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+        return VERR_VD_IMAGE_READ_ONLY;
+
+    *pUuidDst = *pUuid;
+    return dedupHeaderWrite(pImage);
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetUuid */
+static int dedupGetUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidGet(pImage, pImage ? &pImage->ImageUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", rc, pUuid));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetUuid */
+static int dedupSetUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidSet(pImage, pImage ? &pImage->ImageUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetModificationUuid */
+static int dedupGetModificationUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidGet(pImage, pImage ? &pImage->ModificationUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", rc, pUuid));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetModificationUuid */
+static int dedupSetModificationUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidSet(pImage, pImage ? &pImage->ModificationUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetParentUuid */
+static int dedupGetParentUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidGet(pImage, pImage ? &pImage->ParentUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", rc, pUuid));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetParentUuid */
+static int dedupSetParentUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidSet(pImage, pImage ? &pImage->ParentUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnGetParentModificationUuid */
+static int dedupGetParentModificationUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidGet(pImage, pImage ? &pImage->ParentModificationUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", rc, pUuid));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnSetParentModificationUuid */
+static int dedupSetParentModificationUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+    int rc = dedupUuidSet(pImage, pImage ? &pImage->ParentModificationUuid : NULL, pUuid);
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnDump */
+static void dedupDump(void *pBackendData)
+{
+    PDEDUPIMAGE pImage = (PDEDUPIMAGE)pBackendData;
+
+    AssertPtr(pImage);
+    if (pImage)
+    {
+        uint32_t uRatio = dedupRatioPercent(pImage);
+
+        vdIfErrorMessage(pImage->pIfError, "Header: Geometry PCHS=%u/%u/%u LCHS=%u/%u/%u cbBlock=%u cBlocks=%u cIndexBuckets=%u\n",
+                         pImage->PCHSGeometry.cCylinders, pImage->PCHSGeometry.cHeads, pImage->PCHSGeometry.cSectors,
+                         pImage->LCHSGeometry.cCylinders, pImage->LCHSGeometry.cHeads, pImage->LCHSGeometry.cSectors,
+                         pImage->cbBlock, pImage->cBlocks, pImage->cIndexBuckets);
+        vdIfErrorMessage(pImage->pIfError, "Header: uuidCreation={%RTuuid}\n", &pImage->ImageUuid);
+        vdIfErrorMessage(pImage->pIfError, "Header: uuidModification={%RTuuid}\n", &pImage->ModificationUuid);
+        vdIfErrorMessage(pImage->pIfError, "Header: uuidParent={%RTuuid}\n", &pImage->ParentUuid);
+        vdIfErrorMessage(pImage->pIfError, "Header: uuidParentModification={%RTuuid}\n", &pImage->ParentModificationUuid);
+        vdIfErrorMessage(pImage->pIfError, "Store: %u blocks mapped to %u store blocks (%u in the file), dedup ratio %u.%02u, %u zero blocks\n",
+                         pImage->cBlocksMapped, pImage->cStoreBlocksUsed, pImage->cStoreBlocks,
+                         uRatio / 100, uRatio % 100, pImage->cBlocksZero);
+        vdIfErrorMessage(pImage->pIfError, "Store: %llu block writes deduplicated, %llu stored\n",
+                         pImage->cWritesDeduped, pImage->cWritesStored);
+        vdIfErrorMessage(pImage->pIfError, "Index: %u of max %u buckets cached, %llu hits, %llu misses\n",
+                         pImage->cIndexBucketsCached, pImage->cIndexBucketsCachedMax,
+                         pImage->cIndexCacheHits, pImage->cIndexCacheMisses);
+    }
+}
+
+
+
+const VBOXHDDBACKEND g_DedupBackend =
+{
+    /* pszBackendName */
+    "DEDUP",
+    /* cbSize */
+    sizeof(VBOXHDDBACKEND),
+    /* uBackendCaps */
+      VD_CAP_UUID | VD_CAP_CREATE_DYNAMIC | VD_CAP_DIFF
+    | VD_CAP_FILE | VD_CAP_VFS,
+    /* paFileExtensions */
+    s_aDedupFileExtensions,
+    /* paConfigInfo */
+    s_aDedupConfigInfo,
+    /* pfnCheckIfValid */
+    dedupCheckIfValid,
+    /* pfnOpen */
+    dedupOpen,
+    /* pfnCreate */
+    dedupCreate,
+    /* pfnRename */
+    dedupRename,
+    /* pfnClose */
+    dedupClose,
+    /* pfnRead */
+    dedupRead,
+    /* pfnWrite */
+    dedupWrite,
+    /* pfnFlush */
+    dedupFlush,
+    /* pfnDiscard */
+    NULL,
+    /* pfnGetVersion */
+    dedupGetVersion,
+    /* pfnGetSectorSize */
+    dedupGetSectorSize,
+    /* pfnGetSize */
+    dedupGetSize,
+    /* pfnGetFileSize */
+    dedupGetFileSize,
+    /* pfnGetPCHSGeometry */
+    dedupGetPCHSGeometry,
+    /* pfnSetPCHSGeometry */
+    dedupSetPCHSGeometry,
+    /* pfnGetLCHSGeometry */
+    dedupGetLCHSGeometry,
+    /* pfnSetLCHSGeometry */
+    dedupSetLCHSGeometry,
+    /* pfnGetImageFlags */
+    dedupGetImageFlags,
+    /* pfnGetOpenFlags */
+    dedupGetOpenFlags,
+    /* pfnSetOpenFlags */
+    dedupSetOpenFlags,
+    /* pfnGetComment */
+    dedupGetComment,
+    /* pfnSetComment */
+    dedupSetComment,
+    /* pfnGetUuid */
+    dedupGetUuid,
+    /* pfnSetUuid */
+    dedupSetUuid,
+    /* pfnGetModificationUuid */
+    dedupGetModificationUuid,
+    /* pfnSetModificationUuid */
+    dedupSetModificationUuid,
+    /* pfnGetParentUuid */
+    dedupGetParentUuid,
+    /* pfnSetParentUuid */
+    dedupSetParentUuid,
+    /* pfnGetParentModificationUuid */
+    dedupGetParentModificationUuid,
+    /* pfnSetParentModificationUuid */
+    dedupSetParentModificationUuid,
+    /* pfnDump */
+    dedupDump,
+    /* pfnGetTimeStamp */
+    NULL,
+    /* pfnGetParentTimeStamp */
+    NULL,
+    /* pfnSetParentTimeStamp */
+    NULL,
+    /* pfnGetParentFilename */
+    NULL,
+    /* pfnSetParentFilename */
+    NULL,
+    /* pfnComposeLocation */
+    genericFileComposeLocation,
+    /* pfnComposeName */
+    genericFileComposeName,
+    /* pfnCompact */
+    NULL,
+    /* pfnResize */
+    NULL,
+    /* pfnRepair */
+    NULL,
+    /* pfnTraverseMetadata */
+    NULL,
+    /* pfnQueryAllocation */
+    NULL
+};
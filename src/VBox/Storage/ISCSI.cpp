@@ -5554,5 +5554,7 @@ const VBOXHDDBACKEND g_ISCSIBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
+    NULL,
+    /* pfnQueryAllocation */
     NULL
 };
@@ -1299,5 +1299,7 @@ const VBOXHDDBACKEND g_ParallelsBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
+    NULL,
+    /* pfnQueryAllocation */
     NULL
 };
@@ -139,7 +139,7 @@ typedef QCowHeader *PQCowHeader;
  */
 typedef struct QCOWL2CACHEENTRY
 {
-    /** List node for the search list. */
+    /** List node for the hash bucket chain. */
     RTLISTNODE              NodeSearch;
     /** List node for the LRU list. */
     RTLISTNODE              NodeLru;
@@ -151,8 +151,16 @@ typedef struct QCOWL2CACHEENTRY
     uint64_t               *paL2Tbl;
 } QCOWL2CACHEENTRY, *PQCOWL2CACHEENTRY;
 
-/** Maximum amount of memory the cache is allowed to use. */
-#define QCOW_L2_CACHE_MEMORY_MAX (2*_1M)
+/** Default amount of memory the L2 cache is allowed to use, can be changed
+ * with the "L2CacheSize" config key. */
+#define QCOW_L2_CACHE_MEMORY_DEFAULT (2*_1M)
+/** Upper limit for the configurable L2 cache size. */
+#define QCOW_L2_CACHE_MEMORY_MAX     (_1G)
+/** Minimum number of L2 tables the cache can hold regardless of the
+ * configured size. */
+#define QCOW_L2_CACHE_TABLES_MIN     (4)
+/** Minimum number of hash buckets for the L2 cache lookup. */
+#define QCOW_L2_CACHE_BUCKETS_MIN    (16)
 
 /** QCOW default cluster size for image version 2. */
 #define QCOW2_CLUSTER_SIZE_DEFAULT (64*_1K)
@@ -222,10 +230,22 @@ typedef struct QCOWIMAGE
     uint32_t            cL2TableEntries;
     /** Memory occupied by the L2 table cache. */
     size_t              cbL2Cache;
-    /** The sorted L2 entry list used for searching. */
-    RTLISTNODE          ListSearch;
+    /** Maximum amount of memory the L2 table cache may occupy. */
+    size_t              cbL2CacheMax;
+    /** Number of hash buckets, a power of two. */
+    uint32_t            cL2CacheBuckets;
+    /** The hash buckets used for searching, indexed by qcowL2TblCacheHash(). */
+    PRTLISTANCHOR       paL2CacheBuckets;
     /** The LRU L2 entry list used for eviction. */
     RTLISTNODE          ListLru;
+    /** L1 index of the last L2 table lookup, for sequential access detection. */
+    uint32_t            idxL1Last;
+    /** Number of L2 table lookups satisfied by the cache. */
+    uint64_t            cL2CacheHits;
+    /** Number of L2 table lookups which had to read the table from the image. */
+    uint64_t            cL2CacheMisses;
+    /** Number of L2 tables read ahead because of sequential access. */
+    uint64_t            cL2CachePrefetches;
 
     /** Offset of the refcount table. */
     uint64_t            offRefcountTable;
@@ -299,6 +319,16 @@ static const VDFILEEXTENSION s_aQCowFileExtensions[] =
     {NULL,  VDTYPE_INVALID}
 };
 
+/** Default L2 cache size in bytes, keep in sync with QCOW_L2_CACHE_MEMORY_DEFAULT. */
+static const char *s_pszQCowConfigDefaultL2CacheSize = "2097152";
+
+/** Description of all accepted config parameters. */
+static const VDCONFIGINFO s_aQCowConfigInfo[] =
+{
+    { "L2CacheSize",          s_pszQCowConfigDefaultL2CacheSize,         VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
+};
+
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
@@ -482,16 +512,64 @@ static void qcowRefcountTableConvertFromHostEndianess(uint16_t *paTblImg, uint16
     }
 }
 
+/**
+ * Returns the hash bucket index for the given L2 table offset.
+ *
+ * @returns Bucket index.
+ * @param   pImage    The image instance data.
+ * @param   offL2Tbl  Offset of the L2 table.
+ */
+DECLINLINE(uint32_t) qcowL2TblCacheHash(PQCOWIMAGE pImage, uint64_t offL2Tbl)
+{
+    /* L2 tables are cluster aligned, neighbouring tables end up in neighbouring buckets. */
+    return (uint32_t)(offL2Tbl >> pImage->cL2Shift) & (pImage->cL2CacheBuckets - 1);
+}
+
 /**
  * Creates the L2 table cache.
  *
+ * The L2 table size and table masks must be known at this point.
+ *
  * @returns VBox status code.
  * @param   pImage    The image instance data.
  */
 static int qcowL2TblCacheCreate(PQCOWIMAGE pImage)
 {
-    pImage->cbL2Cache = 0;
-    RTListInit(&pImage->ListSearch);
+    uint32_t cbL2CacheMax = QCOW_L2_CACHE_MEMORY_DEFAULT;
+    PVDINTERFACECONFIG pIfConfig = VDIfConfigGet(pImage->pVDIfsImage);
+
+    Assert(pImage->cbL2Table);
+
+    if (pIfConfig)
+    {
+        int rc = VDCFGQueryU32Def(pIfConfig, "L2CacheSize", &cbL2CacheMax,
+                                  QCOW_L2_CACHE_MEMORY_DEFAULT);
+        if (RT_FAILURE(rc))
+            return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                             N_("QCow: configuration error: failed to read L2CacheSize as U32"));
+    }
+
+    pImage->cbL2CacheMax = RT_MIN(cbL2CacheMax, QCOW_L2_CACHE_MEMORY_MAX);
+    pImage->cbL2CacheMax = RT_MAX(pImage->cbL2CacheMax, QCOW_L2_CACHE_TABLES_MIN * pImage->cbL2Table);
+
+    /* One bucket per cached table on average. */
+    size_t cTablesMax = pImage->cbL2CacheMax / pImage->cbL2Table;
+    pImage->cL2CacheBuckets = QCOW_L2_CACHE_BUCKETS_MIN;
+    while (pImage->cL2CacheBuckets < cTablesMax)
+        pImage->cL2CacheBuckets <<= 1;
+
+    pImage->paL2CacheBuckets = (PRTLISTANCHOR)RTMemAllocZ(pImage->cL2CacheBuckets * sizeof(RTLISTANCHOR));
+    if (!pImage->paL2CacheBuckets)
+        return VERR_NO_MEMORY;
+
+    for (uint32_t i = 0; i < pImage->cL2CacheBuckets; i++)
+        RTListInit(&pImage->paL2CacheBuckets[i]);
+
+    pImage->cbL2Cache          = 0;
+    pImage->idxL1Last          = UINT32_MAX;
+    pImage->cL2CacheHits       = 0;
+    pImage->cL2CacheMisses     = 0;
+    pImage->cL2CachePrefetches = 0;
     RTListInit(&pImage->ListLru);
 
     return VINF_SUCCESS;
@@ -508,17 +586,25 @@ static void qcowL2TblCacheDestroy(PQCOWIMAGE pImage)
     PQCOWL2CACHEENTRY pL2Entry = NULL;
     PQCOWL2CACHEENTRY pL2Next  = NULL;
 
-    RTListForEachSafe(&pImage->ListSearch, pL2Entry, pL2Next, QCOWL2CACHEENTRY, NodeSearch)
+    /* Nothing to do if the image failed to open before the cache was created. */
+    if (!pImage->paL2CacheBuckets)
+        return;
+
+    /* Every cached entry is on the LRU list. */
+    RTListForEachSafe(&pImage->ListLru, pL2Entry, pL2Next, QCOWL2CACHEENTRY, NodeLru)
     {
         Assert(!pL2Entry->cRefs);
 
         RTListNodeRemove(&pL2Entry->NodeSearch);
+        RTListNodeRemove(&pL2Entry->NodeLru);
         RTMemPageFree(pL2Entry->paL2Tbl, pImage->cbL2Table);
         RTMemFree(pL2Entry);
     }
 
-    pImage->cbL2Cache       = 0;
-    RTListInit(&pImage->ListSearch);
+    RTMemFree(pImage->paL2CacheBuckets);
+    pImage->paL2CacheBuckets = NULL;
+    pImage->cL2CacheBuckets  = 0;
+    pImage->cbL2Cache        = 0;
     RTListInit(&pImage->ListLru);
 }
 
@@ -531,24 +617,22 @@ static void qcowL2TblCacheDestroy(PQCOWIMAGE pImage)
  */
 static PQCOWL2CACHEENTRY qcowL2TblCacheRetain(PQCOWIMAGE pImage, uint64_t offL2Tbl)
 {
+    PRTLISTANCHOR pBucket = &pImage->paL2CacheBuckets[qcowL2TblCacheHash(pImage, offL2Tbl)];
     PQCOWL2CACHEENTRY pL2Entry = NULL;
 
-    RTListForEach(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch)
+    RTListForEach(pBucket, pL2Entry, QCOWL2CACHEENTRY, NodeSearch)
     {
         if (pL2Entry->offL2Tbl == offL2Tbl)
-            break;
+        {
+            /* Update LRU list. */
+            RTListNodeRemove(&pL2Entry->NodeLru);
+            RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
+            pL2Entry->cRefs++;
+            return pL2Entry;
+        }
     }
 
-    if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch))
-    {
-        /* Update LRU list. */
-        RTListNodeRemove(&pL2Entry->NodeLru);
-        RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
-        pL2Entry->cRefs++;
-        return pL2Entry;
-    }
-    else
-        return NULL;
+    return NULL;
 }
 
 /**
@@ -572,9 +656,8 @@ static void qcowL2TblCacheEntryRelease(PQCOWL2CACHEENTRY pL2Entry)
 static PQCOWL2CACHEENTRY qcowL2TblCacheEntryAlloc(PQCOWIMAGE pImage)
 {
     PQCOWL2CACHEENTRY pL2Entry = NULL;
-    int rc = VINF_SUCCESS;
 
-    if (pImage->cbL2Cache + pImage->cbL2Table <= QCOW_L2_CACHE_MEMORY_MAX)
+    if (pImage->cbL2Cache + pImage->cbL2Table <= pImage->cbL2CacheMax)
     {
         /* Add a new entry. */
         pL2Entry = (PQCOWL2CACHEENTRY)RTMemAllocZ(sizeof(QCOWL2CACHEENTRY));
@@ -604,7 +687,7 @@ static PQCOWL2CACHEENTRY qcowL2TblCacheEntryAlloc(PQCOWIMAGE pImage)
                 break;
         }
 
-        if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch))
+        if (!RTListNodeIsDummy(&pImage->ListLru, pL2Entry, QCOWL2CACHEENTRY, NodeLru))
         {
             RTListNodeRemove(&pL2Entry->NodeSearch);
             RTListNodeRemove(&pL2Entry->NodeLru);
@@ -643,40 +726,66 @@ static void qcowL2TblCacheEntryFree(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2Entr
  */
 static void qcowL2TblCacheEntryInsert(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2Entry)
 {
-    PQCOWL2CACHEENTRY pIt = NULL;
-
     Assert(pL2Entry->offL2Tbl > 0);
 
     /* Insert at the top of the LRU list. */
     RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
 
-    if (RTListIsEmpty(&pImage->ListSearch))
-    {
-        RTListAppend(&pImage->ListSearch, &pL2Entry->NodeSearch);
-    }
-    else
+    RTListAppend(&pImage->paL2CacheBuckets[qcowL2TblCacheHash(pImage, pL2Entry->offL2Tbl)],
+                 &pL2Entry->NodeSearch);
+}
+
+/**
+ * Reads the L2 table following a sequentially accessed one into the cache
+ * before it is needed.
+ *
+ * Only done for synchronous requests, an asynchronous metadata read would stall
+ * the request until the prefetched table arrived.
+ *
+ * @returns nothing, failures are ignored as the table is read on demand later.
+ * @param   pImage    Image instance data.
+ * @param   pIoCtx    The I/O context.
+ * @param   idxL1     The L1 index of the table to prefetch.
+ */
+static void qcowL2TblCachePrefetch(PQCOWIMAGE pImage, PVDIOCTX pIoCtx, uint32_t idxL1)
+{
+    if (   idxL1 >= pImage->cL1TableEntries
+        || !pImage->paL1Table[idxL1]
+        || !vdIfIoIntIoCtxIsSynchronous(pImage->pIfIo, pIoCtx))
+        return;
+
+    uint64_t offL2Tbl = pImage->paL1Table[idxL1];
+    PQCOWL2CACHEENTRY pL2Entry = qcowL2TblCacheRetain(pImage, offL2Tbl);
+    if (!pL2Entry)
     {
-        /* Insert into search list. */
-        pIt = RTListGetFirst(&pImage->ListSearch, QCOWL2CACHEENTRY, NodeSearch);
-        if (pIt->offL2Tbl > pL2Entry->offL2Tbl)
-            RTListPrepend(&pImage->ListSearch, &pL2Entry->NodeSearch);
+        pL2Entry = qcowL2TblCacheEntryAlloc(pImage);
+        if (!pL2Entry)
+            return;
+
+        PVDMETAXFER pMetaXfer;
+        pL2Entry->offL2Tbl = offL2Tbl;
+        int rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pImage->pStorage,
+                                       offL2Tbl, pL2Entry->paL2Tbl,
+                                       pImage->cbL2Table, pIoCtx,
+                                       &pMetaXfer, NULL, NULL);
+        if (RT_SUCCESS(rc))
+        {
+            vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
+#if defined(RT_LITTLE_ENDIAN)
+            qcowTableConvertToHostEndianess(pL2Entry->paL2Tbl, pImage->cL2TableEntries);
+#endif
+            qcowL2TblCacheEntryInsert(pImage, pL2Entry);
+            pImage->cL2CachePrefetches++;
+        }
         else
         {
-            bool fInserted = false;
-
-            RTListForEach(&pImage->ListSearch, pIt, QCOWL2CACHEENTRY, NodeSearch)
-            {
-                Assert(pIt->offL2Tbl != pL2Entry->offL2Tbl);
-                if (pIt->offL2Tbl < pL2Entry->offL2Tbl)
-                {
-                    RTListNodeInsertAfter(&pIt->NodeSearch, &pL2Entry->NodeSearch);
-                    fInserted = true;
-                    break;
-                }
-            }
-             Assert(fInserted);
+            qcowL2TblCacheEntryRelease(pL2Entry);
+            qcowL2TblCacheEntryFree(pImage, pL2Entry);
+            return;
         }
     }
+
+    qcowL2TblCacheEntryRelease(pL2Entry);
 }
 
 /**
@@ -686,18 +795,23 @@ static void qcowL2TblCacheEntryInsert(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2En
  * @returns VBox status code.
  * @param   pImage    Image instance data.
  * @param   pIoCtx    The I/O context.
- * @param   offL2Tbl  The offset of the L2 table in the image.
+ * @param   idxL1     The L1 index of the L2 table.
  * @param   ppL2Entry Where to store the L2 table on success.
  */
-static int qcowL2TblCacheFetch(PQCOWIMAGE pImage, PVDIOCTX pIoCtx, uint64_t offL2Tbl,
+static int qcowL2TblCacheFetch(PQCOWIMAGE pImage, PVDIOCTX pIoCtx, uint32_t idxL1,
                                PQCOWL2CACHEENTRY *ppL2Entry)
 {
     int rc = VINF_SUCCESS;
+    uint64_t offL2Tbl = pImage->paL1Table[idxL1];
+    bool fSequential = idxL1 == pImage->idxL1Last + 1;
+
+    pImage->idxL1Last = idxL1;
 
     /* Try to fetch the L2 table from the cache first. */
     PQCOWL2CACHEENTRY pL2Entry = qcowL2TblCacheRetain(pImage, offL2Tbl);
     if (!pL2Entry)
     {
+        pImage->cL2CacheMisses++;
         pL2Entry = qcowL2TblCacheEntryAlloc(pImage);
 
         if (pL2Entry)
@@ -727,9 +841,16 @@ static int qcowL2TblCacheFetch(PQCOWIMAGE pImage, PVDIOCTX pIoCtx, uint64_t offL
         else
             rc = VERR_NO_MEMORY;
     }
+    else
+        pImage->cL2CacheHits++;
 
     if (RT_SUCCESS(rc))
+    {
+        /* Streaming access, make sure the next table is ready when we get there. */
+        if (fSequential)
+            qcowL2TblCachePrefetch(pImage, pIoCtx, idxL1 + 1);
         *ppL2Entry = pL2Entry;
+    }
 
     return rc;
 }
@@ -844,7 +965,7 @@ static int qcowConvertToImageOffset(PQCOWIMAGE pImage, PVDIOCTX pIoCtx,
     {
         PQCOWL2CACHEENTRY pL2Entry;
 
-        rc = qcowL2TblCacheFetch(pImage, pIoCtx, pImage->paL1Table[idxL1], &pL2Entry);
+        rc = qcowL2TblCacheFetch(pImage, pIoCtx, idxL1, &pL2Entry);
         if (RT_SUCCESS(rc))
         {
             /* Get real file offset. */
@@ -1061,9 +1182,6 @@ static int qcowOpenImage(PQCOWIMAGE pImage, unsigned uOpenFlags)
             pImage->offNextCluster = RT_ALIGN_64(cbFile, 512); /* Align image to sector boundary. */
             Assert(pImage->offNextCluster >= cbFile);
 
-            rc = qcowL2TblCacheCreate(pImage);
-            AssertRC(rc);
-
             if (Header.u32Version == 1)
             {
                 if (!Header.Version.v1.u32CryptMethod)
@@ -1169,7 +1287,11 @@ static int qcowOpenImage(PQCOWIMAGE pImage, unsigned uOpenFlags)
             if (RT_SUCCESS(rc))
             {
                 qcowTableMasksInit(pImage);
+                rc = qcowL2TblCacheCreate(pImage);
+            }
 
+            if (RT_SUCCESS(rc))
+            {
                 /* Allocate L1 table. */
                 pImage->paL1Table = (uint64_t *)RTMemAllocZ(pImage->cbL1Table);
                 if (pImage->paL1Table)
@@ -1843,8 +1965,7 @@ static int qcowWrite(void *pBackendData, uint64_t uOffset, size_t cbToWrite,
                 }
                 else
                 {
-                    rc = qcowL2TblCacheFetch(pImage, pIoCtx, pImage->paL1Table[idxL1],
-                                             &pL2Entry);
+                    rc = qcowL2TblCacheFetch(pImage, pIoCtx, idxL1, &pL2Entry);
                     if (RT_SUCCESS(rc))
                     {
                         PQCOWCLUSTERASYNCALLOC pDataClusterAlloc = NULL;
@@ -2387,6 +2508,9 @@ static void qcowDump(void *pBackendData)
                          pImage->PCHSGeometry.cCylinders, pImage->PCHSGeometry.cHeads, pImage->PCHSGeometry.cSectors,
                          pImage->LCHSGeometry.cCylinders, pImage->LCHSGeometry.cHeads, pImage->LCHSGeometry.cSectors,
                          pImage->cbSize / 512);
+        vdIfErrorMessage(pImage->pIfError, "L2 cache: %zu of %zu bytes used, hits=%llu misses=%llu prefetched=%llu\n",
+                         pImage->cbL2Cache, pImage->cbL2CacheMax, pImage->cL2CacheHits,
+                         pImage->cL2CacheMisses, pImage->cL2CachePrefetches);
     }
 }
 
@@ -2461,6 +2585,68 @@ static int qcowSetParentFilename(void *pBackendData, const char *pszParentFilena
 
 
 
+/** @copydoc VBOXHDDBACKEND::pfnQueryAllocation */
+static DECLCALLBACK(int) qcowQueryAllocation(void *pBackendData, uint64_t uOffset, uint64_t cbRange,
+                                            uint64_t *pcbRange, bool *pfAllocated)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbRange=%llu pcbRange=%#p pfAllocated=%#p\n",
+                 pBackendData, uOffset, cbRange, pcbRange, pfAllocated));
+    PQCOWIMAGE pImage = (PQCOWIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtr(pImage);
+
+    if (   uOffset + cbRange > pImage->cbSize
+        || !cbRange)
+        rc = VERR_INVALID_PARAMETER;
+    else
+    {
+        uint64_t cbL1Span = RT_BIT_64(pImage->cL1Shift);
+        uint64_t cbThisRange = 0;
+        bool fAllocated = false;
+
+        /*
+         * Unused L1 entries cover a whole L2 table worth of clusters. The L2 tables
+         * are only looked at when they are in the cache already, uncached ones
+         * count as allocated to avoid metadata reads here.
+         */
+        while (cbThisRange < cbRange)
+        {
+            uint64_t offCur = uOffset + cbThisRange;
+            uint32_t idxL1, idxL2, offCluster;
+            bool fCurAllocated = true;
+            uint64_t cbCur = cbL1Span - (offCur & (cbL1Span - 1));
+
+            qcowConvertLogicalOffset(pImage, offCur, &idxL1, &idxL2, &offCluster);
+            if (!pImage->paL1Table[idxL1])
+                fCurAllocated = false;
+            else
+            {
+                PQCOWL2CACHEENTRY pL2Entry = qcowL2TblCacheRetain(pImage, pImage->paL1Table[idxL1]);
+                if (pL2Entry)
+                {
+                    fCurAllocated = pL2Entry->paL2Tbl[idxL2] != 0;
+                    cbCur = pImage->cbCluster - offCluster;
+                    qcowL2TblCacheEntryRelease(pL2Entry);
+                }
+            }
+
+            if (!cbThisRange)
+                fAllocated = fCurAllocated;
+            else if (fCurAllocated != fAllocated)
+                break;
+
+            cbThisRange += cbCur;
+        }
+
+        *pcbRange    = RT_MIN(cbThisRange, cbRange);
+        *pfAllocated = fAllocated;
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 const VBOXHDDBACKEND g_QCowBackend =
 {
     /* pszBackendName */
@@ -2472,7 +2658,7 @@ const VBOXHDDBACKEND g_QCowBackend =
     /* paFileExtensions */
     s_aQCowFileExtensions,
     /* paConfigInfo */
-    NULL,
+    s_aQCowConfigInfo,
     /* pfnCheckIfValid */
     qcowCheckIfValid,
     /* pfnOpen */
@@ -2556,5 +2742,7 @@ const VBOXHDDBACKEND g_QCowBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
-    NULL
+    NULL,
+    /* pfnQueryAllocation */
+    qcowQueryAllocation
 };
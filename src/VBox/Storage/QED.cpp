@@ -2599,6 +2599,68 @@ static int qedResize(void *pBackendData, uint64_t cbSize,
 }
 
 
+/** @copydoc VBOXHDDBACKEND::pfnQueryAllocation */
+static DECLCALLBACK(int) qedQueryAllocation(void *pBackendData, uint64_t uOffset, uint64_t cbRange,
+                                            uint64_t *pcbRange, bool *pfAllocated)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbRange=%llu pcbRange=%#p pfAllocated=%#p\n",
+                 pBackendData, uOffset, cbRange, pcbRange, pfAllocated));
+    PQEDIMAGE pImage = (PQEDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtr(pImage);
+
+    if (   uOffset + cbRange > pImage->cbSize
+        || !cbRange)
+        rc = VERR_INVALID_PARAMETER;
+    else
+    {
+        uint64_t cbL1Span = RT_BIT_64(pImage->cL1Shift);
+        uint64_t cbThisRange = 0;
+        bool fAllocated = false;
+
+        /*
+         * Unused L1 entries cover a whole L2 table worth of clusters. The L2 tables
+         * are only looked at when they are in the cache already, uncached ones
+         * count as allocated to avoid metadata reads here.
+         */
+        while (cbThisRange < cbRange)
+        {
+            uint64_t offCur = uOffset + cbThisRange;
+            uint32_t idxL1, idxL2, offCluster;
+            bool fCurAllocated = true;
+            uint64_t cbCur = cbL1Span - (offCur & (cbL1Span - 1));
+
+            qedConvertLogicalOffset(pImage, offCur, &idxL1, &idxL2, &offCluster);
+            if (!pImage->paL1Table[idxL1])
+                fCurAllocated = false;
+            else
+            {
+                PQEDL2CACHEENTRY pL2Entry = qedL2TblCacheRetain(pImage, pImage->paL1Table[idxL1]);
+                if (pL2Entry)
+                {
+                    fCurAllocated = pL2Entry->paL2Tbl[idxL2] != 0;
+                    cbCur = pImage->cbCluster - offCluster;
+                    qedL2TblCacheEntryRelease(pL2Entry);
+                }
+            }
+
+            if (!cbThisRange)
+                fAllocated = fCurAllocated;
+            else if (fCurAllocated != fAllocated)
+                break;
+
+            cbThisRange += cbCur;
+        }
+
+        *pcbRange    = RT_MIN(cbThisRange, cbRange);
+        *pfAllocated = fAllocated;
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 const VBOXHDDBACKEND g_QedBackend =
 {
     /* pszBackendName */
@@ -2694,5 +2756,7 @@ const VBOXHDDBACKEND g_QedBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
-    NULL
+    NULL,
+    /* pfnQueryAllocation */
+    qedQueryAllocation
 };
@@ -1223,5 +1223,7 @@ const VBOXHDDBACKEND g_RawBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
+    NULL,
+    /* pfnQueryAllocation */
     NULL
 };
@@ -39,6 +39,7 @@
 #include <iprt/list.h>
 #include <iprt/avl.h>
 #include <iprt/semaphore.h>
+#include <iprt/thread.h>
 
 #include <VBox/vd-plugin.h>
 
@@ -56,6 +57,11 @@
 /** Buffer size used for merging images. */
 #define VD_MERGE_BUFFER_SIZE    (16 * _1M)
 
+/** Default number of chunks kept in flight when copying images. */
+#define VD_COPY_PIPELINE_DEPTH_DEFAULT 4
+/** Maximum number of chunks kept in flight when copying images. */
+#define VD_COPY_PIPELINE_DEPTH_MAX     16
+
 /** Maximum number of segments in one I/O task. */
 #define VD_IO_TASK_SEGMENTS_MAX 64
 
@@ -595,6 +601,60 @@ typedef struct VDPLUGIN
 /** Pointer to a plugin structure. */
 typedef VDPLUGIN *PVDPLUGIN;
 
+/**
+ * One chunk of the copy pipeline.
+ */
+typedef struct VDCOPYCHUNK
+{
+    /** The buffer holding the data, VD_MERGE_BUFFER_SIZE bytes big. */
+    void              *pvBuf;
+    /** Start offset of the chunk. */
+    uint64_t           uOffset;
+    /** Size of the chunk, may exceed the buffer size for unallocated chunks. */
+    uint64_t           cbChunk;
+    /** Status code of the read. */
+    int                rcRead;
+} VDCOPYCHUNK;
+/** Pointer to a copy pipeline chunk. */
+typedef VDCOPYCHUNK *PVDCOPYCHUNK;
+
+/**
+ * Copy pipeline state shared between the reader thread and the writer.
+ */
+typedef struct VDCOPYPIPELINE
+{
+    /** The disk to read from. */
+    PVBOXHDD           pDiskFrom;
+    /** The image to start reading from. */
+    PVDIMAGE           pImageFrom;
+    /** Overall amount of data to copy. */
+    uint64_t           cbSize;
+    /** Number of images in the source chain to read until the read is cut off. */
+    unsigned           cImagesFromRead;
+    /** Flag whether the data is copied blockwise. */
+    bool               fBlockwiseCopy;
+    /** Flag whether unallocated ranges are skipped without reading them. */
+    bool               fSparse;
+    /** Flag whether the writer stopped and the reader should exit. */
+    volatile bool      fCancelled;
+    /** Number of chunks in the ring. */
+    uint32_t           cChunks;
+    /** Number of chunks committed by the reader so far. */
+    volatile uint32_t  cChunksRead;
+    /** Number of chunks written by the writer so far. */
+    volatile uint32_t  cChunksWritten;
+    /** Event signalled by the reader when a chunk was committed. */
+    RTSEMEVENT         hEvtChunkReady;
+    /** Event signalled by the writer when a slot became free. */
+    RTSEMEVENT         hEvtSlotFree;
+    /** The reader thread. */
+    RTTHREAD           hThreadRead;
+    /** The chunk ring. */
+    PVDCOPYCHUNK       paChunks;
+} VDCOPYPIPELINE;
+/** Pointer to the copy pipeline state. */
+typedef VDCOPYPIPELINE *PVDCOPYPIPELINE;
+
 /** Head of loaded plugin list. */
 static RTLISTANCHOR g_ListPluginsLoaded;
 
@@ -613,6 +673,7 @@ static PCVBOXHDDBACKEND aStaticBackends[] =
     &g_QedBackend,
     &g_QCowBackend,
     &g_VhdxBackend,
+    &g_DedupBackend,
     &g_RawBackend,
     &g_ISCSIBackend
 };
@@ -2306,151 +2367,511 @@ static int vdWriteHelper(PVBOXHDD pDisk, PVDIMAGE pImage, uint64_t uOffset,
 }
 
 /**
- * Internal: Copies the content of one disk to another one applying optimizations
- * to speed up the copy process if possible.
- */
-static int vdCopyHelper(PVBOXHDD pDiskFrom, PVDIMAGE pImageFrom, PVBOXHDD pDiskTo,
-                        uint64_t cbSize, unsigned cImagesFromRead, unsigned cImagesToRead,
-                        bool fSuppressRedundantIo, PVDINTERFACEPROGRESS pIfProgress,
-                        PVDINTERFACEPROGRESS pDstIfProgress)
+ * Internal: Queries the allocation state of a range in an image chain.
+ *
+ * A range is allocated if any image in the chain has data for it. Images
+ * without allocation tracking are considered to be fully allocated.
+ *
+ * @returns VBox status code.
+ * @param   pImage          The image to start with.
+ * @param   cImagesRead     Number of images in the chain to check,
+ *                          a value of 0 checks the whole chain.
+ * @param   uOffset         Offset to start the query at.
+ * @param   cbRange         Maximum number of bytes to check.
+ * @param   pcbRange        Where to store the number of bytes starting at uOffset
+ *                          sharing the same state.
+ * @param   pfAllocated     Where to store whether the range is allocated.
+ */
+static int vdQueryAllocationHelper(PVDIMAGE pImage, unsigned cImagesRead, uint64_t uOffset,
+                                   uint64_t cbRange, uint64_t *pcbRange, bool *pfAllocated)
+{
+    int rc = VINF_SUCCESS;
+    unsigned cImagesToProcess = cImagesRead;
+
+    for (PVDIMAGE pCurrImage = pImage; pCurrImage != NULL; pCurrImage = pCurrImage->pPrev)
+    {
+        uint64_t cbThisRange = cbRange;
+        bool fAllocated = true;
+
+        if (pCurrImage->Backend->pfnQueryAllocation)
+            rc = pCurrImage->Backend->pfnQueryAllocation(pCurrImage->pBackendData, uOffset,
+                                                         cbRange, &cbThisRange, &fAllocated);
+        if (   RT_FAILURE(rc)
+            || fAllocated)
+        {
+            *pcbRange    = cbThisRange;
+            *pfAllocated = true;
+            return rc;
+        }
+
+        /* Only the part free in this image needs to be checked in the parents. */
+        cbRange = cbThisRange;
+
+        if (cImagesToProcess == 1)
+            break;
+        else if (cImagesToProcess > 0)
+            cImagesToProcess--;
+    }
+
+    *pcbRange    = cbRange;
+    *pfAllocated = false;
+    return rc;
+}
+
+/**
+ * Internal: Reads one chunk of data for vdCopyHelper() from the source chain.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_BLOCK_FREE if no image in the chain has data for the chunk
+ *          and the copy is done blockwise or the range is unallocated in the
+ *          whole source chain.
+ * @param   pDiskFrom           The source disk.
+ * @param   pImageFrom          The image to start reading from.
+ * @param   uOffset             Offset to read from.
+ * @param   cbRemaining         Amount of data left to copy.
+ * @param   pvBuf               Where to store the data, VD_MERGE_BUFFER_SIZE bytes big.
+ * @param   pcbThisRead         Where to store the amount of data the chunk covers.
+ *                              Unallocated chunks may be bigger than the buffer.
+ * @param   cImagesFromRead     Number of images in the source chain to read until
+ *                              the read is cut off. A value of 0 disables the cut off.
+ * @param   fBlockwiseCopy      Whether the data is copied blockwise.
+ * @param   fSparse             Whether to skip over unallocated ranges without reading them.
+ */
+static int vdCopyHelperReadChunk(PVBOXHDD pDiskFrom, PVDIMAGE pImageFrom, uint64_t uOffset,
+                                 uint64_t cbRemaining, void *pvBuf, uint64_t *pcbThisRead,
+                                 unsigned cImagesFromRead, bool fBlockwiseCopy, bool fSparse)
 {
     int rc = VINF_SUCCESS;
     int rc2;
-    uint64_t uOffset = 0;
-    uint64_t cbRemaining = cbSize;
-    void *pvBuf = NULL;
-    bool fLockReadFrom = false;
-    bool fLockWriteTo = false;
-    bool fBlockwiseCopy = fSuppressRedundantIo || (cImagesFromRead > 0);
-    unsigned uProgressOld = 0;
+    size_t cbThisRead = (size_t)RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
 
-    LogFlowFunc(("pDiskFrom=%#p pImageFrom=%#p pDiskTo=%#p cbSize=%llu cImagesFromRead=%u cImagesToRead=%u fSuppressRedundantIo=%RTbool pIfProgress=%#p pDstIfProgress=%#p\n",
-                 pDiskFrom, pImageFrom, pDiskTo, cbSize, cImagesFromRead, cImagesToRead, fSuppressRedundantIo, pDstIfProgress, pDstIfProgress));
+    /* Note that we don't attempt to synchronize cross-disk accesses.
+     * It wouldn't be very difficult to do, just the lock order would
+     * need to be defined somehow to prevent deadlocks. Postpone such
+     * magic as there is no use case for this. */
 
-    /* Allocate tmp buffer. */
-    pvBuf = RTMemTmpAlloc(VD_MERGE_BUFFER_SIZE);
-    if (!pvBuf)
-        return rc;
+    rc2 = vdThreadStartRead(pDiskFrom);
+    AssertRC(rc2);
 
-    do
+    if (fSparse)
     {
-        size_t cbThisRead = RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
+        uint64_t cbRange = 0;
+        bool fAllocated = true;
 
-        /* Note that we don't attempt to synchronize cross-disk accesses.
-         * It wouldn't be very difficult to do, just the lock order would
-         * need to be defined somehow to prevent deadlocks. Postpone such
-         * magic as there is no use case for this. */
+        rc = vdQueryAllocationHelper(pImageFrom, cImagesFromRead, uOffset, cbRemaining,
+                                     &cbRange, &fAllocated);
+        if (   RT_SUCCESS(rc)
+            && !fAllocated)
+        {
+            rc2 = vdThreadFinishRead(pDiskFrom);
+            AssertRC(rc2);
 
-        rc2 = vdThreadStartRead(pDiskFrom);
-        AssertRC(rc2);
-        fLockReadFrom = true;
+            *pcbThisRead = cbRange;
+            return VERR_VD_BLOCK_FREE;
+        }
+    }
 
-        if (fBlockwiseCopy)
-        {
-            RTSGSEG SegmentBuf;
-            RTSGBUF SgBuf;
-            VDIOCTX IoCtx;
+    if (fBlockwiseCopy)
+    {
+        RTSGSEG SegmentBuf;
+        RTSGBUF SgBuf;
+        VDIOCTX IoCtx;
 
-            SegmentBuf.pvSeg = pvBuf;
-            SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
-            RTSgBufInit(&SgBuf, &SegmentBuf, 1);
-            vdIoCtxInit(&IoCtx, pDiskFrom, VDIOCTXTXDIR_READ, 0, 0, NULL,
-                        &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
+        SegmentBuf.pvSeg = pvBuf;
+        SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
+        RTSgBufInit(&SgBuf, &SegmentBuf, 1);
+        vdIoCtxInit(&IoCtx, pDiskFrom, VDIOCTXTXDIR_READ, 0, 0, NULL,
+                    &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
 
-            /* Read the source data. */
-            rc = pImageFrom->Backend->pfnRead(pImageFrom->pBackendData,
-                                              uOffset, cbThisRead, &IoCtx,
-                                              &cbThisRead);
+        /* Read the source data. */
+        rc = pImageFrom->Backend->pfnRead(pImageFrom->pBackendData,
+                                          uOffset, cbThisRead, &IoCtx,
+                                          &cbThisRead);
 
-            if (   rc == VERR_VD_BLOCK_FREE
-                && cImagesFromRead != 1)
-            {
-                unsigned cImagesToProcess = cImagesFromRead;
+        if (   rc == VERR_VD_BLOCK_FREE
+            && cImagesFromRead != 1)
+        {
+            unsigned cImagesToProcess = cImagesFromRead;
 
-                for (PVDIMAGE pCurrImage = pImageFrom->pPrev;
-                     pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
-                     pCurrImage = pCurrImage->pPrev)
-                {
-                    rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
-                                                           uOffset, cbThisRead,
-                                                           &IoCtx, &cbThisRead);
-                    if (cImagesToProcess == 1)
-                        break;
-                    else if (cImagesToProcess > 0)
-                        cImagesToProcess--;
-                }
+            for (PVDIMAGE pCurrImage = pImageFrom->pPrev;
+                 pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
+                 pCurrImage = pCurrImage->pPrev)
+            {
+                rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                                  uOffset, cbThisRead,
+                                                  &IoCtx, &cbThisRead);
+                if (cImagesToProcess == 1)
+                    break;
+                else if (cImagesToProcess > 0)
+                    cImagesToProcess--;
             }
         }
-        else
-            rc = vdReadHelper(pDiskFrom, pImageFrom, uOffset, pvBuf, cbThisRead,
-                              false /* fUpdateCache */);
+    }
+    else
+        rc = vdReadHelper(pDiskFrom, pImageFrom, uOffset, pvBuf, cbThisRead,
+                          false /* fUpdateCache */);
 
-        if (RT_FAILURE(rc) && rc != VERR_VD_BLOCK_FREE)
-            break;
+    rc2 = vdThreadFinishRead(pDiskFrom);
+    AssertRC(rc2);
 
-        rc2 = vdThreadFinishRead(pDiskFrom);
+    *pcbThisRead = cbThisRead;
+    return rc;
+}
+
+/**
+ * Internal: Writes one chunk of data read by vdCopyHelperReadChunk() to the
+ * destination disk.
+ *
+ * @returns VBox status code.
+ * @param   pDiskTo             The destination disk.
+ * @param   uOffset             Offset to write to.
+ * @param   pvBuf               The data to write.
+ * @param   cbThisWrite         How much to write.
+ * @param   cImagesToRead       Number of images in the destination chain to read
+ *                              until the read is cut off. A value of 0 disables the cut off.
+ * @param   fBlockwiseCopy      Whether the data is copied blockwise.
+ */
+static int vdCopyHelperWriteChunk(PVBOXHDD pDiskTo, uint64_t uOffset, const void *pvBuf,
+                                  size_t cbThisWrite, unsigned cImagesToRead, bool fBlockwiseCopy)
+{
+    int rc2 = vdThreadStartWrite(pDiskTo);
+    AssertRC(rc2);
+
+    /* Only do collapsed I/O if we are copying the data blockwise. */
+    int rc = vdWriteHelperEx(pDiskTo, pDiskTo->pLast, NULL, uOffset, pvBuf,
+                             cbThisWrite, VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG /* fFlags */,
+                             fBlockwiseCopy ? cImagesToRead : 0);
+
+    rc2 = vdThreadFinishWrite(pDiskTo);
+    AssertRC(rc2);
+    return rc;
+}
+
+/**
+ * Internal: Handles a chunk without any data in the source chain. The
+ * destination needs to be zeroed there unless it is known to be unallocated.
+ *
+ * @returns VBox status code.
+ * @param   pDiskTo             The destination disk.
+ * @param   uOffset             Start offset of the unallocated range.
+ * @param   cbRange             Size of the unallocated range.
+ * @param   pvBuf               Scratch buffer, VD_MERGE_BUFFER_SIZE bytes big.
+ * @param   fBlockwiseCopy      Whether the data is copied blockwise, meaning the
+ *                              destination has the same content as the source
+ *                              wherever the source has no data.
+ */
+static int vdCopyHelperWriteHole(PVBOXHDD pDiskTo, uint64_t uOffset, uint64_t cbRange,
+                                 void *pvBuf, bool fBlockwiseCopy)
+{
+    int rc = VINF_SUCCESS;
+    bool fZeroed = false;
+
+    if (fBlockwiseCopy)
+        return VINF_SUCCESS;
+
+    while (   cbRange
+           && RT_SUCCESS(rc))
+    {
+        uint64_t cbThisRange = cbRange;
+        bool fAllocated = true;
+
+        int rc2 = vdThreadStartRead(pDiskTo);
+        AssertRC(rc2);
+        rc = vdQueryAllocationHelper(pDiskTo->pLast, 0, uOffset, cbRange,
+                                     &cbThisRange, &fAllocated);
+        rc2 = vdThreadFinishRead(pDiskTo);
         AssertRC(rc2);
-        fLockReadFrom = false;
 
-        if (rc != VERR_VD_BLOCK_FREE)
+        if (RT_FAILURE(rc))
         {
-            rc2 = vdThreadStartWrite(pDiskTo);
-            AssertRC(rc2);
-            fLockWriteTo = true;
+            /* Can't tell, overwrite everything. */
+            fAllocated  = true;
+            cbThisRange = cbRange;
+            rc          = VINF_SUCCESS;
+        }
 
-            /* Only do collapsed I/O if we are copying the data blockwise. */
-            rc = vdWriteHelperEx(pDiskTo, pDiskTo->pLast, NULL, uOffset, pvBuf,
-                                 cbThisRead, VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG /* fFlags */,
-                                 fBlockwiseCopy ? cImagesToRead : 0);
+        if (fAllocated)
+        {
+            cbThisRange = RT_MIN(cbThisRange, VD_MERGE_BUFFER_SIZE);
+            if (!fZeroed)
+            {
+                memset(pvBuf, 0, VD_MERGE_BUFFER_SIZE);
+                fZeroed = true;
+            }
+            rc = vdCopyHelperWriteChunk(pDiskTo, uOffset, pvBuf, (size_t)cbThisRange,
+                                        0 /* cImagesToRead */, false /* fBlockwiseCopy */);
+        }
+
+        uOffset += cbThisRange;
+        cbRange -= cbThisRange;
+    }
+
+    return rc;
+}
+
+/**
+ * Internal: Reports the progress of a copy operation to the source and
+ * destination progress interfaces if the percentage changed.
+ *
+ * @returns VBox status code, failure means the operation was cancelled.
+ * @param   uOffset             Current offset.
+ * @param   cbSize              Overall amount of data to copy.
+ * @param   puProgressOld       Where the last reported percentage is kept.
+ * @param   pIfProgress         Source progress interface, optional.
+ * @param   pDstIfProgress      Destination progress interface, optional.
+ */
+static int vdCopyHelperProgress(uint64_t uOffset, uint64_t cbSize, unsigned *puProgressOld,
+                                PVDINTERFACEPROGRESS pIfProgress,
+                                PVDINTERFACEPROGRESS pDstIfProgress)
+{
+    int rc = VINF_SUCCESS;
+    unsigned uProgressNew = uOffset * 99 / cbSize;
+
+    if (uProgressNew != *puProgressOld)
+    {
+        *puProgressOld = uProgressNew;
+
+        if (pIfProgress && pIfProgress->pfnProgress)
+        {
+            rc = pIfProgress->pfnProgress(pIfProgress->Core.pvUser,
+                                          uProgressNew);
             if (RT_FAILURE(rc))
-                break;
+                return rc;
+        }
+        if (pDstIfProgress && pDstIfProgress->pfnProgress)
+            rc = pDstIfProgress->pfnProgress(pDstIfProgress->Core.pvUser,
+                                             uProgressNew);
+    }
 
-            rc2 = vdThreadFinishWrite(pDiskTo);
-            AssertRC(rc2);
-            fLockWriteTo = false;
+    return rc;
+}
+
+/**
+ * Internal: Copy pipeline reader thread. Reads chunks from the source disk
+ * ahead of the writer as long as there are free slots in the ring.
+ */
+static DECLCALLBACK(int) vdCopyPipelineReader(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PVDCOPYPIPELINE pPipe = (PVDCOPYPIPELINE)pvUser;
+    uint64_t uOffset = 0;
+    int rc = VINF_SUCCESS;
+
+    NOREF(hThreadSelf);
+
+    while (   uOffset < pPipe->cbSize
+           && !ASMAtomicReadBool(&pPipe->fCancelled))
+    {
+        /* Wait for a free slot. */
+        if (   ASMAtomicReadU32(&pPipe->cChunksRead) - ASMAtomicReadU32(&pPipe->cChunksWritten)
+            >= pPipe->cChunks)
+        {
+            rc = RTSemEventWait(pPipe->hEvtSlotFree, RT_INDEFINITE_WAIT);
+            AssertRC(rc);
+            continue;
         }
-        else /* Don't propagate the error to the outside */
-            rc = VINF_SUCCESS;
+
+        PVDCOPYCHUNK pChunk = &pPipe->paChunks[pPipe->cChunksRead % pPipe->cChunks];
+        uint64_t cbThisRead = 0;
+
+        rc = vdCopyHelperReadChunk(pPipe->pDiskFrom, pPipe->pImageFrom, uOffset,
+                                   pPipe->cbSize - uOffset, pChunk->pvBuf, &cbThisRead,
+                                   pPipe->cImagesFromRead, pPipe->fBlockwiseCopy,
+                                   pPipe->fSparse);
+        pChunk->uOffset = uOffset;
+        pChunk->cbChunk = cbThisRead;
+        pChunk->rcRead  = rc;
+
+        /* Commit the chunk to the writer. */
+        ASMAtomicIncU32(&pPipe->cChunksRead);
+        RTSemEventSignal(pPipe->hEvtChunkReady);
+
+        if (RT_FAILURE(rc) && rc != VERR_VD_BLOCK_FREE)
+            break;
 
         uOffset += cbThisRead;
-        cbRemaining -= cbThisRead;
+    }
 
-        unsigned uProgressNew = uOffset * 99 / cbSize;
-        if (uProgressNew != uProgressOld)
-        {
-            uProgressOld = uProgressNew;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal: Pipelined variant of vdCopyHelper(). A dedicated thread reads
+ * from the source disk while the calling thread writes the chunks in order
+ * to the destination, keeping up to cChunks chunks in flight.
+ */
+static int vdCopyHelperPipelined(PVBOXHDD pDiskFrom, PVDIMAGE pImageFrom, PVBOXHDD pDiskTo,
+                                 uint64_t cbSize, unsigned cImagesFromRead, unsigned cImagesToRead,
+                                 bool fBlockwiseCopy, bool fSparse, uint32_t cChunks,
+                                 PVDINTERFACEPROGRESS pIfProgress,
+                                 PVDINTERFACEPROGRESS pDstIfProgress)
+{
+    int rc = VINF_SUCCESS;
+    VDCOPYPIPELINE Pipe;
+    unsigned uProgressOld = 0;
+    uint64_t uOffset = 0;
+
+    RT_ZERO(Pipe);
+    Pipe.pDiskFrom       = pDiskFrom;
+    Pipe.pImageFrom      = pImageFrom;
+    Pipe.cbSize          = cbSize;
+    Pipe.cImagesFromRead = cImagesFromRead;
+    Pipe.fBlockwiseCopy  = fBlockwiseCopy;
+    Pipe.fSparse         = fSparse;
+    Pipe.cChunks         = cChunks;
+    Pipe.hEvtChunkReady  = NIL_RTSEMEVENT;
+    Pipe.hEvtSlotFree    = NIL_RTSEMEVENT;
+    Pipe.hThreadRead     = NIL_RTTHREAD;
+
+    Pipe.paChunks = (PVDCOPYCHUNK)RTMemAllocZ(cChunks * sizeof(VDCOPYCHUNK));
+    if (!Pipe.paChunks)
+        return VERR_NO_MEMORY;
 
-            if (pIfProgress && pIfProgress->pfnProgress)
+    for (uint32_t i = 0; i < cChunks && RT_SUCCESS(rc); i++)
+    {
+        Pipe.paChunks[i].pvBuf = RTMemTmpAlloc(VD_MERGE_BUFFER_SIZE);
+        if (!Pipe.paChunks[i].pvBuf)
+            rc = VERR_NO_MEMORY;
+    }
+
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&Pipe.hEvtChunkReady);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&Pipe.hEvtSlotFree);
+    if (RT_SUCCESS(rc))
+        rc = RTThreadCreate(&Pipe.hThreadRead, vdCopyPipelineReader, &Pipe, 0,
+                            RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "VDCopyRd");
+
+    if (RT_SUCCESS(rc))
+    {
+        while (uOffset < cbSize)
+        {
+            /* Wait for the next chunk in order. */
+            if (ASMAtomicReadU32(&Pipe.cChunksRead) == Pipe.cChunksWritten)
             {
-                rc = pIfProgress->pfnProgress(pIfProgress->Core.pvUser,
-                                              uProgressOld);
-                if (RT_FAILURE(rc))
-                    break;
+                rc = RTSemEventWait(Pipe.hEvtChunkReady, RT_INDEFINITE_WAIT);
+                AssertRC(rc);
+                continue;
             }
-            if (pDstIfProgress && pDstIfProgress->pfnProgress)
+
+            PVDCOPYCHUNK pChunk = &Pipe.paChunks[Pipe.cChunksWritten % cChunks];
+            Assert(pChunk->uOffset == uOffset);
+
+            rc = pChunk->rcRead;
+            if (rc != VERR_VD_BLOCK_FREE)
             {
-                rc = pDstIfProgress->pfnProgress(pDstIfProgress->Core.pvUser,
-                                                 uProgressOld);
                 if (RT_FAILURE(rc))
                     break;
+
+                rc = vdCopyHelperWriteChunk(pDiskTo, pChunk->uOffset, pChunk->pvBuf,
+                                            (size_t)pChunk->cbChunk, cImagesToRead, fBlockwiseCopy);
             }
-        }
-    } while (uOffset < cbSize);
+            else /* Don't propagate the error to the outside */
+                rc = vdCopyHelperWriteHole(pDiskTo, pChunk->uOffset, pChunk->cbChunk,
+                                           pChunk->pvBuf, fBlockwiseCopy);
+            if (RT_FAILURE(rc))
+                break;
 
-    RTMemFree(pvBuf);
+            uOffset += pChunk->cbChunk;
 
-    if (fLockReadFrom)
-    {
-        rc2 = vdThreadFinishRead(pDiskFrom);
+            /* Hand the slot back to the reader. */
+            ASMAtomicIncU32(&Pipe.cChunksWritten);
+            RTSemEventSignal(Pipe.hEvtSlotFree);
+
+            rc = vdCopyHelperProgress(uOffset, cbSize, &uProgressOld,
+                                      pIfProgress, pDstIfProgress);
+            if (RT_FAILURE(rc))
+                break;
+        }
+
+        /* Stop the reader if we bailed out early and wait for it to finish. */
+        ASMAtomicWriteBool(&Pipe.fCancelled, true);
+        RTSemEventSignal(Pipe.hEvtSlotFree);
+        int rc2 = RTThreadWait(Pipe.hThreadRead, RT_INDEFINITE_WAIT, NULL);
         AssertRC(rc2);
     }
 
-    if (fLockWriteTo)
+    if (Pipe.hEvtSlotFree != NIL_RTSEMEVENT)
+        RTSemEventDestroy(Pipe.hEvtSlotFree);
+    if (Pipe.hEvtChunkReady != NIL_RTSEMEVENT)
+        RTSemEventDestroy(Pipe.hEvtChunkReady);
+    for (uint32_t i = 0; i < cChunks; i++)
+        if (Pipe.paChunks[i].pvBuf)
+            RTMemTmpFree(Pipe.paChunks[i].pvBuf);
+    RTMemFree(Pipe.paChunks);
+
+    return rc;
+}
+
+/**
+ * Internal: Copies the content of one disk to another one applying optimizations
+ * to speed up the copy process if possible.
+ */
+static int vdCopyHelper(PVBOXHDD pDiskFrom, PVDIMAGE pImageFrom, PVBOXHDD pDiskTo,
+                        uint64_t cbSize, unsigned cImagesFromRead, unsigned cImagesToRead,
+                        bool fSuppressRedundantIo, uint32_t cPipelineDepth,
+                        PVDINTERFACEPROGRESS pIfProgress,
+                        PVDINTERFACEPROGRESS pDstIfProgress)
+{
+    int rc = VINF_SUCCESS;
+    uint64_t uOffset = 0;
+    uint64_t cbRemaining = cbSize;
+    void *pvBuf = NULL;
+    bool fBlockwiseCopy = fSuppressRedundantIo || (cImagesFromRead > 0);
+    /* Unallocated ranges can't be skipped if a filter might transform the data. */
+    bool fSparse = pDiskFrom->pFilterHead == NULL;
+    unsigned uProgressOld = 0;
+
+    LogFlowFunc(("pDiskFrom=%#p pImageFrom=%#p pDiskTo=%#p cbSize=%llu cImagesFromRead=%u cImagesToRead=%u fSuppressRedundantIo=%RTbool cPipelineDepth=%u pIfProgress=%#p pDstIfProgress=%#p\n",
+                 pDiskFrom, pImageFrom, pDiskTo, cbSize, cImagesFromRead, cImagesToRead, fSuppressRedundantIo, cPipelineDepth, pDstIfProgress, pDstIfProgress));
+
+    /* Overlapping reads and writes only works for distinct disks and needs
+     * at least two chunks in the ring. */
+    if (   cPipelineDepth > 1
+        && pDiskFrom != pDiskTo
+        && cbSize > VD_MERGE_BUFFER_SIZE)
     {
-        rc2 = vdThreadFinishWrite(pDiskTo);
-        AssertRC(rc2);
+        rc = vdCopyHelperPipelined(pDiskFrom, pImageFrom, pDiskTo, cbSize,
+                                   cImagesFromRead, cImagesToRead, fBlockwiseCopy, fSparse,
+                                   RT_MIN(cPipelineDepth, VD_COPY_PIPELINE_DEPTH_MAX),
+                                   pIfProgress, pDstIfProgress);
+        LogFlowFunc(("returns rc=%Rrc\n", rc));
+        return rc;
     }
 
+    /* Allocate tmp buffer. */
+    pvBuf = RTMemTmpAlloc(VD_MERGE_BUFFER_SIZE);
+    if (!pvBuf)
+        return rc;
+
+    do
+    {
+        uint64_t cbThisRead = 0;
+
+        rc = vdCopyHelperReadChunk(pDiskFrom, pImageFrom, uOffset, cbRemaining, pvBuf,
+                                   &cbThisRead, cImagesFromRead, fBlockwiseCopy, fSparse);
+        if (RT_FAILURE(rc) && rc != VERR_VD_BLOCK_FREE)
+            break;
+
+        if (rc != VERR_VD_BLOCK_FREE)
+            rc = vdCopyHelperWriteChunk(pDiskTo, uOffset, pvBuf, (size_t)cbThisRead,
+                                        cImagesToRead, fBlockwiseCopy);
+        else /* Don't propagate the error to the outside */
+            rc = vdCopyHelperWriteHole(pDiskTo, uOffset, cbThisRead, pvBuf,
+                                       fBlockwiseCopy);
+        if (RT_FAILURE(rc))
+            break;
+
+        uOffset += cbThisRead;
+        cbRemaining -= cbThisRead;
+
+        rc = vdCopyHelperProgress(uOffset, cbSize, &uProgressOld,
+                                  pIfProgress, pDstIfProgress);
+        if (RT_FAILURE(rc))
+            break;
+    } while (uOffset < cbSize);
+
+    RTMemFree(pvBuf);
+
     LogFlowFunc(("returns rc=%Rrc\n", rc));
     return rc;
 }
@@ -2884,6 +3305,47 @@ static int vdWriteHelperStandardAsync(PVDIOCTX pIoCtx)
     return VINF_SUCCESS;
 }
 
+/**
+ * Internal: Checks whether a write hitting an unallocated block can be dropped
+ * because it only contains zeroes and the range reads as zeroes already.
+ *
+ * This saves dynamic images from growing when the guest zero fills free space.
+ *
+ * @returns true if the write can be skipped, false otherwise.
+ * @param   pDisk           The disk the write is for.
+ * @param   pIoCtx          The I/O context, positioned at the data to write.
+ * @param   pImage          The image the backend reported the block as free in.
+ * @param   uOffset         Start offset of the write.
+ * @param   cbWrite         Size of the write.
+ */
+static bool vdWriteHelperIsZeroWriteRedundant(PVBOXHDD pDisk, PVDIOCTX pIoCtx, PVDIMAGE pImage,
+                                              uint64_t uOffset, size_t cbWrite)
+{
+    if (   (pImage->uOpenFlags & VD_OPEN_FLAGS_HONOR_ZEROES)
+        || pIoCtx->Req.Io.pImageParentOverride
+        || pDisk->pFilterHead)
+        return false;
+
+    /* Check the data first, it bails out quickly for the common case. */
+    if (!RTSgBufIsZero(&pIoCtx->Req.Io.SgBuf, cbWrite))
+        return false;
+
+    /* The block is free in the image, so the parents decide what is read. */
+    if (pImage->pPrev)
+    {
+        uint64_t cbRange = 0;
+        bool fAllocated = true;
+        int rc = vdQueryAllocationHelper(pImage->pPrev, 0, uOffset, cbWrite,
+                                         &cbRange, &fAllocated);
+        if (   RT_FAILURE(rc)
+            || fAllocated
+            || cbRange < cbWrite)
+            return false;
+    }
+
+    return true;
+}
+
 /**
  * internal: write buffer to the image, taking care of block boundaries and
  * write optimizations - async version.
@@ -2930,7 +3392,21 @@ static int vdWriteHelperAsync(PVDIOCTX pIoCtx)
         {
             /* Lock the disk .*/
             rc = vdIoCtxLockDisk(pDisk, pIoCtx);
-            if (RT_SUCCESS(rc))
+            if (   RT_SUCCESS(rc)
+                && vdWriteHelperIsZeroWriteRedundant(pDisk, pIoCtx, pImage, uOffset, cbThisWrite))
+            {
+                /*
+                 * Holding the lock makes sure no other write is allocating the
+                 * block right now, that one would be deferred behind us and
+                 * see the block allocated afterwards.
+                 */
+                LogFlowFunc(("Dropping zero write of %zu bytes at %llu\n", cbThisWrite, uOffset));
+                Assert(pIoCtx->Req.Io.cbTransferLeft >= cbThisWrite);
+                RTSgBufAdvance(&pIoCtx->Req.Io.SgBuf, cbThisWrite);
+                ASMAtomicSubU32(&pIoCtx->Req.Io.cbTransferLeft, (uint32_t)cbThisWrite);
+                vdIoCtxUnlockDisk(pDisk, pIoCtx, false /* fProcessDeferredReqs*/ );
+            }
+            else if (RT_SUCCESS(rc))
             {
                 /*
                  * Allocate segment and buffer in one go.
@@ -4745,7 +5221,7 @@ static int vdIOIntFlush(void *pvUser, PVDIOSTORAGE pIoStorage, PVDIOCTX pIoCtx,
         if (!pMetaXfer)
             return VERR_NO_MEMORY;
 
-        pIoTask = vdIoTaskMetaAlloc(pIoStorage, pfnComplete, pvUser, pMetaXfer);
+        pIoTask = vdIoTaskMetaAlloc(pIoStorage, pfnComplete, pvCompleteUser, pMetaXfer);
         if (!pIoTask)
         {
             RTMemFree(pMetaXfer);
@@ -7700,10 +8176,22 @@ VBOXDDU_DECL(int) VDCopyEx(PVBOXHDD pDiskFrom, unsigned nImage, PVBOXHDD pDiskTo
         else
             cImagesToReadBack = pDiskTo->cImages - nImageToSame - 1;
 
+        /* Number of chunks to keep in flight, 1 disables the pipeline. */
+        uint32_t cPipelineDepth = VD_COPY_PIPELINE_DEPTH_DEFAULT;
+        PVDINTERFACECONFIG pIfCfg = VDIfConfigGet(pVDIfsOperation);
+        if (pIfCfg)
+        {
+            rc = VDCFGQueryU32Def(pIfCfg, "CopyPipelineDepth", &cPipelineDepth,
+                                  VD_COPY_PIPELINE_DEPTH_DEFAULT);
+            if (RT_FAILURE(rc))
+                break;
+        }
+
         /* Copy the data. */
         rc = vdCopyHelper(pDiskFrom, pImageFrom, pDiskTo, cbSize,
                           cImagesFromReadBack, cImagesToReadBack,
-                          fSuppressRedundantIo, pIfProgress, pDstIfProgress);
+                          fSuppressRedundantIo, cPipelineDepth,
+                          pIfProgress, pDstIfProgress);
 
         if (RT_SUCCESS(rc))
         {
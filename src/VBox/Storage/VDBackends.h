@@ -35,6 +35,7 @@ extern const VBOXHDDBACKEND g_ISCSIBackend;
 extern const VBOXHDDBACKEND g_QedBackend;
 extern const VBOXHDDBACKEND g_QCowBackend;
 extern const VBOXHDDBACKEND g_VhdxBackend;
+extern const VBOXHDDBACKEND g_DedupBackend;
 
 extern const VDCACHEBACKEND g_VciCacheBackend;
 
@@ -3195,6 +3195,45 @@ static DECLCALLBACK(int) vdiRepair(const char *pszFilename, PVDINTERFACE pVDIfsD
     return rc;
 }
 
+/** @copydoc VBOXHDDBACKEND::pfnQueryAllocation */
+static DECLCALLBACK(int) vdiQueryAllocation(void *pBackendData, uint64_t uOffset, uint64_t cbRange,
+                                            uint64_t *pcbRange, bool *pfAllocated)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbRange=%llu pcbRange=%#p pfAllocated=%#p\n",
+                 pBackendData, uOffset, cbRange, pcbRange, pfAllocated));
+    PVDIIMAGEDESC pImage = (PVDIIMAGEDESC)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtr(pImage);
+
+    if (   uOffset + cbRange > getImageDiskSize(&pImage->Header)
+        || !cbRange)
+        rc = VERR_INVALID_PARAMETER;
+    else
+    {
+        unsigned cBlocks = getImageBlocks(&pImage->Header);
+        unsigned uBlock  = (unsigned)(uOffset >> pImage->uShiftOffset2Index);
+        uint64_t cbBlock = getImageBlockSize(&pImage->Header);
+        /* Zero blocks hide the parent content and count as allocated. */
+        bool fAllocated = pImage->paBlocks[uBlock] != VDI_IMAGE_BLOCK_FREE;
+        uint64_t cbThisRange = cbBlock - (uOffset & pImage->uBlockMask);
+
+        /* Collect all following blocks with the same state. */
+        for (uBlock++;
+                cbThisRange < cbRange
+             && uBlock < cBlocks
+             && (pImage->paBlocks[uBlock] != VDI_IMAGE_BLOCK_FREE) == fAllocated;
+             uBlock++)
+            cbThisRange += cbBlock;
+
+        *pcbRange    = RT_MIN(cbThisRange, cbRange);
+        *pfAllocated = fAllocated;
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 const VBOXHDDBACKEND g_VDIBackend =
 {
     /* pszBackendName */
@@ -3291,5 +3330,7 @@ const VBOXHDDBACKEND g_VDIBackend =
     /* pfnRepair */
     vdiRepair,
     /* pfnTraverseMetadata */
-    NULL
+    NULL,
+    /* pfnQueryAllocation */
+    vdiQueryAllocation
 };
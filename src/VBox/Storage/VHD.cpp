@@ -3182,6 +3182,52 @@ static DECLCALLBACK(int) vhdRepair(const char *pszFilename, PVDINTERFACE pVDIfsD
 }
 
 
+/** @copydoc VBOXHDDBACKEND::pfnQueryAllocation */
+static DECLCALLBACK(int) vhdQueryAllocation(void *pBackendData, uint64_t uOffset, uint64_t cbRange,
+                                            uint64_t *pcbRange, bool *pfAllocated)
+{
+    PVHDIMAGE pImage = (PVHDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    LogFlowFunc(("pBackendData=%p uOffset=%#llx cbRange=%llu pcbRange=%#p pfAllocated=%#p\n",
+                 pBackendData, uOffset, cbRange, pcbRange, pfAllocated));
+
+    if (   uOffset + cbRange > pImage->cbSize
+        || !cbRange)
+        return VERR_INVALID_PARAMETER;
+
+    if (pImage->pBlockAllocationTable)
+    {
+        /*
+         * A present block might still have sectors which are not marked in the
+         * block bitmap of differencing images. Reporting the whole block as
+         * allocated is fine, reading it resolves the details.
+         */
+        uint32_t idxBat = (uint32_t)((uOffset / VHD_SECTOR_SIZE) / pImage->cSectorsPerDataBlock);
+        bool fAllocated = pImage->pBlockAllocationTable[idxBat] != ~0U;
+        uint64_t cbThisRange = pImage->cbDataBlock - (uOffset % pImage->cbDataBlock);
+
+        for (idxBat++;
+                cbThisRange < cbRange
+             && idxBat < pImage->cBlockAllocationTableEntries
+             && (pImage->pBlockAllocationTable[idxBat] != ~0U) == fAllocated;
+             idxBat++)
+            cbThisRange += pImage->cbDataBlock;
+
+        *pcbRange    = RT_MIN(cbThisRange, cbRange);
+        *pfAllocated = fAllocated;
+    }
+    else
+    {
+        /* Fixed images have everything allocated. */
+        *pcbRange    = cbRange;
+        *pfAllocated = true;
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 const VBOXHDDBACKEND g_VhdBackend =
 {
     /* pszBackendName */
@@ -3279,5 +3325,7 @@ const VBOXHDDBACKEND g_VhdBackend =
     /* pfnRepair */
     vhdRepair,
     /* pfnTraverseMetadata */
-    NULL
+    NULL,
+    /* pfnQueryAllocation */
+    vhdQueryAllocation
 };
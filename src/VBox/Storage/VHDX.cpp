@@ -125,6 +125,8 @@ typedef VhdxRegionTblHdr *PVhdxRegionTblHdr;
 #define VHDX_REGION_TBL_HDR_ENTRY_COUNT_MAX UINT32_C(2047)
 /** Offset where the region table is stored (192 KB). */
 #define VHDX_REGION_TBL_HDR_OFFSET          UINT64_C(196608)
+/** Offset where the second copy of the region table is stored (256 KB). */
+#define VHDX_REGION_TBL_HDR_OFFSET2         UINT64_C(262144)
 /** Maximum size of the region table. */
 #define VHDX_REGION_TBL_SIZE_MAX            _64K
 
@@ -188,6 +190,10 @@ typedef struct VhdxLogEntryHdr *PVhdxLogEntryHdr;
 
 /** VHDX log entry signature ("loge"). */
 #define VHDX_LOG_ENTRY_HEADER_SIGNATURE UINT32_C(0x65676f6c)
+/** Log entries, descriptor areas and data sectors are multiples of this size. */
+#define VHDX_LOG_SECTOR_SIZE            _4K
+/** Maximum number of data descriptors in a log entry written by us. */
+#define VHDX_LOG_ENTRY_DESC_MAX         32
 
 /**
  * VHDX log zero descriptor.
@@ -277,6 +283,10 @@ typedef VhdxBatEntry *PVhdxBatEntry;
 #define VHDX_BAT_ENTRY_GET_FILE_OFFSET_MB(bat) (((bat) & UINT64_C(0xfffffffffff00000)) >> 20)
 /** Get a byte offset from the BAT entry. */
 #define VHDX_BAT_ENTRY_GET_FILE_OFFSET(bat) (VHDX_BAT_ENTRY_GET_FILE_OFFSET_MB(bat) * (uint64_t)_1M)
+/** Create a BAT entry from the given 1MB aligned byte offset and state. */
+#define VHDX_BAT_ENTRY_CREATE(off, state) ((((uint64_t)(off) / _1M) << 20) | (state))
+/** Number of BAT entries stored in one 4KB sector of the BAT region. */
+#define VHDX_BAT_ENTRIES_PER_SECTOR (_4K / sizeof(VhdxBatEntry))
 
 /** Block not present and the data is undefined. */
 #define VHDX_BAT_ENTRY_PAYLOAD_BLOCK_NOT_PRESENT       (0)
@@ -348,6 +358,8 @@ typedef VhdxMetadataTblEntry *PVhdxMetadataTblEntry;
 #define VHDX_METADATA_TBL_ENTRY_FLAGS_IS_VDISK    RT_BIT_32(1)
 /** FLag whether the backend must understand the metadata item to load the image. */
 #define VHDX_METADATA_TBL_ENTRY_FLAGS_IS_REQUIRED RT_BIT_32(2)
+/** Metadata items start at this offset in the metadata region. */
+#define VHDX_METADATA_ITEM_OFFSET_MIN             _64K
 
 /** File parameters item UUID. */
 #define VHDX_METADATA_TBL_ENTRY_ITEM_FILE_PARAMS    "caa16737-fa36-4d43-b3b6-33f0aa44e76b"
@@ -428,7 +440,7 @@ typedef struct VhdxVDiskLogicalSectorSize *PVhdxVDiskLogicalSectorSize;
 typedef struct VhdxVDiskPhysicalSectorSize
 {
     /** Physical sector size. */
-    uint64_t    u64PhysicalSectorSize;
+    uint32_t    u32PhysicalSectorSize;
 } VhdxVDiskPhysicalSectorSize;
 #pragma pack()
 /** Pointer to an on disk VHDX virtual disk physical sector size metadata item. */
@@ -477,6 +489,21 @@ typedef struct VhdxParentLocatorEntry *PVhdxParentLocatorEntry;
 *   Constants And Macros, Structures and Typedefs                              *
 *******************************************************************************/
 
+/** Offset of the log region in images created by us. */
+#define VHDX_CREATE_LOG_OFFSET        _1M
+/** Size of the log region in images created by us. */
+#define VHDX_CREATE_LOG_LENGTH        _1M
+/** Offset of the metadata region in images created by us. */
+#define VHDX_CREATE_METADATA_OFFSET   (2 * _1M)
+/** Size of the metadata region in images created by us. */
+#define VHDX_CREATE_METADATA_LENGTH   _1M
+/** Offset of the BAT region in images created by us. */
+#define VHDX_CREATE_BAT_OFFSET        (3 * _1M)
+/** Block size of images created by us. */
+#define VHDX_CREATE_BLOCK_SIZE        (32 * _1M)
+/** Logical and physical sector size of images created by us. */
+#define VHDX_CREATE_SECTOR_SIZE       512
+
 typedef enum VHDXMETADATAITEM
 {
     VHDXMETADATAITEM_UNKNOWN = 0,
@@ -544,11 +571,115 @@ typedef struct VHDXIMAGE
 
     /** The BAT. */
     PVhdxBatEntry       paBat;
+    /** Number of entries in the BAT, including the sector bitmap entries. */
+    uint32_t            cBatEntries;
     /** Chunk ratio. */
     uint32_t            uChunkRatio;
+    /** Start offset of the BAT region. */
+    uint64_t            offBat;
+    /** Size of the BAT region. */
+    uint32_t            cbBat;
+
+    /** The current header, host endianess. */
+    VhdxHeader          Hdr;
+    /** Which of the two header copies is the current one (0 or 1). */
+    unsigned            idxHdrCurrent;
+    /** Flag whether the header was updated for this session when the image was
+     * opened for writing (new file and data write UUIDs and a log UUID). */
+    bool                fModified;
+    /** Flag whether the in memory header has changes the next flush writes. */
+    bool                fHdrDirty;
+
+    /** Bitmap of BAT sectors which were logged but not yet written to the BAT region. */
+    uint32_t           *pbmBatDirty;
+    /** Number of dirty BAT sectors. */
+    uint32_t            cBatSectorsDirty;
+    /** Offset of the next log entry relative to the start of the log region. */
+    uint32_t            offLogHead;
+    /** Offset of the oldest log entry whose changes are not yet written in place. */
+    uint32_t            offLogTail;
+    /** Sequence number of the last log entry written. */
+    uint64_t            uLogSeqNo;
+    /** File size the last time the log was flushed. */
+    uint64_t            cbFileFlushed;
+    /** Offset where the next payload block is allocated (1MB aligned). */
+    uint64_t            offEof;
+
+    /** Size of the part of a sector bitmap block covering one payload block. */
+    size_t              cbSectorBitmap;
+    /** Buffer holding the sector bitmap of a payload block (differencing images only). */
+    uint8_t            *pbSectorBitmap;
 
 } VHDXIMAGE, *PVHDXIMAGE;
 
+/**
+ * Information about a valid log entry found while replaying the log.
+ */
+typedef struct VHDXLOGENTRYINFO
+{
+    /** Flag whether there is a valid entry at this offset. */
+    bool                fValid;
+    /** Sequence number of the entry. */
+    uint64_t            uSeqNo;
+    /** Size of the entry. */
+    uint32_t            cbEntry;
+    /** Offset of the oldest entry still needed when this entry was written. */
+    uint32_t            offTail;
+    /** Minimum file size required to replay the log. */
+    uint64_t            cbFileFlushed;
+    /** File size after this entry was written. */
+    uint64_t            cbFileLast;
+} VHDXLOGENTRYINFO, *PVHDXLOGENTRYINFO;
+
+/**
+ * Steps of a metadata update.
+ */
+typedef enum VHDXMETAUPDATESTATE
+{
+    /** Invalid state. */
+    VHDXMETAUPDATESTATE_INVALID = 0,
+    /** Write the header to the copy which is not current. */
+    VHDXMETAUPDATESTATE_HEADER_WRITE,
+    /** Flush the header. */
+    VHDXMETAUPDATESTATE_HEADER_FLUSH,
+    /** Make the written header copy the current one. */
+    VHDXMETAUPDATESTATE_HEADER_COMMIT,
+    /** Flush the data of the new payload block. */
+    VHDXMETAUPDATESTATE_DATA_FLUSH,
+    /** Write the log entry changing the BAT. */
+    VHDXMETAUPDATESTATE_LOG_WRITE,
+    /** Flush the log entry. */
+    VHDXMETAUPDATESTATE_LOG_FLUSH,
+    /** Change the BAT in memory, the log entry is on the disk. */
+    VHDXMETAUPDATESTATE_LOG_COMMIT,
+    /** Write the logged BAT sectors in place. */
+    VHDXMETAUPDATESTATE_CHECKPOINT_WRITE,
+    /** Flush the BAT. */
+    VHDXMETAUPDATESTATE_CHECKPOINT_FLUSH,
+    /** Mark the log as empty, the BAT is on the disk. */
+    VHDXMETAUPDATESTATE_CHECKPOINT_COMMIT,
+    /** The update is complete. */
+    VHDXMETAUPDATESTATE_COMPLETE
+} VHDXMETAUPDATESTATE;
+
+/**
+ * State of a metadata update (BAT change, header update or checkpoint) which
+ * might have to wait for I/O between the steps.
+ */
+typedef struct VHDXMETAUPDATE
+{
+    /** Next step. */
+    VHDXMETAUPDATESTATE enmState;
+    /** Flag whether the log starts over after the checkpoint. */
+    bool                fLogRestart;
+    /** The BAT entry to change. */
+    uint32_t            idxBat;
+    /** New value of the BAT entry. */
+    uint64_t            uBatEntry;
+    /** End of the new payload block in the file. */
+    uint64_t            offBlockEnd;
+} VHDXMETAUPDATE, *PVHDXMETAUPDATE;
+
 /**
  * Endianess conversion direction.
  */
@@ -654,9 +785,9 @@ DECLINLINE(void) vhdxConvHeaderEndianess(VHDXECONV enmConv, PVhdxHeader pHdrConv
     pHdrConv->u32Signature      = SET_ENDIAN_U32(pHdr->u32Signature);
     pHdrConv->u32Checksum       = SET_ENDIAN_U32(pHdr->u32Checksum);
     pHdrConv->u64SequenceNumber = SET_ENDIAN_U64(pHdr->u64SequenceNumber);
-    vhdxConvUuidEndianess(enmConv, &pHdrConv->UuidFileWrite, &pHdrConv->UuidFileWrite);
-    vhdxConvUuidEndianess(enmConv, &pHdrConv->UuidDataWrite, &pHdrConv->UuidDataWrite);
-    vhdxConvUuidEndianess(enmConv, &pHdrConv->UuidLog, &pHdrConv->UuidLog);
+    vhdxConvUuidEndianess(enmConv, &pHdrConv->UuidFileWrite, &pHdr->UuidFileWrite);
+    vhdxConvUuidEndianess(enmConv, &pHdrConv->UuidDataWrite, &pHdr->UuidDataWrite);
+    vhdxConvUuidEndianess(enmConv, &pHdrConv->UuidLog, &pHdr->UuidLog);
     pHdrConv->u16LogVersion     = SET_ENDIAN_U16(pHdr->u16LogVersion);
     pHdrConv->u16Version        = SET_ENDIAN_U16(pHdr->u16Version);
     pHdrConv->u32LogLength      = SET_ENDIAN_U32(pHdr->u32LogLength);
@@ -723,6 +854,7 @@ DECLINLINE(void) vhdxConvLogEntryHdrEndianess(VHDXECONV enmConv, PVhdxLogEntryHd
     pLogEntryHdrConv->u32Reserved          = SET_ENDIAN_U32(pLogEntryHdr->u32Reserved);
     vhdxConvUuidEndianess(enmConv, &pLogEntryHdrConv->UuidLog, &pLogEntryHdr->UuidLog);
     pLogEntryHdrConv->u64FlushedFileOffset = SET_ENDIAN_U64(pLogEntryHdr->u64FlushedFileOffset);
+    pLogEntryHdrConv->u64LastFileOffset    = SET_ENDIAN_U64(pLogEntryHdr->u64LastFileOffset);
 }
 
 /**
@@ -918,7 +1050,7 @@ DECLINLINE(void) vhdxConvVDiskLogSectSizeEndianess(VHDXECONV enmConv, PVhdxVDisk
 DECLINLINE(void) vhdxConvVDiskPhysSectSizeEndianess(VHDXECONV enmConv, PVhdxVDiskPhysicalSectorSize pVDiskPhysSectSizeConv,
                                                     PVhdxVDiskPhysicalSectorSize pVDiskPhysSectSize)
 {
-    pVDiskPhysSectSizeConv->u64PhysicalSectorSize = SET_ENDIAN_U64(pVDiskPhysSectSize->u64PhysicalSectorSize);
+    pVDiskPhysSectSizeConv->u32PhysicalSectorSize = SET_ENDIAN_U32(pVDiskPhysSectSize->u32PhysicalSectorSize);
 }
 
 /**
@@ -958,6 +1090,529 @@ DECLINLINE(void) vhdxConvParentLocatorEntryEndianess(VHDXECONV enmConv, PVhdxPar
     pParentLocatorEntryConv->u16ValueLength = SET_ENDIAN_U16(pParentLocatorEntry->u16ValueLength);
 }
 
+/**
+ * Converts the in memory header to file endianess for writing it, incrementing
+ * the sequence number and updating the checksum.
+ *
+ * @returns nothing.
+ * @param   pImage    Image instance data.
+ * @param   pHdr      Where to store the header.
+ */
+static void vhdxHeaderBuild(PVHDXIMAGE pImage, PVhdxHeader pHdr)
+{
+    pImage->Hdr.u64SequenceNumber++;
+    pImage->Hdr.u32Checksum = 0;
+    vhdxConvHeaderEndianess(VHDXECONV_H2F, pHdr, &pImage->Hdr);
+    pHdr->u32Checksum = RT_H2LE_U32(RTCrc32C(pHdr, sizeof(VhdxHeader)));
+}
+
+/**
+ * Writes the in memory header to the location of the header copy which is not
+ * current and makes it the current one.
+ *
+ * The sequence number is incremented and the checksum updated. The write is
+ * flushed so the header is on the disk before anything depending on it is
+ * written.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ */
+static int vhdxHeaderUpdate(PVHDXIMAGE pImage)
+{
+    int rc = VINF_SUCCESS;
+    PVhdxHeader pHdr = (PVhdxHeader)RTMemTmpAllocZ(sizeof(VhdxHeader));
+
+    LogFlowFunc(("pImage=%#p\n", pImage));
+
+    if (pHdr)
+    {
+        unsigned idxHdr = pImage->idxHdrCurrent ^ 1;
+
+        vhdxHeaderBuild(pImage, pHdr);
+        rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage,
+                                    idxHdr == 0 ? VHDX_HEADER1_OFFSET : VHDX_HEADER2_OFFSET,
+                                    pHdr, sizeof(VhdxHeader));
+        if (RT_SUCCESS(rc))
+            rc = vdIfIoIntFileFlushSync(pImage->pIfIo, pImage->pStorage);
+        if (RT_SUCCESS(rc))
+        {
+            pImage->idxHdrCurrent = idxHdr;
+            pImage->fHdrDirty = false;
+        }
+        else
+            rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                           "VHDX: Writing the header of image \'%s\' failed",
+                           pImage->pszFilename);
+
+        RTMemTmpFree(pHdr);
+    }
+    else
+        rc = vdIfError(pImage->pIfError, VERR_NO_MEMORY, RT_SRC_POS,
+                       "VHDX: Out of memory while allocating memory for the header");
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Prepares an image opened for writing for modifications.
+ *
+ * The specification requires a new file write UUID in the header before
+ * anything in the file changes. The log UUID is set at the same time, log
+ * entries carrying it are only valid after the header was written. The data
+ * write UUID is changed by the upper layer through vhdxSetModificationUuid()
+ * right before the first user data write.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ */
+static int vhdxImageSetModified(PVHDXIMAGE pImage)
+{
+    int rc = VINF_SUCCESS;
+
+    if (!pImage->fModified)
+    {
+        RTUuidCreate(&pImage->Hdr.UuidFileWrite);
+        RTUuidCreate(&pImage->Hdr.UuidLog);
+        pImage->Hdr.u16LogVersion = VHDX_HEADER_LOG_VERSION;
+        pImage->offLogHead = 0;
+        pImage->offLogTail = 0;
+        pImage->uLogSeqNo  = 0;
+
+        rc = vhdxHeaderUpdate(pImage);
+        if (RT_SUCCESS(rc))
+            pImage->fModified = true;
+    }
+
+    return rc;
+}
+
+/**
+ * Returns the file endianess content of the given BAT sector.
+ *
+ * @returns nothing.
+ * @param   pImage      Image instance data.
+ * @param   idxSector   The BAT sector to get.
+ * @param   paBatSector Where to store the content, 4KB.
+ */
+static void vhdxBatSectorGet(PVHDXIMAGE pImage, uint32_t idxSector, PVhdxBatEntry paBatSector)
+{
+    uint32_t idxBatFirst = idxSector * VHDX_BAT_ENTRIES_PER_SECTOR;
+    uint32_t cEntries = RT_MIN(VHDX_BAT_ENTRIES_PER_SECTOR, pImage->cBatEntries - idxBatFirst);
+
+    memset(paBatSector, 0, VHDX_LOG_SECTOR_SIZE);
+    vhdxConvBatTableEndianess(VHDXECONV_H2F, paBatSector, &pImage->paBat[idxBatFirst], cEntries);
+}
+
+/**
+ * Returns the size of a log entry with the given number of data sectors.
+ *
+ * @returns Size of the entry in bytes.
+ * @param   cSectors    Number of sectors logged by the entry.
+ */
+DECLINLINE(uint32_t) vhdxLogEntrySize(unsigned cSectors)
+{
+    return   RT_ALIGN_32(sizeof(VhdxLogEntryHdr) + cSectors * sizeof(VhdxLogDataDesc), VHDX_LOG_SECTOR_SIZE)
+           + cSectors * VHDX_LOG_SECTOR_SIZE;
+}
+
+/**
+ * Builds a log entry with a data descriptor for each of the given 4KB sectors.
+ * The entry is written at the current log head.
+ *
+ * @returns Pointer to the entry, free with RTMemTmpFree().
+ * @returns NULL if out of memory.
+ * @param   pImage        Image instance data.
+ * @param   cSectors      Number of sectors to log.
+ * @param   paoffSectors  File offsets of the sectors.
+ * @param   pbSectors     New content of the sectors, cSectors * 4KB.
+ * @param   uSeqNo        Sequence number of the entry.
+ */
+static uint8_t *vhdxLogEntryBuild(PVHDXIMAGE pImage, unsigned cSectors, const uint64_t *paoffSectors,
+                                  const uint8_t *pbSectors, uint64_t uSeqNo)
+{
+    uint32_t cbDescs = RT_ALIGN_32(sizeof(VhdxLogEntryHdr) + cSectors * sizeof(VhdxLogDataDesc), VHDX_LOG_SECTOR_SIZE);
+    uint32_t cbEntry = vhdxLogEntrySize(cSectors);
+    uint8_t *pbEntry = (uint8_t *)RTMemTmpAllocZ(cbEntry);
+
+    Assert(cSectors && cSectors <= VHDX_LOG_ENTRY_DESC_MAX);
+
+    if (pbEntry)
+    {
+        PVhdxLogEntryHdr pEntryHdr = (PVhdxLogEntryHdr)pbEntry;
+        PVhdxLogDataDesc paDescs = (PVhdxLogDataDesc)(pEntryHdr + 1);
+
+        /* New blocks are only allocated below offEof and the data was flushed before. */
+        pEntryHdr->u32Signature         = VHDX_LOG_ENTRY_HEADER_SIGNATURE;
+        pEntryHdr->u32EntryLength       = cbEntry;
+        pEntryHdr->u32Tail              = pImage->offLogTail;
+        pEntryHdr->u64SequenceNumber    = uSeqNo;
+        pEntryHdr->u32DescriptorCount   = cSectors;
+        pEntryHdr->UuidLog              = pImage->Hdr.UuidLog;
+        pEntryHdr->u64FlushedFileOffset = pImage->cbFileFlushed;
+        pEntryHdr->u64LastFileOffset    = RT_MAX(pImage->cbFileFlushed, pImage->offEof);
+        vhdxConvLogEntryHdrEndianess(VHDXECONV_H2F, pEntryHdr, pEntryHdr);
+
+        for (unsigned i = 0; i < cSectors; i++)
+        {
+            const uint8_t *pbSector = pbSectors + i * VHDX_LOG_SECTOR_SIZE;
+            PVhdxLogDataSector pDataSector = (PVhdxLogDataSector)(pbEntry + cbDescs + i * VHDX_LOG_SECTOR_SIZE);
+
+            paDescs[i].u32DataSignature  = VHDX_LOG_DATA_DESC_SIGNATURE;
+            paDescs[i].u64FileOffset     = paoffSectors[i];
+            paDescs[i].u64SequenceNumber = uSeqNo;
+            vhdxConvLogDataDescEndianess(VHDXECONV_H2F, &paDescs[i], &paDescs[i]);
+
+            /* The first 8 and the last 4 bytes of the sector are stored in the descriptor. */
+            memcpy(&paDescs[i].u64LeadingBytes, pbSector, sizeof(uint64_t));
+            memcpy(&paDescs[i].u32TrailingBytes, pbSector + VHDX_LOG_SECTOR_SIZE - sizeof(uint32_t), sizeof(uint32_t));
+
+            pDataSector->u32DataSignature = VHDX_LOG_DATA_SECTOR_SIGNATURE;
+            pDataSector->u32SequenceHigh  = (uint32_t)(uSeqNo >> 32);
+            pDataSector->u32SequenceLow   = (uint32_t)uSeqNo;
+            vhdxConvLogDataSectorEndianess(VHDXECONV_H2F, pDataSector, pDataSector);
+            memcpy(&pDataSector->u8Data[0], pbSector + sizeof(uint64_t), sizeof(pDataSector->u8Data));
+        }
+
+        pEntryHdr->u32Checksum = RT_H2LE_U32(RTCrc32C(pbEntry, cbEntry));
+    }
+
+    return pbEntry;
+}
+
+/**
+ * Writes the log entry changing the BAT entry of the given update at the log head.
+ *
+ * @returns VBox status code.
+ * @param   pImage        Image instance data.
+ * @param   pIoCtx        The I/O context, NULL for synchronous I/O.
+ * @param   pUpdate       The metadata update.
+ * @param   pfnComplete   Completion callback.
+ * @param   pvUser        Opaque user data for the completion callback.
+ */
+static int vhdxLogEntryWrite(PVHDXIMAGE pImage, PVDIOCTX pIoCtx, PVHDXMETAUPDATE pUpdate,
+                             PFNVDXFERCOMPLETED pfnComplete, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVhdxBatEntry paBatSector = (PVhdxBatEntry)RTMemTmpAlloc(VHDX_LOG_SECTOR_SIZE);
+
+    if (paBatSector)
+    {
+        uint32_t idxSector = pUpdate->idxBat / VHDX_BAT_ENTRIES_PER_SECTOR;
+        uint64_t offSector = pImage->offBat + idxSector * VHDX_LOG_SECTOR_SIZE;
+
+        /*
+         * The in memory BAT is changed only after the entry is on the disk, a checkpoint
+         * before must not write the change in place already.
+         */
+        vhdxBatSectorGet(pImage, idxSector, paBatSector);
+        paBatSector[pUpdate->idxBat % VHDX_BAT_ENTRIES_PER_SECTOR].u64BatEntry = RT_H2LE_U64(pUpdate->uBatEntry);
+
+        uint8_t *pbEntry = vhdxLogEntryBuild(pImage, 1, &offSector, (uint8_t *)paBatSector,
+                                             pImage->uLogSeqNo + 1);
+        if (pbEntry)
+        {
+            /* The metadata write keeps a copy of the entry. */
+            rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage,
+                                        pImage->Hdr.u64LogOffset + pImage->offLogHead,
+                                        pbEntry, vhdxLogEntrySize(1),
+                                        pIoCtx, pfnComplete, pvUser);
+            RTMemTmpFree(pbEntry);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+
+        RTMemTmpFree(paBatSector);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    return rc;
+}
+
+/**
+ * Writes the BAT sectors logged so far in place, as one write covering the
+ * first to the last dirty sector.
+ *
+ * @returns VBox status code.
+ * @param   pImage        Image instance data.
+ * @param   pIoCtx        The I/O context, NULL for synchronous I/O.
+ * @param   pfnComplete   Completion callback.
+ * @param   pvUser        Opaque user data for the completion callback.
+ */
+static int vhdxBatDirtyWrite(PVHDXIMAGE pImage, PVDIOCTX pIoCtx,
+                             PFNVDXFERCOMPLETED pfnComplete, void *pvUser)
+{
+    uint32_t cBatSectors = RT_ALIGN_32(pImage->cBatEntries, VHDX_BAT_ENTRIES_PER_SECTOR) / VHDX_BAT_ENTRIES_PER_SECTOR;
+    int32_t  idxFirst = ASMBitFirstSet(pImage->pbmBatDirty, RT_ALIGN_32(cBatSectors, 32));
+    uint32_t idxLast = cBatSectors - 1;
+    int rc = VINF_SUCCESS;
+
+    AssertReturn(idxFirst >= 0 && (uint32_t)idxFirst < cBatSectors, VERR_INTERNAL_ERROR);
+
+    while (!ASMBitTest(pImage->pbmBatDirty, idxLast))
+        idxLast--;
+
+    /* Sectors in between which are not dirty match the BAT region already. */
+    uint32_t offFirst = idxFirst * VHDX_LOG_SECTOR_SIZE;
+    uint32_t cbRange = RT_MIN((idxLast + 1) * VHDX_LOG_SECTOR_SIZE, pImage->cbBat) - offFirst;
+    uint8_t *pbRange = (uint8_t *)RTMemTmpAlloc((idxLast - idxFirst + 1) * VHDX_LOG_SECTOR_SIZE);
+
+    if (pbRange)
+    {
+        for (uint32_t idxSector = idxFirst; idxSector <= idxLast; idxSector++)
+            vhdxBatSectorGet(pImage, idxSector,
+                             (PVhdxBatEntry)(pbRange + (idxSector - idxFirst) * VHDX_LOG_SECTOR_SIZE));
+
+        rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage, pImage->offBat + offFirst,
+                                    pbRange, cbRange, pIoCtx, pfnComplete, pvUser);
+        RTMemTmpFree(pbRange);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    return rc;
+}
+
+static DECLCALLBACK(int) vhdxMetaUpdateComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq);
+
+/**
+ * Processes a metadata update until it is complete or has to wait for I/O.
+ *
+ * Each step issues at most one request and the next step starts when it
+ * completed. Without an I/O context all requests are synchronous.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_ASYNC_IO_IN_PROGRESS if a request is pending, the update
+ *          continues in vhdxMetaUpdateComplete().
+ * @param   pImage    Image instance data.
+ * @param   pIoCtx    The I/O context, NULL for synchronous I/O.
+ * @param   pUpdate   The metadata update.
+ */
+static int vhdxMetaUpdateProcess(PVHDXIMAGE pImage, PVDIOCTX pIoCtx, PVHDXMETAUPDATE pUpdate)
+{
+    PFNVDXFERCOMPLETED pfnComplete = pIoCtx ? vhdxMetaUpdateComplete : NULL;
+    void *pvUser = pIoCtx ? pUpdate : NULL;
+    int rc = VINF_SUCCESS;
+
+    LogFlowFunc(("pImage=%#p pIoCtx=%#p pUpdate=%#p enmState=%d\n",
+                 pImage, pIoCtx, pUpdate, pUpdate->enmState));
+
+    while (   RT_SUCCESS(rc)
+           && pUpdate->enmState != VHDXMETAUPDATESTATE_COMPLETE)
+    {
+        switch (pUpdate->enmState)
+        {
+            case VHDXMETAUPDATESTATE_HEADER_WRITE:
+            {
+                PVhdxHeader pHdr = (PVhdxHeader)RTMemTmpAllocZ(sizeof(VhdxHeader));
+                if (!pHdr)
+                {
+                    rc = VERR_NO_MEMORY;
+                    break;
+                }
+
+                vhdxHeaderBuild(pImage, pHdr);
+                pUpdate->enmState = VHDXMETAUPDATESTATE_HEADER_FLUSH;
+                rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage,
+                                            pImage->idxHdrCurrent == 0 ? VHDX_HEADER2_OFFSET : VHDX_HEADER1_OFFSET,
+                                            pHdr, sizeof(VhdxHeader), pIoCtx, pfnComplete, pvUser);
+                RTMemTmpFree(pHdr);
+                break;
+            }
+            case VHDXMETAUPDATESTATE_HEADER_FLUSH:
+            {
+                pUpdate->enmState = VHDXMETAUPDATESTATE_HEADER_COMMIT;
+                rc = vdIfIoIntFileFlush(pImage->pIfIo, pImage->pStorage, pIoCtx, pfnComplete, pvUser);
+                break;
+            }
+            case VHDXMETAUPDATESTATE_HEADER_COMMIT:
+            {
+                pImage->idxHdrCurrent ^= 1;
+                pImage->fHdrDirty = false;
+                pUpdate->enmState = VHDXMETAUPDATESTATE_CHECKPOINT_WRITE;
+                break;
+            }
+            case VHDXMETAUPDATESTATE_DATA_FLUSH:
+            {
+                pUpdate->enmState = VHDXMETAUPDATESTATE_LOG_WRITE;
+                rc = vdIfIoIntFileFlush(pImage->pIfIo, pImage->pStorage, pIoCtx, pfnComplete, pvUser);
+                break;
+            }
+            case VHDXMETAUPDATESTATE_LOG_WRITE:
+            {
+                /* The new block is on the disk, the BAT entry referencing it can be logged. */
+                pImage->cbFileFlushed = RT_MAX(pImage->cbFileFlushed, pUpdate->offBlockEnd);
+
+                if (pImage->offLogHead + vhdxLogEntrySize(1) > pImage->Hdr.u32LogLength)
+                {
+                    /* Write everything logged so far in place and start over. */
+                    pUpdate->fLogRestart = true;
+                    pUpdate->enmState = VHDXMETAUPDATESTATE_CHECKPOINT_WRITE;
+                }
+                else
+                {
+                    pUpdate->enmState = VHDXMETAUPDATESTATE_LOG_FLUSH;
+                    rc = vhdxLogEntryWrite(pImage, pIoCtx, pUpdate, pfnComplete, pvUser);
+                }
+                break;
+            }
+            case VHDXMETAUPDATESTATE_LOG_FLUSH:
+            {
+                pUpdate->enmState = VHDXMETAUPDATESTATE_LOG_COMMIT;
+                rc = vdIfIoIntFileFlush(pImage->pIfIo, pImage->pStorage, pIoCtx, pfnComplete, pvUser);
+                break;
+            }
+            case VHDXMETAUPDATESTATE_LOG_COMMIT:
+            {
+                uint32_t idxSector = pUpdate->idxBat / VHDX_BAT_ENTRIES_PER_SECTOR;
+
+                pImage->uLogSeqNo++;
+                pImage->offLogHead += vhdxLogEntrySize(1);
+                pImage->paBat[pUpdate->idxBat].u64BatEntry = pUpdate->uBatEntry;
+                if (!ASMBitTestAndSet(pImage->pbmBatDirty, idxSector))
+                    pImage->cBatSectorsDirty++;
+                pUpdate->enmState = VHDXMETAUPDATESTATE_COMPLETE;
+                break;
+            }
+            case VHDXMETAUPDATESTATE_CHECKPOINT_WRITE:
+            {
+                pUpdate->enmState = VHDXMETAUPDATESTATE_CHECKPOINT_FLUSH;
+                if (pImage->cBatSectorsDirty)
+                    rc = vhdxBatDirtyWrite(pImage, pIoCtx, pfnComplete, pvUser);
+                break;
+            }
+            case VHDXMETAUPDATESTATE_CHECKPOINT_FLUSH:
+            {
+                pUpdate->enmState = VHDXMETAUPDATESTATE_CHECKPOINT_COMMIT;
+                rc = vdIfIoIntFileFlush(pImage->pIfIo, pImage->pStorage, pIoCtx, pfnComplete, pvUser);
+                break;
+            }
+            case VHDXMETAUPDATESTATE_CHECKPOINT_COMMIT:
+            {
+                uint32_t cBatSectors = RT_ALIGN_32(pImage->cBatEntries, VHDX_BAT_ENTRIES_PER_SECTOR) / VHDX_BAT_ENTRIES_PER_SECTOR;
+
+                /* The log entries written so far are not required anymore. */
+                memset(pImage->pbmBatDirty, 0, RT_ALIGN_32(cBatSectors, 32) / 8);
+                pImage->cBatSectorsDirty = 0;
+                pImage->offLogTail = pImage->offLogHead;
+
+                if (pUpdate->fLogRestart)
+                {
+                    pImage->offLogHead = 0;
+                    pImage->offLogTail = 0;
+                    pUpdate->fLogRestart = false;
+                    pUpdate->enmState = VHDXMETAUPDATESTATE_LOG_WRITE;
+                }
+                else
+                    pUpdate->enmState = VHDXMETAUPDATESTATE_COMPLETE;
+                break;
+            }
+            default:
+                AssertMsgFailed(("Invalid metadata update state %d\n", pUpdate->enmState));
+                rc = VERR_INVALID_STATE;
+        }
+    }
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Completion callback for the requests of a metadata update.
+ *
+ * @copydoc FNVDXFERCOMPLETED
+ */
+static DECLCALLBACK(int) vhdxMetaUpdateComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq)
+{
+    PVHDXIMAGE pImage = (PVHDXIMAGE)pBackendData;
+    PVHDXMETAUPDATE pUpdate = (PVHDXMETAUPDATE)pvUser;
+    int rc = VINF_SUCCESS;
+
+    LogFlowFunc(("pBackendData=%#p pIoCtx=%#p pvUser=%#p rcReq=%Rrc\n",
+                 pBackendData, pIoCtx, pvUser, rcReq));
+
+    /* On failure the request completes with rcReq, the BAT in memory is unchanged. */
+    if (RT_SUCCESS(rcReq))
+        rc = vhdxMetaUpdateProcess(pImage, pIoCtx, pUpdate);
+
+    if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        RTMemFree(pUpdate);
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Starts a metadata update in the given state.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_ASYNC_IO_IN_PROGRESS if the update completes asynchronously.
+ * @param   pImage    Image instance data.
+ * @param   pIoCtx    The I/O context, NULL for synchronous I/O.
+ * @param   pUpdate   The metadata update, allocated with RTMemAllocZ(). Freed
+ *                    when the update completes.
+ */
+static int vhdxMetaUpdateStart(PVHDXIMAGE pImage, PVDIOCTX pIoCtx, PVHDXMETAUPDATE pUpdate)
+{
+    int rc = vhdxMetaUpdateProcess(pImage, pIoCtx, pUpdate);
+
+    if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        RTMemFree(pUpdate);
+
+    return rc;
+}
+
+/**
+ * Writes all logged BAT sectors to the BAT region and flushes the image.
+ * The log entries written so far are not required anymore afterwards.
+ * A changed header is written and flushed first.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_ASYNC_IO_IN_PROGRESS if the checkpoint completes asynchronously.
+ * @param   pImage    Image instance data.
+ * @param   pIoCtx    The I/O context, NULL for synchronous I/O.
+ */
+static int vhdxLogCheckpoint(PVHDXIMAGE pImage, PVDIOCTX pIoCtx)
+{
+    int rc = VINF_SUCCESS;
+    PVHDXMETAUPDATE pUpdate = (PVHDXMETAUPDATE)RTMemAllocZ(sizeof(VHDXMETAUPDATE));
+
+    LogFlowFunc(("pImage=%#p pIoCtx=%#p cBatSectorsDirty=%u\n", pImage, pIoCtx, pImage->cBatSectorsDirty));
+
+    if (pUpdate)
+    {
+        pUpdate->enmState =   pImage->fHdrDirty
+                            ? VHDXMETAUPDATESTATE_HEADER_WRITE
+                            : VHDXMETAUPDATESTATE_CHECKPOINT_WRITE;
+        rc = vhdxMetaUpdateStart(pImage, pIoCtx, pUpdate);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    if (   RT_FAILURE(rc)
+        && rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                       "VHDX: Writing the header or BAT of image \'%s\' failed",
+                       pImage->pszFilename);
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Returns the BAT entry of the sector bitmap block covering the given payload block.
+ *
+ * @returns The sector bitmap BAT entry.
+ * @param   pImage      Image instance data.
+ * @param   idxBlock    The payload block.
+ */
+DECLINLINE(uint64_t) vhdxSectorBitmapBatEntryGet(PVHDXIMAGE pImage, uint32_t idxBlock)
+{
+    uint32_t idxChunk = idxBlock / pImage->uChunkRatio;
+    return pImage->paBat[idxChunk * (pImage->uChunkRatio + 1) + pImage->uChunkRatio].u64BatEntry;
+}
+
 /**
  * Internal. Free all allocated space for representing an image except pImage,
  * and optionally delete the image from disk.
@@ -972,7 +1627,25 @@ static int vhdxFreeImage(PVHDXIMAGE pImage, bool fDelete)
     {
         if (pImage->pStorage)
         {
-            rc = vdIfIoIntFileClose(pImage->pIfIo, pImage->pStorage);
+            /*
+             * Write everything logged in place and mark the log as empty
+             * so the image is consistent without replaying it.
+             */
+            if (   pImage->fModified
+                && !fDelete)
+            {
+                rc = vhdxLogCheckpoint(pImage, NULL);
+                if (RT_SUCCESS(rc))
+                {
+                    RTUuidClear(&pImage->Hdr.UuidLog);
+                    rc = vhdxHeaderUpdate(pImage);
+                }
+            }
+            pImage->fModified = false;
+
+            int rc2 = vdIfIoIntFileClose(pImage->pIfIo, pImage->pStorage);
+            if (RT_SUCCESS(rc))
+                rc = rc2;
             pImage->pStorage = NULL;
         }
 
@@ -982,6 +1655,18 @@ static int vhdxFreeImage(PVHDXIMAGE pImage, bool fDelete)
             pImage->paBat = NULL;
         }
 
+        if (pImage->pbmBatDirty)
+        {
+            RTMemFree(pImage->pbmBatDirty);
+            pImage->pbmBatDirty = NULL;
+        }
+
+        if (pImage->pbSectorBitmap)
+        {
+            RTMemFree(pImage->pbSectorBitmap);
+            pImage->pbSectorBitmap = NULL;
+        }
+
         if (fDelete && pImage->pszFilename)
             vdIfIoIntFileDelete(pImage->pIfIo, pImage->pszFilename);
     }
@@ -997,27 +1682,37 @@ static int vhdxFreeImage(PVHDXIMAGE pImage, bool fDelete)
  * @returns VBox status code.
  * @param   pImage    Image instance data.
  * @param   pHdr      The header to load.
+ * @param   idxHdr    Which of the two header copies is loaded (0 or 1).
  */
-static int vhdxLoadHeader(PVHDXIMAGE pImage, PVhdxHeader pHdr)
+static int vhdxLoadHeader(PVHDXIMAGE pImage, PVhdxHeader pHdr, unsigned idxHdr)
 {
     int rc = VINF_SUCCESS;
 
-    LogFlowFunc(("pImage=%#p pHdr=%#p\n", pImage, pHdr));
+    LogFlowFunc(("pImage=%#p pHdr=%#p idxHdr=%u\n", pImage, pHdr, idxHdr));
 
     /*
-     * Most fields in the header are not required because the backend implements
-     * readonly access only so far.
-     * We just have to check that the log is empty, we have to refuse to load the
-     * image otherwsie because replaying the log is not implemented.
+     * The header is kept in memory because it is written again when the image
+     * is modified. A non empty log is replayed after the header was loaded,
+     * check that the log region is sane if it is going to be used.
      */
     if (pHdr->u16Version == VHDX_HEADER_VHDX_VERSION)
     {
-        /* Check that the log UUID is zero. */
         pImage->uVersion = pHdr->u16Version;
-        if (!RTUuidIsNull(&pHdr->UuidLog))
-            rc = vdIfError(pImage->pIfError, VERR_NOT_SUPPORTED, RT_SRC_POS,
-                           "VHDX: Image \'%s\' has a non empty log which is not supported",
-                           pImage->pszFilename);
+        if (   (   !RTUuidIsNull(&pHdr->UuidLog)
+                || !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+            && (   pHdr->u16LogVersion != VHDX_HEADER_LOG_VERSION
+                || !pHdr->u32LogLength
+            || pHdr->u32LogLength % _1M
+            || pHdr->u64LogOffset % _1M
+                || pHdr->u64LogOffset < VHDX_HEADER2_OFFSET + _64K))
+            rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                           "VHDX: Image \'%s\' has an invalid log region (version %u, offset %llu, length %u)",
+                           pImage->pszFilename, pHdr->u16LogVersion, pHdr->u64LogOffset, pHdr->u32LogLength);
+        else
+        {
+            pImage->Hdr           = *pHdr;
+            pImage->idxHdrCurrent = idxHdr;
+        }
     }
     else
         rc = vdIfError(pImage->pIfError, VERR_NOT_SUPPORTED, RT_SRC_POS,
@@ -1093,7 +1788,7 @@ static int vhdxFindAndLoadCurrentHeader(PVHDXIMAGE pImage)
         if (fHdr1Valid != fHdr2Valid)
         {
             /* Only one header is valid - use it. */
-            rc = vhdxLoadHeader(pImage, fHdr1Valid ? pHdr1 : pHdr2);
+            rc = vhdxLoadHeader(pImage, fHdr1Valid ? pHdr1 : pHdr2, fHdr1Valid ? 0 : 1);
         }
         else if (!fHdr1Valid && !fHdr2Valid)
         {
@@ -1105,9 +1800,9 @@ static int vhdxFindAndLoadCurrentHeader(PVHDXIMAGE pImage)
         {
             /* Both headers are valid. Use the sequence number to find the current one. */
             if (pHdr1->u64SequenceNumber > pHdr2->u64SequenceNumber)
-                rc = vhdxLoadHeader(pImage, pHdr1);
+                rc = vhdxLoadHeader(pImage, pHdr1, 0);
             else
-                rc = vhdxLoadHeader(pImage, pHdr2);
+                rc = vhdxLoadHeader(pImage, pHdr2, 1);
         }
     }
     else
@@ -1157,7 +1852,14 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
     if (cDataBlocks % uChunkRatio)
         cSectorBitmapBlocks++;
 
-    cBatEntries = cDataBlocks + (cDataBlocks - 1)/uChunkRatio;
+    /*
+     * Differencing images have a sector bitmap entry after each chunk,
+     * including the last one.
+     */
+    if (pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF)
+        cBatEntries = cSectorBitmapBlocks * (uChunkRatio + 1);
+    else
+        cBatEntries = cDataBlocks + (cDataBlocks - 1)/uChunkRatio;
     cbBatEntries = cBatEntries * sizeof(VhdxBatEntry);
 
     if (cbBatEntries <= cbRegion)
@@ -1179,17 +1881,16 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
                 /* Go through the table and validate it. */
                 for (unsigned i = 0; i < cBatEntries; i++)
                 {
-                    if (   i != 0
-                        && (i % uChunkRatio) == 0)
+                    if (((i + 1) % (uChunkRatio + 1)) == 0)
                     {
 /**
  * Disabled the verification because there are images out there with the sector bitmap
- * marked as present. The entry is never accessed and the image is readonly anyway,
- * so no harm done.
+ * marked as present. The entry is only accessed for differencing images, so no harm done.
  */
 #if 0
                         /* Sector bitmap block. */
-                        if (   VHDX_BAT_ENTRY_GET_STATE(paBatEntries[i].u64BatEntry)
+                        if (   !(pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF)
+                            && VHDX_BAT_ENTRY_GET_STATE(paBatEntries[i].u64BatEntry)
                             != VHDX_BAT_ENTRY_SB_BLOCK_NOT_PRESENT)
                         {
                             rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
@@ -1201,8 +1902,9 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
                     }
                     else
                     {
-                        /* Payload block. */
-                        if (   VHDX_BAT_ENTRY_GET_STATE(paBatEntries[i].u64BatEntry)
+                        /* Payload block, only differencing images can have partially present blocks. */
+                        if (   !(pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF)
+                            && VHDX_BAT_ENTRY_GET_STATE(paBatEntries[i].u64BatEntry)
                             == VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT)
                         {
                             rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
@@ -1216,7 +1918,10 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
                 if (RT_SUCCESS(rc))
                 {
                     pImage->paBat       = paBatEntries;
+                    pImage->cBatEntries = cBatEntries;
                     pImage->uChunkRatio = uChunkRatio;
+                    pImage->offBat      = offRegion;
+                    pImage->cbBat       = (uint32_t)cbRegion;
                 }
             }
             else
@@ -1271,11 +1976,10 @@ static int vhdxLoadFileParametersMetadata(PVHDXIMAGE pImage, uint64_t offItem, s
             vhdxConvFileParamsEndianess(VHDXECONV_F2H, &FileParameters, &FileParameters);
             pImage->cbBlock = FileParameters.u32BlockSize;
 
-            /* @todo: No support for differencing images yet. */
             if (FileParameters.u32Flags & VHDX_FILE_PARAMETERS_FLAGS_HAS_PARENT)
-                rc = vdIfError(pImage->pIfError, VERR_NOT_SUPPORTED, RT_SRC_POS,
-                               "VHDX: Image \'%s\' is a differencing image which is not supported yet",
-                               pImage->pszFilename);
+                pImage->uImageFlags |= VD_IMAGE_FLAGS_DIFF;
+            if (FileParameters.u32Flags & VHDX_FILE_PARAMETERS_FLAGS_LEAVE_BLOCKS_ALLOCATED)
+                pImage->uImageFlags |= VD_IMAGE_FLAGS_FIXED;
         }
         else
             rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
@@ -1366,6 +2070,52 @@ static int vhdxLoadVDiskLogSectorSizeMetadata(PVHDXIMAGE pImage, uint64_t offIte
     return rc;
 }
 
+/**
+ * Load the parent locator metadata item from the file.
+ *
+ * Only the locator type is checked, the parent is found by the caller
+ * opening the images of the chain in order.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ * @param   offItem   File offset where the data is stored.
+ * @param   cbItem    Size of the item in the file.
+ */
+static int vhdxLoadParentLocatorMetadata(PVHDXIMAGE pImage, uint64_t offItem, size_t cbItem)
+{
+    int rc = VINF_SUCCESS;
+
+    LogFlowFunc(("pImage=%#p offItem=%llu cbItem=%zu\n", pImage, offItem, cbItem));
+
+    if (cbItem < sizeof(VhdxParentLocatorHeader))
+        rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                       "VHDX: Parent locator item size mismatch (expected at least %u got %zu) in image \'%s\'",
+                       sizeof(VhdxParentLocatorHeader), cbItem, pImage->pszFilename);
+    else
+    {
+        VhdxParentLocatorHeader ParentLocatorHdr;
+
+        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, offItem,
+                                   &ParentLocatorHdr, sizeof(ParentLocatorHdr));
+        if (RT_SUCCESS(rc))
+        {
+            vhdxConvParentLocatorHeaderEndianness(VHDXECONV_F2H, &ParentLocatorHdr,
+                                                  &ParentLocatorHdr);
+            if (RTUuidCompareStr(&ParentLocatorHdr.UuidLocatorType, VHDX_PARENT_LOCATOR_TYPE_VHDX))
+                rc = vdIfError(pImage->pIfError, VERR_NOT_SUPPORTED, RT_SRC_POS,
+                               "VHDX: Image \'%s\' uses an unsupported parent locator type",
+                               pImage->pszFilename);
+        }
+        else
+            rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                           "VHDX: Reading the parent locator metadata item from image \'%s\' failed",
+                           pImage->pszFilename);
+    }
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
 /**
  * Loads the metadata region.
  *
@@ -1505,9 +2255,8 @@ static int vhdxLoadMetadataRegion(PVHDXIMAGE pImage, uint64_t offRegion,
                     }
                     case VHDXMETADATAITEM_PARENT_LOCATOR:
                     {
-                        rc = vdIfError(pImage->pIfError, VERR_NOT_SUPPORTED, RT_SRC_POS,
-                                       "VHDX: Image \'%s\' is a differencing image which is not supported yet",
-                                       pImage->pszFilename);
+                        rc = vhdxLoadParentLocatorMetadata(pImage, offMetadataItem,
+                                                           MetadataTblEntry.u32Length);
                         break;
                     }
                     case VHDXMETADATAITEM_UNKNOWN:
@@ -1640,7 +2389,9 @@ static int vhdxLoadRegionTable(PVHDXIMAGE pImage)
                     pRegTblEntry++;
                 }
 
-                if (fBatRegPresent)
+                if (RT_FAILURE(rc))
+                    /* nothing */;
+                else if (fBatRegPresent)
                     rc = vhdxLoadBatRegion(pImage, RegTblEntryBat.u64FileOffset, RegTblEntryBat.u32Length);
                 else
                     rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
@@ -1658,8 +2409,345 @@ static int vhdxLoadRegionTable(PVHDXIMAGE pImage)
                        "VHDX: Out of memory allocating memory for the region table of image \'%s\'",
                        pImage->pszFilename);
 
-    if (pbRegionTbl)
-        RTMemTmpFree(pbRegionTbl);
+    if (pbRegionTbl)
+        RTMemTmpFree(pbRegionTbl);
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Copies data out of the circular log buffer.
+ *
+ * @returns nothing.
+ * @param   pbLog     The log buffer.
+ * @param   cbLog     Size of the log.
+ * @param   off       Offset to start copying at.
+ * @param   pvDst     Where to copy the data to.
+ * @param   cb        How much to copy.
+ */
+static void vhdxLogCopy(const uint8_t *pbLog, uint32_t cbLog, uint32_t off, void *pvDst, uint32_t cb)
+{
+    uint32_t cbFirst = RT_MIN(cb, cbLog - off);
+
+    memcpy(pvDst, pbLog + off, cbFirst);
+    if (cb > cbFirst)
+        memcpy((uint8_t *)pvDst + cbFirst, pbLog, cb - cbFirst);
+}
+
+/**
+ * Checks whether there is a valid log entry at the given offset of the log.
+ *
+ * @returns true if the entry is valid, false otherwise.
+ * @param   pImage    Image instance data.
+ * @param   pbLog     The log buffer.
+ * @param   cbLog     Size of the log.
+ * @param   offEntry  Offset of the entry in the log.
+ * @param   pbEntry   Scratch buffer of at least cbLog bytes, holds the entry
+ *                    on success.
+ * @param   pInfo     Where to store information about the entry.
+ */
+static bool vhdxLogEntryValidate(PVHDXIMAGE pImage, const uint8_t *pbLog, uint32_t cbLog,
+                                 uint32_t offEntry, uint8_t *pbEntry, PVHDXLOGENTRYINFO pInfo)
+{
+    VhdxLogEntryHdr EntryHdr;
+
+    vhdxLogCopy(pbLog, cbLog, offEntry, &EntryHdr, sizeof(EntryHdr));
+    vhdxConvLogEntryHdrEndianess(VHDXECONV_F2H, &EntryHdr, &EntryHdr);
+
+    if (   EntryHdr.u32Signature != VHDX_LOG_ENTRY_HEADER_SIGNATURE
+        || EntryHdr.u32EntryLength < VHDX_LOG_SECTOR_SIZE
+        || EntryHdr.u32EntryLength % VHDX_LOG_SECTOR_SIZE
+        || EntryHdr.u32EntryLength > cbLog
+        || EntryHdr.u32Tail % VHDX_LOG_SECTOR_SIZE
+        || EntryHdr.u32Tail >= cbLog
+        || RTUuidCompare(&EntryHdr.UuidLog, &pImage->Hdr.UuidLog)
+        || EntryHdr.u32DescriptorCount > (EntryHdr.u32EntryLength - sizeof(VhdxLogEntryHdr)) / sizeof(VhdxLogDataDesc))
+        return false;
+
+    uint32_t cbDescs = RT_ALIGN_32(sizeof(VhdxLogEntryHdr) + EntryHdr.u32DescriptorCount * sizeof(VhdxLogDataDesc),
+                                   VHDX_LOG_SECTOR_SIZE);
+    if (cbDescs > EntryHdr.u32EntryLength)
+        return false;
+
+    /* Verify the checksum over the complete entry. */
+    vhdxLogCopy(pbLog, cbLog, offEntry, pbEntry, EntryHdr.u32EntryLength);
+    ((PVhdxLogEntryHdr)pbEntry)->u32Checksum = 0;
+    if (RTCrc32C(pbEntry, EntryHdr.u32EntryLength) != EntryHdr.u32Checksum)
+        return false;
+
+    /* Check the descriptors and the data sectors they refer to. */
+    uint32_t cDataSectors = 0;
+    for (uint32_t i = 0; i < EntryHdr.u32DescriptorCount; i++)
+    {
+        uint8_t *pbDesc = pbEntry + sizeof(VhdxLogEntryHdr) + i * sizeof(VhdxLogDataDesc);
+        uint32_t u32Signature = RT_LE2H_U32(*(uint32_t *)pbDesc);
+
+        if (u32Signature == VHDX_LOG_ZERO_DESC_SIGNATURE)
+        {
+            VhdxLogZeroDesc ZeroDesc;
+
+            vhdxConvLogZeroDescEndianess(VHDXECONV_F2H, &ZeroDesc, (PVhdxLogZeroDesc)pbDesc);
+            if (   ZeroDesc.u64ZeroLength % VHDX_LOG_SECTOR_SIZE
+                || ZeroDesc.u64FileOffset % VHDX_LOG_SECTOR_SIZE
+                || ZeroDesc.u64SequenceNumber != EntryHdr.u64SequenceNumber)
+                return false;
+        }
+        else if (u32Signature == VHDX_LOG_DATA_DESC_SIGNATURE)
+        {
+            VhdxLogDataDesc DataDesc;
+            VhdxLogDataSector DataSector;
+            uint32_t offDataSector = cbDescs + cDataSectors * VHDX_LOG_SECTOR_SIZE;
+
+            vhdxConvLogDataDescEndianess(VHDXECONV_F2H, &DataDesc, (PVhdxLogDataDesc)pbDesc);
+            if (   DataDesc.u64FileOffset % VHDX_LOG_SECTOR_SIZE
+                || DataDesc.u64SequenceNumber != EntryHdr.u64SequenceNumber
+                || offDataSector >= EntryHdr.u32EntryLength)
+                return false;
+
+            vhdxConvLogDataSectorEndianess(VHDXECONV_F2H, &DataSector, (PVhdxLogDataSector)(pbEntry + offDataSector));
+            if (   DataSector.u32DataSignature != VHDX_LOG_DATA_SECTOR_SIGNATURE
+                || DataSector.u32SequenceHigh != (uint32_t)(EntryHdr.u64SequenceNumber >> 32)
+                || DataSector.u32SequenceLow != (uint32_t)EntryHdr.u64SequenceNumber)
+                return false;
+
+            cDataSectors++;
+        }
+        else
+            return false;
+    }
+
+    if (cbDescs + cDataSectors * VHDX_LOG_SECTOR_SIZE != EntryHdr.u32EntryLength)
+        return false;
+
+    pInfo->fValid        = true;
+    pInfo->uSeqNo        = EntryHdr.u64SequenceNumber;
+    pInfo->cbEntry       = EntryHdr.u32EntryLength;
+    pInfo->offTail       = EntryHdr.u32Tail;
+    pInfo->cbFileFlushed = EntryHdr.u64FlushedFileOffset;
+    pInfo->cbFileLast    = EntryHdr.u64LastFileOffset;
+    return true;
+}
+
+/**
+ * Applies a single 4KB sector from the log.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ * @param   offFile   File offset of the sector.
+ * @param   pbSector  The sector content.
+ * @param   fInMemory Flag whether to apply the sector to the in memory BAT only.
+ */
+static int vhdxLogSectorApply(PVHDXIMAGE pImage, uint64_t offFile, const uint8_t *pbSector, bool fInMemory)
+{
+    int rc = VINF_SUCCESS;
+
+    if (fInMemory)
+    {
+        if (   offFile >= pImage->offBat
+            && offFile < pImage->offBat + pImage->cbBat)
+        {
+            uint64_t idxBat = (offFile - pImage->offBat) / sizeof(VhdxBatEntry);
+            const uint64_t *pu64Entries = (const uint64_t *)pbSector;
+
+            for (unsigned i = 0; i < VHDX_BAT_ENTRIES_PER_SECTOR && idxBat + i < pImage->cBatEntries; i++)
+                pImage->paBat[idxBat + i].u64BatEntry = RT_LE2H_U64(pu64Entries[i]);
+        }
+        else
+            rc = vdIfError(pImage->pIfError, VERR_NOT_SUPPORTED, RT_SRC_POS,
+                           "VHDX: The log of image \'%s\' changes more than the BAT, replaying it requires write access",
+                           pImage->pszFilename);
+    }
+    else
+        rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage, offFile,
+                                    pbSector, VHDX_LOG_SECTOR_SIZE);
+
+    return rc;
+}
+
+/**
+ * Applies all descriptors of a validated log entry.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ * @param   pbEntry   The log entry.
+ * @param   fInMemory Flag whether to apply the entry to the in memory BAT only.
+ */
+static int vhdxLogEntryApply(PVHDXIMAGE pImage, const uint8_t *pbEntry, bool fInMemory)
+{
+    VhdxLogEntryHdr EntryHdr;
+    int rc = VINF_SUCCESS;
+    uint8_t *pbSector = (uint8_t *)RTMemTmpAlloc(VHDX_LOG_SECTOR_SIZE);
+
+    if (!pbSector)
+        return VERR_NO_MEMORY;
+
+    vhdxConvLogEntryHdrEndianess(VHDXECONV_F2H, &EntryHdr, (PVhdxLogEntryHdr)pbEntry);
+
+    uint32_t cbDescs = RT_ALIGN_32(sizeof(VhdxLogEntryHdr) + EntryHdr.u32DescriptorCount * sizeof(VhdxLogDataDesc),
+                                   VHDX_LOG_SECTOR_SIZE);
+    uint32_t cDataSectors = 0;
+
+    for (uint32_t i = 0; i < EntryHdr.u32DescriptorCount && RT_SUCCESS(rc); i++)
+    {
+        const uint8_t *pbDesc = pbEntry + sizeof(VhdxLogEntryHdr) + i * sizeof(VhdxLogDataDesc);
+
+        if (RT_LE2H_U32(*(const uint32_t *)pbDesc) == VHDX_LOG_ZERO_DESC_SIGNATURE)
+        {
+            VhdxLogZeroDesc ZeroDesc;
+
+            vhdxConvLogZeroDescEndianess(VHDXECONV_F2H, &ZeroDesc, (PVhdxLogZeroDesc)pbDesc);
+            memset(pbSector, 0, VHDX_LOG_SECTOR_SIZE);
+            for (uint64_t off = 0; off < ZeroDesc.u64ZeroLength && RT_SUCCESS(rc); off += VHDX_LOG_SECTOR_SIZE)
+                rc = vhdxLogSectorApply(pImage, ZeroDesc.u64FileOffset + off, pbSector, fInMemory);
+        }
+        else
+        {
+            const VhdxLogDataDesc *pDataDesc = (const VhdxLogDataDesc *)pbDesc;
+            const VhdxLogDataSector *pDataSector = (const VhdxLogDataSector *)(pbEntry + cbDescs + cDataSectors * VHDX_LOG_SECTOR_SIZE);
+
+            /* Reassemble the sector, the leading and trailing bytes are stored in the descriptor. */
+            memcpy(pbSector, &pDataDesc->u64LeadingBytes, sizeof(uint64_t));
+            memcpy(pbSector + sizeof(uint64_t), &pDataSector->u8Data[0], sizeof(pDataSector->u8Data));
+            memcpy(pbSector + VHDX_LOG_SECTOR_SIZE - sizeof(uint32_t), &pDataDesc->u32TrailingBytes, sizeof(uint32_t));
+
+            rc = vhdxLogSectorApply(pImage, RT_LE2H_U64(pDataDesc->u64FileOffset), pbSector, fInMemory);
+            cDataSectors++;
+        }
+    }
+
+    RTMemTmpFree(pbSector);
+    return rc;
+}
+
+/**
+ * Replays the log of the image.
+ *
+ * The active sequence is the chain of entries with consecutive sequence
+ * numbers ending in the entry with the highest sequence number whose tail
+ * is part of the chain. All entries from the tail up to the head are applied
+ * in order.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ * @param   fInMemory Flag whether to apply the log to the in memory BAT only
+ *                    because the image is opened readonly. Fails if the log
+ *                    changes anything else.
+ */
+static int vhdxLogReplay(PVHDXIMAGE pImage, bool fInMemory)
+{
+    uint32_t cbLog = pImage->Hdr.u32LogLength;
+    uint32_t cEntriesMax = cbLog / VHDX_LOG_SECTOR_SIZE;
+    int rc = VINF_SUCCESS;
+
+    LogFlowFunc(("pImage=%#p fInMemory=%RTbool\n", pImage, fInMemory));
+
+    uint8_t *pbLog = (uint8_t *)RTMemAlloc(cbLog);
+    uint8_t *pbEntry = (uint8_t *)RTMemAlloc(cbLog);
+    PVHDXLOGENTRYINFO paInfo = (PVHDXLOGENTRYINFO)RTMemAllocZ(cEntriesMax * sizeof(VHDXLOGENTRYINFO));
+
+    if (pbLog && pbEntry && paInfo)
+    {
+        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, pImage->Hdr.u64LogOffset,
+                                   pbLog, cbLog);
+        if (RT_SUCCESS(rc))
+        {
+            uint32_t idxHead = UINT32_MAX;
+
+            for (uint32_t i = 0; i < cEntriesMax; i++)
+                vhdxLogEntryValidate(pImage, pbLog, cbLog, i * VHDX_LOG_SECTOR_SIZE, pbEntry, &paInfo[i]);
+
+            /* Find the head of the active sequence. */
+            for (uint32_t i = 0; i < cEntriesMax; i++)
+            {
+                if (   !paInfo[i].fValid
+                    || (   idxHead != UINT32_MAX
+                        && paInfo[i].uSeqNo <= paInfo[idxHead].uSeqNo))
+                    continue;
+
+                uint32_t idx = paInfo[i].offTail / VHDX_LOG_SECTOR_SIZE;
+                for (uint32_t cSteps = 0; cSteps < cEntriesMax && idx != i; cSteps++)
+                {
+                    uint32_t idxNext = ((idx * VHDX_LOG_SECTOR_SIZE + paInfo[idx].cbEntry) % cbLog) / VHDX_LOG_SECTOR_SIZE;
+
+                    if (   !paInfo[idx].fValid
+                        || !paInfo[idxNext].fValid
+                        || paInfo[idxNext].uSeqNo != paInfo[idx].uSeqNo + 1)
+                        break;
+                    idx = idxNext;
+                }
+
+                if (idx == i && paInfo[i].fValid)
+                    idxHead = i;
+            }
+
+            if (idxHead != UINT32_MAX)
+            {
+                uint64_t cbFile = 0;
+
+                LogRel(("VHDX: Replaying the log of image \'%s\' (head sequence number %llu)\n",
+                        pImage->pszFilename, paInfo[idxHead].uSeqNo));
+
+                if (!fInMemory)
+                {
+                    rc = vdIfIoIntFileGetSize(pImage->pIfIo, pImage->pStorage, &cbFile);
+                    if (   RT_SUCCESS(rc)
+                        && cbFile < paInfo[idxHead].cbFileFlushed)
+                        rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
+                                       "VHDX: Image \'%s\' is smaller than recorded in the log, the log can't be replayed",
+                                       pImage->pszFilename);
+                }
+
+                /* Apply everything from the tail to the head. */
+                uint32_t idx = paInfo[idxHead].offTail / VHDX_LOG_SECTOR_SIZE;
+                while (RT_SUCCESS(rc))
+                {
+                    vhdxLogCopy(pbLog, cbLog, idx * VHDX_LOG_SECTOR_SIZE, pbEntry, paInfo[idx].cbEntry);
+                    rc = vhdxLogEntryApply(pImage, pbEntry, fInMemory);
+                    if (idx == idxHead)
+                        break;
+                    idx = ((idx * VHDX_LOG_SECTOR_SIZE + paInfo[idx].cbEntry) % cbLog) / VHDX_LOG_SECTOR_SIZE;
+                }
+
+                if (   RT_SUCCESS(rc)
+                    && !fInMemory
+                    && cbFile < paInfo[idxHead].cbFileLast)
+                    rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, paInfo[idxHead].cbFileLast);
+            }
+
+            /* The log is empty now. */
+            if (   RT_SUCCESS(rc)
+                && !fInMemory)
+            {
+                rc = vdIfIoIntFileFlushSync(pImage->pIfIo, pImage->pStorage);
+                if (RT_SUCCESS(rc))
+                {
+                    RTUuidClear(&pImage->Hdr.UuidLog);
+                    rc = vhdxHeaderUpdate(pImage);
+                }
+            }
+
+            if (RT_FAILURE(rc))
+                rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                               "VHDX: Replaying the log of image \'%s\' failed",
+                               pImage->pszFilename);
+        }
+        else
+            rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                           "VHDX: Reading the log of image \'%s\' failed",
+                           pImage->pszFilename);
+    }
+    else
+        rc = vdIfError(pImage->pIfError, VERR_NO_MEMORY, RT_SRC_POS,
+                       "VHDX: Out of memory allocating memory for the log of image \'%s\'",
+                       pImage->pszFilename);
+
+    if (pbLog)
+        RTMemFree(pbLog);
+    if (pbEntry)
+        RTMemFree(pbEntry);
+    if (paInfo)
+        RTMemFree(paInfo);
 
     LogFlowFunc(("returns rc=%Rrc\n", rc));
     return rc;
@@ -1681,9 +2769,10 @@ static int vhdxOpenImage(PVHDXIMAGE pImage, unsigned uOpenFlags)
     pImage->pIfIo = VDIfIoIntGet(pImage->pVDIfsImage);
     AssertPtrReturn(pImage->pIfIo, VERR_INVALID_PARAMETER);
 
-    /* Refuse write access, it is not implemented so far. */
-    if (!(uOpenFlags & VD_OPEN_FLAGS_READONLY))
-        return VERR_NOT_SUPPORTED;
+    pImage->uImageFlags      = 0;
+    pImage->fModified        = false;
+    pImage->fHdrDirty        = false;
+    pImage->cBatSectorsDirty = 0;
 
     /*
      * Open the image.
@@ -1713,9 +2802,70 @@ static int vhdxOpenImage(PVHDXIMAGE pImage, unsigned uOpenFlags)
                 else
                     rc = vhdxFindAndLoadCurrentHeader(pImage);
 
+                /*
+                 * A non empty log must be replayed before anything else is loaded
+                 * because it might change the region table and the metadata.
+                 */
+                if (   RT_SUCCESS(rc)
+                    && !RTUuidIsNull(&pImage->Hdr.UuidLog)
+                    && !(uOpenFlags & VD_OPEN_FLAGS_READONLY))
+                    rc = vhdxLogReplay(pImage, false /* fInMemory */);
+
                 /* Load the region table. */
                 if (RT_SUCCESS(rc))
                     rc = vhdxLoadRegionTable(pImage);
+
+                /*
+                 * Without write access the log can only be applied to the BAT in memory,
+                 * which is sufficient for everything written by this backend.
+                 */
+                if (   RT_SUCCESS(rc)
+                    && !RTUuidIsNull(&pImage->Hdr.UuidLog)
+                    && (uOpenFlags & VD_OPEN_FLAGS_READONLY))
+                    rc = vhdxLogReplay(pImage, true /* fInMemory */);
+
+                if (   RT_SUCCESS(rc)
+                    && (pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF))
+                {
+                    pImage->cbSectorBitmap = pImage->cbBlock / pImage->cbLogicalSector / 8;
+                    pImage->pbSectorBitmap = (uint8_t *)RTMemAllocZ(pImage->cbSectorBitmap);
+                    if (!pImage->pbSectorBitmap)
+                        rc = VERR_NO_MEMORY;
+                }
+
+                if (   RT_SUCCESS(rc)
+                    && !(uOpenFlags & VD_OPEN_FLAGS_READONLY))
+                {
+                    uint32_t cBatSectors = RT_ALIGN_32(pImage->cBatEntries, VHDX_BAT_ENTRIES_PER_SECTOR) / VHDX_BAT_ENTRIES_PER_SECTOR;
+
+                    /* New blocks are appended after everything referenced by the BAT. */
+                    rc = vdIfIoIntFileGetSize(pImage->pIfIo, pImage->pStorage, &cbFile);
+                    if (RT_SUCCESS(rc))
+                    {
+                        pImage->offEof = RT_ALIGN_64(cbFile, _1M);
+                        for (uint32_t i = 0; i < pImage->cBatEntries; i++)
+                        {
+                            uint64_t offBlock = VHDX_BAT_ENTRY_GET_FILE_OFFSET(pImage->paBat[i].u64BatEntry);
+                            uint64_t cbEntry = ((i + 1) % (pImage->uChunkRatio + 1)) == 0
+                                             ? _1M /* sector bitmap block */
+                                             : pImage->cbBlock;
+                            if (offBlock)
+                                pImage->offEof = RT_MAX(pImage->offEof, offBlock + cbEntry);
+                        }
+                        pImage->cbFileFlushed = cbFile;
+
+                        pImage->pbmBatDirty = (uint32_t *)RTMemAllocZ(RT_ALIGN_32(cBatSectors, 32) / 8);
+                        if (!pImage->pbmBatDirty)
+                            rc = VERR_NO_MEMORY;
+                    }
+
+                    /*
+                     * Update the header right away instead of on the first write,
+                     * it requires synchronous I/O which must not happen there.
+                     */
+                    if (RT_SUCCESS(rc))
+                        rc = vhdxImageSetModified(pImage);
+                }
             }
         }
         else
@@ -1729,6 +2879,290 @@ static int vhdxOpenImage(PVHDXIMAGE pImage, unsigned uOpenFlags)
     return rc;
 }
 
+/**
+ * Internal: Writes the metadata region of a new image.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ * @param   fFixed    Flag whether the image is fixed.
+ * @param   pUuid     UUID to use for the page 83 data, NULL to create a random one.
+ */
+static int vhdxCreateMetadataRegion(PVHDXIMAGE pImage, bool fFixed, PCRTUUID pUuid)
+{
+    static const struct
+    {
+        const char *pszItemUuid;
+        uint32_t    cbItem;
+        uint32_t    fFlags;
+    } s_aItems[] =
+    {
+        { VHDX_METADATA_TBL_ENTRY_ITEM_FILE_PARAMS,    sizeof(VhdxFileParameters),          VHDX_METADATA_TBL_ENTRY_FLAGS_IS_REQUIRED },
+        { VHDX_METADATA_TBL_ENTRY_ITEM_VDISK_SIZE,     sizeof(VhdxVDiskSize),               VHDX_METADATA_TBL_ENTRY_FLAGS_IS_VDISK | VHDX_METADATA_TBL_ENTRY_FLAGS_IS_REQUIRED },
+        { VHDX_METADATA_TBL_ENTRY_ITEM_PAGE83_DATA,    sizeof(VhdxPage83Data),              VHDX_METADATA_TBL_ENTRY_FLAGS_IS_VDISK | VHDX_METADATA_TBL_ENTRY_FLAGS_IS_REQUIRED },
+        { VHDX_METADATA_TBL_ENTRY_ITEM_LOG_SECT_SIZE,  sizeof(VhdxVDiskLogicalSectorSize),  VHDX_METADATA_TBL_ENTRY_FLAGS_IS_VDISK | VHDX_METADATA_TBL_ENTRY_FLAGS_IS_REQUIRED },
+        { VHDX_METADATA_TBL_ENTRY_ITEM_PHYS_SECT_SIZE, sizeof(VhdxVDiskPhysicalSectorSize), VHDX_METADATA_TBL_ENTRY_FLAGS_IS_VDISK | VHDX_METADATA_TBL_ENTRY_FLAGS_IS_REQUIRED }
+    };
+    int rc = VINF_SUCCESS;
+    uint32_t cbMetadata = VHDX_METADATA_ITEM_OFFSET_MIN + _4K;
+    uint8_t *pbMetadata = (uint8_t *)RTMemTmpAllocZ(cbMetadata);
+
+    if (pbMetadata)
+    {
+        PVhdxMetadataTblHdr pMetadataTblHdr = (PVhdxMetadataTblHdr)pbMetadata;
+        PVhdxMetadataTblEntry paMetadataTblEntries = (PVhdxMetadataTblEntry)(pMetadataTblHdr + 1);
+        uint32_t offItem = VHDX_METADATA_ITEM_OFFSET_MIN;
+
+        pMetadataTblHdr->u64Signature  = VHDX_METADATA_TBL_HDR_SIGNATURE;
+        pMetadataTblHdr->u16EntryCount = RT_ELEMENTS(s_aItems);
+        vhdxConvMetadataTblHdrEndianess(VHDXECONV_H2F, pMetadataTblHdr, pMetadataTblHdr);
+
+        for (unsigned i = 0; i < RT_ELEMENTS(s_aItems); i++)
+        {
+            PVhdxMetadataTblEntry pEntry = &paMetadataTblEntries[i];
+
+            RTUuidFromStr(&pEntry->UuidItem, s_aItems[i].pszItemUuid);
+            pEntry->u32Offset = offItem;
+            pEntry->u32Length = s_aItems[i].cbItem;
+            pEntry->u32Flags  = s_aItems[i].fFlags;
+            vhdxConvMetadataTblEntryEndianess(VHDXECONV_H2F, pEntry, pEntry);
+
+            offItem += s_aItems[i].cbItem;
+        }
+
+        /* The items, in the same order as in the table. */
+        uint8_t *pbItem = pbMetadata + VHDX_METADATA_ITEM_OFFSET_MIN;
+        PVhdxFileParameters pFileParams = (PVhdxFileParameters)pbItem;
+        pFileParams->u32BlockSize = (uint32_t)pImage->cbBlock;
+        pFileParams->u32Flags     = fFixed ? VHDX_FILE_PARAMETERS_FLAGS_LEAVE_BLOCKS_ALLOCATED : 0;
+        vhdxConvFileParamsEndianess(VHDXECONV_H2F, pFileParams, pFileParams);
+        pbItem += sizeof(VhdxFileParameters);
+
+        PVhdxVDiskSize pVDiskSize = (PVhdxVDiskSize)pbItem;
+        pVDiskSize->u64VDiskSize = pImage->cbSize;
+        vhdxConvVDiskSizeEndianess(VHDXECONV_H2F, pVDiskSize, pVDiskSize);
+        pbItem += sizeof(VhdxVDiskSize);
+
+        PVhdxPage83Data pPage83Data = (PVhdxPage83Data)pbItem;
+        if (pUuid)
+            pPage83Data->UuidPage83Data = *pUuid;
+        else
+            RTUuidCreate(&pPage83Data->UuidPage83Data);
+        vhdxConvPage83DataEndianess(VHDXECONV_H2F, pPage83Data, pPage83Data);
+        pbItem += sizeof(VhdxPage83Data);
+
+        PVhdxVDiskLogicalSectorSize pLogSectSize = (PVhdxVDiskLogicalSectorSize)pbItem;
+        pLogSectSize->u32LogicalSectorSize = pImage->cbLogicalSector;
+        vhdxConvVDiskLogSectSizeEndianess(VHDXECONV_H2F, pLogSectSize, pLogSectSize);
+        pbItem += sizeof(VhdxVDiskLogicalSectorSize);
+
+        PVhdxVDiskPhysicalSectorSize pPhysSectSize = (PVhdxVDiskPhysicalSectorSize)pbItem;
+        pPhysSectSize->u32PhysicalSectorSize = pImage->cbLogicalSector;
+        vhdxConvVDiskPhysSectSizeEndianess(VHDXECONV_H2F, pPhysSectSize, pPhysSectSize);
+
+        rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage, VHDX_CREATE_METADATA_OFFSET,
+                                    pbMetadata, cbMetadata);
+        RTMemTmpFree(pbMetadata);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    return rc;
+}
+
+/**
+ * Internal: Writes both copies of the region table of a new image.
+ *
+ * @returns VBox status code.
+ * @param   pImage    Image instance data.
+ */
+static int vhdxCreateRegionTable(PVHDXIMAGE pImage)
+{
+    int rc = VINF_SUCCESS;
+    uint8_t *pbRegionTbl = (uint8_t *)RTMemTmpAllocZ(VHDX_REGION_TBL_SIZE_MAX);
+
+    if (pbRegionTbl)
+    {
+        PVhdxRegionTblHdr pRegionTblHdr = (PVhdxRegionTblHdr)pbRegionTbl;
+        PVhdxRegionTblEntry paRegionTblEntries = (PVhdxRegionTblEntry)(pRegionTblHdr + 1);
+
+        pRegionTblHdr->u32Signature  = VHDX_REGION_TBL_HDR_SIGNATURE;
+        pRegionTblHdr->u32EntryCount = 2;
+        vhdxConvRegionTblHdrEndianess(VHDXECONV_H2F, pRegionTblHdr, pRegionTblHdr);
+
+        RTUuidFromStr(&paRegionTblEntries[0].UuidObject, VHDX_REGION_TBL_ENTRY_UUID_BAT);
+        paRegionTblEntries[0].u64FileOffset = pImage->offBat;
+        paRegionTblEntries[0].u32Length     = pImage->cbBat;
+        paRegionTblEntries[0].u32Flags      = VHDX_REGION_TBL_ENTRY_FLAGS_IS_REQUIRED;
+        vhdxConvRegionTblEntryEndianess(VHDXECONV_H2F, &paRegionTblEntries[0], &paRegionTblEntries[0]);
+
+        RTUuidFromStr(&paRegionTblEntries[1].UuidObject, VHDX_REGION_TBL_ENTRY_UUID_METADATA);
+        paRegionTblEntries[1].u64FileOffset = VHDX_CREATE_METADATA_OFFSET;
+        paRegionTblEntries[1].u32Length     = VHDX_CREATE_METADATA_LENGTH;
+        paRegionTblEntries[1].u32Flags      = VHDX_REGION_TBL_ENTRY_FLAGS_IS_REQUIRED;
+        vhdxConvRegionTblEntryEndianess(VHDXECONV_H2F, &paRegionTblEntries[1], &paRegionTblEntries[1]);
+
+        pRegionTblHdr->u32Checksum = RT_H2LE_U32(RTCrc32C(pbRegionTbl, VHDX_REGION_TBL_SIZE_MAX));
+
+        rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage, VHDX_REGION_TBL_HDR_OFFSET,
+                                    pbRegionTbl, VHDX_REGION_TBL_SIZE_MAX);
+        if (RT_SUCCESS(rc))
+            rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage, VHDX_REGION_TBL_HDR_OFFSET2,
+                                        pbRegionTbl, VHDX_REGION_TBL_SIZE_MAX);
+        RTMemTmpFree(pbRegionTbl);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    return rc;
+}
+
+/**
+ * Internal: Create a VHDX image.
+ */
+static int vhdxCreateImage(PVHDXIMAGE pImage, uint64_t cbSize,
+                           unsigned uImageFlags, PCRTUUID pUuid,
+                           unsigned uOpenFlags, PFNVDPROGRESS pfnProgress,
+                           void *pvUser, unsigned uPercentStart,
+                           unsigned uPercentSpan)
+{
+    int rc = VINF_SUCCESS;
+
+    pImage->pIfError = VDIfErrorGet(pImage->pVDIfsDisk);
+    pImage->pIfIo = VDIfIoIntGet(pImage->pVDIfsImage);
+    AssertPtrReturn(pImage->pIfIo, VERR_INVALID_PARAMETER);
+
+    if (uImageFlags & VD_IMAGE_FLAGS_DIFF)
+        return vdIfError(pImage->pIfError, VERR_VD_INVALID_TYPE, RT_SRC_POS,
+                         "VHDX: Creating differencing images is not supported");
+
+    pImage->uOpenFlags      = uOpenFlags & ~VD_OPEN_FLAGS_READONLY;
+    pImage->uImageFlags     = uImageFlags;
+    pImage->uVersion        = VHDX_HEADER_VHDX_VERSION;
+    pImage->cbSize          = cbSize;
+    pImage->cbBlock         = VHDX_CREATE_BLOCK_SIZE;
+    pImage->cbLogicalSector = VHDX_CREATE_SECTOR_SIZE;
+    pImage->uChunkRatio     = (uint32_t)((RT_BIT_64(23) * pImage->cbLogicalSector) / pImage->cbBlock);
+
+    uint64_t cDataBlocks64 = (cbSize + pImage->cbBlock - 1) / pImage->cbBlock;
+    uint32_t cDataBlocks = (uint32_t)cDataBlocks64;
+    if (   !cDataBlocks
+        || cDataBlocks != cDataBlocks64
+        || cbSize % pImage->cbLogicalSector)
+        return vdIfError(pImage->pIfError, VERR_VD_INVALID_SIZE, RT_SRC_POS,
+                         "VHDX: Invalid size %llu for image \'%s\'", cbSize, pImage->pszFilename);
+
+    pImage->cBatEntries = cDataBlocks + (cDataBlocks - 1) / pImage->uChunkRatio;
+    pImage->offBat      = VHDX_CREATE_BAT_OFFSET;
+    pImage->cbBat       = RT_ALIGN_32(pImage->cBatEntries * sizeof(VhdxBatEntry), _1M);
+    pImage->offEof      = pImage->offBat + pImage->cbBat;
+
+    rc = vdIfIoIntFileOpen(pImage->pIfIo, pImage->pszFilename,
+                           VDOpenFlagsToFileOpenFlags(pImage->uOpenFlags, true /* fCreate */),
+                           &pImage->pStorage);
+    if (RT_FAILURE(rc))
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                         "VHDX: cannot create image \'%s\'", pImage->pszFilename);
+
+    /* The file identifier. */
+    VhdxFileIdentifier FileIdentifier;
+    RT_ZERO(FileIdentifier);
+    FileIdentifier.u64Signature = VHDX_FILE_IDENTIFIER_SIGNATURE;
+    vhdxConvFileIdentifierEndianess(VHDXECONV_H2F, &FileIdentifier, &FileIdentifier);
+    rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage, VHDX_FILE_IDENTIFIER_OFFSET,
+                                &FileIdentifier, sizeof(FileIdentifier));
+
+    /* Both header copies, the second one written becomes the current one. */
+    if (RT_SUCCESS(rc))
+    {
+        RT_ZERO(pImage->Hdr);
+        pImage->Hdr.u32Signature   = VHDX_HEADER_SIGNATURE;
+        pImage->Hdr.u16LogVersion  = VHDX_HEADER_LOG_VERSION;
+        pImage->Hdr.u16Version     = VHDX_HEADER_VHDX_VERSION;
+        pImage->Hdr.u32LogLength   = VHDX_CREATE_LOG_LENGTH;
+        pImage->Hdr.u64LogOffset   = VHDX_CREATE_LOG_OFFSET;
+        RTUuidCreate(&pImage->Hdr.UuidFileWrite);
+        RTUuidCreate(&pImage->Hdr.UuidDataWrite);
+        pImage->idxHdrCurrent = 1;
+
+        rc = vhdxHeaderUpdate(pImage);
+        if (RT_SUCCESS(rc))
+            rc = vhdxHeaderUpdate(pImage);
+    }
+
+    if (RT_SUCCESS(rc))
+        rc = vhdxCreateRegionTable(pImage);
+    if (RT_SUCCESS(rc))
+        rc = vhdxCreateMetadataRegion(pImage, RT_BOOL(uImageFlags & VD_IMAGE_FLAGS_FIXED), pUuid);
+
+    if (RT_SUCCESS(rc) && pfnProgress)
+        pfnProgress(pvUser, uPercentStart + uPercentSpan * 10 / 100);
+
+    /*
+     * The BAT of a dynamic image is empty. A fixed image has all blocks allocated
+     * one after another following the BAT.
+     */
+    if (   RT_SUCCESS(rc)
+        && (uImageFlags & VD_IMAGE_FLAGS_FIXED))
+    {
+        PVhdxBatEntry paBatSector = (PVhdxBatEntry)RTMemTmpAllocZ(VHDX_LOG_SECTOR_SIZE);
+
+        if (paBatSector)
+        {
+            uint32_t cBatSectors = RT_ALIGN_32(pImage->cBatEntries, VHDX_BAT_ENTRIES_PER_SECTOR) / VHDX_BAT_ENTRIES_PER_SECTOR;
+            uint32_t idxBat = 0;
+
+            for (uint32_t idxSector = 0; idxSector < cBatSectors && RT_SUCCESS(rc); idxSector++)
+            {
+                memset(paBatSector, 0, VHDX_LOG_SECTOR_SIZE);
+                for (unsigned i = 0; i < VHDX_BAT_ENTRIES_PER_SECTOR && idxBat < pImage->cBatEntries; i++, idxBat++)
+                {
+                    /* Sector bitmap entries stay not present. */
+                    if (((idxBat + 1) % (pImage->uChunkRatio + 1)) != 0)
+                    {
+                        paBatSector[i].u64BatEntry = RT_H2LE_U64(VHDX_BAT_ENTRY_CREATE(pImage->offEof,
+                                                                                       VHDX_BAT_ENTRY_PAYLOAD_BLOCK_FULLY_PRESENT));
+                        pImage->offEof += pImage->cbBlock;
+                    }
+                }
+
+                rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage,
+                                            pImage->offBat + idxSector * VHDX_LOG_SECTOR_SIZE,
+                                            paBatSector, VHDX_LOG_SECTOR_SIZE);
+
+                if (RT_SUCCESS(rc) && pfnProgress)
+                    pfnProgress(pvUser, uPercentStart + uPercentSpan * 10 / 100
+                                        + (idxSector + 1) * (uPercentSpan * 80 / 100) / cBatSectors);
+            }
+
+            RTMemTmpFree(paBatSector);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    if (RT_SUCCESS(rc))
+        rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pImage->offEof);
+    if (RT_SUCCESS(rc))
+        rc = vdIfIoIntFileFlushSync(pImage->pIfIo, pImage->pStorage);
+
+    if (RT_FAILURE(rc))
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                       "VHDX: writing the initial structures of image \'%s\' failed",
+                       pImage->pszFilename);
+    else
+    {
+        /* Reopen with the requested flags to load everything the normal way. */
+        vhdxFreeImage(pImage, false);
+        rc = vhdxOpenImage(pImage, uOpenFlags);
+    }
+
+    if (RT_SUCCESS(rc) && pfnProgress)
+        pfnProgress(pvUser, uPercentStart + uPercentSpan);
+
+    if (RT_FAILURE(rc))
+        vhdxFreeImage(pImage, rc != VERR_ALREADY_EXISTS);
+    return rc;
+}
 
 /** @copydoc VBOXHDDBACKEND::pfnCheckIfValid */
 static int vhdxCheckIfValid(const char *pszFilename, PVDINTERFACE pVDIfsDisk,
@@ -1824,6 +3258,61 @@ static int vhdxOpen(const char *pszFilename, unsigned uOpenFlags,
     return rc;
 }
 
+/** @copydoc VBOXHDDBACKEND::pfnCreate */
+static int vhdxCreate(const char *pszFilename, uint64_t cbSize,
+                      unsigned uImageFlags, const char *pszComment,
+                      PCVDGEOMETRY pPCHSGeometry, PCVDGEOMETRY pLCHSGeometry,
+                      PCRTUUID pUuid, unsigned uOpenFlags,
+                      unsigned uPercentStart, unsigned uPercentSpan,
+                      PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
+                      PVDINTERFACE pVDIfsOperation, void **ppBackendData)
+{
+    LogFlowFunc(("pszFilename=\"%s\" cbSize=%llu uImageFlags=%#x pszComment=\"%s\" pPCHSGeometry=%#p pLCHSGeometry=%#p Uuid=%RTuuid uOpenFlags=%#x uPercentStart=%u uPercentSpan=%u pVDIfsDisk=%#p pVDIfsImage=%#p pVDIfsOperation=%#p ppBackendData=%#p",
+                 pszFilename, cbSize, uImageFlags, pszComment, pPCHSGeometry, pLCHSGeometry, pUuid, uOpenFlags, uPercentStart, uPercentSpan, pVDIfsDisk, pVDIfsImage, pVDIfsOperation, ppBackendData));
+    int rc = VINF_SUCCESS;
+    PVHDXIMAGE pImage;
+
+    PFNVDPROGRESS pfnProgress = NULL;
+    void *pvUser = NULL;
+    PVDINTERFACEPROGRESS pIfProgress = VDIfProgressGet(pVDIfsOperation);
+    if (pIfProgress)
+    {
+        pfnProgress = pIfProgress->pfnProgress;
+        pvUser = pIfProgress->Core.pvUser;
+    }
+
+    /* Check open flags and remaining arguments. */
+    if (   uOpenFlags & ~VD_OPEN_FLAGS_MASK
+        || !VALID_PTR(pszFilename)
+        || !*pszFilename
+        || !VALID_PTR(pPCHSGeometry)
+        || !VALID_PTR(pLCHSGeometry))
+        rc = VERR_INVALID_PARAMETER;
+    else
+    {
+        pImage = (PVHDXIMAGE)RTMemAllocZ(sizeof(VHDXIMAGE));
+        if (!pImage)
+            rc = VERR_NO_MEMORY;
+        else
+        {
+            pImage->pszFilename = pszFilename;
+            pImage->pStorage = NULL;
+            pImage->pVDIfsDisk = pVDIfsDisk;
+            pImage->pVDIfsImage = pVDIfsImage;
+
+            rc = vhdxCreateImage(pImage, cbSize, uImageFlags, pUuid, uOpenFlags,
+                                 pfnProgress, pvUser, uPercentStart, uPercentSpan);
+            if (RT_SUCCESS(rc))
+                *ppBackendData = pImage;
+            else
+                RTMemFree(pImage);
+        }
+    }
+
+    LogFlowFunc(("returns %Rrc (pBackendData=%#p)\n", rc, *ppBackendData));
+    return rc;
+}
+
 /** @copydoc VBOXHDDBACKEND::pfnRename */
 static int vhdxRename(void *pBackendData, const char *pszFilename)
 {
@@ -1898,7 +3387,8 @@ static int vhdxRead(void *pBackendData, uint64_t uOffset, size_t cbToRead,
         rc = VERR_INVALID_PARAMETER;
     else
     {
-        uint32_t idxBat = (uint32_t)(uOffset / pImage->cbBlock); Assert(idxBat == uOffset / pImage->cbBlock);
+        uint32_t idxBlock = (uint32_t)(uOffset / pImage->cbBlock); Assert(idxBlock == uOffset / pImage->cbBlock);
+        uint32_t idxBat = idxBlock;
         uint32_t offRead = uOffset % pImage->cbBlock;
         uint64_t uBatEntry;
 
@@ -1910,6 +3400,16 @@ static int vhdxRead(void *pBackendData, uint64_t uOffset, size_t cbToRead,
         switch (VHDX_BAT_ENTRY_GET_STATE(uBatEntry))
         {
             case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_NOT_PRESENT:
+            {
+                /* The data is in the parent for differencing images. */
+                if (pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF)
+                {
+                    rc = VERR_VD_BLOCK_FREE;
+                    break;
+                }
+                vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
+                break;
+            }
             case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_UNDEFINED:
             case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_ZERO:
             case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_UNMAPPED:
@@ -1925,6 +3425,47 @@ static int vhdxRead(void *pBackendData, uint64_t uOffset, size_t cbToRead,
                 break;
             }
             case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT:
+            {
+                uint64_t uSbEntry = vhdxSectorBitmapBatEntryGet(pImage, idxBlock);
+                PVDMETAXFER pMetaXfer = NULL;
+
+                if (   !(pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF)
+                    || VHDX_BAT_ENTRY_GET_STATE(uSbEntry) != VHDX_BAT_ENTRY_SB_BLOCK_PRESENT)
+                {
+                    rc = VERR_VD_GEN_INVALID_HEADER;
+                    break;
+                }
+
+                /* Read the part of the sector bitmap covering the block. */
+                rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pImage->pStorage,
+                                             VHDX_BAT_ENTRY_GET_FILE_OFFSET(uSbEntry)
+                                           + (idxBlock % pImage->uChunkRatio) * pImage->cbSectorBitmap,
+                                           pImage->pbSectorBitmap, pImage->cbSectorBitmap,
+                                           pIoCtx, &pMetaXfer, NULL, NULL);
+                if (RT_SUCCESS(rc))
+                {
+                    uint32_t iSector = offRead / pImage->cbLogicalSector;
+                    uint32_t cSectors = (uint32_t)(cbToRead / pImage->cbLogicalSector);
+                    bool fPresent = ASMBitTest(pImage->pbSectorBitmap, iSector);
+                    uint32_t cSectorsRun = 1;
+
+                    vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
+
+                    /* Clip the read to the sectors having the same state as the first one. */
+                    while (   cSectorsRun < cSectors
+                           && ASMBitTest(pImage->pbSectorBitmap, iSector + cSectorsRun) == fPresent)
+                        cSectorsRun++;
+
+                    cbToRead = cSectorsRun * pImage->cbLogicalSector;
+                    if (fPresent)
+                        rc = vdIfIoIntFileReadUser(pImage->pIfIo, pImage->pStorage,
+                                                   VHDX_BAT_ENTRY_GET_FILE_OFFSET(uBatEntry) + offRead,
+                                                   pIoCtx, cbToRead);
+                    else
+                        rc = VERR_VD_BLOCK_FREE;
+                }
+                break;
+            }
             default:
                 rc = VERR_INVALID_PARAMETER;
                 break;
@@ -1946,19 +3487,102 @@ static int vhdxWrite(void *pBackendData, uint64_t uOffset,  size_t cbToWrite,
     LogFlowFunc(("pBackendData=%#p uOffset=%llu pIoCtx=%#p cbToWrite=%zu pcbWriteProcess=%#p pcbPreRead=%#p pcbPostRead=%#p\n",
                  pBackendData, uOffset, pIoCtx, cbToWrite, pcbWriteProcess, pcbPreRead, pcbPostRead));
     PVHDXIMAGE pImage = (PVHDXIMAGE)pBackendData;
-    int rc;
+    int rc = VINF_SUCCESS;
 
     AssertPtr(pImage);
     Assert(uOffset % 512 == 0);
     Assert(cbToWrite % 512 == 0);
 
+    /* The last block is written completely when it gets allocated, even if the disk ends inside. */
     if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
         rc = VERR_VD_IMAGE_READ_ONLY;
-    else if (   uOffset + cbToWrite > pImage->cbSize
+    else if (   uOffset >= pImage->cbSize
+             || uOffset + cbToWrite > RT_ALIGN_64(pImage->cbSize, pImage->cbBlock)
              || cbToWrite == 0)
         rc = VERR_INVALID_PARAMETER;
-    else
-        rc = VERR_NOT_SUPPORTED;
+
+    if (RT_SUCCESS(rc))
+    {
+        uint32_t idxBlock = (uint32_t)(uOffset / pImage->cbBlock); Assert(idxBlock == uOffset / pImage->cbBlock);
+        uint32_t idxBat = idxBlock + idxBlock / pImage->uChunkRatio;
+        uint32_t offWrite = uOffset % pImage->cbBlock;
+        uint64_t uBatEntry = pImage->paBat[idxBat].u64BatEntry;
+
+        cbToWrite = RT_MIN(cbToWrite, pImage->cbBlock - offWrite);
+
+        switch (VHDX_BAT_ENTRY_GET_STATE(uBatEntry))
+        {
+            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_FULLY_PRESENT:
+            {
+                rc = vdIfIoIntFileWriteUser(pImage->pIfIo, pImage->pStorage,
+                                            VHDX_BAT_ENTRY_GET_FILE_OFFSET(uBatEntry) + offWrite,
+                                            pIoCtx, cbToWrite, NULL, NULL);
+                break;
+            }
+            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT:
+            {
+                if (!(pImage->uImageFlags & VD_IMAGE_FLAGS_DIFF))
+                {
+                    rc = VERR_VD_GEN_INVALID_HEADER;
+                    break;
+                }
+                /* fall through */
+            }
+            default:
+            {
+                /*
+                 * Allocate a new block or turn a partially present block into a fully
+                 * present one instead of updating the sector bitmap. Only complete blocks
+                 * are written, let the upper layer fill in the rest otherwise. The present
+                 * sectors of a partially present block are read from this image then.
+                 */
+                if (   (fWrite & VD_WRITE_NO_ALLOC)
+                    || cbToWrite != pImage->cbBlock)
+                {
+                    *pcbPreRead = offWrite;
+                    *pcbPostRead = pImage->cbBlock - cbToWrite - offWrite;
+                    rc = VERR_VD_BLOCK_FREE;
+                    break;
+                }
+
+                PVHDXMETAUPDATE pUpdate = (PVHDXMETAUPDATE)RTMemAllocZ(sizeof(VHDXMETAUPDATE));
+                if (!pUpdate)
+                {
+                    rc = VERR_NO_MEMORY;
+                    break;
+                }
+
+                uint64_t offBlock;
+                if (VHDX_BAT_ENTRY_GET_STATE(uBatEntry) == VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT)
+                    offBlock = VHDX_BAT_ENTRY_GET_FILE_OFFSET(uBatEntry);
+                else
+                {
+                    offBlock = pImage->offEof;
+                    pImage->offEof += pImage->cbBlock;
+                }
+
+                /*
+                 * The data is written and flushed before the log entry changing the BAT,
+                 * the BAT must never reference a block whose data isn't on the disk.
+                 */
+                pUpdate->enmState    = VHDXMETAUPDATESTATE_DATA_FLUSH;
+                pUpdate->idxBat      = idxBat;
+                pUpdate->uBatEntry   = VHDX_BAT_ENTRY_CREATE(offBlock, VHDX_BAT_ENTRY_PAYLOAD_BLOCK_FULLY_PRESENT);
+                pUpdate->offBlockEnd = offBlock + pImage->cbBlock;
+
+                rc = vdIfIoIntFileWriteUser(pImage->pIfIo, pImage->pStorage, offBlock,
+                                            pIoCtx, cbToWrite, vhdxMetaUpdateComplete, pUpdate);
+                if (RT_SUCCESS(rc))
+                    rc = vhdxMetaUpdateStart(pImage, pIoCtx, pUpdate);
+                else if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+                    RTMemFree(pUpdate);
+                break;
+            }
+        }
+
+        if (pcbWriteProcess)
+            *pcbWriteProcess = cbToWrite;
+    }
 
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
@@ -1974,7 +3598,13 @@ static int vhdxFlush(void *pBackendData, PVDIOCTX pIoCtx)
     if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
         rc = VERR_VD_IMAGE_READ_ONLY;
     else
-        rc = VERR_NOT_SUPPORTED;
+    {
+        /*
+         * Write the logged BAT changes in place so the log can be reused. The
+         * checkpoint ends with a flush which covers everything written before.
+         */
+        rc = vhdxLogCheckpoint(pImage, pIoCtx);
+    }
 
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
@@ -2193,7 +3823,8 @@ static int vhdxSetOpenFlags(void *pBackendData, unsigned uOpenFlags)
     int rc = VINF_SUCCESS;
 
     /* Image must be opened and the new flags must be valid. */
-    if (!pImage || (uOpenFlags & ~(VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_INFO | VD_OPEN_FLAGS_SKIP_CONSISTENCY_CHECKS)))
+    if (!pImage || (uOpenFlags & ~(  VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_INFO
+                                   | VD_OPEN_FLAGS_ASYNC_IO | VD_OPEN_FLAGS_SKIP_CONSISTENCY_CHECKS)))
         rc = VERR_INVALID_PARAMETER;
     else
     {
@@ -2300,8 +3931,12 @@ static int vhdxGetModificationUuid(void *pBackendData, PRTUUID pUuid)
 
     AssertPtr(pImage);
 
+    /* The data write UUID changes whenever the user visible content changes. */
     if (pImage)
-        rc = VERR_NOT_SUPPORTED;
+    {
+        *pUuid = pImage->Hdr.UuidDataWrite;
+        rc = VINF_SUCCESS;
+    }
     else
         rc = VERR_VD_NOT_OPENED;
 
@@ -2318,10 +3953,19 @@ static int vhdxSetModificationUuid(void *pBackendData, PCRTUUID pUuid)
 
     AssertPtr(pImage);
 
+    /*
+     * Called before the first user data write of a session followed by a flush,
+     * which writes the header. The header can't be written here, the call is
+     * made from the async I/O path.
+     */
     if (pImage)
     {
         if (!(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
-            rc = VERR_NOT_SUPPORTED;
+        {
+            pImage->Hdr.UuidDataWrite = *pUuid;
+            pImage->fHdrDirty = true;
+            rc = VINF_SUCCESS;
+        }
         else
             rc = VERR_VD_IMAGE_READ_ONLY;
     }
@@ -2430,6 +4074,56 @@ static void vhdxDump(void *pBackendData)
 }
 
 
+/**
+ * Returns whether the given BAT entry refers to data stored in the image.
+ *
+ * @returns true if the payload block is stored in the image, false otherwise.
+ * @param   uBatEntry    The BAT entry.
+ */
+DECLINLINE(bool) vhdxBatEntryIsAllocated(uint64_t uBatEntry)
+{
+    return    VHDX_BAT_ENTRY_GET_STATE(uBatEntry) == VHDX_BAT_ENTRY_PAYLOAD_BLOCK_FULLY_PRESENT
+           || VHDX_BAT_ENTRY_GET_STATE(uBatEntry) == VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT;
+}
+
+/** @copydoc VBOXHDDBACKEND::pfnQueryAllocation */
+static DECLCALLBACK(int) vhdxQueryAllocation(void *pBackendData, uint64_t uOffset, uint64_t cbRange,
+                                             uint64_t *pcbRange, bool *pfAllocated)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbRange=%llu pcbRange=%#p pfAllocated=%#p\n",
+                 pBackendData, uOffset, cbRange, pcbRange, pfAllocated));
+    PVHDXIMAGE pImage = (PVHDXIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtr(pImage);
+
+    if (   uOffset + cbRange > pImage->cbSize
+        || cbRange == 0)
+        rc = VERR_INVALID_PARAMETER;
+    else
+    {
+        uint32_t idxBlock = (uint32_t)(uOffset / pImage->cbBlock); Assert(idxBlock == uOffset / pImage->cbBlock);
+        uint64_t offRange = uOffset - uOffset % pImage->cbBlock;
+        bool fAllocated = vhdxBatEntryIsAllocated(pImage->paBat[idxBlock + idxBlock / pImage->uChunkRatio].u64BatEntry);
+        uint64_t cbThisRange = pImage->cbBlock - uOffset % pImage->cbBlock;
+
+        /* Collect all following payload blocks with the same state, skipping the sector bitmap entries. */
+        for (idxBlock++, offRange += pImage->cbBlock;
+                cbThisRange < cbRange
+             && offRange < pImage->cbSize
+             &&    vhdxBatEntryIsAllocated(pImage->paBat[idxBlock + idxBlock / pImage->uChunkRatio].u64BatEntry)
+                == fAllocated;
+             idxBlock++, offRange += pImage->cbBlock)
+            cbThisRange += pImage->cbBlock;
+
+        *pcbRange    = RT_MIN(cbThisRange, cbRange);
+        *pfAllocated = fAllocated;
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 const VBOXHDDBACKEND g_VhdxBackend =
 {
     /* pszBackendName */
@@ -2437,7 +4131,7 @@ const VBOXHDDBACKEND g_VhdxBackend =
     /* cbSize */
     sizeof(VBOXHDDBACKEND),
     /* uBackendCaps */
-    VD_CAP_FILE | VD_CAP_VFS,
+    VD_CAP_FILE | VD_CAP_VFS | VD_CAP_CREATE_FIXED | VD_CAP_CREATE_DYNAMIC | VD_CAP_ASYNC,
     /* paFileExtensions */
     s_aVhdxFileExtensions,
     /* paConfigInfo */
@@ -2447,7 +4141,7 @@ const VBOXHDDBACKEND g_VhdxBackend =
     /* pfnOpen */
     vhdxOpen,
     /* pfnCreate */
-    NULL,
+    vhdxCreate,
     /* pfnRename */
     vhdxRename,
     /* pfnClose */
@@ -2525,5 +4219,7 @@ const VBOXHDDBACKEND g_VhdxBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
-    NULL
+    NULL,
+    /* pfnQueryAllocation */
+    vhdxQueryAllocation
 };
@@ -330,9 +330,11 @@ typedef struct VMDKEXTENT
 } VMDKEXTENT, *PVMDKEXTENT;
 
 /**
- * Grain table cache size. Allocated per image.
+ * Minimum number of grain table cache lines. Allocated per image. Also the
+ * buffer for writing grain tables of streamOptimized images, so it must hold
+ * a complete grain table.
  */
-#define VMDK_GT_CACHE_SIZE 256
+#define VMDK_GT_CACHE_LINES_MIN 256
 
 /**
  * Grain table block size. Smaller than an actual grain table block to allow
@@ -341,6 +343,20 @@ typedef struct VMDKEXTENT
  */
 #define VMDK_GT_CACHELINE_SIZE 128
 
+/** Number of cache lines per set of the grain table cache. */
+#define VMDK_GT_CACHE_WAYS 4
+
+/** Default grain table cache size in bytes, keep in sync with s_pszVmdkConfigDefaultGTCacheSize. */
+#define VMDK_GT_CACHE_SIZE_DEFAULT _1M
+/** Maximum grain table cache size in bytes. */
+#define VMDK_GT_CACHE_SIZE_MAX (64 * _1M)
+
+/** Default number of grain table cache lines read ahead on sequential misses,
+ * keep in sync with s_pszVmdkConfigDefaultGTCachePrefetch. */
+#define VMDK_GT_CACHE_PREFETCH_DEFAULT 8
+/** Maximum number of grain table cache lines read ahead. */
+#define VMDK_GT_CACHE_PREFETCH_MAX 32
+
 
 /**
  * Maximum number of lines in a descriptor file. Not worth the effort of
@@ -383,24 +399,48 @@ typedef struct VMDKGTCACHEENTRY
 {
     /** Extent number for which this entry is valid. */
     uint32_t    uExtent;
+    /** Set if the entry was read ahead and not accessed since. */
+    bool        fPrefetched;
     /** GT data block number. */
     uint64_t    uGTBlock;
+    /** Cache tick of the last access, for LRU replacement within the set. */
+    uint64_t    uLastUse;
     /** Data part of the cache entry. */
     uint32_t    aGTData[VMDK_GT_CACHELINE_SIZE];
 } VMDKGTCACHEENTRY, *PVMDKGTCACHEENTRY;
 
 /**
- * Cache data structure for blocks of grain table entries. For now this is a
- * fixed size direct mapping cache, but this should be adapted to the size of
- * the sparse image and maybe converted to a set-associative cache. The
+ * Cache data structure for blocks of grain table entries. This is a
+ * set-associative cache with VMDK_GT_CACHE_WAYS lines per set and LRU
+ * replacement within a set, sized per image from the configuration. The
  * implementation below implements a write-through cache with write allocate.
  */
 typedef struct VMDKGTCACHE
 {
-    /** Cache entries. */
-    VMDKGTCACHEENTRY    aGTCache[VMDK_GT_CACHE_SIZE];
-    /** Number of cache entries (currently unused). */
-    unsigned            cEntries;
+    /** Cache entries, cSets * VMDK_GT_CACHE_WAYS of them. */
+    PVMDKGTCACHEENTRY   paGTCache;
+    /** Number of cache entries. */
+    uint32_t            cEntries;
+    /** Number of sets. */
+    uint32_t            cSets;
+    /** Maximum number of lines read ahead on a sequential miss. */
+    uint32_t            cPrefetch;
+    /** Extent of the last miss, for detecting sequential access. */
+    uint32_t            uExtentLastMiss;
+    /** Next GT data block expected by a sequential access after the last miss. */
+    uint64_t            uGTBlockNextMiss;
+    /** Cache tick, incremented on every access. */
+    uint64_t            uTick;
+    /** Number of lookups which found the entry in the cache. */
+    uint64_t            cHits;
+    /** Number of lookups which had to read the entry from disk. */
+    uint64_t            cMisses;
+    /** Number of valid entries replaced. */
+    uint64_t            cEvictions;
+    /** Number of lines read ahead. */
+    uint64_t            cPrefetched;
+    /** Number of read ahead lines which were used before being replaced. */
+    uint64_t            cPrefetchHits;
 } VMDKGTCACHE, *PVMDKGTCACHE;
 
 /**
@@ -520,6 +560,19 @@ static const VDFILEEXTENSION s_aVmdkFileExtensions[] =
     {NULL, VDTYPE_INVALID}
 };
 
+/** Default grain table cache size in bytes, keep in sync with VMDK_GT_CACHE_SIZE_DEFAULT. */
+static const char *s_pszVmdkConfigDefaultGTCacheSize = "1048576";
+/** Default grain table read-ahead, keep in sync with VMDK_GT_CACHE_PREFETCH_DEFAULT. */
+static const char *s_pszVmdkConfigDefaultGTCachePrefetch = "8";
+
+/** Description of all accepted config parameters. */
+static const VDCONFIGINFO s_aVmdkConfigInfo[] =
+{
+    { "GTCacheSize",          s_pszVmdkConfigDefaultGTCacheSize,         VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "GTCachePrefetch",      s_pszVmdkConfigDefaultGTCachePrefetch,     VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
+};
+
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
@@ -2931,16 +2984,54 @@ static int vmdkAllocateGrainTableCache(PVMDKIMAGE pImage)
 #endif /* VBOX_WITH_VMDK_ESX */
            )
         {
+            uint32_t cbCache = VMDK_GT_CACHE_SIZE_DEFAULT;
+            uint32_t cPrefetch = VMDK_GT_CACHE_PREFETCH_DEFAULT;
+            PVDINTERFACECONFIG pIfConfig = VDIfConfigGet(pImage->pVDIfsImage);
+            if (pIfConfig)
+            {
+                int rc = VDCFGQueryU32Def(pIfConfig, "GTCacheSize", &cbCache, VMDK_GT_CACHE_SIZE_DEFAULT);
+                if (RT_FAILURE(rc))
+                    return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                                     N_("VMDK: configuration error: failed to read GTCacheSize as U32"));
+                rc = VDCFGQueryU32Def(pIfConfig, "GTCachePrefetch", &cPrefetch, VMDK_GT_CACHE_PREFETCH_DEFAULT);
+                if (RT_FAILURE(rc))
+                    return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                                     N_("VMDK: configuration error: failed to read GTCachePrefetch as U32"));
+            }
+
+            /* There is no point in caching more lines than all sparse
+             * extents have, which keeps the cache small for small images. */
+            uint64_t cGTBlocks = 0;
+            for (unsigned j = i; j < pImage->cExtents; j++)
+                if (pImage->pExtents[j].cSectorsPerGrain)
+                    cGTBlocks += pImage->pExtents[j].cNominalSectors
+                               / (pImage->pExtents[j].cSectorsPerGrain * VMDK_GT_CACHELINE_SIZE) + 1;
+            uint64_t cEntries = RT_MIN(cbCache, VMDK_GT_CACHE_SIZE_MAX) / sizeof(VMDKGTCACHEENTRY);
+            cEntries = RT_MIN(cEntries, RT_ALIGN_64(cGTBlocks, VMDK_GT_CACHE_WAYS));
+            cEntries = RT_MAX(cEntries, VMDK_GT_CACHE_LINES_MIN);
+            cEntries = cEntries / VMDK_GT_CACHE_WAYS * VMDK_GT_CACHE_WAYS;
+
             /* Allocate grain table cache. */
-            pImage->pGTCache = (PVMDKGTCACHE)RTMemAllocZ(sizeof(VMDKGTCACHE));
-            if (!pImage->pGTCache)
+            PVMDKGTCACHE pCache = (PVMDKGTCACHE)RTMemAllocZ(sizeof(VMDKGTCACHE));
+            if (!pCache)
                 return VERR_NO_MEMORY;
-            for (unsigned j = 0; j < VMDK_GT_CACHE_SIZE; j++)
+            pCache->paGTCache = (PVMDKGTCACHEENTRY)RTMemAllocZ(cEntries * sizeof(VMDKGTCACHEENTRY));
+            if (!pCache->paGTCache)
             {
-                PVMDKGTCACHEENTRY pGCE = &pImage->pGTCache->aGTCache[j];
+                RTMemFree(pCache);
+                return VERR_NO_MEMORY;
+            }
+            for (unsigned j = 0; j < cEntries; j++)
+            {
+                PVMDKGTCACHEENTRY pGCE = &pCache->paGTCache[j];
                 pGCE->uExtent = UINT32_MAX;
             }
-            pImage->pGTCache->cEntries = VMDK_GT_CACHE_SIZE;
+            pCache->cEntries         = (uint32_t)cEntries;
+            pCache->cSets            = (uint32_t)cEntries / VMDK_GT_CACHE_WAYS;
+            pCache->cPrefetch        = RT_MIN(cPrefetch, VMDK_GT_CACHE_PREFETCH_MAX);
+            pCache->uExtentLastMiss  = UINT32_MAX;
+            pCache->uGTBlockNextMiss = UINT64_MAX;
+            pImage->pGTCache = pCache;
             break;
         }
     }
@@ -2948,6 +3039,27 @@ static int vmdkAllocateGrainTableCache(PVMDKIMAGE pImage)
     return VINF_SUCCESS;
 }
 
+/**
+ * Internal: free the grain table cache, logging its statistics.
+ */
+static void vmdkFreeGrainTableCache(PVMDKIMAGE pImage)
+{
+    PVMDKGTCACHE pCache = pImage->pGTCache;
+
+    if (pCache)
+    {
+        if (pCache->cHits + pCache->cMisses)
+            LogRel(("VMDK: Grain table cache of '%s': %u lines, %llu hits, %llu misses (%u%% hit rate), "
+                    "%llu evictions, %llu lines read ahead of which %llu were used\n",
+                    pImage->pszFilename, pCache->cEntries, pCache->cHits, pCache->cMisses,
+                    (unsigned)(pCache->cHits * 100 / (pCache->cHits + pCache->cMisses)),
+                    pCache->cEvictions, pCache->cPrefetched, pCache->cPrefetchHits));
+        RTMemFree(pCache->paGTCache);
+        RTMemFree(pCache);
+        pImage->pGTCache = NULL;
+    }
+}
+
 /**
  * Internal: allocate the given number of extents.
  */
@@ -4141,7 +4253,7 @@ static void vmdkStreamClearGT(PVMDKIMAGE pImage, PVMDKEXTENT pExtent)
 {
     uint32_t cCacheLines = RT_ALIGN(pExtent->cGTEntries, VMDK_GT_CACHELINE_SIZE) / VMDK_GT_CACHELINE_SIZE;
     for (uint32_t i = 0; i < cCacheLines; i++)
-        memset(&pImage->pGTCache->aGTCache[i].aGTData[0], '\0',
+        memset(&pImage->pGTCache->paGTCache[i].aGTData[0], '\0',
                VMDK_GT_CACHELINE_SIZE * sizeof(uint32_t));
 }
 
@@ -4163,7 +4275,7 @@ static int vmdkStreamFlushGT(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
     {
         /* Convert the grain table to little endian in place, as it will not
          * be used at all after this function has been called. */
-        uint32_t *pGTTmp = &pImage->pGTCache->aGTCache[i].aGTData[0];
+        uint32_t *pGTTmp = &pImage->pGTCache->paGTCache[i].aGTData[0];
         for (uint32_t j = 0; j < VMDK_GT_CACHELINE_SIZE; j++, pGTTmp++)
             if (*pGTTmp)
             {
@@ -4202,12 +4314,12 @@ static int vmdkStreamFlushGT(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
     {
         /* Convert the grain table to little endian in place, as it will not
          * be used at all after this function has been called. */
-        uint32_t *pGTTmp = &pImage->pGTCache->aGTCache[i].aGTData[0];
+        uint32_t *pGTTmp = &pImage->pGTCache->paGTCache[i].aGTData[0];
         for (uint32_t j = 0; j < VMDK_GT_CACHELINE_SIZE; j++, pGTTmp++)
             *pGTTmp = RT_H2LE_U32(*pGTTmp);
 
         rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage, uFileOffset,
-                                    &pImage->pGTCache->aGTCache[i].aGTData[0],
+                                    &pImage->pGTCache->paGTCache[i].aGTData[0],
                                     VMDK_GT_CACHELINE_SIZE * sizeof(uint32_t));
         uFileOffset += VMDK_GT_CACHELINE_SIZE * sizeof(uint32_t);
         if (RT_FAILURE(rc))
@@ -4361,11 +4473,7 @@ static int vmdkFreeImage(PVMDKIMAGE pImage, bool fDelete)
         if (RT_SUCCESS(rc))
             rc = rc2; /* Propogate any error when closing the file. */
 
-        if (pImage->pGTCache)
-        {
-            RTMemFree(pImage->pGTCache);
-            pImage->pGTCache = NULL;
-        }
+        vmdkFreeGrainTableCache(pImage);
         if (pImage->pDescData)
         {
             RTMemFree(pImage->pDescData);
@@ -4494,14 +4602,85 @@ static int vmdkFindExtent(PVMDKIMAGE pImage, uint64_t offSector,
 }
 
 /**
- * Internal. Hash function for placing the grain table hash entries.
+ * Internal. Hash function for selecting the grain table cache set.
  */
-static uint32_t vmdkGTCacheHash(PVMDKGTCACHE pCache, uint64_t uSector,
+static uint32_t vmdkGTCacheHash(PVMDKGTCACHE pCache, uint64_t uGTBlock,
                                 unsigned uExtent)
 {
-    /** @todo this hash function is quite simple, maybe use a better one which
-     * scrambles the bits better. */
-    return (uSector + uExtent) % pCache->cEntries;
+    /* Multiplicative hashing scrambles the bits so that neighbouring blocks
+     * and the same block of different extents end up in different sets. */
+    uint64_t u64 = (uGTBlock ^ ((uint64_t)uExtent << 40)) * UINT64_C(0x9e3779b97f4a7c15);
+    return (uint32_t)((u64 >> 32) % pCache->cSets);
+}
+
+/**
+ * Internal. Finds the grain table cache entry for the given block without
+ * touching the replacement state or the statistics.
+ */
+static PVMDKGTCACHEENTRY vmdkGTCacheFind(PVMDKGTCACHE pCache, uint64_t uGTBlock,
+                                         uint32_t uExtent)
+{
+    PVMDKGTCACHEENTRY pSet = &pCache->paGTCache[vmdkGTCacheHash(pCache, uGTBlock, uExtent) * VMDK_GT_CACHE_WAYS];
+    for (unsigned i = 0; i < VMDK_GT_CACHE_WAYS; i++)
+        if (   pSet[i].uExtent == uExtent
+            && pSet[i].uGTBlock == uGTBlock)
+            return &pSet[i];
+    return NULL;
+}
+
+/**
+ * Internal. Looks up the grain table cache entry for the given block,
+ * marking it as most recently used.
+ *
+ * @returns Pointer to the entry, NULL on a cache miss.
+ */
+static PVMDKGTCACHEENTRY vmdkGTCacheLookup(PVMDKGTCACHE pCache, uint64_t uGTBlock,
+                                           uint32_t uExtent)
+{
+    PVMDKGTCACHEENTRY pGTCacheEntry = vmdkGTCacheFind(pCache, uGTBlock, uExtent);
+    if (pGTCacheEntry)
+    {
+        pCache->cHits++;
+        if (pGTCacheEntry->fPrefetched)
+        {
+            pCache->cPrefetchHits++;
+            pGTCacheEntry->fPrefetched = false;
+        }
+        pGTCacheEntry->uLastUse = ++pCache->uTick;
+    }
+    else
+        pCache->cMisses++;
+    return pGTCacheEntry;
+}
+
+/**
+ * Internal. Assigns a grain table cache entry to the given block, replacing
+ * the least recently used entry of the set. The caller fills in the data.
+ */
+static PVMDKGTCACHEENTRY vmdkGTCacheReplace(PVMDKGTCACHE pCache, uint64_t uGTBlock,
+                                            uint32_t uExtent, bool fPrefetched)
+{
+    PVMDKGTCACHEENTRY pSet = &pCache->paGTCache[vmdkGTCacheHash(pCache, uGTBlock, uExtent) * VMDK_GT_CACHE_WAYS];
+    PVMDKGTCACHEENTRY pGTCacheEntry = &pSet[0];
+    for (unsigned i = 0; i < VMDK_GT_CACHE_WAYS; i++)
+    {
+        if (pSet[i].uExtent == UINT32_MAX)
+        {
+            pGTCacheEntry = &pSet[i];
+            break;
+        }
+        if (pSet[i].uLastUse < pGTCacheEntry->uLastUse)
+            pGTCacheEntry = &pSet[i];
+    }
+    if (pGTCacheEntry->uExtent != UINT32_MAX)
+        pCache->cEvictions++;
+    pGTCacheEntry->uExtent     = uExtent;
+    pGTCacheEntry->uGTBlock    = uGTBlock;
+    pGTCacheEntry->fPrefetched = fPrefetched;
+    /* Read ahead lines are inserted as older than the block which caused the
+     * read, so they never replace it and a useless read-ahead goes first. */
+    pGTCacheEntry->uLastUse    = fPrefetched ? pCache->uTick - 1 : ++pCache->uTick;
+    return pGTCacheEntry;
 }
 
 /**
@@ -4514,7 +4693,7 @@ static int vmdkGetSector(PVMDKIMAGE pImage, PVDIOCTX pIoCtx,
 {
     PVMDKGTCACHE pCache = pImage->pGTCache;
     uint64_t uGDIndex, uGTSector, uGTBlock;
-    uint32_t uGTHash, uGTBlockIndex;
+    uint32_t uGTBlockIndex;
     PVMDKGTCACHEENTRY pGTCacheEntry;
     uint32_t aGTDataTmp[VMDK_GT_CACHELINE_SIZE];
     int rc;
@@ -4544,24 +4723,68 @@ static int vmdkGetSector(PVMDKIMAGE pImage, PVDIOCTX pIoCtx,
     }
 
     uGTBlock = uSector / (pExtent->cSectorsPerGrain * VMDK_GT_CACHELINE_SIZE);
-    uGTHash = vmdkGTCacheHash(pCache, uGTBlock, pExtent->uExtent);
-    pGTCacheEntry = &pCache->aGTCache[uGTHash];
-    if (    pGTCacheEntry->uExtent != pExtent->uExtent
-        ||  pGTCacheEntry->uGTBlock != uGTBlock)
-    {
-        /* Cache miss, fetch data from disk. */
+    pGTCacheEntry = vmdkGTCacheLookup(pCache, uGTBlock, pExtent->uExtent);
+    if (!pGTCacheEntry)
+    {
+        /* Cache miss, fetch data from disk. On sequential access read the
+         * following blocks of the same grain table along with it. This is
+         * only done for synchronous I/O contexts, for asynchronous ones every
+         * metadata read is a dependency of the context and a larger transfer
+         * would overlap the single block transfers of the grain allocation. */
+        uint32_t cGTBlocksPerGT = pExtent->cGTEntries / VMDK_GT_CACHELINE_SIZE;
+        uint32_t uGTBlockInGT = (uint32_t)(uGTBlock % cGTBlocksPerGT);
+        uint32_t cGTBlocks = 1;
+        uint32_t *paGTData = aGTDataTmp;
+        if (   pCache->cPrefetch
+            && pCache->uExtentLastMiss == pExtent->uExtent
+            && pCache->uGTBlockNextMiss == uGTBlock
+            && vdIfIoIntIoCtxIsSynchronous(pImage->pIfIo, pIoCtx))
+        {
+            cGTBlocks += RT_MIN(pCache->cPrefetch, cGTBlocksPerGT - 1 - uGTBlockInGT);
+            if (cGTBlocks > 1)
+            {
+                paGTData = (uint32_t *)RTMemTmpAlloc(cGTBlocks * sizeof(aGTDataTmp));
+                if (!paGTData)
+                {
+                    /* Not fatal, just don't read ahead. */
+                    paGTData = aGTDataTmp;
+                    cGTBlocks = 1;
+                }
+            }
+        }
+
         PVDMETAXFER pMetaXfer;
         rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pExtent->pFile->pStorage,
-                                   VMDK_SECTOR2BYTE(uGTSector) + (uGTBlock % (pExtent->cGTEntries / VMDK_GT_CACHELINE_SIZE)) * sizeof(aGTDataTmp),
-                                   aGTDataTmp, sizeof(aGTDataTmp), pIoCtx, &pMetaXfer, NULL, NULL);
+                                   VMDK_SECTOR2BYTE(uGTSector) + uGTBlockInGT * sizeof(aGTDataTmp),
+                                   paGTData, cGTBlocks * sizeof(aGTDataTmp), pIoCtx, &pMetaXfer, NULL, NULL);
+        if (RT_SUCCESS(rc))
+        {
+            /* We can release the metadata transfer immediately. */
+            vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
+            pCache->uExtentLastMiss = pExtent->uExtent;
+            pCache->uGTBlockNextMiss = uGTBlock + cGTBlocks;
+            pGTCacheEntry = vmdkGTCacheReplace(pCache, uGTBlock, pExtent->uExtent, false /* fPrefetched */);
+            for (unsigned i = 0; i < VMDK_GT_CACHELINE_SIZE; i++)
+                pGTCacheEntry->aGTData[i] = RT_LE2H_U32(paGTData[i]);
+            for (uint32_t iBlock = 1; iBlock < cGTBlocks; iBlock++)
+            {
+                /* Entries already in the cache are up to date, as the cache
+                 * is write-through. */
+                if (vmdkGTCacheFind(pCache, uGTBlock + iBlock, pExtent->uExtent))
+                    continue;
+                PVMDKGTCACHEENTRY pGCE = vmdkGTCacheReplace(pCache, uGTBlock + iBlock, pExtent->uExtent,
+                                                            true /* fPrefetched */);
+                /* The entry just read must stay, it is used below. */
+                Assert(pGCE != pGTCacheEntry);
+                for (unsigned i = 0; i < VMDK_GT_CACHELINE_SIZE; i++)
+                    pGCE->aGTData[i] = RT_LE2H_U32(paGTData[iBlock * VMDK_GT_CACHELINE_SIZE + i]);
+                pCache->cPrefetched++;
+            }
+        }
+        if (paGTData != aGTDataTmp)
+            RTMemTmpFree(paGTData);
         if (RT_FAILURE(rc))
             return rc;
-        /* We can release the metadata transfer immediately. */
-        vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
-        pGTCacheEntry->uExtent = pExtent->uExtent;
-        pGTCacheEntry->uGTBlock = uGTBlock;
-        for (unsigned i = 0; i < VMDK_GT_CACHELINE_SIZE; i++)
-            pGTCacheEntry->aGTData[i] = RT_LE2H_U32(aGTDataTmp[i]);
     }
     uGTBlockIndex = (uSector / pExtent->cSectorsPerGrain) % VMDK_GT_CACHELINE_SIZE;
     uint32_t uGrainSector = pGTCacheEntry->aGTData[uGTBlockIndex];
@@ -4643,12 +4866,12 @@ static int vmdkStreamAllocGrain(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
      * grain table buffer space. Also grain table entry must be clear. */
     if (   pExtent->enmType != VMDKETYPE_HOSTED_SPARSE
         || !pImage->pGTCache
-        || pExtent->cGTEntries > VMDK_GT_CACHE_SIZE * VMDK_GT_CACHELINE_SIZE
-        || pImage->pGTCache->aGTCache[uCacheLine].aGTData[uCacheEntry])
+        || pExtent->cGTEntries > pImage->pGTCache->cEntries * VMDK_GT_CACHELINE_SIZE
+        || pImage->pGTCache->paGTCache[uCacheLine].aGTData[uCacheEntry])
         return VERR_INTERNAL_ERROR;
 
     /* Update grain table entry. */
-    pImage->pGTCache->aGTCache[uCacheLine].aGTData[uCacheEntry] = VMDK_BYTE2SECTOR(uFileOffset);
+    pImage->pGTCache->paGTCache[uCacheLine].aGTData[uCacheEntry] = VMDK_BYTE2SECTOR(uFileOffset);
 
     if (cbWrite != VMDK_SECTOR2BYTE(pExtent->cSectorsPerGrain))
     {
@@ -4692,7 +4915,7 @@ static int vmdkAllocGrainGTUpdate(PVMDKIMAGE pImage, PVMDKEXTENT pExtent, PVDIOC
     int rc = VINF_SUCCESS;
     PVMDKGTCACHE pCache = pImage->pGTCache;
     uint32_t aGTDataTmp[VMDK_GT_CACHELINE_SIZE];
-    uint32_t uGTHash, uGTBlockIndex;
+    uint32_t uGTBlockIndex;
     uint64_t uGTSector, uRGTSector, uGTBlock;
     uint64_t uSector = pGrainAlloc->uSector;
     PVMDKGTCACHEENTRY pGTCacheEntry;
@@ -4706,10 +4929,8 @@ static int vmdkAllocGrainGTUpdate(PVMDKIMAGE pImage, PVMDKEXTENT pExtent, PVDIOC
 
     /* Update the grain table (and the cache). */
     uGTBlock = uSector / (pExtent->cSectorsPerGrain * VMDK_GT_CACHELINE_SIZE);
-    uGTHash = vmdkGTCacheHash(pCache, uGTBlock, pExtent->uExtent);
-    pGTCacheEntry = &pCache->aGTCache[uGTHash];
-    if (    pGTCacheEntry->uExtent != pExtent->uExtent
-        ||  pGTCacheEntry->uGTBlock != uGTBlock)
+    pGTCacheEntry = vmdkGTCacheLookup(pCache, uGTBlock, pExtent->uExtent);
+    if (!pGTCacheEntry)
     {
         /* Cache miss, fetch data from disk. */
         LogFlow(("Cache miss, fetch data from disk\n"));
@@ -4729,8 +4950,7 @@ static int vmdkAllocGrainGTUpdate(PVMDKIMAGE pImage, PVMDKEXTENT pExtent, PVDIOC
         else if (RT_FAILURE(rc))
             return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VMDK: cannot read allocated grain table entry in '%s'"), pExtent->pszFullname);
         vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
-        pGTCacheEntry->uExtent = pExtent->uExtent;
-        pGTCacheEntry->uGTBlock = uGTBlock;
+        pGTCacheEntry = vmdkGTCacheReplace(pCache, uGTBlock, pExtent->uExtent, false /* fPrefetched */);
         for (unsigned i = 0; i < VMDK_GT_CACHELINE_SIZE; i++)
             pGTCacheEntry->aGTData[i] = RT_LE2H_U32(aGTDataTmp[i]);
     }
@@ -6557,11 +6777,79 @@ static void vmdkDump(void *pBackendData)
         vdIfErrorMessage(pImage->pIfError, "Header: uuidModification={%RTuuid}\n", &pImage->ModificationUuid);
         vdIfErrorMessage(pImage->pIfError, "Header: uuidParent={%RTuuid}\n", &pImage->ParentUuid);
         vdIfErrorMessage(pImage->pIfError, "Header: uuidParentModification={%RTuuid}\n", &pImage->ParentModificationUuid);
+        PVMDKGTCACHE pCache = pImage->pGTCache;
+        if (pCache)
+            vdIfErrorMessage(pImage->pIfError, "GT cache: cEntries=%u cSets=%u cPrefetch=%u cHits=%llu cMisses=%llu cEvictions=%llu cPrefetched=%llu cPrefetchHits=%llu\n",
+                             pCache->cEntries, pCache->cSets, pCache->cPrefetch, pCache->cHits, pCache->cMisses,
+                             pCache->cEvictions, pCache->cPrefetched, pCache->cPrefetchHits);
     }
 }
 
 
 
+/** @copydoc VBOXHDDBACKEND::pfnQueryAllocation */
+static DECLCALLBACK(int) vmdkQueryAllocation(void *pBackendData, uint64_t uOffset, uint64_t cbRange,
+                                             uint64_t *pcbRange, bool *pfAllocated)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu cbRange=%llu pcbRange=%#p pfAllocated=%#p\n",
+                 pBackendData, uOffset, cbRange, pcbRange, pfAllocated));
+    PVMDKIMAGE pImage = (PVMDKIMAGE)pBackendData;
+    PVMDKEXTENT pExtent;
+    uint64_t uSectorExtentRel;
+    int rc;
+
+    AssertPtr(pImage);
+
+    if (   uOffset + cbRange > pImage->cbSize
+        || cbRange == 0)
+    {
+        rc = VERR_INVALID_PARAMETER;
+        goto out;
+    }
+
+    rc = vmdkFindExtent(pImage, VMDK_BYTE2SECTOR(uOffset),
+                        &pExtent, &uSectorExtentRel);
+    if (RT_FAILURE(rc))
+        goto out;
+
+    /* Clip range to remain in this extent. */
+    cbRange = RT_MIN(cbRange, VMDK_SECTOR2BYTE(pExtent->uSectorOffset + pExtent->cNominalSectors - uSectorExtentRel));
+
+    /*
+     * Only the grain directory is looked at, so a grain table which exists
+     * counts as completely allocated. Stream optimized images are always
+     * reported as allocated, they can't be accessed randomly anyway.
+     */
+    if (   pExtent->enmType == VMDKETYPE_HOSTED_SPARSE
+        && pExtent->pGD
+        && !(pImage->uImageFlags & VD_VMDK_IMAGE_FLAGS_STREAM_OPTIMIZED))
+    {
+        uint32_t uGDIndex = (uint32_t)(uSectorExtentRel / pExtent->cSectorsPerGDE);
+        bool fAllocated = pExtent->pGD[uGDIndex] != 0;
+        uint64_t cbThisRange = VMDK_SECTOR2BYTE(pExtent->cSectorsPerGDE - uSectorExtentRel % pExtent->cSectorsPerGDE);
+
+        for (uGDIndex++;
+                cbThisRange < cbRange
+             && uGDIndex < pExtent->cGDEntries
+             && (pExtent->pGD[uGDIndex] != 0) == fAllocated;
+             uGDIndex++)
+            cbThisRange += VMDK_SECTOR2BYTE(pExtent->cSectorsPerGDE);
+
+        *pcbRange    = RT_MIN(cbThisRange, cbRange);
+        *pfAllocated = fAllocated;
+    }
+    else
+    {
+        /* Flat, VMFS and zero extents never defer to the parent. */
+        *pcbRange    = cbRange;
+        *pfAllocated = true;
+    }
+
+out:
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 const VBOXHDDBACKEND g_VmdkBackend =
 {
     /* pszBackendName */
@@ -6575,7 +6863,7 @@ const VBOXHDDBACKEND g_VmdkBackend =
     /* paFileExtensions */
     s_aVmdkFileExtensions,
     /* paConfigInfo */
-    NULL,
+    s_aVmdkConfigInfo,
     /* pfnCheckIfValid */
     vmdkCheckIfValid,
     /* pfnOpen */
@@ -6659,5 +6947,7 @@ const VBOXHDDBACKEND g_VmdkBackend =
     /* pfnRepair */
     NULL,
     /* pfnTraverseMetadata */
-    NULL
+    NULL,
+    /* pfnQueryAllocation */
+    vmdkQueryAllocation
 };
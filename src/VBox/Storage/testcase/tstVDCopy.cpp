@@ -24,6 +24,7 @@
 #include <iprt/mem.h>
 #include <iprt/initterm.h>
 #include <iprt/rand.h>
+#include <iprt/time.h>
 #include "stdio.h"
 #include "stdlib.h"
 
@@ -35,6 +36,8 @@
 *******************************************************************************/
 /** The error count. */
 unsigned g_cErrors = 0;
+/** The copy pipeline depth handed to VDCopy() through the config interface. */
+static uint32_t g_cPipelineDepth = 1;
 
 
 static void tstVDError(void *pvUser, int rc, RT_SRC_POS_DECL,
@@ -46,15 +49,163 @@ static void tstVDError(void *pvUser, int rc, RT_SRC_POS_DECL,
     RTPrintf("\n");
 }
 
+static bool tstVDCfgAreKeysValid(void *pvUser, const char *pszzValid)
+{
+    NOREF(pvUser); NOREF(pszzValid);
+    return true;
+}
+
+static int tstVDCfgQuerySize(void *pvUser, const char *pszName, size_t *pcbValue)
+{
+    char szValue[32];
+
+    NOREF(pvUser);
+    if (strcmp(pszName, "CopyPipelineDepth"))
+        return VERR_CFGM_VALUE_NOT_FOUND;
+
+    *pcbValue = RTStrPrintf(szValue, sizeof(szValue), "%u", g_cPipelineDepth) + 1;
+    return VINF_SUCCESS;
+}
+
+static int tstVDCfgQuery(void *pvUser, const char *pszName, char *pszValue, size_t cchValue)
+{
+    NOREF(pvUser);
+    if (strcmp(pszName, "CopyPipelineDepth"))
+        return VERR_CFGM_VALUE_NOT_FOUND;
+
+    RTStrPrintf(pszValue, cchValue, "%u", g_cPipelineDepth);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Copies the image given by pszSrc to pszDst with different pipeline depths
+ * and reports the achieved throughput.
+ */
+static int tstVDCopyBenchmark(PVDINTERFACE pVDIfs, const char *pszSrc, const char *pszDst)
+{
+    static const uint32_t s_acDepths[] = { 1, 2, 4, 8 };
+    PVBOXHDD pVDSrc = NULL;
+    char *pszFormat = NULL;
+    VDTYPE enmType = VDTYPE_INVALID;
+    VDINTERFACECONFIG VDIfConfig;
+    PVDINTERFACE pVDIfsOperation = NULL;
+
+    VDIfConfig.pfnAreKeysValid = tstVDCfgAreKeysValid;
+    VDIfConfig.pfnQuerySize    = tstVDCfgQuerySize;
+    VDIfConfig.pfnQuery        = tstVDCfgQuery;
+    VDIfConfig.pfnQueryBytes   = NULL;
+    /* The copy is deleted after each run, never touch a file which was there before. */
+    if (RTFileExists(pszDst))
+    {
+        RTPrintf("tstVDCopy: %s exists already, refusing to overwrite it\n", pszDst);
+        g_cErrors++;
+        return VERR_ALREADY_EXISTS;
+    }
+
+    int rc = VDInterfaceAdd(&VDIfConfig.Core, "tstVDCopy_Config", VDINTERFACETYPE_CONFIG,
+                            NULL, sizeof(VDINTERFACECONFIG), &pVDIfsOperation);
+    AssertRC(rc);
+
+    rc = VDGetFormat(NULL /* pVDIfsDisk */, NULL /* pVDIfsImage */,
+                     pszSrc, &pszFormat, &enmType);
+    if (RT_SUCCESS(rc))
+        rc = VDCreate(pVDIfs, enmType, &pVDSrc);
+    if (RT_SUCCESS(rc))
+        rc = VDOpen(pVDSrc, pszFormat, pszSrc, VD_OPEN_FLAGS_READONLY, NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstVDCopy: Opening %s failed rc=%Rrc\n", pszSrc, rc);
+        g_cErrors++;
+        if (pVDSrc)
+            VDDestroy(pVDSrc);
+        RTStrFree(pszFormat);
+        return rc;
+    }
+
+    uint64_t cbSize = VDGetSize(pVDSrc, VD_LAST_IMAGE);
+
+    for (unsigned i = 0; i < RT_ELEMENTS(s_acDepths) && RT_SUCCESS(rc); i++)
+    {
+        PVBOXHDD pVDDst = NULL;
+
+        /* Only there if deleting the copy of the previous run failed. */
+        if (RTFileExists(pszDst))
+        {
+            RTPrintf("tstVDCopy: %s still exists, stopping\n", pszDst);
+            g_cErrors++;
+            rc = VERR_ALREADY_EXISTS;
+            break;
+        }
+
+        rc = VDCreate(pVDIfs, enmType, &pVDDst);
+        if (RT_FAILURE(rc))
+            break;
+
+        g_cPipelineDepth = s_acDepths[i];
+        uint64_t tsStart = RTTimeNanoTS();
+        rc = VDCopy(pVDSrc, VD_LAST_IMAGE, pVDDst, pszFormat, pszDst, false /* fMoveByRename */,
+                    0 /* cbSize */, VD_IMAGE_FLAGS_NONE, NULL /* pDstUuid */, VD_OPEN_FLAGS_NORMAL,
+                    pVDIfsOperation, NULL /* pDstVDIfsImage */, NULL /* pDstVDIfsOperation */);
+        uint64_t cNsElapsed = RTTimeNanoTS() - tsStart;
+        if (RT_SUCCESS(rc))
+        {
+            RTPrintf("tstVDCopy: depth %2u: %llu bytes in %llu ms (%llu MB/s)\n",
+                     g_cPipelineDepth, cbSize, cNsElapsed / RT_NS_1MS,
+                     cNsElapsed ? cbSize * RT_NS_1SEC / cNsElapsed / _1M : 0);
+        }
+        else
+        {
+            RTPrintf("tstVDCopy: VDCopy() with depth %u failed rc=%Rrc\n", g_cPipelineDepth, rc);
+            g_cErrors++;
+        }
+
+        /* Don't leave the copy behind, whether it completed or not. It didn't exist before the run. */
+        if (VDGetCount(pVDDst))
+            VDClose(pVDDst, true /* fDelete */);
+        else if (RTFileExists(pszDst))
+            RTFileDelete(pszDst);
+        VDDestroy(pVDDst);
+    }
+
+    VDCloseAll(pVDSrc);
+    VDDestroy(pVDSrc);
+    RTStrFree(pszFormat);
+    return rc;
+}
+
 int main(int argc, char *argv[])
 {
     int rc;
 
     RTR3InitExe(argc, &argv, 0);
 
+    if (   argc == 4
+        && !strcmp(argv[1], "--benchmark"))
+    {
+        VDINTERFACEERROR VDIfError;
+        PVDINTERFACE     pVDIfs = NULL;
+
+        RTPrintf("tstVDCopy: BENCHMARKING...\n");
+
+        VDIfError.pfnError = tstVDError;
+        rc = VDInterfaceAdd(&VDIfError.Core, "tstVD_Error", VDINTERFACETYPE_ERROR,
+                            NULL, sizeof(VDINTERFACEERROR), &pVDIfs);
+        AssertRC(rc);
+
+        tstVDCopyBenchmark(pVDIfs, argv[2], argv[3]);
+        VDShutdown();
+
+        if (!g_cErrors)
+            RTPrintf("tstVDCopy: SUCCESS\n");
+        else
+            RTPrintf("tstVDCopy: FAILURE - %d errors\n", g_cErrors);
+        return !!g_cErrors;
+    }
+
     if (argc != 3)
     {
-        RTPrintf("Usage: ./tstVDCopy <hdd1> <hdd2>\n");
+        RTPrintf("Usage: ./tstVDCopy <hdd1> <hdd2>\n"
+                 "       ./tstVDCopy --benchmark <hdd> <copy>\n");
         return 1;
     }
 
@@ -0,0 +1,470 @@
+/* $Id$ */
+/** @file
+ * Simple VBox HDD container test utility for the deduplicating backend.
+ *
+ * Writes duplicate and distinct data to a DEDUP image, discards it again by
+ * overwriting it with zeros and checks the block map, the index and the size
+ * of the store in the image file after every step.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vd.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/file.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The image file name. */
+#define TSTVDDEDUP_FILENAME     "tmpVDDedup.vdd"
+/** Size of a block, the default of the backend. */
+#define TSTVDDEDUP_BLOCK_SIZE   _64K
+/** Number of blocks of the disk. */
+#define TSTVDDEDUP_BLOCKS       64
+/** Size of the disk. */
+#define TSTVDDEDUP_DISK_SIZE    ((uint64_t)TSTVDDEDUP_BLOCKS * TSTVDDEDUP_BLOCK_SIZE)
+
+/** Block map entry: block not allocated. */
+#define TSTVDDEDUP_MAP_FREE     UINT32_C(0)
+/** Block map entry: block contains only zeros. */
+#define TSTVDDEDUP_MAP_ZERO     UINT32_MAX
+/** Index entry: slot was never used. */
+#define TSTVDDEDUP_INDEX_FREE    UINT32_C(0)
+/** Index entry: slot held a hash which was removed. */
+#define TSTVDDEDUP_INDEX_DELETED UINT32_MAX
+/** Size of an index bucket. */
+#define TSTVDDEDUP_BUCKET_SIZE  _4K
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/*
+ * The on-disk structures, see Dedup.cpp for the details. Everything is little
+ * endian, only the leading part of the header is needed.
+ */
+#pragma pack(1)
+typedef struct TSTDEDUPHDR
+{
+    uint32_t            u32Magic;
+    uint32_t            u32Version;
+    uint32_t            cbHeader;
+    uint32_t            fFlags;
+    uint64_t            cbDisk;
+    uint32_t            cbBlock;
+    uint32_t            cBlocks;
+    uint32_t            cIndexBuckets;
+    uint32_t            u32Reserved;
+    uint64_t            offMap;
+    uint64_t            offBlockTbl;
+    uint64_t            offIndex;
+    uint64_t            offData;
+} TSTDEDUPHDR;
+
+typedef struct TSTDEDUPINDEXENTRY
+{
+    uint8_t             abHash[28];
+    uint32_t            u32Block;
+} TSTDEDUPINDEXENTRY;
+#pragma pack()
+
+/**
+ * What the image is expected to look like.
+ */
+typedef struct TSTDEDUPEXPECT
+{
+    /** Number of blocks in the store, i.e. the size of the store. */
+    uint32_t            cStoreBlocks;
+    /** Number of store blocks referenced by the block map. */
+    uint32_t            cStoreBlocksUsed;
+    /** Number of virtual blocks referencing a store block. */
+    uint32_t            cBlocksMapped;
+    /** Number of virtual blocks containing only zeros. */
+    uint32_t            cBlocksZero;
+} TSTDEDUPEXPECT;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The error count. */
+unsigned g_cErrors = 0;
+
+
+static void tstVDError(void *pvUser, int rc, RT_SRC_POS_DECL,
+                       const char *pszFormat, va_list va)
+{
+    g_cErrors++;
+    RTPrintf("tstVDDedup: Error %Rrc at %s:%u (%s): ", rc, RT_SRC_POS_ARGS);
+    RTPrintfV(pszFormat, va);
+    RTPrintf("\n");
+}
+
+static int tstVDMessage(void *pvUser, const char *pszFormat, va_list va)
+{
+    RTPrintf("tstVDDedup: ");
+    RTPrintfV(pszFormat, va);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Fills a block with content depending only on the given pattern number,
+ * 0 gives a block of zeros.
+ */
+static void tstVDDedupFillBlock(uint8_t *pb, uint32_t uPattern)
+{
+    uint32_t *pu32 = (uint32_t *)pb;
+    for (unsigned i = 0; i < TSTVDDEDUP_BLOCK_SIZE / sizeof(uint32_t); i++)
+        pu32[i] = uPattern ? (uPattern * 0x9e3779b1) ^ i : 0;
+}
+
+/**
+ * Writes the given pattern to a range of blocks, the pattern number is
+ * increased by @a uStep from block to block.
+ */
+static int tstVDDedupWrite(PVBOXHDD pVD, uint8_t *pbBuf, uint32_t iBlockFirst, uint32_t cBlocks,
+                           uint32_t uPattern, uint32_t uStep)
+{
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < cBlocks && RT_SUCCESS(rc); i++, uPattern += uStep)
+    {
+        tstVDDedupFillBlock(pbBuf, uPattern);
+        rc = VDWrite(pVD, (uint64_t)(iBlockFirst + i) * TSTVDDEDUP_BLOCK_SIZE, pbBuf, TSTVDDEDUP_BLOCK_SIZE);
+    }
+    if (RT_FAILURE(rc))
+        RTPrintf("tstVDDedup: Writing blocks %u..%u failed rc=%Rrc\n", iBlockFirst, iBlockFirst + cBlocks - 1, rc);
+    return rc;
+}
+
+/**
+ * Reads a range of blocks and compares them against the given pattern.
+ */
+static int tstVDDedupVerify(PVBOXHDD pVD, uint8_t *pbBuf, uint8_t *pbCmp, uint32_t iBlockFirst,
+                            uint32_t cBlocks, uint32_t uPattern, uint32_t uStep)
+{
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < cBlocks && RT_SUCCESS(rc); i++, uPattern += uStep)
+    {
+        rc = VDRead(pVD, (uint64_t)(iBlockFirst + i) * TSTVDDEDUP_BLOCK_SIZE, pbBuf, TSTVDDEDUP_BLOCK_SIZE);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("tstVDDedup: Reading block %u failed rc=%Rrc\n", iBlockFirst + i, rc);
+            break;
+        }
+
+        tstVDDedupFillBlock(pbCmp, uPattern);
+        if (memcmp(pbBuf, pbCmp, TSTVDDEDUP_BLOCK_SIZE))
+        {
+            RTPrintf("tstVDDedup: Block %u has wrong content\n", iBlockFirst + i);
+            g_cErrors++;
+        }
+    }
+    return rc;
+}
+
+/**
+ * Checks the block map, the index and the store size of the closed image.
+ *
+ * Every store block referenced by the map must be in the index exactly once
+ * and the index must not contain any leftover deleted entries, they are
+ * reclaimed when the last hash of a probe sequence is removed.
+ */
+static int tstVDDedupCheck(const char *pszFilename, const char *pszWhat, const TSTDEDUPEXPECT *pExpect)
+{
+    RTFILE hFile;
+    int rc = RTFileOpen(&hFile, pszFilename, RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_NONE);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    TSTDEDUPHDR Hdr;
+    uint64_t cbFile = 0;
+    uint32_t *pau32Map = NULL;
+    uint8_t *pbIndex = NULL;
+    bool *pafUsed = NULL;
+    rc = RTFileReadAt(hFile, 0, &Hdr, sizeof(Hdr), NULL);
+    if (RT_SUCCESS(rc))
+        rc = RTFileGetSize(hFile, &cbFile);
+    if (   RT_SUCCESS(rc)
+        && (   RT_LE2H_U32(Hdr.cbBlock) != TSTVDDEDUP_BLOCK_SIZE
+            || RT_LE2H_U32(Hdr.cBlocks) != TSTVDDEDUP_BLOCKS
+            || cbFile < RT_LE2H_U64(Hdr.offData)))
+        rc = VERR_VD_IMAGE_CORRUPTED;
+
+    size_t cbIndex = 0;
+    if (RT_SUCCESS(rc))
+    {
+        cbIndex  = (size_t)RT_LE2H_U32(Hdr.cIndexBuckets) * TSTVDDEDUP_BUCKET_SIZE;
+        pau32Map = (uint32_t *)RTMemAlloc(TSTVDDEDUP_BLOCKS * sizeof(uint32_t));
+        pbIndex  = (uint8_t *)RTMemAlloc(cbIndex);
+        pafUsed  = (bool *)RTMemAllocZ(TSTVDDEDUP_BLOCKS + 1);
+        if (!pau32Map || !pbIndex || !pafUsed)
+            rc = VERR_NO_MEMORY;
+    }
+    if (RT_SUCCESS(rc))
+        rc = RTFileReadAt(hFile, RT_LE2H_U64(Hdr.offMap), pau32Map, TSTVDDEDUP_BLOCKS * sizeof(uint32_t), NULL);
+    if (RT_SUCCESS(rc))
+        rc = RTFileReadAt(hFile, RT_LE2H_U64(Hdr.offIndex), pbIndex, cbIndex, NULL);
+
+    if (RT_SUCCESS(rc))
+    {
+        TSTDEDUPEXPECT Actual;
+        RT_ZERO(Actual);
+        Actual.cStoreBlocks = (uint32_t)((cbFile - RT_LE2H_U64(Hdr.offData)) / TSTVDDEDUP_BLOCK_SIZE);
+
+        for (unsigned i = 0; i < TSTVDDEDUP_BLOCKS; i++)
+        {
+            uint32_t u32 = RT_LE2H_U32(pau32Map[i]);
+            if (u32 == TSTVDDEDUP_MAP_ZERO)
+                Actual.cBlocksZero++;
+            else if (u32 != TSTVDDEDUP_MAP_FREE)
+            {
+                Actual.cBlocksMapped++;
+                if (u32 > TSTVDDEDUP_BLOCKS + 1)
+                {
+                    RTPrintf("tstVDDedup: %s: block %u references store block %u\n", pszWhat, i, u32 - 1);
+                    g_cErrors++;
+                }
+                else if (!pafUsed[u32 - 1])
+                {
+                    pafUsed[u32 - 1] = true;
+                    Actual.cStoreBlocksUsed++;
+                }
+            }
+        }
+
+        uint32_t cIndexed = 0;
+        uint32_t cDeleted = 0;
+        TSTDEDUPINDEXENTRY *paEntries = (TSTDEDUPINDEXENTRY *)pbIndex;
+        for (size_t i = 0; i < cbIndex / sizeof(TSTDEDUPINDEXENTRY); i++)
+        {
+            uint32_t u32Block = RT_LE2H_U32(paEntries[i].u32Block);
+            if (u32Block == TSTVDDEDUP_INDEX_DELETED)
+                cDeleted++;
+            else if (u32Block != TSTVDDEDUP_INDEX_FREE)
+            {
+                cIndexed++;
+                if (u32Block > TSTVDDEDUP_BLOCKS + 1 || !pafUsed[u32Block - 1])
+                {
+                    RTPrintf("tstVDDedup: %s: index slot %zu references unused store block %u\n",
+                             pszWhat, i, u32Block - 1);
+                    g_cErrors++;
+                }
+            }
+        }
+
+        RTPrintf("tstVDDedup: %s: %u store blocks, %u used, %u blocks mapped, %u zero, %u indexed, %u deleted\n",
+                 pszWhat, Actual.cStoreBlocks, Actual.cStoreBlocksUsed, Actual.cBlocksMapped,
+                 Actual.cBlocksZero, cIndexed, cDeleted);
+        if (   Actual.cStoreBlocks     != pExpect->cStoreBlocks
+            || Actual.cStoreBlocksUsed != pExpect->cStoreBlocksUsed
+            || Actual.cBlocksMapped    != pExpect->cBlocksMapped
+            || Actual.cBlocksZero      != pExpect->cBlocksZero)
+        {
+            RTPrintf("tstVDDedup: %s: expected %u store blocks, %u used, %u blocks mapped, %u zero\n",
+                     pszWhat, pExpect->cStoreBlocks, pExpect->cStoreBlocksUsed, pExpect->cBlocksMapped,
+                     pExpect->cBlocksZero);
+            g_cErrors++;
+        }
+        if (cIndexed != pExpect->cStoreBlocksUsed || cDeleted)
+        {
+            RTPrintf("tstVDDedup: %s: expected %u indexed and no deleted index entries\n",
+                     pszWhat, pExpect->cStoreBlocksUsed);
+            g_cErrors++;
+        }
+    }
+
+    RTMemFree(pafUsed);
+    RTMemFree(pbIndex);
+    RTMemFree(pau32Map);
+    RTFileClose(hFile);
+    return rc;
+}
+
+static int tstVDDedup(const char *pszFilename)
+{
+    int rc;
+    PVBOXHDD pVD = NULL;
+    VDGEOMETRY       PCHS = { 0, 0, 0 };
+    VDGEOMETRY       LCHS = { 0, 0, 0 };
+    PVDINTERFACE     pVDIfs = NULL;
+    VDINTERFACEERROR VDIfError;
+    uint8_t *pbBuf = NULL;
+    uint8_t *pbCmp = NULL;
+
+#define CHECK(str) \
+    do \
+    { \
+        RTPrintf("%s rc=%Rrc\n", str, rc); \
+        if (RT_FAILURE(rc)) \
+        { \
+            RTMemFree(pbCmp); \
+            RTMemFree(pbBuf); \
+            VDDestroy(pVD); \
+            return rc; \
+        } \
+    } while (0)
+
+    /* Create error interface. */
+    VDIfError.pfnError = tstVDError;
+    VDIfError.pfnMessage = tstVDMessage;
+
+    rc = VDInterfaceAdd(&VDIfError.Core, "tstVDDedup_Error", VDINTERFACETYPE_ERROR,
+                        NULL, sizeof(VDINTERFACEERROR), &pVDIfs);
+    AssertRC(rc);
+
+    pbBuf = (uint8_t *)RTMemAlloc(TSTVDDEDUP_BLOCK_SIZE);
+    pbCmp = (uint8_t *)RTMemAlloc(TSTVDDEDUP_BLOCK_SIZE);
+    rc = pbBuf && pbCmp ? VINF_SUCCESS : VERR_NO_MEMORY;
+    CHECK("RTMemAlloc()");
+
+    rc = VDCreate(pVDIfs, VDTYPE_HDD, &pVD);
+    CHECK("VDCreate()");
+
+    rc = VDCreateBase(pVD, "DEDUP", pszFilename, TSTVDDEDUP_DISK_SIZE,
+                      VD_IMAGE_FLAGS_NONE, "Test image", &PCHS, &LCHS, NULL,
+                      VD_OPEN_FLAGS_NORMAL, NULL, NULL);
+    CHECK("VDCreateBase()");
+
+    /* Identical blocks take up the space of a single one. */
+    rc = tstVDDedupWrite(pVD, pbBuf, 0, TSTVDDEDUP_BLOCKS, 1, 0);
+    CHECK("Write duplicates");
+    rc = tstVDDedupVerify(pVD, pbBuf, pbCmp, 0, TSTVDDEDUP_BLOCKS, 1, 0);
+    CHECK("Verify duplicates");
+    VDClose(pVD, false);
+
+    TSTDEDUPEXPECT Expect = { 1, 1, TSTVDDEDUP_BLOCKS, 0 };
+    rc = tstVDDedupCheck(pszFilename, "duplicates", &Expect);
+    CHECK("Check duplicates");
+
+    /*
+     * Discard everything by writing zeros (the backend has no discard
+     * support), the store block is released and its index entry reclaimed.
+     */
+    rc = VDOpen(pVD, "DEDUP", pszFilename, VD_OPEN_FLAGS_NORMAL, NULL);
+    CHECK("VDOpen()");
+    rc = tstVDDedupWrite(pVD, pbBuf, 0, TSTVDDEDUP_BLOCKS, 0, 0);
+    CHECK("Discard duplicates");
+    VDClose(pVD, false);
+
+    Expect.cStoreBlocks     = 1;
+    Expect.cStoreBlocksUsed = 0;
+    Expect.cBlocksMapped    = 0;
+    Expect.cBlocksZero      = TSTVDDEDUP_BLOCKS;
+    rc = tstVDDedupCheck(pszFilename, "discarded duplicates", &Expect);
+    CHECK("Check discarded duplicates");
+
+    /*
+     * Distinct data in the first half. After discarding it and flushing
+     * the released blocks are reused for new data, and the second half
+     * with the same data as the first one doesn't need any new blocks.
+     */
+    uint32_t const cHalf = TSTVDDEDUP_BLOCKS / 2;
+    rc = VDOpen(pVD, "DEDUP", pszFilename, VD_OPEN_FLAGS_NORMAL, NULL);
+    CHECK("VDOpen()");
+    rc = tstVDDedupWrite(pVD, pbBuf, 0, cHalf, 100, 1);
+    CHECK("Write distinct blocks");
+    rc = tstVDDedupWrite(pVD, pbBuf, 0, cHalf, 0, 0);
+    CHECK("Discard distinct blocks");
+    rc = VDFlush(pVD);
+    CHECK("VDFlush()");
+    rc = tstVDDedupWrite(pVD, pbBuf, 0, cHalf, 200, 1);
+    CHECK("Rewrite distinct blocks");
+    rc = tstVDDedupWrite(pVD, pbBuf, cHalf, cHalf, 200, 1);
+    CHECK("Write copy of distinct blocks");
+    rc = tstVDDedupVerify(pVD, pbBuf, pbCmp, 0, cHalf, 200, 1);
+    if (RT_SUCCESS(rc))
+        rc = tstVDDedupVerify(pVD, pbBuf, pbCmp, cHalf, cHalf, 200, 1);
+    CHECK("Verify distinct blocks");
+    VDClose(pVD, false);
+
+    Expect.cStoreBlocks     = cHalf;
+    Expect.cStoreBlocksUsed = cHalf;
+    Expect.cBlocksMapped    = TSTVDDEDUP_BLOCKS;
+    Expect.cBlocksZero      = 0;
+    rc = tstVDDedupCheck(pszFilename, "distinct blocks", &Expect);
+    CHECK("Check distinct blocks");
+
+    /* Discarding everything leaves an empty index behind. */
+    rc = VDOpen(pVD, "DEDUP", pszFilename, VD_OPEN_FLAGS_NORMAL, NULL);
+    CHECK("VDOpen()");
+    rc = tstVDDedupWrite(pVD, pbBuf, 0, TSTVDDEDUP_BLOCKS, 0, 0);
+    CHECK("Discard distinct blocks");
+    rc = tstVDDedupVerify(pVD, pbBuf, pbCmp, 0, TSTVDDEDUP_BLOCKS, 0, 0);
+    CHECK("Verify discarded blocks");
+    VDClose(pVD, false);
+
+    Expect.cStoreBlocks     = cHalf;
+    Expect.cStoreBlocksUsed = 0;
+    Expect.cBlocksMapped    = 0;
+    Expect.cBlocksZero      = TSTVDDEDUP_BLOCKS;
+    rc = tstVDDedupCheck(pszFilename, "discarded distinct blocks", &Expect);
+    CHECK("Check discarded distinct blocks");
+
+    RTMemFree(pbCmp);
+    RTMemFree(pbBuf);
+    VDDestroy(pVD);
+#undef CHECK
+    return rc;
+}
+
+int main(int argc, char *argv[])
+{
+    RTR3InitExe(argc, &argv, 0);
+    int rc;
+
+    RTPrintf("tstVDDedup: TESTING...\n");
+
+    /*
+     * Clean up potential leftovers from previous unsuccessful runs.
+     */
+    RTFileDelete(TSTVDDEDUP_FILENAME);
+
+    rc = tstVDDedup(TSTVDDEDUP_FILENAME);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstVDDedup: DEDUP test failed! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+
+    /*
+     * Clean up any leftovers.
+     */
+    RTFileDelete(TSTVDDEDUP_FILENAME);
+
+    rc = VDShutdown();
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstVDDedup: unloading backends failed! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+     /*
+      * Summary
+      */
+    if (!g_cErrors)
+        RTPrintf("tstVDDedup: SUCCESS\n");
+    else
+        RTPrintf("tstVDDedup: FAILURE - %u errors\n", g_cErrors);
+
+    return !!g_cErrors;
+}
@@ -0,0 +1,598 @@
+/* $Id$ */
+/** @file
+ * Simple VBox HDD container test utility for the DMG read-ahead.
+ *
+ * Creates a small DMG image with zlib compressed extents, reads it
+ * sequentially so the backend inflates ahead and checks that the image is
+ * only ever accessed by the thread doing the disk I/O.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vd.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/base64.h>
+#include <iprt/file.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/path.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/zip.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The image file name. */
+#define TSTVDDMG_FILENAME       "tmpVDDmg.dmg"
+/** Number of compressed extents in the image. */
+#define TSTVDDMG_EXTENTS        32
+/** Number of sectors per extent. */
+#define TSTVDDMG_EXTENT_SECTORS 128
+/** Size of a sector. */
+#define TSTVDDMG_SECTOR_SIZE    512
+/** Size of an extent in bytes. */
+#define TSTVDDMG_EXTENT_SIZE    (TSTVDDMG_EXTENT_SECTORS * TSTVDDMG_SECTOR_SIZE)
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/*
+ * The on-disk structures, see DMG.cpp for the details. Everything is big
+ * endian.
+ */
+#pragma pack(1)
+typedef struct TSTDMGCKSUM
+{
+    uint32_t            u32Kind;
+    uint32_t            cBits;
+    uint8_t             abSum[128];
+} TSTDMGCKSUM;
+
+typedef struct TSTDMGUDIF
+{
+    uint32_t            u32Magic;
+    uint32_t            u32Version;
+    uint32_t            cbFooter;
+    uint32_t            fFlags;
+    uint64_t            offRunData;
+    uint64_t            offData;
+    uint64_t            cbData;
+    uint64_t            offRsrc;
+    uint64_t            cbRsrc;
+    uint32_t            iSegment;
+    uint32_t            cSegments;
+    uint8_t             abSegmentId[16];
+    TSTDMGCKSUM         DataCkSum;
+    uint64_t            offXml;
+    uint64_t            cbXml;
+    uint8_t             abUnknown[120];
+    TSTDMGCKSUM         MasterCkSum;
+    uint32_t            u32Type;
+    uint64_t            cSectors;
+    uint32_t            au32Unknown[3];
+} TSTDMGUDIF;
+
+typedef struct TSTDMGBLKX
+{
+    uint32_t            u32Magic;
+    uint32_t            u32Version;
+    uint64_t            cSectornumberFirst;
+    uint64_t            cSectors;
+    uint64_t            offDataStart;
+    uint32_t            cSectorsDecompress;
+    uint32_t            u32BlocksDescriptor;
+    uint8_t             abReserved[24];
+    TSTDMGCKSUM         BlkxCkSum;
+    uint32_t            cBlocksRunCount;
+} TSTDMGBLKX;
+
+typedef struct TSTDMGBLKXDESC
+{
+    uint32_t            u32Type;
+    uint32_t            u32Reserved;
+    uint64_t            u64SectorStart;
+    uint64_t            u64SectorCount;
+    uint64_t            offData;
+    uint64_t            cbData;
+} TSTDMGBLKXDESC;
+#pragma pack()
+AssertCompileSize(TSTDMGUDIF, 512);
+AssertCompileSize(TSTDMGBLKX, 204);
+AssertCompileSize(TSTDMGBLKXDESC, 40);
+
+/**
+ * Output buffer for the compressor.
+ */
+typedef struct TSTDMGZIPBUF
+{
+    uint8_t            *pb;
+    size_t              cb;
+    size_t              cbAlloc;
+} TSTDMGZIPBUF;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The error count. */
+static unsigned volatile g_cErrors = 0;
+/** The thread doing the disk I/O, the only one allowed to access the image. */
+static RTTHREAD          g_hThreadIo = NIL_RTTHREAD;
+/** Number of image accesses from other threads. */
+static uint32_t volatile g_cForeignAccesses = 0;
+
+
+static void tstVDError(void *pvUser, int rc, RT_SRC_POS_DECL,
+                       const char *pszFormat, va_list va)
+{
+    g_cErrors++;
+    RTPrintf("tstVDDmg: Error %Rrc at %s:%u (%s): ", rc, RT_SRC_POS_ARGS);
+    RTPrintfV(pszFormat, va);
+    RTPrintf("\n");
+}
+
+static int tstVDMessage(void *pvUser, const char *pszFormat, va_list va)
+{
+    RTPrintf("tstVDDmg: ");
+    RTPrintfV(pszFormat, va);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Checks that the image is accessed by the I/O thread.
+ */
+static void tstVDDmgCheckThread(const char *pszWhat)
+{
+    if (   g_hThreadIo != NIL_RTTHREAD
+        && RTThreadSelf() != g_hThreadIo)
+    {
+        if (ASMAtomicIncU32(&g_cForeignAccesses) == 1)
+            RTPrintf("tstVDDmg: %s from thread '%s' which doesn't do the disk I/O\n",
+                     pszWhat, RTThreadSelfName());
+    }
+}
+
+static int tstVDDmgOpen(void *pvUser, const char *pszLocation, uint32_t fOpen,
+                        PFNVDCOMPLETED pfnCompleted, void **ppStorage)
+{
+    RTFILE hFile;
+    int rc = RTFileOpen(&hFile, pszLocation, fOpen);
+    if (RT_SUCCESS(rc))
+        *ppStorage = (void *)(uintptr_t)hFile;
+    return rc;
+}
+
+static int tstVDDmgClose(void *pvUser, void *pStorage)
+{
+    return RTFileClose((RTFILE)(uintptr_t)pStorage);
+}
+
+static int tstVDDmgDelete(void *pvUser, const char *pcszFilename)
+{
+    return RTFileDelete(pcszFilename);
+}
+
+static int tstVDDmgMove(void *pvUser, const char *pcszSrc, const char *pcszDst, unsigned fMove)
+{
+    return RTFileMove(pcszSrc, pcszDst, fMove);
+}
+
+static int tstVDDmgGetFreeSpace(void *pvUser, const char *pcszFilename, int64_t *pcbFreeSpace)
+{
+    return VERR_NOT_IMPLEMENTED;
+}
+
+static int tstVDDmgGetModificationTime(void *pvUser, const char *pcszFilename, PRTTIMESPEC pModificationTime)
+{
+    return VERR_NOT_IMPLEMENTED;
+}
+
+static int tstVDDmgGetSize(void *pvUser, void *pStorage, uint64_t *pcbSize)
+{
+    tstVDDmgCheckThread("Size query");
+    return RTFileGetSize((RTFILE)(uintptr_t)pStorage, pcbSize);
+}
+
+static int tstVDDmgSetSize(void *pvUser, void *pStorage, uint64_t cbSize)
+{
+    return VERR_NOT_IMPLEMENTED;
+}
+
+static int tstVDDmgWriteSync(void *pvUser, void *pStorage, uint64_t uOffset,
+                             const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    return VERR_NOT_IMPLEMENTED;
+}
+
+static int tstVDDmgReadSync(void *pvUser, void *pStorage, uint64_t uOffset,
+                            void *pvBuf, size_t cbRead, size_t *pcbRead)
+{
+    tstVDDmgCheckThread("Read");
+    return RTFileReadAt((RTFILE)(uintptr_t)pStorage, uOffset, pvBuf, cbRead, pcbRead);
+}
+
+static int tstVDDmgFlushSync(void *pvUser, void *pStorage)
+{
+    return VINF_SUCCESS;
+}
+
+static int tstVDDmgReadAsync(void *pvUser, void *pStorage, uint64_t uOffset,
+                             PCRTSGSEG paSegments, size_t cSegments,
+                             size_t cbRead, void *pvCompletion,
+                             void **ppTask)
+{
+    return VERR_NOT_IMPLEMENTED;
+}
+
+static int tstVDDmgWriteAsync(void *pvUser, void *pStorage, uint64_t uOffset,
+                              PCRTSGSEG paSegments, size_t cSegments,
+                              size_t cbWrite, void *pvCompletion,
+                              void **ppTask)
+{
+    return VERR_NOT_IMPLEMENTED;
+}
+
+static int tstVDDmgFlushAsync(void *pvUser, void *pStorage,
+                              void *pvCompletion, void **ppTask)
+{
+    return VERR_NOT_IMPLEMENTED;
+}
+
+/**
+ * Fills the buffer with the content of the given sector.
+ */
+static void tstVDDmgFillSector(uint8_t *pb, uint64_t iSector)
+{
+    uint32_t *pu32 = (uint32_t *)pb;
+    for (unsigned i = 0; i < TSTVDDMG_SECTOR_SIZE / sizeof(uint32_t); i++)
+        pu32[i] = (uint32_t)(iSector * 0x9e3779b1) ^ (i & 0xf);
+}
+
+static DECLCALLBACK(int) tstVDDmgZipOut(void *pvUser, const void *pvBuf, size_t cbBuf)
+{
+    TSTDMGZIPBUF *pBuf = (TSTDMGZIPBUF *)pvUser;
+    if (pBuf->cb + cbBuf > pBuf->cbAlloc)
+    {
+        size_t cbAlloc = RT_MAX(pBuf->cbAlloc * 2, pBuf->cb + cbBuf);
+        uint8_t *pbNew = (uint8_t *)RTMemRealloc(pBuf->pb, cbAlloc);
+        if (!pbNew)
+            return VERR_NO_MEMORY;
+        pBuf->pb      = pbNew;
+        pBuf->cbAlloc = cbAlloc;
+    }
+    memcpy(&pBuf->pb[pBuf->cb], pvBuf, cbBuf);
+    pBuf->cb += cbBuf;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Compresses one extent and appends it to the image file.
+ *
+ * The DMG extents are plain zlib streams while the IPRT compressor prefixes
+ * them with its type byte, so that is dropped.
+ */
+static int tstVDDmgWriteExtent(RTFILE hFile, unsigned iExtent, uint64_t *poffFile, TSTDMGBLKXDESC *pDesc)
+{
+    uint8_t *pbData = (uint8_t *)RTMemAlloc(TSTVDDMG_EXTENT_SIZE);
+    if (!pbData)
+        return VERR_NO_MEMORY;
+    for (unsigned i = 0; i < TSTVDDMG_EXTENT_SECTORS; i++)
+        tstVDDmgFillSector(&pbData[i * TSTVDDMG_SECTOR_SIZE], iExtent * TSTVDDMG_EXTENT_SECTORS + i);
+
+    TSTDMGZIPBUF Buf = { NULL, 0, 0 };
+    PRTZIPCOMP pZip;
+    int rc = RTZipCompCreate(&pZip, &Buf, tstVDDmgZipOut, RTZIPTYPE_ZLIB, RTZIPLEVEL_DEFAULT);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTZipCompress(pZip, pbData, TSTVDDMG_EXTENT_SIZE);
+        if (RT_SUCCESS(rc))
+            rc = RTZipCompFinish(pZip);
+        RTZipCompDestroy(pZip);
+    }
+    if (RT_SUCCESS(rc))
+        rc = RTFileWriteAt(hFile, *poffFile, &Buf.pb[1], Buf.cb - 1, NULL);
+    if (RT_SUCCESS(rc))
+    {
+        pDesc->u32Type        = RT_H2BE_U32(UINT32_C(0x80000005));
+        pDesc->u32Reserved    = 0;
+        pDesc->u64SectorStart = RT_H2BE_U64((uint64_t)iExtent * TSTVDDMG_EXTENT_SECTORS);
+        pDesc->u64SectorCount = RT_H2BE_U64(TSTVDDMG_EXTENT_SECTORS);
+        pDesc->offData        = RT_H2BE_U64(*poffFile);
+        pDesc->cbData         = RT_H2BE_U64(Buf.cb - 1);
+        *poffFile += Buf.cb - 1;
+    }
+
+    RTMemFree(Buf.pb);
+    RTMemFree(pbData);
+    return rc;
+}
+
+/**
+ * Creates the test image: the compressed extents, the XML resource fork with
+ * a single blkx entry and the UDIF footer.
+ */
+static int tstVDDmgCreate(const char *pszFilename)
+{
+    RTFILE hFile;
+    int rc = RTFileOpen(&hFile, pszFilename, RTFILE_O_READWRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_NONE);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    size_t cbBlkx = sizeof(TSTDMGBLKX) + (TSTVDDMG_EXTENTS + 1) * sizeof(TSTDMGBLKXDESC);
+    TSTDMGBLKX *pBlkx = (TSTDMGBLKX *)RTMemAllocZ(cbBlkx);
+    if (!pBlkx)
+    {
+        RTFileClose(hFile);
+        return VERR_NO_MEMORY;
+    }
+    TSTDMGBLKXDESC *paDescs = (TSTDMGBLKXDESC *)(pBlkx + 1);
+
+    uint64_t offFile = 0;
+    for (unsigned i = 0; i < TSTVDDMG_EXTENTS && RT_SUCCESS(rc); i++)
+        rc = tstVDDmgWriteExtent(hFile, i, &offFile, &paDescs[i]);
+
+    char *pszXml = NULL;
+    if (RT_SUCCESS(rc))
+    {
+        uint64_t const cSectors = (uint64_t)TSTVDDMG_EXTENTS * TSTVDDMG_EXTENT_SECTORS;
+        paDescs[TSTVDDMG_EXTENTS].u32Type        = RT_H2BE_U32(UINT32_C(0xffffffff));
+        paDescs[TSTVDDMG_EXTENTS].u64SectorStart = RT_H2BE_U64(cSectors);
+        paDescs[TSTVDDMG_EXTENTS].offData        = RT_H2BE_U64(offFile);
+
+        pBlkx->u32Magic            = RT_H2BE_U32(UINT32_C(0x6d697368)); /* 'mish' */
+        pBlkx->u32Version          = RT_H2BE_U32(1);
+        pBlkx->cSectors            = RT_H2BE_U64(cSectors);
+        pBlkx->cSectorsDecompress  = RT_H2BE_U32(TSTVDDMG_EXTENT_SECTORS);
+        pBlkx->u32BlocksDescriptor = RT_H2BE_U32(UINT32_C(0xfffffffe));
+        pBlkx->cBlocksRunCount     = RT_H2BE_U32(TSTVDDMG_EXTENTS + 1);
+
+        size_t cchBase64 = RTBase64EncodedLength(cbBlkx);
+        char *pszBase64 = (char *)RTMemAlloc(cchBase64 + 1);
+        if (pszBase64)
+        {
+            rc = RTBase64Encode(pBlkx, cbBlkx, pszBase64, cchBase64 + 1, NULL);
+            if (RT_SUCCESS(rc))
+            {
+                RTStrAPrintf(&pszXml,
+                             "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                             "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+                             "<plist version=\"1.0\">\n"
+                             "<dict>\n"
+                             "\t<key>resource-fork</key>\n"
+                             "\t<dict>\n"
+                             "\t\t<key>blkx</key>\n"
+                             "\t\t<array>\n"
+                             "\t\t\t<dict>\n"
+                             "\t\t\t\t<key>Attributes</key>\n"
+                             "\t\t\t\t<string>0x0050</string>\n"
+                             "\t\t\t\t<key>Data</key>\n"
+                             "\t\t\t\t<data>\n"
+                             "%s\n"
+                             "\t\t\t\t</data>\n"
+                             "\t\t\t\t<key>ID</key>\n"
+                             "\t\t\t\t<string>0</string>\n"
+                             "\t\t\t\t<key>Name</key>\n"
+                             "\t\t\t\t<string>whole disk (tstVDDmg : 0)</string>\n"
+                             "\t\t\t</dict>\n"
+                             "\t\t</array>\n"
+                             "\t</dict>\n"
+                             "</dict>\n"
+                             "</plist>\n",
+                             pszBase64);
+                if (!pszXml)
+                    rc = VERR_NO_STR_MEMORY;
+            }
+            RTMemFree(pszBase64);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        size_t cchXml = strlen(pszXml);
+        rc = RTFileWriteAt(hFile, offFile, pszXml, cchXml, NULL);
+        if (RT_SUCCESS(rc))
+        {
+            TSTDMGUDIF Ftr;
+            RT_ZERO(Ftr);
+            Ftr.u32Magic   = RT_H2BE_U32(UINT32_C(0x6b6f6c79)); /* 'koly' */
+            Ftr.u32Version = RT_H2BE_U32(4);
+            Ftr.cbFooter   = RT_H2BE_U32(sizeof(Ftr));
+            Ftr.cbData     = RT_H2BE_U64(offFile);
+            Ftr.cSegments  = RT_H2BE_U32(1);
+            Ftr.iSegment   = RT_H2BE_U32(1);
+            Ftr.offXml     = RT_H2BE_U64(offFile);
+            Ftr.cbXml      = RT_H2BE_U64(cchXml);
+            Ftr.u32Type    = RT_H2BE_U32(1); /* device image */
+            Ftr.cSectors   = RT_H2BE_U64((uint64_t)TSTVDDMG_EXTENTS * TSTVDDMG_EXTENT_SECTORS);
+            rc = RTFileWriteAt(hFile, offFile + cchXml, &Ftr, sizeof(Ftr), NULL);
+        }
+    }
+
+    RTStrFree(pszXml);
+    RTMemFree(pBlkx);
+    RTFileClose(hFile);
+    return rc;
+}
+
+/**
+ * Reads the whole image sequentially and verifies the content.
+ */
+static int tstVDDmgReadAll(const char *pszFilename)
+{
+    int rc;
+    PVBOXHDD pVD = NULL;
+    PVDINTERFACE     pVDIfs = NULL;
+    PVDINTERFACE     pVDIfsImage = NULL;
+    VDINTERFACEERROR VDIfError;
+    VDINTERFACEIO    VDIfIo;
+
+#define CHECK(str) \
+    do \
+    { \
+        RTPrintf("%s rc=%Rrc\n", str, rc); \
+        if (RT_FAILURE(rc)) \
+        { \
+            VDDestroy(pVD); \
+            return rc; \
+        } \
+    } while (0)
+
+    /* Create error interface. */
+    VDIfError.pfnError = tstVDError;
+    VDIfError.pfnMessage = tstVDMessage;
+
+    rc = VDInterfaceAdd(&VDIfError.Core, "tstVDDmg_Error", VDINTERFACETYPE_ERROR,
+                        NULL, sizeof(VDINTERFACEERROR), &pVDIfs);
+    AssertRC(rc);
+
+    /* Create the I/O interface checking who accesses the image. */
+    VDIfIo.pfnOpen                = tstVDDmgOpen;
+    VDIfIo.pfnClose               = tstVDDmgClose;
+    VDIfIo.pfnDelete              = tstVDDmgDelete;
+    VDIfIo.pfnMove                = tstVDDmgMove;
+    VDIfIo.pfnGetFreeSpace        = tstVDDmgGetFreeSpace;
+    VDIfIo.pfnGetModificationTime = tstVDDmgGetModificationTime;
+    VDIfIo.pfnGetSize             = tstVDDmgGetSize;
+    VDIfIo.pfnSetSize             = tstVDDmgSetSize;
+    VDIfIo.pfnReadSync            = tstVDDmgReadSync;
+    VDIfIo.pfnWriteSync           = tstVDDmgWriteSync;
+    VDIfIo.pfnFlushSync           = tstVDDmgFlushSync;
+    VDIfIo.pfnReadAsync           = tstVDDmgReadAsync;
+    VDIfIo.pfnWriteAsync          = tstVDDmgWriteAsync;
+    VDIfIo.pfnFlushAsync          = tstVDDmgFlushAsync;
+
+    rc = VDInterfaceAdd(&VDIfIo.Core, "tstVDDmg_Io", VDINTERFACETYPE_IO,
+                        NULL, sizeof(VDINTERFACEIO), &pVDIfsImage);
+    AssertRC(rc);
+
+    rc = VDCreate(pVDIfs, VDTYPE_DVD, &pVD);
+    CHECK("VDCreate()");
+
+    g_hThreadIo = RTThreadSelf();
+    rc = VDOpen(pVD, "DMG", pszFilename, VD_OPEN_FLAGS_READONLY, pVDIfsImage);
+    CHECK("VDOpen()");
+
+    uint8_t *pbBuf = (uint8_t *)RTMemAlloc(TSTVDDMG_EXTENT_SIZE);
+    uint8_t *pbCmp = (uint8_t *)RTMemAlloc(TSTVDDMG_SECTOR_SIZE);
+    if (!pbBuf || !pbCmp)
+        rc = VERR_NO_MEMORY;
+
+    /*
+     * Read half an extent at a time and give the workers time to pick up
+     * the read-ahead, they must not touch the image while doing so.
+     */
+    size_t const cbRead = TSTVDDMG_EXTENT_SIZE / 2;
+    for (uint64_t off = 0;
+         off < (uint64_t)TSTVDDMG_EXTENTS * TSTVDDMG_EXTENT_SIZE && RT_SUCCESS(rc);
+         off += cbRead)
+    {
+        rc = VDRead(pVD, off, pbBuf, cbRead);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("tstVDDmg: Reading %zu bytes at %llu failed rc=%Rrc\n", cbRead, off, rc);
+            break;
+        }
+
+        for (unsigned i = 0; i < cbRead / TSTVDDMG_SECTOR_SIZE; i++)
+        {
+            uint64_t iSector = off / TSTVDDMG_SECTOR_SIZE + i;
+            tstVDDmgFillSector(pbCmp, iSector);
+            if (memcmp(&pbBuf[i * TSTVDDMG_SECTOR_SIZE], pbCmp, TSTVDDMG_SECTOR_SIZE))
+            {
+                RTPrintf("tstVDDmg: Sector %llu has wrong content\n", iSector);
+                g_cErrors++;
+                break;
+            }
+        }
+
+        RTThreadSleep(1);
+    }
+    RTPrintf("Sequential read rc=%Rrc\n", rc);
+
+    RTMemFree(pbCmp);
+    RTMemFree(pbBuf);
+
+    VDClose(pVD, false);
+    g_hThreadIo = NIL_RTTHREAD;
+    VDDestroy(pVD);
+
+    if (g_cForeignAccesses)
+    {
+        RTPrintf("tstVDDmg: The image was accessed %u times by threads not doing the disk I/O\n",
+                 g_cForeignAccesses);
+        g_cErrors++;
+    }
+#undef CHECK
+    return rc;
+}
+
+int main(int argc, char *argv[])
+{
+    RTR3InitExe(argc, &argv, 0);
+    int rc;
+
+    RTPrintf("tstVDDmg: TESTING...\n");
+
+    /*
+     * Clean up potential leftovers from previous unsuccessful runs.
+     */
+    RTFileDelete(TSTVDDMG_FILENAME);
+
+    rc = tstVDDmgCreate(TSTVDDMG_FILENAME);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstVDDmg: Creating the DMG image failed! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+    else
+    {
+        rc = tstVDDmgReadAll(TSTVDDMG_FILENAME);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("tstVDDmg: DMG read-ahead test failed! rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+    }
+
+    /*
+     * Clean up any leftovers.
+     */
+    RTFileDelete(TSTVDDMG_FILENAME);
+
+    rc = VDShutdown();
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstVDDmg: unloading backends failed! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+     /*
+      * Summary
+      */
+    if (!g_cErrors)
+        RTPrintf("tstVDDmg: SUCCESS\n");
+    else
+        RTPrintf("tstVDDmg: FAILURE - %u errors\n", g_cErrors);
+
+    return !!g_cErrors;
+}
@@ -50,6 +50,8 @@ typedef struct VDFILE
     char          *pszName;
     /** Storage backing the file. */
     PVDIOSTORAGE   pIoStorage;
+    /** Completion callback the storage was created with. */
+    PFNVDCOMPLETED pfnComplete;
     /** Flag whether the file is read locked. */
     bool           fReadLock;
     /** Flag whether the file is write locked. */
@@ -235,6 +237,7 @@ static DECLCALLBACK(int) vdScriptHandlerIoPatternCreateFromFile(PVDSCRIPTARG paS
 static DECLCALLBACK(int) vdScriptHandlerIoPatternDestroy(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerSleep(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerDumpFile(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerCopyFile(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerCreateDisk(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerDestroyDisk(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerCompareDisks(PVDSCRIPTARG paScriptArgs, void *pvUser);
@@ -393,6 +396,13 @@ const VDSCRIPTTYPE g_aArgDumpFile[] =
     VDSCRIPTTYPE_STRING  /* path */
 };
 
+/* Copy memory file */
+const VDSCRIPTTYPE g_aArgCopyFile[] =
+{
+    VDSCRIPTTYPE_STRING, /* source */
+    VDSCRIPTTYPE_STRING  /* destination */
+};
+
 /* Create virtual disk handle */
 const VDSCRIPTTYPE g_aArgCreateDisk[] =
 {
@@ -471,6 +481,7 @@ const VDSCRIPTCALLBACK g_aScriptActions[] =
     {"iopatterndestroy",           VDSCRIPTTYPE_VOID, g_aArgIoPatternDestroy,            RT_ELEMENTS(g_aArgIoPatternDestroy),           vdScriptHandlerIoPatternDestroy},
     {"sleep",                      VDSCRIPTTYPE_VOID, g_aArgSleep,                       RT_ELEMENTS(g_aArgSleep),                      vdScriptHandlerSleep},
     {"dumpfile",                   VDSCRIPTTYPE_VOID, g_aArgDumpFile,                    RT_ELEMENTS(g_aArgDumpFile),                   vdScriptHandlerDumpFile},
+    {"copyfile",                   VDSCRIPTTYPE_VOID, g_aArgCopyFile,                    RT_ELEMENTS(g_aArgCopyFile),                   vdScriptHandlerCopyFile},
     {"createdisk",                 VDSCRIPTTYPE_VOID, g_aArgCreateDisk,                  RT_ELEMENTS(g_aArgCreateDisk),                 vdScriptHandlerCreateDisk},
     {"destroydisk",                VDSCRIPTTYPE_VOID, g_aArgDestroyDisk,                 RT_ELEMENTS(g_aArgDestroyDisk),                vdScriptHandlerDestroyDisk},
     {"comparedisks",               VDSCRIPTTYPE_VOID, g_aArgCompareDisks,                RT_ELEMENTS(g_aArgCompareDisks),               vdScriptHandlerCompareDisks},
@@ -1725,6 +1736,97 @@ static DECLCALLBACK(int) vdScriptHandlerDumpFile(PVDSCRIPTARG paScriptArgs, void
     return rc;
 }
 
+/**
+ * Copies a memory file while it might be still in use, which gives the state
+ * of the file after a host crash at this point.
+ */
+static DECLCALLBACK(int) vdScriptHandlerCopyFile(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    const char *pcszSrc = NULL;
+    const char *pcszDst = NULL;
+
+    pcszSrc = paScriptArgs[0].psz;
+    pcszDst = paScriptArgs[1].psz;
+
+    /* Check for the files. */
+    PVDFILE pIt = NULL;
+    PVDFILE pFileSrc = NULL;
+    RTListForEach(&pGlob->ListFiles, pIt, VDFILE, Node)
+    {
+        if (!RTStrCmp(pIt->pszName, pcszSrc))
+            pFileSrc = pIt;
+        else if (!RTStrCmp(pIt->pszName, pcszDst))
+            return VERR_ALREADY_EXISTS;
+    }
+
+    if (!pFileSrc)
+        return VERR_FILE_NOT_FOUND;
+
+    PVDFILE pFileDst = (PVDFILE)RTMemAllocZ(sizeof(VDFILE));
+    if (pFileDst)
+    {
+        pFileDst->pszName     = RTStrDup(pcszDst);
+        pFileDst->pfnComplete = pFileSrc->pfnComplete;
+        if (pFileDst->pszName)
+            rc = VDIoBackendStorageCreate(pGlob->pIoBackend, pGlob->pszIoBackend,
+                                          pcszDst, pFileDst->pfnComplete, &pFileDst->pIoStorage);
+        else
+            rc = VERR_NO_MEMORY;
+
+        if (RT_SUCCESS(rc))
+        {
+            uint64_t cbFile = 0;
+            size_t cbBuf = _1M;
+            void *pvBuf = RTMemAlloc(cbBuf);
+
+            rc = VDIoBackendStorageGetSize(pFileSrc->pIoStorage, &cbFile);
+            if (RT_SUCCESS(rc) && !pvBuf)
+                rc = VERR_NO_MEMORY;
+            if (RT_SUCCESS(rc))
+                rc = VDIoBackendStorageSetSize(pFileDst->pIoStorage, cbFile);
+
+            for (uint64_t off = 0; off < cbFile && RT_SUCCESS(rc); off += cbBuf)
+            {
+                size_t cbThisCopy = (size_t)RT_MIN(cbBuf, cbFile - off);
+                RTSGBUF SgBuf;
+                RTSGSEG Seg;
+
+                Seg.pvSeg = pvBuf;
+                Seg.cbSeg = cbThisCopy;
+                RTSgBufInit(&SgBuf, &Seg, 1);
+                rc = VDIoBackendTransfer(pFileSrc->pIoStorage, VDIOTXDIR_READ, off,
+                                         cbThisCopy, &SgBuf, NULL, true /* fSync */);
+                if (RT_SUCCESS(rc))
+                {
+                    RTSgBufReset(&SgBuf);
+                    rc = VDIoBackendTransfer(pFileDst->pIoStorage, VDIOTXDIR_WRITE, off,
+                                             cbThisCopy, &SgBuf, NULL, true /* fSync */);
+                }
+            }
+
+            if (pvBuf)
+                RTMemFree(pvBuf);
+            if (RT_FAILURE(rc))
+                VDIoBackendStorageDestroy(pFileDst->pIoStorage);
+        }
+
+        if (RT_SUCCESS(rc))
+            RTListAppend(&pGlob->ListFiles, &pFileDst->Node);
+        else
+        {
+            if (pFileDst->pszName)
+                RTStrFree(pFileDst->pszName);
+            RTMemFree(pFileDst);
+        }
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    return rc;
+}
+
 static DECLCALLBACK(int) vdScriptHandlerCreateDisk(PVDSCRIPTARG paScriptArgs, void *pvUser)
 {
     int rc = VINF_SUCCESS;
@@ -2060,6 +2162,7 @@ static DECLCALLBACK(int) tstVDIoFileOpen(void *pvUser, const char *pszLocation,
             if (pIt)
             {
                 pIt->pszName = RTStrDup(pszLocation);
+                pIt->pfnComplete = pfnCompleted;
 
                 if (pIt->pszName)
                 {
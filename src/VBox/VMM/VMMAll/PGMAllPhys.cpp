@@ -1258,6 +1258,23 @@ int pgmPhysPageLoadIntoTlbWithPage(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys)
     PGM_LOCK_ASSERT_OWNER(pVM);
     STAM_COUNTER_INC(&pVM->pgm.s.CTX_SUFF(pStats)->CTX_MID_Z(Stat,PageMapTlbMisses));
 
+    /*
+     * RAM pages still pending in a lazy saved state restore are covered by an
+     * all access handler and must be read in before anyone gets to see them.
+     */
+    if (RT_UNLIKELY(   pVM->pgm.s.fLazyRestoreActive
+                    && PGM_PAGE_GET_HNDL_PHYS_STATE(pPage) == PGM_PAGE_HNDL_PHYS_STATE_ALL
+                    && PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM))
+    {
+# ifdef IN_RING3
+        int rc = pgmR3LazyRestoreFaultIn(pVM, pPage, GCPhys);
+# else
+        int rc = VMMRZCallRing3NoCpu(pVM, VMMCALLRING3_PGM_LAZY_RESTORE_PAGE, GCPhys & X86_PTE_PAE_PG_MASK);
+# endif
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
     /*
      * Map the page.
      * Make a special case for the zero page as it is kind of special.
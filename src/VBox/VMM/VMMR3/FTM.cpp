@@ -603,6 +603,7 @@ static DECLCALLBACK(int) ftmR3TcpOpClose(void *pvUser, bool fCanceled)
 static SSMSTRMOPS const g_ftmR3TcpOps =
 {
     SSMSTRMOPS_VERSION,
+    0 /*fFlags*/,
     ftmR3TcpOpWrite,
     ftmR3TcpOpRead,
     ftmR3TcpOpSeek,
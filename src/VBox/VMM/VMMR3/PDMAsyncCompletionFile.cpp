@@ -417,6 +417,34 @@ int pdmacFileEpTaskInitiate(PPDMASYNCCOMPLETIONTASK pTask,
     return VINF_AIO_TASK_PENDING;
 }
 
+/**
+ * Registers the statistics of a normal async I/O manager.
+ *
+ * @returns nothing.
+ * @param   pEpClass    Pointer to the endpoint class data.
+ * @param   pAioMgr     The async I/O manager.
+ */
+static void pdmacFileAioMgrStatsRegister(PPDMASYNCCOMPLETIONEPCLASSFILE pEpClass, PPDMACEPFILEMGR pAioMgr)
+{
+    PVM pVM = pEpClass->Core.pVM;
+
+    STAMR3RegisterF(pVM, &pAioMgr->cEndpoints, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                    "Number of endpoints assigned to the manager",
+                    "/PDM/AsyncCompletion/File/AioMgr%u/Endpoints", pAioMgr->idMgr);
+    STAMR3RegisterF(pVM, &pAioMgr->cRequestsActive, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                    "Number of requests submitted to the host (queue depth)",
+                    "/PDM/AsyncCompletion/File/AioMgr%u/QueueDepth", pAioMgr->idMgr);
+    STAMR3RegisterF(pVM, (void *)&pAioMgr->cReqsPerSec, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                    "Requests processed per second during the last update period",
+                    "/PDM/AsyncCompletion/File/AioMgr%u/ReqsPerSec", pAioMgr->idMgr);
+    STAMR3RegisterF(pVM, &pAioMgr->StatCompletionLatency, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_CALL,
+                    "Time from submitting a request to the host until it completed",
+                    "/PDM/AsyncCompletion/File/AioMgr%u/CompletionLatency", pAioMgr->idMgr);
+    STAMR3RegisterF(pVM, &pAioMgr->StatEndpointsMigrated, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                    "Number of endpoints moved to another manager to balance the load",
+                    "/PDM/AsyncCompletion/File/AioMgr%u/EndpointsMigrated", pAioMgr->idMgr);
+}
+
 /**
  * Creates a new async I/O manager.
  *
@@ -440,6 +468,7 @@ int pdmacFileAioMgrCreate(PPDMASYNCCOMPLETIONEPCLASSFILE pEpClass, PPPDMACEPFILE
             pAioMgrNew->enmMgrType = pEpClass->enmMgrTypeOverride;
 
         pAioMgrNew->msBwLimitExpired = RT_INDEFINITE_WAIT;
+        pAioMgrNew->pEpClass         = pEpClass;
 
         rc = RTSemEventCreate(&pAioMgrNew->EventSem);
         if (RT_SUCCESS(rc))
@@ -479,8 +508,12 @@ int pdmacFileAioMgrCreate(PPDMASYNCCOMPLETIONEPCLASSFILE pEpClass, PPPDMACEPFILE
                                 pEpClass->pAioMgrHead->pPrev = pAioMgrNew;
                             pEpClass->pAioMgrHead = pAioMgrNew;
                             pEpClass->cAioMgrs++;
+                            pAioMgrNew->idMgr = pEpClass->idAioMgrNext++;
                             RTCritSectLeave(&pEpClass->CritSect);
 
+                            if (pAioMgrNew->enmMgrType != PDMACEPFILEMGRTYPE_SIMPLE)
+                                pdmacFileAioMgrStatsRegister(pEpClass, pAioMgrNew);
+
                             *ppAioMgr = pAioMgrNew;
 
                             Log(("PDMAC: Successfully created new file AIO Mgr {%s}\n", RTThreadGetName(pAioMgrNew->Thread)));
@@ -532,6 +565,9 @@ static void pdmacFileAioMgrDestroy(PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile,
     rc = RTCritSectLeave(&pEpClassFile->CritSect);
     AssertRC(rc);
 
+    if (pAioMgr->enmMgrType != PDMACEPFILEMGRTYPE_SIMPLE)
+        STAMR3DeregisterF(pEpClassFile->Core.pVM->pUVM, "/PDM/AsyncCompletion/File/AioMgr%u/*", pAioMgr->idMgr);
+
     /* Free the resources. */
     RTCritSectDelete(&pAioMgr->CritSectBlockingEvent);
     RTSemEventDestroy(pAioMgr->EventSem);
@@ -541,6 +577,61 @@ static void pdmacFileAioMgrDestroy(PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile,
     MMR3HeapFree(pAioMgr);
 }
 
+/**
+ * Selects the async I/O manager from the pool a new endpoint is assigned to.
+ *
+ * The least loaded manager of the given type is chosen. If every manager already
+ * serves at least one endpoint and the pool is not full yet a new one is created.
+ *
+ * @returns VBox status code.
+ * @param   pEpClassFile    Pointer to the endpoint class data.
+ * @param   enmMgrType      The manager type.
+ * @param   ppAioMgr        Where to store the selected manager on success.
+ */
+static int pdmacFileAioMgrPoolSelect(PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile, PDMACEPFILEMGRTYPE enmMgrType,
+                                     PPPDMACEPFILEMGR ppAioMgr)
+{
+    PPDMACEPFILEMGR pAioMgrBest = NULL;
+    uint32_t        cAioMgrs    = 0;
+    int             rc          = VINF_SUCCESS;
+
+    RTCritSectEnter(&pEpClassFile->CritSect);
+    for (PPDMACEPFILEMGR pAioMgr = pEpClassFile->pAioMgrHead; pAioMgr; pAioMgr = pAioMgr->pNext)
+    {
+        if (pAioMgr->enmMgrType != enmMgrType)
+            continue;
+
+        cAioMgrs++;
+        if (   !pAioMgrBest
+            || pAioMgr->cReqsPerSec < pAioMgrBest->cReqsPerSec
+            || (   pAioMgr->cReqsPerSec == pAioMgrBest->cReqsPerSec
+                && pAioMgr->cEndpoints < pAioMgrBest->cEndpoints))
+            pAioMgrBest = pAioMgr;
+    }
+    RTCritSectLeave(&pEpClassFile->CritSect);
+
+    if (   !pAioMgrBest
+        || (   pAioMgrBest->cEndpoints
+            && cAioMgrs < pEpClassFile->cAioMgrsPoolMax))
+    {
+        PPDMACEPFILEMGR pAioMgrNew = NULL;
+
+        rc = pdmacFileAioMgrCreate(pEpClassFile, &pAioMgrNew, enmMgrType);
+        if (RT_SUCCESS(rc))
+            pAioMgrBest = pAioMgrNew;
+        else if (pAioMgrBest)
+        {
+            /* Not fatal, the endpoint shares an existing manager. */
+            LogRel(("AIOMgr: Creating another I/O manager failed with %Rrc\n", rc));
+            rc = VINF_SUCCESS;
+        }
+    }
+
+    if (RT_SUCCESS(rc))
+        *ppAioMgr = pAioMgrBest;
+    return rc;
+}
+
 static int pdmacFileMgrTypeFromName(const char *pszVal, PPDMACEPFILEMGRTYPE penmMgrType)
 {
     int rc = VINF_SUCCESS;
@@ -852,6 +943,19 @@ static int pdmacFileInitialize(PPDMASYNCCOMPLETIONEPCLASS pClassGlobals, PCFGMNO
 
             LogRel(("AIOMgr: Default file backend is \"%s\"\n", pdmacFileBackendTypeToName(pEpClassFile->enmEpBackendDefault)));
 
+            /* Query the number of async I/O managers to distribute the endpoints across. */
+            rc = CFGMR3QueryU32Def(pCfgNode, "IoMgrThreads", &pEpClassFile->cAioMgrsPoolMax, 1);
+            AssertLogRelRCReturn(rc, rc);
+            if (   !pEpClassFile->cAioMgrsPoolMax
+                || pEpClassFile->cAioMgrsPoolMax > PDMACEPFILEMGR_POOL_MAX)
+            {
+                LogRel(("AIOMgr: Number of I/O manager threads %u is out of range (1..%u)\n",
+                        pEpClassFile->cAioMgrsPoolMax, PDMACEPFILEMGR_POOL_MAX));
+                return VERR_OUT_OF_RANGE;
+            }
+
+            LogRel(("AIOMgr: Using up to %u I/O manager threads\n", pEpClassFile->cAioMgrsPoolMax));
+
 #ifdef RT_OS_LINUX
             if (   pEpClassFile->enmMgrTypeOverride == PDMACEPFILEMGRTYPE_ASYNC
                 && pEpClassFile->enmEpBackendDefault == PDMACFILEEPBACKEND_BUFFERED)
@@ -866,6 +970,7 @@ static int pdmacFileInitialize(PPDMASYNCCOMPLETIONEPCLASS pClassGlobals, PCFGMNO
             /* No configuration supplied, set defaults */
             pEpClassFile->enmEpBackendDefault = PDMACFILEEPBACKEND_NON_BUFFERED;
             pEpClassFile->enmMgrTypeOverride  = PDMACEPFILEMGRTYPE_ASYNC;
+            pEpClassFile->cAioMgrsPoolMax     = 1;
         }
     }
 
@@ -1054,21 +1159,8 @@ static int pdmacFileEpInitialize(PPDMASYNCCOMPLETIONENDPOINT pEndpoint,
                 }
                 else
                 {
-                    pAioMgr = pEpClassFile->pAioMgrHead;
-
-                    /* Check for an idling manager of the same type */
-                    while (pAioMgr)
-                    {
-                        if (pAioMgr->enmMgrType == enmMgrType)
-                            break;
-                        pAioMgr = pAioMgr->pNext;
-                    }
-
-                    if (!pAioMgr)
-                    {
-                        rc = pdmacFileAioMgrCreate(pEpClassFile, &pAioMgr, enmMgrType);
-                        AssertRC(rc);
-                    }
+                    rc = pdmacFileAioMgrPoolSelect(pEpClassFile, enmMgrType, &pAioMgr);
+                    AssertRC(rc);
                 }
 
                 pEpFile->AioMgr.pTreeRangesLocked = (PAVLRFOFFTREE)RTMemAllocZ(sizeof(AVLRFOFFTREE));
@@ -31,6 +31,9 @@
 
 /** The update period for the I/O load statistics in ms. */
 #define PDMACEPFILEMGR_LOAD_UPDATE_PERIOD   1000
+/** Minimum number of requests per second a manager has to process before
+ * endpoints are moved to other managers of the pool. */
+#define PDMACEPFILEMGR_BALANCE_REQS_MIN     1000
 /** Maximum number of requests a manager will handle. */
 #define PDMACEPFILEMGR_REQS_STEP            512
 
@@ -208,6 +211,7 @@ static bool pdmacFileAioMgrNormalRemoveEndpoint(PPDMASYNCCOMPLETIONENDPOINTFILE
         Assert(!pEndpointRemove->pFlushReq);
 
         /* Reopen the file so that the new endpoint can re-associate with the file */
+        RTFileAioCtxDisassociateFromFile(pAioMgr->hAioCtx, pEndpointRemove->hFile);
         RTFileClose(pEndpointRemove->hFile);
         int rc = RTFileOpen(&pEndpointRemove->hFile, pEndpointRemove->Core.pszUri, pEndpointRemove->fFlags);
         AssertRC(rc);
@@ -217,109 +221,184 @@ static bool pdmacFileAioMgrNormalRemoveEndpoint(PPDMASYNCCOMPLETIONENDPOINTFILE
     return true;
 }
 
-#if 0 /* currently unused */
-
-static bool pdmacFileAioMgrNormalIsBalancePossible(PPDMACEPFILEMGR pAioMgr)
+/**
+ * Hands an endpoint which is moved to another manager over to the destination.
+ *
+ * @returns VBox status code.
+ * @param   pEndpoint    The endpoint to move, already removed from the current manager.
+ */
+static int pdmacFileAioMgrNormalEndpointMoveFinish(PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint)
 {
-    /* Balancing doesn't make sense with only one endpoint. */
-    if (pAioMgr->cEndpoints == 1)
-        return false;
+    PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile = (PPDMASYNCCOMPLETIONEPCLASSFILE)pEndpoint->Core.pEpClass;
+    bool fBalancing = pEndpoint->AioMgr.fBalancing;
 
-    /* Doesn't make sens to move endpoints if only one produces the whole load */
-    unsigned cEndpointsWithLoad = 0;
+    pEndpoint->AioMgr.fMoving    = false;
+    pEndpoint->AioMgr.fBalancing = false;
+    int rc = pdmacFileAioMgrAddEndpoint(pEndpoint->AioMgr.pAioMgrDst, pEndpoint);
 
-    PPDMASYNCCOMPLETIONENDPOINTFILE pCurr = pAioMgr->pEndpointsHead;
+    /* The destination took over, allow the next move. */
+    if (fBalancing)
+        ASMAtomicWriteBool(&pEpClassFile->fBalancing, false);
 
-    while (pCurr)
-    {
-        if (pCurr->AioMgr.cReqsPerSec)
-            cEndpointsWithLoad++;
+    return rc;
+}
 
-        pCurr = pCurr->AioMgr.pEndpointNext;
-    }
+/**
+ * Cancels a move of the given endpoint to another manager which didn't happen
+ * yet because requests were still active.
+ *
+ * Must be called before an endpoint which is closed or removed is unlinked,
+ * otherwise the completion of the last request would unlink it a second time
+ * and hand it to the destination.
+ *
+ * @returns nothing.
+ * @param   pEndpoint    The endpoint, still linked into the current manager.
+ */
+static void pdmacFileAioMgrNormalEndpointMoveCancel(PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint)
+{
+    if (!pEndpoint->AioMgr.fMoving)
+        return;
 
-    return (cEndpointsWithLoad > 1);
+    LogFlowFunc((": Cancelling move of endpoint %#p{%s}\n", pEndpoint, pEndpoint->Core.pszUri));
+
+    /*
+     * Failed requests waiting for the failsafe manager are queued on the pending list
+     * and get another try here, the closing endpoint waits for them to complete.
+     */
+    if (pEndpoint->AioMgr.fBalancing)
+    {
+        PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile = (PPDMASYNCCOMPLETIONEPCLASSFILE)pEndpoint->Core.pEpClass;
+        ASMAtomicWriteBool(&pEpClassFile->fBalancing, false);
+    }
+    pEndpoint->AioMgr.fMoving    = false;
+    pEndpoint->AioMgr.fBalancing = false;
+    pEndpoint->AioMgr.pAioMgrDst = NULL;
 }
 
 /**
- * Creates a new I/O manager and spreads the I/O load of the endpoints
- * between the given I/O manager and the new one.
+ * Moves one endpoint to the least loaded manager of the pool if this manager
+ * handles considerably more requests.
+ *
+ * Only one endpoint is moved at a time across the whole pool because the
+ * source manager waits until the destination accepted the endpoint.
  *
  * @returns nothing.
- * @param   pAioMgr    The I/O manager with high I/O load.
+ * @param   pAioMgr    The I/O manager to balance.
  */
 static void pdmacFileAioMgrNormalBalanceLoad(PPDMACEPFILEMGR pAioMgr)
 {
+    PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile = pAioMgr->pEpClass;
+    PPDMACEPFILEMGR                pAioMgrDst   = NULL;
+
+    /* Balancing doesn't make sense with only one endpoint or a small load. */
+    if (   pAioMgr->cEndpoints < 2
+        || pAioMgr->cReqsPerSec < PDMACEPFILEMGR_BALANCE_REQS_MIN
+        || ASMAtomicReadBool(&pEpClassFile->fBalancing))
+        return;
+
+    /* Find the least loaded manager of the pool. */
+    RTCritSectEnter(&pEpClassFile->CritSect);
+    for (PPDMACEPFILEMGR pAioMgrCurr = pEpClassFile->pAioMgrHead; pAioMgrCurr; pAioMgrCurr = pAioMgrCurr->pNext)
+    {
+        if (   pAioMgrCurr != pAioMgr
+            && pAioMgrCurr->enmMgrType == pAioMgr->enmMgrType
+            && pAioMgrCurr->enmState == PDMACEPFILEMGRSTATE_RUNNING
+            && (   !pAioMgrDst
+                || pAioMgrCurr->cReqsPerSec < pAioMgrDst->cReqsPerSec))
+            pAioMgrDst = pAioMgrCurr;
+    }
+    RTCritSectLeave(&pEpClassFile->CritSect);
+
+    uint32_t cReqsHere  = pAioMgr->cReqsPerSec;
+    uint32_t cReqsOther = pAioMgrDst ? pAioMgrDst->cReqsPerSec : UINT32_MAX;
+    if (cReqsHere / 2 <= cReqsOther)
+    {
+        Log(("AIOMgr: Load balancing would not improve anything\n"));
+        return;
+    }
+
     /*
-     * Check if balancing would improve the situation.
+     * Pick the busiest endpoint which doesn't make the destination busier than
+     * this manager afterwards, moving the only busy endpoint around is pointless.
      */
-    if (pdmacFileAioMgrNormalIsBalancePossible(pAioMgr))
+    PPDMASYNCCOMPLETIONENDPOINTFILE pMove = NULL;
+    for (PPDMASYNCCOMPLETIONENDPOINTFILE pCurr = pAioMgr->pEndpointsHead; pCurr; pCurr = pCurr->AioMgr.pEndpointNext)
     {
-        PPDMASYNCCOMPLETIONEPCLASSFILE  pEpClassFile = (PPDMASYNCCOMPLETIONEPCLASSFILE)pAioMgr->pEndpointsHead->Core.pEpClass;
-        PPDMACEPFILEMGR                 pAioMgrNew = NULL;
+        if (   pCurr->AioMgr.cReqsPerSec
+            && pCurr->AioMgr.cReqsPerSec <= (cReqsHere - cReqsOther) / 2
+            && pCurr->enmState == PDMASYNCCOMPLETIONENDPOINTFILESTATE_ACTIVE
+            && !pCurr->AioMgr.fMoving
+            && !pCurr->pFlushReq
+            && (   !pMove
+                || pCurr->AioMgr.cReqsPerSec > pMove->AioMgr.cReqsPerSec))
+            pMove = pCurr;
+    }
 
-        int rc = pdmacFileAioMgrCreate(pEpClassFile, &pAioMgrNew, PDMACEPFILEMGRTYPE_ASYNC);
-        if (RT_SUCCESS(rc))
-        {
-            /* We will sort the list by request count per second. */
-            pdmacFileAioMgrNormalEndpointsSortByLoad(pAioMgr);
+    if (   !pMove
+        || !ASMAtomicCmpXchgBool(&pEpClassFile->fBalancing, true, false))
+        return;
 
-            /* Now move some endpoints to the new manager. */
-            unsigned cReqsHere  = pAioMgr->pEndpointsHead->AioMgr.cReqsPerSec;
-            unsigned cReqsOther = 0;
-            PPDMASYNCCOMPLETIONENDPOINTFILE pCurr = pAioMgr->pEndpointsHead->AioMgr.pEndpointNext;
+    Log(("AIOMgr: Moving endpoint %#p{%s} with %u reqs/s to other manager\n",
+         pMove, pMove->Core.pszUri, pMove->AioMgr.cReqsPerSec));
+    STAM_REL_COUNTER_INC(&pAioMgr->StatEndpointsMigrated);
 
-            while (pCurr)
-            {
-                if (cReqsHere <= cReqsOther)
-                {
-                    /*
-                     * The other manager has more requests to handle now.
-                     * We will keep the current endpoint.
-                     */
-                    Log(("Keeping endpoint %#p{%s} with %u reqs/s\n", pCurr->Core.pszUri, pCurr->AioMgr.cReqsPerSec));
-                    cReqsHere += pCurr->AioMgr.cReqsPerSec;
-                    pCurr = pCurr->AioMgr.pEndpointNext;
-                }
-                else
-                {
-                    /* Move to other endpoint. */
-                    Log(("Moving endpoint %#p{%s} with %u reqs/s to other manager\n", pCurr, pCurr->Core.pszUri, pCurr->AioMgr.cReqsPerSec));
-                    cReqsOther += pCurr->AioMgr.cReqsPerSec;
+    pAioMgr->cReqsPerSec         -= pMove->AioMgr.cReqsPerSec;
+    pMove->AioMgr.pAioMgrDst      = pAioMgrDst;
+    pMove->AioMgr.fBalancing      = true;
+    pMove->AioMgr.fMoving         = true;
 
-                    PPDMASYNCCOMPLETIONENDPOINTFILE pMove = pCurr;
+    /*
+     * The endpoint stays in the list until the last active request completed,
+     * no new requests are queued meanwhile because it is marked as moving.
+     */
+    if (!pMove->AioMgr.cRequestsActive)
+    {
+        bool fReqsPending = pdmacFileAioMgrNormalRemoveEndpoint(pMove);
+        Assert(!fReqsPending); NOREF(fReqsPending);
 
-                    pCurr = pCurr->AioMgr.pEndpointNext;
+        int rc = pdmacFileAioMgrNormalEndpointMoveFinish(pMove);
+        AssertRC(rc);
+    }
+}
 
-                    bool fReqsPending = pdmacFileAioMgrNormalRemoveEndpoint(pMove);
+/**
+ * Updates the load statistics of the manager and its endpoints once the
+ * update period expired and balances the load across the pool.
+ *
+ * @returns nothing.
+ * @param   pAioMgr       The I/O manager.
+ * @param   puMillisEnd   Where the end of the current update period is stored.
+ */
+static void pdmacFileAioMgrNormalLoadUpdate(PPDMACEPFILEMGR pAioMgr, uint64_t *puMillisEnd)
+{
+    uint64_t uMillisCurr = RTTimeMilliTS();
+    if (uMillisCurr > *puMillisEnd)
+    {
+        PPDMASYNCCOMPLETIONENDPOINTFILE pEndpointCurr = pAioMgr->pEndpointsHead;
+        uint32_t                        cReqsPerSec   = 0;
 
-                    if (fReqsPending)
-                    {
-                        pMove->enmState          = PDMASYNCCOMPLETIONENDPOINTFILESTATE_REMOVING;
-                        pMove->AioMgr.fMoving    = true;
-                        pMove->AioMgr.pAioMgrDst = pAioMgrNew;
-                    }
-                    else
-                    {
-                        pMove->AioMgr.fMoving    = false;
-                        pMove->AioMgr.pAioMgrDst = NULL;
-                        pdmacFileAioMgrAddEndpoint(pAioMgrNew, pMove);
-                    }
-                }
-            }
-        }
-        else
+        /* Calculate timespan. */
+        uMillisCurr -= *puMillisEnd;
+
+        while (pEndpointCurr)
         {
-            /* Don't process further but leave a log entry about reduced performance. */
-            LogRel(("AIOMgr: Could not create new I/O manager (rc=%Rrc). Expect reduced performance\n", rc));
+            pEndpointCurr->AioMgr.cReqsPerSec    = (uint32_t)(  (uint64_t)pEndpointCurr->AioMgr.cReqsProcessed * RT_MS_1SEC
+                                                              / (uMillisCurr + PDMACEPFILEMGR_LOAD_UPDATE_PERIOD));
+            pEndpointCurr->AioMgr.cReqsProcessed = 0;
+            cReqsPerSec += pEndpointCurr->AioMgr.cReqsPerSec;
+            pEndpointCurr = pEndpointCurr->AioMgr.pEndpointNext;
         }
+
+        ASMAtomicWriteU32(&pAioMgr->cReqsPerSec, cReqsPerSec);
+
+        if (pAioMgr->pEpClass->cAioMgrsPoolMax > 1)
+            pdmacFileAioMgrNormalBalanceLoad(pAioMgr);
+
+        /* Set new update interval */
+        *puMillisEnd = RTTimeMilliTS() + PDMACEPFILEMGR_LOAD_UPDATE_PERIOD;
     }
-    else
-        Log(("AIOMgr: Load balancing would not improve anything\n"));
 }
 
-#endif /* unused */
-
 /**
  * Increase the maximum number of active requests for the given I/O manager.
  *
@@ -549,6 +628,13 @@ static int pdmacFileAioMgrNormalReqsEnqueue(PPDMACEPFILEMGR pAioMgr,
     pAioMgr->cRequestsActive += cReqs;
     pEndpoint->AioMgr.cRequestsActive += cReqs;
 
+    uint64_t tsSubmit = RTTimeNanoTS();
+    for (unsigned i = 0; i < cReqs; i++)
+    {
+        PPDMACTASKFILE pTask = (PPDMACTASKFILE)RTFileAioReqGetUser(pahReqs[i]);
+        pTask->tsSubmit = tsSubmit;
+    }
+
     LogFlow(("Enqueuing %d requests. I/O manager has a total of %d active requests now\n", cReqs, pAioMgr->cRequestsActive));
     LogFlow(("Endpoint has a total of %d active requests now\n", pEndpoint->AioMgr.cRequestsActive));
 
@@ -1209,6 +1295,7 @@ static int pdmacFileAioMgrNormalProcessBlockingEvent(PPDMACEPFILEMGR pAioMgr)
             PPDMASYNCCOMPLETIONENDPOINTFILE pEndpointRemove = ASMAtomicReadPtrT(&pAioMgr->BlockingEventData.RemoveEndpoint.pEndpoint, PPDMASYNCCOMPLETIONENDPOINTFILE);
             AssertMsg(VALID_PTR(pEndpointRemove), ("Removing endpoint event without a endpoint to remove\n"));
 
+            pdmacFileAioMgrNormalEndpointMoveCancel(pEndpointRemove);
             pEndpointRemove->enmState = PDMASYNCCOMPLETIONENDPOINTFILESTATE_REMOVING;
             fNotifyWaiter = !pdmacFileAioMgrNormalRemoveEndpoint(pEndpointRemove);
             break;
@@ -1222,6 +1309,9 @@ static int pdmacFileAioMgrNormalProcessBlockingEvent(PPDMACEPFILEMGR pAioMgr)
             {
                 LogFlowFunc((": Closing endpoint %#p{%s}\n", pEndpointClose, pEndpointClose->Core.pszUri));
 
+                /* The endpoint stays here, requests held back for a pending move are processed below. */
+                pdmacFileAioMgrNormalEndpointMoveCancel(pEndpointClose);
+
                 /* Make sure all tasks finished. Process the queues a last time first. */
                 rc = pdmacFileAioMgrNormalQueueReqs(pAioMgr, pEndpointClose);
                 AssertRC(rc);
@@ -1299,15 +1389,13 @@ static int pdmacFileAioMgrNormalCheckEndpoints(PPDMACEPFILEMGR pAioMgr)
                  && pEndpoint->enmState != PDMASYNCCOMPLETIONENDPOINTFILESTATE_ACTIVE)
         {
             /* Reopen the file so that the new endpoint can re-associate with the file */
+            RTFileAioCtxDisassociateFromFile(pAioMgr->hAioCtx, pEndpoint->hFile);
             RTFileClose(pEndpoint->hFile);
             rc = RTFileOpen(&pEndpoint->hFile, pEndpoint->Core.pszUri, pEndpoint->fFlags);
             AssertRC(rc);
 
             if (pEndpoint->AioMgr.fMoving)
-            {
-                pEndpoint->AioMgr.fMoving = false;
-                pdmacFileAioMgrAddEndpoint(pEndpoint->AioMgr.pAioMgrDst, pEndpoint);
-            }
+                pdmacFileAioMgrNormalEndpointMoveFinish(pEndpoint);
             else
             {
                 Assert(pAioMgr->fBlockingEventPending);
@@ -1354,6 +1442,7 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
     pAioMgr->cRequestsActive--;
     pEndpoint->AioMgr.cRequestsActive--;
     pEndpoint->AioMgr.cReqsProcessed++;
+    STAM_REL_PROFILE_ADD_PERIOD(&pAioMgr->StatCompletionLatency, RTTimeNanoTS() - pTask->tsSubmit);
 
     /*
      * It is possible that the request failed on Linux with kernels < 2.6.23
@@ -1392,9 +1481,11 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
             /*
              * Fatal errors are reported to the guest and non-fatal errors
              * will cause a migration to the failsafe manager in the hope
-             * that the error disappears.
+             * that the error disappears. An endpoint which is closed or
+             * removed already can't be migrated anymore.
              */
-            if (!pdmacFileAioMgrNormalRcIsFatal(rcReq))
+            if (   !pdmacFileAioMgrNormalRcIsFatal(rcReq)
+                && pEndpoint->enmState == PDMASYNCCOMPLETIONENDPOINTFILESTATE_ACTIVE)
             {
                 /* Queue the request on the pending list. */
                 pTask->pNext = pEndpoint->AioMgr.pReqsPendingHead;
@@ -1426,7 +1517,7 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
                     bool fReqsPending = pdmacFileAioMgrNormalRemoveEndpoint(pEndpoint);
                     Assert(!fReqsPending);
 
-                    rc = pdmacFileAioMgrAddEndpoint(pEndpoint->AioMgr.pAioMgrDst, pEndpoint);
+                    rc = pdmacFileAioMgrNormalEndpointMoveFinish(pEndpoint);
                     AssertRC(rc);
                 }
             }
@@ -1579,11 +1670,13 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
                 }
                 else if (RT_UNLIKELY(!pEndpoint->AioMgr.cRequestsActive && pEndpoint->AioMgr.fMoving))
                 {
+                    Assert(pEndpoint->enmState == PDMASYNCCOMPLETIONENDPOINTFILESTATE_ACTIVE);
+
                     /* If the endpoint is about to be migrated do it now. */
                     bool fReqsPending = pdmacFileAioMgrNormalRemoveEndpoint(pEndpoint);
                     Assert(!fReqsPending);
 
-                    rc = pdmacFileAioMgrAddEndpoint(pEndpoint->AioMgr.pAioMgrDst, pEndpoint);
+                    rc = pdmacFileAioMgrNormalEndpointMoveFinish(pEndpoint);
                     AssertRC(rc);
                 }
             }
@@ -1627,6 +1720,9 @@ DECLCALLBACK(int) pdmacFileAioMgrNormal(RTTHREAD hThreadSelf, void *pvUser)
 
             LogFlow(("Got woken up\n"));
             ASMAtomicWriteBool(&pAioMgr->fWokenUp, false);
+
+            /* The load dropped while sleeping, keep the pool informed. */
+            pdmacFileAioMgrNormalLoadUpdate(pAioMgr, &uMillisEnd);
         }
 
         /* Check for an external blocking event first. */
@@ -1676,24 +1772,7 @@ DECLCALLBACK(int) pdmacFileAioMgrNormal(RTTHREAD hThreadSelf, void *pvUser)
                 }
 
                 /* Update load statistics. */
-                uint64_t uMillisCurr = RTTimeMilliTS();
-                if (uMillisCurr > uMillisEnd)
-                {
-                    PPDMASYNCCOMPLETIONENDPOINTFILE pEndpointCurr = pAioMgr->pEndpointsHead;
-
-                    /* Calculate timespan. */
-                    uMillisCurr -= uMillisEnd;
-
-                    while (pEndpointCurr)
-                    {
-                        pEndpointCurr->AioMgr.cReqsPerSec    = pEndpointCurr->AioMgr.cReqsProcessed / (uMillisCurr + PDMACEPFILEMGR_LOAD_UPDATE_PERIOD);
-                        pEndpointCurr->AioMgr.cReqsProcessed = 0;
-                        pEndpointCurr = pEndpointCurr->AioMgr.pEndpointNext;
-                    }
-
-                    /* Set new update interval */
-                    uMillisEnd = RTTimeMilliTS() + PDMACEPFILEMGR_LOAD_UPDATE_PERIOD;
-                }
+                pdmacFileAioMgrNormalLoadUpdate(pAioMgr, &uMillisEnd);
 
                 /* Check endpoints for new requests. */
                 if (pAioMgr->enmState != PDMACEPFILEMGRSTATE_GROWING)
@@ -17,6 +17,14 @@
 
 /** @page pg_pdm_block_cache     PDM Block Cache - The I/O cache
  * This component implements an I/O cache based on the 2Q cache algorithm.
+ *
+ * Alternatively the adaptive replacement cache (ARC) policy can be selected
+ * with the PDM/BlkCache/CachePolicy config key. ARC uses the same recently
+ * and frequently used lists but keeps a ghost list for each of them and
+ * shifts the target size of the recently used list depending on which ghost
+ * list gets hit. Entries seen only once, like the blocks of a backup run or
+ * virus scan inside the guest, therefore can't push the frequently used
+ * working set out of the cache.
  */
 
 /*******************************************************************************
@@ -97,57 +105,141 @@ DECLINLINE(void) pdmBlkCacheEntryRef(PPDMBLKCACHEENTRY pEntry)
 }
 
 #ifdef VBOX_STRICT
-static void pdmBlkCacheValidate(PPDMBLKCACHEGLOBAL pCache)
+static void pdmBlkCacheValidate(PPDMBLKCACHESHARD pShard)
 {
     /* Amount of cached data should never exceed the maximum amount. */
-    AssertMsg(pCache->cbCached <= pCache->cbMax,
+    AssertMsg(pShard->cbCached <= pShard->cbMax,
               ("Current amount of cached data exceeds maximum\n"));
 
     /* The amount of cached data in the LRU and FRU list should match cbCached */
-    AssertMsg(pCache->LruRecentlyUsedIn.cbCached + pCache->LruFrequentlyUsed.cbCached == pCache->cbCached,
+    AssertMsg(pShard->LruRecentlyUsedIn.cbCached + pShard->LruFrequentlyUsed.cbCached == pShard->cbCached,
               ("Amount of cached data doesn't match\n"));
 
-    AssertMsg(pCache->LruRecentlyUsedOut.cbCached <= pCache->cbRecentlyUsedOutMax,
-              ("Paged out list exceeds maximum\n"));
+    if (pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_2Q)
+        AssertMsg(pShard->LruRecentlyUsedOut.cbCached <= pShard->cbRecentlyUsedOutMax,
+                  ("Paged out list exceeds maximum\n"));
+    else
+        AssertMsg(   pShard->LruRecentlyUsedOut.cbCached <= pShard->cbMax
+                  && pShard->LruFrequentlyUsedOut.cbCached <= pShard->cbMax,
+                  ("Ghost lists exceed maximum\n"));
 }
 #endif
 
 DECLINLINE(void) pdmBlkCacheLockEnter(PPDMBLKCACHEGLOBAL pCache)
 {
     RTCritSectEnter(&pCache->CritSect);
+}
+
+DECLINLINE(void) pdmBlkCacheLockLeave(PPDMBLKCACHEGLOBAL pCache)
+{
+    RTCritSectLeave(&pCache->CritSect);
+}
+
+DECLINLINE(void) pdmBlkCacheShardLockEnter(PPDMBLKCACHESHARD pShard)
+{
+    if (RT_FAILURE(RTCritSectTryEnter(&pShard->CritSect)))
+    {
+        STAM_REL_COUNTER_INC(&pShard->StatLockContended);
+        RTCritSectEnter(&pShard->CritSect);
+    }
 #ifdef VBOX_STRICT
-    pdmBlkCacheValidate(pCache);
+    pdmBlkCacheValidate(pShard);
 #endif
 }
 
-DECLINLINE(void) pdmBlkCacheLockLeave(PPDMBLKCACHEGLOBAL pCache)
+DECLINLINE(void) pdmBlkCacheShardLockLeave(PPDMBLKCACHESHARD pShard)
 {
 #ifdef VBOX_STRICT
-    pdmBlkCacheValidate(pCache);
+    pdmBlkCacheValidate(pShard);
 #endif
-    RTCritSectLeave(&pCache->CritSect);
+    RTCritSectLeave(&pShard->CritSect);
 }
 
-DECLINLINE(void) pdmBlkCacheSub(PPDMBLKCACHEGLOBAL pCache, uint32_t cbAmount)
+/**
+ * Enters the global lock and the locks of all shards, needed before
+ * acquiring the entry semaphore of a user to tear down its entries.
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
+static void pdmBlkCacheLockEnterAll(PPDMBLKCACHEGLOBAL pCache)
 {
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
-    pCache->cbCached -= cbAmount;
+    pdmBlkCacheLockEnter(pCache);
+    for (uint32_t i = 0; i < pCache->cShards; i++)
+        pdmBlkCacheShardLockEnter(&pCache->paShards[i]);
 }
 
-DECLINLINE(void) pdmBlkCacheAdd(PPDMBLKCACHEGLOBAL pCache, uint32_t cbAmount)
+/**
+ * Leaves all locks entered with pdmBlkCacheLockEnterAll().
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
+static void pdmBlkCacheLockLeaveAll(PPDMBLKCACHEGLOBAL pCache)
+{
+    for (uint32_t i = pCache->cShards; i > 0; i--)
+        pdmBlkCacheShardLockLeave(&pCache->paShards[i - 1]);
+    pdmBlkCacheLockLeave(pCache);
+}
+
+/**
+ * Returns the shard responsible for the given offset of a cache user.
+ *
+ * Ranges of 1MB of a user map to the same shard so neighbouring entries share
+ * the lists, different users and ranges are spread across all shards.
+ *
+ * @returns Pointer to the shard.
+ * @param   pBlkCache The cache user.
+ * @param   off       The offset in the medium of the user.
+ */
+DECLINLINE(PPDMBLKCACHESHARD) pdmBlkCacheShardGet(PPDMBLKCACHE pBlkCache, uint64_t off)
 {
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
-    pCache->cbCached += cbAmount;
+    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
+    uint64_t uHash = ((uintptr_t)pBlkCache >> 4) ^ (off >> PDMBLKCACHE_SHARD_RANGE_SHIFT);
+
+    uHash *= UINT64_C(0x9e3779b97f4a7c15);
+    return &pCache->paShards[(uint32_t)(uHash >> 32) % pCache->cShards];
+}
+
+DECLINLINE(void) pdmBlkCacheSub(PPDMBLKCACHESHARD pShard, uint32_t cbAmount)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+    pShard->cbCached -= cbAmount;
+    ASMAtomicSubU32(&pShard->pCache->cbCached, cbAmount);
+}
+
+DECLINLINE(void) pdmBlkCacheAdd(PPDMBLKCACHESHARD pShard, uint32_t cbAmount)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+    pShard->cbCached += cbAmount;
+    ASMAtomicAddU32(&pShard->pCache->cbCached, cbAmount);
 }
 
 DECLINLINE(void) pdmBlkCacheListAdd(PPDMBLKLRULIST pList, uint32_t cbAmount)
 {
-    pList->cbCached += cbAmount;
+    ASMAtomicWriteU32(&pList->cbCached, pList->cbCached + cbAmount);
+    ASMAtomicAddU32(pList->pcbCachedTotal, cbAmount);
 }
 
 DECLINLINE(void) pdmBlkCacheListSub(PPDMBLKLRULIST pList, uint32_t cbAmount)
 {
-    pList->cbCached -= cbAmount;
+    ASMAtomicWriteU32(&pList->cbCached, pList->cbCached - cbAmount);
+    ASMAtomicSubU32(pList->pcbCachedTotal, cbAmount);
+}
+
+/**
+ * Sets the adaptive target size of the recently used list of a shard,
+ * keeping the sum over all shards up to date.
+ *
+ * @returns nothing.
+ * @param   pShard    The cache shard, the caller owns the lock.
+ * @param   cbTarget  The new target size in bytes.
+ */
+DECLINLINE(void) pdmBlkCacheShardSetMruInTarget(PPDMBLKCACHESHARD pShard, uint32_t cbTarget)
+{
+    ASMAtomicSubU32(&pShard->pCache->cbRecentlyUsedInTarget, pShard->cbRecentlyUsedInTarget);
+    ASMAtomicAddU32(&pShard->pCache->cbRecentlyUsedInTarget, cbTarget);
+    pShard->cbRecentlyUsedInTarget = cbTarget;
 }
 
 #ifdef PDMACFILECACHE_WITH_LRULIST_CHECKS
@@ -230,7 +322,7 @@ static void pdmBlkCacheEntryRemoveFromList(PPDMBLKCACHEENTRY pEntry)
             pPrev->pNext = NULL;
     }
 
-    pEntry->pList    = NULL;
+    ASMAtomicWriteNullPtr(&pEntry->pList);
     pEntry->pPrev    = NULL;
     pEntry->pNext    = NULL;
     pdmBlkCacheListSub(pList, pEntry->cbData);
@@ -270,7 +362,7 @@ static void pdmBlkCacheEntryAddToList(PPDMBLKLRULIST pList, PPDMBLKCACHEENTRY pE
     pEntry->pPrev    = NULL;
     pList->pHead     = pEntry;
     pdmBlkCacheListAdd(pList, pEntry->cbData);
-    pEntry->pList    = pList;
+    ASMAtomicWritePtr(&pEntry->pList, pList);
 #ifdef PDMACFILECACHE_WITH_LRULIST_CHECKS
     pdmBlkCacheCheckList(pList, NULL);
 #endif
@@ -300,12 +392,30 @@ static void pdmBlkCacheDestroyList(PPDMBLKLRULIST pList)
     }
 }
 
+/**
+ * Returns the maximum number of bytes the given ghost list may track.
+ *
+ * @returns Maximum size of the ghost list in bytes.
+ * @param   pShard       The cache shard.
+ * @param   pGhostList   The ghost list.
+ */
+DECLINLINE(uint32_t) pdmBlkCacheGhostListMax(PPDMBLKCACHESHARD pShard, PPDMBLKLRULIST pGhostList)
+{
+    if (pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_2Q)
+        return pShard->cbRecentlyUsedOutMax;
+
+    /* ARC: The recency side (T1 + B1) is limited to the cache size, the frequency ghost list as well. */
+    if (pGhostList == &pShard->LruRecentlyUsedOut)
+        return pShard->cbMax - RT_MIN(pShard->LruRecentlyUsedIn.cbCached, pShard->cbMax);
+    return pShard->cbMax;
+}
+
 /**
  * Tries to remove the given amount of bytes from a given list in the cache
  * moving the entries to one of the given ghosts lists
  *
  * @returns Amount of data which could be freed.
- * @param    pCache           Pointer to the global cache data.
+ * @param    pShard           The cache shard.
  * @param    cbData           The amount of the data to free.
  * @param    pListSrc         The source list to evict data from.
  * @param    pGhostListSrc    The ghost list removed entries should be moved to
@@ -318,18 +428,20 @@ static void pdmBlkCacheDestroyList(PPDMBLKLRULIST pList)
  *          may be marked as non evictable if they are used for I/O at the
  *          moment.
  */
-static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData,
+static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHESHARD pShard, size_t cbData,
                                         PPDMBLKLRULIST pListSrc, PPDMBLKLRULIST pGhostListDst,
                                         bool fReuseBuffer, uint8_t **ppbBuffer)
 {
     size_t cbEvicted = 0;
 
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
 
     AssertMsg(cbData > 0, ("Evicting 0 bytes not possible\n"));
     AssertMsg(   !pGhostListDst
-              || (pGhostListDst == &pCache->LruRecentlyUsedOut),
-              ("Destination list must be NULL or the recently used but paged out list\n"));
+              || (pGhostListDst == &pShard->LruRecentlyUsedOut)
+              || (   pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC
+                  && pGhostListDst == &pShard->LruFrequentlyUsedOut),
+              ("Destination list must be NULL or one of the paged out lists\n"));
 
     if (fReuseBuffer)
     {
@@ -362,7 +474,7 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
 
                 if (fReuseBuffer && pCurr->cbData == cbData)
                 {
-                    STAM_COUNTER_INC(&pCache->StatBuffersReused);
+                    STAM_COUNTER_INC(&pShard->pCache->StatBuffersReused);
                     *ppbBuffer = pCurr->pbData;
                 }
                 else if (pCurr->pbData)
@@ -372,16 +484,17 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                 cbEvicted += pCurr->cbData;
 
                 pdmBlkCacheEntryRemoveFromList(pCurr);
-                pdmBlkCacheSub(pCache, pCurr->cbData);
+                pdmBlkCacheSub(pShard, pCurr->cbData);
 
                 if (pGhostListDst)
                 {
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
                     PPDMBLKCACHEENTRY pGhostEntFree = pGhostListDst->pTail;
+                    uint32_t cbGhostMax = pdmBlkCacheGhostListMax(pShard, pGhostListDst);
 
                     /* We have to remove the last entries from the paged out list. */
-                    while (   pGhostListDst->cbCached + pCurr->cbData > pCache->cbRecentlyUsedOutMax
+                    while (   pGhostListDst->cbCached + pCurr->cbData > cbGhostMax
                            && pGhostEntFree)
                     {
                         PPDMBLKCACHEENTRY pFree = pGhostEntFree;
@@ -395,9 +508,9 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                         {
                             pdmBlkCacheEntryRemoveFromList(pFree);
 
-                            STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_START(&pShard->pCache->StatTreeRemove, Cache);
                             RTAvlrU64Remove(pBlkCacheFree->pTree, pFree->Core.Key);
-                            STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_STOP(&pShard->pCache->StatTreeRemove, Cache);
 
                             RTMemFree(pFree);
                         }
@@ -405,12 +518,12 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                         RTSemRWReleaseWrite(pBlkCacheFree->SemRWEntries);
                     }
 
-                    if (pGhostListDst->cbCached + pCurr->cbData > pCache->cbRecentlyUsedOutMax)
+                    if (pGhostListDst->cbCached + pCurr->cbData > cbGhostMax)
                     {
                         /* Couldn't remove enough entries. Delete */
-                        STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                        STAM_PROFILE_ADV_START(&pShard->pCache->StatTreeRemove, Cache);
                         RTAvlrU64Remove(pCurr->pBlkCache->pTree, pCurr->Core.Key);
-                        STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                        STAM_PROFILE_ADV_STOP(&pShard->pCache->StatTreeRemove, Cache);
 
                         RTMemFree(pCurr);
                     }
@@ -420,9 +533,9 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                 else
                 {
                     /* Delete the entry from the AVL tree it is assigned to. */
-                    STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_START(&pShard->pCache->StatTreeRemove, Cache);
                     RTAvlrU64Remove(pCurr->pBlkCache->pTree, pCurr->Core.Key);
-                    STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_STOP(&pShard->pCache->StatTreeRemove, Cache);
 
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
                     RTMemFree(pCurr);
@@ -437,17 +550,169 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
     return cbEvicted;
 }
 
-static bool pdmBlkCacheReclaim(PPDMBLKCACHEGLOBAL pCache, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
+/**
+ * Makes room in the cache according to the ARC policy.
+ *
+ * Evicts from the recently used list into its ghost list while that list is
+ * above its adaptive target size and from the frequently used list into its
+ * ghost list otherwise.
+ *
+ * @returns Amount of data which could be freed.
+ * @param   pShard       The cache shard.
+ * @param   cbData       The amount of the data to free.
+ * @param   fReuseBuffer Flag whether a buffer should be reused if it has the same size
+ * @param   ppbBuffer    Where to store the address of the buffer if an entry with the
+ *                       same size was found and fReuseBuffer is true.
+ */
+static size_t pdmBlkCacheReclaimArc(PPDMBLKCACHESHARD pShard, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
+{
+    PPDMBLKLRULIST pListFirst      = &pShard->LruFrequentlyUsed;
+    PPDMBLKLRULIST pGhostFirst     = &pShard->LruFrequentlyUsedOut;
+    PPDMBLKLRULIST pListSecond     = &pShard->LruRecentlyUsedIn;
+    PPDMBLKLRULIST pGhostSecond    = &pShard->LruRecentlyUsedOut;
+
+    if (   pShard->LruRecentlyUsedIn.cbCached
+        && pShard->LruRecentlyUsedIn.cbCached >= pShard->cbRecentlyUsedInTarget)
+    {
+        pListFirst   = &pShard->LruRecentlyUsedIn;
+        pGhostFirst  = &pShard->LruRecentlyUsedOut;
+        pListSecond  = &pShard->LruFrequentlyUsed;
+        pGhostSecond = &pShard->LruFrequentlyUsedOut;
+    }
+
+    size_t cbRemoved = pdmBlkCacheEvictPagesFrom(pShard, cbData, pListFirst, pGhostFirst,
+                                                 fReuseBuffer, ppbBuffer);
+    if (cbRemoved < cbData)
+    {
+        /* Entries which are in use can't be evicted, fall back to the other list. */
+        if (!cbRemoved)
+            cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData, pListSecond, pGhostSecond,
+                                                   fReuseBuffer, ppbBuffer);
+        else
+            cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData - cbRemoved, pListSecond,
+                                                   pGhostSecond, false, NULL);
+    }
+
+    return cbRemoved;
+}
+
+/**
+ * Adapts the ARC target size of the recently used list after an access
+ * hit an entry on one of the ghost lists.
+ *
+ * A hit in the recently used ghost list means the list was too small, a hit in
+ * the frequently used ghost list means the opposite. Does nothing for 2Q.
+ *
+ * @returns nothing.
+ * @param   pShard    The cache shard.
+ * @param   pEntry    The ghost entry which was hit, still linked into its list.
+ */
+static void pdmBlkCacheGhostHit(PPDMBLKCACHESHARD pShard, PPDMBLKCACHEENTRY pEntry)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+
+    if (pShard->pCache->enmPolicy != PDMBLKCACHEPOLICY_ARC)
+        return;
+
+    uint64_t cbRecentOut   = RT_MAX(pShard->LruRecentlyUsedOut.cbCached, 1);
+    uint64_t cbFrequentOut = RT_MAX(pShard->LruFrequentlyUsedOut.cbCached, 1);
+
+    if (pEntry->pList == &pShard->LruRecentlyUsedOut)
+    {
+        uint64_t cbDelta = RT_MAX(cbFrequentOut / cbRecentOut, 1) * pEntry->cbData;
+        pdmBlkCacheShardSetMruInTarget(pShard, (uint32_t)RT_MIN(pShard->cbRecentlyUsedInTarget + cbDelta, pShard->cbMax));
+    }
+    else if (pEntry->pList == &pShard->LruFrequentlyUsedOut)
+    {
+        uint64_t cbDelta = RT_MAX(cbRecentOut / cbFrequentOut, 1) * pEntry->cbData;
+        pdmBlkCacheShardSetMruInTarget(pShard,   pShard->cbRecentlyUsedInTarget > cbDelta
+                                               ? pShard->cbRecentlyUsedInTarget - (uint32_t)cbDelta
+                                               : 0);
+    }
+}
+
+/**
+ * Returns whether a hit on the given entry moves it to the top of the
+ * frequently used list.
+ *
+ * @returns true if the entry should be moved, false otherwise.
+ * @param   pShard    The cache shard.
+ * @param   pList     The list the entry was in when it was hit.
+ */
+DECLINLINE(bool) pdmBlkCacheEntryHitPromotes(PPDMBLKCACHESHARD pShard, PPDMBLKLRULIST pList)
+{
+    /* 2Q keeps entries on the recently used list until they are paged out, ARC promotes on the second access. */
+    return    pList == &pShard->LruFrequentlyUsed
+           || (   pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC
+               && pList == &pShard->LruRecentlyUsedIn);
+}
+
+/**
+ * Moves the given entry to the top of the frequently used list.
+ *
+ * @returns nothing.
+ * @param   pShard    The cache shard, the caller owns the lock.
+ * @param   pEntry    The entry to move.
+ */
+DECLINLINE(void) pdmBlkCacheEntryPromote(PPDMBLKCACHESHARD pShard, PPDMBLKCACHEENTRY pEntry)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+
+    pdmBlkCacheEntryAddToList(&pShard->LruFrequentlyUsed, pEntry);
+    uint64_t cbPromoted = pShard->cbPromoted + pEntry->cbData;
+    ASMAtomicWriteU64(&pEntry->cbPromotedLast, cbPromoted);
+    ASMAtomicWriteU64(&pShard->cbPromoted, cbPromoted);
+}
+
+/**
+ * Updates the position of an entry containing data after a hit.
+ *
+ * Entries which are still in the top quarter of the frequently used list are
+ * left alone without taking the shard lock, this keeps the hit path of the hot
+ * set lock free. The distance to the top is estimated from the number of bytes
+ * moved to the top since the entry got there, entries removed in the meantime
+ * only move it closer. Everything looked at before taking the lock is only
+ * changed atomically, so the worst outcome of a stale value is a superfluous
+ * or a skipped move which is re-evaluated under the lock or on the next hit.
+ *
+ * @returns nothing.
+ * @param   pShard    The cache shard the entry belongs to.
+ * @param   pEntry    The entry which was hit, referenced by the caller.
+ */
+static void pdmBlkCacheEntryHit(PPDMBLKCACHESHARD pShard, PPDMBLKCACHEENTRY pEntry)
+{
+    PPDMBLKLRULIST pList = ASMAtomicReadPtrT(&pEntry->pList, PPDMBLKLRULIST);
+    if (!pdmBlkCacheEntryHitPromotes(pShard, pList))
+        return;
+
+    if (   pList == &pShard->LruFrequentlyUsed
+        &&   ASMAtomicReadU64(&pShard->cbPromoted) - ASMAtomicReadU64(&pEntry->cbPromotedLast)
+           < ASMAtomicReadU32(&pShard->LruFrequentlyUsed.cbCached) / 4)
+    {
+        STAM_REL_COUNTER_INC(&pShard->StatPromoteSkipped);
+        return;
+    }
+
+    pdmBlkCacheShardLockEnter(pShard);
+    /* The entry might have been moved to a ghost list while the lock was not held. */
+    if (pdmBlkCacheEntryHitPromotes(pShard, pEntry->pList))
+        pdmBlkCacheEntryPromote(pShard, pEntry);
+    pdmBlkCacheShardLockLeave(pShard);
+}
+
+static bool pdmBlkCacheReclaim(PPDMBLKCACHESHARD pShard, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
 {
     size_t cbRemoved = 0;
 
-    if ((pCache->cbCached + cbData) < pCache->cbMax)
+    if ((pShard->cbCached + cbData) < pShard->cbMax)
         return true;
-    else if ((pCache->LruRecentlyUsedIn.cbCached + cbData) > pCache->cbRecentlyUsedInMax)
+    else if (pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC)
+        cbRemoved = pdmBlkCacheReclaimArc(pShard, cbData, fReuseBuffer, ppbBuffer);
+    else if ((pShard->LruRecentlyUsedIn.cbCached + cbData) > pShard->cbRecentlyUsedInMax)
     {
         /* Try to evict as many bytes as possible from A1in */
-        cbRemoved = pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruRecentlyUsedIn,
-                                                 &pCache->LruRecentlyUsedOut, fReuseBuffer, ppbBuffer);
+        cbRemoved = pdmBlkCacheEvictPagesFrom(pShard, cbData, &pShard->LruRecentlyUsedIn,
+                                                 &pShard->LruRecentlyUsedOut, fReuseBuffer, ppbBuffer);
 
         /*
          * If it was not possible to remove enough entries
@@ -462,17 +727,17 @@ static bool pdmBlkCacheReclaim(PPDMBLKCACHEGLOBAL pCache, size_t cbData, bool fR
              * we don't need to evict that much data
              */
             if (!cbRemoved)
-                cbRemoved += pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruFrequentlyUsed,
+                cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData, &pShard->LruFrequentlyUsed,
                                                           NULL, fReuseBuffer, ppbBuffer);
             else
-                cbRemoved += pdmBlkCacheEvictPagesFrom(pCache, cbData - cbRemoved, &pCache->LruFrequentlyUsed,
+                cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData - cbRemoved, &pShard->LruFrequentlyUsed,
                                                           NULL, false, NULL);
         }
     }
     else
     {
         /* We have to remove entries from frequently access list. */
-        cbRemoved = pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruFrequentlyUsed,
+        cbRemoved = pdmBlkCacheEvictPagesFrom(pShard, cbData, &pShard->LruFrequentlyUsed,
                                                  NULL, fReuseBuffer, ppbBuffer);
     }
 
@@ -812,7 +1077,7 @@ static DECLCALLBACK(int) pdmR3BlkCacheSaveExec(PVM pVM, PSSMHANDLE pSSM)
 
     AssertPtr(pBlkCacheGlobal);
 
-    pdmBlkCacheLockEnter(pBlkCacheGlobal);
+    pdmBlkCacheLockEnterAll(pBlkCacheGlobal);
 
     SSMR3PutU32(pSSM, pBlkCacheGlobal->cRefs);
 
@@ -843,8 +1108,8 @@ static DECLCALLBACK(int) pdmR3BlkCacheSaveExec(PVM pVM, PSSMHANDLE pSSM)
             AssertMsg(pEntry->fFlags & PDMBLKCACHE_ENTRY_IS_DIRTY, ("Entry is not dirty\n"));
             AssertMsg(!(pEntry->fFlags & ~PDMBLKCACHE_ENTRY_IS_DIRTY), ("Invalid flags set\n"));
             AssertMsg(!pEntry->pWaitingHead && !pEntry->pWaitingTail, ("There are waiting requests\n"));
-            AssertMsg(   pEntry->pList == &pBlkCacheGlobal->LruRecentlyUsedIn
-                      || pEntry->pList == &pBlkCacheGlobal->LruFrequentlyUsed,
+            AssertMsg(   pEntry->pList == &pEntry->pShard->LruRecentlyUsedIn
+                      || pEntry->pList == &pEntry->pShard->LruFrequentlyUsed,
                       ("Invalid list\n"));
             AssertMsg(pEntry->cbData == pEntry->Core.KeyLast - pEntry->Core.Key + 1,
                       ("Size and range do not match\n"));
@@ -858,7 +1123,7 @@ static DECLCALLBACK(int) pdmR3BlkCacheSaveExec(PVM pVM, PSSMHANDLE pSSM)
         RTSemRWReleaseRead(pBlkCache->SemRWEntries);
     }
 
-    pdmBlkCacheLockLeave(pBlkCacheGlobal);
+    pdmBlkCacheLockLeaveAll(pBlkCacheGlobal);
 
     /* Terminator */
     return SSMR3PutU32(pSSM, UINT32_MAX);
@@ -872,11 +1137,11 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
     NOREF(uPass);
     AssertPtr(pBlkCacheGlobal);
 
-    pdmBlkCacheLockEnter(pBlkCacheGlobal);
-
     if (uVersion != PDM_BLK_CACHE_SAVED_STATE_VERSION)
         return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
 
+    pdmBlkCacheLockEnterAll(pBlkCacheGlobal);
+
     SSMR3GetU32(pSSM, &cRefs);
 
     /*
@@ -956,8 +1221,8 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
 
             /* Add to the dirty list. */
             pdmBlkCacheAddDirtyEntry(pBlkCache, pEntry);
-            pdmBlkCacheEntryAddToList(&pBlkCacheGlobal->LruRecentlyUsedIn, pEntry);
-            pdmBlkCacheAdd(pBlkCacheGlobal, cbEntry);
+            pdmBlkCacheEntryAddToList(&pEntry->pShard->LruRecentlyUsedIn, pEntry);
+            pdmBlkCacheAdd(pEntry->pShard, cbEntry);
             pdmBlkCacheEntryRelease(pEntry);
             cEntries--;
         }
@@ -972,7 +1237,7 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
         rc = SSMR3SetCfgError(pSSM, RT_SRC_POS,
                               N_("Unexpected error while restoring state. Please make sure the source and target VMs have compatible storage configurations"));
 
-    pdmBlkCacheLockLeave(pBlkCacheGlobal);
+    pdmBlkCacheLockLeaveAll(pBlkCacheGlobal);
 
     if (RT_SUCCESS(rc))
     {
@@ -985,6 +1250,30 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
     return rc;
 }
 
+static int pdmBlkCachePolicyFromName(const char *pszVal, PPDMBLKCACHEPOLICY penmPolicy)
+{
+    int rc = VINF_SUCCESS;
+
+    if (!RTStrICmp(pszVal, "2Q"))
+        *penmPolicy = PDMBLKCACHEPOLICY_2Q;
+    else if (!RTStrICmp(pszVal, "ARC"))
+        *penmPolicy = PDMBLKCACHEPOLICY_ARC;
+    else
+        rc = VERR_CFGM_CONFIG_UNKNOWN_VALUE;
+
+    return rc;
+}
+
+static const char *pdmBlkCachePolicyToName(PDMBLKCACHEPOLICY enmPolicy)
+{
+    if (enmPolicy == PDMBLKCACHEPOLICY_2Q)
+        return "2Q";
+    if (enmPolicy == PDMBLKCACHEPOLICY_ARC)
+        return "ARC";
+
+    return NULL;
+}
+
 int pdmR3BlkCacheInit(PVM pVM)
 {
     int  rc   = VINF_SUCCESS;
@@ -1008,29 +1297,74 @@ int pdmR3BlkCacheInit(PVM pVM)
     pBlkCacheGlobal->cbCached  = 0;
     pBlkCacheGlobal->fCommitInProgress = false;
 
-    /* Initialize members */
-    pBlkCacheGlobal->LruRecentlyUsedIn.pHead    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedIn.pTail    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedIn.cbCached = 0;
-
-    pBlkCacheGlobal->LruRecentlyUsedOut.pHead    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedOut.pTail    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedOut.cbCached = 0;
-
-    pBlkCacheGlobal->LruFrequentlyUsed.pHead    = NULL;
-    pBlkCacheGlobal->LruFrequentlyUsed.pTail    = NULL;
-    pBlkCacheGlobal->LruFrequentlyUsed.cbCached = 0;
-
     do
     {
         rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheSize", &pBlkCacheGlobal->cbMax, 5 * _1M);
         AssertLogRelRCBreak(rc);
         LogFlowFunc(("Maximum number of bytes cached %u\n", pBlkCacheGlobal->cbMax));
 
-        pBlkCacheGlobal->cbRecentlyUsedInMax  = (pBlkCacheGlobal->cbMax / 100) * 25; /* 25% of the buffer size */
-        pBlkCacheGlobal->cbRecentlyUsedOutMax = (pBlkCacheGlobal->cbMax / 100) * 50; /* 50% of the buffer size */
-        LogFlowFunc(("cbRecentlyUsedInMax=%u cbRecentlyUsedOutMax=%u\n",
-                     pBlkCacheGlobal->cbRecentlyUsedInMax, pBlkCacheGlobal->cbRecentlyUsedOutMax));
+        /* Replacement policy. */
+        char *pszPolicy = NULL;
+        rc = CFGMR3QueryStringAllocDef(pCfgBlkCache, "CachePolicy", &pszPolicy, "2Q");
+        AssertLogRelRCBreak(rc);
+        rc = pdmBlkCachePolicyFromName(pszPolicy, &pBlkCacheGlobal->enmPolicy);
+        MMR3HeapFree(pszPolicy);
+        if (RT_FAILURE(rc))
+            break;
+
+        /*
+         * Number of independently locked shards the cache is split into. The default
+         * gives every shard at least 4MB so small caches don't end up with per shard
+         * lists too short for the replacement policy to work.
+         */
+        uint32_t cShardsDef = RT_MIN(RT_MAX(pBlkCacheGlobal->cbMax / (4 * _1M), 1), 16);
+        rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheShards", &pBlkCacheGlobal->cShards, cShardsDef);
+        AssertLogRelRCBreak(rc);
+        if (   !pBlkCacheGlobal->cShards
+            || pBlkCacheGlobal->cShards > PDMBLKCACHE_SHARDS_MAX)
+        {
+            LogRel(("BlkCache: Invalid number of cache shards %u (1..%u)\n",
+                    pBlkCacheGlobal->cShards, PDMBLKCACHE_SHARDS_MAX));
+            rc = VERR_OUT_OF_RANGE;
+            break;
+        }
+
+        pBlkCacheGlobal->paShards = (PPDMBLKCACHESHARD)RTMemAllocZ(pBlkCacheGlobal->cShards * sizeof(PDMBLKCACHESHARD));
+        if (!pBlkCacheGlobal->paShards)
+        {
+            rc = VERR_NO_MEMORY;
+            break;
+        }
+
+        /* Each shard gets an equal part of the cache, ARC starts out with no preference for the recency list. */
+        uint32_t cShardsInit = 0;
+        for (; cShardsInit < pBlkCacheGlobal->cShards; cShardsInit++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->paShards[cShardsInit];
+
+            pShard->pCache                 = pBlkCacheGlobal;
+            pShard->cbMax                  = pBlkCacheGlobal->cbMax / pBlkCacheGlobal->cShards;
+            pShard->cbRecentlyUsedInMax    = (pShard->cbMax / 100) * 25; /* 25% of the buffer size */
+            pShard->cbRecentlyUsedOutMax   = (pShard->cbMax / 100) * 50; /* 50% of the buffer size */
+            pShard->cbRecentlyUsedInTarget = 0;
+            pShard->LruRecentlyUsedIn.pcbCachedTotal    = &pBlkCacheGlobal->cbCachedMruIn;
+            pShard->LruRecentlyUsedOut.pcbCachedTotal   = &pBlkCacheGlobal->cbCachedMruOut;
+            pShard->LruFrequentlyUsed.pcbCachedTotal    = &pBlkCacheGlobal->cbCachedFru;
+            pShard->LruFrequentlyUsedOut.pcbCachedTotal = &pBlkCacheGlobal->cbCachedFruOut;
+            rc = RTCritSectInit(&pShard->CritSect);
+            if (RT_FAILURE(rc))
+                break;
+        }
+        if (RT_FAILURE(rc))
+        {
+            while (cShardsInit-- > 0)
+                RTCritSectDelete(&pBlkCacheGlobal->paShards[cShardsInit].CritSect);
+            RTMemFree(pBlkCacheGlobal->paShards);
+            pBlkCacheGlobal->paShards = NULL;
+            break;
+        }
+        LogFlowFunc(("cShards=%u cbRecentlyUsedInMax=%u cbRecentlyUsedOutMax=%u\n", pBlkCacheGlobal->cShards,
+                     pBlkCacheGlobal->paShards[0].cbRecentlyUsedInMax, pBlkCacheGlobal->paShards[0].cbRecentlyUsedOutMax));
 
         /** @todo r=aeichner: Experiment to find optimal default values */
         rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheCommitIntervalMs", &pBlkCacheGlobal->u32CommitTimeoutMs, 10000 /* 10sec */);
@@ -1046,26 +1380,79 @@ int pdmR3BlkCacheInit(PVM pVM)
                        "/PDM/BlkCache/cbMax",
                        STAMUNIT_BYTES,
                        "Maximum cache size");
-        STAMR3Register(pVM, &pBlkCacheGlobal->cbCached,
+        STAMR3Register(pVM, (void *)&pBlkCacheGlobal->cbCached,
                        STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/cbCached",
                        STAMUNIT_BYTES,
                        "Currently used cache");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruRecentlyUsedIn.cbCached,
+        STAMR3Register(pVM, (void *)&pBlkCacheGlobal->cbCachedMruIn,
                        STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/cbCachedMruIn",
                        STAMUNIT_BYTES,
                        "Number of bytes cached in MRU list");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruRecentlyUsedOut.cbCached,
+        STAMR3Register(pVM, (void *)&pBlkCacheGlobal->cbCachedMruOut,
                        STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/cbCachedMruOut",
                        STAMUNIT_BYTES,
                        "Number of bytes cached in FRU list");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruFrequentlyUsed.cbCached,
+        STAMR3Register(pVM, (void *)&pBlkCacheGlobal->cbCachedFru,
                        STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/cbCachedFru",
                        STAMUNIT_BYTES,
                        "Number of bytes cached in FRU ghost list");
+        if (pBlkCacheGlobal->enmPolicy == PDMBLKCACHEPOLICY_ARC)
+        {
+            STAMR3Register(pVM, (void *)&pBlkCacheGlobal->cbCachedFruOut,
+                           STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                           "/PDM/BlkCache/cbCachedFruOut",
+                           STAMUNIT_BYTES,
+                           "Number of bytes tracked in the FRU ghost list");
+            STAMR3Register(pVM, (void *)&pBlkCacheGlobal->cbRecentlyUsedInTarget,
+                           STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                           "/PDM/BlkCache/cbMruInTarget",
+                           STAMUNIT_BYTES,
+                           "Adaptive target size of the MRU list");
+        }
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->paShards[i];
+
+            STAMR3RegisterF(pVM, &pShard->cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Currently used cache of the shard",
+                            "/PDM/BlkCache/Shard%u/cbCached", i);
+            STAMR3RegisterF(pVM, (void *)&pShard->LruRecentlyUsedIn.cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes cached in MRU list",
+                            "/PDM/BlkCache/Shard%u/cbCachedMruIn", i);
+            STAMR3RegisterF(pVM, (void *)&pShard->LruRecentlyUsedOut.cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes cached in FRU list",
+                            "/PDM/BlkCache/Shard%u/cbCachedMruOut", i);
+            STAMR3RegisterF(pVM, (void *)&pShard->LruFrequentlyUsed.cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes cached in FRU ghost list",
+                            "/PDM/BlkCache/Shard%u/cbCachedFru", i);
+            if (pBlkCacheGlobal->enmPolicy == PDMBLKCACHEPOLICY_ARC)
+            {
+                STAMR3RegisterF(pVM, (void *)&pShard->LruFrequentlyUsedOut.cbCached,
+                                STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                                "Number of bytes tracked in the FRU ghost list",
+                                "/PDM/BlkCache/Shard%u/cbCachedFruOut", i);
+                STAMR3RegisterF(pVM, &pShard->cbRecentlyUsedInTarget,
+                                STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                                "Adaptive target size of the MRU list",
+                                "/PDM/BlkCache/Shard%u/cbMruInTarget", i);
+            }
+            STAMR3RegisterF(pVM, &pShard->StatLockContended,
+                            STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                            "Number of times the shard lock was busy when entering it",
+                            "/PDM/BlkCache/Shard%u/LockContended", i);
+            STAMR3RegisterF(pVM, &pShard->StatPromoteSkipped,
+                            STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                            "Number of hits which left the entry in place without taking the lock",
+                            "/PDM/BlkCache/Shard%u/PromoteSkipped", i);
+        }
 
 #ifdef VBOX_WITH_STATISTICS
         STAMR3Register(pVM, &pBlkCacheGlobal->cHits,
@@ -1130,6 +1517,8 @@ int pdmR3BlkCacheInit(PVM pVM)
             if (RT_SUCCESS(rc))
             {
                 LogRel(("BlkCache: Cache successfully initialised. Cache size is %u bytes\n", pBlkCacheGlobal->cbMax));
+                LogRel(("BlkCache: Cache replacement policy is %s\n", pdmBlkCachePolicyToName(pBlkCacheGlobal->enmPolicy)));
+                LogRel(("BlkCache: Cache is split into %u shards\n", pBlkCacheGlobal->cShards));
                 LogRel(("BlkCache: Cache commit interval is %u ms\n", pBlkCacheGlobal->u32CommitTimeoutMs));
                 LogRel(("BlkCache: Cache commit threshold is %u bytes\n", pBlkCacheGlobal->cbCommitDirtyThreshold));
                 pUVM->pdm.s.pBlkCacheGlobal = pBlkCacheGlobal;
@@ -1140,6 +1529,13 @@ int pdmR3BlkCacheInit(PVM pVM)
         RTCritSectDelete(&pBlkCacheGlobal->CritSect);
     }
 
+    if (pBlkCacheGlobal->paShards)
+    {
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+            RTCritSectDelete(&pBlkCacheGlobal->paShards[i].CritSect);
+        RTMemFree(pBlkCacheGlobal->paShards);
+    }
+
     if (pBlkCacheGlobal)
         RTMemFree(pBlkCacheGlobal);
 
@@ -1154,15 +1550,24 @@ void pdmR3BlkCacheTerm(PVM pVM)
     if (pBlkCacheGlobal)
     {
         /* Make sure no one else uses the cache now */
-        pdmBlkCacheLockEnter(pBlkCacheGlobal);
+        pdmBlkCacheLockEnterAll(pBlkCacheGlobal);
 
         /* Cleanup deleting all cache entries waiting for in progress entries to finish. */
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruRecentlyUsedIn);
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruRecentlyUsedOut);
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruFrequentlyUsed);
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->paShards[i];
+
+            pdmBlkCacheDestroyList(&pShard->LruRecentlyUsedIn);
+            pdmBlkCacheDestroyList(&pShard->LruRecentlyUsedOut);
+            pdmBlkCacheDestroyList(&pShard->LruFrequentlyUsed);
+            pdmBlkCacheDestroyList(&pShard->LruFrequentlyUsedOut);
+        }
 
-        pdmBlkCacheLockLeave(pBlkCacheGlobal);
+        pdmBlkCacheLockLeaveAll(pBlkCacheGlobal);
 
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+            RTCritSectDelete(&pBlkCacheGlobal->paShards[i].CritSect);
+        RTMemFree(pBlkCacheGlobal->paShards);
         RTCritSectDelete(&pBlkCacheGlobal->CritSect);
         RTMemFree(pBlkCacheGlobal);
         pVM->pUVM->pdm.s.pBlkCacheGlobal = NULL;
@@ -1383,12 +1788,12 @@ static int pdmBlkCacheEntryDestroy(PAVLRU64NODECORE pNode, void *pvUser)
         /* Leave the locks to let the I/O thread make progress but reference the entry to prevent eviction. */
         pdmBlkCacheEntryRef(pEntry);
         RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
-        pdmBlkCacheLockLeave(pCache);
+        pdmBlkCacheLockLeaveAll(pCache);
 
         RTThreadSleep(250);
 
         /* Re-enter all locks */
-        pdmBlkCacheLockEnter(pCache);
+        pdmBlkCacheLockEnterAll(pCache);
         RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
         pdmBlkCacheEntryRelease(pEntry);
     }
@@ -1396,13 +1801,14 @@ static int pdmBlkCacheEntryDestroy(PAVLRU64NODECORE pNode, void *pvUser)
     AssertMsg(!(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS),
                 ("Entry is dirty and/or still in progress fFlags=%#x\n", pEntry->fFlags));
 
-    bool fUpdateCache =    pEntry->pList == &pCache->LruFrequentlyUsed
-                        || pEntry->pList == &pCache->LruRecentlyUsedIn;
+    PPDMBLKCACHESHARD pShard = pEntry->pShard;
+    bool fUpdateCache =    pEntry->pList == &pShard->LruFrequentlyUsed
+                        || pEntry->pList == &pShard->LruRecentlyUsedIn;
 
     pdmBlkCacheEntryRemoveFromList(pEntry);
 
     if (fUpdateCache)
-        pdmBlkCacheSub(pCache, pEntry->cbData);
+        pdmBlkCacheSub(pShard, pEntry->cbData);
 
     RTMemPageFree(pEntry->pbData, pEntry->cbData);
     RTMemFree(pEntry);
@@ -1429,7 +1835,7 @@ VMMR3DECL(void) PDMR3BlkCacheRelease(PPDMBLKCACHE pBlkCache)
         pdmBlkCacheCommit(pBlkCache);
 
     /* Make sure nobody is accessing the cache while we delete the tree. */
-    pdmBlkCacheLockEnter(pCache);
+    pdmBlkCacheLockEnterAll(pCache);
     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
     RTAvlrU64Destroy(pBlkCache->pTree, pdmBlkCacheEntryDestroy, pCache);
     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
@@ -1439,7 +1845,7 @@ VMMR3DECL(void) PDMR3BlkCacheRelease(PPDMBLKCACHE pBlkCache)
     pCache->cRefs--;
     RTListNodeRemove(&pBlkCache->NodeCacheUser);
 
-    pdmBlkCacheLockLeave(pCache);
+    pdmBlkCacheLockLeaveAll(pCache);
 
     RTSemRWDestroy(pBlkCache->SemRWEntries);
 
@@ -1617,6 +2023,7 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryAlloc(PPDMBLKCACHE pBlkCache,
     pEntryNew->Core.Key      = off;
     pEntryNew->Core.KeyLast  = off + cbData - 1;
     pEntryNew->pBlkCache     = pBlkCache;
+    pEntryNew->pShard        = pdmBlkCacheShardGet(pBlkCache, off);
     pEntryNew->fFlags        = 0;
     pEntryNew->cRefs         = 1; /* We are using it now. */
     pEntryNew->pList         = NULL;
@@ -1819,12 +2226,12 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache,
     *pcbData = pdmBlkCacheEntryBoundariesCalc(pBlkCache, off, (uint32_t)cb, &cbEntry);
     AssertReturn(cb <= UINT32_MAX, NULL);
 
-    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
-    pdmBlkCacheLockEnter(pCache);
+    PPDMBLKCACHESHARD pShard = pdmBlkCacheShardGet(pBlkCache, off);
+    pdmBlkCacheShardLockEnter(pShard);
 
     PPDMBLKCACHEENTRY pEntryNew = NULL;
     uint8_t          *pbBuffer  = NULL;
-    bool fEnough = pdmBlkCacheReclaim(pCache, cbEntry, true, &pbBuffer);
+    bool fEnough = pdmBlkCacheReclaim(pShard, cbEntry, true, &pbBuffer);
     if (fEnough)
     {
         LogFlow(("Evicted enough bytes (%u requested). Creating new cache entry\n", cbEntry));
@@ -1832,9 +2239,9 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache,
         pEntryNew = pdmBlkCacheEntryAlloc(pBlkCache, off, cbEntry, pbBuffer);
         if (RT_LIKELY(pEntryNew))
         {
-            pdmBlkCacheEntryAddToList(&pCache->LruRecentlyUsedIn, pEntryNew);
-            pdmBlkCacheAdd(pCache, cbEntry);
-            pdmBlkCacheLockLeave(pCache);
+            pdmBlkCacheEntryAddToList(&pShard->LruRecentlyUsedIn, pEntryNew);
+            pdmBlkCacheAdd(pShard, cbEntry);
+            pdmBlkCacheShardLockLeave(pShard);
 
             pdmBlkCacheInsertEntry(pBlkCache, pEntryNew);
 
@@ -1843,10 +2250,10 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache,
                       ("Overflow in calculation off=%llu\n", off));
         }
         else
-            pdmBlkCacheLockLeave(pCache);
+            pdmBlkCacheShardLockLeave(pShard);
     }
     else
-        pdmBlkCacheLockLeave(pCache);
+        pdmBlkCacheShardLockLeave(pShard);
 
     return pEntryNew;
 }
@@ -1990,8 +2397,9 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
             STAM_COUNTER_ADD(&pCache->StatRead, cbToRead);
 
             /* Ghost lists contain no data. */
-            if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                || (pEntry->pList == &pCache->LruFrequentlyUsed))
+            PPDMBLKCACHESHARD pShard = pEntry->pShard;
+            if (   (pEntry->pList == &pShard->LruRecentlyUsedIn)
+                || (pEntry->pList == &pShard->LruFrequentlyUsed))
             {
                 if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
                                                               PDMBLKCACHE_ENTRY_IO_IN_PROGRESS,
@@ -2010,12 +2418,7 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
                 }
 
                 /* Move this entry to the top position */
-                if (pEntry->pList == &pCache->LruFrequentlyUsed)
-                {
-                    pdmBlkCacheLockEnter(pCache);
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheLockLeave(pCache);
-                }
+                pdmBlkCacheEntryHit(pShard, pEntry);
                 /* Release the entry */
                 pdmBlkCacheEntryRelease(pEntry);
             }
@@ -2025,16 +2428,17 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
 
                 LogFlow(("Fetching data for ghost entry %#p from file\n", pEntry));
 
-                pdmBlkCacheLockEnter(pCache);
+                pdmBlkCacheShardLockEnter(pShard);
+                pdmBlkCacheGhostHit(pShard, pEntry);
                 pdmBlkCacheEntryRemoveFromList(pEntry); /* Remove it before we remove data, otherwise it may get freed when evicting data. */
-                bool fEnough = pdmBlkCacheReclaim(pCache, pEntry->cbData, true, &pbBuffer);
+                bool fEnough = pdmBlkCacheReclaim(pShard, pEntry->cbData, true, &pbBuffer);
 
                 /* Move the entry to Am and fetch it to the cache. */
                 if (fEnough)
                 {
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheAdd(pCache, pEntry->cbData);
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheEntryPromote(pShard, pEntry);
+                    pdmBlkCacheAdd(pShard, pEntry->cbData);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     if (pbBuffer)
                         pEntry->pbData = pbBuffer;
@@ -2057,7 +2461,7 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
                     STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     RTMemFree(pEntry);
 
@@ -2190,8 +2594,9 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
             STAM_COUNTER_ADD(&pCache->StatWritten, cbToWrite);
 
             /* Ghost lists contain no data. */
-            if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                || (pEntry->pList == &pCache->LruFrequentlyUsed))
+            PPDMBLKCACHESHARD pShard = pEntry->pShard;
+            if (   (pEntry->pList == &pShard->LruRecentlyUsedIn)
+                || (pEntry->pList == &pShard->LruFrequentlyUsed))
             {
                 /* Check if the entry is dirty. */
                 if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
@@ -2240,12 +2645,7 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
                 } /* Dirty bit not set */
 
                 /* Move this entry to the top position */
-                if (pEntry->pList == &pCache->LruFrequentlyUsed)
-                {
-                    pdmBlkCacheLockEnter(pCache);
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheLockLeave(pCache);
-                }
+                pdmBlkCacheEntryHit(pShard, pEntry);
 
                 pdmBlkCacheEntryRelease(pEntry);
             }
@@ -2253,16 +2653,17 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
             {
                 uint8_t *pbBuffer = NULL;
 
-                pdmBlkCacheLockEnter(pCache);
+                pdmBlkCacheShardLockEnter(pShard);
+                pdmBlkCacheGhostHit(pShard, pEntry);
                 pdmBlkCacheEntryRemoveFromList(pEntry); /* Remove it before we remove data, otherwise it may get freed when evicting data. */
-                bool fEnough = pdmBlkCacheReclaim(pCache, pEntry->cbData, true, &pbBuffer);
+                bool fEnough = pdmBlkCacheReclaim(pShard, pEntry->cbData, true, &pbBuffer);
 
                 if (fEnough)
                 {
                     /* Move the entry to Am and fetch it to the cache. */
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheAdd(pCache, pEntry->cbData);
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheEntryPromote(pShard, pEntry);
+                    pdmBlkCacheAdd(pShard, pEntry->cbData);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     if (pbBuffer)
                         pEntry->pbData = pbBuffer;
@@ -2287,7 +2688,7 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
                     STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     RTMemFree(pEntry);
                     pdmBlkCacheRequestPassthrough(pBlkCache, pReq,
@@ -2439,8 +2840,9 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                 cbThisDiscard = RT_MIN(pEntry->cbData - offDiff, cbLeft);
 
                 /* Ghost lists contain no data. */
-                if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                    || (pEntry->pList == &pCache->LruFrequentlyUsed))
+                PPDMBLKCACHESHARD pShard = pEntry->pShard;
+                if (   (pEntry->pList == &pShard->LruRecentlyUsedIn)
+                    || (pEntry->pList == &pShard->LruFrequentlyUsed))
                 {
                     /* Check if the entry is dirty. */
                     if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
@@ -2450,14 +2852,14 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                         /* If it is dirty but not yet in progress remove it. */
                         if (!(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS))
                         {
-                            pdmBlkCacheLockEnter(pCache);
+                            pdmBlkCacheShardLockEnter(pShard);
                             pdmBlkCacheEntryRemoveFromList(pEntry);
 
                             STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
                             RTAvlrU64Remove(pBlkCache->pTree, pEntry->Core.Key);
                             STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
 
-                            pdmBlkCacheLockLeave(pCache);
+                            pdmBlkCacheShardLockLeave(pShard);
 
                             RTMemFree(pEntry);
                         }
@@ -2496,7 +2898,7 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                         }
                         else /* I/O in progress flag not set */
                         {
-                            pdmBlkCacheLockEnter(pCache);
+                            pdmBlkCacheShardLockEnter(pShard);
                             pdmBlkCacheEntryRemoveFromList(pEntry);
 
                             RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
@@ -2505,7 +2907,7 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                             STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                             RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                            pdmBlkCacheLockLeave(pCache);
+                            pdmBlkCacheShardLockLeave(pShard);
 
                             RTMemFree(pEntry);
                         }
@@ -2513,7 +2915,7 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                 }
                 else /* Entry is on the ghost list just remove cache entry. */
                 {
-                    pdmBlkCacheLockEnter(pCache);
+                    pdmBlkCacheShardLockEnter(pShard);
                     pdmBlkCacheEntryRemoveFromList(pEntry);
 
                     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
@@ -2522,7 +2924,7 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                     STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     RTMemFree(pEntry);
                 }
@@ -2749,12 +3151,12 @@ VMMR3DECL(int) PDMR3BlkCacheClear(PPDMBLKCACHE pBlkCache)
         pdmBlkCacheCommit(pBlkCache);
 
     /* Make sure nobody is accessing the cache while we delete the tree. */
-    pdmBlkCacheLockEnter(pCache);
+    pdmBlkCacheLockEnterAll(pCache);
     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
     RTAvlrU64Destroy(pBlkCache->pTree, pdmBlkCacheEntryDestroy, pCache);
     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-    pdmBlkCacheLockLeave(pCache);
+    pdmBlkCacheLockLeaveAll(pCache);
     return rc;
 }
 
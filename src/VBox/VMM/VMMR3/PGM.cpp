@@ -2513,6 +2513,11 @@ VMMR3_INT_DECL(void) PGMR3Reset(PVM pVM)
     LogFlow(("PGMR3Reset:\n"));
     VM_ASSERT_EMT(pVM);
 
+    /*
+     * Stop any lazy restore that is still in progress, RAM is reset below.
+     */
+    pgmR3LazyRestoreTerm(pVM);
+
     pgmLock(pVM);
 
     /*
@@ -2642,6 +2647,8 @@ VMMR3DECL(void) PGMR3ResetNoMorePhysWritesFlag(PVM pVM)
  */
 VMMR3DECL(int) PGMR3Term(PVM pVM)
 {
+    pgmR3LazyRestoreTerm(pVM);
+
     /* Must free shared pages here. */
     pgmLock(pVM);
     pgmR3PhysRamTerm(pVM);
@@ -25,6 +25,7 @@
 #include <VBox/vmm/ssm.h>
 #include <VBox/vmm/pdmdrv.h>
 #include <VBox/vmm/pdmdev.h>
+#include <VBox/vmm/cfgm.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
 #include "PGMInline.h"
@@ -37,6 +38,7 @@
 #include <iprt/assert.h>
 #include <iprt/crc.h>
 #include <iprt/mem.h>
+#include <iprt/semaphore.h>
 #include <iprt/sha.h>
 #include <iprt/string.h>
 #include <iprt/thread.h>
@@ -124,6 +126,18 @@
 #define PGMPAGETYPE_OLD_MMIO                5
 /** @}  */
 
+/** @name Lazy restore tunables.
+ * @{ */
+/** The number of pages the lazy restore thread has an EMT restore at a time. */
+#define PGM_LAZY_RESTORE_BATCH_PAGES        64
+/** Runs of this many (or more) pages that aren't pending split the access
+ * handler in two. */
+#define PGM_LAZY_RESTORE_SPLIT_PAGES        4096
+/** @} */
+
+/** The version of the page digests unit ("pgmdigests"). */
+#define PGM_DIGESTS_SAVED_STATE_VERSION     1
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
@@ -149,6 +163,135 @@ typedef struct
 } PGMOLD;
 
 
+/**
+ * Lazy restore tracking of one RAM range.
+ */
+typedef struct PGMLAZYRANGE
+{
+    /** The first address of the range. */
+    RTGCPHYS                        GCPhys;
+    /** The last address of the range (inclusive). */
+    RTGCPHYS                        GCPhysLast;
+    /** The number of pages in the range. */
+    uint32_t                        cPages;
+    /** The number of pages still pending. */
+    uint32_t                        cPending;
+    /** The saved state offset of each page, UINT64_MAX if not pending.
+     * (RTMemPageAlloc) */
+    uint64_t                       *paoffPages;
+} PGMLAZYRANGE;
+/** Pointer to the lazy restore tracking of a RAM range. */
+typedef PGMLAZYRANGE *PPGMLAZYRANGE;
+
+
+/**
+ * Lazy restore state (PGM::pLazyRestoreR3).
+ *
+ * RAM pages in the saved state are not read while loading, only their
+ * location in the file is recorded.  Access handlers catch the guest and
+ * everyone else touching them, while a thread paces an EMT thru restoring the
+ * remainder in the background.  Everything but the thread related members are
+ * protected by the PGM lock.
+ */
+typedef struct PGMLAZYRESTORE
+{
+    /** The cross context VM structure. */
+    PVM                             pVM;
+    /** The saved state page reader. */
+    PSSMPAGEREADER                  pReader;
+    /** The total number of pages still pending. */
+    uint32_t volatile               cPendingPages;
+    /** The number of RAM ranges in aRanges. */
+    uint32_t                        cRanges;
+    /** The range index of the background restore cursor. */
+    uint32_t                        iRangeNext;
+    /** The page index of the background restore cursor. */
+    uint32_t                        iPageNext;
+    /** Number of access handlers registered. */
+    uint32_t                        cHandlers;
+    /** Number of entries allocated in paGCPhysHandlers. */
+    uint32_t                        cHandlersAlloc;
+    /** The start addresses of the registered access handlers. */
+    PRTGCPHYS                       paGCPhysHandlers;
+    /** The first error putting a batch in place, reported by the thread. */
+    int32_t volatile                rcError;
+    /** Set when the thread should terminate. */
+    bool volatile                   fTerminate;
+    /** The background thread. */
+    RTTHREAD                        hThread;
+    /** Signalled by the EMT when it has picked the next batch. */
+    RTSEMEVENT                      hEvtBatch;
+    /** Number of EMTs reading a page without owning the PGM lock, the state
+     * must not be freed before this drops to zero. */
+    uint32_t volatile               cReaders;
+    /** The number of pages in aBatch. */
+    uint32_t                        cBatch;
+    /** The pages of the current batch.  Picked by an EMT, read by the thread
+     * into pbBatch and then put in place by an EMT again. */
+    struct
+    {
+        /** The page address. */
+        RTGCPHYS                    GCPhys;
+        /** The saved state offset, UINT64_MAX if the thread failed to read it. */
+        uint64_t                    offPage;
+    }                               aBatch[PGM_LAZY_RESTORE_BATCH_PAGES];
+    /** Buffer for the batch pages (RTMemPageAlloc). */
+    uint8_t                        *pbBatch;
+    /** The number of pages deferred while loading. */
+    uint32_t                        cDeferred;
+    /** The number of pages restored on access. */
+    uint32_t                        cFaultedIn;
+    /** The number of pages restored in the background. */
+    uint32_t                        cBackground;
+    /** When the load completed (RTTimeMilliTS). */
+    uint64_t                        msStart;
+    /** The RAM ranges. */
+    PGMLAZYRANGE                    aRanges[1];
+} PGMLAZYRESTORE;
+/** Pointer to the lazy restore state. */
+typedef PGMLAZYRESTORE *PPGMLAZYRESTORE;
+
+
+/**
+ * The SHA-1 digests of the pages in one RAM range.
+ */
+typedef struct PGMSAVEDIGESTRANGE
+{
+    /** The first address of the range. */
+    RTGCPHYS                        GCPhys;
+    /** The size of the range. */
+    RTGCPHYS                        cb;
+    /** The digest of each page as it was last saved, all zeros if unknown
+     * and all 0xff for ballooned pages. */
+    uint8_t                       (*paDigests)[RTSHA1_HASH_SIZE];
+} PGMSAVEDIGESTRANGE;
+/** Pointer to the digests of a RAM range. */
+typedef PGMSAVEDIGESTRANGE *PPGMSAVEDIGESTRANGE;
+
+
+/**
+ * Page digests for incremental saved states (PGM::LiveSave::pDigestsR3).
+ *
+ * When saving relative to a base, the digests are initialized from the base's
+ * "pgmdigests" unit and RAM pages whose digest is unchanged are left out.  The
+ * digests are updated as pages are saved, so they describe the new saved state
+ * when written to its "pgmdigests" unit at the end.
+ */
+typedef struct PGMSAVEDIGESTS
+{
+    /** The digest of a zero page. */
+    uint8_t                         abZero[RTSHA1_HASH_SIZE];
+    /** Whether the digests came from a base, i.e. pages can be skipped. */
+    bool                            fHaveBase;
+    /** The number of RAM ranges in aRanges. */
+    uint32_t                        cRanges;
+    /** The RAM ranges. */
+    PGMSAVEDIGESTRANGE              aRanges[1];
+} PGMSAVEDIGESTS;
+/** Pointer to the page digests. */
+typedef PGMSAVEDIGESTS *PPGMSAVEDIGESTS;
+
+
 /*******************************************************************************
 *   Global Variables                                                           *
 *******************************************************************************/
@@ -1536,6 +1679,239 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
 }
 
 
+/**
+ * Loads the page digests of the base of an incremental save.
+ *
+ * Ranges which doesn't match the current RAM configuration are left as
+ * unknown and will be saved in full.
+ *
+ * @returns VBox status code.
+ * @param   pDigests            The digests.
+ * @param   pszBaseFilename     The base saved state.
+ */
+static int pgmR3DigestsLoadBase(PPGMSAVEDIGESTS pDigests, const char *pszBaseFilename)
+{
+    PSSMHANDLE pSSM;
+    int rc = SSMR3Open(pszBaseFilename, 0 /*fFlags*/, &pSSM);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint32_t uVersion;
+    rc = SSMR3Seek(pSSM, "pgmdigests", 0 /*iInstance*/, &uVersion);
+    if (RT_SUCCESS(rc) && uVersion != PGM_DIGESTS_SAVED_STATE_VERSION)
+        rc = VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+    while (RT_SUCCESS(rc))
+    {
+        RTGCPHYS GCPhys;
+        RTGCPHYS cb;
+        SSMR3GetGCPhys(pSSM, &GCPhys);
+        rc = SSMR3GetGCPhys(pSSM, &cb);
+        if (RT_FAILURE(rc) || GCPhys == NIL_RTGCPHYS)
+            break;
+        AssertLogRelMsgBreakStmt(cb && !(cb & PAGE_OFFSET_MASK) && cb <= _4G * (RTGCPHYS)PAGE_SIZE,
+                                 ("GCPhys=%RGp cb=%RGp\n", GCPhys, cb), rc = VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+
+        uint32_t const cPages = (uint32_t)(cb >> PAGE_SHIFT);
+        uint32_t       i      = 0;
+        while (   i < pDigests->cRanges
+               && (pDigests->aRanges[i].GCPhys != GCPhys || pDigests->aRanges[i].cb != cb))
+            i++;
+        if (i < pDigests->cRanges)
+            rc = SSMR3GetMem(pSSM, pDigests->aRanges[i].paDigests, cPages * RTSHA1_HASH_SIZE);
+        else
+        {
+            LogRel(("PGM: The RAM range %RGp LB %RGp in the base is gone, ignoring its digests\n", GCPhys, cb));
+            rc = SSMR3Skip(pSSM, (size_t)cPages * RTSHA1_HASH_SIZE);
+        }
+    }
+
+    SSMR3Close(pSSM);
+    return rc;
+}
+
+
+/**
+ * Sets up the page digests when saving relative to a base or when the
+ * digests are to be saved (/PGM/SaveDigests).
+ *
+ * @returns VBox status code.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pSSM                The SSM handle.
+ */
+static int pgmR3DigestsPrep(PVM pVM, PSSMHANDLE pSSM)
+{
+    const char *pszBaseFilename = SSMR3HandleBaseFilename(pSSM);
+    if (   pVM->pgm.s.LiveSave.pDigestsR3
+        || (!pszBaseFilename && !pVM->pgm.s.LiveSave.fSaveDigests))
+        return VINF_SUCCESS;
+
+    /*
+     * Allocate digests for all the real RAM ranges, all unknown.
+     */
+    pgmLock(pVM);
+    uint32_t cRanges = 0;
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam; pRam = pRam->pNextR3)
+        if (!PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            cRanges++;
+
+    int rc = VINF_SUCCESS;
+    PPGMSAVEDIGESTS pDigests = (PPGMSAVEDIGESTS)RTMemAllocZ(RT_OFFSETOF(PGMSAVEDIGESTS, aRanges[RT_MAX(cRanges, 1)]));
+    if (pDigests)
+    {
+        for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam; pRam = pRam->pNextR3)
+            if (!PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            {
+                PPGMSAVEDIGESTRANGE pRange = &pDigests->aRanges[pDigests->cRanges];
+                pRange->GCPhys    = pRam->GCPhys;
+                pRange->cb        = pRam->cb;
+                pRange->paDigests = (uint8_t (*)[RTSHA1_HASH_SIZE])RTMemPageAllocZ((size_t)(pRam->cb >> PAGE_SHIFT) * RTSHA1_HASH_SIZE);
+                if (!pRange->paDigests)
+                {
+                    rc = VERR_NO_MEMORY;
+                    break;
+                }
+                pDigests->cRanges++;
+            }
+    }
+    else
+        rc = VERR_NO_MEMORY;
+    pgmUnlock(pVM);
+
+    if (RT_SUCCESS(rc))
+    {
+        uint8_t abZeroPage[PAGE_SIZE];
+        RT_ZERO(abZeroPage);
+        RTSha1(abZeroPage, sizeof(abZeroPage), pDigests->abZero);
+
+        /*
+         * Pick up the digests of the base.  Without them everything is saved.
+         */
+        if (pszBaseFilename)
+        {
+            int rc2 = pgmR3DigestsLoadBase(pDigests, pszBaseFilename);
+            if (RT_SUCCESS(rc2))
+                pDigests->fHaveBase = true;
+            else
+            {
+                LogRel(("PGM: No page digests in the base '%s' (%Rrc), saving all RAM.\n", pszBaseFilename, rc2));
+                for (uint32_t i = 0; i < pDigests->cRanges; i++)
+                    RT_BZERO(pDigests->aRanges[i].paDigests, (size_t)(pDigests->aRanges[i].cb >> PAGE_SHIFT) * RTSHA1_HASH_SIZE);
+            }
+        }
+        pVM->pgm.s.LiveSave.pDigestsR3 = pDigests;
+    }
+    else if (pDigests)
+    {
+        for (uint32_t i = 0; i < pDigests->cRanges; i++)
+            RTMemPageFree(pDigests->aRanges[i].paDigests, (size_t)(pDigests->aRanges[i].cb >> PAGE_SHIFT) * RTSHA1_HASH_SIZE);
+        RTMemFree(pDigests);
+    }
+    return rc;
+}
+
+
+/**
+ * Frees the page digests.
+ *
+ * @param   pVM                 Pointer to the VM.
+ */
+static void pgmR3DigestsTerm(PVM pVM)
+{
+    PPGMSAVEDIGESTS pDigests = pVM->pgm.s.LiveSave.pDigestsR3;
+    pVM->pgm.s.LiveSave.pDigestsR3 = NULL;
+    if (pDigests)
+    {
+        for (uint32_t i = 0; i < pDigests->cRanges; i++)
+            RTMemPageFree(pDigests->aRanges[i].paDigests, (size_t)(pDigests->aRanges[i].cb >> PAGE_SHIFT) * RTSHA1_HASH_SIZE);
+        RTMemFree(pDigests);
+    }
+}
+
+
+/**
+ * Looks up the digests of a RAM range.
+ *
+ * @returns Pointer to the digest array, NULL if not tracked.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pRam                The RAM range.
+ */
+static uint8_t (*pgmR3DigestsLookup(PVM pVM, PPGMRAMRANGE pRam))[RTSHA1_HASH_SIZE]
+{
+    PPGMSAVEDIGESTS pDigests = pVM->pgm.s.LiveSave.pDigestsR3;
+    if (pDigests)
+        for (uint32_t i = 0; i < pDigests->cRanges; i++)
+            if (   pDigests->aRanges[i].GCPhys == pRam->GCPhys
+                && pDigests->aRanges[i].cb     == pRam->cb)
+                return pDigests->aRanges[i].paDigests;
+    return NULL;
+}
+
+
+/**
+ * Updates the digest of a RAM page about to be saved.
+ *
+ * @returns true if the page is unchanged since the base and can be skipped,
+ *          false if it must be saved.
+ * @param   pDigests            The digests.
+ * @param   pabEntry            The digest entry of the page.
+ * @param   pabDigest           The digest of the current page content.
+ */
+DECLINLINE(bool) pgmR3DigestsUpdate(PPGMSAVEDIGESTS pDigests, uint8_t *pabEntry, uint8_t const *pabDigest)
+{
+    if (!memcmp(pabEntry, pabDigest, RTSHA1_HASH_SIZE))
+        return pDigests->fHaveBase;
+    memcpy(pabEntry, pabDigest, RTSHA1_HASH_SIZE);
+    return false;
+}
+
+
+/**
+ * Execute state save operation for the page digests unit.
+ *
+ * This is only registered when /PGM/SaveDigests is set, so saved states are
+ * still loadable by older versions by default.
+ *
+ * @returns VBox status code.
+ * @param   pVM             Pointer to the VM.
+ * @param   pSSM            SSM operation handle.
+ */
+static DECLCALLBACK(int) pgmR3DigestsSaveExec(PVM pVM, PSSMHANDLE pSSM)
+{
+    PPGMSAVEDIGESTS pDigests = pVM->pgm.s.LiveSave.pDigestsR3;
+    AssertLogRelReturn(pDigests, VERR_INTERNAL_ERROR_2);
+
+    for (uint32_t i = 0; i < pDigests->cRanges; i++)
+    {
+        SSMR3PutGCPhys(pSSM, pDigests->aRanges[i].GCPhys);
+        SSMR3PutGCPhys(pSSM, pDigests->aRanges[i].cb);
+        int rc = SSMR3PutMem(pSSM, pDigests->aRanges[i].paDigests,
+                             (size_t)(pDigests->aRanges[i].cb >> PAGE_SHIFT) * RTSHA1_HASH_SIZE);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    return SSMR3PutGCPhys(pSSM, NIL_RTGCPHYS);
+}
+
+
+/**
+ * Execute state load operation for the page digests unit.
+ *
+ * The digests are only of interest to incremental saves, which reads them
+ * using SSMR3Seek.
+ *
+ * @returns VBox status code.
+ * @param   pVM             Pointer to the VM.
+ * @param   pSSM            SSM operation handle.
+ * @param   uVersion        Data layout version.
+ * @param   uPass           The data pass.
+ */
+static DECLCALLBACK(int) pgmR3DigestsLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    NOREF(pVM); NOREF(uVersion); NOREF(uPass);
+    return SSMR3SkipToEndOfUnit(pSSM);
+}
+
+
 /**
  * Save quiescent RAM pages.
  *
@@ -1556,6 +1932,7 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
     RTGCPHYS GCPhysCur = 0;
     PPGMRAMRANGE pCur;
     bool fFTMDeltaSaveActive = FTMIsDeltaLoadSaveActive(pVM);
+    PPGMSAVEDIGESTS pDigests = !fFTMDeltaSaveActive ? pVM->pgm.s.LiveSave.pDigestsR3 : NULL;
 
     pgmLock(pVM);
     do
@@ -1567,6 +1944,7 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                 && !PGM_RAM_RANGE_IS_AD_HOC(pCur))
             {
                 PPGMLIVESAVERAMPAGE paLSPages = pCur->paLSPages;
+                uint8_t        (*paDigests)[RTSHA1_HASH_SIZE] = pDigests ? pgmR3DigestsLookup(pVM, pCur) : NULL;
                 uint32_t         cPages    = pCur->cb >> PAGE_SHIFT;
                 uint32_t         iPage     = GCPhysCur <= pCur->GCPhys ? 0 : (GCPhysCur - pCur->GCPhys) >> PAGE_SHIFT;
                 GCPhysCur = 0;
@@ -1680,16 +2058,27 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                             }
                             else
                             {
-                                if (GCPhys == GCPhysLast + PAGE_SIZE)
-                                    SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_RAW);
+                                /* Unchanged since the base of an incremental save? */
+                                uint8_t abDigest[RTSHA1_HASH_SIZE];
+                                if (paDigests)
+                                    RTSha1(abPage, PAGE_SIZE, abDigest);
+                                if (paDigests && pgmR3DigestsUpdate(pDigests, paDigests[iPage], abDigest))
+                                    fSkipped = true;
                                 else
                                 {
-                                    SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_RAW | PGM_STATE_REC_FLAG_ADDR);
-                                    SSMR3PutGCPhys(pSSM, GCPhys);
+                                    if (GCPhys == GCPhysLast + PAGE_SIZE)
+                                        SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_RAW);
+                                    else
+                                    {
+                                        SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_RAW | PGM_STATE_REC_FLAG_ADDR);
+                                        SSMR3PutGCPhys(pSSM, GCPhys);
+                                    }
+                                    rc = SSMR3PutMem(pSSM, abPage, PAGE_SIZE);
                                 }
-                                rc = SSMR3PutMem(pSSM, abPage, PAGE_SIZE);
                             }
                         }
+                        else if (paDigests && pgmR3DigestsUpdate(pDigests, paDigests[iPage], pDigests->abZero))
+                            fSkipped = true;
                         else
                         {
                             if (GCPhys == GCPhysLast + PAGE_SIZE)
@@ -1712,13 +2101,29 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
 #endif
                         pgmUnlock(pVM);
 
-                        uint8_t u8RecType = fBallooned ? PGM_STATE_REC_RAM_BALLOONED : PGM_STATE_REC_RAM_ZERO;
-                        if (GCPhys == GCPhysLast + PAGE_SIZE)
-                            rc = SSMR3PutU8(pSSM, u8RecType);
+                        uint8_t abDigest[RTSHA1_HASH_SIZE];
+                        if (paDigests)
+                        {
+                            if (fBallooned)
+                                memset(abDigest, 0xff, sizeof(abDigest));
+                            else
+                                memcpy(abDigest, pDigests->abZero, sizeof(abDigest));
+                        }
+                        if (paDigests && pgmR3DigestsUpdate(pDigests, paDigests[iPage], abDigest))
+                        {
+                            fSkipped = true;
+                            rc = VINF_SUCCESS;
+                        }
                         else
                         {
-                            SSMR3PutU8(pSSM, u8RecType | PGM_STATE_REC_FLAG_ADDR);
-                            rc = SSMR3PutGCPhys(pSSM, GCPhys);
+                            uint8_t u8RecType = fBallooned ? PGM_STATE_REC_RAM_BALLOONED : PGM_STATE_REC_RAM_ZERO;
+                            if (GCPhys == GCPhysLast + PAGE_SIZE)
+                                rc = SSMR3PutU8(pSSM, u8RecType);
+                            else
+                            {
+                                SSMR3PutU8(pSSM, u8RecType | PGM_STATE_REC_FLAG_ADDR);
+                                rc = SSMR3PutGCPhys(pSSM, GCPhys);
+                            }
                         }
                     }
                     if (RT_FAILURE(rc))
@@ -1825,81 +2230,891 @@ static void pgmR3DoneRamPages(PVM pVM)
 
 
 /**
- * Execute a live save pass.
+ * Access handler callback for RAM pages pending in a lazy restore.
  *
- * @returns VBox status code.
+ * The page has already been restored by pgmPhysPageLoadIntoTlbWithPage when
+ * the caller mapped it, so all there is left to do is the default access.
  *
- * @param   pVM         Pointer to the VM.
- * @param   pSSM        The SSM handle.
+ * @returns VINF_PGM_HANDLER_DO_DEFAULT.
+ * @param   pVM             Pointer to the VM.
+ * @param   GCPhys          The physical address the guest is accessing.
+ * @param   pvPhys          The HC mapping of that address.
+ * @param   pvBuf           What the guest is reading/writing.
+ * @param   cbBuf           How much it's reading/writing.
+ * @param   enmAccessType   The access type.
+ * @param   pvUser          The lazy restore state.
  */
-static DECLCALLBACK(int) pgmR3LiveExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
+static DECLCALLBACK(int) pgmR3LazyRestoreHandler(PVM pVM, RTGCPHYS GCPhys, void *pvPhys, void *pvBuf, size_t cbBuf,
+                                                 PGMACCESSTYPE enmAccessType, void *pvUser)
 {
-    int rc;
+    NOREF(pVM); NOREF(GCPhys); NOREF(pvPhys); NOREF(pvBuf); NOREF(cbBuf); NOREF(enmAccessType); NOREF(pvUser);
+    return VINF_PGM_HANDLER_DO_DEFAULT;
+}
 
-    /*
-     * Save the MMIO2 and ROM range IDs in pass 0.
-     */
-    if (uPass == 0)
+
+/**
+ * Looks up the lazy restore tracking for a page.
+ *
+ * @returns Pointer to the range, NULL if not tracked.
+ * @param   pThis       The lazy restore state.
+ * @param   GCPhys      The page address.
+ * @param   piPage      Where to return the page index into the range.
+ */
+static PPGMLAZYRANGE pgmR3LazyRestoreLookup(PPGMLAZYRESTORE pThis, RTGCPHYS GCPhys, uint32_t *piPage)
+{
+    for (uint32_t i = 0; i < pThis->cRanges; i++)
     {
-        rc = pgmR3SaveRamConfig(pVM, pSSM);
-        if (RT_FAILURE(rc))
-            return rc;
-        rc = pgmR3SaveRomRanges(pVM, pSSM);
-        if (RT_FAILURE(rc))
-            return rc;
-        rc = pgmR3SaveMmio2Ranges(pVM, pSSM);
-        if (RT_FAILURE(rc))
-            return rc;
+        PPGMLAZYRANGE pRange = &pThis->aRanges[i];
+        RTGCPHYS const off = GCPhys - pRange->GCPhys;
+        if (off <= pRange->GCPhysLast - pRange->GCPhys)
+        {
+            *piPage = (uint32_t)(off >> PAGE_SHIFT);
+            return pRange;
+        }
     }
-    /*
-     * Reset the page-per-second estimate to avoid inflation by the initial
-     * load of zero pages.  pgmR3LiveVote ASSUMES this is done at pass 7.
-     */
-    else if (uPass == 7)
+    return NULL;
+}
+
+
+/**
+ * Stops tracking a page, called when a later record supersedes the deferred
+ * one or the page is loaded normally.
+ *
+ * @param   pThis       The lazy restore state.
+ * @param   GCPhys      The page address.
+ */
+static void pgmR3LazyRestoreForget(PPGMLAZYRESTORE pThis, RTGCPHYS GCPhys)
+{
+    uint32_t      iPage;
+    PPGMLAZYRANGE pRange = pgmR3LazyRestoreLookup(pThis, GCPhys, &iPage);
+    if (pRange && pRange->paoffPages[iPage] != UINT64_MAX)
     {
-        pVM->pgm.s.LiveSave.cSavedPages  = 0;
-        pVM->pgm.s.LiveSave.uSaveStartNS = RTTimeNanoTS();
+        pRange->paoffPages[iPage] = UINT64_MAX;
+        pRange->cPending--;
+        pThis->cPendingPages--;
     }
+}
 
-    /*
-     * Do the scanning.
-     */
-    pgmR3ScanRomPages(pVM);
-    pgmR3ScanMmio2Pages(pVM, uPass);
-    pgmR3ScanRamPages(pVM, false /*fFinalPass*/);
-    pgmR3PoolClearAll(pVM, true /*fFlushRemTlb*/); /** @todo this could perhaps be optimized a bit. */
+
+/**
+ * Puts the data of a pending page in place and stops catching accesses to it.
+ *
+ * @returns VBox status code.  The page remains pending if it could not be
+ *          allocated.
+ * @param   pVM         Pointer to the VM.
+ * @param   pThis       The lazy restore state.
+ * @param   pRange      The range tracking the page.
+ * @param   iPage       The page index into the range.
+ * @param   pPage       The page.
+ * @param   GCPhys      The page address.
+ * @param   pvSrc       The page content read from the saved state.
+ */
+static int pgmR3LazyRestoreInstallPageLocked(PVM pVM, PPGMLAZYRESTORE pThis, PPGMLAZYRANGE pRange, uint32_t iPage,
+                                             PPGMPAGE pPage, RTGCPHYS GCPhys, void const *pvSrc)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    Assert(pRange->paoffPages[iPage] != UINT64_MAX);
+
+    /* This doesn't go thru the TLB, so we won't end up here again. */
+    void *pvPage;
+    int rc = pgmPhysPageMakeWritableAndMap(pVM, pPage, GCPhys, &pvPage);
+    if (RT_FAILURE(rc))
+        return rc;
+    memcpy(pvPage, pvSrc, PAGE_SIZE);
+
+    pRange->paoffPages[iPage] = UINT64_MAX;
+    pRange->cPending--;
+    pThis->cPendingPages--;
 
     /*
-     * Save the pages.
+     * Stop catching accesses to the page.
      */
-    if (uPass == 0)
-        rc = pgmR3SaveRomVirginPages(  pVM, pSSM, true /*fLiveSave*/);
-    else
-        rc = VINF_SUCCESS;
-    if (RT_SUCCESS(rc))
-        rc = pgmR3SaveShadowedRomPages(pVM, pSSM, true /*fLiveSave*/, false /*fFinalPass*/);
-    if (RT_SUCCESS(rc))
-        rc = pgmR3SaveMmio2Pages(      pVM, pSSM, true /*fLiveSave*/, uPass);
-    if (RT_SUCCESS(rc))
-        rc = pgmR3SaveRamPages(        pVM, pSSM, true /*fLiveSave*/, uPass);
-    SSMR3PutU8(pSSM, PGM_STATE_REC_END);    /* (Ignore the rc, SSM takes care of it.) */
+    if (PGM_PAGE_GET_HNDL_PHYS_STATE(pPage) == PGM_PAGE_HNDL_PHYS_STATE_ALL)
+    {
+        PPGMPHYSHANDLER pHandler = pgmHandlerPhysicalLookup(pVM, GCPhys);
+        if (pHandler && pHandler->pfnHandlerR3 == pgmR3LazyRestoreHandler)
+            PGMHandlerPhysicalPageTempOff(pVM, pHandler->Core.Key, GCPhys);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads and restores one pending page while owning the PGM lock.
+ *
+ * @returns VBox status code.  The page remains pending on failure.
+ * @param   pVM         Pointer to the VM.
+ * @param   pThis       The lazy restore state.
+ * @param   pRange      The range tracking the page.
+ * @param   iPage       The page index into the range.
+ * @param   pPage       The page.
+ * @param   GCPhys      The page address.
+ */
+static int pgmR3LazyRestorePageLocked(PVM pVM, PPGMLAZYRESTORE pThis, PPGMLAZYRANGE pRange, uint32_t iPage,
+                                      PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    uint64_t const offPage = pRange->paoffPages[iPage];
+    Assert(offPage != UINT64_MAX);
 
+    uint8_t abPage[PAGE_SIZE];
+    int rc = SSMR3PageReaderRead(pThis->pReader, offPage, abPage);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3LazyRestoreInstallPageLocked(pVM, pThis, pRange, iPage, pPage, GCPhys, abPage);
+    else
+        LogRel(("PGM: Lazy restore of %RGp from offset %#llx failed: %Rrc\n", GCPhys, offPage, rc));
     return rc;
 }
 
 
 /**
- * Votes on whether the live save phase is done or not.
- *
- * @returns VBox status code.
+ * Reads and restores one pending page, leaving the PGM lock while reading the
+ * file.
  *
+ * @returns VBox status code.  The page remains pending on failure.
  * @param   pVM         Pointer to the VM.
- * @param   pSSM        The SSM handle.
- * @param   uPass       The data pass.
+ * @param   pThis       The lazy restore state.
+ * @param   pRange      The range tracking the page.
+ * @param   iPage       The page index into the range.
+ * @param   pvBuf       Page sized buffer to read the page into.
+ *
+ * @remarks Called owning the PGM lock, which is owned again on return.  The
+ *          lock must not be owned recursively, leaving one level of it would
+ *          not release it.  The caller keeps the state alive by holding a
+ *          PGMLAZYRESTORE::cReaders reference.
  */
-static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
+static int pgmR3LazyRestorePageDropLock(PVM pVM, PPGMLAZYRESTORE pThis, PPGMLAZYRANGE pRange, uint32_t iPage, void *pvBuf)
 {
-    /*
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    Assert(PDMCritSectGetRecursion(&pVM->pgm.s.CritSectX) == 1);
+    uint64_t const offPage = pRange->paoffPages[iPage];
+    if (offPage == UINT64_MAX)
+        return VINF_SUCCESS;
+    RTGCPHYS const GCPhys = pRange->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+
+    pgmUnlock(pVM);
+    int rc = SSMR3PageReaderRead(pThis->pReader, offPage, pvBuf);
+    pgmLock(pVM);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("PGM: Lazy restore of %RGp from offset %#llx failed: %Rrc\n", GCPhys, offPage, rc));
+        return rc;
+    }
+
+    /* Someone else may have restored the page while we were reading it. */
+    if (pRange->paoffPages[iPage] == offPage)
+    {
+        PPGMPAGE pPage;
+        rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+        if (RT_SUCCESS(rc))
+            rc = pgmR3LazyRestoreInstallPageLocked(pVM, pThis, pRange, iPage, pPage, GCPhys, pvBuf);
+    }
+    return rc;
+}
+
+
+/**
+ * Picks the next pending pages in address order starting at the background
+ * cursor for the thread to read.
+ *
+ * @param   pThis       The lazy restore state.
+ */
+static void pgmR3LazyRestorePickBatchLocked(PPGMLAZYRESTORE pThis)
+{
+    uint32_t cBatch = 0;
+    while (pThis->iRangeNext < pThis->cRanges && cBatch < RT_ELEMENTS(pThis->aBatch))
+    {
+        PPGMLAZYRANGE pRange = &pThis->aRanges[pThis->iRangeNext];
+        while (pRange->cPending > 0 && pThis->iPageNext < pRange->cPages && cBatch < RT_ELEMENTS(pThis->aBatch))
+        {
+            uint32_t const iPage = pThis->iPageNext++;
+            if (pRange->paoffPages[iPage] != UINT64_MAX)
+            {
+                pThis->aBatch[cBatch].GCPhys  = pRange->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+                pThis->aBatch[cBatch].offPage = pRange->paoffPages[iPage];
+                cBatch++;
+            }
+        }
+        if (!pRange->cPending || pThis->iPageNext >= pRange->cPages)
+        {
+            pThis->iRangeNext++;
+            pThis->iPageNext = 0;
+        }
+    }
+    pThis->cBatch = cBatch;
+}
+
+
+/**
+ * Restores a page pending in a lazy restore before it's mapped.
+ *
+ * Called by pgmPhysPageLoadIntoTlbWithPage for pages with an all access
+ * handler while PGM::fLazyRestoreActive is set.  The caller owns the PGM lock
+ * and has a pointer to the page, so the page is read with the lock held.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ * @param   pPage       The page.
+ * @param   GCPhys      The address of the page.
+ */
+int pgmR3LazyRestoreFaultIn(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    PPGMLAZYRESTORE pThis = pVM->pgm.s.pLazyRestoreR3;
+    if (!pThis)
+        return VINF_SUCCESS;
+
+    GCPhys &= ~(RTGCPHYS)PAGE_OFFSET_MASK;
+    uint32_t      iPage;
+    PPGMLAZYRANGE pRange = pgmR3LazyRestoreLookup(pThis, GCPhys, &iPage);
+    if (!pRange || pRange->paoffPages[iPage] == UINT64_MAX)
+        return VINF_SUCCESS;
+
+    pThis->cFaultedIn++;
+    return pgmR3LazyRestorePageLocked(pVM, pThis, pRange, iPage, pPage, GCPhys);
+}
+
+
+/**
+ * Restores a page pending in a lazy restore on behalf of ring-0.
+ *
+ * This is the response to VMMCALLRING3_PGM_LAZY_RESTORE_PAGE, the ring-0 side
+ * of pgmPhysPageLoadIntoTlbWithPage.  That keeps owning the PGM lock across
+ * the call, so like in the ring-3 fault path the page is read with the lock
+ * held.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ * @param   GCPhys      The address of the page.
+ */
+VMMR3_INT_DECL(int) PGMR3PhysLazyRestorePage(PVM pVM, RTGCPHYS GCPhys)
+{
+    pgmLock(pVM);
+    PPGMPAGE pPage;
+    int rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3LazyRestoreFaultIn(pVM, pPage, GCPhys);
+    pgmUnlock(pVM);
+    return rc;
+}
+
+
+/**
+ * Installs the batch the lazy restore thread has read and picks the next one.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @thread  EMT
+ */
+static DECLCALLBACK(void) pgmR3LazyRestoreBatch(PVM pVM)
+{
+    pgmLock(pVM);
+    PPGMLAZYRESTORE pThis = pVM->pgm.s.pLazyRestoreR3;
+    if (!pThis)
+    {
+        /* Terminated while the request was queued. */
+        pgmUnlock(pVM);
+        return;
+    }
+
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < pThis->cBatch; i++)
+    {
+        /* Skip pages the thread failed to read and pages restored on access meanwhile. */
+        RTGCPHYS const GCPhys = pThis->aBatch[i].GCPhys;
+        uint32_t       iPage;
+        PPGMLAZYRANGE  pRange = pgmR3LazyRestoreLookup(pThis, GCPhys, &iPage);
+        if (   !pRange
+            || pThis->aBatch[i].offPage == UINT64_MAX
+            || pRange->paoffPages[iPage] != pThis->aBatch[i].offPage)
+            continue;
+
+        PPGMPAGE pPage;
+        int rc2 = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+        if (RT_SUCCESS(rc2))
+            rc2 = pgmR3LazyRestoreInstallPageLocked(pVM, pThis, pRange, iPage, pPage, GCPhys,
+                                                    pThis->pbBatch + ((size_t)i << PAGE_SHIFT));
+        if (RT_SUCCESS(rc2))
+            pThis->cBackground++;
+        else
+        {
+            LogRel(("PGM: Lazy restore of %RGp failed: %Rrc\n", GCPhys, rc2));
+            if (RT_SUCCESS(rc))
+                rc = rc2;
+        }
+    }
+
+    /* Failed pages stay pending, the thread reports the error and stops. */
+    if (RT_FAILURE(rc))
+        ASMAtomicCmpXchgS32(&pThis->rcError, rc, VINF_SUCCESS);
+    bool const fDone = !pThis->cPendingPages;
+    if (!fDone)
+    {
+        pgmR3LazyRestorePickBatchLocked(pThis);
+        RTSemEventSignal(pThis->hEvtBatch);
+    }
+    pgmUnlock(pVM);
+
+    if (fDone)
+        pgmR3LazyRestoreTerm(pVM);
+}
+
+
+/**
+ * The lazy restore thread.
+ *
+ * This paces the background restore: it reads the batch picked by the EMT
+ * into memory and has an EMT put it in place, one batch at a time so the EMTs
+ * still get to run the guest and never wait for the file while owning the PGM
+ * lock.
+ *
+ * A failure puts the VM into the fatal error state, the pages which couldn't
+ * be restored remain covered by the access handlers.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   hThread     The thread handle.
+ * @param   pvUser      The lazy restore state.
+ */
+static DECLCALLBACK(int) pgmR3LazyRestoreThread(RTTHREAD hThread, void *pvUser)
+{
+    PPGMLAZYRESTORE pThis = (PPGMLAZYRESTORE)pvUser;
+    PVM             pVM   = pThis->pVM;
+    NOREF(hThread);
+
+    for (;;)
+    {
+        /* Wait for the EMT to pick the next batch. */
+        int rc;
+        do
+            rc = RTSemEventWait(pThis->hEvtBatch, 100);
+        while (rc == VERR_TIMEOUT && !ASMAtomicReadBool(&pThis->fTerminate));
+        if (ASMAtomicReadBool(&pThis->fTerminate))
+            break;
+
+        int32_t rcError = ASMAtomicXchgS32(&pThis->rcError, VINF_SUCCESS);
+        if (RT_SUCCESS(rcError))
+            for (uint32_t i = 0; i < pThis->cBatch; i++)
+            {
+                rc = SSMR3PageReaderRead(pThis->pReader, pThis->aBatch[i].offPage, pThis->pbBatch + ((size_t)i << PAGE_SHIFT));
+                if (RT_FAILURE(rc))
+                {
+                    LogRel(("PGM: Lazy restore of %RGp from offset %#llx failed: %Rrc\n",
+                            pThis->aBatch[i].GCPhys, pThis->aBatch[i].offPage, rc));
+                    pThis->aBatch[i].offPage = UINT64_MAX;
+                    if (RT_SUCCESS(rcError))
+                        rcError = rc;
+                }
+            }
+
+        if (RT_FAILURE(rcError))
+        {
+            VMSetRuntimeError(pVM, VMSETRTERR_FLAGS_FATAL | VMSETRTERR_FLAGS_NO_WAIT, "PGMLazyRestore",
+                              N_("Failed to restore guest memory from the saved state file (%Rrc)"), rcError);
+            break;
+        }
+
+        rc = VMR3ReqCallNoWait(pVM, VMCPUID_ANY, (PFNRT)pgmR3LazyRestoreBatch, 1, pVM);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("PGM: Lazy restore thread failed to queue a batch: %Rrc\n", rc));
+            break;
+        }
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Sets up lazy restore if enabled and possible, called when preparing to load
+ * a saved state.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ * @param   pSSM        The saved state handle.
+ */
+static int pgmR3LazyRestoreInit(PVM pVM, PSSMHANDLE pSSM)
+{
+    Assert(!pVM->pgm.s.pLazyRestoreR3);
+
+    /** @cfgm{/PGM/LazyRestore, boolean, false}
+     * Whether to restore guest RAM from saved state files on demand, letting the
+     * VM resume before all of it has been read.  Requires nested paging and is
+     * ignored when RAM is preallocated. */
+    bool fLazyRestore;
+    int rc = CFGMR3QueryBoolDef(CFGMR3GetChild(CFGMR3GetRoot(pVM), "PGM"), "LazyRestore", &fLazyRestore, false);
+    AssertLogRelRCReturn(rc, rc);
+    if (!fLazyRestore)
+        return VINF_SUCCESS;
+
+    /* Shadow and raw-mode paging walk the guest page tables in ring-0 and
+       raw-mode context without going thru the TLB, so nested paging only. */
+    if (   !pVM->pgm.s.fNestedPaging
+        || pVM->pgm.s.fRamPreAlloc
+        || FTMIsDeltaLoadSaveActive(pVM))
+    {
+        LogRel(("PGM: Lazy restore requires nested paging and no RAM preallocation, restoring normally.\n"));
+        return VINF_SUCCESS;
+    }
+
+    PSSMPAGEREADER pReader;
+    rc = SSMR3PageReaderOpen(pSSM, &pReader);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("PGM: Lazy restore not possible (%Rrc), restoring normally.\n", rc));
+        return VINF_SUCCESS;
+    }
+
+    /*
+     * Allocate the tracking structures for all the real RAM ranges.
+     */
+    pgmLock(pVM);
+    uint32_t cRanges = 0;
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam; pRam = pRam->pNextR3)
+        if (!PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            cRanges++;
+
+    PPGMLAZYRESTORE pThis = (PPGMLAZYRESTORE)RTMemAllocZ(RT_OFFSETOF(PGMLAZYRESTORE, aRanges[RT_MAX(cRanges, 1)]));
+    if (pThis)
+    {
+        pThis->pVM       = pVM;
+        pThis->pReader   = pReader;
+        pThis->hThread   = NIL_RTTHREAD;
+        pThis->hEvtBatch = NIL_RTSEMEVENT;
+        for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam; pRam = pRam->pNextR3)
+            if (!PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            {
+                PPGMLAZYRANGE pRange = &pThis->aRanges[pThis->cRanges];
+                pRange->GCPhys     = pRam->GCPhys;
+                pRange->GCPhysLast = pRam->GCPhysLast;
+                pRange->cPages     = (uint32_t)(pRam->cb >> PAGE_SHIFT);
+                pRange->paoffPages = (uint64_t *)RTMemPageAlloc(pRange->cPages * sizeof(uint64_t));
+                if (!pRange->paoffPages)
+                {
+                    rc = VERR_NO_MEMORY;
+                    break;
+                }
+                memset(pRange->paoffPages, 0xff, pRange->cPages * sizeof(uint64_t));
+                pThis->cRanges++;
+            }
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    if (RT_SUCCESS(rc))
+        pVM->pgm.s.pLazyRestoreR3 = pThis;
+    pgmUnlock(pVM);
+
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("PGM: Lazy restore setup failed (%Rrc), restoring normally.\n", rc));
+        if (pThis)
+        {
+            for (uint32_t i = 0; i < pThis->cRanges; i++)
+                RTMemPageFree(pThis->aRanges[i].paoffPages, pThis->aRanges[i].cPages * sizeof(uint64_t));
+            RTMemFree(pThis);
+        }
+        SSMR3PageReaderClose(pReader);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Tries to defer loading a RAM page, called by pgmR3LoadMemory for raw RAM
+ * page records.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if the page must be loaded normally.
+ * @param   pVM         Pointer to the VM.
+ * @param   pSSM        The saved state handle.
+ * @param   pPage       The page.
+ * @param   GCPhys      The address of the page.
+ */
+static int pgmR3LazyRestoreDefer(PVM pVM, PSSMHANDLE pSSM, PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    PPGMLAZYRESTORE pThis = pVM->pgm.s.pLazyRestoreR3;
+    uint32_t        iPage;
+    PPGMLAZYRANGE   pRange = pgmR3LazyRestoreLookup(pThis, GCPhys, &iPage);
+    if (!pRange)
+        return VERR_NOT_SUPPORTED;
+    if (   PGM_PAGE_GET_TYPE(pPage) != PGMPAGETYPE_RAM
+        || PGM_PAGE_HAS_ANY_HANDLERS(pPage)
+        || PGM_PAGE_IS_BALLOONED(pPage))
+    {
+        pgmR3LazyRestoreForget(pThis, GCPhys);
+        return VERR_NOT_SUPPORTED;
+    }
+
+    uint64_t offPage;
+    bool     fZero;
+    int rc = SSMR3SkipPageDeferred(pSSM, &offPage, &fZero);
+    if (RT_FAILURE(rc))
+    {
+        pgmR3LazyRestoreForget(pThis, GCPhys);
+        return rc;
+    }
+
+    if (fZero)
+    {
+        /* Compressed to nothing, just clear it. */
+        pgmR3LazyRestoreForget(pThis, GCPhys);
+        if (!PGM_PAGE_IS_ZERO(pPage))
+        {
+            PGMPAGEMAPLOCK PgMpLck;
+            void          *pvDstPage;
+            rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, GCPhys, &pvDstPage, &PgMpLck);
+            AssertLogRelMsgRCReturn(rc, ("GCPhys=%RGp %R[pgmpage] rc=%Rrc\n", GCPhys, pPage, rc), rc);
+            ASMMemZeroPage(pvDstPage);
+            pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+        }
+        return VINF_SUCCESS;
+    }
+
+    if (pRange->paoffPages[iPage] == UINT64_MAX)
+    {
+        pRange->cPending++;
+        pThis->cPendingPages++;
+        pThis->cDeferred++;
+    }
+    pRange->paoffPages[iPage] = offPage;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Adds an access handler to the lazy restore state.
+ *
+ * @returns VBox status code.
+ * @param   pVM             Pointer to the VM.
+ * @param   pThis           The lazy restore state.
+ * @param   GCPhysFirst     The first page.
+ * @param   GCPhysLast      The last page.
+ */
+static int pgmR3LazyRestoreAddHandler(PVM pVM, PPGMLAZYRESTORE pThis, RTGCPHYS GCPhysFirst, RTGCPHYS GCPhysLast)
+{
+    if (pThis->cHandlers >= pThis->cHandlersAlloc)
+    {
+        uint32_t const cNew = pThis->cHandlersAlloc ? pThis->cHandlersAlloc * 2 : 16;
+        void *pvNew = RTMemRealloc(pThis->paGCPhysHandlers, cNew * sizeof(RTGCPHYS));
+        if (!pvNew)
+            return VERR_NO_MEMORY;
+        pThis->paGCPhysHandlers = (PRTGCPHYS)pvNew;
+        pThis->cHandlersAlloc   = cNew;
+    }
+
+    int rc = PGMR3HandlerPhysicalRegister(pVM, PGMPHYSHANDLERTYPE_PHYSICAL_ALL, GCPhysFirst, GCPhysLast | PAGE_OFFSET_MASK,
+                                          pgmR3LazyRestoreHandler, pThis,
+                                          NULL, NULL, NIL_RTR0PTR,
+                                          NULL, NULL, NIL_RTRCPTR,
+                                          "Lazy restore");
+    if (RT_SUCCESS(rc))
+        pThis->paGCPhysHandlers[pThis->cHandlers++] = GCPhysFirst;
+    return rc;
+}
+
+
+/**
+ * Puts access handlers over the pending pages once the RAM has been loaded.
+ *
+ * Pending pages are grouped into as few handlers as possible, pages in between
+ * which aren't pending get their monitoring turned off right away.  Any pages
+ * we fail to cover are restored immediately.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ */
+static int pgmR3LazyRestoreArm(PVM pVM)
+{
+    PPGMLAZYRESTORE pThis = pVM->pgm.s.pLazyRestoreR3;
+    if (!pThis)
+        return VINF_SUCCESS;
+    if (!pThis->cPendingPages)
+    {
+        pgmR3LazyRestoreTerm(pVM);
+        return VINF_SUCCESS;
+    }
+
+    int rc = VINF_SUCCESS;
+    pgmLock(pVM);
+    for (uint32_t iRange = 0; iRange < pThis->cRanges && RT_SUCCESS(rc); iRange++)
+    {
+        PPGMLAZYRANGE pRange = &pThis->aRanges[iRange];
+        uint32_t      iPage  = 0;
+        while (iPage < pRange->cPages && RT_SUCCESS(rc))
+        {
+            /* Find the next pending page. */
+            while (iPage < pRange->cPages && pRange->paoffPages[iPage] == UINT64_MAX)
+                iPage++;
+            if (iPage >= pRange->cPages)
+                break;
+
+            /* Extend the run as long as the pages can be covered and the gaps are small. */
+            uint32_t const iFirst = iPage;
+            uint32_t       iLast  = iPage;
+            for (iPage++; iPage < pRange->cPages && iPage - iLast < PGM_LAZY_RESTORE_SPLIT_PAGES; iPage++)
+            {
+                PPGMPAGE pPage = pgmPhysGetPage(pVM, pRange->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
+                if (   !pPage
+                    || PGM_PAGE_GET_TYPE(pPage) != PGMPAGETYPE_RAM
+                    || PGM_PAGE_HAS_ANY_HANDLERS(pPage))
+                    break;
+                if (pRange->paoffPages[iPage] != UINT64_MAX)
+                    iLast = iPage;
+            }
+            iPage = iLast + 1;
+
+            RTGCPHYS const GCPhysFirst = pRange->GCPhys + ((RTGCPHYS)iFirst << PAGE_SHIFT);
+            RTGCPHYS const GCPhysLast  = pRange->GCPhys + ((RTGCPHYS)iLast  << PAGE_SHIFT);
+            int rc2 = pgmR3LazyRestoreAddHandler(pVM, pThis, GCPhysFirst, GCPhysLast);
+            if (RT_SUCCESS(rc2))
+            {
+                for (uint32_t i = iFirst + 1; i < iLast; i++)
+                    if (pRange->paoffPages[i] == UINT64_MAX)
+                        PGMHandlerPhysicalPageTempOff(pVM, GCPhysFirst, pRange->GCPhys + ((RTGCPHYS)i << PAGE_SHIFT));
+            }
+            else
+            {
+                LogRel(("PGM: Failed to register lazy restore handler for %RGp-%RGp: %Rrc\n", GCPhysFirst, GCPhysLast, rc2));
+                for (uint32_t i = iFirst; i <= iLast && RT_SUCCESS(rc); i++)
+                    if (pRange->paoffPages[i] != UINT64_MAX)
+                    {
+                        RTGCPHYS const GCPhys = pRange->GCPhys + ((RTGCPHYS)i << PAGE_SHIFT);
+                        PPGMPAGE       pPage  = pgmPhysGetPage(pVM, GCPhys);
+                        AssertBreakStmt(pPage, rc = VERR_PGM_PHYS_PAGE_GET_IPE);
+                        rc = pgmR3LazyRestorePageLocked(pVM, pThis, pRange, i, pPage, GCPhys);
+                    }
+            }
+        }
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        pThis->msStart = RTTimeMilliTS();
+        pVM->pgm.s.fLazyRestoreActive = true;
+        pgmPhysInvalidatePageMapTLB(pVM);
+        pgmR3LazyRestorePickBatchLocked(pThis);
+        LogRel(("PGM: Lazy restore of %u pages (%u MB) using %u handlers\n",
+                pThis->cPendingPages, pThis->cPendingPages / (_1M / PAGE_SIZE), pThis->cHandlers));
+    }
+    pgmUnlock(pVM);
+
+    if (RT_FAILURE(rc))
+        pgmR3LazyRestoreTerm(pVM);
+    return rc;
+}
+
+
+/**
+ * Starts the lazy restore thread, called when the load has completed
+ * successfully.
+ *
+ * Falls back on restoring everything right away if the thread cannot be
+ * started.
+ *
+ * @param   pVM         Pointer to the VM.
+ */
+static void pgmR3LazyRestoreStart(PVM pVM)
+{
+    PPGMLAZYRESTORE pThis = pVM->pgm.s.pLazyRestoreR3;
+    if (!pThis)
+        return;
+
+    int rc = VERR_NO_MEMORY;
+    pThis->pbBatch = (uint8_t *)RTMemPageAlloc(RT_ELEMENTS(pThis->aBatch) << PAGE_SHIFT);
+    if (pThis->pbBatch)
+        rc = RTSemEventCreate(&pThis->hEvtBatch);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTThreadCreate(&pThis->hThread, pgmR3LazyRestoreThread, pThis, 0, RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE,
+                            "PgmLazyRst");
+        if (RT_SUCCESS(rc))
+        {
+            /* The first batch was picked when arming. */
+            RTSemEventSignal(pThis->hEvtBatch);
+            return;
+        }
+        pThis->hThread = NIL_RTTHREAD;
+    }
+    LogRel(("PGM: Failed to start the lazy restore thread (%Rrc), restoring the rest now.\n", rc));
+    rc = pgmR3LazyRestoreComplete(pVM);
+    if (RT_FAILURE(rc))
+        VMSetRuntimeError(pVM, VMSETRTERR_FLAGS_FATAL | VMSETRTERR_FLAGS_NO_WAIT, "PGMLazyRestore",
+                          N_("Failed to restore guest memory from the saved state file (%Rrc)"), rc);
+}
+
+
+/**
+ * Restores whatever is still pending and ends the lazy restore.
+ *
+ * This is used before saving the state as the saving code expects the RAM to
+ * be the real thing.  The PGM lock is left while reading the file.
+ *
+ * @returns VBox status code.  On failure the pages which could not be read
+ *          remain pending and covered by the access handlers, the caller
+ *          must not save the RAM.
+ * @param   pVM         Pointer to the VM.
+ * @thread  EMT
+ */
+int pgmR3LazyRestoreComplete(PVM pVM)
+{
+    pgmLock(pVM);
+    PPGMLAZYRESTORE pThis = pVM->pgm.s.pLazyRestoreR3;
+    if (!pThis)
+    {
+        pgmUnlock(pVM);
+        return VINF_SUCCESS;
+    }
+
+    /* The thread may go on meanwhile, whoever gets to a page first restores it. */
+    uint8_t abPage[PAGE_SIZE];
+    int     rc = VINF_SUCCESS;
+    ASMAtomicIncU32(&pThis->cReaders);
+    for (uint32_t iRange = 0; iRange < pThis->cRanges && RT_SUCCESS(rc); iRange++)
+    {
+        PPGMLAZYRANGE pRange = &pThis->aRanges[iRange];
+        for (uint32_t iPage = 0; iPage < pRange->cPages && pRange->cPending > 0 && RT_SUCCESS(rc); iPage++)
+            rc = pgmR3LazyRestorePageDropLock(pVM, pThis, pRange, iPage, abPage);
+    }
+    if (RT_FAILURE(rc))
+        LogRel(("PGM: Failed to complete the lazy restore, %u pages left: %Rrc\n", pThis->cPendingPages, rc));
+    ASMAtomicDecU32(&pThis->cReaders);
+    pgmUnlock(pVM);
+
+    if (RT_SUCCESS(rc))
+        pgmR3LazyRestoreTerm(pVM);
+    return rc;
+}
+
+
+/**
+ * Ends the lazy restore, stopping the thread, removing the access handlers and
+ * freeing the resources.
+ *
+ * Pages still pending at this point are left as they are, so this should only
+ * be used directly when the RAM is about to be reset or freed.
+ *
+ * @param   pVM         Pointer to the VM.
+ */
+void pgmR3LazyRestoreTerm(PVM pVM)
+{
+    pgmLock(pVM);
+    PPGMLAZYRESTORE pThis = pVM->pgm.s.pLazyRestoreR3;
+    pVM->pgm.s.pLazyRestoreR3     = NULL;
+    pVM->pgm.s.fLazyRestoreActive = false;
+    pgmUnlock(pVM);
+    if (!pThis)
+        return;
+
+    if (pThis->hThread != NIL_RTTHREAD)
+    {
+        ASMAtomicWriteBool(&pThis->fTerminate, true);
+        RTSemEventSignal(pThis->hEvtBatch);
+        int rc = RTThreadWait(pThis->hThread, RT_INDEFINITE_WAIT, NULL);
+        AssertLogRelRC(rc);
+    }
+    if (pThis->hEvtBatch != NIL_RTSEMEVENT)
+        RTSemEventDestroy(pThis->hEvtBatch);
+
+    /* EMTs reading a page without owning the lock still use the state. */
+    while (ASMAtomicReadU32(&pThis->cReaders))
+        RTThreadSleep(1);
+
+    for (uint32_t i = 0; i < pThis->cHandlers; i++)
+    {
+        int rc = PGMHandlerPhysicalDeregister(pVM, pThis->paGCPhysHandlers[i]);
+        AssertLogRelRC(rc);
+    }
+
+    if (pThis->msStart)
+        LogRel(("PGM: Lazy restore ended after %llu ms: %u pages deferred, %u restored on access, %u in the background, %u left\n",
+                RTTimeMilliTS() - pThis->msStart, pThis->cDeferred, pThis->cFaultedIn, pThis->cBackground,
+                pThis->cPendingPages));
+
+    for (uint32_t i = 0; i < pThis->cRanges; i++)
+        RTMemPageFree(pThis->aRanges[i].paoffPages, pThis->aRanges[i].cPages * sizeof(uint64_t));
+    if (pThis->pbBatch)
+        RTMemPageFree(pThis->pbBatch, RT_ELEMENTS(pThis->aBatch) << PAGE_SHIFT);
+    RTMemFree(pThis->paGCPhysHandlers);
+    SSMR3PageReaderClose(pThis->pReader);
+    RTMemFree(pThis);
+}
+
+
+/**
+ * Execute a live save pass.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   pSSM        The SSM handle.
+ */
+static DECLCALLBACK(int) pgmR3LiveExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
+{
+    int rc;
+
+    /*
+     * Save the MMIO2 and ROM range IDs in pass 0.
+     */
+    if (uPass == 0)
+    {
+        rc = pgmR3SaveRamConfig(pVM, pSSM);
+        if (RT_FAILURE(rc))
+            return rc;
+        rc = pgmR3SaveRomRanges(pVM, pSSM);
+        if (RT_FAILURE(rc))
+            return rc;
+        rc = pgmR3SaveMmio2Ranges(pVM, pSSM);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    /*
+     * Reset the page-per-second estimate to avoid inflation by the initial
+     * load of zero pages.  pgmR3LiveVote ASSUMES this is done at pass 7.
+     */
+    else if (uPass == 7)
+    {
+        pVM->pgm.s.LiveSave.cSavedPages  = 0;
+        pVM->pgm.s.LiveSave.uSaveStartNS = RTTimeNanoTS();
+    }
+
+    /*
+     * Do the scanning.
+     */
+    pgmR3ScanRomPages(pVM);
+    pgmR3ScanMmio2Pages(pVM, uPass);
+    pgmR3ScanRamPages(pVM, false /*fFinalPass*/);
+    pgmR3PoolClearAll(pVM, true /*fFlushRemTlb*/); /** @todo this could perhaps be optimized a bit. */
+
+    /*
+     * Save the pages.
+     */
+    if (uPass == 0)
+        rc = pgmR3SaveRomVirginPages(  pVM, pSSM, true /*fLiveSave*/);
+    else
+        rc = VINF_SUCCESS;
+    if (RT_SUCCESS(rc))
+        rc = pgmR3SaveShadowedRomPages(pVM, pSSM, true /*fLiveSave*/, false /*fFinalPass*/);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3SaveMmio2Pages(      pVM, pSSM, true /*fLiveSave*/, uPass);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3SaveRamPages(        pVM, pSSM, true /*fLiveSave*/, uPass);
+    SSMR3PutU8(pSSM, PGM_STATE_REC_END);    /* (Ignore the rc, SSM takes care of it.) */
+
+    return rc;
+}
+
+
+/**
+ * Votes on whether the live save phase is done or not.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   pSSM        The SSM handle.
+ * @param   uPass       The data pass.
+ */
+static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
+{
+    /*
      * Update and calculate parameters used in the decision making.
      */
     const uint32_t cHistoryEntries = RT_ELEMENTS(pVM->pgm.s.LiveSave.acDirtyPagesHistory);
@@ -2011,6 +3226,13 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
  */
 static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
 {
+    /*
+     * The RAM must be complete before we can start saving it.
+     */
+    int rc = pgmR3LazyRestoreComplete(pVM);
+    if (RT_FAILURE(rc))
+        return rc;
+
     /*
      * Indicate that we will be using the write monitoring.
      */
@@ -2045,17 +3267,34 @@ static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
     /*
      * Per page type.
      */
-    int rc = pgmR3PrepRomPages(pVM);
+    rc = pgmR3PrepRomPages(pVM);
     if (RT_SUCCESS(rc))
         rc = pgmR3PrepMmio2Pages(pVM);
     if (RT_SUCCESS(rc))
         rc = pgmR3PrepRamPages(pVM);
-
-    NOREF(pSSM);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3DigestsPrep(pVM, pSSM);
     return rc;
 }
 
 
+/**
+ * Prepare state save operation.
+ *
+ * @returns VBox status code.
+ * @param   pVM             Pointer to the VM.
+ * @param   pSSM            SSM operation handle.
+ */
+static DECLCALLBACK(int) pgmR3SavePrep(PVM pVM, PSSMHANDLE pSSM)
+{
+    /* The RAM must be complete before we can calculate any digests. */
+    int rc = pgmR3LazyRestoreComplete(pVM);
+    if (RT_FAILURE(rc))
+        return rc;
+    return pgmR3DigestsPrep(pVM, pSSM);
+}
+
+
 /**
  * Execute state save operation.
  *
@@ -2068,6 +3307,13 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
     int     rc   = VINF_SUCCESS;
     PPGM    pPGM = &pVM->pgm.s;
 
+    /*
+     * The RAM must be complete before we can save it.
+     */
+    rc = pgmR3LazyRestoreComplete(pVM);
+    if (RT_FAILURE(rc))
+        return rc;
+
     /*
      * Lock PGM and set the no-more-writes indicator.
      */
@@ -2144,6 +3390,7 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
         pgmR3DoneMmio2Pages(pVM);
         pgmR3DoneRamPages(pVM);
     }
+    pgmR3DigestsTerm(pVM);
 
     /*
      * Clear the live save indicator and disengage write monitoring.
@@ -2170,12 +3417,24 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
 static DECLCALLBACK(int) pgmR3LoadPrep(PVM pVM, PSSMHANDLE pSSM)
 {
     /*
-     * Call the reset function to make sure all the memory is cleared.
+     * Call the reset function to make sure all the memory is cleared.  An
+     * incremental saved state is loaded on top of its base instead, which
+     * has to be fully in place first.
      */
-    PGMR3Reset(pVM);
+    if (SSMR3HandleBaseFilename(pSSM))
+    {
+        int rc = pgmR3LazyRestoreComplete(pVM);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    else
+        PGMR3Reset(pVM);
     pVM->pgm.s.LiveSave.fActive = false;
-    NOREF(pSSM);
-    return VINF_SUCCESS;
+
+    /*
+     * Defer reading the RAM pages if configured to do so.
+     */
+    return pgmR3LazyRestoreInit(pVM, pSSM);
 }
 
 
@@ -2707,6 +3966,11 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
                 rc = pgmPhysGetPageWithHintEx(pVM, GCPhys, &pPage, &pRamHint);
                 AssertLogRelMsgRCReturn(rc, ("rc=%Rrc %RGp\n", rc, GCPhys), rc);
 
+                /* This record supersedes any deferred raw page from an earlier pass. */
+                if (   pVM->pgm.s.pLazyRestoreR3
+                    && (u8 & ~PGM_STATE_REC_FLAG_ADDR) != PGM_STATE_REC_RAM_RAW)
+                    pgmR3LazyRestoreForget(pVM->pgm.s.pLazyRestoreR3, GCPhys);
+
                 /*
                  * Take action according to the record type.
                  */
@@ -2783,6 +4047,17 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
 
                     case PGM_STATE_REC_RAM_RAW:
                     {
+                        if (pVM->pgm.s.pLazyRestoreR3)
+                        {
+                            rc = pgmR3LazyRestoreDefer(pVM, pSSM, pPage, GCPhys);
+                            if (rc != VERR_NOT_SUPPORTED)
+                            {
+                                if (RT_FAILURE(rc))
+                                    return rc;
+                                break;
+                            }
+                        }
+
                         PGMPAGEMAPLOCK PgMpLck;
                         void          *pvDstPage;
                         rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, GCPhys, &pvDstPage, &PgMpLck);
@@ -3176,6 +4451,19 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
         return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
     }
 
+    /*
+     * A flattened incremental saved state has the executions of each layer
+     * after one another, the RAM of the previous layer must be in place
+     * before loading the next one on top of it.
+     */
+    if (pVM->pgm.s.fLazyRestoreActive)
+    {
+        rc = pgmR3LazyRestoreComplete(pVM);
+        if (RT_FAILURE(rc))
+            return rc;
+        pgmR3LazyRestoreInit(pVM, pSSM);
+    }
+
     /*
      * Do the loading while owning the lock because a bunch of the functions
      * we're using requires this.
@@ -3227,6 +4515,15 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
 
             pgmR3HandlerPhysicalUpdateAll(pVM);
 
+            /*
+             * Start catching accesses to RAM pages we haven't read yet.  This
+             * must be done after the handler update above as it would
+             * otherwise undo the monitoring exemptions.
+             */
+            rc = pgmR3LazyRestoreArm(pVM);
+            if (RT_FAILURE(rc))
+                return rc;
+
             /*
              * Change the paging mode and restore PGMCPU::GCPhysCR3.
              * (The latter requires the CPUM state to be restored already.)
@@ -3325,6 +4622,31 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
 }
 
 
+/**
+ * Cleans up after a state load operation.
+ *
+ * @returns VBox status code.
+ * @param   pVM             Pointer to the VM.
+ * @param   pSSM            SSM operation handle.
+ */
+static DECLCALLBACK(int) pgmR3LoadDone(PVM pVM, PSSMHANDLE pSSM)
+{
+    /*
+     * Kick off the background part of a lazy restore, or drop it if the
+     * load failed.
+     */
+    if (pVM->pgm.s.pLazyRestoreR3)
+    {
+        if (   RT_SUCCESS(SSMR3HandleGetStatus(pSSM))
+            && pVM->pgm.s.fLazyRestoreActive)
+            pgmR3LazyRestoreStart(pVM);
+        else
+            pgmR3LazyRestoreTerm(pVM);
+    }
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Registers the saved state callbacks with SSM.
  *
@@ -3334,9 +4656,23 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
  */
 int pgmR3InitSavedState(PVM pVM, uint64_t cbRam)
 {
-    return SSMR3RegisterInternal(pVM, "pgm", 1, PGM_SAVED_STATE_VERSION, (size_t)cbRam + sizeof(PGM),
-                                 pgmR3LivePrep, pgmR3LiveExec, pgmR3LiveVote,
-                                 NULL,          pgmR3SaveExec, pgmR3SaveDone,
-                                 pgmR3LoadPrep, pgmR3Load,     NULL);
+    /** @cfgm{/PGM/SaveDigests, boolean, false}
+     * Whether to include SHA-1 digests of the RAM pages in saved states so they
+     * can serve as the base of incremental saved states.  Older versions cannot
+     * load saved states with digests. */
+    int rc = CFGMR3QueryBoolDef(CFGMR3GetChild(CFGMR3GetRoot(pVM), "PGM"), "SaveDigests",
+                                &pVM->pgm.s.LiveSave.fSaveDigests, false);
+    AssertLogRelRCReturn(rc, rc);
+
+    rc = SSMR3RegisterInternal(pVM, "pgm", 1, PGM_SAVED_STATE_VERSION, (size_t)cbRam + sizeof(PGM),
+                               pgmR3LivePrep, pgmR3LiveExec, pgmR3LiveVote,
+                               pgmR3SavePrep, pgmR3SaveExec, pgmR3SaveDone,
+                               pgmR3LoadPrep, pgmR3Load,     pgmR3LoadDone);
+    if (RT_SUCCESS(rc))
+        rc = SSMR3RegisterInternal(pVM, "pgmdigests", 0, PGM_DIGESTS_SAVED_STATE_VERSION, (size_t)(cbRam >> PAGE_SHIFT) * RTSHA1_HASH_SIZE,
+                                   NULL, NULL, NULL,
+                                   NULL, pVM->pgm.s.LiveSave.fSaveDigests ? pgmR3DigestsSaveExec : NULL, NULL,
+                                   NULL, pgmR3DigestsLoadExec, NULL);
+    return rc;
 }
 
@@ -128,6 +128,47 @@
  * needed updating after the data was written.)
  *
  *
+ * @section sec_ssm_zip_pipeline    Parallel Compression
+ *
+ * Compressing page sized blocks is what the save operation spends most of its
+ * CPU time on, so when configured to (SSM/CompressionThreads) the blocks are
+ * handed to a small pool of worker threads instead of being compressed inline
+ * by the thread doing the saving.  The output format is unchanged, each block
+ * still ends up as a type 3 or 4 record.
+ *
+ * The pipeline is a ring of jobs.  Each job carries a copy of the block and
+ * whatever small data was buffered in front of it (as a ready made raw
+ * record).  The saving thread fills the jobs in stream order, the workers
+ * compress them in any order, and the saving thread writes them to the stream
+ * strictly in ring order as they complete.  Any other write to the stream
+ * drains the pipeline first, so the record order is exactly what the inline
+ * code would produce.
+ *
+ *
+ * @section sec_ssm_incremental     Incremental Saved States
+ *
+ * A saved state file can be saved relative to an earlier one, the base.  The
+ * header then has SSMFILEHDR_FLAGS_INCREMENTAL set and is followed by a base
+ * reference (SSMFILEBASEREF) naming the base file and recording its size and
+ * stream CRC so that replacing or modifying the base is detected on load.
+ * Relative base names are relative to the directory of the incremental file.
+ *
+ * SSM itself does not know which data is relative to the base, that is up to
+ * the units (PGM, which leaves out RAM pages equal to the ones in the base).
+ * Loading an incremental file first loads the base (recursively, since the
+ * base may be incremental too), and then loads the incremental file on top of
+ * it without any further ado.  Units can use SSMR3HandleBaseFilename to tell
+ * the two apart during both saving and loading.
+ *
+ * SSMR3Flatten merges a chain into a single self contained file by inserting
+ * the relative units (only "pgm") of all the layers in front of the ones of
+ * the top layer.  They go right before the final pass of the top layer's unit,
+ * so whatever its final pass depends on (like the CPUM state) has been loaded
+ * already, while the live passes of the top layer are moved after them.
+ * Loading it will thus execute those units once per layer, just like loading
+ * the chain does, while the other units only appear once.
+ *
+ *
  * @section sec_ssm_future          Future Changes
  *
  * There are plans to extend SSM to make it easier to be both backwards and
@@ -145,6 +186,7 @@
 *******************************************************************************/
 #define LOG_GROUP LOG_GROUP_SSM
 #include <VBox/vmm/ssm.h>
+#include <VBox/vmm/cfgm.h>
 #include <VBox/vmm/dbgf.h>
 #include <VBox/vmm/pdmapi.h>
 #include <VBox/vmm/pdmcritsect.h>
@@ -161,7 +203,9 @@
 #include <iprt/crc.h>
 #include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/mp.h>
 #include <iprt/param.h>
+#include <iprt/path.h>
 #include <iprt/thread.h>
 #include <iprt/semaphore.h>
 #include <iprt/string.h>
@@ -192,8 +236,14 @@
 #define SSMFILEHDR_FLAGS_STREAM_CRC32           RT_BIT_32(0)
 /** Indicates that the file was produced by a live save. */
 #define SSMFILEHDR_FLAGS_STREAM_LIVE_SAVE       RT_BIT_32(1)
+/** The file is relative to a base saved state file, the header is followed by
+ * a SSMFILEBASEREF. */
+#define SSMFILEHDR_FLAGS_INCREMENTAL            RT_BIT_32(2)
 /** @} */
 
+/** The base reference magic. */
+#define SSMFILEBASEREF_MAGIC                    "\nBase\n\0"
+
 /** The directory magic. */
 #define SSMFILEDIR_MAGIC                        "\nDir\n\0\0"
 
@@ -285,6 +335,15 @@
 #define SSM_ZIP_BLOCK_SIZE                      _4K
 AssertCompile(SSM_ZIP_BLOCK_SIZE / _1K * _1K == SSM_ZIP_BLOCK_SIZE);
 
+/** The max size of a compressed (or stored) block record, including header. */
+#define SSM_ZIP_BLOCK_REC_SIZE                  (1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE)
+
+/** The max number of compression worker threads. */
+#define SSM_ZIP_THREADS_MAX                     16
+/** The number of compression pipeline jobs per worker thread.
+ * The total is rounded up to a power of two. */
+#define SSM_ZIP_JOBS_PER_THREAD                 16
+
 
 /**
  * Asserts that the handle is writable and returns with VERR_SSM_INVALID_STATE
@@ -447,6 +506,66 @@ typedef struct SSMSTRM
 typedef SSMSTRM *PSSMSTRM;
 
 
+/**
+ * A job in the compression pipeline.
+ */
+typedef struct SSMZIPJOB
+{
+    /** The block to compress.  Kept first for alignment. */
+    uint8_t                 abBlock[SSM_ZIP_BLOCK_SIZE];
+    /** The resulting record, written by the worker. */
+    uint8_t                 abRec[SSM_ZIP_BLOCK_REC_SIZE];
+    /** Raw record with the data that was buffered up before the block. */
+    uint8_t                 abPrefix[4 + 4096];
+    /** The size of the prefix record, 0 if none. */
+    uint32_t                cbPrefix;
+    /** The size of the record in abRec. */
+    uint32_t                cbRec;
+    /** Set by the worker when abRec is ready. */
+    bool volatile           fDone;
+} SSMZIPJOB;
+/** Pointer to a compression pipeline job. */
+typedef SSMZIPJOB *PSSMZIPJOB;
+
+/**
+ * The compression pipeline.
+ *
+ * The job indexes are free running and masked when accessing the job array.
+ * Only the saving thread advances iJobSubmit and iJobEmit, the workers (and
+ * the saving thread when it has nothing better to do) claim jobs by advancing
+ * iJobNextWork.
+ */
+typedef struct SSMZIPPIPE
+{
+    /** The number of worker threads. */
+    uint32_t                cThreads;
+    /** The number of jobs in the ring (power of two). */
+    uint32_t                cJobs;
+    /** The size of a job entry in the array (cache line aligned). */
+    size_t                  cbJobStride;
+    /** Tells the worker threads to quit. */
+    bool volatile           fTerminate;
+    /** Set while the saving thread is waiting on hEvtDone. */
+    bool volatile           fWaiting;
+    /** The next job to be submitted. */
+    uint32_t volatile       iJobSubmit;
+    /** The next job to be written to the stream. */
+    uint32_t volatile       iJobEmit;
+    /** The next job to be claimed for compression. */
+    uint32_t volatile       iJobNextWork;
+    /** Signalled when there are jobs to compress. */
+    RTSEMEVENT              hEvtWork;
+    /** Signalled when a job completes and fWaiting is set. */
+    RTSEMEVENT              hEvtDone;
+    /** The job array (page allocation). */
+    uint8_t                *pbJobs;
+    /** The worker threads. */
+    RTTHREAD                ahThreads[SSM_ZIP_THREADS_MAX];
+} SSMZIPPIPE;
+/** Pointer to a compression pipeline. */
+typedef SSMZIPPIPE *PSSMZIPPIPE;
+
+
 /**
  * Handle structure.
  */
@@ -500,6 +619,9 @@ typedef struct SSMHANDLE
     unsigned                uReportedLivePercent;
     /** The filename, NULL if remote stream. */
     const char             *pszFilename;
+    /** The name of the base file of an incremental saved state, NULL if not
+     * incremental.  (RTStrDup'ed) */
+    char                   *pszBaseFilename;
 
     union
     {
@@ -514,6 +636,17 @@ typedef struct SSMHANDLE
             uint8_t         abDataBuffer[4096];
             /** The maximum downtime given as milliseconds. */
             uint32_t        cMsMaxDowntime;
+            /** The compression pipeline, NULL if compressing inline. */
+            PSSMZIPPIPE     pZipPipe;
+            /** Set if the stream compresses the data itself
+             * (SSMSTRMOPS_FLAGS_NO_COMPRESSION), blocks are stored raw. */
+            bool            fNoCompression;
+            /** The size of the base file (incremental saves). */
+            uint64_t        cbBaseFile;
+            /** The stream CRC of the base file (incremental saves). */
+            uint32_t        u32BaseStreamCRC;
+            /** The base file name as given by the caller (incremental saves). */
+            const char     *pszBaseRef;
         } Write;
 
         /** Read data. */
@@ -582,6 +715,12 @@ typedef struct SSMHANDLE
             uint32_t        u32LoadCRC;
             /** The size of the load file. */
             uint64_t        cbLoadFile;
+            /** The unit count from the header. */
+            uint32_t        cUnits;
+            /** The stream CRC the base file must have (incremental files). */
+            uint32_t        u32BaseStreamCRC;
+            /** The size the base file must have (incremental files). */
+            uint64_t        cbBaseFile;
             /** @} */
 
             /** V2: Data buffer.
@@ -593,6 +732,23 @@ typedef struct SSMHANDLE
         } Read;
     } u;
 } SSMHANDLE;
+/* The compression jobs must be able to carry a full data buffer. */
+AssertCompile(RT_SIZEOFMEMB(SSMZIPJOB, abPrefix) >= 4 + RT_SIZEOFMEMB(SSMHANDLE, u.Write.abDataBuffer));
+
+
+/**
+ * Reader for pages skipped by SSMR3SkipPageDeferred.
+ *
+ * This has its own file handle so it can be used after the saved state handle
+ * has been closed, and it is safe to use from any thread.
+ */
+typedef struct SSMPAGEREADER
+{
+    /** The saved state file. */
+    RTFILE                  hFile;
+    /** The size of the file. */
+    uint64_t                cbFile;
+} SSMPAGEREADER;
 
 
 /**
@@ -640,6 +796,35 @@ typedef SSMFILEHDR *PSSMFILEHDR;
 typedef SSMFILEHDR const *PCSSMFILEHDR;
 
 
+/**
+ * Base file reference following the header of incremental saved state files
+ * (SSMFILEHDR_FLAGS_INCREMENTAL).
+ *
+ * The name of the base file, including the terminator, follows immediately.
+ */
+typedef struct SSMFILEBASEREF
+{
+    /** Magic string which identifies this as a base reference
+     * (SSMFILEBASEREF_MAGIC). */
+    char            szMagic[8];
+    /** The size of the base file. */
+    uint64_t        cbBaseFile;
+    /** The stream CRC-32 of the base file (from its footer). */
+    uint32_t        u32BaseStreamCRC;
+    /** The size of the name, including the terminator. */
+    uint32_t        cbName;
+    /** Reserved, MBZ. */
+    uint32_t        u32Reserved;
+    /** The checksum of this structure and the name.
+     * This field is set to zero when calculating the checksum. */
+    uint32_t        u32CRC;
+} SSMFILEBASEREF;
+AssertCompileSize(SSMFILEBASEREF, 32);
+AssertCompileMemberSize(SSMFILEBASEREF, szMagic, sizeof(SSMFILEBASEREF_MAGIC));
+/** Pointer to a base file reference. */
+typedef SSMFILEBASEREF *PSSMFILEBASEREF;
+
+
 /**
  * Header of the saved state file.
  *
@@ -884,6 +1069,11 @@ static DECLCALLBACK(int)    ssmR3SelfLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_t
 static DECLCALLBACK(int)    ssmR3LiveControlLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass);
 static int                  ssmR3Register(PVM pVM, const char *pszName, uint32_t uInstance, uint32_t uVersion, size_t cbGuess, const char *pszBefore, PSSMUNIT *ppUnit);
 static int                  ssmR3LiveControlEmit(PSSMHANDLE pSSM, long double lrdPct, uint32_t uPass);
+static int                  ssmR3LoadDoIt(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
+                                          SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvProgressUser,
+                                          PSSMHANDLE pTop, unsigned cDepth);
+static int                  ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvUser,
+                                          bool fChecksumIt, bool fChecksumOnRead, uint32_t cBuffers, PSSMHANDLE pSSM);
 #endif
 
 static int                  ssmR3StrmWriteBuffers(PSSMSTRM pStrm);
@@ -891,6 +1081,7 @@ static int                  ssmR3StrmReadMore(PSSMSTRM pStrm);
 
 #ifndef SSM_STANDALONE
 static int                  ssmR3DataFlushBuffer(PSSMHANDLE pSSM);
+static int                  ssmR3DataZipDrain(PSSMHANDLE pSSM);
 #endif
 static int                  ssmR3DataReadRecHdrV2(PSSMHANDLE pSSM);
 
@@ -945,6 +1136,23 @@ static int ssmR3LazyInit(PVM pVM)
         STAM_REL_REG_USED(pVM, &pVM->ssm.s.uPass, STAMTYPE_U32, "/SSM/uPass", STAMUNIT_COUNT, "Current pass");
     }
 
+    /*
+     * Query the compression thread count.
+     */
+    if (RT_SUCCESS(rc))
+    {
+        /** @cfgm{/SSM/CompressionThreads, uint32_t, 0..16, half the online CPUs (max 4)}
+         * The number of threads compressing saved state data.  Zero means
+         * compressing on EMT.  The default is half the online CPUs, max 4,
+         * when there are more than two CPUs, otherwise zero. */
+        RTCPUID  cCpus            = RTMpGetOnlineCount();
+        uint32_t cZipThreadsDef   = cCpus > 2 ? RT_MIN((uint32_t)cCpus / 2, 4) : 0;
+        rc = CFGMR3QueryU32Def(CFGMR3GetChild(CFGMR3GetRoot(pVM), "SSM"), "CompressionThreads",
+                               &pVM->ssm.s.cZipThreads, cZipThreadsDef);
+        if (RT_SUCCESS(rc) && pVM->ssm.s.cZipThreads > SSM_ZIP_THREADS_MAX)
+            pVM->ssm.s.cZipThreads = SSM_ZIP_THREADS_MAX;
+    }
+
     pVM->ssm.s.fInitialized = RT_SUCCESS(rc);
     return rc;
 }
@@ -1957,6 +2165,32 @@ static int ssmR3StrmInit(PSSMSTRM pStrm, PCSSMSTRMOPS pStreamOps, void *pvUser,
 }
 
 
+/**
+ * Resolves the name of the base file of an incremental saved state.
+ *
+ * Relative names are relative to the directory of the incremental file.
+ *
+ * @returns Pointer to the resolved name (RTStrFree), NULL if out of memory.
+ * @param   pszFilename     The incremental file, NULL if remote stream.
+ * @param   pszBaseRef      The base file name as given / recorded.
+ */
+static char *ssmR3ResolveBaseFilename(const char *pszFilename, const char *pszBaseRef)
+{
+    if (    !pszFilename
+        ||  RTPathStartsWithRoot(pszBaseRef)
+        ||  RTPathFilename(pszFilename) == pszFilename)
+        return RTStrDup(pszBaseRef);
+
+    char *pszDir = RTStrDup(pszFilename);
+    if (!pszDir)
+        return NULL;
+    RTPathStripFilename(pszDir);
+    char *pszResolved = RTPathJoinA(pszDir, pszBaseRef);
+    RTStrFree(pszDir);
+    return pszResolved;
+}
+
+
 /**
  * @copydoc SSMSTRMOPS::pfnWrite
  */
@@ -2048,6 +2282,7 @@ static DECLCALLBACK(int) ssmR3FileClose(void *pvUser, bool fCancelled)
 static SSMSTRMOPS const g_ssmR3FileOps =
 {
     SSMSTRMOPS_VERSION,
+    0 /*fFlags*/,
     ssmR3FileWrite,
     ssmR3FileRead,
     ssmR3FileSeek,
@@ -3282,13 +3517,20 @@ static int ssmR3DataWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
     if (RT_FAILURE(pSSM->rc))
         return pSSM->rc;
 
+    /*
+     * Anything queued up in the compression pipeline goes first.
+     */
+    int rc = ssmR3DataZipDrain(pSSM);
+    if (RT_FAILURE(rc))
+        return rc;
+
     /*
      * Write the data item in 1MB chunks for progress indicator reasons.
      */
     while (cbBuf > 0)
     {
         size_t cbChunk = RT_MIN(cbBuf, _1M);
-        int rc = ssmR3StrmWrite(&pSSM->Strm, pvBuf, cbChunk);
+        rc = ssmR3StrmWrite(&pSSM->Strm, pvBuf, cbChunk);
         if (RT_FAILURE(rc))
             return rc;
         pSSM->offUnit += cbChunk;
@@ -3301,17 +3543,16 @@ static int ssmR3DataWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
 
 
 /**
- * Writes a record header for the specified amount of data.
+ * Encodes a record header for the specified amount of data.
  *
- * @returns VBox status code. Sets pSSM->rc on failure.
- * @param   pSSM            The saved state handle
+ * @returns The size of the header, 0 if @a cb is too big.
+ * @param   abHdr           Where to return the header.
  * @param   cb              The amount of data.
  * @param   u8TypeAndFlags  The record type and flags.
  */
-static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFlags)
+static size_t ssmR3DataEncodeRecHdr(uint8_t abHdr[8], size_t cb, uint8_t u8TypeAndFlags)
 {
     size_t  cbHdr;
-    uint8_t abHdr[8];
     abHdr[0] = u8TypeAndFlags;
     if (cb < 0x80)
     {
@@ -3359,6 +3600,24 @@ static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFla
         abHdr[6] = (uint8_t)(0x80 | (cb & 0x3f));
     }
     else
+        cbHdr = 0;
+    return cbHdr;
+}
+
+
+/**
+ * Writes a record header for the specified amount of data.
+ *
+ * @returns VBox status code. Sets pSSM->rc on failure.
+ * @param   pSSM            The saved state handle
+ * @param   cb              The amount of data.
+ * @param   u8TypeAndFlags  The record type and flags.
+ */
+static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFlags)
+{
+    uint8_t abHdr[8];
+    size_t  cbHdr = ssmR3DataEncodeRecHdr(abHdr, cb, u8TypeAndFlags);
+    if (RT_UNLIKELY(!cbHdr))
         AssertLogRelMsgFailedReturn(("cb=%#x\n", cb), pSSM->rc = VERR_SSM_MEM_TOO_BIG);
 
     Log3(("ssmR3DataWriteRecHdr: %08llx|%08llx/%08x: Type=%02x fImportant=%RTbool cbHdr=%u\n",
@@ -3377,11 +3636,17 @@ static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFla
 static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
 {
     /*
-     * Check how much there current is in the buffer.
+     * Check how much there current is in the buffer.  The compression
+     * pipeline must be drained even if it's empty, as callers expect the
+     * stream position and CRC to be up to date on return.
      */
     uint32_t cb = pSSM->u.Write.offDataBuffer;
     if (!cb)
+    {
+        if (RT_SUCCESS(pSSM->rc))
+            return ssmR3DataZipDrain(pSSM);
         return pSSM->rc;
+    }
     pSSM->u.Write.offDataBuffer = 0;
 
     /*
@@ -3398,243 +3663,568 @@ static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
 
 
 /**
- * ssmR3DataWrite worker that writes big stuff.
+ * Encodes a SSM_ZIP_BLOCK_SIZE sized block as a zero, LZF compressed or raw
+ * record, whichever fits.
  *
- * @returns VBox status code
- * @param   pSSM            The saved state handle.
- * @param   pvBuf           The bits to write.
- * @param   cbBuf           The number of bytes to write.
+ * @returns The size of the record (including the header).
+ * @param   pvBlock         The block.
+ * @param   pbRec           Where to put the record.  Must have room for
+ *                          SSM_ZIP_BLOCK_REC_SIZE bytes.
+ * @param   fCompress       Whether to try LZF compress it, if not it will be
+ *                          a zero or raw record.
+ *
+ * @remarks Called on the compression worker threads.
  */
-static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+static size_t ssmR3DataEncodeBlock(const void *pvBlock, uint8_t *pbRec, bool fCompress)
 {
-    int rc = ssmR3DataFlushBuffer(pSSM);
-    if (RT_SUCCESS(rc))
+    AssertCompile(SSM_ZIP_BLOCK_SIZE == PAGE_SIZE);
+    if (    !((uintptr_t)pvBlock & 0xf)
+        &&  ASMMemIsZeroPage(pvBlock))
     {
-        pSSM->offUnitUser += cbBuf;
-
-        /*
-         * Split it up into compression blocks.
-         */
-        for (;;)
-        {
-            AssertCompile(SSM_ZIP_BLOCK_SIZE == PAGE_SIZE);
-            if (    cbBuf >= SSM_ZIP_BLOCK_SIZE
-                && (    ((uintptr_t)pvBuf & 0xf)
-                    ||  !ASMMemIsZeroPage(pvBuf))
-               )
-            {
-                /*
-                 * Compress it.
-                 */
-                AssertCompile(1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE < 0x00010000);
-                uint8_t *pb;
-                rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, 1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE, &pb);
-                if (RT_FAILURE(rc))
-                    break;
-                size_t cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
-                rc = RTZipBlockCompress(RTZIPTYPE_LZF, RTZIPLEVEL_FAST, 0 /*fFlags*/,
-                                        pvBuf, SSM_ZIP_BLOCK_SIZE,
-                                        pb + 1 + 3 + 1, cbRec, &cbRec);
-                if (RT_SUCCESS(rc))
-                {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_LZF;
-                    pb[4] = SSM_ZIP_BLOCK_SIZE / _1K;
-                    cbRec += 1;
-                }
-                else
-                {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
-                    memcpy(&pb[4], pvBuf, SSM_ZIP_BLOCK_SIZE);
-                    cbRec = SSM_ZIP_BLOCK_SIZE;
-                }
-                pb[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
-                pb[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
-                pb[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
-                cbRec += 1 + 3;
-                rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
-                if (RT_FAILURE(rc))
-                    break;
-
-                pSSM->offUnit += cbRec;
-                ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
-
-                /* advance */
-                if (cbBuf == SSM_ZIP_BLOCK_SIZE)
-                    return VINF_SUCCESS;
-                cbBuf -= SSM_ZIP_BLOCK_SIZE;
-                pvBuf = (uint8_t const*)pvBuf + SSM_ZIP_BLOCK_SIZE;
-            }
-            else if (cbBuf >= SSM_ZIP_BLOCK_SIZE)
-            {
-                /*
-                 * Zero block.
-                 */
-                uint8_t abRec[3];
-                abRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_ZERO;
-                abRec[1] = 1;
-                abRec[2] = SSM_ZIP_BLOCK_SIZE / _1K;
-                Log3(("ssmR3DataWriteBig: %08llx|%08llx/%08x: ZERO\n", ssmR3StrmTell(&pSSM->Strm) + 2, pSSM->offUnit + 2, 1));
-                rc = ssmR3DataWriteRaw(pSSM, &abRec[0], sizeof(abRec));
-                if (RT_FAILURE(rc))
-                    break;
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_ZERO;
+        pbRec[1] = 1;
+        pbRec[2] = SSM_ZIP_BLOCK_SIZE / _1K;
+        return 3;
+    }
 
-                /* advance */
-                ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
-                if (cbBuf == SSM_ZIP_BLOCK_SIZE)
-                    return VINF_SUCCESS;
-                cbBuf -= SSM_ZIP_BLOCK_SIZE;
-                pvBuf = (uint8_t const*)pvBuf + SSM_ZIP_BLOCK_SIZE;
-            }
-            else
-            {
-                /*
-                 * Less than one block left, store it the simple way.
-                 */
-                rc = ssmR3DataWriteRecHdr(pSSM, cbBuf, SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW);
-                if (RT_SUCCESS(rc))
-                    rc = ssmR3DataWriteRaw(pSSM, pvBuf, cbBuf);
-                ssmR3ProgressByByte(pSSM, cbBuf);
-                break;
-            }
-        }
+    AssertCompile(SSM_ZIP_BLOCK_REC_SIZE < 0x00010000);
+    size_t cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
+    int rc = VERR_BUFFER_OVERFLOW;
+    if (fCompress)
+        rc = RTZipBlockCompress(RTZIPTYPE_LZF, RTZIPLEVEL_FAST, 0 /*fFlags*/,
+                                pvBlock, SSM_ZIP_BLOCK_SIZE,
+                                pbRec + 1 + 3 + 1, cbRec, &cbRec);
+    if (RT_SUCCESS(rc))
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_LZF;
+        pbRec[4] = SSM_ZIP_BLOCK_SIZE / _1K;
+        cbRec += 1;
     }
-    return rc;
+    else
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
+        memcpy(&pbRec[4], pvBlock, SSM_ZIP_BLOCK_SIZE);
+        cbRec = SSM_ZIP_BLOCK_SIZE;
+    }
+    pbRec[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
+    pbRec[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
+    pbRec[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
+    return cbRec + 1 + 3;
 }
 
 
 /**
- * ssmR3DataWrite worker that is called when there isn't enough room in the
- * buffer for the current chunk of data.
+ * Gets a compression pipeline job by (free running) index.
  *
- * This will first flush the buffer and then add the new bits to it.
+ * @returns Pointer to the job.
+ * @param   pPipe           The compression pipeline.
+ * @param   iJob            The job index.
+ */
+DECLINLINE(PSSMZIPJOB) ssmR3ZipPipeJob(PSSMZIPPIPE pPipe, uint32_t iJob)
+{
+    return (PSSMZIPJOB)&pPipe->pbJobs[(iJob & (pPipe->cJobs - 1)) * pPipe->cbJobStride];
+}
+
+
+/**
+ * Tries to claim and compress one pending job.
  *
- * @returns VBox status code
- * @param   pSSM            The saved state handle.
- * @param   pvBuf           The bits to write.
- * @param   cbBuf           The number of bytes to write.
+ * @returns true if a job was processed, false if there was nothing to do.
+ * @param   pPipe           The compression pipeline.
  */
-static int ssmR3DataWriteFlushAndBuffer(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+static bool ssmR3ZipPipeDoOneJob(PSSMZIPPIPE pPipe)
 {
-    int rc = ssmR3DataFlushBuffer(pSSM);
-    if (RT_SUCCESS(rc))
+    for (;;)
     {
-        memcpy(&pSSM->u.Write.abDataBuffer[0], pvBuf, cbBuf);
-        pSSM->u.Write.offDataBuffer = (uint32_t)cbBuf;
-        pSSM->offUnitUser += cbBuf;
+        uint32_t const iJob = ASMAtomicReadU32(&pPipe->iJobNextWork);
+        if (iJob == ASMAtomicReadU32(&pPipe->iJobSubmit))
+            return false;
+        if (ASMAtomicCmpXchgU32(&pPipe->iJobNextWork, iJob + 1, iJob))
+        {
+            /* Wake up another worker if there is more to do. */
+            if (iJob + 1 != ASMAtomicReadU32(&pPipe->iJobSubmit))
+                RTSemEventSignal(pPipe->hEvtWork);
+
+            PSSMZIPJOB pJob = ssmR3ZipPipeJob(pPipe, iJob);
+            pJob->cbRec = (uint32_t)ssmR3DataEncodeBlock(pJob->abBlock, pJob->abRec, true /*fCompress*/);
+            ASMAtomicWriteBool(&pJob->fDone, true);
+            if (ASMAtomicReadBool(&pPipe->fWaiting))
+                RTSemEventSignal(pPipe->hEvtDone);
+            return true;
+        }
     }
-    return rc;
 }
 
 
 /**
- * Writes data to the current data unit.
- *
- * This is an inlined wrapper that optimizes the small writes that so many of
- * the APIs make.
+ * The compression worker thread.
  *
- * @returns VBox status code
- * @param   pSSM            The saved state handle.
- * @param   pvBuf           The bits to write.
- * @param   cbBuf           The number of bytes to write.
+ * @returns VINF_SUCCESS.
+ * @param   hSelf       The thread handle.
+ * @param   pvPipe      The compression pipeline.
  */
-DECLINLINE(int) ssmR3DataWrite(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+static DECLCALLBACK(int) ssmR3ZipPipeThread(RTTHREAD hSelf, void *pvPipe)
 {
-    if (cbBuf > sizeof(pSSM->u.Write.abDataBuffer) / 8)
-        return ssmR3DataWriteBig(pSSM, pvBuf, cbBuf);
-    if (!cbBuf)
-        return VINF_SUCCESS;
+    PSSMZIPPIPE pPipe = (PSSMZIPPIPE)pvPipe;
+    NOREF(hSelf);
 
-    uint32_t off = pSSM->u.Write.offDataBuffer;
-    if (RT_UNLIKELY(cbBuf + off > sizeof(pSSM->u.Write.abDataBuffer)))
-        return ssmR3DataWriteFlushAndBuffer(pSSM, pvBuf, cbBuf);
-
-    memcpy(&pSSM->u.Write.abDataBuffer[off], pvBuf, cbBuf);
-    pSSM->u.Write.offDataBuffer = off + (uint32_t)cbBuf;
-    pSSM->offUnitUser += cbBuf;
+    while (!ASMAtomicReadBool(&pPipe->fTerminate))
+    {
+        if (!ssmR3ZipPipeDoOneJob(pPipe))
+        {
+            int rc = RTSemEventWait(pPipe->hEvtWork, RT_INDEFINITE_WAIT);
+            AssertLogRelMsgBreak(RT_SUCCESS(rc) || rc == VERR_INTERRUPTED, ("%Rrc\n", rc));
+        }
+    }
     return VINF_SUCCESS;
 }
 
 
 /**
- * Puts a structure.
+ * Writes completed jobs to the stream in order.
  *
  * @returns VBox status code.
  * @param   pSSM            The saved state handle.
- * @param   pvStruct        The structure address.
- * @param   paFields        The array of structure fields descriptions.
- *                          The array must be terminated by a SSMFIELD_ENTRY_TERM().
+ * @param   pPipe           The compression pipeline.
+ * @param   iJobUntil       Wait for all jobs up to (but not including) this
+ *                          one to be written.  Jobs completing in the
+ *                          meantime are written as well.
  */
-VMMR3DECL(int) SSMR3PutStruct(PSSMHANDLE pSSM, const void *pvStruct, PCSSMFIELD paFields)
+static int ssmR3ZipPipeEmit(PSSMHANDLE pSSM, PSSMZIPPIPE pPipe, uint32_t iJobUntil)
 {
-    SSM_ASSERT_WRITEABLE_RET(pSSM);
-    SSM_CHECK_CANCELLED_RET(pSSM);
-    AssertPtr(pvStruct);
-    AssertPtr(paFields);
-
-    /* begin marker. */
-    int rc = SSMR3PutU32(pSSM, SSMR3STRUCT_BEGIN);
-    if (RT_FAILURE(rc))
-        return rc;
-
-    /* put the fields */
-    for (PCSSMFIELD pCur = paFields;
-         pCur->cb != UINT32_MAX && pCur->off != UINT32_MAX;
-         pCur++)
+    int rc = VINF_SUCCESS;
+    while (pPipe->iJobEmit != pPipe->iJobSubmit)
     {
-        uint8_t const *pbField = (uint8_t const *)pvStruct + pCur->off;
-        switch ((uintptr_t)pCur->pfnGetPutOrTransformer)
+        PSSMZIPJOB pJob = ssmR3ZipPipeJob(pPipe, pPipe->iJobEmit);
+        if (!ASMAtomicReadBool(&pJob->fDone))
         {
-            case SSMFIELDTRANS_NO_TRANSFORMATION:
-                rc = ssmR3DataWrite(pSSM, pbField, pCur->cb);
-                break;
-
-            case SSMFIELDTRANS_GCPTR:
-                AssertMsgBreakStmt(pCur->cb == sizeof(RTGCPTR), ("%#x (%s)\n", pCur->cb, pCur->pszName), rc = VERR_SSM_FIELD_INVALID_SIZE);
-                rc = SSMR3PutGCPtr(pSSM, *(PRTGCPTR)pbField);
-                break;
-
-            case SSMFIELDTRANS_GCPHYS:
-                AssertMsgBreakStmt(pCur->cb == sizeof(RTGCPHYS), ("%#x (%s)\n", pCur->cb, pCur->pszName), rc = VERR_SSM_FIELD_INVALID_SIZE);
-                rc = SSMR3PutGCPhys(pSSM, *(PRTGCPHYS)pbField);
-                break;
-
-            case SSMFIELDTRANS_RCPTR:
-                AssertMsgBreakStmt(pCur->cb == sizeof(RTRCPTR), ("%#x (%s)\n", pCur->cb, pCur->pszName), rc = VERR_SSM_FIELD_INVALID_SIZE);
-                rc = SSMR3PutRCPtr(pSSM, *(PRTRCPTR)pbField);
+            if ((int32_t)(iJobUntil - pPipe->iJobEmit) <= 0)
                 break;
 
-            case SSMFIELDTRANS_RCPTR_ARRAY:
+            /*
+             * Lend a hand instead of just waiting, then wait for the worker
+             * that's got the job we want.
+             */
+            while (ssmR3ZipPipeDoOneJob(pPipe))
+                if (ASMAtomicReadBool(&pJob->fDone))
+                    break;
+            while (!ASMAtomicReadBool(&pJob->fDone))
             {
-                uint32_t const cEntries = pCur->cb / sizeof(RTRCPTR);
-                AssertMsgBreakStmt(pCur->cb == cEntries * sizeof(RTRCPTR) && cEntries, ("%#x (%s)\n", pCur->cb, pCur->pszName),
-                                   rc = VERR_SSM_FIELD_INVALID_SIZE);
-                rc = VINF_SUCCESS;
-                for (uint32_t i = 0; i < cEntries && RT_SUCCESS(rc); i++)
-                    rc = SSMR3PutRCPtr(pSSM, ((PRTRCPTR)pbField)[i]);
-                break;
+                ASMAtomicWriteBool(&pPipe->fWaiting, true);
+                if (!ASMAtomicReadBool(&pJob->fDone))
+                    RTSemEventWait(pPipe->hEvtDone, RT_INDEFINITE_WAIT);
+                ASMAtomicWriteBool(&pPipe->fWaiting, false);
             }
+        }
 
-            default:
-                AssertMsgFailedBreakStmt(("%#x\n", pCur->pfnGetPutOrTransformer), rc = VERR_SSM_FIELD_COMPLEX);
+        /*
+         * Write the prefix record and the block record.
+         */
+        if (pJob->cbPrefix)
+        {
+            rc = ssmR3StrmWrite(&pSSM->Strm, pJob->abPrefix, pJob->cbPrefix);
+            pSSM->offUnit += pJob->cbPrefix;
         }
-        if (RT_FAILURE(rc))
+        if (RT_SUCCESS(rc))
         {
-            if (RT_SUCCESS(pSSM->rc))
-                pSSM->rc = rc;
-            return rc;
+            Log3(("ssmR3ZipPipeEmit: %08llx|%08llx/%08x: type=%02x\n",
+                  ssmR3StrmTell(&pSSM->Strm), pSSM->offUnit, pJob->cbRec, pJob->abRec[0] & SSM_REC_TYPE_MASK));
+            rc = ssmR3StrmWrite(&pSSM->Strm, pJob->abRec, pJob->cbRec);
+            pSSM->offUnit += pJob->cbRec;
         }
+        ASMAtomicWriteBool(&pJob->fDone, false);
+        ASMAtomicWriteU32(&pPipe->iJobEmit, pPipe->iJobEmit + 1);
+        if (RT_FAILURE(rc))
+            break;
     }
-
-    /* end marker */
-    return SSMR3PutU32(pSSM, SSMR3STRUCT_END);
+    return rc;
 }
 
 
 /**
- * SSMR3PutStructEx helper that puts a HCPTR that is used as a NULL indicator.
+ * Writes all jobs in the compression pipeline to the stream.
  *
  * @returns VBox status code.
- *
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataZipDrain(PSSMHANDLE pSSM)
+{
+    PSSMZIPPIPE pPipe = pSSM->u.Write.pZipPipe;
+    if (!pPipe || pPipe->iJobEmit == pPipe->iJobSubmit)
+        return VINF_SUCCESS;
+    return ssmR3ZipPipeEmit(pSSM, pPipe, pPipe->iJobSubmit);
+}
+
+
+/**
+ * Queues full blocks on the compression pipeline.
+ *
+ * The data currently buffered goes along with the first block so that the
+ * record order is preserved.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   pPipe           The compression pipeline.
+ * @param   pvBuf           The bits to write.
+ * @param   cbBuf           The number of bytes to write, multiple of
+ *                          SSM_ZIP_BLOCK_SIZE.
+ */
+static int ssmR3ZipPipeSubmit(PSSMHANDLE pSSM, PSSMZIPPIPE pPipe, const void *pvBuf, size_t cbBuf)
+{
+    Assert(!(cbBuf % SSM_ZIP_BLOCK_SIZE));
+    while (cbBuf > 0)
+    {
+        /*
+         * Make room if the ring is full.
+         */
+        uint32_t const iJob = pPipe->iJobSubmit;
+        if (iJob - pPipe->iJobEmit >= pPipe->cJobs)
+        {
+            int rc = ssmR3ZipPipeEmit(pSSM, pPipe, pPipe->iJobEmit + 1);
+            if (RT_FAILURE(rc))
+                return rc;
+        }
+
+        /*
+         * Fill in the job.
+         */
+        PSSMZIPJOB pJob = ssmR3ZipPipeJob(pPipe, iJob);
+        Assert(!pJob->fDone);
+        uint32_t cbData = pSSM->u.Write.offDataBuffer;
+        if (cbData)
+        {
+            size_t cbHdr = ssmR3DataEncodeRecHdr(pJob->abPrefix, cbData,
+                                                 SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW);
+            memcpy(&pJob->abPrefix[cbHdr], pSSM->u.Write.abDataBuffer, cbData);
+            pJob->cbPrefix = (uint32_t)(cbHdr + cbData);
+            pSSM->u.Write.offDataBuffer = 0;
+            ssmR3ProgressByByte(pSSM, cbData);
+        }
+        else
+            pJob->cbPrefix = 0;
+        memcpy(pJob->abBlock, pvBuf, SSM_ZIP_BLOCK_SIZE);
+
+        /*
+         * Submit it and write whatever has completed meanwhile.
+         */
+        ASMAtomicWriteU32(&pPipe->iJobSubmit, iJob + 1);
+        RTSemEventSignal(pPipe->hEvtWork);
+        ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
+
+        int rc = ssmR3ZipPipeEmit(pSSM, pPipe, pPipe->iJobEmit);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        cbBuf -= SSM_ZIP_BLOCK_SIZE;
+        pvBuf = (uint8_t const *)pvBuf + SSM_ZIP_BLOCK_SIZE;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys the compression pipeline, discarding any pending jobs.
+ *
+ * @param   pSSM            The saved state handle.
+ */
+static void ssmR3ZipPipeDestroy(PSSMHANDLE pSSM)
+{
+    PSSMZIPPIPE pPipe = pSSM->u.Write.pZipPipe;
+    if (!pPipe)
+        return;
+    pSSM->u.Write.pZipPipe = NULL;
+
+    ASMAtomicWriteBool(&pPipe->fTerminate, true);
+    for (uint32_t i = 0; i < pPipe->cThreads; i++)
+        RTSemEventSignal(pPipe->hEvtWork);
+    for (uint32_t i = 0; i < pPipe->cThreads; i++)
+    {
+        int rc = RTThreadWait(pPipe->ahThreads[i], RT_INDEFINITE_WAIT, NULL);
+        AssertLogRelRC(rc);
+        /* Make sure the other threads get woken up too. */
+        RTSemEventSignal(pPipe->hEvtWork);
+    }
+
+    RTSemEventDestroy(pPipe->hEvtWork);
+    RTSemEventDestroy(pPipe->hEvtDone);
+    RTMemPageFree(pPipe->pbJobs, pPipe->cJobs * pPipe->cbJobStride);
+    RTMemFree(pPipe);
+}
+
+
+/**
+ * Creates the compression pipeline.
+ *
+ * Failure is not fatal, the caller just continues compressing inline.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   cThreads        The number of worker threads.
+ */
+static int ssmR3ZipPipeCreate(PSSMHANDLE pSSM, uint32_t cThreads)
+{
+    AssertReturn(cThreads > 0 && cThreads <= SSM_ZIP_THREADS_MAX, VERR_OUT_OF_RANGE);
+
+    PSSMZIPPIPE pPipe = (PSSMZIPPIPE)RTMemAllocZ(sizeof(*pPipe));
+    if (!pPipe)
+        return VERR_NO_MEMORY;
+    pPipe->cJobs       = RT_BIT_32(ASMBitLastSetU32(cThreads * SSM_ZIP_JOBS_PER_THREAD - 1));
+    pPipe->cbJobStride = RT_ALIGN_Z(sizeof(SSMZIPJOB), 64);
+    pPipe->hEvtWork    = NIL_RTSEMEVENT;
+    pPipe->hEvtDone    = NIL_RTSEMEVENT;
+    pPipe->pbJobs      = (uint8_t *)RTMemPageAllocZ(pPipe->cJobs * pPipe->cbJobStride);
+    int rc = pPipe->pbJobs ? VINF_SUCCESS : VERR_NO_MEMORY;
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pPipe->hEvtWork);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pPipe->hEvtDone);
+    if (RT_FAILURE(rc))
+    {
+        RTSemEventDestroy(pPipe->hEvtWork);
+        RTSemEventDestroy(pPipe->hEvtDone);
+        if (pPipe->pbJobs)
+            RTMemPageFree(pPipe->pbJobs, pPipe->cJobs * pPipe->cbJobStride);
+        RTMemFree(pPipe);
+        return rc;
+    }
+
+    /*
+     * Install it and start the threads.  Should thread creation fail we
+     * make do with what we got.
+     */
+    pSSM->u.Write.pZipPipe = pPipe;
+    for (uint32_t i = 0; i < cThreads; i++)
+    {
+        rc = RTThreadCreateF(&pPipe->ahThreads[i], ssmR3ZipPipeThread, pPipe, 0, RTTHREADTYPE_DEFAULT,
+                             RTTHREADFLAGS_WAITABLE, "SSM-Zip%u", i);
+        if (RT_FAILURE(rc))
+            break;
+        pPipe->cThreads = i + 1;
+    }
+    if (!pPipe->cThreads)
+    {
+        ssmR3ZipPipeDestroy(pSSM);
+        return rc;
+    }
+    LogRel(("SSM: Using %u compression threads\n", pPipe->cThreads));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * ssmR3DataWrite worker that writes big stuff.
+ *
+ * @returns VBox status code
+ * @param   pSSM            The saved state handle.
+ * @param   pvBuf           The bits to write.
+ * @param   cbBuf           The number of bytes to write.
+ */
+static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+{
+    /*
+     * Full blocks goes to the compression pipeline if we've got one.
+     */
+    PSSMZIPPIPE pPipe = pSSM->u.Write.pZipPipe;
+    if (    pPipe
+        &&  cbBuf >= SSM_ZIP_BLOCK_SIZE
+        &&  RT_SUCCESS(pSSM->rc))
+    {
+        size_t const cbBlocks = cbBuf & ~(size_t)(SSM_ZIP_BLOCK_SIZE - 1);
+        int rc = ssmR3ZipPipeSubmit(pSSM, pPipe, pvBuf, cbBlocks);
+        if (RT_FAILURE(rc))
+            return rc;
+        pSSM->offUnitUser += cbBlocks;
+        if (cbBuf == cbBlocks)
+            return VINF_SUCCESS;
+        cbBuf -= cbBlocks;
+        pvBuf  = (uint8_t const *)pvBuf + cbBlocks;
+    }
+
+    int rc = ssmR3DataFlushBuffer(pSSM);
+    if (RT_SUCCESS(rc))
+    {
+        pSSM->offUnitUser += cbBuf;
+
+        /*
+         * Split it up into compression blocks.
+         */
+        for (;;)
+        {
+            if (cbBuf >= SSM_ZIP_BLOCK_SIZE)
+            {
+                /*
+                 * Compress it unless the stream does (or emit a zero record).
+                 */
+                uint8_t *pb;
+                rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, SSM_ZIP_BLOCK_REC_SIZE, &pb);
+                if (RT_FAILURE(rc))
+                    break;
+                size_t cbRec = ssmR3DataEncodeBlock(pvBuf, pb, !pSSM->u.Write.fNoCompression);
+                Log3(("ssmR3DataWriteBig: %08llx|%08llx/%08x: type=%02x\n",
+                      ssmR3StrmTell(&pSSM->Strm), pSSM->offUnit, cbRec, pb[0] & SSM_REC_TYPE_MASK));
+                rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
+                if (RT_FAILURE(rc))
+                    break;
+
+                pSSM->offUnit += cbRec;
+                ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
+
+                /* advance */
+                if (cbBuf == SSM_ZIP_BLOCK_SIZE)
+                    return VINF_SUCCESS;
+                cbBuf -= SSM_ZIP_BLOCK_SIZE;
+                pvBuf = (uint8_t const*)pvBuf + SSM_ZIP_BLOCK_SIZE;
+            }
+            else
+            {
+                /*
+                 * Less than one block left, store it the simple way.
+                 */
+                rc = ssmR3DataWriteRecHdr(pSSM, cbBuf, SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW);
+                if (RT_SUCCESS(rc))
+                    rc = ssmR3DataWriteRaw(pSSM, pvBuf, cbBuf);
+                ssmR3ProgressByByte(pSSM, cbBuf);
+                break;
+            }
+        }
+    }
+    return rc;
+}
+
+
+/**
+ * ssmR3DataWrite worker that is called when there isn't enough room in the
+ * buffer for the current chunk of data.
+ *
+ * This will first flush the buffer and then add the new bits to it.
+ *
+ * @returns VBox status code
+ * @param   pSSM            The saved state handle.
+ * @param   pvBuf           The bits to write.
+ * @param   cbBuf           The number of bytes to write.
+ */
+static int ssmR3DataWriteFlushAndBuffer(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+{
+    int rc = ssmR3DataFlushBuffer(pSSM);
+    if (RT_SUCCESS(rc))
+    {
+        memcpy(&pSSM->u.Write.abDataBuffer[0], pvBuf, cbBuf);
+        pSSM->u.Write.offDataBuffer = (uint32_t)cbBuf;
+        pSSM->offUnitUser += cbBuf;
+    }
+    return rc;
+}
+
+
+/**
+ * Writes data to the current data unit.
+ *
+ * This is an inlined wrapper that optimizes the small writes that so many of
+ * the APIs make.
+ *
+ * @returns VBox status code
+ * @param   pSSM            The saved state handle.
+ * @param   pvBuf           The bits to write.
+ * @param   cbBuf           The number of bytes to write.
+ */
+DECLINLINE(int) ssmR3DataWrite(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+{
+    if (cbBuf > sizeof(pSSM->u.Write.abDataBuffer) / 8)
+        return ssmR3DataWriteBig(pSSM, pvBuf, cbBuf);
+    if (!cbBuf)
+        return VINF_SUCCESS;
+
+    uint32_t off = pSSM->u.Write.offDataBuffer;
+    if (RT_UNLIKELY(cbBuf + off > sizeof(pSSM->u.Write.abDataBuffer)))
+        return ssmR3DataWriteFlushAndBuffer(pSSM, pvBuf, cbBuf);
+
+    memcpy(&pSSM->u.Write.abDataBuffer[off], pvBuf, cbBuf);
+    pSSM->u.Write.offDataBuffer = off + (uint32_t)cbBuf;
+    pSSM->offUnitUser += cbBuf;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Puts a structure.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   pvStruct        The structure address.
+ * @param   paFields        The array of structure fields descriptions.
+ *                          The array must be terminated by a SSMFIELD_ENTRY_TERM().
+ */
+VMMR3DECL(int) SSMR3PutStruct(PSSMHANDLE pSSM, const void *pvStruct, PCSSMFIELD paFields)
+{
+    SSM_ASSERT_WRITEABLE_RET(pSSM);
+    SSM_CHECK_CANCELLED_RET(pSSM);
+    AssertPtr(pvStruct);
+    AssertPtr(paFields);
+
+    /* begin marker. */
+    int rc = SSMR3PutU32(pSSM, SSMR3STRUCT_BEGIN);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* put the fields */
+    for (PCSSMFIELD pCur = paFields;
+         pCur->cb != UINT32_MAX && pCur->off != UINT32_MAX;
+         pCur++)
+    {
+        uint8_t const *pbField = (uint8_t const *)pvStruct + pCur->off;
+        switch ((uintptr_t)pCur->pfnGetPutOrTransformer)
+        {
+            case SSMFIELDTRANS_NO_TRANSFORMATION:
+                rc = ssmR3DataWrite(pSSM, pbField, pCur->cb);
+                break;
+
+            case SSMFIELDTRANS_GCPTR:
+                AssertMsgBreakStmt(pCur->cb == sizeof(RTGCPTR), ("%#x (%s)\n", pCur->cb, pCur->pszName), rc = VERR_SSM_FIELD_INVALID_SIZE);
+                rc = SSMR3PutGCPtr(pSSM, *(PRTGCPTR)pbField);
+                break;
+
+            case SSMFIELDTRANS_GCPHYS:
+                AssertMsgBreakStmt(pCur->cb == sizeof(RTGCPHYS), ("%#x (%s)\n", pCur->cb, pCur->pszName), rc = VERR_SSM_FIELD_INVALID_SIZE);
+                rc = SSMR3PutGCPhys(pSSM, *(PRTGCPHYS)pbField);
+                break;
+
+            case SSMFIELDTRANS_RCPTR:
+                AssertMsgBreakStmt(pCur->cb == sizeof(RTRCPTR), ("%#x (%s)\n", pCur->cb, pCur->pszName), rc = VERR_SSM_FIELD_INVALID_SIZE);
+                rc = SSMR3PutRCPtr(pSSM, *(PRTRCPTR)pbField);
+                break;
+
+            case SSMFIELDTRANS_RCPTR_ARRAY:
+            {
+                uint32_t const cEntries = pCur->cb / sizeof(RTRCPTR);
+                AssertMsgBreakStmt(pCur->cb == cEntries * sizeof(RTRCPTR) && cEntries, ("%#x (%s)\n", pCur->cb, pCur->pszName),
+                                   rc = VERR_SSM_FIELD_INVALID_SIZE);
+                rc = VINF_SUCCESS;
+                for (uint32_t i = 0; i < cEntries && RT_SUCCESS(rc); i++)
+                    rc = SSMR3PutRCPtr(pSSM, ((PRTRCPTR)pbField)[i]);
+                break;
+            }
+
+            default:
+                AssertMsgFailedBreakStmt(("%#x\n", pCur->pfnGetPutOrTransformer), rc = VERR_SSM_FIELD_COMPLEX);
+        }
+        if (RT_FAILURE(rc))
+        {
+            if (RT_SUCCESS(pSSM->rc))
+                pSSM->rc = rc;
+            return rc;
+        }
+    }
+
+    /* end marker */
+    return SSMR3PutU32(pSSM, SSMR3STRUCT_END);
+}
+
+
+/**
+ * SSMR3PutStructEx helper that puts a HCPTR that is used as a NULL indicator.
+ *
+ * @returns VBox status code.
+ *
  * @param   pSSM            The saved state handle.
  * @param   pv              The value to put.
  * @param   fFlags          SSMSTRUCT_FLAGS_XXX.
@@ -4532,9 +5122,11 @@ static int ssmR3SaveDoClose(PVM pVM, PSSMHANDLE pSSM)
     pVM->ssm.s.uPass = 0;
 
     /*
-     * Make it non-cancellable, close the stream and delete the file on failure.
+     * Make it non-cancellable, stop the compression threads, close the stream
+     * and delete the file on failure.
      */
     ssmR3SetCancellable(pVM, pSSM, false);
+    ssmR3ZipPipeDestroy(pSSM);
     int rc = ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
     if (RT_SUCCESS(rc))
         rc = pSSM->rc;
@@ -4574,6 +5166,7 @@ static int ssmR3SaveDoClose(PVM pVM, PSSMHANDLE pSSM)
     pSSM->pVM = NULL;
     pSSM->enmAfter = SSMAFTER_INVALID;
     pSSM->enmOp = SSMSTATE_INVALID;
+    RTStrFree(pSSM->pszBaseFilename);
     RTMemFree(pSSM);
 
     return rc;
@@ -5068,6 +5661,8 @@ static int ssmR3WriteHeaderAndClearPerUnitData(PVM pVM, PSSMHANDLE pSSM)
     FileHdr.fFlags       = SSMFILEHDR_FLAGS_STREAM_CRC32;
     if (pSSM->fLiveSave)
         FileHdr.fFlags  |= SSMFILEHDR_FLAGS_STREAM_LIVE_SAVE;
+    if (pSSM->pszBaseFilename)
+        FileHdr.fFlags  |= SSMFILEHDR_FLAGS_INCREMENTAL;
     FileHdr.cbMaxDecompr = RT_SIZEOFMEMB(SSMHANDLE, u.Read.abDataBuffer);
     FileHdr.u32CRC       = 0;
     FileHdr.u32CRC       = RTCrc32(&FileHdr, sizeof(FileHdr));
@@ -5075,6 +5670,27 @@ static int ssmR3WriteHeaderAndClearPerUnitData(PVM pVM, PSSMHANDLE pSSM)
     if (RT_FAILURE(rc))
         return rc;
 
+    /*
+     * Write the base reference of an incremental save.
+     */
+    if (pSSM->pszBaseFilename)
+    {
+        SSMFILEBASEREF BaseRef;
+        memcpy(&BaseRef.szMagic, SSMFILEBASEREF_MAGIC, sizeof(BaseRef.szMagic));
+        BaseRef.cbBaseFile       = pSSM->u.Write.cbBaseFile;
+        BaseRef.u32BaseStreamCRC = pSSM->u.Write.u32BaseStreamCRC;
+        BaseRef.cbName           = (uint32_t)strlen(pSSM->u.Write.pszBaseRef) + 1;
+        BaseRef.u32Reserved      = 0;
+        BaseRef.u32CRC           = 0;
+        BaseRef.u32CRC           = RTCrc32Finish(RTCrc32Process(RTCrc32Process(RTCrc32Start(), &BaseRef, sizeof(BaseRef)),
+                                                                pSSM->u.Write.pszBaseRef, BaseRef.cbName));
+        rc = ssmR3StrmWrite(&pSSM->Strm, &BaseRef, sizeof(BaseRef));
+        if (RT_SUCCESS(rc))
+            rc = ssmR3StrmWrite(&pSSM->Strm, pSSM->u.Write.pszBaseRef, BaseRef.cbName);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
     /*
      * Clear the per unit flags and offsets.
      */
@@ -5095,6 +5711,8 @@ static int ssmR3WriteHeaderAndClearPerUnitData(PVM pVM, PSSMHANDLE pSSM)
  * @param   pVM                 Pointer to the VM.
  * @param   pszFilename         The name of the file.  NULL if pStreamOps is
  *                              used.
+ * @param   pszBaseFilename     The base file for an incremental save, NULL
+ *                              for a normal one.  Requires pszFilename.
  * @param   pStreamOps          The stream methods.  NULL if pszFilename is
  *                              used.
  * @param   pvStreamOpsUser     The user argument to the stream methods.
@@ -5105,13 +5723,60 @@ static int ssmR3WriteHeaderAndClearPerUnitData(PVM pVM, PSSMHANDLE pSSM)
  *                              handle upon successful return.  Free it using
  *                              RTMemFree after closing the stream.
  */
-static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
+static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, const char *pszBaseFilename,
+                                 PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
                                  SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvProgressUser, PSSMHANDLE *ppSSM)
 {
     PSSMHANDLE pSSM = (PSSMHANDLE)RTMemAllocZ(sizeof(*pSSM));
     if (!pSSM)
         return VERR_NO_MEMORY;
 
+    /*
+     * Check out the base file of an incremental save before creating
+     * anything.  It must be a proper v2 file since we reference it by its
+     * stream CRC.
+     */
+    int rc;
+    if (pszBaseFilename)
+    {
+        rc = VERR_NO_STR_MEMORY;
+        pSSM->pszBaseFilename = ssmR3ResolveBaseFilename(pszFilename, pszBaseFilename);
+        if (pSSM->pszBaseFilename)
+        {
+            PSSMHANDLE pBase = (PSSMHANDLE)RTMemAllocZ(sizeof(*pBase));
+            if (pBase)
+            {
+                rc = ssmR3OpenFile(NULL, pSSM->pszBaseFilename, NULL /*pStreamOps*/, NULL /*pvUser*/, false /*fChecksumIt*/,
+                                   false /*fChecksumOnRead*/, 1 /*cBuffers*/, pBase);
+                if (RT_SUCCESS(rc))
+                {
+                    if (    pBase->u.Read.uFmtVerMajor >= 2
+                        &&  pBase->u.Read.fStreamCrc32
+                        &&  ssmR3StrmIsFile(&pBase->Strm))
+                    {
+                        pSSM->u.Write.cbBaseFile       = pBase->u.Read.cbLoadFile;
+                        pSSM->u.Write.u32BaseStreamCRC = pBase->u.Read.u32LoadCRC;
+                        pSSM->u.Write.pszBaseRef       = pszBaseFilename;
+                    }
+                    else
+                        rc = VERR_SSM_INTEGRITY_VERSION;
+                    ssmR3StrmClose(&pBase->Strm, false /*fCancelled*/);
+                    RTStrFree(pBase->pszBaseFilename);
+                }
+                RTMemFree(pBase);
+            }
+            else
+                rc = VERR_NO_MEMORY;
+        }
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("SSM: Cannot use '%s' as base for an incremental save: %Rrc\n", pszBaseFilename, rc));
+            RTStrFree(pSSM->pszBaseFilename);
+            RTMemFree(pSSM);
+            return rc;
+        }
+    }
+
     pSSM->pVM                       = pVM;
     pSSM->enmOp                     = SSMSTATE_INVALID;
     pSSM->enmAfter                  = enmAfter;
@@ -5135,8 +5800,9 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
     pSSM->pszFilename               = pszFilename;
     pSSM->u.Write.offDataBuffer     = 0;
     pSSM->u.Write.cMsMaxDowntime    = UINT32_MAX;
+    pSSM->u.Write.pZipPipe          = NULL;
+    pSSM->u.Write.fNoCompression    = pStreamOps && (pStreamOps->fFlags & SSMSTRMOPS_FLAGS_NO_COMPRESSION);
 
-    int rc;
     if (pStreamOps)
         rc = ssmR3StrmInit(&pSSM->Strm, pStreamOps, pvStreamOpsUser, true /*fWrite*/, true /*fChecksummed*/, 8 /*cBuffers*/);
     else
@@ -5144,10 +5810,23 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
     if (RT_FAILURE(rc))
     {
         LogRel(("SSM: Failed to create save state file '%s', rc=%Rrc.\n",  pszFilename, rc));
+        RTStrFree(pSSM->pszBaseFilename);
         RTMemFree(pSSM);
         return rc;
     }
 
+    /*
+     * Start the compression threads if configured.  We'll just compress
+     * on EMT if this fails.  Not needed if the stream compresses itself.
+     */
+    if (    pVM->ssm.s.cZipThreads
+        &&  !pSSM->u.Write.fNoCompression)
+    {
+        rc = ssmR3ZipPipeCreate(pSSM, pVM->ssm.s.cZipThreads);
+        if (RT_FAILURE(rc))
+            LogRel(("SSM: Failed to create the compression threads (%u), rc=%Rrc.\n", pVM->ssm.s.cZipThreads, rc));
+    }
+
     *ppSSM = pSSM;
     return VINF_SUCCESS;
 }
@@ -5160,6 +5839,10 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
  *
  * @param   pVM             Pointer to the VM.
  * @param   pszFilename     Name of the file to save the state in. NULL if pStreamOps is used.
+ * @param   pszBaseFilename The saved state file to save relative to (an
+ *                          incremental save), NULL for a normal save.  A
+ *                          relative name is relative to the directory of
+ *                          pszFilename.  Requires pszFilename.
  * @param   pStreamOps      The stream method table. NULL if pszFilename is
  *                          used.
  * @param   pvStreamOpsUser The user argument to the stream methods.
@@ -5169,10 +5852,11 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
  *
  * @thread  EMT
  */
-VMMR3DECL(int) SSMR3Save(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
-                         SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvUser)
+VMMR3DECL(int) SSMR3Save(PVM pVM, const char *pszFilename, const char *pszBaseFilename, PCSSMSTRMOPS pStreamOps,
+                         void *pvStreamOpsUser, SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvUser)
 {
-    LogFlow(("SSMR3Save: pszFilename=%p:{%s} enmAfter=%d pfnProgress=%p pvUser=%p\n", pszFilename, pszFilename, enmAfter, pfnProgress, pvUser));
+    LogFlow(("SSMR3Save: pszFilename=%p:{%s} pszBaseFilename=%p:{%s} enmAfter=%d pfnProgress=%p pvUser=%p\n",
+             pszFilename, pszFilename, pszBaseFilename, pszBaseFilename, enmAfter, pfnProgress, pvUser));
     VM_ASSERT_EMT0(pVM);
 
     /*
@@ -5184,6 +5868,7 @@ VMMR3DECL(int) SSMR3Save(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
                     VERR_INVALID_PARAMETER);
 
     AssertReturn(!pszFilename != !pStreamOps, VERR_INVALID_PARAMETER);
+    AssertReturn(!pszBaseFilename || (pszFilename && *pszBaseFilename), VERR_INVALID_PARAMETER);
     if (pStreamOps)
     {
         AssertReturn(pStreamOps->u32Version == SSMSTRMOPS_VERSION, VERR_INVALID_MAGIC);
@@ -5203,7 +5888,7 @@ VMMR3DECL(int) SSMR3Save(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
      * so we reserve 20% for the 'Done' period.
      */
     PSSMHANDLE pSSM;
-    int rc = ssmR3SaveDoCreateFile(pVM, pszFilename, pStreamOps, pvStreamOpsUser,
+    int rc = ssmR3SaveDoCreateFile(pVM, pszFilename, pszBaseFilename, pStreamOps, pvStreamOpsUser,
                                    enmAfter, pfnProgress, pvUser, &pSSM);
     if (RT_FAILURE(rc))
         return rc;
@@ -5678,6 +6363,9 @@ VMMR3_INT_DECL(int) SSMR3LiveDoStep1(PSSMHANDLE pSSM)
  * @param   pszFilename     Name of the file to save the state in. This string
  *                          must remain valid until SSMR3LiveDone is called.
  *                          Must be NULL if pStreamOps is used.
+ * @param   pszBaseFilename The saved state file to save relative to, NULL for
+ *                          a normal save.  Same lifetime as pszFilename.  See
+ *                          SSMR3Save for details.
  * @param   pStreamOps      The stream method table. NULL if pszFilename is
  *                          used.
  * @param   pvStreamOpsUser The user argument to the stream methods.
@@ -5688,12 +6376,14 @@ VMMR3_INT_DECL(int) SSMR3LiveDoStep1(PSSMHANDLE pSSM)
  * @thread  EMT0
  */
 VMMR3_INT_DECL(int) SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
-                                  const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
+                                  const char *pszFilename, const char *pszBaseFilename,
+                                  PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
                                   SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvProgressUser,
                                   PSSMHANDLE *ppSSM)
 {
-    LogFlow(("SSMR3LiveSave: cMsMaxDowntime=%u pszFilename=%p:{%s} pStreamOps=%p pvStreamOpsUser=%p enmAfter=%d pfnProgress=%p pvProgressUser=%p\n",
-             cMsMaxDowntime, pszFilename, pszFilename, pStreamOps, pvStreamOpsUser, enmAfter, pfnProgress, pvProgressUser));
+    LogFlow(("SSMR3LiveSave: cMsMaxDowntime=%u pszFilename=%p:{%s} pszBaseFilename=%p:{%s} pStreamOps=%p pvStreamOpsUser=%p enmAfter=%d pfnProgress=%p pvProgressUser=%p\n",
+             cMsMaxDowntime, pszFilename, pszFilename, pszBaseFilename, pszBaseFilename, pStreamOps, pvStreamOpsUser, enmAfter,
+             pfnProgress, pvProgressUser));
     VM_ASSERT_EMT0(pVM);
 
     /*
@@ -5705,6 +6395,7 @@ VMMR3_INT_DECL(int) SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
                     ("%d\n", enmAfter),
                     VERR_INVALID_PARAMETER);
     AssertReturn(!pszFilename != !pStreamOps, VERR_INVALID_PARAMETER);
+    AssertReturn(!pszBaseFilename || (pszFilename && *pszBaseFilename), VERR_INVALID_PARAMETER);
     if (pStreamOps)
     {
         AssertReturn(pStreamOps->u32Version == SSMSTRMOPS_VERSION, VERR_INVALID_MAGIC);
@@ -5724,7 +6415,7 @@ VMMR3_INT_DECL(int) SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
      * so we reserve 20% for the 'Done' period.
      */
     PSSMHANDLE pSSM;
-    int rc = ssmR3SaveDoCreateFile(pVM, pszFilename, pStreamOps, pvStreamOpsUser,
+    int rc = ssmR3SaveDoCreateFile(pVM, pszFilename, pszBaseFilename, pStreamOps, pvStreamOpsUser,
                                    enmAfter, pfnProgress, pvProgressUser, &pSSM);
     if (RT_FAILURE(rc))
         return rc;
@@ -5753,6 +6444,7 @@ VMMR3_INT_DECL(int) SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
     }
     /* bail out. */
     int rc2 = ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
+    RTStrFree(pSSM->pszBaseFilename);
     RTMemFree(pSSM);
     rc2 = RTFileDelete(pszFilename);
     AssertRC(rc2);
@@ -7493,6 +8185,251 @@ VMMR3DECL(int) SSMR3SkipToEndOfUnit(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Skips a page sized data item, returning where to find it in the file so it
+ * can be read later using SSMR3PageReaderRead.
+ *
+ * This is for lazily restoring guest RAM.  The item must have been written
+ * using a single SSMR3PutMem call with nothing else pending in the data
+ * buffer, so it ends up in a record of its own.  The record bits still pass
+ * thru the stream so the stream CRC is verified as usual, it's just not
+ * decompressed nor copied anywhere.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if the item cannot be deferred.  The handle is
+ *          then left in a state where the item can be read by SSMR3GetMem.
+ *
+ * @param   pSSM            The saved state handle.
+ * @param   poffPage        Where to return the file offset of the record.
+ * @param   pfZero          Where to return whether the page is all zeros, in
+ *                          which case there is nothing to read later.
+ */
+VMMR3DECL(int) SSMR3SkipPageDeferred(PSSMHANDLE pSSM, uint64_t *poffPage, bool *pfZero)
+{
+    SSM_ASSERT_READABLE_RET(pSSM);
+    SSM_CHECK_CANCELLED_RET(pSSM);
+    *poffPage = UINT64_MAX;
+    *pfZero   = false;
+
+    /*
+     * We must be at a record boundary in a file stream with nothing buffered.
+     */
+    if (RT_FAILURE(pSSM->rc))
+        return pSSM->rc;
+    if (    pSSM->u.Read.uFmtVerMajor < 2
+        ||  !ssmR3StrmIsFile(&pSSM->Strm)
+        ||  pSSM->u.Read.fEndOfData
+        ||  pSSM->u.Read.cbRecLeft != 0
+        ||  pSSM->u.Read.offDataBuffer != pSSM->u.Read.cbDataBuffer)
+        return VERR_NOT_SUPPORTED;
+
+    uint64_t const offRec = ssmR3StrmTell(&pSSM->Strm);
+    int rc = ssmR3DataReadRecHdrV2(pSSM);
+    if (RT_FAILURE(rc))
+        return pSSM->rc = rc;
+    AssertLogRelMsgReturn(!pSSM->u.Read.fEndOfData, ("offRec=%#llx\n", offRec), pSSM->rc = VERR_SSM_LOADED_TOO_MUCH);
+    pSSM->u.Read.cbDataBuffer  = 0;
+    pSSM->u.Read.offDataBuffer = 0;
+
+    uint32_t cbRec;
+    switch (pSSM->u.Read.u8TypeAndFlags & SSM_REC_TYPE_MASK)
+    {
+        case SSM_REC_TYPE_RAW:
+            if (pSSM->u.Read.cbRecLeft != PAGE_SIZE)
+                return VERR_NOT_SUPPORTED;
+            cbRec = PAGE_SIZE;
+            break;
+
+        case SSM_REC_TYPE_RAW_LZF:
+        {
+            uint32_t cbDecompr;
+            rc = ssmR3DataReadV2RawLzfHdr(pSSM, &cbDecompr);
+            if (RT_FAILURE(rc))
+                return rc;
+            if (cbDecompr != PAGE_SIZE)
+            {
+                /* Unexpected block size, hand it to SSMR3GetMem via the data buffer. */
+                rc = ssmR3DataReadV2RawLzf(pSSM, &pSSM->u.Read.abDataBuffer[0], cbDecompr);
+                if (RT_FAILURE(rc))
+                    return rc;
+                pSSM->u.Read.cbDataBuffer = cbDecompr;
+                return VERR_NOT_SUPPORTED;
+            }
+            cbRec = pSSM->u.Read.cbRecLeft;
+            break;
+        }
+
+        case SSM_REC_TYPE_RAW_ZERO:
+        {
+            uint32_t cbZero;
+            rc = ssmR3DataReadV2RawZeroHdr(pSSM, &cbZero);
+            if (RT_FAILURE(rc))
+                return rc;
+            if (cbZero != PAGE_SIZE)
+            {
+                memset(&pSSM->u.Read.abDataBuffer[0], 0, cbZero);
+                pSSM->u.Read.cbDataBuffer = cbZero;
+                return VERR_NOT_SUPPORTED;
+            }
+            pSSM->offUnitUser += PAGE_SIZE;
+            *pfZero = true;
+            return VINF_SUCCESS;
+        }
+
+        default:
+            AssertMsgFailedReturn(("%x\n", pSSM->u.Read.u8TypeAndFlags), pSSM->rc = VERR_SSM_BAD_REC_TYPE);
+    }
+
+    /*
+     * Skip the record data.
+     */
+    if (ssmR3StrmReadDirect(&pSSM->Strm, cbRec))
+    {
+        pSSM->offUnit += cbRec;
+        ssmR3ProgressByByte(pSSM, cbRec);
+    }
+    else
+    {
+        AssertCompile(sizeof(pSSM->u.Read.abComprBuffer) >= PAGE_SIZE);
+        rc = ssmR3DataReadV2Raw(pSSM, &pSSM->u.Read.abComprBuffer[0], cbRec);
+        if (RT_FAILURE(rc))
+            return pSSM->rc = rc;
+    }
+    pSSM->u.Read.cbRecLeft = 0;
+    pSSM->offUnitUser += PAGE_SIZE;
+    *poffPage = offRec;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Opens a reader for pages skipped by SSMR3SkipPageDeferred.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if the saved state isn't a file.
+ *
+ * @param   pSSM            The saved state handle.
+ * @param   ppReader        Where to return the reader.
+ */
+VMMR3DECL(int) SSMR3PageReaderOpen(PSSMHANDLE pSSM, PSSMPAGEREADER *ppReader)
+{
+    SSM_ASSERT_READABLE_RET(pSSM);
+    AssertPtrReturn(ppReader, VERR_INVALID_POINTER);
+    *ppReader = NULL;
+    if (    !pSSM->pszFilename
+        ||  !ssmR3StrmIsFile(&pSSM->Strm)
+        ||  pSSM->u.Read.uFmtVerMajor < 2)
+        return VERR_NOT_SUPPORTED;
+
+    PSSMPAGEREADER pReader = (PSSMPAGEREADER)RTMemAllocZ(sizeof(*pReader));
+    if (!pReader)
+        return VERR_NO_MEMORY;
+
+    /* Don't prevent the owner from deleting the file while we're still reading it. */
+    int rc = RTFileOpen(&pReader->hFile, pSSM->pszFilename,
+                        RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_WRITE | RTFILE_O_DENY_NOT_DELETE);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTFileGetSize(pReader->hFile, &pReader->cbFile);
+        if (RT_SUCCESS(rc))
+        {
+            *ppReader = pReader;
+            return VINF_SUCCESS;
+        }
+        RTFileClose(pReader->hFile);
+    }
+    RTMemFree(pReader);
+    return rc;
+}
+
+
+/**
+ * Reads a page skipped by SSMR3SkipPageDeferred.
+ *
+ * @returns VBox status code.
+ * @param   pReader         The page reader.
+ * @param   offPage         The offset returned by SSMR3SkipPageDeferred.
+ * @param   pvPage          Where to return the page.
+ *
+ * @thread  Any.
+ */
+VMMR3DECL(int) SSMR3PageReaderRead(PSSMPAGEREADER pReader, uint64_t offPage, void *pvPage)
+{
+    AssertPtrReturn(pReader, VERR_INVALID_POINTER);
+    AssertReturn(offPage < pReader->cbFile, VERR_OUT_OF_RANGE);
+
+    /*
+     * Read the record in one go.  The header is at most 1+3 bytes as the
+     * record is no bigger than a page.
+     */
+    uint8_t abRec[1 + 3 + 1 + PAGE_SIZE];
+    size_t  cbRead = (size_t)RT_MIN(sizeof(abRec), pReader->cbFile - offPage);
+    int rc = RTFileReadAt(pReader->hFile, offPage, abRec, cbRead, NULL);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint32_t cbRec;
+    uint32_t offData;
+    if (!(abRec[1] & 0x80))
+    {
+        cbRec   = abRec[1];
+        offData = 2;
+    }
+    else if ((abRec[1] & 0xe0) == 0xc0 && (abRec[2] & 0xc0) == 0x80)
+    {
+        cbRec   = ((uint32_t)(abRec[1] & 0x1f) << 6) | (abRec[2] & 0x3f);
+        offData = 3;
+    }
+    else if ((abRec[1] & 0xf0) == 0xe0 && (abRec[2] & 0xc0) == 0x80 && (abRec[3] & 0xc0) == 0x80)
+    {
+        cbRec   = ((uint32_t)(abRec[1] & 0x0f) << 12) | ((uint32_t)(abRec[2] & 0x3f) << 6) | (abRec[3] & 0x3f);
+        offData = 4;
+    }
+    else
+        AssertLogRelMsgFailedReturn(("off=%#llx %.4Rhxs\n", offPage, abRec), VERR_SSM_INTEGRITY_REC_HDR);
+    AssertLogRelMsgReturn(offData + cbRec <= cbRead, ("off=%#llx cbRec=%#x\n", offPage, cbRec), VERR_SSM_INTEGRITY_REC_HDR);
+
+    switch (abRec[0] & SSM_REC_TYPE_MASK)
+    {
+        case SSM_REC_TYPE_RAW:
+            AssertLogRelMsgReturn(cbRec == PAGE_SIZE, ("off=%#llx cbRec=%#x\n", offPage, cbRec), VERR_SSM_INTEGRITY_REC_HDR);
+            memcpy(pvPage, &abRec[offData], PAGE_SIZE);
+            return VINF_SUCCESS;
+
+        case SSM_REC_TYPE_RAW_LZF:
+        {
+            AssertLogRelMsgReturn(cbRec > 1 && abRec[offData] == PAGE_SIZE / _1K, ("off=%#llx cbRec=%#x\n", offPage, cbRec),
+                                  VERR_SSM_INTEGRITY_DECOMPRESSION);
+            size_t cbDstActual;
+            rc = RTZipBlockDecompress(RTZIPTYPE_LZF, 0 /*fFlags*/,
+                                      &abRec[offData + 1], cbRec - 1, NULL /*pcbSrcActual*/,
+                                      pvPage, PAGE_SIZE, &cbDstActual);
+            AssertLogRelMsgReturn(RT_SUCCESS(rc) && cbDstActual == PAGE_SIZE, ("off=%#llx rc=%Rrc\n", offPage, rc),
+                                  VERR_SSM_INTEGRITY_DECOMPRESSION);
+            return VINF_SUCCESS;
+        }
+
+        default:
+            AssertLogRelMsgFailedReturn(("off=%#llx %#x\n", offPage, abRec[0]), VERR_SSM_BAD_REC_TYPE);
+    }
+}
+
+
+/**
+ * Closes a page reader.
+ *
+ * @param   pReader         The page reader.  NULL is ignored.
+ */
+VMMR3DECL(void) SSMR3PageReaderClose(PSSMPAGEREADER pReader)
+{
+    if (pReader)
+    {
+        RTFileClose(pReader->hFile);
+        RTMemFree(pReader);
+    }
+}
+
+
 /**
  * Calculate the checksum of a file portion.
  *
@@ -7660,11 +8597,71 @@ static int ssmR3ValidateHeaderInfo(PSSMHANDLE pSSM, bool fHaveHostBits, bool fHa
     if (    pSSM->u.Read.cbGCPtr != sizeof(uint32_t)
         &&  pSSM->u.Read.cbGCPtr != sizeof(uint64_t))
     {
-        LogRel(("SSM: Incorrect cbGCPtr value: %d\n", pSSM->u.Read.cbGCPtr));
-        return VERR_SSM_INTEGRITY_HEADER;
+        LogRel(("SSM: Incorrect cbGCPtr value: %d\n", pSSM->u.Read.cbGCPtr));
+        return VERR_SSM_INTEGRITY_HEADER;
+    }
+
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads the base reference following the header of an incremental file.
+ *
+ * @returns VBox status code.
+ * @param   pSSM                The saved state handle.  On success
+ *                              SSMHANDLE::pszBaseFilename is set to the
+ *                              resolved base file name.
+ */
+static int ssmR3ReadBaseRef(PSSMHANDLE pSSM)
+{
+    SSMFILEBASEREF BaseRef;
+    int rc = ssmR3StrmRead(&pSSM->Strm, &BaseRef, sizeof(BaseRef));
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("SSM: Failed to read the base reference. rc=%Rrc\n", rc));
+        return rc;
+    }
+    if (    memcmp(BaseRef.szMagic, SSMFILEBASEREF_MAGIC, sizeof(BaseRef.szMagic))
+        ||  BaseRef.cbName < 2
+        ||  BaseRef.cbName > RTPATH_MAX
+        ||  BaseRef.u32Reserved)
+    {
+        LogRel(("SSM: Invalid base reference: %.*Rhxs\n", sizeof(BaseRef), &BaseRef));
+        return VERR_SSM_INTEGRITY;
     }
 
-    return VINF_SUCCESS;
+    char *pszBaseRef = (char *)RTMemTmpAlloc(BaseRef.cbName);
+    if (!pszBaseRef)
+        return VERR_NO_TMP_MEMORY;
+    rc = ssmR3StrmRead(&pSSM->Strm, pszBaseRef, BaseRef.cbName);
+    if (RT_SUCCESS(rc))
+    {
+        uint32_t const u32CRC = BaseRef.u32CRC;
+        BaseRef.u32CRC = 0;
+        uint32_t const u32ActualCRC = RTCrc32Finish(RTCrc32Process(RTCrc32Process(RTCrc32Start(), &BaseRef, sizeof(BaseRef)),
+                                                                   pszBaseRef, BaseRef.cbName));
+        if (u32CRC != u32ActualCRC)
+        {
+            LogRel(("SSM: Base reference CRC mismatch: %08x, correct is %08x\n", u32CRC, u32ActualCRC));
+            rc = VERR_SSM_INTEGRITY_CRC;
+        }
+        else if (pszBaseRef[BaseRef.cbName - 1] || RTStrValidateEncoding(pszBaseRef) != VINF_SUCCESS)
+        {
+            LogRel(("SSM: Malformed base reference name\n"));
+            rc = VERR_SSM_INTEGRITY;
+        }
+        else
+        {
+            pSSM->u.Read.cbBaseFile       = BaseRef.cbBaseFile;
+            pSSM->u.Read.u32BaseStreamCRC = BaseRef.u32BaseStreamCRC;
+            pSSM->pszBaseFilename = ssmR3ResolveBaseFilename(pSSM->pszFilename, pszBaseRef);
+            if (!pSSM->pszBaseFilename)
+                rc = VERR_NO_STR_MEMORY;
+        }
+    }
+    RTMemTmpFree(pszBaseRef);
+    return rc;
 }
 
 
@@ -7758,7 +8755,7 @@ static int ssmR3HeaderAndValidate(PSSMHANDLE pSSM, bool fChecksumIt, bool fCheck
                 LogRel(("SSM: Reserved header field isn't zero: %02x\n", uHdr.v2_0.u8Reserved));
                 return VERR_SSM_INTEGRITY;
             }
-            if (uHdr.v2_0.fFlags & ~(SSMFILEHDR_FLAGS_STREAM_CRC32 | SSMFILEHDR_FLAGS_STREAM_LIVE_SAVE))
+            if (uHdr.v2_0.fFlags & ~(SSMFILEHDR_FLAGS_STREAM_CRC32 | SSMFILEHDR_FLAGS_STREAM_LIVE_SAVE | SSMFILEHDR_FLAGS_INCREMENTAL))
             {
                 LogRel(("SSM: Unknown header flags: %08x\n", uHdr.v2_0.fFlags));
                 return VERR_SSM_INTEGRITY;
@@ -7781,6 +8778,7 @@ static int ssmR3HeaderAndValidate(PSSMHANDLE pSSM, bool fChecksumIt, bool fCheck
             pSSM->u.Read.cbGCPtr        = uHdr.v2_0.cbGCPtr;
             pSSM->u.Read.fFixedGCPtrSize= true;
             pSSM->u.Read.fStreamCrc32   = !!(uHdr.v2_0.fFlags & SSMFILEHDR_FLAGS_STREAM_CRC32);
+            pSSM->u.Read.cUnits         = uHdr.v2_0.cUnits;
             pSSM->fLiveSave             = !!(uHdr.v2_0.fFlags & SSMFILEHDR_FLAGS_STREAM_LIVE_SAVE);
         }
         else
@@ -7788,6 +8786,16 @@ static int ssmR3HeaderAndValidate(PSSMHANDLE pSSM, bool fChecksumIt, bool fCheck
         if (!pSSM->u.Read.fStreamCrc32)
             ssmR3StrmDisableChecksumming(&pSSM->Strm);
 
+        /*
+         * Read the base reference of an incremental file.
+         */
+        if (uHdr.v2_0.fFlags & SSMFILEHDR_FLAGS_INCREMENTAL)
+        {
+            rc = ssmR3ReadBaseRef(pSSM);
+            if (RT_FAILURE(rc))
+                return rc;
+        }
+
         /*
          * Read and validate the footer if it's a file.
          */
@@ -7986,6 +8994,7 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     pSSM->uPercentDone          = 2;
     pSSM->uReportedLivePercent  = 0;
     pSSM->pszFilename           = pszFilename;
+    pSSM->pszBaseFilename       = NULL;
 
     pSSM->u.Read.pZipDecompV1   = NULL;
     pSSM->u.Read.uFmtVerMajor   = UINT32_MAX;
@@ -8002,6 +9011,9 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     pSSM->u.Read.u32SvnRev      = UINT32_MAX;
     pSSM->u.Read.cHostBits      = UINT8_MAX;
     pSSM->u.Read.cbLoadFile     = UINT64_MAX;
+    pSSM->u.Read.cUnits         = 0;
+    pSSM->u.Read.u32BaseStreamCRC = 0;
+    pSSM->u.Read.cbBaseFile     = 0;
 
     pSSM->u.Read.cbRecLeft      = 0;
     pSSM->u.Read.cbDataBuffer   = 0;
@@ -8030,6 +9042,8 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
 
         /* failure path */
         ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
+        RTStrFree(pSSM->pszBaseFilename);
+        pSSM->pszBaseFilename = NULL;
     }
     else
         Log(("SSM: Failed to open save state file '%s', rc=%Rrc.\n",  pszFilename, rc));
@@ -8576,12 +9590,87 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
         AssertReturn(pStreamOps->pfnClose, VERR_INVALID_PARAMETER);
     }
 
+    return ssmR3LoadDoIt(pVM, pszFilename, pStreamOps, pvStreamOpsUser, enmAfter, pfnProgress, pvProgressUser,
+                         NULL /*pTop*/, 0 /*cDepth*/);
+}
+
+
+/**
+ * Checks that a base file is the one the incremental file was saved relative
+ * to and loads the base of the given file if it has one.
+ *
+ * @returns VBox status code.
+ * @param   pVM             Pointer to the VM.
+ * @param   pSSM            The handle of the file being loaded.
+ * @param   pTop            The handle of the incremental file @a pSSM is the
+ *                          base of, NULL if @a pSSM isn't a base.
+ * @param   enmAfter        What is planned after a successful load operation.
+ * @param   cDepth          The number of incremental files above @a pSSM.
+ */
+static int ssmR3LoadBase(PVM pVM, PSSMHANDLE pSSM, PSSMHANDLE pTop, SSMAFTER enmAfter, unsigned cDepth)
+{
+    if (    pTop
+        &&  (   pSSM->u.Read.cbLoadFile != pTop->u.Read.cbBaseFile
+             || pSSM->u.Read.u32LoadCRC != pTop->u.Read.u32BaseStreamCRC))
+    {
+        LogRel(("SSM: The base file '%s' has changed since '%s' was saved (%#llx/%08x, expected %#llx/%08x)\n",
+                pSSM->pszFilename, pTop->pszFilename, pSSM->u.Read.cbLoadFile, pSSM->u.Read.u32LoadCRC,
+                pTop->u.Read.cbBaseFile, pTop->u.Read.u32BaseStreamCRC));
+        return VMSetError(pVM, VERR_SSM_BASE_MISMATCH, RT_SRC_POS,
+                          N_("The base saved state '%s' does not match the one '%s' was saved relative to"),
+                          pSSM->pszFilename, pTop->pszFilename);
+    }
+
+    if (!pSSM->pszBaseFilename)
+        return VINF_SUCCESS;
+    if (cDepth + 1 >= SSM_MAX_BASE_DEPTH)
+        return VMSetError(pVM, VERR_SSM_BASE_TOO_DEEP, RT_SRC_POS,
+                          N_("Too many incremental saved states on top of each other, flatten them"));
+
+    LogRel(("SSM: '%s' is incremental, loading the base '%s' first\n",
+            pSSM->pszFilename ? pSSM->pszFilename : "<stream>", pSSM->pszBaseFilename));
+    return ssmR3LoadDoIt(pVM, pSSM->pszBaseFilename, NULL /*pStreamOps*/, NULL /*pvStreamOpsUser*/, enmAfter,
+                         NULL /*pfnProgress*/, NULL /*pvProgressUser*/, pSSM, cDepth + 1);
+}
+
+
+/**
+ * Worker for SSMR3Load that also takes care of loading base files.
+ *
+ * @returns VBox status.
+ * @param   pVM             Pointer to the VM.
+ * @param   pszFilename     The name of the saved state file. NULL if pStreamOps
+ *                          is used.
+ * @param   pStreamOps      The stream method table. NULL if pszFilename is
+ *                          used.
+ * @param   pvStreamOpsUser The user argument for the stream methods.
+ * @param   enmAfter        What is planned after a successful load operation.
+ * @param   pfnProgress     Progress callback. Optional.
+ * @param   pvProgressUser  User argument for the progress callback.
+ * @param   pTop            The handle of the incremental file this is the
+ *                          base of, NULL if not loading a base.
+ * @param   cDepth          The number of incremental files above this one.
+ */
+static int ssmR3LoadDoIt(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
+                         SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvProgressUser, PSSMHANDLE pTop, unsigned cDepth)
+{
     /*
      * Create the handle and open the file.
      */
     SSMHANDLE Handle;
     int rc = ssmR3OpenFile(pVM, pszFilename, pStreamOps, pvStreamOpsUser, false /* fChecksumIt */,
                            true /* fChecksumOnRead */, 8 /*cBuffers*/, &Handle);
+    if (    RT_SUCCESS(rc)
+        &&  (pTop || Handle.pszBaseFilename))
+    {
+        /* The base must be completely loaded before we start on this file. */
+        rc = ssmR3LoadBase(pVM, &Handle, pTop, enmAfter, cDepth);
+        if (RT_FAILURE(rc))
+        {
+            ssmR3StrmClose(&Handle.Strm, false /*fCancelled*/);
+            RTStrFree(Handle.pszBaseFilename);
+        }
+    }
     if (RT_SUCCESS(rc))
     {
         ssmR3StrmStartIoThread(&Handle.Strm);
@@ -8746,6 +9835,7 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
 
         ssmR3SetCancellable(pVM, &Handle, false);
         ssmR3StrmClose(&Handle.Strm, Handle.rc == VERR_SSM_CANCELLED);
+        RTStrFree(Handle.pszBaseFilename);
         rc = Handle.rc;
     }
 
@@ -8889,7 +9979,10 @@ VMMR3DECL(int) SSMR3ValidateFile(const char *pszFilename, bool fChecksumIt)
     int rc = ssmR3OpenFile(NULL, pszFilename, NULL /*pStreamOps*/, NULL /*pvUser*/, fChecksumIt,
                            false /*fChecksumOnRead*/, 1 /*cBuffers*/, &Handle);
     if (RT_SUCCESS(rc))
+    {
         ssmR3StrmClose(&Handle.Strm, false /*fCancelled*/);
+        RTStrFree(Handle.pszBaseFilename);
+    }
     else
         Log(("SSM: Failed to open saved state file '%s', rc=%Rrc.\n",  pszFilename, rc));
     return rc;
@@ -8975,6 +10068,7 @@ VMMR3DECL(int) SSMR3Close(PSSMHANDLE pSSM)
         RTZipDecompDestroy(pSSM->u.Read.pZipDecompV1);
         pSSM->u.Read.pZipDecompV1 = NULL;
     }
+    RTStrFree(pSSM->pszBaseFilename);
     RTMemFree(pSSM);
     return rc;
 }
@@ -9308,6 +10402,23 @@ VMMR3DECL(bool) SSMR3HandleIsLiveSave(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Gets the base file of an incremental save or load operation.
+ *
+ * Units which only save what differs from the base use this to find it when
+ * saving, and to tell that they are loading on top of the base state when
+ * loading.
+ *
+ * @returns The base file name (resolved), NULL if not incremental.
+ * @param   pSSM            The saved state handle.
+ */
+VMMR3DECL(const char *) SSMR3HandleBaseFilename(PSSMHANDLE pSSM)
+{
+    SSM_ASSERT_VALID_HANDLE(pSSM);
+    return pSSM->pszBaseFilename;
+}
+
+
 /**
  * Gets the maximum downtime for a live operation.
  *
@@ -9461,5 +10572,471 @@ VMMR3DECL(int) SSMR3Cancel(PUVM pUVM)
     RTCritSectLeave(&pVM->ssm.s.CancelCritSect);
     return rc;
 }
+
+
+/** The units whose data in an incremental saved state is relative to the
+ * base.  SSMR3Flatten replays the executions of these from the base files
+ * ahead of the ones in the incremental file. */
+static const char * const g_apszSsmIncrementalUnits[] =
+{
+    "pgm",
+};
+
+
+/**
+ * Checks if the unit is listed in g_apszSsmIncrementalUnits.
+ *
+ * @returns true if it is, false if not.
+ * @param   pszName         The unit name.
+ */
+static bool ssmR3FlattenIsIncrementalUnit(const char *pszName)
+{
+    for (unsigned i = 0; i < RT_ELEMENTS(g_apszSsmIncrementalUnits); i++)
+        if (!strcmp(pszName, g_apszSsmIncrementalUnits[i]))
+            return true;
+    return false;
+}
+
+
+/**
+ * Reads and validates the next unit header of a saved state opened by
+ * SSMR3Open.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   pUnitHdr        Where to return the header.  The name is
+ *                          terminated.
+ * @param   pfEnd           Where to return whether this is the end unit.
+ */
+static int ssmR3FlattenReadUnitHdr(PSSMHANDLE pSSM, PSSMFILEUNITHDRV2 pUnitHdr, bool *pfEnd)
+{
+    uint64_t const offUnit         = ssmR3StrmTell(&pSSM->Strm);
+    uint32_t const u32CurStreamCRC = ssmR3StrmCurCRC(&pSSM->Strm);
+    int rc = ssmR3StrmRead(&pSSM->Strm, pUnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName));
+    if (RT_FAILURE(rc))
+        return rc;
+    bool const fEnd = !memcmp(&pUnitHdr->szMagic[0], SSMFILEUNITHDR_END, sizeof(pUnitHdr->szMagic));
+    AssertLogRelMsgReturn(fEnd || !memcmp(&pUnitHdr->szMagic[0], SSMFILEUNITHDR_MAGIC, sizeof(pUnitHdr->szMagic)),
+                          ("Unit at %#llx (%lld): Invalid unit magic: %.*Rhxs!\n",
+                           offUnit, offUnit, sizeof(pUnitHdr->szMagic) - 1, &pUnitHdr->szMagic[0]),
+                          VERR_SSM_INTEGRITY_UNIT_MAGIC);
+    if (pUnitHdr->cbName)
+    {
+        AssertLogRelMsgReturn(pUnitHdr->cbName <= sizeof(pUnitHdr->szName),
+                              ("Unit at %#llx (%lld): UnitHdr.cbName=%u > %u\n",
+                               offUnit, offUnit, pUnitHdr->cbName, sizeof(pUnitHdr->szName)),
+                              VERR_SSM_INTEGRITY_UNIT);
+        rc = ssmR3StrmRead(&pSSM->Strm, &pUnitHdr->szName[0], pUnitHdr->cbName);
+        if (RT_FAILURE(rc))
+            return rc;
+        AssertLogRelMsgReturn(!pUnitHdr->szName[pUnitHdr->cbName - 1],
+                              ("Unit at %#llx (%lld): Name %.*Rhxs was not properly terminated.\n",
+                               offUnit, offUnit, pUnitHdr->cbName, pUnitHdr->szName),
+                              VERR_SSM_INTEGRITY_UNIT);
+    }
+    SSM_CHECK_CRC32_RET(pUnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[pUnitHdr->cbName]),
+                        ("Unit at %#llx (%lld): CRC mismatch: %08x, correct is %08x\n", offUnit, offUnit, u32CRC, u32ActualCRC));
+    AssertLogRelMsgReturn(   pUnitHdr->offStream == offUnit
+                          && (pUnitHdr->u32CurStreamCRC == u32CurStreamCRC || !pSSM->Strm.fChecksummed)
+                          && !pUnitHdr->fFlags
+                          && (fEnd ? pUnitHdr->cbName == 0 : pUnitHdr->cbName > 1),
+                          ("Unit at %#llx (%lld): Malformed unit header\n", offUnit, offUnit),
+                          VERR_SSM_INTEGRITY_UNIT);
+    *pfEnd = fEnd;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Copies one data unit execution from a saved state to the flattened one.
+ *
+ * The data is decoded and encoded again since the stream CRC in the
+ * termination record and the compression depend on the position in the
+ * output stream.
+ *
+ * @returns VBox status code.
+ * @param   pOut            The output handle.
+ * @param   pIn             The input handle, positioned right after the unit
+ *                          header.
+ * @param   pInHdr          The unit header read from the input.
+ * @param   ppDir           Pointer to the directory being built.  Will be
+ *                          reallocated as needed.
+ */
+static int ssmR3FlattenCopyUnit(PSSMHANDLE pOut, PSSMHANDLE pIn, SSMFILEUNITHDRV2 const *pInHdr, PSSMFILEDIR *ppDir)
+{
+    /*
+     * The unit header.
+     */
+    SSMFILEUNITHDRV2 UnitHdr;
+    memcpy(&UnitHdr, pInHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[pInHdr->cbName]));
+    UnitHdr.offStream       = ssmR3StrmTell(&pOut->Strm);
+    UnitHdr.u32CurStreamCRC = ssmR3StrmCurCRC(&pOut->Strm);
+    UnitHdr.u32CRC          = 0;
+    UnitHdr.u32CRC          = RTCrc32(&UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]));
+    Log(("SSM: Unit at %#9llx: '%s', instance %u, pass %#x, version %u (flatten)\n",
+         UnitHdr.offStream, UnitHdr.szName, UnitHdr.u32Instance, UnitHdr.u32Pass, UnitHdr.u32Version));
+    int rc = ssmR3StrmWrite(&pOut->Strm, &UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]));
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /*
+     * Record it in the directory, the last execution of a unit wins.
+     */
+    PSSMFILEDIR pDir       = *ppDir;
+    uint32_t    u32NameCRC = RTCrc32(UnitHdr.szName, UnitHdr.cbName - 1);
+    uint32_t    i          = 0;
+    while (   i < pDir->cEntries
+           && (   pDir->aEntries[i].u32NameCRC  != u32NameCRC
+               || pDir->aEntries[i].u32Instance != UnitHdr.u32Instance))
+        i++;
+    if (i == pDir->cEntries)
+    {
+        if (!(i % 32))
+        {
+            pDir = (PSSMFILEDIR)RTMemRealloc(pDir, RT_OFFSETOF(SSMFILEDIR, aEntries[i + 32]));
+            if (!pDir)
+                return VERR_NO_MEMORY;
+            *ppDir = pDir;
+        }
+        pDir->aEntries[i].u32NameCRC  = u32NameCRC;
+        pDir->aEntries[i].u32Instance = UnitHdr.u32Instance;
+        pDir->cEntries++;
+    }
+    pDir->aEntries[i].off = UnitHdr.offStream;
+
+    /*
+     * Copy the data a record at the time.
+     */
+    ssmR3DataReadBeginV2(pIn);
+    ssmR3DataWriteBegin(pOut);
+    for (;;)
+    {
+        uint32_t const cbBuffered = pIn->u.Read.cbDataBuffer - pIn->u.Read.offDataBuffer;
+        if (cbBuffered)
+        {
+            rc = SSMR3PutMem(pOut, &pIn->u.Read.abDataBuffer[pIn->u.Read.offDataBuffer], cbBuffered);
+            pIn->u.Read.offDataBuffer = pIn->u.Read.cbDataBuffer;
+            pIn->offUnitUser         += cbBuffered;
+        }
+        else
+        {
+            if (!pIn->u.Read.cbRecLeft)
+            {
+                rc = ssmR3DataReadRecHdrV2(pIn);
+                if (RT_FAILURE(rc) || pIn->u.Read.fEndOfData)
+                    break;
+                if (!pIn->u.Read.cbRecLeft)
+                    continue; /* empty record */
+            }
+
+            /* Have the next record decoded into the data buffer. */
+            uint8_t b;
+            rc = ssmR3DataReadBufferedV2(pIn, &b, sizeof(b));
+            if (RT_SUCCESS(rc))
+                rc = SSMR3PutU8(pOut, b);
+        }
+        if (RT_FAILURE(rc))
+            break;
+    }
+    if (RT_SUCCESS(rc))
+        rc = ssmR3DataReadFinishV2(pIn);
+    if (RT_SUCCESS(rc))
+        rc = ssmR3DataFlushBuffer(pOut);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /*
+     * Write the termination record and flush the compression stream.
+     */
+    SSMRECTERM TermRec;
+    TermRec.u8TypeAndFlags   = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_TERM;
+    TermRec.cbRec            = sizeof(TermRec) - 2;
+    TermRec.fFlags           = SSMRECTERM_FLAGS_CRC32;
+    TermRec.u32StreamCRC     = RTCrc32Finish(RTCrc32Process(ssmR3StrmCurCRC(&pOut->Strm), &TermRec, 2));
+    TermRec.cbUnit           = pOut->offUnit + sizeof(TermRec);
+    rc = ssmR3DataWriteRaw(pOut, &TermRec, sizeof(TermRec));
+    if (RT_SUCCESS(rc))
+        rc = ssmR3DataWriteFinish(pOut);
+    pIn->offUnit  = UINT64_MAX;
+    pOut->offUnit = UINT64_MAX;
+    return rc;
+}
+
+
+/**
+ * Skips the data of a unit execution in a saved state opened by SSMR3Open.
+ *
+ * @returns VBox status code.
+ * @param   pIn             The input handle, positioned right after the unit
+ *                          header.
+ */
+static int ssmR3FlattenSkipUnit(PSSMHANDLE pIn)
+{
+    ssmR3DataReadBeginV2(pIn);
+    int rc = SSMR3SkipToEndOfUnit(pIn);
+    if (RT_SUCCESS(rc))
+        rc = ssmR3DataReadFinishV2(pIn);
+    pIn->offUnit = UINT64_MAX;
+    return rc;
+}
+
+
+/**
+ * Copies the executions of the incremental units from a layer.
+ *
+ * @returns VBox status code.
+ * @param   pOut            The output handle.
+ * @param   pIn             The layer handle, positioned at the first unit.
+ * @param   fLiveOnly       Whether to copy only the live passes, i.e. leave
+ *                          out the SSM_PASS_FINAL executions.
+ * @param   ppDir           Pointer to the directory being built.
+ */
+static int ssmR3FlattenCopyRelative(PSSMHANDLE pOut, PSSMHANDLE pIn, bool fLiveOnly, PSSMFILEDIR *ppDir)
+{
+    LogRel(("SSM: Flatten: Taking the relative units from '%s'%s\n", pIn->pszFilename, fLiveOnly ? " (live passes)" : ""));
+    for (;;)
+    {
+        SSMFILEUNITHDRV2 UnitHdr;
+        bool             fEnd;
+        int rc = ssmR3FlattenReadUnitHdr(pIn, &UnitHdr, &fEnd);
+        if (RT_FAILURE(rc) || fEnd)
+            return rc;
+
+        if (    ssmR3FlattenIsIncrementalUnit(UnitHdr.szName)
+            &&  (!fLiveOnly || UnitHdr.u32Pass != SSM_PASS_FINAL))
+            rc = ssmR3FlattenCopyUnit(pOut, pIn, &UnitHdr, ppDir);
+        else
+            rc = ssmR3FlattenSkipUnit(pIn);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+}
+
+
+/**
+ * Writes a saved state with the data of an incremental saved state and all
+ * its base files, i.e. one that loads without any of them.
+ *
+ * The units listed in g_apszSsmIncrementalUnits are the only ones whose data
+ * depend on the base.  The executions of these are carried over from the base
+ * files, bottom first, ahead of the ones in the incremental file.  They are
+ * inserted right before the final pass of the first such unit in the
+ * incremental file so that the final passes of the units loaded ahead of it
+ * (CPUM in particular) precede them, with the live passes of the incremental
+ * file moved along after them.  The loaders of these units handle the passes
+ * of one layer after the other.  Everything else is taken from the
+ * incremental file only.
+ *
+ * @returns VBox status code.
+ * @param   pszFilename     The incremental saved state.
+ * @param   pszOutFilename  The file to write the flattened saved state to.
+ *                          This is overwritten if it exists.
+ *
+ * @thread  Any.
+ */
+VMMR3DECL(int) SSMR3Flatten(const char *pszFilename, const char *pszOutFilename)
+{
+    LogFlow(("SSMR3Flatten: pszFilename=%p:{%s} pszOutFilename=%p:{%s}\n", pszFilename, pszFilename, pszOutFilename, pszOutFilename));
+    AssertMsgReturn(VALID_PTR(pszFilename), ("%p\n", pszFilename), VERR_INVALID_PARAMETER);
+    AssertMsgReturn(VALID_PTR(pszOutFilename), ("%p\n", pszOutFilename), VERR_INVALID_PARAMETER);
+
+    /*
+     * Open the chain, top first, making sure each base is the one its
+     * incremental file was saved relative to.
+     */
+    PSSMHANDLE  apLayers[SSM_MAX_BASE_DEPTH];
+    unsigned    cLayers = 0;
+    int rc = SSMR3Open(pszFilename, 0 /*fFlags*/, &apLayers[cLayers]);
+    if (RT_SUCCESS(rc))
+    {
+        cLayers++;
+        if (apLayers[0]->u.Read.uFmtVerMajor < 2)
+            rc = VERR_SSM_INTEGRITY_VERSION;
+    }
+    while (    RT_SUCCESS(rc)
+           &&  apLayers[cLayers - 1]->pszBaseFilename)
+    {
+        PSSMHANDLE pTop = apLayers[cLayers - 1];
+        if (cLayers >= SSM_MAX_BASE_DEPTH)
+        {
+            LogRel(("SSM: Flatten: Too many incremental saved states on top of each other\n"));
+            rc = VERR_SSM_BASE_TOO_DEEP;
+            break;
+        }
+        rc = SSMR3Open(pTop->pszBaseFilename, 0 /*fFlags*/, &apLayers[cLayers]);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("SSM: Flatten: Failed to open the base '%s': %Rrc\n", pTop->pszBaseFilename, rc));
+            break;
+        }
+        PSSMHANDLE pBase = apLayers[cLayers++];
+        if (    pBase->u.Read.cbLoadFile != pTop->u.Read.cbBaseFile
+            ||  pBase->u.Read.u32LoadCRC != pTop->u.Read.u32BaseStreamCRC)
+        {
+            LogRel(("SSM: Flatten: The base file '%s' has changed since '%s' was saved (%#llx/%08x, expected %#llx/%08x)\n",
+                    pBase->pszFilename, pTop->pszFilename, pBase->u.Read.cbLoadFile, pBase->u.Read.u32LoadCRC,
+                    pTop->u.Read.cbBaseFile, pTop->u.Read.u32BaseStreamCRC));
+            rc = VERR_SSM_BASE_MISMATCH;
+        }
+        else if (   pBase->u.Read.uFmtVerMajor < 2
+                 || pBase->u.Read.cHostBits != pTop->u.Read.cHostBits
+                 || pBase->u.Read.cbGCPhys  != pTop->u.Read.cbGCPhys
+                 || pBase->u.Read.cbGCPtr   != pTop->u.Read.cbGCPtr)
+        {
+            LogRel(("SSM: Flatten: The base '%s' is too old or from an incompatible host\n", pBase->pszFilename));
+            rc = VERR_SSM_INTEGRITY_VERSION;
+        }
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        /*
+         * Create the output and write the header, the format version
+         * info comes from the incremental file.
+         */
+        PSSMHANDLE pTop = apLayers[0];
+        PSSMHANDLE pOut = (PSSMHANDLE)RTMemAllocZ(sizeof(*pOut));
+        PSSMFILEDIR pDir = (PSSMFILEDIR)RTMemAllocZ(RT_OFFSETOF(SSMFILEDIR, aEntries[32]));
+        if (pOut && pDir)
+        {
+            pOut->enmOp                 = SSMSTATE_SAVE_EXEC;
+            pOut->enmAfter              = SSMAFTER_DESTROY;
+            pOut->fCancelled            = SSMHANDLE_OK;
+            pOut->rc                    = VINF_SUCCESS;
+            pOut->offUnit               = UINT64_MAX;
+            pOut->offUnitUser           = UINT64_MAX;
+            pOut->pszFilename           = pszOutFilename;
+            pOut->u.Write.cMsMaxDowntime = UINT32_MAX;
+            rc = ssmR3StrmOpenFile(&pOut->Strm, pszOutFilename, true /*fWrite*/, true /*fChecksummed*/, 8 /*cBuffers*/);
+            if (RT_SUCCESS(rc))
+            {
+                SSMFILEHDR FileHdr;
+                memcpy(&FileHdr.szMagic, SSMFILEHDR_MAGIC_V2_0, sizeof(FileHdr.szMagic));
+                FileHdr.u16VerMajor  = pTop->u.Read.u16VerMajor;
+                FileHdr.u16VerMinor  = pTop->u.Read.u16VerMinor;
+                FileHdr.u32VerBuild  = pTop->u.Read.u32VerBuild;
+                FileHdr.u32SvnRev    = pTop->u.Read.u32SvnRev;
+                FileHdr.cHostBits    = pTop->u.Read.cHostBits;
+                FileHdr.cbGCPhys     = (uint8_t)pTop->u.Read.cbGCPhys;
+                FileHdr.cbGCPtr      = (uint8_t)pTop->u.Read.cbGCPtr;
+                FileHdr.u8Reserved   = 0;
+                FileHdr.cUnits       = pTop->u.Read.cUnits;
+                FileHdr.fFlags       = SSMFILEHDR_FLAGS_STREAM_CRC32;
+                if (pTop->fLiveSave)
+                    FileHdr.fFlags  |= SSMFILEHDR_FLAGS_STREAM_LIVE_SAVE;
+                FileHdr.cbMaxDecompr = RT_SIZEOFMEMB(SSMHANDLE, u.Read.abDataBuffer);
+                FileHdr.u32CRC       = 0;
+                FileHdr.u32CRC       = RTCrc32(&FileHdr, sizeof(FileHdr));
+                rc = ssmR3StrmWrite(&pOut->Strm, &FileHdr, sizeof(FileHdr));
+
+                /*
+                 * Copy the units of the incremental file, inserting the
+                 * relative units of the bases in front of the first final
+                 * pass of one.  The live passes of the relative units come
+                 * before that in a live saved state, so they are skipped here
+                 * and copied after the bases using a second handle.
+                 */
+                bool fDoneBases   = false;
+                bool fLivePending = false;
+                while (RT_SUCCESS(rc))
+                {
+                    SSMFILEUNITHDRV2 UnitHdr;
+                    bool             fEnd;
+                    rc = ssmR3FlattenReadUnitHdr(pTop, &UnitHdr, &fEnd);
+                    if (RT_FAILURE(rc) || fEnd)
+                        break;
+                    if (    !fDoneBases
+                        &&  ssmR3FlattenIsIncrementalUnit(UnitHdr.szName))
+                    {
+                        if (UnitHdr.u32Pass != SSM_PASS_FINAL)
+                        {
+                            fLivePending = true;
+                            rc = ssmR3FlattenSkipUnit(pTop);
+                            continue;
+                        }
+
+                        for (unsigned iLayer = cLayers - 1; iLayer > 0 && RT_SUCCESS(rc); iLayer--)
+                            rc = ssmR3FlattenCopyRelative(pOut, apLayers[iLayer], false /*fLiveOnly*/, &pDir);
+                        if (RT_SUCCESS(rc) && fLivePending)
+                        {
+                            PSSMHANDLE pTopLive;
+                            rc = SSMR3Open(pszFilename, 0 /*fFlags*/, &pTopLive);
+                            if (RT_SUCCESS(rc))
+                            {
+                                rc = ssmR3FlattenCopyRelative(pOut, pTopLive, true /*fLiveOnly*/, &pDir);
+                                SSMR3Close(pTopLive);
+                            }
+                        }
+                        fDoneBases = true;
+                    }
+                    if (RT_SUCCESS(rc))
+                        rc = ssmR3FlattenCopyUnit(pOut, pTop, &UnitHdr, &pDir);
+                }
+
+                /*
+                 * The end unit, directory and footer.
+                 */
+                if (RT_SUCCESS(rc))
+                {
+                    SSMFILEUNITHDRV2 UnitHdr;
+                    memcpy(&UnitHdr.szMagic[0], SSMFILEUNITHDR_END, sizeof(UnitHdr.szMagic));
+                    UnitHdr.offStream       = ssmR3StrmTell(&pOut->Strm);
+                    UnitHdr.u32CurStreamCRC = ssmR3StrmCurCRC(&pOut->Strm);
+                    UnitHdr.u32CRC          = 0;
+                    UnitHdr.u32Version      = 0;
+                    UnitHdr.u32Instance     = 0;
+                    UnitHdr.u32Pass         = SSM_PASS_FINAL;
+                    UnitHdr.fFlags          = 0;
+                    UnitHdr.cbName          = 0;
+                    UnitHdr.u32CRC          = RTCrc32(&UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[0]));
+                    rc = ssmR3StrmWrite(&pOut->Strm, &UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[0]));
+                }
+                if (RT_SUCCESS(rc))
+                {
+                    size_t cbDir = RT_OFFSETOF(SSMFILEDIR, aEntries[pDir->cEntries]);
+                    memcpy(pDir->szMagic, SSMFILEDIR_MAGIC, sizeof(pDir->szMagic));
+                    pDir->u32CRC = 0;
+                    pDir->u32CRC = RTCrc32(pDir, cbDir);
+                    rc = ssmR3StrmWrite(&pOut->Strm, pDir, cbDir);
+                }
+                if (RT_SUCCESS(rc))
+                {
+                    SSMFILEFTR Footer;
+                    memcpy(Footer.szMagic, SSMFILEFTR_MAGIC, sizeof(Footer.szMagic));
+                    Footer.offStream    = ssmR3StrmTell(&pOut->Strm);
+                    Footer.u32StreamCRC = ssmR3StrmFinalCRC(&pOut->Strm);
+                    Footer.cDirEntries  = pDir->cEntries;
+                    Footer.u32Reserved  = 0;
+                    Footer.u32CRC       = 0;
+                    Footer.u32CRC       = RTCrc32(&Footer, sizeof(Footer));
+                    rc = ssmR3StrmWrite(&pOut->Strm, &Footer, sizeof(Footer));
+                    if (RT_SUCCESS(rc))
+                        rc = ssmR3StrmSetEnd(&pOut->Strm);
+                }
+
+                int rc2 = ssmR3StrmClose(&pOut->Strm, RT_FAILURE(rc));
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
+                if (RT_FAILURE(rc))
+                {
+                    LogRel(("SSM: Flatten: Failed writing '%s': %Rrc\n", pszOutFilename, rc));
+                    RTFileDelete(pszOutFilename);
+                }
+                else
+                    LogRel(("SSM: Flattened '%s' and %u base file(s) into '%s'\n", pszFilename, cLayers - 1, pszOutFilename));
+            }
+            else
+                LogRel(("SSM: Flatten: Failed to create '%s': %Rrc\n", pszOutFilename, rc));
+        }
+        else
+            rc = VERR_NO_MEMORY;
+        RTMemFree(pDir);
+        RTMemFree(pOut);
+    }
+
+    while (cLayers-- > 0)
+        SSMR3Close(apLayers[cLayers]);
+    return rc;
+}
 #endif /* !SSM_STANDALONE */
 
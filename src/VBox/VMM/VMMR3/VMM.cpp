@@ -2210,6 +2210,15 @@ static int vmmR3ServiceCallRing3Request(PVM pVM, PVMCPU pVCpu)
             break;
         }
 
+        /*
+         * Restores a page which is still pending in a lazy saved state restore.
+         */
+        case VMMCALLRING3_PGM_LAZY_RESTORE_PAGE:
+        {
+            pVCpu->vmm.s.rcCallRing3 = PGMR3PhysLazyRestorePage(pVM, pVCpu->vmm.s.u64CallRing3Arg);
+            break;
+        }
+
         /*
          * Acquire the PGM lock.
          */
@@ -48,6 +48,9 @@
 # define PDM_ASYNC_COMPLETION_FILE_WITH_DELAY
 #endif
 
+/** Maximum number of normal async I/O managers the endpoints are distributed across. */
+#define PDMACEPFILEMGR_POOL_MAX 32
+
 RT_C_DECLS_BEGIN
 
 /**
@@ -147,6 +150,10 @@ typedef struct PDMACEPFILEMGR
     PDMACEPFILEMGRTYPE                     enmMgrType;
     /** Current state of the manager. */
     PDMACEPFILEMGRSTATE                    enmState;
+    /** The endpoint class the manager belongs to. */
+    R3PTRTYPE(struct PDMASYNCCOMPLETIONEPCLASSFILE *) pEpClass;
+    /** Identifier of the manager used for the statistics. */
+    uint32_t                               idMgr;
     /** Event semaphore the manager sleeps on when waiting for new requests. */
     RTSEMEVENT                             EventSem;
     /** Flag whether the thread waits in the event semaphore. */
@@ -165,6 +172,9 @@ typedef struct PDMACEPFILEMGR
     unsigned                               cRequestsActive;
     /** Number of maximum requests active. */
     uint32_t                               cRequestsActiveMax;
+    /** Number of requests processed during the last update period by all
+     * endpoints, normalized to one second. */
+    volatile uint32_t                      cReqsPerSec;
     /** Pointer to an array of free async I/O request handles. */
     RTFILEAIOREQ                          *pahReqsFree;
     /** Index of the next free entry in the cache. */
@@ -209,6 +219,10 @@ typedef struct PDMACEPFILEMGR
             volatile PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint;
         } CloseEndpoint;
     } BlockingEventData;
+    /** Time from submitting a request to the host until it completed. */
+    STAMPROFILE                            StatCompletionLatency;
+    /** Number of endpoints moved to another manager to balance the load. */
+    STAMCOUNTER                            StatEndpointsMigrated;
 } PDMACEPFILEMGR;
 /** Pointer to a async I/O manager state. */
 typedef PDMACEPFILEMGR *PPDMACEPFILEMGR;
@@ -263,6 +277,15 @@ typedef struct PDMASYNCCOMPLETIONEPCLASSFILE
     R3PTRTYPE(PPDMACEPFILEMGR)          pAioMgrHead;
     /** Number of async I/O managers currently running. */
     unsigned                            cAioMgrs;
+    /** Maximum number of normal async I/O managers the endpoints are
+     * distributed across. */
+    uint32_t                            cAioMgrsPoolMax;
+    /** Identifier for the next async I/O manager. */
+    uint32_t                            idAioMgrNext;
+    /** Flag whether an endpoint is moved between managers of the pool to balance
+     * the load. Only one move is in flight at a time so the managers never
+     * wait for each other. */
+    volatile bool                       fBalancing;
     /** Maximum number of segments to cache per endpoint */
     unsigned                            cTasksCacheMax;
     /** Maximum number of simultaneous outstandingrequests. */
@@ -438,6 +461,8 @@ typedef struct PDMASYNCCOMPLETIONENDPOINTFILE
         unsigned                                   cReqsProcessed;
         /** Flag whether the endpoint is about to be moved to another manager. */
         bool                                       fMoving;
+        /** Flag whether the move is done to balance the load. */
+        bool                                       fBalancing;
         /** Destination I/O manager. */
         PPDMACEPFILEMGR                            pAioMgrDst;
     } AioMgr;
@@ -494,6 +519,8 @@ typedef struct PDMACTASKFILE
     uint32_t                             offBounceBuffer;
     /** Flag whether this is a prefetch request. */
     bool                                 fPrefetch;
+    /** Timestamp when the request was submitted to the host. */
+    uint64_t                             tsSubmit;
     /** Already prepared native I/O request.
      * Used if the request is prepared already but
      * was not queued because the host has not enough
@@ -41,6 +41,8 @@ RT_C_DECLS_BEGIN
 typedef struct PDMBLKLRULIST *PPDMBLKLRULIST;
 /** Pointer to the global cache structure. */
 typedef struct PDMBLKCACHEGLOBAL *PPDMBLKCACHEGLOBAL;
+/** Pointer to a cache shard. */
+typedef struct PDMBLKCACHESHARD *PPDMBLKCACHESHARD;
 /** Pointer to a cache entry waiter structure. */
 typedef struct PDMBLKCACHEWAITER *PPDMBLKCACHEWAITER;
 
@@ -55,10 +57,16 @@ typedef struct PDMBLKCACHEENTRY
     struct PDMBLKCACHEENTRY        *pPrev;
     /** Pointer to the next element. Used in one of the LRU lists.*/
     struct PDMBLKCACHEENTRY        *pNext;
-    /** Pointer to the list the entry is in. */
-    PPDMBLKLRULIST                  pList;
+    /** Pointer to the list the entry is in, read without the shard lock
+     * on the hit path and therefore only changed atomically. */
+    PPDMBLKLRULIST volatile         pList;
     /** Cache the entry belongs to. */
     PPDMBLKCACHE                    pBlkCache;
+    /** The shard managing the entry. */
+    PPDMBLKCACHESHARD               pShard;
+    /** Value of PDMBLKCACHESHARD::cbPromoted when the entry was last moved
+     * to the top of the frequently used list. */
+    volatile uint64_t               cbPromotedLast;
     /** Flags for this entry. Combinations of PDMACFILECACHE_* #defines */
     volatile uint32_t               fFlags;
     /** Reference counter. Prevents eviction of the entry if > 0. */
@@ -93,32 +101,107 @@ typedef struct PDMBLKLRULIST
     /** Tail of the list. */
     PPDMBLKCACHEENTRY pTail;
     /** Number of bytes cached in the list. */
-    uint32_t          cbCached;
+    volatile uint32_t cbCached;
+    /** Pointer to the counter of the same list summed up over all shards. */
+    volatile uint32_t *pcbCachedTotal;
 } PDMBLKLRULIST;
 
 /**
- * Global cache data.
+ * Cache replacement policy.
  */
-typedef struct PDMBLKCACHEGLOBAL
+typedef enum PDMBLKCACHEPOLICY
 {
-    /** Pointer to the owning VM instance. */
-    PVM                 pVM;
-    /** Maximum size of the cache in bytes. */
+    /** Invalid policy. */
+    PDMBLKCACHEPOLICY_INVALID = 0,
+    /** 2Q with fixed list sizes, the default. */
+    PDMBLKCACHEPOLICY_2Q,
+    /** Adaptive replacement cache (ARC) which balances the recency and
+     * frequency lists based on hits in the ghost lists. */
+    PDMBLKCACHEPOLICY_ARC,
+    /** 32bit hack. */
+    PDMBLKCACHEPOLICY_32BIT_HACK = 0x7fffffff
+} PDMBLKCACHEPOLICY;
+/** Pointer to a cache replacement policy. */
+typedef PDMBLKCACHEPOLICY *PPDMBLKCACHEPOLICY;
+
+/** Maximum number of shards the cache can be split into. */
+#define PDMBLKCACHE_SHARDS_MAX          64
+/** Shift of the disk offset giving the range which is mapped to the same shard. */
+#define PDMBLKCACHE_SHARD_RANGE_SHIFT   20
+
+/**
+ * Independently locked part of the cache.
+ *
+ * Entries are distributed over the shards by hashing the user and the offset
+ * range, each shard gets an equal part of the cache size and runs the
+ * replacement policy on its own lists.
+ */
+typedef struct PDMBLKCACHESHARD
+{
+    /** Number of bytes moved to the top of the frequently used list so far,
+     * used to decide whether a hit needs to move the entry. */
+    volatile uint64_t   cbPromoted;
+    /** Number of times the lock was busy when trying to enter it. */
+    STAMCOUNTER         StatLockContended;
+    /** Number of hits which didn't take the lock because the entry was
+     * close enough to the top of the frequently used list. */
+    STAMCOUNTER         StatPromoteSkipped;
+    /** Critical section protecting the lists of the shard. */
+    RTCRITSECT          CritSect;
+    /** Pointer to the global cache data. */
+    PPDMBLKCACHEGLOBAL  pCache;
+    /** Maximum size of the shard in bytes. */
     uint32_t            cbMax;
-    /** Current size of the cache in bytes. */
+    /** Current size of the shard in bytes. */
     uint32_t            cbCached;
-    /** Critical section protecting the cache. */
-    RTCRITSECT          CritSect;
     /** Maximum number of bytes cached. */
     uint32_t            cbRecentlyUsedInMax;
     /** Maximum number of bytes in the paged out list .*/
     uint32_t            cbRecentlyUsedOutMax;
+    /** ARC only: Adaptive target size of the recently used list in bytes. */
+    uint32_t            cbRecentlyUsedInTarget;
     /** Recently used cache entries list */
     PDMBLKLRULIST       LruRecentlyUsedIn;
     /** Scorecard cache entry list. */
     PDMBLKLRULIST       LruRecentlyUsedOut;
     /** List of frequently used cache entries */
     PDMBLKLRULIST       LruFrequentlyUsed;
+    /** ARC only: Ghost list of entries evicted from the frequently used list. */
+    PDMBLKLRULIST       LruFrequentlyUsedOut;
+} PDMBLKCACHESHARD;
+AssertCompileSizeAlignment(PDMBLKCACHESHARD, 8);
+
+/**
+ * Global cache data.
+ */
+typedef struct PDMBLKCACHEGLOBAL
+{
+    /** Pointer to the owning VM instance. */
+    PVM                 pVM;
+    /** Maximum size of the cache in bytes. */
+    uint32_t            cbMax;
+    /** Current size of the cache in bytes, sum of all shards. */
+    volatile uint32_t   cbCached;
+    /** Number of bytes in the recently used lists of all shards. */
+    volatile uint32_t   cbCachedMruIn;
+    /** Number of bytes in the recently used ghost lists of all shards. */
+    volatile uint32_t   cbCachedMruOut;
+    /** Number of bytes in the frequently used lists of all shards. */
+    volatile uint32_t   cbCachedFru;
+    /** ARC only: Number of bytes in the frequently used ghost lists of all shards. */
+    volatile uint32_t   cbCachedFruOut;
+    /** ARC only: Sum of the adaptive target sizes of the recently used lists. */
+    volatile uint32_t   cbRecentlyUsedInTarget;
+    /** Critical section protecting the list of users. Must be entered before
+     * any of the shard locks. */
+    RTCRITSECT          CritSect;
+    /** The replacement policy in use. */
+    PDMBLKCACHEPOLICY   enmPolicy;
+    /** Number of shards. */
+    uint32_t            cShards;
+    /** The shards, locks have to be taken in ascending index order if
+     * more than one is needed. */
+    PPDMBLKCACHESHARD   paShards;
     /** Commit timeout in milli seconds */
     uint32_t            u32CommitTimeoutMs;
     /** Number of dirty bytes needed to start a commit of the data to the disk. */
@@ -3132,8 +3132,11 @@ typedef struct PGM
     bool                            fPciPassthrough;
     /** The number of MMIO2 regions (serves as the next MMIO2 ID). */
     uint8_t                         cMmio2Regions;
+    /** Set while guest RAM is being lazily restored from a saved state, see
+     * pgmR3LazyRestoreFaultIn. */
+    bool                            fLazyRestoreActive;
     /** Alignment padding that makes the next member start on a 8 byte boundary. */
-    bool                            afAlignment1[2];
+    bool                            afAlignment1[1];
 
     /** Indicates that PGMR3FinalizeMappings has been called and that further
      * PGMR3MapIntermediate calls will be rejected. */
@@ -3188,7 +3191,8 @@ typedef struct PGM
     /** Pointer to SHW+GST mode data (function pointers).
      * The index into this table is made up from */
     R3PTRTYPE(PPGMMODEDATA)         paModeData;
-    RTR3PTR                         R3PtrAlignment0;
+    /** The lazy restore state, NULL if not active.  See fLazyRestoreActive. */
+    R3PTRTYPE(struct PGMLAZYRESTORE *) pLazyRestoreR3;
     /** MMIO2 lookup array for ring-3.  Indexed by idMmio2 minus 1.  */
     R3PTRTYPE(PPGMMMIO2RANGE)       apMmio2RangesR3[PGM_MMIO2_MAX_RANGES];
 
@@ -3408,8 +3412,11 @@ typedef struct PGM
         uint32_t                    cIgnoredPages;
         /** Indicates that a live save operation is active.  */
         bool                        fActive;
+        /** Whether to save the page digests (/PGM/SaveDigests) so the saved
+         * state can serve as the base of an incremental one. */
+        bool                        fSaveDigests;
         /** Padding. */
-        bool                        afReserved[2];
+        bool                        afReserved[1];
         /** The next history index. */
         uint8_t                     iDirtyPagesHistory;
         /** History of the total amount of dirty pages. */
@@ -3428,6 +3435,12 @@ typedef struct PGM
         /** Pages per second (for statistics). */
         uint32_t                    cPagesPerSecond;
         uint32_t                    cAlignment;
+        /** The page digests of the current save, NULL if not tracking them.
+         * Owned by the saving thread. */
+        R3PTRTYPE(struct PGMSAVEDIGESTS *) pDigestsR3;
+#if HC_ARCH_BITS == 32
+        uint32_t                    u32Padding;
+#endif
     } LiveSave;
 
     /** @name   Error injection.
@@ -4026,6 +4039,9 @@ void            pgmHandlerVirtualDumpPhysPages(PVM pVM);
 #endif
 DECLCALLBACK(void) pgmR3InfoHandlers(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 int             pgmR3InitSavedState(PVM pVM, uint64_t cbRam);
+int             pgmR3LazyRestoreFaultIn(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys);
+int             pgmR3LazyRestoreComplete(PVM pVM);
+void            pgmR3LazyRestoreTerm(PVM pVM);
 
 int             pgmPhysAllocPage(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys);
 int             pgmPhysAllocLargePage(PVM pVM, RTGCPHYS GCPhys);
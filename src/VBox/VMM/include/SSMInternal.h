@@ -313,7 +313,8 @@ typedef struct SSM
     bool                    fInitialized;
     /** Current pass (for STAM). */
     uint32_t                uPass;
-    uint32_t                u32Alignment;
+    /** The number of compression threads to use when saving (CFGM). */
+    uint32_t                cZipThreads;
 } SSM;
 /** Pointer to SSM VM instance data. */
 typedef SSM *PSSM;
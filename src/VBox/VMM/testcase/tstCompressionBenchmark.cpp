@@ -323,7 +323,6 @@ int main(int argc, char **argv)
 
     g_cbPages = g_cPages * PAGE_SIZE;
     uint64_t cbTotal = (uint64_t)g_cPages * PAGE_SIZE * cIterations;
-    uint64_t cbTotalKB = cbTotal / _1K;
     if (cbTotal / cIterations != g_cbPages)
         return Error("cPages * cIterations -> overflow\n");
 
@@ -350,13 +349,49 @@ int main(int argc, char **argv)
 #ifdef RT_OS_LINUX
             RTPrintf("To get real RAM on linux: sudo dd if=/dev/mem ... \n");
 #endif
-            uint8_t *pb    = g_pabSrc;
-            uint8_t *pbEnd = &g_pabSrc[g_cbPages];
-            for (; pb != pbEnd; pb += 16)
+            /* Try resemble guest memory a little: about a quarter of the pages
+               are zero, an eighth are incompressible and the rest are a mix of
+               text-like patterns and sparse binary data. */
+            uint32_t uSeed = 0x19850101;
+            for (size_t iPage = 0; iPage < g_cPages; iPage++)
             {
-                char szTmp[17];
-                RTStrPrintf(szTmp, sizeof(szTmp), "aaaa%08Xzzzz", (uint32_t)(uintptr_t)pb);
-                memcpy(pb, szTmp, 16);
+                uint8_t *pb    = &g_pabSrc[iPage * PAGE_SIZE];
+                uint8_t *pbEnd = pb + PAGE_SIZE;
+                uSeed = uSeed * 1103515245 + 12345;
+                switch ((uSeed >> 16) & 7)
+                {
+                    case 0:
+                    case 1:
+                        memset(pb, 0, PAGE_SIZE);
+                        break;
+
+                    case 2:
+                        for (; pb != pbEnd; pb += sizeof(uint32_t))
+                        {
+                            uSeed = uSeed * 1103515245 + 12345;
+                            *(uint32_t *)pb = uSeed ^ (uSeed >> 15);
+                        }
+                        break;
+
+                    case 3:
+                    case 4:
+                        memset(pb, 0, PAGE_SIZE);
+                        for (; pb != pbEnd; pb += 64)
+                        {
+                            uSeed = uSeed * 1103515245 + 12345;
+                            *(uint64_t *)pb = (uintptr_t)pb ^ (uSeed >> 24);
+                        }
+                        break;
+
+                    default:
+                        for (; pb != pbEnd; pb += 16)
+                        {
+                            char szTmp[17];
+                            RTStrPrintf(szTmp, sizeof(szTmp), "aaaa%08Xzzzz", (uint32_t)(uintptr_t)pb);
+                            memcpy(pb, szTmp, 16);
+                        }
+                        break;
+                }
             }
         }
     }
@@ -394,11 +429,18 @@ int main(int argc, char **argv)
     {
         { 0, 0, 0, VINF_SUCCESS, false, RTZIPTYPE_STORE, RTZIPLEVEL_DEFAULT, "RTZip/Store"      },
         { 0, 0, 0, VINF_SUCCESS, false, RTZIPTYPE_LZF,   RTZIPLEVEL_DEFAULT, "RTZip/LZF"        },
+        { 0, 0, 0, VINF_SUCCESS, false, RTZIPTYPE_LZ4,   RTZIPLEVEL_DEFAULT, "RTZip/LZ4"        },
+        { 0, 0, 0, VINF_SUCCESS, false, RTZIPTYPE_ZSTD,  RTZIPLEVEL_FAST,    "RTZip/Zstd-fast"  },
+        { 0, 0, 0, VINF_SUCCESS, false, RTZIPTYPE_ZSTD,  RTZIPLEVEL_DEFAULT, "RTZip/Zstd"       },
 /*      { 0, 0, 0, VINF_SUCCESS, false, RTZIPTYPE_ZLIB,  RTZIPLEVEL_DEFAULT, "RTZip/zlib"       }, - slow plus it randomly hits VERR_GENERAL_FAILURE atm. */
         { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_STORE, RTZIPLEVEL_DEFAULT, "RTZipBlock/Store" },
         { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_LZF,   RTZIPLEVEL_DEFAULT, "RTZipBlock/LZF"   },
         { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_LZJB,  RTZIPLEVEL_DEFAULT, "RTZipBlock/LZJB"  },
         { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_LZO,   RTZIPLEVEL_DEFAULT, "RTZipBlock/LZO"   },
+        { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_LZ4,   RTZIPLEVEL_DEFAULT, "RTZipBlock/LZ4"   },
+        { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_LZ4,   RTZIPLEVEL_MAX,     "RTZipBlock/LZ4-HC" },
+        { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_ZSTD,  RTZIPLEVEL_FAST,    "RTZipBlock/Zstd-fast" },
+        { 0, 0, 0, VINF_SUCCESS, true,  RTZIPTYPE_ZSTD,  RTZIPLEVEL_DEFAULT, "RTZipBlock/Zstd"  },
     };
     RTPrintf("tstCompressionBenchmark: TESTING..");
     for (uint32_t i = 0; i < cIterations; i++)
@@ -572,12 +614,12 @@ int main(int argc, char **argv)
     {
         if (RT_SUCCESS(aTests[j].rc))
         {
-            unsigned uComprSpeedIn    = (unsigned)(cbTotalKB         / (long double)aTests[j].cNanoCompr   * 1000000000.0);
-            unsigned uComprSpeedOut   = (unsigned)(aTests[j].cbCompr / (long double)aTests[j].cNanoCompr   * 1000000000.0 / 1024);
+            unsigned uComprSpeedIn    = (unsigned)(cbTotal           / (long double)aTests[j].cNanoCompr   * 1000000000.0 / _1M);
+            unsigned uComprSpeedOut   = (unsigned)(aTests[j].cbCompr / (long double)aTests[j].cNanoCompr   * 1000000000.0 / _1M);
             unsigned uRatio           = (unsigned)(aTests[j].cbCompr / cIterations * 100 / g_cbPages);
-            unsigned uDecomprSpeedIn  = (unsigned)(aTests[j].cbCompr / (long double)aTests[j].cNanoDecompr * 1000000000.0 / 1024);
-            unsigned uDecomprSpeedOut = (unsigned)(cbTotalKB         / (long double)aTests[j].cNanoDecompr * 1000000000.0);
-            RTPrintf("%-20s %'9u KB/s  %'9u KB/s  %3u%%  %'11llu bytes   %'9u KB/s  %'9u KB/s",
+            unsigned uDecomprSpeedIn  = (unsigned)(aTests[j].cbCompr / (long double)aTests[j].cNanoDecompr * 1000000000.0 / _1M);
+            unsigned uDecomprSpeedOut = (unsigned)(cbTotal           / (long double)aTests[j].cNanoDecompr * 1000000000.0 / _1M);
+            RTPrintf("%-20s %'9u MB/s  %'9u MB/s  %3u%%  %'11llu bytes   %'9u MB/s  %'9u MB/s",
                      aTests[j].pszName,
                      uComprSpeedIn,   uComprSpeedOut, uRatio, aTests[j].cbCompr / cIterations,
                      uDecomprSpeedIn, uDecomprSpeedOut);
@@ -589,6 +631,9 @@ int main(int argc, char **argv)
             RTPrintf("\n");
 #endif
         }
+        else if (   aTests[j].rc == VERR_NOT_SUPPORTED
+                 || aTests[j].rc == VERR_NOT_IMPLEMENTED)
+            RTPrintf("%-20s: not included in this build\n", aTests[j].pszName);
         else
         {
             RTPrintf("%-20s: %Rrc\n", aTests[j].pszName, aTests[j].rc);
@@ -0,0 +1,510 @@
+/* $Id$ */
+/** @file
+ * PDM Block Cache Testcase - Replays I/O traces against the different replacement policies.
+ *
+ * The testcase feeds a recorded or synthetic I/O trace through the block cache
+ * and reports the hit rate and the CPU time spent per request for every
+ * replacement policy. The medium is simulated, read transfers are completed
+ * with zeroed data right away so only the cache itself is measured.
+ *
+ * Use: ./tstPDMBlkCacheReplay [--trace <file>] [--policy <2Q|ARC>] [--cache-size <MB>]
+ *
+ * A trace file contains one request per line in the form "R|W <offset> <size>",
+ * lines starting with '#' are ignored.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_PDM_BLK_CACHE
+
+#include "VMInternal.h" /* UVM */
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
+#include <VBox/vmm/pdmblkcache.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/ctype.h>
+#include <iprt/getopt.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/semaphore.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+#define TESTCASE "tstPDMBlkCacheReplay"
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * A single request of the trace.
+ */
+typedef struct TSTTRACEREQ
+{
+    /** Start offset. */
+    uint64_t        off;
+    /** Size of the request in bytes. */
+    uint32_t        cb;
+    /** Flag whether this is a write. */
+    bool            fWrite;
+} TSTTRACEREQ;
+/** Pointer to a trace request. */
+typedef TSTTRACEREQ *PTSTTRACEREQ;
+
+/**
+ * A transfer the cache enqueued on the simulated medium.
+ */
+typedef struct TSTXFER
+{
+    PDMBLKCACHEXFERDIR  enmXferDir;
+    size_t              cbXfer;
+    RTSGBUF             SgBuf;
+    PPDMBLKCACHEIOXFER  hIoXfer;
+} TSTXFER;
+/** Pointer to a simulated transfer. */
+typedef TSTXFER *PTSTXFER;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The policy the VM is configured with. */
+static const char  *g_pszPolicy;
+/** The cache size in bytes. */
+static uint64_t     g_cbCache = 8 * _1M;
+/** Protects the transfer queue, the commit timer might enqueue as well. */
+static RTSEMFASTMUTEX g_hMtxXfers;
+/** Transfers waiting for completion. */
+static PTSTXFER    *g_papXfers;
+/** Number of transfers queued. */
+static uint32_t     g_cXfers;
+/** Size of the transfer queue. */
+static uint32_t     g_cXfersMax;
+/** Bytes read from the simulated medium. */
+static uint64_t     g_cbMediumRead;
+/** Number of requests completed asynchronously. */
+static volatile uint32_t g_cReqsCompleted;
+
+
+static DECLCALLBACK(void) tstXferComplete(void *pvUserInt, void *pvUser, int rc)
+{
+    NOREF(pvUserInt); NOREF(pvUser);
+    AssertRC(rc);
+    ASMAtomicIncU32(&g_cReqsCompleted);
+}
+
+static DECLCALLBACK(int) tstXferEnqueue(void *pvUser, PDMBLKCACHEXFERDIR enmXferDir,
+                                        uint64_t off, size_t cbXfer,
+                                        PCRTSGBUF pcSgBuf, PPDMBLKCACHEIOXFER hIoXfer)
+{
+    NOREF(pvUser); NOREF(off);
+
+    PTSTXFER pXfer = (PTSTXFER)RTMemAllocZ(sizeof(TSTXFER));
+    if (!pXfer)
+        return VERR_NO_MEMORY;
+
+    pXfer->enmXferDir = enmXferDir;
+    pXfer->cbXfer     = cbXfer;
+    pXfer->hIoXfer    = hIoXfer;
+    if (pcSgBuf)
+        RTSgBufClone(&pXfer->SgBuf, pcSgBuf);
+
+    RTSemFastMutexRequest(g_hMtxXfers);
+    if (g_cXfers == g_cXfersMax)
+    {
+        uint32_t  cXfersNew  = RT_MAX(g_cXfersMax * 2, 64);
+        PTSTXFER *papXfersNew = (PTSTXFER *)RTMemRealloc(g_papXfers, cXfersNew * sizeof(PTSTXFER));
+        if (!papXfersNew)
+        {
+            RTSemFastMutexRelease(g_hMtxXfers);
+            RTMemFree(pXfer);
+            return VERR_NO_MEMORY;
+        }
+        g_papXfers  = papXfersNew;
+        g_cXfersMax = cXfersNew;
+    }
+    g_papXfers[g_cXfers++] = pXfer;
+    RTSemFastMutexRelease(g_hMtxXfers);
+
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) tstXferEnqueueDiscard(void *pvUser, PCRTRANGE paRanges, unsigned cRanges,
+                                               PPDMBLKCACHEIOXFER hIoXfer)
+{
+    NOREF(pvUser); NOREF(paRanges); NOREF(cRanges); NOREF(hIoXfer);
+    return VERR_NOT_SUPPORTED;
+}
+
+/**
+ * Completes all transfers the cache enqueued so far.
+ *
+ * @param   pBlkCache    The cache instance.
+ */
+static void tstXfersComplete(PPDMBLKCACHE pBlkCache)
+{
+    for (;;)
+    {
+        RTSemFastMutexRequest(g_hMtxXfers);
+        PTSTXFER pXfer = g_cXfers ? g_papXfers[--g_cXfers] : NULL;
+        RTSemFastMutexRelease(g_hMtxXfers);
+        if (!pXfer)
+            break;
+
+        if (pXfer->enmXferDir == PDMBLKCACHEXFERDIR_READ)
+        {
+            RTSgBufSet(&pXfer->SgBuf, 0, pXfer->cbXfer);
+            g_cbMediumRead += pXfer->cbXfer;
+        }
+
+        PDMR3BlkCacheIoXferComplete(pBlkCache, pXfer->hIoXfer, VINF_SUCCESS);
+        RTMemFree(pXfer);
+    }
+}
+
+/**
+ * Loads a trace file.
+ *
+ * @returns VBox status code.
+ * @param   pszFilename  The trace to load.
+ * @param   ppaReqs      Where to store the request array on success.
+ * @param   pcReqs       Where to store the number of requests on success.
+ */
+static int tstTraceLoad(const char *pszFilename, PTSTTRACEREQ *ppaReqs, uint32_t *pcReqs)
+{
+    PRTSTREAM pStrm;
+    int rc = RTStrmOpen(pszFilename, "r", &pStrm);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    PTSTTRACEREQ paReqs = NULL;
+    uint32_t     cReqs = 0;
+    uint32_t     cReqsMax = 0;
+    char         szLine[256];
+    while (RT_SUCCESS(rc = RTStrmGetLine(pStrm, szLine, sizeof(szLine))))
+    {
+        char *psz = RTStrStrip(szLine);
+        if (!*psz || *psz == '#')
+            continue;
+
+        bool fWrite;
+        if (RT_C_TO_UPPER(*psz) == 'R')
+            fWrite = false;
+        else if (RT_C_TO_UPPER(*psz) == 'W')
+            fWrite = true;
+        else
+        {
+            rc = VERR_PARSE_ERROR;
+            break;
+        }
+
+        uint64_t off;
+        uint32_t cb;
+        psz = RTStrStripL(psz + 1);
+        rc = RTStrToUInt64Ex(psz, &psz, 0, &off);
+        if (rc != VWRN_TRAILING_CHARS)
+        {
+            rc = VERR_PARSE_ERROR;
+            break;
+        }
+        rc = RTStrToUInt32Full(RTStrStripL(psz), 0, &cb);
+        if (rc != VINF_SUCCESS || !cb)
+        {
+            rc = VERR_PARSE_ERROR;
+            break;
+        }
+
+        if (cReqs == cReqsMax)
+        {
+            uint32_t     cReqsNew = RT_MAX(cReqsMax * 2, _4K);
+            PTSTTRACEREQ paReqsNew = (PTSTTRACEREQ)RTMemRealloc(paReqs, cReqsNew * sizeof(TSTTRACEREQ));
+            if (!paReqsNew)
+            {
+                rc = VERR_NO_MEMORY;
+                break;
+            }
+            paReqs   = paReqsNew;
+            cReqsMax = cReqsNew;
+        }
+
+        paReqs[cReqs].off    = off;
+        paReqs[cReqs].cb     = cb;
+        paReqs[cReqs].fWrite = fWrite;
+        cReqs++;
+    }
+    RTStrmClose(pStrm);
+
+    if (rc == VERR_EOF)
+    {
+        *ppaReqs = paReqs;
+        *pcReqs  = cReqs;
+        return VINF_SUCCESS;
+    }
+
+    RTMemFree(paReqs);
+    return rc;
+}
+
+/**
+ * Creates a synthetic trace: Random 4K accesses to a hot set which fits into
+ * the cache interleaved with a sequential scan over a much larger area, the
+ * scan should not push the hot set out of the cache.
+ *
+ * @returns VBox status code.
+ * @param   cReqs        Number of requests to generate.
+ * @param   ppaReqs      Where to store the request array on success.
+ */
+static int tstTraceCreateSynthetic(uint32_t cReqs, PTSTTRACEREQ *ppaReqs)
+{
+    PTSTTRACEREQ paReqs = (PTSTTRACEREQ)RTMemAllocZ(cReqs * sizeof(TSTTRACEREQ));
+    if (!paReqs)
+        return VERR_NO_MEMORY;
+
+    RTRAND hRand;
+    int rc = RTRandAdvCreateParkMiller(&hRand);
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(paReqs);
+        return rc;
+    }
+    RTRandAdvSeed(hRand, 0x20141103);
+
+    uint64_t const cbHotSet  = g_cbCache / 2;
+    uint64_t const offScan   = _1G;
+    uint64_t       offScanCur = offScan;
+    for (uint32_t i = 0; i < cReqs; i++)
+    {
+        if (RTRandAdvU32Ex(hRand, 0, 99) < 60)
+        {
+            paReqs[i].off    = RTRandAdvU64Ex(hRand, 0, cbHotSet / _4K - 1) * _4K;
+            paReqs[i].cb     = _4K;
+            paReqs[i].fWrite = RTRandAdvU32Ex(hRand, 0, 99) < 10;
+        }
+        else
+        {
+            paReqs[i].off    = offScanCur;
+            paReqs[i].cb     = _64K;
+            paReqs[i].fWrite = false;
+            offScanCur += _64K;
+        }
+    }
+
+    RTRandAdvDestroy(hRand);
+    *ppaReqs = paReqs;
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) tstCfgmConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    NOREF(pUVM); NOREF(pvUser);
+    int rc = CFGMR3ConstructDefaultTree(pVM);
+    if (RT_SUCCESS(rc))
+    {
+        PCFGMNODE pPdm = CFGMR3GetChild(CFGMR3GetRoot(pVM), "PDM");
+        PCFGMNODE pBlkCache;
+        rc = CFGMR3InsertNode(pPdm, "BlkCache", &pBlkCache);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertString(pBlkCache, "CachePolicy", g_pszPolicy);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertInteger(pBlkCache, "CacheSize", g_cbCache);
+    }
+    return rc;
+}
+
+/**
+ * Replays the trace with the given policy.
+ *
+ * @param   hTest        The test handle.
+ * @param   pszPolicy    The replacement policy to use.
+ * @param   paReqs       The trace.
+ * @param   cReqs        Number of requests in the trace.
+ */
+static void tstReplay(RTTEST hTest, const char *pszPolicy, PTSTTRACEREQ paReqs, uint32_t cReqs)
+{
+    RTTestSubF(hTest, "Policy %s", pszPolicy);
+    g_pszPolicy       = pszPolicy;
+    g_cbMediumRead    = 0;
+    g_cReqsCompleted  = 0;
+
+    PVM pVM;
+    PUVM pUVM;
+    int rc = VMR3Create(1, NULL, NULL, NULL, tstCfgmConstructor, NULL, &pVM, &pUVM);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(hTest, "VMR3Create failed: rc=%Rrc\n", rc);
+        return;
+    }
+
+    /*
+     * Little hack to avoid the VM_ASSERT_EMT assertion.
+     */
+    RTTlsSet(pVM->pUVM->vm.s.idxTLS, &pVM->pUVM->aCpus[0]);
+    pVM->pUVM->aCpus[0].pUVM = pVM->pUVM;
+    pVM->pUVM->aCpus[0].vm.s.NativeThreadEMT = RTThreadNativeSelf();
+
+    uint32_t cbBuf = 0;
+    for (uint32_t i = 0; i < cReqs; i++)
+        cbBuf = RT_MAX(cbBuf, paReqs[i].cb);
+    void *pvBuf = RTMemAllocZ(cbBuf);
+
+    PPDMBLKCACHE pBlkCache;
+    rc = PDMR3BlkCacheRetainInt(pVM, NULL, &pBlkCache, tstXferComplete, tstXferEnqueue,
+                                tstXferEnqueueDiscard, TESTCASE);
+    if (RT_SUCCESS(rc) && pvBuf)
+    {
+        uint64_t cbRequested = 0;
+        uint64_t nsStart = RTTimeNanoTS();
+        for (uint32_t i = 0; i < cReqs && RT_SUCCESS(rc); i++)
+        {
+            RTSGSEG Seg;
+            RTSGBUF SgBuf;
+
+            Seg.pvSeg = pvBuf;
+            Seg.cbSeg = paReqs[i].cb;
+            RTSgBufInit(&SgBuf, &Seg, 1);
+
+            if (paReqs[i].fWrite)
+                rc = PDMR3BlkCacheWrite(pBlkCache, paReqs[i].off, &SgBuf, paReqs[i].cb, NULL);
+            else
+            {
+                rc = PDMR3BlkCacheRead(pBlkCache, paReqs[i].off, &SgBuf, paReqs[i].cb, NULL);
+                cbRequested += paReqs[i].cb;
+            }
+            if (rc == VINF_AIO_TASK_PENDING)
+                rc = VINF_SUCCESS;
+
+            tstXfersComplete(pBlkCache);
+        }
+        uint64_t nsElapsed = RTTimeNanoTS() - nsStart;
+
+        if (RT_SUCCESS(rc))
+        {
+            /* Write back the dirty entries so releasing the cache doesn't wait for us. */
+            rc = PDMR3BlkCacheFlush(pBlkCache, NULL);
+            tstXfersComplete(pBlkCache);
+            if (rc == VINF_AIO_TASK_PENDING)
+                rc = VINF_SUCCESS;
+        }
+        if (RT_FAILURE(rc))
+            RTTestFailed(hTest, "Replaying the trace failed: rc=%Rrc\n", rc);
+
+        uint64_t cbHit = cbRequested - RT_MIN(g_cbMediumRead, cbRequested);
+        RTTestValue(hTest, "Read hit rate", cbRequested ? cbHit * 10000 / cbRequested : 0, RTTESTUNIT_PP10K);
+        RTTestValue(hTest, "Read from medium", g_cbMediumRead, RTTESTUNIT_BYTES);
+        RTTestValue(hTest, "Time per request", cReqs ? nsElapsed / cReqs : 0, RTTESTUNIT_NS_PER_CALL);
+
+        PDMR3BlkCacheRelease(pBlkCache);
+    }
+    else if (RT_FAILURE(rc))
+        RTTestFailed(hTest, "PDMR3BlkCacheRetainInt failed: rc=%Rrc\n", rc);
+    else
+        RTTestFailed(hTest, "Out of memory\n");
+
+    RTMemFree(pvBuf);
+
+    rc = VMR3Destroy(pUVM);
+    if (RT_FAILURE(rc))
+        RTTestFailed(hTest, "VMR3Destroy failed: rc=%Rrc\n", rc);
+    VMR3ReleaseUVM(pUVM);
+}
+
+
+int main(int argc, char *argv[])
+{
+    RTTEST hTest;
+    RTEXITCODE rcExit = RTTestInitExAndCreate(argc, &argv, RTR3INIT_FLAGS_SUPLIB, TESTCASE, &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    static const RTGETOPTDEF s_aOptions[] =
+    {
+        { "--trace",         't', RTGETOPT_REQ_STRING },
+        { "--policy",        'p', RTGETOPT_REQ_STRING },
+        { "--cache-size",    'c', RTGETOPT_REQ_UINT64 },
+        { "--requests",      'r', RTGETOPT_REQ_UINT32 },
+    };
+
+    const char *pszTrace  = NULL;
+    const char *pszPolicy = NULL;
+    uint32_t    cReqs     = 200000;
+
+    int ch;
+    RTGETOPTUNION ValueUnion;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0);
+    while ((ch = RTGetOpt(&GetState, &ValueUnion)))
+    {
+        switch (ch)
+        {
+            case 't':
+                pszTrace = ValueUnion.psz;
+                break;
+
+            case 'p':
+                pszPolicy = ValueUnion.psz;
+                break;
+
+            case 'c':
+                g_cbCache = ValueUnion.u64 * _1M;
+                break;
+
+            case 'r':
+                cReqs = ValueUnion.u32;
+                break;
+
+            case 'h':
+                RTPrintf("usage: " TESTCASE " [--trace <file>] [--policy <2Q|ARC>] [--cache-size <MB>] [--requests <count>]\n");
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &ValueUnion);
+        }
+    }
+
+    PTSTTRACEREQ paReqs = NULL;
+    int rc;
+    if (pszTrace)
+        rc = tstTraceLoad(pszTrace, &paReqs, &cReqs);
+    else
+        rc = tstTraceCreateSynthetic(cReqs, &paReqs);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(hTest, "Creating the trace failed: rc=%Rrc\n", rc);
+        return RTTestSummaryAndDestroy(hTest);
+    }
+
+    rc = RTSemFastMutexCreate(&g_hMtxXfers);
+    RTTESTI_CHECK_RC_OK_RET(rc, RTTestSummaryAndDestroy(hTest));
+
+    static const char * const s_apszPolicies[] = { "2Q", "ARC" };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_apszPolicies); i++)
+        if (!pszPolicy || !RTStrICmp(pszPolicy, s_apszPolicies[i]))
+            tstReplay(hTest, s_apszPolicies[i], paReqs, cReqs);
+
+    RTSemFastMutexDestroy(g_hMtxXfers);
+    RTMemFree(g_papXfers);
+    RTMemFree(paReqs);
+
+    return RTTestSummaryAndDestroy(hTest);
+}
@@ -21,6 +21,7 @@
 *******************************************************************************/
 #include <VBox/vmm/ssm.h>
 #include "VMInternal.h" /* createFakeVM */
+#include "SSMInternal.h" /* cZipThreads */
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
 #include <VBox/vmm/mm.h>
@@ -683,6 +684,560 @@ static int createFakeVM(PVM *ppVM)
 }
 
 
+/**
+ * Saves and loads the state with different numbers of compression threads,
+ * reporting the save throughput for each.
+ *
+ * @returns 0 on success, 1 on failure.
+ * @param   pVM             The fake VM.
+ * @param   pszFilename     The file to save to.
+ */
+static int tstSSMCompressionThreads(PVM pVM, const char *pszFilename)
+{
+    static uint32_t const s_acThreads[] = { 0, 1, 2, 4 };
+    uint32_t const cZipThreadsSaved = pVM->ssm.s.cZipThreads;
+    for (unsigned i = 0; i < RT_ELEMENTS(s_acThreads); i++)
+    {
+        pVM->ssm.s.cZipThreads = s_acThreads[i];
+
+        uint64_t u64Start = RTTimeNanoTS();
+        int rc = SSMR3Save(pVM, pszFilename, NULL, NULL, NULL, SSMAFTER_DESTROY, NULL, NULL);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("SSMR3Save #2 (%u threads) -> %Rrc\n", s_acThreads[i], rc);
+            return 1;
+        }
+        uint64_t u64Elapsed = RTTimeNanoTS() - u64Start;
+        /* Items 3 and 4 make up the bulk of it. */
+        RTPrintf("tstSSM: Saved with %u compression threads in %'RI64 ns (%RU64 MB/s)\n", s_acThreads[i], u64Elapsed,
+                 (uint64_t)TSTSSM_ITEM_SIZE * 2 * RT_NS_1SEC / _1M / RT_MAX(u64Elapsed, 1));
+
+        rc = SSMR3Load(pVM, pszFilename, NULL /*pStreamOps*/, NULL /*pStreamOpsUser*/,
+                       SSMAFTER_RESUME, NULL /*pfnProgress*/, NULL /*pvProgressUser*/);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("SSMR3Load #2 (%u threads) -> %Rrc\n", s_acThreads[i], rc);
+            return 1;
+        }
+        rc = SSMR3ValidateFile(pszFilename, true /* fChecksumIt */);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("SSMR3ValidateFile #2 (%u threads) -> %Rrc\n", s_acThreads[i], rc);
+            return 1;
+        }
+    }
+    pVM->ssm.s.cZipThreads = cZipThreadsSaved;
+    return 0;
+}
+
+
+/** The layer number the incremental test units save. */
+static uint32_t g_uIncrLayer;
+/** Set when the incremental test "cpum" unit has been loaded. */
+static bool     g_fIncrCpumLoaded;
+/** The layers the incremental test "pgm" unit loaded, in order. */
+static uint32_t g_auIncrLoaded[8];
+/** The number of valid entries in g_auIncrLoaded. */
+static uint32_t g_cIncrLoaded;
+
+
+/**
+ * Saves the incremental test "cpum" unit.
+ */
+static DECLCALLBACK(int) IncrCpumSave(PVM pVM, PSSMHANDLE pSSM)
+{
+    NOREF(pVM);
+    return SSMR3PutU32(pSSM, g_uIncrLayer);
+}
+
+
+/**
+ * Loads the incremental test "cpum" unit.
+ */
+static DECLCALLBACK(int) IncrCpumLoad(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    NOREF(pVM); NOREF(uVersion); NOREF(uPass);
+    uint32_t uLayer;
+    int rc = SSMR3GetU32(pSSM, &uLayer);
+    if (RT_SUCCESS(rc))
+        g_fIncrCpumLoaded = true;
+    return rc;
+}
+
+
+/**
+ * Saves the incremental test "pgm" unit, the layer number and a page of data
+ * depending on it.
+ */
+static DECLCALLBACK(int) IncrPgmSave(PVM pVM, PSSMHANDLE pSSM)
+{
+    NOREF(pVM);
+    uint8_t abPage[PAGE_SIZE];
+    memset(abPage, (int)g_uIncrLayer, sizeof(abPage));
+    SSMR3PutU32(pSSM, g_uIncrLayer);
+    return SSMR3PutMem(pSSM, abPage, sizeof(abPage));
+}
+
+
+/**
+ * Loads the incremental test "pgm" unit, recording the layer.
+ *
+ * Like the real PGM unit this requires the "cpum" unit to be loaded first.
+ */
+static DECLCALLBACK(int) IncrPgmLoad(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    NOREF(pVM); NOREF(uVersion);
+    if (uPass == SSM_PASS_FINAL && !g_fIncrCpumLoaded)
+    {
+        RTPrintf("IncrPgmLoad: loaded before the cpum unit\n");
+        return VERR_WRONG_ORDER;
+    }
+
+    uint32_t uLayer;
+    uint8_t  abPage[PAGE_SIZE];
+    SSMR3GetU32(pSSM, &uLayer);
+    int rc = SSMR3GetMem(pSSM, abPage, sizeof(abPage));
+    if (RT_FAILURE(rc))
+        return rc;
+    for (unsigned i = 0; i < sizeof(abPage); i++)
+        if (abPage[i] != (uint8_t)uLayer)
+        {
+            RTPrintf("IncrPgmLoad: layer %u data mismatch at %#x\n", uLayer, i);
+            return VERR_GENERAL_FAILURE;
+        }
+    if (g_cIncrLoaded >= RT_ELEMENTS(g_auIncrLoaded))
+        return VERR_BUFFER_OVERFLOW;
+    g_auIncrLoaded[g_cIncrLoaded++] = uLayer;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Loads a saved state and checks that the "pgm" unit was loaded once for
+ * each layer, bottom first.
+ *
+ * @returns 0 on success, 1 on failure.
+ * @param   pVM             The fake VM.
+ * @param   pszFilename     The file to load.
+ * @param   cLayers         The expected number of layers.
+ */
+static int tstSSMIncrementalLoad(PVM pVM, const char *pszFilename, uint32_t cLayers)
+{
+    g_fIncrCpumLoaded = false;
+    g_cIncrLoaded     = 0;
+    int rc = SSMR3Load(pVM, pszFilename, NULL /*pStreamOps*/, NULL /*pStreamOpsUser*/,
+                       SSMAFTER_RESUME, NULL /*pfnProgress*/, NULL /*pvProgressUser*/);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3Load '%s' -> %Rrc\n", pszFilename, rc);
+        return 1;
+    }
+    if (g_cIncrLoaded != cLayers)
+    {
+        RTPrintf("tstSSM: '%s' loaded %u layers, expected %u\n", pszFilename, g_cIncrLoaded, cLayers);
+        return 1;
+    }
+    for (uint32_t i = 0; i < cLayers; i++)
+        if (g_auIncrLoaded[i] != i + 1)
+        {
+            RTPrintf("tstSSM: '%s' loaded layer %u as #%u\n", pszFilename, g_auIncrLoaded[i], i);
+            return 1;
+        }
+    return 0;
+}
+
+
+/**
+ * Saves a chain of incremental saved states, loads it and flattens it.
+ *
+ * @returns 0 on success, 1 on failure.
+ * @param   pVM             The fake VM.
+ */
+static int tstSSMIncremental(PVM pVM)
+{
+    static const char * const s_apszFiles[] = { "SSMTestSave#Base", "SSMTestSave#Incr1", "SSMTestSave#Incr2" };
+    const char *pszFlatFilename = "SSMTestSave#Flat";
+
+    int rc = SSMR3RegisterInternal(pVM, "cpum", 0, 1, 64,
+                                   NULL, NULL, NULL,
+                                   NULL, IncrCpumSave, NULL,
+                                   NULL, IncrCpumLoad, NULL);
+    if (RT_SUCCESS(rc))
+        rc = SSMR3RegisterInternal(pVM, "pgm", 0, 1, PAGE_SIZE * 2,
+                                   NULL, NULL, NULL,
+                                   NULL, IncrPgmSave, NULL,
+                                   NULL, IncrPgmLoad, NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3Register incremental -> %Rrc\n", rc);
+        return 1;
+    }
+
+    /*
+     * Save the chain, each file relative to the previous one.
+     */
+    for (unsigned i = 0; i < RT_ELEMENTS(s_apszFiles); i++)
+    {
+        g_uIncrLayer = i + 1;
+        rc = SSMR3Save(pVM, s_apszFiles[i], i ? s_apszFiles[i - 1] : NULL, NULL, NULL, SSMAFTER_DESTROY, NULL, NULL);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("SSMR3Save '%s' -> %Rrc\n", s_apszFiles[i], rc);
+            return 1;
+        }
+    }
+
+    /*
+     * Load the top, which loads the bases first.
+     */
+    if (tstSSMIncrementalLoad(pVM, s_apszFiles[RT_ELEMENTS(s_apszFiles) - 1], RT_ELEMENTS(s_apszFiles)))
+        return 1;
+
+    /*
+     * Flatten it and check that the result loads the same way without the
+     * bases around.
+     */
+    rc = SSMR3Flatten(s_apszFiles[RT_ELEMENTS(s_apszFiles) - 1], pszFlatFilename);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3Flatten -> %Rrc\n", rc);
+        return 1;
+    }
+    rc = SSMR3ValidateFile(pszFlatFilename, true /* fChecksumIt */);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3ValidateFile flattened -> %Rrc\n", rc);
+        return 1;
+    }
+    for (unsigned i = 0; i < RT_ELEMENTS(s_apszFiles); i++)
+        RTFileDelete(s_apszFiles[i]);
+    if (tstSSMIncrementalLoad(pVM, pszFlatFilename, RT_ELEMENTS(s_apszFiles)))
+        return 1;
+    RTFileDelete(pszFlatFilename);
+
+    SSMR3DeregisterInternal(pVM, "pgm");
+    SSMR3DeregisterInternal(pVM, "cpum");
+    return 0;
+}
+
+
+/** Number of pages the lazy restore test unit saves. */
+#define TSTSSM_LAZY_PAGES   12
+
+/**
+ * A page of the lazy restore test unit.
+ */
+typedef struct TSTSSMLAZYPAGE
+{
+    /** The file offset returned by SSMR3SkipPageDeferred. */
+    uint64_t        offPage;
+    /** Set if the page was saved as a zero record. */
+    bool            fZero;
+    /** Set while the page still has to be read. */
+    bool            fPending;
+} TSTSSMLAZYPAGE;
+
+/** The pages deferred by the lazy restore test unit. */
+static TSTSSMLAZYPAGE   g_aLazyPages[TSTSSM_LAZY_PAGES];
+/** The page reader opened by the lazy restore test unit. */
+static PSSMPAGEREADER   g_pLazyReader;
+
+
+/**
+ * Fills a page of the lazy restore test unit.
+ *
+ * The pages cycle thru random data, which is saved as a raw record, text,
+ * which is LZF compressed, and zeros.
+ */
+static void tstSSMLazyFillPage(uint32_t iPage, uint8_t *pbPage, size_t cbPage)
+{
+    switch (iPage % 3)
+    {
+        case 0:
+        {
+            uint32_t u32 = iPage * UINT32_C(0x9e3779b9) + 1;
+            for (size_t i = 0; i < cbPage; i++)
+            {
+                u32 ^= u32 << 13;
+                u32 ^= u32 >> 17;
+                u32 ^= u32 << 5;
+                pbPage[i] = (uint8_t)(u32 >> 24);
+            }
+            break;
+        }
+
+        case 1:
+            for (size_t i = 0; i < cbPage; i += 16)
+            {
+                char szTmp[17];
+                RTStrPrintf(szTmp, sizeof(szTmp), "lazy%08Xpage", iPage * PAGE_SIZE + (uint32_t)i);
+                memcpy(&pbPage[i], szTmp, 16);
+            }
+            break;
+
+        default:
+            memset(pbPage, 0, cbPage);
+            break;
+    }
+}
+
+
+/**
+ * Saves the lazy restore test unit, each page preceded by its number, and a
+ * half page at the end.
+ */
+static DECLCALLBACK(int) LazySave(PVM pVM, PSSMHANDLE pSSM)
+{
+    NOREF(pVM);
+
+    /* Only aligned pages are checked for being zero. */
+    uint8_t *pbPage = (uint8_t *)RTMemPageAlloc(PAGE_SIZE);
+    if (!pbPage)
+        return VERR_NO_MEMORY;
+
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < TSTSSM_LAZY_PAGES && RT_SUCCESS(rc); i++)
+    {
+        tstSSMLazyFillPage(i, pbPage, PAGE_SIZE);
+        SSMR3PutU32(pSSM, i);
+        rc = SSMR3PutMem(pSSM, pbPage, PAGE_SIZE);
+    }
+    if (RT_SUCCESS(rc))
+    {
+        tstSSMLazyFillPage(1, pbPage, PAGE_SIZE / 2);
+        rc = SSMR3PutMem(pSSM, pbPage, PAGE_SIZE / 2);
+    }
+    RTMemPageFree(pbPage, PAGE_SIZE);
+    return rc;
+}
+
+
+/**
+ * Loads the lazy restore test unit, deferring the pages.
+ *
+ * The half page can't be deferred and must be readable the normal way after
+ * SSMR3SkipPageDeferred refused it.
+ */
+static DECLCALLBACK(int) LazyLoad(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    NOREF(pVM); NOREF(uVersion); NOREF(uPass);
+    int rc = SSMR3PageReaderOpen(pSSM, &g_pLazyReader);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("LazyLoad: SSMR3PageReaderOpen -> %Rrc\n", rc);
+        return rc;
+    }
+
+    for (uint32_t i = 0; i < TSTSSM_LAZY_PAGES; i++)
+    {
+        uint32_t iPage;
+        rc = SSMR3GetU32(pSSM, &iPage);
+        if (RT_SUCCESS(rc) && iPage != i)
+            rc = VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+        if (RT_SUCCESS(rc))
+            rc = SSMR3SkipPageDeferred(pSSM, &g_aLazyPages[i].offPage, &g_aLazyPages[i].fZero);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("LazyLoad: deferring page %u -> %Rrc\n", i, rc);
+            return rc;
+        }
+        g_aLazyPages[i].fPending = !g_aLazyPages[i].fZero;
+    }
+
+    uint64_t offPage;
+    bool     fZero;
+    rc = SSMR3SkipPageDeferred(pSSM, &offPage, &fZero);
+    if (rc != VERR_NOT_SUPPORTED)
+    {
+        RTPrintf("LazyLoad: deferring the half page -> %Rrc, expected VERR_NOT_SUPPORTED\n", rc);
+        return RT_FAILURE(rc) ? rc : VERR_GENERAL_FAILURE;
+    }
+
+    uint8_t abPage[PAGE_SIZE / 2];
+    uint8_t abCmp[PAGE_SIZE / 2];
+    rc = SSMR3GetMem(pSSM, abPage, sizeof(abPage));
+    if (RT_FAILURE(rc))
+        return rc;
+    tstSSMLazyFillPage(1, abCmp, sizeof(abCmp));
+    if (memcmp(abPage, abCmp, sizeof(abPage)))
+    {
+        RTPrintf("LazyLoad: half page mismatch\n");
+        return VERR_GENERAL_FAILURE;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads the pending pages of the lazy restore test unit, leaving the ones
+ * which could not be read pending like PGM does.
+ *
+ * @returns 0 on success, 1 if a page was read with the wrong content.
+ * @param   pcPending       Where to return the number of pages left pending.
+ */
+static int tstSSMLazyRestore(uint32_t *pcPending)
+{
+    *pcPending = 0;
+    for (uint32_t i = 0; i < TSTSSM_LAZY_PAGES; i++)
+    {
+        if (!g_aLazyPages[i].fPending)
+            continue;
+
+        uint8_t abPage[PAGE_SIZE];
+        uint8_t abCmp[PAGE_SIZE];
+        int rc = SSMR3PageReaderRead(g_pLazyReader, g_aLazyPages[i].offPage, abPage);
+        if (RT_FAILURE(rc))
+        {
+            (*pcPending)++;
+            continue;
+        }
+        tstSSMLazyFillPage(i, abCmp, sizeof(abCmp));
+        if (memcmp(abPage, abCmp, sizeof(abPage)))
+        {
+            RTPrintf("tstSSM: lazy page %u read from %#llx has the wrong content\n", i, g_aLazyPages[i].offPage);
+            return 1;
+        }
+        g_aLazyPages[i].fPending = false;
+    }
+    return 0;
+}
+
+
+/**
+ * Saves pages, defers them when loading and reads them back thru the page
+ * reader.
+ *
+ * @returns 0 on success, 1 on failure.
+ * @param   pVM             The fake VM.
+ */
+static int tstSSMLazy(PVM pVM)
+{
+    const char *pszFilename = "SSMTestSave#Lazy";
+
+    int rc = SSMR3RegisterInternal(pVM, "lazy", 0, 1, PAGE_SIZE * TSTSSM_LAZY_PAGES,
+                                   NULL, NULL, NULL,
+                                   NULL, LazySave, NULL,
+                                   NULL, LazyLoad, NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3Register lazy -> %Rrc\n", rc);
+        return 1;
+    }
+    rc = SSMR3Save(pVM, pszFilename, NULL, NULL, NULL, SSMAFTER_DESTROY, NULL, NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3Save lazy -> %Rrc\n", rc);
+        return 1;
+    }
+
+    RT_ZERO(g_aLazyPages);
+    rc = SSMR3Load(pVM, pszFilename, NULL /*pStreamOps*/, NULL /*pStreamOpsUser*/,
+                   SSMAFTER_RESUME, NULL /*pfnProgress*/, NULL /*pvProgressUser*/);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3Load lazy -> %Rrc\n", rc);
+        SSMR3PageReaderClose(g_pLazyReader);
+        return 1;
+    }
+
+    /*
+     * Check that all three kinds of page records were deferred.  The record
+     * type is in the low nibble of the first byte (SSM_REC_TYPE_RAW is 2,
+     * SSM_REC_TYPE_RAW_LZF 3).
+     */
+    RTFILE hFile;
+    rc = RTFileOpen(&hFile, pszFilename, RTFILE_O_READWRITE | RTFILE_O_OPEN | RTFILE_O_DENY_NONE);
+    bool const fWritable = RT_SUCCESS(rc);
+    if (!fWritable)
+        rc = RTFileOpen(&hFile, pszFilename, RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_NONE);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstSSM: opening '%s' -> %Rrc\n", pszFilename, rc);
+        SSMR3PageReaderClose(g_pLazyReader);
+        return 1;
+    }
+
+    static const uint8_t s_abRecType[3] = { 2, 3, 0 };
+    uint32_t iLastPage = 0;
+    for (uint32_t i = 0; i < TSTSSM_LAZY_PAGES && RT_SUCCESS(rc); i++)
+    {
+        uint8_t bType = 0;
+        if (!g_aLazyPages[i].fZero)
+        {
+            rc = RTFileReadAt(hFile, g_aLazyPages[i].offPage, &bType, 1, NULL);
+            bType &= 0x0f;
+            iLastPage = i;
+        }
+        if (RT_SUCCESS(rc) && bType != s_abRecType[i % 3])
+        {
+            RTPrintf("tstSSM: lazy page %u has record type %u, expected %u\n", i, bType, s_abRecType[i % 3]);
+            rc = VERR_SSM_BAD_REC_TYPE;
+        }
+    }
+
+    /*
+     * Read them, failing on the last page first by cutting the file short in
+     * the middle of its record.
+     */
+    uint32_t cPending = 0;
+    if (RT_SUCCESS(rc) && fWritable)
+    {
+        uint64_t const offCut = g_aLazyPages[iLastPage].offPage + 2;
+        uint64_t       cbFile = 0;
+        uint8_t       *pbTail = NULL;
+        rc = RTFileGetSize(hFile, &cbFile);
+        if (RT_SUCCESS(rc))
+        {
+            pbTail = (uint8_t *)RTMemAlloc(cbFile - offCut);
+            if (!pbTail)
+                rc = VERR_NO_MEMORY;
+        }
+        if (RT_SUCCESS(rc))
+            rc = RTFileReadAt(hFile, offCut, pbTail, cbFile - offCut, NULL);
+        if (RT_SUCCESS(rc))
+            rc = RTFileSetSize(hFile, offCut);
+        if (RT_SUCCESS(rc))
+        {
+            if (tstSSMLazyRestore(&cPending))
+                rc = VERR_GENERAL_FAILURE;
+            else if (cPending != 1 || !g_aLazyPages[iLastPage].fPending)
+            {
+                RTPrintf("tstSSM: %u lazy pages pending after a failed read, expected only page %u\n",
+                         cPending, iLastPage);
+                rc = VERR_GENERAL_FAILURE;
+            }
+            int rc2 = RTFileWriteAt(hFile, offCut, pbTail, cbFile - offCut, NULL);
+            if (RT_SUCCESS(rc))
+                rc = rc2;
+        }
+        RTMemFree(pbTail);
+    }
+    else if (RT_SUCCESS(rc))
+        RTPrintf("tstSSM: the saved state can't be written while the page reader is open, skipping the read failure\n");
+    RTFileClose(hFile);
+
+    if (RT_SUCCESS(rc) && tstSSMLazyRestore(&cPending))
+        rc = VERR_GENERAL_FAILURE;
+    if (RT_SUCCESS(rc) && cPending)
+    {
+        RTPrintf("tstSSM: %u lazy pages still pending\n", cPending);
+        rc = VERR_GENERAL_FAILURE;
+    }
+
+    SSMR3PageReaderClose(g_pLazyReader);
+    g_pLazyReader = NULL;
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstSSM: lazy restore -> %Rrc\n", rc);
+        return 1;
+    }
+
+    RTFileDelete(pszFilename);
+    SSMR3DeregisterInternal(pVM, "lazy");
+    return 0;
+}
+
+
 int main(int argc, char **argv)
 {
     /*
@@ -753,7 +1308,7 @@ int main(int argc, char **argv)
      * Attempt a save.
      */
     uint64_t u64Start = RTTimeNanoTS();
-    rc = SSMR3Save(pVM, pszFilename, NULL, NULL, SSMAFTER_DESTROY, NULL, NULL);
+    rc = SSMR3Save(pVM, pszFilename, NULL, NULL, NULL, SSMAFTER_DESTROY, NULL, NULL);
     if (RT_FAILURE(rc))
     {
         RTPrintf("SSMR3Save #1 -> %Rrc\n", rc);
@@ -912,6 +1467,29 @@ int main(int argc, char **argv)
     /* delete */
     RTFileDelete(pszFilename);
 
+    /*
+     * Save it again using the compression threads.
+     */
+    if (tstSSMCompressionThreads(pVM, pszFilename))
+        return 1;
+    RTFileDelete(pszFilename);
+
+    /*
+     * Incremental saved states, without the big units.
+     */
+    SSMR3DeregisterInternal(pVM, "SSM Testcase Data Item no.1 (all types)");
+    SSMR3DeregisterInternal(pVM, "SSM Testcase Data Item no.2 (rand mem)");
+    SSMR3DeregisterInternal(pVM, "SSM Testcase Data Item no.3 (big mem)");
+    SSMR3DeregisterInternal(pVM, "SSM Testcase Data Item no.4 (big zero mem)");
+    if (tstSSMIncremental(pVM))
+        return 1;
+
+    /*
+     * Lazy restore of pages.
+     */
+    if (tstSSMLazy(pVM))
+        return 1;
+
     RTPrintf("tstSSM: SUCCESS\n");
     return 0;
 }
@@ -0,0 +1,148 @@
+/* $Id$ */
+/** @file
+ * VBoxSavedState - Inspects and flattens incremental saved states.
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/ssm.h>
+#include <VBox/err.h>
+#include <VBox/version.h>
+
+#include <iprt/buildconfig.h>
+#include <iprt/getopt.h>
+#include <iprt/initterm.h>
+#include <iprt/message.h>
+#include <iprt/path.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+
+
+/**
+ * Shows the usage.
+ *
+ * @returns RTEXITCODE_SUCCESS.
+ */
+static RTEXITCODE ShowUsage(void)
+{
+    RTPrintf(VBOX_PRODUCT " Saved State Tool Version " VBOX_VERSION_STRING "\n"
+             "(C) 2005-" VBOX_C_YEAR " " VBOX_VENDOR "\n"
+             "All rights reserved.\n"
+             "\n"
+             "Usage: VBoxSavedState [-hV] info <file>\n"
+             "       VBoxSavedState [-hV] flatten <incremental-file> <output-file>\n"
+             "\n"
+             "The info command lists the base files an incremental saved state depends on,\n"
+             "the flatten command writes a saved state that loads without them.\n");
+    return RTEXITCODE_SUCCESS;
+}
+
+
+/**
+ * Lists a saved state and the chain of base files it depends on.
+ *
+ * @returns Exit code.
+ * @param   pszFilename         The saved state.
+ */
+static RTEXITCODE ShowInfo(const char *pszFilename)
+{
+    char *pszCur = RTStrDup(pszFilename);
+    for (unsigned iLayer = 0; pszCur; iLayer++)
+    {
+        /* Same limit as when loading, this also stops on files referencing each other. */
+        if (iLayer >= SSM_MAX_BASE_DEPTH)
+        {
+            RTMsgError("Too many incremental saved states on top of each other, stopping at '%s'", pszCur);
+            RTStrFree(pszCur);
+            return RTEXITCODE_FAILURE;
+        }
+
+        PSSMHANDLE pSSM;
+        int rc = SSMR3Open(pszCur, 0 /*fFlags*/, &pSSM);
+        if (RT_FAILURE(rc))
+        {
+            RTMsgError("Failed to open '%s': %Rrc", pszCur, rc);
+            RTStrFree(pszCur);
+            return RTEXITCODE_FAILURE;
+        }
+
+        RTPrintf("%*s%s: %s saved state by version %u (r%u)\n", iLayer * 2, "", pszCur,
+                 SSMR3HandleIsLiveSave(pSSM) ? "live" : "normal",
+                 SSMR3HandleVersion(pSSM), SSMR3HandleRevision(pSSM));
+        RTStrFree(pszCur);
+        pszCur = NULL;
+        const char *pszBase = SSMR3HandleBaseFilename(pSSM);
+        if (pszBase)
+            pszCur = RTStrDup(pszBase);
+        SSMR3Close(pSSM);
+    }
+    return RTEXITCODE_SUCCESS;
+}
+
+
+/**
+ * Main entry point.
+ */
+int main(int argc, char **argv)
+{
+    int rc = RTR3InitExe(argc, &argv, 0);
+    if (RT_FAILURE(rc))
+        return RTMsgInitFailure(rc);
+
+    const char     *apszArgs[3];
+    unsigned        cArgs = 0;
+    int             ch;
+    RTGETOPTUNION   ValueUnion;
+    RTGETOPTSTATE   GetState;
+    RTGetOptInit(&GetState, argc, argv, NULL, 0, 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &ValueUnion)))
+    {
+        switch (ch)
+        {
+            case VINF_GETOPT_NOT_OPTION:
+                if (cArgs >= RT_ELEMENTS(apszArgs))
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "Too many arguments: '%s'", ValueUnion.psz);
+                apszArgs[cArgs++] = ValueUnion.psz;
+                break;
+
+            case 'h':
+                return ShowUsage();
+
+            case 'V':
+                RTPrintf("%sr%s\n", RTBldCfgVersion(), RTBldCfgRevisionStr());
+                return RTEXITCODE_SUCCESS;
+
+            default:
+                return RTGetOptPrintError(ch, &ValueUnion);
+        }
+    }
+
+    if (cArgs == 2 && !strcmp(apszArgs[0], "info"))
+        return ShowInfo(apszArgs[1]);
+
+    if (cArgs == 3 && !strcmp(apszArgs[0], "flatten"))
+    {
+        rc = SSMR3Flatten(apszArgs[1], apszArgs[2]);
+        if (RT_FAILURE(rc))
+            return RTMsgErrorExit(RTEXITCODE_FAILURE, "Flattening '%s' into '%s' failed: %Rrc", apszArgs[1], apszArgs[2], rc);
+        RTMsgInfo("Wrote '%s'\n", apszArgs[2]);
+        return RTEXITCODE_SUCCESS;
+    }
+
+    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "Expected 'info <file>' or 'flatten <file> <output-file>', try --help");
+}
+